@@ -0,0 +1,16 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+
+namespace CacheConfig {
+  // GetMountSourceIndexRの結果をキャッシュするエントリ数の上限（0で無効）
+  constexpr std::size_t SourceIndexCacheCapacity = 16384;
+  // 下位ソースはMergeFSの外から変更され得るため、エントリは一定時間で失効させる（0で無期限）
+  constexpr std::chrono::milliseconds SourceIndexCacheTTL{2000};
+  // FindFilesのマージ結果をキャッシュするメモリ量の上限（バイト、0で無効）
+  constexpr std::size_t FindFilesCacheCapacity = 32 * 1024 * 1024;
+  // 同上、下位ソースの変更に追従するためのエントリの寿命（0で無期限）
+  constexpr std::chrono::milliseconds FindFilesCacheTTL{2000};
+}
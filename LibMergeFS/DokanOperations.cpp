@@ -67,12 +67,8 @@ namespace {
 
 
   NTSTATUS DOKAN_CALLBACK DFindFilesWithPattern(LPCWSTR PathName, LPCWSTR SearchPattern, PFillFindData FillFindData, PDOKAN_FILE_INFO DokanFileInfo) {
-    /*
     auto& mount = GetMountFromFileInfo(DokanFileInfo);
     return mount.DFindFilesWithPattern(PathName, SearchPattern, FillFindData, DokanFileInfo);
-    /*/
-    return STATUS_NOT_IMPLEMENTED;
-    //*/
   }
 
 
@@ -191,7 +187,7 @@ const DOKAN_OPERATIONS gDokanOperations = {
   DFlushFileBuffers,
   DGetFileInformation,
   DFindFiles,
-  nullptr,  //DFindFilesWithPattern,
+  DFindFilesWithPattern,
   DSetFileAttributes,
   DSetFileTime,
   DDeleteFile,
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+
+
+// DokanFileInfo->Contextに格納するハンドルとオブジェクトを対応付けるテーブル
+// ハンドルはスロット番号と世代からなり、解放済みのハンドルで参照しても（スロットが再利用されていても）nullptrが返る
+// スロットは複数のシャードに分割されており、それぞれが独立したロックを持つ
+template<typename T, std::size_t ShardCount = 64>
+class FileContextTable {
+  static_assert(ShardCount != 0 && (ShardCount & (ShardCount - 1)) == 0, "ShardCount must be a power of 2");
+
+public:
+  using Handle = std::uint64_t;
+
+  static constexpr Handle NullHandle = 0;
+
+private:
+  struct Slot {
+    std::uint32_t generation;
+    std::shared_ptr<T> ptr;
+  };
+
+  // 偽共有を避けるためシャードごとにキャッシュラインを分ける
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mutex;
+    std::vector<Slot> slots;
+    std::vector<std::uint32_t> freeSlots;
+  };
+
+  std::array<Shard, ShardCount> mShards;
+  std::atomic<std::uint32_t> mNextShard;
+
+  // 下位32ビットは (スロット番号 * ShardCount + シャード番号 + 1)、上位32ビットは世代
+  static constexpr Handle MakeHandle(std::size_t shardIndex, std::uint32_t slotIndex, std::uint32_t generation) {
+    return (static_cast<Handle>(generation) << 32) | (static_cast<Handle>(slotIndex) * ShardCount + shardIndex + 1);
+  }
+
+  static constexpr bool DecodeHandle(Handle handle, std::size_t& shardIndex, std::uint32_t& slotIndex, std::uint32_t& generation) {
+    const auto index = handle & 0xFFFFFFFF;
+    if (index == 0) {
+      return false;
+    }
+    shardIndex = static_cast<std::size_t>((index - 1) % ShardCount);
+    slotIndex = static_cast<std::uint32_t>((index - 1) / ShardCount);
+    generation = static_cast<std::uint32_t>(handle >> 32);
+    return true;
+  }
+
+public:
+  FileContextTable() :
+    mShards(),
+    mNextShard(0)
+  {}
+
+  FileContextTable(const FileContextTable&) = delete;
+  FileContextTable& operator=(const FileContextTable&) = delete;
+
+  Handle Insert(std::shared_ptr<T> ptr) {
+    const std::size_t shardIndex = mNextShard.fetch_add(1, std::memory_order_relaxed) % ShardCount;
+    auto& shard = mShards[shardIndex];
+
+    std::lock_guard lock(shard.mutex);
+
+    std::uint32_t slotIndex;
+    if (!shard.freeSlots.empty()) {
+      slotIndex = shard.freeSlots.back();
+      shard.freeSlots.pop_back();
+    } else {
+      slotIndex = static_cast<std::uint32_t>(shard.slots.size());
+      shard.slots.push_back(Slot{
+        1,
+        nullptr,
+      });
+    }
+
+    auto& slot = shard.slots[slotIndex];
+    slot.ptr = std::move(ptr);
+
+    return MakeHandle(shardIndex, slotIndex, slot.generation);
+  }
+
+  std::shared_ptr<T> Get(Handle handle) const {
+    std::size_t shardIndex;
+    std::uint32_t slotIndex;
+    std::uint32_t generation;
+    if (!DecodeHandle(handle, shardIndex, slotIndex, generation)) {
+      return nullptr;
+    }
+
+    const auto& shard = mShards[shardIndex];
+
+    std::shared_lock lock(shard.mutex);
+
+    if (slotIndex >= shard.slots.size()) {
+      return nullptr;
+    }
+    const auto& slot = shard.slots[slotIndex];
+    if (slot.generation != generation) {
+      return nullptr;
+    }
+    return slot.ptr;
+  }
+
+  // 取り除いたオブジェクトを返す（ハンドルが無効な場合はnullptr）
+  std::shared_ptr<T> Remove(Handle handle) {
+    std::size_t shardIndex;
+    std::uint32_t slotIndex;
+    std::uint32_t generation;
+    if (!DecodeHandle(handle, shardIndex, slotIndex, generation)) {
+      return nullptr;
+    }
+
+    auto& shard = mShards[shardIndex];
+
+    std::lock_guard lock(shard.mutex);
+
+    if (slotIndex >= shard.slots.size()) {
+      return nullptr;
+    }
+    auto& slot = shard.slots[slotIndex];
+    if (slot.generation != generation || !slot.ptr) {
+      return nullptr;
+    }
+
+    auto ptr = std::move(slot.ptr);
+    slot.ptr = nullptr;
+    // 世代を進めることで古いハンドルを無効にする
+    slot.generation++;
+    shard.freeSlots.push_back(slotIndex);
+    return ptr;
+  }
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+
+
+// 定数時間で確保・解放を行うIDアロケータ
+// 解放されたIDはFIFOのフリーリストに入り、その後reuseDelay回以上の解放が行われるまでは再利用されない
+// これにより、解放直後のIDを古い参照が使い続けた場合に別のオブジェクトを指してしまうこと（ABA問題）を起きにくくする
+// 使用中かどうかはビットマップで管理しており、二重解放や未確保のIDの解放は無視される
+template<typename T>
+class IdAllocator {
+  static_assert(std::is_unsigned_v<T>);
+
+  mutable std::mutex mMutex;
+  const T mStart;
+  const std::size_t mReuseDelay;
+  T mNext;
+  std::deque<T> mFreeIds;
+  std::vector<bool> mUsedBitmap;
+
+public:
+  // startより小さい値（NULL値など）は割り当てない
+  IdAllocator(T start, std::size_t reuseDelay) :
+    mMutex(),
+    mStart(start),
+    mReuseDelay(reuseDelay),
+    mNext(start),
+    mFreeIds(),
+    mUsedBitmap()
+  {}
+
+  IdAllocator(const IdAllocator&) = delete;
+  IdAllocator& operator=(const IdAllocator&) = delete;
+
+  T Allocate() {
+    std::lock_guard lock(mMutex);
+
+    T id;
+    if (mFreeIds.size() > mReuseDelay) {
+      id = mFreeIds.front();
+      mFreeIds.pop_front();
+    } else {
+      if (mNext == std::numeric_limits<T>::max()) {
+        // 新たなIDを使い切ったので、遅延を諦めて再利用する
+        if (mFreeIds.empty()) {
+          throw std::length_error("no ID available");
+        }
+        id = mFreeIds.front();
+        mFreeIds.pop_front();
+      } else {
+        id = mNext++;
+        mUsedBitmap.push_back(false);
+      }
+    }
+
+    mUsedBitmap[static_cast<std::size_t>(id - mStart)] = true;
+    return id;
+  }
+
+  bool Release(T id) {
+    if (id < mStart) {
+      return false;
+    }
+
+    std::lock_guard lock(mMutex);
+
+    const auto index = static_cast<std::size_t>(id - mStart);
+    if (index >= mUsedBitmap.size() || !mUsedBitmap[index]) {
+      return false;
+    }
+
+    mUsedBitmap[index] = false;
+    mFreeIds.push_back(id);
+    return true;
+  }
+
+  bool IsAllocated(T id) const {
+    if (id < mStart) {
+      return false;
+    }
+
+    std::lock_guard lock(mMutex);
+
+    const auto index = static_cast<std::size_t>(id - mStart);
+    return index < mUsedBitmap.size() && mUsedBitmap[index];
+  }
+};
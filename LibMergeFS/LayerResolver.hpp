@@ -0,0 +1,110 @@
+#pragma once
+
+#include "PathCache.hpp"
+#include "Util.hpp"
+
+#include "../Util/VirtualFs.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+
+// 解決済みのパス（RenameStoreを通したもの）について、オブジェクトが存在する一番上位のソースとその種類を調べ、結果をキャッシュする
+// ソースやメタデータを変更した場合は、その変更を行った後でInvalidateを呼び出さなければならない
+// （変更前に無効化すると、変更が完了するまでの間に行われた問い合わせによって古い結果が再びキャッシュされてしまう）
+// TMountSourceはFileType型（Inexistent, Directoryを含む）とGetFileType(LPCWSTR)を持つ必要がある
+template<typename TMountSource>
+class LayerResolver {
+public:
+  using FileType = typename TMountSource::FileType;
+
+  struct Result {
+    std::optional<std::size_t> sourceIndex;
+    FileType fileType;
+  };
+
+  // メタデータにより削除済みとマークされていなければtrueを返す
+  using ExistsFunction = std::function<bool(std::wstring_view resolvedFilename)>;
+
+  static constexpr std::size_t TopSourceIndex = 0;
+
+private:
+  const std::vector<std::unique_ptr<TMountSource>>& mMountSources;
+  const bool mCaseSensitive;
+  const ExistsFunction mExistsFunction;
+  PathCache<Result> mCache;
+
+  Result LookupUncached(std::wstring_view resolvedFilename) {
+    // 祖先ディレクトリの正当性を確認する
+    // 祖先ディレクトリがここより優先度の高いソースにおいてファイルとして存在しているか、
+    // メタデータにより削除済みとマークされている場合は対象のオブジェクトは存在しない
+    // ここでは直属の親ディレクトリに対してLookupを呼び出して確認することで再帰的にチェックしている
+    const auto parent = Lookup(util::vfs::GetParentPath(resolvedFilename));
+    if (!parent.sourceIndex || parent.fileType != FileType::Directory) {
+      return {std::nullopt, FileType::Inexistent};
+    }
+
+    // メタデータにより削除済みとマークされている場合は存在しない
+    if (mExistsFunction && !mExistsFunction(resolvedFilename)) {
+      return {std::nullopt, FileType::Inexistent};
+    }
+
+    // それ以外の場合、一番上位のソースに存在するものを探す
+    const std::wstring sResolvedFilename(resolvedFilename);
+    for (std::size_t i = 0; i < mMountSources.size(); i++) {
+      const auto& mountSource = *mMountSources[i];
+      if (const auto fileType = mountSource.GetFileType(sResolvedFilename.c_str()); fileType != FileType::Inexistent) {
+        return {i, fileType};
+      }
+    }
+
+    // 見つからなかった
+    return {std::nullopt, FileType::Inexistent};
+  }
+
+public:
+  LayerResolver(const std::vector<std::unique_ptr<TMountSource>>& mountSources, bool caseSensitive, ExistsFunction existsFunction, std::size_t cacheCapacity, std::chrono::milliseconds cacheTTL) :
+    mMountSources(mountSources),
+    mCaseSensitive(caseSensitive),
+    mExistsFunction(std::move(existsFunction)),
+    mCache(cacheCapacity, cacheTTL)
+  {}
+
+  LayerResolver(const LayerResolver&) = delete;
+  LayerResolver& operator=(const LayerResolver&) = delete;
+
+  Result Lookup(std::wstring_view resolvedFilename) {
+    if (util::vfs::IsRootDirectory(resolvedFilename)) {
+      return {TopSourceIndex, FileType::Directory};
+    }
+
+    // 存在しないという結果もキャッシュする
+    const auto key = FilenameToKey(resolvedFilename, mCaseSensitive);
+    if (const auto cachedResult = mCache.Get(key)) {
+      return cachedResult.value();
+    }
+
+    // 世代は問い合わせの前に取得しておく（問い合わせ中に無効化された場合は格納されない）
+    const auto generation = mCache.GetGeneration();
+    const auto result = LookupUncached(resolvedFilename);
+    mCache.Put(key, result, generation);
+    return result;
+  }
+
+  // resolvedFilenameとその子孫の結果を無効化する
+  void Invalidate(std::wstring_view resolvedFilename) {
+    mCache.Invalidate(FilenameToKey(resolvedFilename, mCaseSensitive));
+  }
+
+  PathCacheStatistics GetStatistics() const {
+    return mCache.GetStatistics();
+  }
+};
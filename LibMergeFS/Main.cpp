@@ -13,6 +13,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <ios>
@@ -376,7 +377,31 @@ namespace Exports {
         volumeInfoOverride.TotalNumberOfFreeBytes.emplace(mountInitializeInfo->volumeInfoOverride.TotalNumberOfFreeBytes);
       }
 
-      const auto mountId = mountStore.Mount(mountInitializeInfo->mountPoint, mountInitializeInfo->writable, mountInitializeInfo->metadataFileName, mountInitializeInfo->deferCopyEnabled, mountInitializeInfo->caseSensitive, volumeInfoOverride, sources, [callback](MOUNT_ID mountId, const MOUNT_INFO* ptrMountInfo, int dokanMainResult) {
+      MetadataOptions metadataOptions{};
+      switch (mountInitializeInfo->metadataDurability) {
+        case MERGEFS_METADATA_DURABILITY_DEFAULT:
+          break;
+
+        case MERGEFS_METADATA_DURABILITY_PEROPERATION:
+          metadataOptions.durability = MetadataStore::Durability::PerOperation;
+          break;
+
+        case MERGEFS_METADATA_DURABILITY_BATCHED:
+          metadataOptions.durability = MetadataStore::Durability::Batched;
+          break;
+
+        case MERGEFS_METADATA_DURABILITY_ONFLUSH:
+          metadataOptions.durability = MetadataStore::Durability::OnFlush;
+          break;
+
+        default:
+          return MERGEFS_ERROR_INVALID_PARAMETER;
+      }
+      if (mountInitializeInfo->metadataCommitDelay != 0) {
+        metadataOptions.maxCommitDelay = std::chrono::milliseconds(mountInitializeInfo->metadataCommitDelay);
+      }
+
+      const auto mountId = mountStore.Mount(mountInitializeInfo->mountPoint, mountInitializeInfo->writable, mountInitializeInfo->metadataFileName, mountInitializeInfo->deferCopyEnabled, mountInitializeInfo->caseSensitive, volumeInfoOverride, metadataOptions, sources, [callback](MOUNT_ID mountId, const MOUNT_INFO* ptrMountInfo, int dokanMainResult) {
         callback(mountId, ptrMountInfo, dokanMainResult);
       });
 
@@ -446,6 +471,29 @@ namespace Exports {
   }
 
 
+  BOOL WINAPI LMF_GetMountCacheStatistics(MOUNT_ID mountId, MOUNT_CACHE_STATISTICS* outCacheStatistics) MFNOEXCEPT {
+    return WrapException([=]() {
+      std::shared_lock lock(gMutex);
+
+      if (!gMountStoreN) {
+        return MERGEFS_ERROR_NOT_INITIALIZED;
+      }
+
+      auto& mountStore = gMountStoreN.value();
+
+      if (!mountStore.HasMount(mountId)) {
+        return MERGEFS_ERROR_INVALID_MOUNT_ID;
+      }
+
+      if (outCacheStatistics) {
+        *outCacheStatistics = mountStore.GetMountCacheStatistics(mountId);
+      }
+
+      return MERGEFS_ERROR_SUCCESS;
+    });
+  }
+
+
   BOOL WINAPI LMF_SafeUnmount(MOUNT_ID mountId) MFNOEXCEPT {
     return WrapException([=]() -> DWORD {
       std::lock_guard lock(gMutex);
@@ -2,21 +2,30 @@
 #include "Metadata.hpp"
 #include "Util.hpp"
 #include "NsError.hpp"
+#include "MountConfig.hpp"
 
 #include "../Util/Common.hpp"
 
 #include <malloc.h>
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <new>
 #include <optional>
 #include <shared_mutex>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -29,6 +38,11 @@ namespace {
   const std::wstring StrRemovedPrefix(MetadataStore::RemovedPrefix);
   const std::wstring StrRemovedPrefixB(StrRemovedPrefix + L"\\"s);
 
+  constexpr auto TempFileSuffix = L".tmp";
+
+  // このスレッドで最も内側のMetadataStore::DeferredCommit
+  thread_local MetadataStore::DeferredCommit* gDeferredCommit = nullptr;
+
 
   template<typename T, std::size_t Alignment>
   auto make_unique_aligned(std::size_t size) {
@@ -44,6 +58,65 @@ namespace {
     }
     return std::unique_ptr<T[], aligned_deleter>(reinterpret_cast<T*>(ptr), aligned_deleter());
   }
+
+
+  // ファイル上の文字列はUTF-16のコード単位の列として格納する
+  // wchar_tが16ビットの環境ではそのままコピーし、そうでない環境（テスト用のビルド）ではコード単位ごとに変換する
+  constexpr bool IsWcharUTF16 = sizeof(wchar_t) == sizeof(char16_t);
+
+
+  std::wstring ReadUTF16(const std::byte* ptr, std::size_t count) {
+    if constexpr (IsWcharUTF16) {
+      const auto strPtr = reinterpret_cast<const wchar_t*>(ptr);
+      return std::wstring(strPtr, strPtr + count);
+    } else {
+      std::wstring str(count, L'\0');
+      for (std::size_t i = 0; i < count; i++) {
+        char16_t c;
+        std::memcpy(&c, ptr + i * sizeof(char16_t), sizeof(c));
+        str[i] = static_cast<wchar_t>(c);
+      }
+      return str;
+    }
+  }
+
+
+  // マップしている領域上の文字列を参照する（変換が必要な場合はstorageに保持する）
+  std::wstring_view ViewUTF16(const std::byte* ptr, std::size_t count, std::deque<std::wstring>& storage) {
+    if constexpr (IsWcharUTF16) {
+      return std::wstring_view(reinterpret_cast<const wchar_t*>(ptr), count);
+    } else {
+      return storage.emplace_back(ReadUTF16(ptr, count));
+    }
+  }
+
+
+  bool EqualsUTF16(const std::byte* ptr, std::wstring_view str) {
+    if constexpr (IsWcharUTF16) {
+      return std::wstring_view(reinterpret_cast<const wchar_t*>(ptr), str.size()) == str;
+    } else {
+      for (std::size_t i = 0; i < str.size(); i++) {
+        char16_t c;
+        std::memcpy(&c, ptr + i * sizeof(char16_t), sizeof(c));
+        if (static_cast<wchar_t>(c) != str[i]) {
+          return false;
+        }
+      }
+      return true;
+    }
+  }
+
+
+  void WriteUTF16(std::byte* ptr, std::wstring_view str) {
+    if constexpr (IsWcharUTF16) {
+      std::memcpy(ptr, str.data(), str.size() * sizeof(char16_t));
+    } else {
+      for (std::size_t i = 0; i < str.size(); i++) {
+        const auto c = static_cast<char16_t>(str[i]);
+        std::memcpy(ptr + i * sizeof(char16_t), &c, sizeof(c));
+      }
+    }
+  }
 }
 
 
@@ -96,8 +169,8 @@ namespace MetadataFileV2 {
 
   constexpr FILETIME ToFILETIME(std::uint64_t filetime) {
     return FILETIME{
-      filetime & 0xFFFFFFFF,
-      (filetime >> 32) & 0xFFFFFFFF,
+      static_cast<DWORD>(filetime & 0xFFFFFFFF),
+      static_cast<DWORD>((filetime >> 32) & 0xFFFFFFFF),
     };
   }
 
@@ -148,16 +221,12 @@ namespace MetadataFileV2 {
       checkPtr(nextPtr);
       ptr += sizeof(RenameEntryHeader);
 
-      static_assert(sizeof(wchar_t) == sizeof(char16_t));
-
       const auto alignedASize = Align(header.aSize * sizeof(char16_t));
-      auto aStrPtr = reinterpret_cast<const wchar_t*>(ptr);
-      const std::wstring a(aStrPtr, aStrPtr + header.aSize);
+      const auto a = ReadUTF16(ptr, header.aSize);
       ptr += alignedASize;
 
       const auto alignedBSize = Align(header.bSize * sizeof(char16_t));
-      auto bStrPtr = reinterpret_cast<const wchar_t*>(ptr);
-      const std::wstring b(bStrPtr, bStrPtr + header.bSize);
+      const auto b = ReadUTF16(ptr, header.bSize);
       ptr += alignedBSize;
 
       assert(ptr == nextPtr);
@@ -190,6 +259,71 @@ namespace MetadataFileV2 {
   };
   static_assert(sizeof(MetadataEntryHeader) == 16 * 3);
 
+  Metadata ToMetadata(const MetadataEntryHeader& header, std::string_view security) {
+    Metadata metadata;
+
+    if (header.flags & EntryFlags::HasAttributes) {
+      metadata.fileAttributes.emplace(header.attributes);
+    }
+    if (header.flags & EntryFlags::HasCreationTime) {
+      metadata.creationTime.emplace(ToFILETIME(header.creationTime));
+    }
+    if (header.flags & EntryFlags::HasLastAccessTime) {
+      metadata.lastAccessTime.emplace(ToFILETIME(header.lastAccessTime));
+    }
+    if (header.flags & EntryFlags::HasLastWriteTime) {
+      metadata.lastWriteTime.emplace(ToFILETIME(header.lastWriteTime));
+    }
+    if (header.flags & EntryFlags::HasSecurity) {
+      metadata.security.emplace(security);
+    }
+
+    return metadata;
+  }
+
+  std::size_t GetMetadataEntrySize(std::wstring_view keyName, const Metadata& metadata) {
+    return sizeof(MetadataEntryHeader) + Align(keyName.size() * sizeof(char16_t)) + Align(metadata.security ? metadata.security.value().size() : 0);
+  }
+
+  // ptrから始まる0埋めされた領域にエントリを書き込み、その直後のポインタを返す
+  std::byte* WriteMetadataEntry(std::byte* ptr, std::wstring_view keyName, const Metadata& metadata) {
+    const auto prevPtr = ptr;
+
+    std::uint32_t flags = 0;
+    if (metadata.fileAttributes) flags |= EntryFlags::HasAttributes;
+    if (metadata.creationTime)   flags |= EntryFlags::HasCreationTime;
+    if (metadata.lastAccessTime) flags |= EntryFlags::HasLastAccessTime;
+    if (metadata.lastWriteTime)  flags |= EntryFlags::HasLastWriteTime;
+    if (metadata.security)       flags |= EntryFlags::HasSecurity;
+
+    auto& entryHeader = *reinterpret_cast<MetadataEntryHeader*>(ptr);
+    ptr += sizeof(MetadataEntryHeader);
+    entryHeader = MetadataEntryHeader{
+      0,    // filled later
+      0,
+      static_cast<std::uint32_t>(keyName.size()),
+      metadata.security ? static_cast<std::uint32_t>(metadata.security.value().size()) : 0,
+      flags,
+      metadata.fileAttributes ? metadata.fileAttributes.value() : 0,
+      metadata.creationTime   ? ReadFILETIME(metadata.creationTime.value())   : 0,
+      metadata.lastAccessTime ? ReadFILETIME(metadata.lastAccessTime.value()) : 0,
+      metadata.lastWriteTime  ? ReadFILETIME(metadata.lastWriteTime.value())  : 0,
+    };
+
+    WriteUTF16(ptr, keyName);
+    ptr += Align(keyName.size() * sizeof(char16_t));
+
+    if (metadata.security) {
+      const auto& security = metadata.security.value();
+      std::memcpy(ptr, security.data(), security.size());
+      ptr += Align(security.size());
+    }
+
+    entryHeader.blockSize = static_cast<std::uint32_t>(ptr - prevPtr);
+
+    return ptr;
+  }
+
   struct MetadataEntry : MetadataEntryHeader {
     std::wstring filename;
     std::string security;
@@ -201,27 +335,7 @@ namespace MetadataFileV2 {
     {}
 
     operator Metadata() const {
-      using namespace MetadataFileV2;
-
-      Metadata metadata;
-
-      if (flags & EntryFlags::HasAttributes) {
-        metadata.fileAttributes.emplace(attributes);
-      }
-      if (flags & EntryFlags::HasCreationTime) {
-        metadata.creationTime.emplace(ToFILETIME(creationTime));
-      }
-      if (flags & EntryFlags::HasLastAccessTime) {
-        metadata.lastAccessTime.emplace(ToFILETIME(lastAccessTime));
-      }
-      if (flags & EntryFlags::HasLastWriteTime) {
-        metadata.lastWriteTime.emplace(ToFILETIME(lastWriteTime));
-      }
-      if (flags & EntryFlags::HasSecurity) {
-        metadata.security.emplace(security);
-      }
-
-      return metadata;
+      return ToMetadata(*this, security);
     }
 
     static MetadataEntry Parse(const std::byte* data, std::function<void(const std::byte * ptr)> checkPtr, std::size_t& size) {
@@ -233,11 +347,8 @@ namespace MetadataFileV2 {
       checkPtr(nextPtr);
       ptr += sizeof(MetadataEntryHeader);
 
-      static_assert(sizeof(wchar_t) == sizeof(char16_t));
-
       const auto alignedFilenameSize = Align(header.filenameSize * sizeof(char16_t));
-      auto filenameStrPtr = reinterpret_cast<const wchar_t*>(ptr);
-      const std::wstring filename(filenameStrPtr, filenameStrPtr + header.filenameSize);
+      const auto filename = ReadUTF16(ptr, header.filenameSize);
       ptr += alignedFilenameSize;
 
       const auto alignedSecuritySize = Align(header.securitySize);
@@ -268,6 +379,57 @@ namespace MetadataFileV2 {
 }
 
 
+namespace MetadataFileV3 {
+  // V2からヘッダにインデックス部が加わったのみで、各エントリおよび追記部の形式は同じ
+  using MetadataFileV2::Signature;
+  constexpr std::uint32_t Version = 0x00030000;
+
+  using MetadataFileV2::Alignment;
+  using MetadataFileV2::Align;
+  using MetadataFileV2::RenameEntryHeader;
+  using MetadataFileV2::RenameEntry;
+  using MetadataFileV2::MetadataEntryHeader;
+  using MetadataFileV2::GetMetadataEntrySize;
+  using MetadataFileV2::WriteMetadataEntry;
+
+  struct Header {
+    std::uint32_t signature;
+    std::uint32_t version;
+    std::uint64_t dataSize;
+    std::uint64_t renameSectionOffset;
+    std::uint64_t renameSectionSize;
+    std::uint64_t renameSectionCount;
+    std::uint64_t reserved1;
+    std::uint64_t metadataSectionOffset;
+    std::uint64_t metadataSectionSize;
+    std::uint64_t metadataSectionCount;
+    std::uint64_t reserved2;
+    std::uint64_t indexSectionOffset;
+    std::uint64_t indexSectionSize;
+    std::uint64_t indexSectionCount;
+    std::uint64_t reserved3;
+  };
+  static_assert(sizeof(Header) == 16 * 7);
+
+  // (hash, filename)の順に整列して格納する
+  struct IndexEntry {
+    std::uint32_t hash;
+    std::uint32_t filenameSize;
+    std::uint64_t metadataEntryOffset;
+  };
+  static_assert(sizeof(IndexEntry) == 16 * 1);
+
+  // ファイルに保存されるため、実装依存のstd::hashではなくFNV-1aを用いる
+  constexpr std::uint32_t HashKey(std::wstring_view key) {
+    std::uint32_t hash = 0x811C9DC5;
+    for (const auto c : key) {
+      hash = (hash ^ static_cast<std::uint16_t>(c)) * 0x01000193;
+    }
+    return hash;
+  }
+}
+
+
 static_assert(sizeof(DWORD) == 4);
 static_assert(sizeof(FILETIME) == sizeof(DWORD) * 2);
 
@@ -321,9 +483,8 @@ void MetadataStore::LoadFromFileV1() {
 
     const auto keyNameCount = *reinterpret_cast<const KeyNameCount*>(ptr);
     ptr += sizeof(keyNameCount);
-    const auto keyName = reinterpret_cast<const wchar_t*>(ptr);
-    ptr += keyNameCount * sizeof(wchar_t);
-    const std::wstring key(keyName, keyNameCount);
+    const auto key = ReadUTF16(reinterpret_cast<const std::byte*>(ptr), keyNameCount);
+    ptr += keyNameCount * sizeof(char16_t);
 
     if (entryFlag & EntryFlags::HasAttributes) {
       const auto fileAttributes = *reinterpret_cast<const DWORD*>(ptr);
@@ -353,7 +514,7 @@ void MetadataStore::LoadFromFileV1() {
       metadata.security = std::string(securityData, securityCount);
     }
 
-    mMetadataMap.emplace(key, metadata);
+    SetOverlayEntryL(key, metadata);
   }
 
   std::uint64_t renameCount;
@@ -372,25 +533,105 @@ void MetadataStore::LoadFromFileV1() {
       throw W32Error();
     }
 
-    const std::size_t renamedStrSize = renamedSize * sizeof(wchar_t);
-    auto renamedBuffer = std::make_unique<wchar_t[]>(renamedSize);
+    const std::size_t renamedStrSize = renamedSize * sizeof(char16_t);
+    auto renamedBuffer = std::make_unique<std::byte[]>(renamedStrSize);
     if (!ReadFile(mHFile, renamedBuffer.get(), static_cast<DWORD>(renamedStrSize), &read, NULL) || read != renamedStrSize) {
       throw W32Error();
     }
-    const std::wstring_view renamed(renamedBuffer.get(), renamedSize);
+    const auto renamed = ReadUTF16(renamedBuffer.get(), renamedSize);
 
-    const std::size_t originalStrSize = originalSize * sizeof(wchar_t);
-    auto originalBuffer = std::make_unique<wchar_t[]>(originalSize);
+    const std::size_t originalStrSize = originalSize * sizeof(char16_t);
+    auto originalBuffer = std::make_unique<std::byte[]>(originalStrSize);
     if (!ReadFile(mHFile, originalBuffer.get(), static_cast<DWORD>(originalStrSize), &read, NULL) || read != originalStrSize) {
       throw W32Error();
     }
-    const std::wstring_view original(originalBuffer.get(), originalSize);
+    const auto original = ReadUTF16(originalBuffer.get(), originalSize);
 
     mRenameStore.AddEntry(original, renamed);
   }
 }
 
 
+void MetadataStore::LoadRenameSection(const std::byte* begin, const std::byte* end, std::uint64_t count) {
+  using namespace MetadataFileV2;
+
+  auto checkPtr = [end] (const std::byte* ptr) {
+    if (ptr > end) {
+      throw W32Error(ERROR_BUFFER_OVERFLOW);
+    }
+  };
+
+  auto ptr = begin;
+  for (std::uint_fast64_t i = 0; i < count; i++) {
+    std::size_t size = 0;
+    const auto renameEntry = RenameEntry::Parse(ptr, checkPtr, size);
+    ptr += size;
+    if (renameEntry.bSize == 0 || renameEntry.a == renameEntry.b) {
+      continue;
+    }
+    mRenameStore.AddEntry(renameEntry.a, renameEntry.b);
+  }
+
+  assert(ptr == end);
+}
+
+
+void MetadataStore::LoadAppendix(const std::byte* begin, const std::byte* end) {
+  using namespace MetadataFileV2;
+
+  auto checkPtr = [end] (const std::byte* ptr) {
+    if (ptr > end) {
+      throw W32Error(ERROR_BUFFER_OVERFLOW);
+    }
+  };
+
+  auto ptr = begin;
+  while (ptr != end) {
+    checkPtr(ptr + sizeof(AppendixEntryHeader));
+    const auto& appendixEntry = *reinterpret_cast<const AppendixEntryHeader*>(ptr);
+    const auto nextPtr = ptr + appendixEntry.blockSize;
+    checkPtr(nextPtr);
+    ptr += sizeof(AppendixEntryHeader);
+
+    std::size_t size = 0;
+
+    switch (appendixEntry.dataType) {
+      case AppendixDataType::Rename:
+      {
+        const auto renameEntry = RenameEntry::Parse(ptr, checkPtr, size);
+        if (renameEntry.bSize != 0) {
+          mRenameStore.Rename(renameEntry.a, renameEntry.b);
+        } else {
+          mRenameStore.RemoveEntry(renameEntry.a);
+        }
+        break;
+      }
+
+      case AppendixDataType::Metadata:
+      {
+        const auto metadataEntry = MetadataEntry::Parse(ptr, checkPtr, size);
+        if (metadataEntry.flags != 0) {
+          SetOverlayEntryL(metadataEntry.filename, static_cast<Metadata>(metadataEntry));
+        } else {
+          SetOverlayEntryL(metadataEntry.filename, std::nullopt);
+        }
+        break;
+      }
+
+      default:
+        throw W32Error(ERROR_INVALID_PARAMETER);
+    }
+
+    ptr += size;
+    assert(ptr == nextPtr);
+
+    ptr = nextPtr;
+  }
+
+  mAppendixSize += end - begin;
+}
+
+
 bool MetadataStore::LoadFromFileV2() {
   using namespace MetadataFileV2;
 
@@ -411,47 +652,29 @@ bool MetadataStore::LoadFromFileV2() {
     throw W32Error();
   }
 
+  const auto ptrFileData = const_cast<const std::byte*>(fileData.get());
+
   // Read Header
 
-  const auto& header = *reinterpret_cast<const Header*>(fileData.get());
+  const auto& header = *reinterpret_cast<const Header*>(ptrFileData);
 
   if (header.dataSize % Alignment != 0) {
     throw W32Error(ERROR_INVALID_PARAMETER);
   }
 
   // Read Rename Entries
-  {
-    const auto endPtr = const_cast<const std::byte*>(fileData.get()) + header.renameSectionOffset + header.renameSectionSize;
-    auto checkPtr = [endPtr] (const std::byte* ptr) {
-      if (ptr > endPtr) {
-        throw W32Error(ERROR_BUFFER_OVERFLOW);
-      }
-    };
-
-    auto ptr = const_cast<const std::byte*>(fileData.get()) + header.renameSectionOffset;
-    for (std::uint_fast32_t i = 0; i < header.renameSectionCount; i++) {
-      std::size_t size = 0;
-      const auto renameEntry = RenameEntry::Parse(ptr, checkPtr, size);
-      ptr += size;
-      if (renameEntry.bSize == 0 || renameEntry.a == renameEntry.b) {
-        continue;
-      }
-      mRenameStore.AddEntry(renameEntry.a, renameEntry.b);
-    }
-
-    assert(ptr == endPtr);
-  }
+  LoadRenameSection(ptrFileData + header.renameSectionOffset, ptrFileData + header.renameSectionOffset + header.renameSectionSize, header.renameSectionCount);
 
   // Read Metadata Entries
   {
-    const auto endPtr = const_cast<const std::byte*>(fileData.get()) + header.metadataSectionOffset + header.metadataSectionSize;
+    const auto endPtr = ptrFileData + header.metadataSectionOffset + header.metadataSectionSize;
     auto checkPtr = [endPtr] (const std::byte* ptr) {
       if (ptr > endPtr) {
         throw W32Error(ERROR_BUFFER_OVERFLOW);
       }
     };
 
-    auto ptr = const_cast<const std::byte*>(fileData.get()) + header.metadataSectionOffset;
+    auto ptr = ptrFileData + header.metadataSectionOffset;
     for (std::uint_fast32_t i = 0; i < header.metadataSectionCount; i++) {
       std::size_t size = 0;
       const auto metadataEntry = MetadataEntry::Parse(ptr, checkPtr, size);
@@ -459,7 +682,7 @@ bool MetadataStore::LoadFromFileV2() {
       if (metadataEntry.flags == 0) {
         continue;
       }
-      mMetadataMap.emplace(metadataEntry.filename, static_cast<Metadata>(metadataEntry));
+      SetOverlayEntryL(metadataEntry.filename, static_cast<Metadata>(metadataEntry));
     }
 
     assert(ptr == endPtr);
@@ -468,66 +691,191 @@ bool MetadataStore::LoadFromFileV2() {
   // Read Appendix Entries
   const bool hasAppendix = header.dataSize != fileSize;
   if (hasAppendix) {
-    const auto endPtr = const_cast<const std::byte*>(fileData.get()) + fileSize;
-    auto checkPtr = [endPtr] (const std::byte* ptr) {
-      if (ptr > endPtr) {
-        throw W32Error(ERROR_BUFFER_OVERFLOW);
+    LoadAppendix(ptrFileData + header.dataSize, ptrFileData + fileSize);
+  }
+
+  return hasAppendix;
+}
+
+
+bool MetadataStore::LoadFromFileV3() {
+  using namespace MetadataFileV3;
+
+  // メタデータエントリ部とインデックス部はマップしたまま参照するので、ここではヘッダの検証のみを行う
+  MapFile();
+
+  try {
+    if (mMappedSize < sizeof(Header) || mMappedSize % Alignment != 0) {
+      throw W32Error(ERROR_INVALID_PARAMETER);
+    }
+
+    const auto& header = *reinterpret_cast<const Header*>(mMappedData);
+
+    if (header.dataSize % Alignment != 0 || header.dataSize > mMappedSize) {
+      throw W32Error(ERROR_INVALID_PARAMETER);
+    }
+
+    const auto checkSection = [&header] (std::uint64_t offset, std::uint64_t size) {
+      if (offset % Alignment != 0 || offset > header.dataSize || size > header.dataSize - offset) {
+        throw W32Error(ERROR_INVALID_PARAMETER);
       }
     };
+    checkSection(header.renameSectionOffset, header.renameSectionSize);
+    checkSection(header.metadataSectionOffset, header.metadataSectionSize);
+    checkSection(header.indexSectionOffset, header.indexSectionSize);
 
-    auto ptr = const_cast<const std::byte*>(fileData.get()) + header.dataSize;
-    while (ptr != endPtr) {
-      checkPtr(ptr + sizeof(AppendixEntryHeader));
-      const auto& appendixEntry = *reinterpret_cast<const AppendixEntryHeader*>(ptr);
-      const auto nextPtr = ptr + appendixEntry.blockSize;
-      checkPtr(nextPtr);
-      ptr += sizeof(AppendixEntryHeader);
+    if (header.indexSectionCount != header.metadataSectionCount || header.indexSectionSize != header.indexSectionCount * sizeof(IndexEntry)) {
+      throw W32Error(ERROR_INVALID_PARAMETER);
+    }
 
-      auto checkPtr2 = [nextPtr] (const std::byte* ptr) {
-        if (ptr > nextPtr) {
-          throw W32Error(ERROR_BUFFER_OVERFLOW);
-        }
-      };
+    mDataSize = header.dataSize;
 
-      std::size_t size = 0;
+    // Read Rename Entries
+    // リネームエントリはRenameStoreの木構造に展開する必要があるため、従来通りすべて読み込む
+    LoadRenameSection(mMappedData + header.renameSectionOffset, mMappedData + header.renameSectionOffset + header.renameSectionSize, header.renameSectionCount);
 
-      switch (appendixEntry.dataType) {
-        case AppendixDataType::Rename:
-        {
-          const auto renameEntry = RenameEntry::Parse(ptr, checkPtr, size);
-          if (renameEntry.bSize != 0) {
-            mRenameStore.Rename(renameEntry.a, renameEntry.b);
-          } else {
-            mRenameStore.RemoveEntry(renameEntry.a);
-          }
-          break;
-        }
+    // Read Appendix Entries
+    const bool hasAppendix = header.dataSize != mMappedSize;
+    if (hasAppendix) {
+      LoadAppendix(mMappedData + header.dataSize, mMappedData + mMappedSize);
+    }
 
-        case AppendixDataType::Metadata:
-        {
-          const auto metadataEntry = MetadataEntry::Parse(ptr, checkPtr, size);
-          if (metadataEntry.flags != 0) {
-            mMetadataMap.insert_or_assign(metadataEntry.filename, static_cast<Metadata>(metadataEntry));
-          } else {
-            mMetadataMap.erase(metadataEntry.filename);
-          }
-          break;
-        }
+    // 追記部はファイル末尾に書き込む
+    if (SetFilePointer(mHFile, 0, NULL, FILE_END) == INVALID_SET_FILE_POINTER) {
+      throw W32Error();
+    }
 
-        default:
-          throw W32Error(ERROR_INVALID_PARAMETER);
-      }
+    return hasAppendix;
+  } catch (...) {
+    UnmapFile();
+    throw;
+  }
+}
+
+
+void MetadataStore::MapFile() {
+  UnmapFile();
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(mHFile, &fileSize)) {
+    throw W32Error();
+  }
+
+  mHMapping = CreateFileMappingW(mHFile, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mHMapping) {
+    throw W32Error();
+  }
+
+  const auto ptr = MapViewOfFile(mHMapping, FILE_MAP_READ, 0, 0, 0);
+  if (!ptr) {
+    const auto error = GetLastError();
+    CloseHandle(mHMapping);
+    mHMapping = NULL;
+    throw W32Error(error);
+  }
+
+  mMappedData = static_cast<const std::byte*>(ptr);
+  mMappedSize = static_cast<std::size_t>(fileSize.QuadPart);
+}
+
+
+void MetadataStore::UnmapFile() noexcept {
+  if (mMappedData) {
+    UnmapViewOfFile(mMappedData);
+    mMappedData = nullptr;
+    mMappedSize = 0;
+  }
+  if (mHMapping) {
+    CloseHandle(mHMapping);
+    mHMapping = NULL;
+  }
+}
 
-      ptr += size;
-      assert(ptr == nextPtr);
 
-      ptr = nextPtr;
+const std::byte* MetadataStore::GetMappedMetadataEntry(std::size_t index) const {
+  using namespace MetadataFileV3;
+
+  const auto& header = *reinterpret_cast<const Header*>(mMappedData);
+  const auto& indexEntry = reinterpret_cast<const IndexEntry*>(mMappedData + header.indexSectionOffset)[index];
+
+  // インデックスが指す先は遅延して検証する
+  const auto sectionBegin = header.metadataSectionOffset;
+  const auto sectionEnd = header.metadataSectionOffset + header.metadataSectionSize;
+  const auto offset = indexEntry.metadataEntryOffset;
+  if (offset < sectionBegin || offset % Alignment != 0 || offset > sectionEnd || sectionEnd - offset < sizeof(MetadataEntryHeader)) {
+    throw W32Error(ERROR_BUFFER_OVERFLOW);
+  }
+
+  const auto& entryHeader = *reinterpret_cast<const MetadataEntryHeader*>(mMappedData + offset);
+  const auto minBlockSize = sizeof(MetadataEntryHeader) + Align(static_cast<std::uint64_t>(entryHeader.filenameSize) * sizeof(char16_t)) + Align(static_cast<std::uint64_t>(entryHeader.securitySize));
+  if (entryHeader.blockSize < minBlockSize || entryHeader.blockSize % Alignment != 0 || entryHeader.blockSize > sectionEnd - offset || entryHeader.filenameSize != indexEntry.filenameSize) {
+    throw W32Error(ERROR_BUFFER_OVERFLOW);
+  }
+
+  return mMappedData + offset;
+}
+
+
+const std::byte* MetadataStore::FindMappedMetadataEntryN(std::wstring_view key) const {
+  using namespace MetadataFileV3;
+
+  if (!mMappedData) {
+    return nullptr;
+  }
+
+  const auto& header = *reinterpret_cast<const Header*>(mMappedData);
+  const auto indexBegin = reinterpret_cast<const IndexEntry*>(mMappedData + header.indexSectionOffset);
+  const auto indexEnd = indexBegin + header.indexSectionCount;
+  const auto hash = HashKey(key);
+
+  auto itr = std::lower_bound(indexBegin, indexEnd, hash, [] (const IndexEntry& indexEntry, std::uint32_t value) {
+    return indexEntry.hash < value;
+  });
+  for (; itr != indexEnd && itr->hash == hash; ++itr) {
+    if (itr->filenameSize != key.size()) {
+      continue;
     }
+    const auto ptr = GetMappedMetadataEntry(static_cast<std::size_t>(itr - indexBegin));
+    if (EqualsUTF16(ptr + sizeof(MetadataEntryHeader), key)) {
+      return ptr;
+    }
+  }
 
-    assert(ptr == endPtr);
+  return nullptr;
+}
+
+
+bool MetadataStore::ContainsKey(const std::wstring& key) const {
+  if (const auto itr = mMetadataMap.find(key); itr != mMetadataMap.end()) {
+    return itr->second.metadata.has_value();
   }
+  return FindMappedMetadataEntryN(key) != nullptr;
+}
 
-  return hasAppendix;
+
+std::optional<Metadata> MetadataStore::FindMetadataN(const std::wstring& key) const {
+  using namespace MetadataFileV3;
+
+  if (const auto itr = mMetadataMap.find(key); itr != mMetadataMap.end()) {
+    return itr->second.metadata;
+  }
+
+  const auto ptr = FindMappedMetadataEntryN(key);
+  if (!ptr) {
+    return std::nullopt;
+  }
+
+  const auto& entryHeader = *reinterpret_cast<const MetadataEntryHeader*>(ptr);
+  const auto securityPtr = reinterpret_cast<const char*>(ptr + sizeof(MetadataEntryHeader) + Align(entryHeader.filenameSize * sizeof(char16_t)));
+  return MetadataFileV2::ToMetadata(entryHeader, std::string_view(securityPtr, entryHeader.securitySize));
+}
+
+
+void MetadataStore::SetOverlayEntryL(std::wstring_view key, std::optional<Metadata> metadata) {
+  mMetadataMap.insert_or_assign(std::wstring(key), OverlayEntry{
+    std::move(metadata),
+    ++mSequence,
+  });
 }
 
 
@@ -536,7 +884,10 @@ void MetadataStore::LoadFromFile() {
     throw W32Error(ERROR_INVALID_HANDLE);
   }
 
+  UnmapFile();
   mMetadataMap.clear();
+  mDataSize = 0;
+  mAppendixSize = 0;
   if (SetFilePointer(mHFile, 0, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER) {
     throw W32Error();
   }
@@ -558,6 +909,13 @@ void MetadataStore::LoadFromFile() {
     throw W32Error();
   }
 
+  std::uint32_t version = 0;
+  if (signature == MetadataFileV3::Signature) {
+    if (!ReadFile(mHFile, &version, sizeof(version), &read, NULL) || read != sizeof(version)) {
+      throw W32Error();
+    }
+  }
+
   if (SetFilePointer(mHFile, 0, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER) {
     throw W32Error();
   }
@@ -565,14 +923,27 @@ void MetadataStore::LoadFromFile() {
   switch (signature) {
     case MetadataFileV1::Signature:
       LoadFromFileV1();
-      // convert to V2 format
+      // convert to V3 format
       SaveToFile();
       break;
 
-    case MetadataFileV2::Signature:
-      if (LoadFromFileV2()) {
-        // has appendix section; remove it
-        SaveToFile();
+    case MetadataFileV3::Signature:
+      switch (version) {
+        case MetadataFileV2::Version:
+          LoadFromFileV2();
+          // convert to V3 format
+          SaveToFile();
+          break;
+
+        case MetadataFileV3::Version:
+          if (LoadFromFileV3()) {
+            // has appendix section; remove it
+            SaveToFile();
+          }
+          break;
+
+        default:
+          throw W32Error(ERROR_INVALID_PARAMETER);
       }
       break;
 
@@ -582,14 +953,80 @@ void MetadataStore::LoadFromFile() {
 }
 
 
-void MetadataStore::SaveToFile() {
-  using namespace MetadataFileV2;
+MetadataStore::Snapshot MetadataStore::TakeSnapshotL() const {
+  Snapshot snapshot{
+    mRenameStore.GetEntries(),
+    {},
+    mSequence,
+    mAppendixSize,
+  };
 
-  if (!util::IsValidHandle(mHFile)) {
-    throw W32Error(ERROR_INVALID_HANDLE);
+  snapshot.metadataEntries.reserve(mMetadataMap.size());
+  for (const auto& [keyName, overlayEntry] : mMetadataMap) {
+    snapshot.metadataEntries.emplace_back(keyName, overlayEntry.metadata);
   }
 
-  const auto renameEntries = mRenameStore.GetEntries();
+  return snapshot;
+}
+
+
+std::vector<std::byte> MetadataStore::BuildFileImage(const Snapshot& snapshot) const {
+  using namespace MetadataFileV3;
+
+  const auto& renameEntries = snapshot.renameEntries;
+
+  // マップしているエントリとスナップショットのエントリ（追加・変更・削除されたもの）を統合する
+  struct MetadataItem {
+    std::uint32_t hash;
+    std::wstring_view keyName;
+    const Metadata* metadata;       // nullptr if mapped
+    const std::byte* mappedEntry;   // nullptr if not mapped
+  };
+
+  std::vector<MetadataItem> metadataItems;
+  std::deque<std::wstring> keyNameStorage;
+
+  if (mMappedData) {
+    const auto& mappedHeader = *reinterpret_cast<const Header*>(mMappedData);
+
+    std::unordered_set<std::wstring_view> overriddenKeys;
+    overriddenKeys.reserve(snapshot.metadataEntries.size());
+    for (const auto& [keyName, metadataN] : snapshot.metadataEntries) {
+      overriddenKeys.emplace(keyName);
+    }
+
+    metadataItems.reserve(static_cast<std::size_t>(mappedHeader.metadataSectionCount) + snapshot.metadataEntries.size());
+    const auto indexBegin = reinterpret_cast<const IndexEntry*>(mMappedData + mappedHeader.indexSectionOffset);
+    for (std::size_t i = 0; i < mappedHeader.indexSectionCount; i++) {
+      const auto ptr = GetMappedMetadataEntry(i);
+      const auto keyName = ViewUTF16(ptr + sizeof(MetadataEntryHeader), indexBegin[i].filenameSize, keyNameStorage);
+      if (overriddenKeys.count(keyName)) {
+        continue;
+      }
+      metadataItems.push_back(MetadataItem{
+        indexBegin[i].hash,
+        keyName,
+        nullptr,
+        ptr,
+      });
+    }
+  }
+
+  for (const auto& [keyName, metadataN] : snapshot.metadataEntries) {
+    if (!metadataN) {
+      continue;
+    }
+    metadataItems.push_back(MetadataItem{
+      HashKey(keyName),
+      keyName,
+      &metadataN.value(),
+      nullptr,
+    });
+  }
+
+  std::sort(metadataItems.begin(), metadataItems.end(), [] (const MetadataItem& a, const MetadataItem& b) {
+    return a.hash != b.hash ? a.hash < b.hash : a.keyName < b.keyName;
+  });
 
   // calculate fileSize
   std::size_t fileSize = 0;
@@ -602,18 +1039,19 @@ void MetadataStore::SaveToFile() {
     fileSize += Align(b.size() * sizeof(char16_t));
   }
   const auto offsetToMetadataSection = fileSize;
-  for (const auto& [keyName, metadata] : mMetadataMap) {
-    fileSize += sizeof(MetadataEntryHeader);
-    fileSize += Align(keyName.size() * sizeof(char16_t));
-    fileSize += Align(metadata.security ? metadata.security.value().size() : 0);
+  for (const auto& item : metadataItems) {
+    fileSize += item.mappedEntry
+      ? reinterpret_cast<const MetadataEntryHeader*>(item.mappedEntry)->blockSize
+      : GetMetadataEntrySize(item.keyName, *item.metadata);
   }
+  const auto offsetToIndexSection = fileSize;
+  fileSize += metadataItems.size() * sizeof(IndexEntry);
 
   assert(fileSize % Alignment == 0);
 
-  auto fileData = make_unique_aligned<std::byte, Alignment>(fileSize);
-  std::memset(fileData.get(), 0, fileSize);
+  std::vector<std::byte> fileData(fileSize);
 
-  auto ptr = fileData.get();
+  auto ptr = fileData.data();
 
   auto& header = *reinterpret_cast<Header*>(ptr);
   ptr += sizeof(Header);
@@ -626,8 +1064,12 @@ void MetadataStore::SaveToFile() {
     static_cast<std::uint64_t>(renameEntries.size()),
     0,
     static_cast<std::uint64_t>(offsetToMetadataSection),
-    static_cast<std::uint64_t>(fileSize - offsetToMetadataSection),
-    static_cast<std::uint64_t>(mMetadataMap.size()),
+    static_cast<std::uint64_t>(offsetToIndexSection - offsetToMetadataSection),
+    static_cast<std::uint64_t>(metadataItems.size()),
+    0,
+    static_cast<std::uint64_t>(offsetToIndexSection),
+    static_cast<std::uint64_t>(fileSize - offsetToIndexSection),
+    static_cast<std::uint64_t>(metadataItems.size()),
     0,
   };
 
@@ -643,62 +1085,467 @@ void MetadataStore::SaveToFile() {
       static_cast<std::uint32_t>(b.size()),
     };
 
-    std::memcpy(ptr, a.c_str(), a.size() * sizeof(char16_t));
+    WriteUTF16(ptr, a);
     ptr += Align(a.size() * sizeof(char16_t));
 
-    std::memcpy(ptr, b.c_str(), b.size() * sizeof(char16_t));
+    WriteUTF16(ptr, b);
     ptr += Align(b.size() * sizeof(char16_t));
 
     entryHeader.blockSize = static_cast<std::uint32_t>(ptr - prevPtr);
   }
 
-  for (const auto& [keyName, metadata] : mMetadataMap) {
-    const auto prevPtr = ptr;
+  auto indexPtr = reinterpret_cast<IndexEntry*>(fileData.data() + offsetToIndexSection);
+  for (const auto& item : metadataItems) {
+    *indexPtr++ = IndexEntry{
+      item.hash,
+      static_cast<std::uint32_t>(item.keyName.size()),
+      static_cast<std::uint64_t>(ptr - fileData.data()),
+    };
 
-    std::uint32_t flags = 0;
-    if (metadata.fileAttributes) flags |= EntryFlags::HasAttributes;
-    if (metadata.creationTime)   flags |= EntryFlags::HasCreationTime;
-    if (metadata.lastAccessTime) flags |= EntryFlags::HasLastAccessTime;
-    if (metadata.lastWriteTime)  flags |= EntryFlags::HasLastWriteTime;
-    if (metadata.security)       flags |= EntryFlags::HasSecurity;
+    if (item.mappedEntry) {
+      const auto blockSize = reinterpret_cast<const MetadataEntryHeader*>(item.mappedEntry)->blockSize;
+      std::memcpy(ptr, item.mappedEntry, blockSize);
+      ptr += blockSize;
+    } else {
+      ptr = WriteMetadataEntry(ptr, item.keyName, *item.metadata);
+    }
+  }
 
-    auto& entryHeader = *reinterpret_cast<MetadataEntryHeader*>(ptr);
-    ptr += sizeof(MetadataEntryHeader);
-    entryHeader = MetadataEntryHeader{
-      0,    // filled later
-      0,
-      static_cast<std::uint32_t>(keyName.size()),
-      metadata.security ? static_cast<std::uint32_t>(metadata.security.value().size()) : 0,
-      flags,
-      metadata.fileAttributes ? metadata.fileAttributes.value() : 0,
-      metadata.creationTime   ? ReadFILETIME(metadata.creationTime.value())   : 0,
-      metadata.lastAccessTime ? ReadFILETIME(metadata.lastAccessTime.value()) : 0,
-      metadata.lastWriteTime  ? ReadFILETIME(metadata.lastWriteTime.value())  : 0,
-    };
+  assert(ptr == fileData.data() + offsetToIndexSection);
 
-    std::memcpy(ptr, keyName.c_str(), keyName.size() * sizeof(char16_t));
-    ptr += Align(keyName.size() * sizeof(char16_t));
+  return fileData;
+}
 
-    if (metadata.security) {
-      const auto& security = metadata.security.value();
-      std::memcpy(ptr, security.c_str(), security.size() * sizeof(char16_t));
-      ptr += Align(security.size() * sizeof(char16_t));
+
+HANDLE MetadataStore::WriteTempFile(const std::vector<std::byte>& fileImage) const {
+  const std::wstring tempFilePath = mFilePath + TempFileSuffix;
+
+  const HANDLE hTempFile = CreateFileW(tempFilePath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hTempFile == INVALID_HANDLE_VALUE) {
+    throw W32Error();
+  }
+
+  DWORD written = 0;
+  if (!WriteFile(hTempFile, fileImage.data(), static_cast<DWORD>(fileImage.size()), &written, NULL) || written != fileImage.size() || !FlushFileBuffers(hTempFile)) {
+    const auto error = GetLastError();
+    CloseHandle(hTempFile);
+    DeleteFileW(tempFilePath.c_str());
+    throw W32Error(error);
+  }
+
+  return hTempFile;
+}
+
+
+void MetadataStore::CommitTempFileL(HANDLE hTempFile, const Snapshot& snapshot, std::uint64_t dataSize) {
+  const std::wstring tempFilePath = mFilePath + TempFileSuffix;
+
+  std::lock_guard journalWriteLock(mJournalWriteMutex);
+  std::lock_guard journalFlushLock(mJournalFlushMutex);
+
+  // スナップショットを取った後に書き込まれた追記部を新しいファイルにも追記する
+  // mAppendixSizeはまだ書き込まれていない記録も含むので、スナップショットに含まれる記録も含めて先に書き込んでおく
+  // （残しておくと新しいファイルに数えられないまま追記され、次の統合で末尾を読み出す位置がずれる）
+  const auto tailSize = mAppendixSize - snapshot.appendixSize;
+  try {
+    WriteJournalL();
+
+    if (tailSize != 0) {
+      std::vector<std::byte> tail(static_cast<std::size_t>(tailSize));
+
+      LARGE_INTEGER offset;
+      offset.QuadPart = mDataSize + snapshot.appendixSize;
+      if (!SetFilePointerEx(mHFile, offset, NULL, FILE_BEGIN)) {
+        throw W32Error();
+      }
+
+      DWORD read = 0;
+      if (!ReadFile(mHFile, tail.data(), static_cast<DWORD>(tail.size()), &read, NULL) || read != tail.size()) {
+        throw W32Error();
+      }
+
+      if (SetFilePointer(mHFile, 0, NULL, FILE_END) == INVALID_SET_FILE_POINTER) {
+        throw W32Error();
+      }
+
+      DWORD written = 0;
+      if (!WriteFile(hTempFile, tail.data(), static_cast<DWORD>(tail.size()), &written, NULL) || written != tail.size() || !FlushFileBuffers(hTempFile)) {
+        throw W32Error();
+      }
     }
+  } catch (...) {
+    CloseHandle(hTempFile);
+    DeleteFileW(tempFilePath.c_str());
+    throw;
+  }
 
-    entryHeader.blockSize = static_cast<std::uint32_t>(ptr - prevPtr);
+  CloseHandle(hTempFile);
+
+  // 置き換えはアトミックに行われるので、どの時点で中断されても元のファイルか新しいファイルのどちらかが残る
+  UnmapFile();
+  if (util::IsValidHandle(mHFile)) {
+    CloseHandle(mHFile);
+    mHFile = NULL;
   }
 
-  if (SetFilePointer(mHFile, 0, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER) {
-    throw W32Error();
+  const bool moved = MoveFileExW(tempFilePath.c_str(), mFilePath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+  const DWORD moveError = moved ? ERROR_SUCCESS : GetLastError();
+
+  OpenFile();
+
+  if (!moved) {
+    DeleteFileW(tempFilePath.c_str());
+    // 元のファイルをそのまま使い続ける
+    if (mDataSize != 0) {
+      MapFile();
+    }
+    if (SetFilePointer(mHFile, 0, NULL, FILE_END) == INVALID_SET_FILE_POINTER) {
+      throw W32Error();
+    }
+    throw W32Error(moveError);
   }
-  if (!SetEndOfFile(mHFile)) {
+
+  MapFile();
+  if (SetFilePointer(mHFile, 0, NULL, FILE_END) == INVALID_SET_FILE_POINTER) {
     throw W32Error();
   }
 
-  DWORD written = 0;
-  if (!WriteFile(mHFile, fileData.get(), fileSize, &written, NULL) || written != fileSize) {
+  // 新しいファイルは追記部も含めてフラッシュ済み
+  {
+    std::lock_guard lock(mJournalMutex);
+    mJournalSyncedPosition = mJournalWrittenPosition;
+  }
+
+  mDataSize = dataSize;
+  mAppendixSize = tailSize;
+
+  // スナップショットに含まれていた変更は新しいファイルに反映されたので取り除く
+  for (auto itr = mMetadataMap.begin(); itr != mMetadataMap.end(); ) {
+    if (itr->second.sequence <= snapshot.sequence) {
+      itr = mMetadataMap.erase(itr);
+    } else {
+      ++itr;
+    }
+  }
+}
+
+
+void MetadataStore::SaveToFile() {
+  const auto snapshot = TakeSnapshotL();
+  const auto fileImage = BuildFileImage(snapshot);
+  CommitTempFileL(WriteTempFile(fileImage), snapshot, fileImage.size());
+}
+
+
+void MetadataStore::OpenFile() {
+  mHFile = CreateFileW(mFilePath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (!mHFile || mHFile == INVALID_HANDLE_VALUE) {
+    mHFile = NULL;
+    throw W32Error(GetLastError());
+  }
+}
+
+
+bool MetadataStore::NeedsCompactionL() const {
+  return mAppendixSize >= MountConfig::MetadataCompactionThreshold && mAppendixSize >= mDataSize / MountConfig::MetadataCompactionRatioDivisor;
+}
+
+
+void MetadataStore::Compact() {
+  Snapshot snapshot;
+  {
+    std::shared_lock lock(mMutex);
+    if (!util::IsValidHandle(mHFile) || !NeedsCompactionL()) {
+      return;
+    }
+    snapshot = TakeSnapshotL();
+  }
+
+  // マップしている領域はCommitTempFileLでしか置き換えられないので、ロックせずに読み出せる
+  const auto fileImage = BuildFileImage(snapshot);
+  const auto hTempFile = WriteTempFile(fileImage);
+
+  std::lock_guard lock(mMutex);
+  CommitTempFileL(hTempFile, snapshot, fileImage.size());
+}
+
+
+void MetadataStore::RequestCompaction() {
+  {
+    std::lock_guard lock(mCompactionMutex);
+    mCompactionRequested = true;
+  }
+  mCompactionCV.notify_one();
+}
+
+
+void MetadataStore::StartCompactionThread() {
+  mCompactionRequested = false;
+  mCompactionTerminate = false;
+  mCompactionThread = std::thread([this]() {
+    std::unique_lock lock(mCompactionMutex);
+    while (true) {
+      mCompactionCV.wait(lock, [this]() {
+        return mCompactionRequested || mCompactionTerminate;
+      });
+      if (mCompactionTerminate) {
+        return;
+      }
+      mCompactionRequested = false;
+
+      lock.unlock();
+      try {
+        Compact();
+      } catch (...) {
+        // 失敗しても追記部はそのまま残っているので、次に追記された際に再試行する
+      }
+      lock.lock();
+    }
+  });
+}
+
+
+void MetadataStore::StopCompactionThread() {
+  if (!mCompactionThread.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard lock(mCompactionMutex);
+    mCompactionTerminate = true;
+  }
+  mCompactionCV.notify_one();
+  mCompactionThread.join();
+}
+
+
+void MetadataStore::AppendJournalL(const std::byte* data, std::size_t size) {
+  {
+    std::lock_guard lock(mJournalMutex);
+    mJournal.insert(mJournal.end(), data, data + size);
+    mJournalAppendedPosition += size;
+  }
+  mAppendixSize += size;
+
+  if (NeedsCompactionL()) {
+    RequestCompaction();
+  }
+}
+
+
+void MetadataStore::WriteJournalL() {
+  std::vector<std::byte> journal;
+  std::uint64_t position;
+  {
+    std::lock_guard lock(mJournalMutex);
+    journal.swap(mJournal);
+    position = mJournalAppendedPosition;
+  }
+
+  if (!journal.empty() && util::IsValidHandle(mHFile)) {
+    DWORD written = 0;
+    if (!WriteFile(mHFile, journal.data(), static_cast<DWORD>(journal.size()), &written, NULL) || written != journal.size()) {
+      // 次の書き込みで再試行する（終了時の統合でも書き出される）
+      std::lock_guard lock(mJournalMutex);
+      mJournal.insert(mJournal.begin(), journal.begin(), journal.end());
+      throw W32Error();
+    }
+  }
+
+  std::lock_guard lock(mJournalMutex);
+  mJournalWrittenPosition = position;
+}
+
+
+void MetadataStore::SyncJournal() {
+  std::lock_guard lock(mJournalFlushMutex);
+
+  std::uint64_t position;
+  {
+    std::lock_guard journalLock(mJournalMutex);
+    if (mJournalSyncedPosition >= mJournalWrittenPosition) {
+      return;
+    }
+    position = mJournalWrittenPosition;
+  }
+
+  if (util::IsValidHandle(mHFile) && !FlushFileBuffers(mHFile)) {
     throw W32Error();
   }
+
+  std::lock_guard journalLock(mJournalMutex);
+  mJournalSyncedPosition = std::max(mJournalSyncedPosition, position);
+}
+
+
+void MetadataStore::FlushJournal(bool durable) {
+  {
+    std::lock_guard lock(mJournalWriteMutex);
+    WriteJournalL();
+  }
+  // フラッシュの間も他のスレッドが書き込めるよう、mJournalWriteMutexを解放してから行う
+  if (durable) {
+    SyncJournal();
+  }
+}
+
+
+// positionまでの記録が書き込まれる（durableならフラッシュされる）まで待つ
+// 書き込み中のリーダーがいなければ自身がリーダーとなり、その時点までに溜まった他のスレッドの記録もまとめて書き込む
+void MetadataStore::GroupCommitJournal(std::uint64_t position, bool durable) {
+  std::unique_lock lock(mJournalMutex);
+  while ((durable ? mJournalSyncedPosition : mJournalWrittenPosition) < position) {
+    if (mJournalCommitting) {
+      mJournalCommitCV.wait(lock);
+      continue;
+    }
+
+    mJournalCommitting = true;
+    lock.unlock();
+    try {
+      FlushJournal(durable);
+    } catch (...) {
+      lock.lock();
+      mJournalCommitting = false;
+      mJournalCommitCV.notify_all();
+      throw;
+    }
+    lock.lock();
+    mJournalCommitting = false;
+    mJournalCommitCV.notify_all();
+  }
+}
+
+
+// mMutexを解放してから呼ぶ
+void MetadataStore::CommitJournal() {
+  if (gDeferredCommit && &gDeferredCommit->mStore == this) {
+    return;
+  }
+
+  std::uint64_t position;
+  bool full;
+  {
+    std::lock_guard lock(mJournalMutex);
+    position = mJournalAppendedPosition;
+    full = mJournal.size() >= MountConfig::MetadataJournalBufferSize;
+  }
+
+  switch (mDurability) {
+    case Durability::PerOperation:
+      GroupCommitJournal(position, true);
+      break;
+
+    case Durability::Batched:
+      // 書き込みはすぐに行い、フラッシュだけをmJournalThreadでまとめて行う
+      GroupCommitJournal(position, false);
+      {
+        std::lock_guard lock(mJournalMutex);
+        mJournalSyncRequested = true;
+      }
+      mJournalCV.notify_one();
+      break;
+
+    case Durability::OnFlush:
+      if (full) {
+        GroupCommitJournal(position, false);
+      }
+      break;
+  }
+}
+
+
+void MetadataStore::StartJournalThread() {
+  if (mDurability != Durability::Batched) {
+    return;
+  }
+
+  mJournalSyncRequested = false;
+  mJournalTerminate = false;
+  mJournalThread = std::thread([this]() {
+    std::unique_lock lock(mJournalMutex);
+    while (true) {
+      mJournalCV.wait(lock, [this]() {
+        return mJournalSyncRequested || mJournalTerminate;
+      });
+      if (mJournalTerminate) {
+        return;
+      }
+
+      // 最初の記録から最大mMaxCommitDelayだけ待ち、その間に書き込まれた記録とまとめてフラッシュする
+      mJournalCV.wait_for(lock, mMaxCommitDelay, [this]() {
+        return mJournalTerminate;
+      });
+      mJournalSyncRequested = false;
+
+      lock.unlock();
+      try {
+        SyncJournal();
+      } catch (...) {
+        // メモリ上の状態は最新なので、終了時の統合で書き出される
+      }
+      lock.lock();
+    }
+  });
+}
+
+
+void MetadataStore::StopJournalThread() {
+  if (!mJournalThread.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard lock(mJournalMutex);
+    mJournalTerminate = true;
+  }
+  mJournalCV.notify_one();
+  mJournalThread.join();
+}
+
+
+void MetadataStore::Flush() {
+  std::uint64_t position;
+  {
+    std::lock_guard lock(mJournalMutex);
+    position = mJournalAppendedPosition;
+  }
+  GroupCommitJournal(position, true);
+}
+
+
+MetadataStore::DeferredCommit::DeferredCommit(MetadataStore& store) :
+  mStore(store),
+  mOuter(gDeferredCommit)
+{
+  gDeferredCommit = this;
+}
+
+
+MetadataStore::DeferredCommit::~DeferredCommit() {
+  if (!mActive) {
+    return;
+  }
+  try {
+    Commit();
+  } catch (...) {
+    // 書き込めなかった記録は次の書き込みか終了時の統合で書き出される
+  }
+}
+
+
+void MetadataStore::DeferredCommit::Deactivate() noexcept {
+  mActive = false;
+  gDeferredCommit = mOuter;
+}
+
+
+void MetadataStore::DeferredCommit::Commit() {
+  if (!mActive) {
+    return;
+  }
+  Deactivate();
+  mStore.CommitJournal();
 }
 
 
@@ -739,18 +1586,15 @@ void MetadataStore::AddRenameAppendix(std::wstring_view a, std::wstring_view b)
     static_cast<std::uint32_t>(b.size()),
   };
 
-  std::memcpy(ptr, a.data(), a.size() * sizeof(char16_t));
+  WriteUTF16(ptr, a);
   ptr += alignedASize;
 
-  std::memcpy(ptr, b.data(), b.size() * sizeof(char16_t));
+  WriteUTF16(ptr, b);
   ptr += alignedBSize;
 
   assert(ptr == data.get() + dataSize);
 
-  DWORD written = 0;
-  if (!WriteFile(mHFile, data.get(), dataSize, &written, NULL) || written != dataSize) {
-    throw W32Error();
-  }
+  AppendJournalL(data.get(), dataSize);
 }
 
 
@@ -763,14 +1607,9 @@ void MetadataStore::AddRenameAppendix(std::wstring_view a) {
 void MetadataStore::AddMetadataAppendix(std::wstring_view keyName, const Metadata& metadata) {
   using namespace MetadataFileV2;
 
-  const auto alignedFilenameSize = Align(keyName.size() * sizeof(char16_t));
-  const auto alignedSecuritySize = Align(metadata.security ? metadata.security.value().size() : 0);
-
   std::size_t dataSize = 0;
   dataSize += sizeof(AppendixEntryHeader);
-  dataSize += sizeof(MetadataEntryHeader);
-  dataSize += alignedFilenameSize;
-  dataSize += alignedSecuritySize;
+  dataSize += GetMetadataEntrySize(keyName, metadata);
 
   assert(dataSize % Alignment == 0);
 
@@ -788,42 +1627,11 @@ void MetadataStore::AddMetadataAppendix(std::wstring_view keyName, const Metadat
     0,
   };
 
-  std::uint32_t flags = 0;
-  if (metadata.fileAttributes) flags |= EntryFlags::HasAttributes;
-  if (metadata.creationTime)   flags |= EntryFlags::HasCreationTime;
-  if (metadata.lastAccessTime) flags |= EntryFlags::HasLastAccessTime;
-  if (metadata.lastWriteTime)  flags |= EntryFlags::HasLastWriteTime;
-  if (metadata.security)       flags |= EntryFlags::HasSecurity;
-
-  auto& entryHeader = *reinterpret_cast<MetadataEntryHeader*>(ptr);
-  ptr += sizeof(MetadataEntryHeader);
-  entryHeader = MetadataEntryHeader{
-    static_cast<std::uint32_t>(dataSize - sizeof(AppendixEntryHeader)),
-    0,
-    static_cast<std::uint32_t>(keyName.size()),
-    metadata.security ? static_cast<std::uint32_t>(metadata.security.value().size()) : 0,
-    flags,
-    metadata.fileAttributes ? metadata.fileAttributes.value() : 0,
-    metadata.creationTime ? ReadFILETIME(metadata.creationTime.value()) : 0,
-    metadata.lastAccessTime ? ReadFILETIME(metadata.lastAccessTime.value()) : 0,
-    metadata.lastWriteTime ? ReadFILETIME(metadata.lastWriteTime.value()) : 0,
-  };
-
-  std::memcpy(ptr, keyName.data(), keyName.size() * sizeof(char16_t));
-  ptr += alignedFilenameSize;
-
-  if (metadata.security) {
-    const auto& security = metadata.security.value();
-    std::memcpy(ptr, security.c_str(), security.size() * sizeof(char16_t));
-    ptr += alignedSecuritySize;
-  }
+  ptr = WriteMetadataEntry(ptr, keyName, metadata);
 
   assert(ptr == data.get() + dataSize);
 
-  DWORD written = 0;
-  if (!WriteFile(mHFile, data.get(), dataSize, &written, NULL) || written != dataSize) {
-    throw W32Error();
-  }
+  AppendJournalL(data.get(), dataSize);
 }
 
 
@@ -833,8 +1641,10 @@ void MetadataStore::AddMetadataAppendix(std::wstring_view keyName) {
 }
 
 
-MetadataStore::MetadataStore(std::wstring_view storeFileName, bool caseSensitive) :
+MetadataStore::MetadataStore(std::wstring_view storeFileName, bool caseSensitive, Durability durability, std::chrono::milliseconds maxCommitDelay) :
   mCaseSensitive(caseSensitive),
+  mDurability(durability),
+  mMaxCommitDelay(maxCommitDelay),
   mRenameStore(caseSensitive)
 {
   if (!storeFileName.empty()) {
@@ -844,44 +1654,71 @@ MetadataStore::MetadataStore(std::wstring_view storeFileName, bool caseSensitive
 
 
 MetadataStore::~MetadataStore() {
+  StopCompactionThread();
+  StopJournalThread();
+
   if (util::IsValidHandle(mHFile)) {
-    SaveToFile();
-    CloseHandle(mHFile);
-    mHFile = NULL;
+    // 追記部がなければファイルは最新なので書き直す必要はない
+    if (mAppendixSize != 0) {
+      try {
+        // 統合に失敗しても変更が失われないよう、先に追記部を書き込んでおく
+        FlushJournal(true);
+        SaveToFile();
+      } catch (...) {
+        // 追記部が残っていれば次回の起動時に統合される
+      }
+    }
+    UnmapFile();
+    if (util::IsValidHandle(mHFile)) {
+      CloseHandle(mHFile);
+      mHFile = NULL;
+    }
   }
 }
 
 
 void MetadataStore::SetFilePath(std::wstring_view storeFilename) {
-  const bool previousExists = util::IsValidHandle(mHFile);
+  StopCompactionThread();
+  StopJournalThread();
 
-  if (previousExists) {
-    SaveToFile();
-    CloseHandle(mHFile);
-  }
+  {
+    std::lock_guard lock(mMutex);
 
-  const std::wstring sStoreFilename(storeFilename);
-  mHFile = CreateFileW(sStoreFilename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-  if (!mHFile || mHFile == INVALID_HANDLE_VALUE) {
-    throw W32Error(GetLastError());
-  }
+    const bool previousExists = util::IsValidHandle(mHFile);
+
+    mFilePath = storeFilename;
+
+    // 書き込み途中で中断された一時ファイルが残っていれば削除する（元のファイルはそのまま残っている）
+    DeleteFileW((mFilePath + TempFileSuffix).c_str());
 
-  if (!previousExists) {
-    LoadFromFile();
+    if (previousExists) {
+      // 現在の内容を新しいファイルに書き出す
+      SaveToFile();
+    } else {
+      OpenFile();
+      LoadFromFile();
+    }
   }
+
+  StartJournalThread();
+  StartCompactionThread();
 }
 
 
 std::optional<std::wstring> MetadataStore::ResolveFilepath(std::wstring_view filename) const {
+  std::shared_lock lock(mMutex);
+
   return mRenameStore.Resolve(filename);
 }
 
 
 bool MetadataStore::HasMetadataR(std::wstring_view resolvedFilename) const {
+  std::shared_lock lock(mMutex);
+
   if (!util::IsValidHandle(mHFile)) {
     return false;
   }
-  return mMetadataMap.count(FilenameToKey(resolvedFilename));
+  return ContainsKey(FilenameToKey(resolvedFilename));
 }
 
 
@@ -894,19 +1731,21 @@ bool MetadataStore::HasMetadata(std::wstring_view filename) const {
 }
 
 
-const Metadata& MetadataStore::GetMetadataR(std::wstring_view resolvedFilename) const {
+Metadata MetadataStore::GetMetadataR(std::wstring_view resolvedFilename) const {
+  std::shared_lock lock(mMutex);
+
   if (!util::IsValidHandle(mHFile)) {
     throw W32Error(ERROR_FILE_NOT_FOUND);
   }
-  const std::wstring key = FilenameToKey(resolvedFilename);
-  if (!mMetadataMap.count(key)) {
+  auto metadataN = FindMetadataN(FilenameToKey(resolvedFilename));
+  if (!metadataN) {
     throw W32Error(ERROR_FILE_NOT_FOUND);
   }
-  return mMetadataMap.at(key);
+  return std::move(metadataN.value());
 }
 
 
-const Metadata& MetadataStore::GetMetadata(std::wstring_view filename) const {
+Metadata MetadataStore::GetMetadata(std::wstring_view filename) const {
   const auto resolvedFilenameN = ResolveFilepath(filename);
   if (!resolvedFilenameN) {
     throw W32Error(ERROR_FILE_NOT_FOUND);
@@ -916,11 +1755,12 @@ const Metadata& MetadataStore::GetMetadata(std::wstring_view filename) const {
 
 
 Metadata MetadataStore::GetMetadata2R(std::wstring_view resolvedFilename) const {
+  std::shared_lock lock(mMutex);
+
   if (!util::IsValidHandle(mHFile)) {
     return Metadata{};
   }
-  const std::wstring key = FilenameToKey(resolvedFilename);
-  return mMetadataMap.count(key) ? mMetadataMap.at(key) : Metadata{};
+  return FindMetadataN(FilenameToKey(resolvedFilename)).value_or(Metadata{});
 }
 
 
@@ -934,12 +1774,17 @@ Metadata MetadataStore::GetMetadata2(std::wstring_view filename) const {
 
 
 void MetadataStore::SetMetadataR(std::wstring_view resolvedFilename, const Metadata& metadata) {
-  if (!util::IsValidHandle(mHFile)) {
-    return;
+  {
+    std::lock_guard lock(mMutex);
+
+    if (!util::IsValidHandle(mHFile)) {
+      return;
+    }
+    const auto key = FilenameToKey(resolvedFilename);
+    SetOverlayEntryL(key, metadata);
+    AddMetadataAppendix(key, metadata);
   }
-  const auto key = FilenameToKey(resolvedFilename);
-  mMetadataMap.insert_or_assign(key, metadata);
-  AddMetadataAppendix(key, metadata);
+  CommitJournal();
 }
 
 
@@ -953,12 +1798,20 @@ void MetadataStore::SetMetadata(std::wstring_view filename, const Metadata& meta
 
 
 bool MetadataStore::RemoveMetadataR(std::wstring_view resolvedFilename) {
-  if (!util::IsValidHandle(mHFile)) {
-    return false;
+  bool ret;
+  {
+    std::lock_guard lock(mMutex);
+
+    if (!util::IsValidHandle(mHFile)) {
+      return false;
+    }
+    const auto key = FilenameToKey(resolvedFilename);
+    ret = ContainsKey(key);
+    // マップしているエントリを隠すため、nulloptを入れておく
+    SetOverlayEntryL(key, std::nullopt);
+    AddMetadataAppendix(key);
   }
-  const auto key = FilenameToKey(resolvedFilename);
-  const auto ret = mMetadataMap.erase(key);
-  AddMetadataAppendix(key);
+  CommitJournal();
   return ret;
 }
 
@@ -973,6 +1826,8 @@ bool MetadataStore::RemoveMetadata(std::wstring_view filename) {
 
 
 bool MetadataStore::ExistsR(std::wstring_view resolvedFilename) const {
+  std::shared_lock lock(mMutex);
+
   if (!util::IsValidHandle(mHFile)) {
     return true;
   }
@@ -991,21 +1846,27 @@ bool MetadataStore::Exists(std::wstring_view filename) const {
 
 
 std::optional<bool> MetadataStore::ExistsO(std::wstring_view filename) const {
+  std::shared_lock lock(mMutex);
+
   return mRenameStore.Exists(filename);
 }
 
 
 std::vector<std::pair<std::wstring, std::wstring>> MetadataStore::ListChildrenInForwardLookupTree(std::wstring_view filename) const {
+  std::shared_lock lock(mMutex);
+
   return mRenameStore.ListChildrenInForwardLookupTree(filename);
 }
 
 
 std::vector<std::pair<std::wstring, std::wstring>> MetadataStore::ListChildrenInReverseLookupTree(std::wstring_view filename) const {
+  std::shared_lock lock(mMutex);
+
   return mRenameStore.ListChildrenInReverseLookupTree(filename);
 }
 
 
-void MetadataStore::Rename(std::wstring_view srcFilename, std::wstring_view destFilename) {
+void MetadataStore::RenameL(std::wstring_view srcFilename, std::wstring_view destFilename) {
   if (!util::IsValidHandle(mHFile)) {
     return;
   }
@@ -1031,23 +1892,44 @@ void MetadataStore::Rename(std::wstring_view srcFilename, std::wstring_view dest
 }
 
 
-void MetadataStore::Delete(std::wstring_view filename) {
-  if (!util::IsValidHandle(mHFile)) {
-    return;
+void MetadataStore::Rename(std::wstring_view srcFilename, std::wstring_view destFilename) {
+  {
+    std::lock_guard lock(mMutex);
+
+    RenameL(srcFilename, destFilename);
   }
-  const auto resolvedFilenameN = ResolveFilepath(filename);
-  if (!resolvedFilenameN) {
-    return;
+  CommitJournal();
+}
+
+
+void MetadataStore::Delete(std::wstring_view filename) {
+  {
+    std::lock_guard lock(mMutex);
+
+    if (!util::IsValidHandle(mHFile)) {
+      return;
+    }
+    const auto resolvedFilenameN = mRenameStore.Resolve(filename);
+    if (!resolvedFilenameN) {
+      return;
+    }
+    RenameL(filename, StrRemovedPrefix + resolvedFilenameN.value());
   }
-  Rename(filename, StrRemovedPrefix + resolvedFilenameN.value());
+  CommitJournal();
 }
 
 
 bool MetadataStore::RemoveRenameEntry(std::wstring_view filename) {
-  if (!util::IsValidHandle(mHFile)) {
-    return false;
+  bool result;
+  {
+    std::lock_guard lock(mMutex);
+
+    if (!util::IsValidHandle(mHFile)) {
+      return false;
+    }
+    result = mRenameStore.RemoveEntry(filename);
+    AddRenameAppendix(filename);
   }
-  const auto result = mRenameStore.RemoveEntry(filename);
-  AddRenameAppendix(filename);
+  CommitJournal();
   return result;
 }
@@ -3,10 +3,16 @@
 #include "Metadata.hpp"
 #include "RenameStore.hpp"
 
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
 #include <optional>
 #include <shared_mutex>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -18,35 +24,151 @@ class MetadataStore {
 public:
   static constexpr auto RemovedPrefix = L"\\$MergeFSSystemData\\Removed";
 
+  // 追記部への記録をいつファイルに書き込むか
+  enum class Durability {
+    PerOperation,   // 操作ごとに書き込んでフラッシュしてから戻る（同時に戻る操作の記録はまとめて書き込む）
+    Batched,        // 操作ごとに書き込んでから戻り（OSには渡る）、最大maxCommitDelayの間のフラッシュをまとめて行う
+    OnFlush,        // Flushが呼ばれるか、バッファが一杯になった場合にのみ書き込む
+  };
+
+  static constexpr Durability DefaultDurability = Durability::Batched;
+  static constexpr std::chrono::milliseconds DefaultMaxCommitDelay{10};
+
+  // 存在する間、このスレッドでのこのストアの変更は追記部への記録を書き込まずに戻る
+  // 呼び出し側のロックの中で変更する場合に、ロックを解放してからCommitで書き込むために使う
+  class DeferredCommit {
+    MetadataStore& mStore;
+    DeferredCommit* mOuter;
+    bool mActive = true;
+
+    void Deactivate() noexcept;
+
+  public:
+    DeferredCommit(const DeferredCommit&) = delete;
+
+    explicit DeferredCommit(MetadataStore& store);
+    ~DeferredCommit();
+
+    DeferredCommit& operator=(const DeferredCommit&) = delete;
+
+    // それまでの変更をDurabilityに従って書き込む（以降の変更はすぐに書き込む）
+    void Commit();
+
+    friend class MetadataStore;
+  };
+
 private:
+  struct OverlayEntry {
+    std::optional<Metadata> metadata;   // std::nullopt if removed
+    std::uint64_t sequence;
+  };
+
+  // 圧縮（追記部の統合）の開始時点での状態
+  struct Snapshot {
+    std::vector<std::pair<std::wstring, std::wstring>> renameEntries;
+    std::vector<std::pair<std::wstring, std::optional<Metadata>>> metadataEntries;
+    std::uint64_t sequence;
+    std::uint64_t appendixSize;
+  };
+
   const bool mCaseSensitive;
+  const Durability mDurability = DefaultDurability;
+  const std::chrono::milliseconds mMaxCommitDelay = DefaultMaxCommitDelay;
+  // 圧縮と追記部への書き込みに関するもの以外はmMutexで保護する（マップしている領域の置き換えは排他ロックで行う）
+  mutable std::shared_mutex mMutex;
+  std::wstring mFilePath;
   HANDLE mHFile = NULL;
+  // V3形式のファイルは読み取り専用でマップし、メタデータエントリはインデックスから直接参照する
+  HANDLE mHMapping = NULL;
+  const std::byte* mMappedData = nullptr;
+  std::size_t mMappedSize = 0;
+  std::uint64_t mDataSize = 0;
+  std::uint64_t mAppendixSize = 0;
+  std::uint64_t mSequence = 0;
   RenameStore mRenameStore;
-  std::unordered_map<std::wstring, Metadata> mMetadataMap;
+  // マップしているエントリに対する差分
+  std::unordered_map<std::wstring, OverlayEntry> mMetadataMap;
+  // 追記部が一定の大きさを超えたら、バックグラウンドで統合したファイルを作成して置き換える
+  std::mutex mCompactionMutex;
+  std::condition_variable mCompactionCV;
+  bool mCompactionRequested = false;
+  bool mCompactionTerminate = false;
+  std::thread mCompactionThread;
+  // 追記部への記録はmMutexを保持してmJournalに溜めておき、mMutexを解放してから書き込む（グループコミット）
+  // 書き込みは一つのスレッド（リーダー）がそれまでに溜まった記録をまとめて行い、他のスレッドはその完了を待つ
+  // ロックの順序はmMutex、mJournalWriteMutex、mJournalFlushMutex、mJournalMutexの順
+  std::mutex mJournalWriteMutex;
+  // mHFileの置き換えはmJournalWriteMutexとmJournalFlushMutexの両方を保持して行うので、フラッシュはmJournalFlushMutexだけで行える
+  std::mutex mJournalFlushMutex;
+  std::mutex mJournalMutex;
+  std::condition_variable mJournalCV;
+  std::vector<std::byte> mJournal;
+  // 以下はmJournalMutexで保護する
+  // 記録の位置は開いてからの累計バイト数で表す
+  std::uint64_t mJournalAppendedPosition = 0;   // mJournalに加えた記録の末尾
+  std::uint64_t mJournalWrittenPosition = 0;    // 書き込んだ記録の末尾
+  std::uint64_t mJournalSyncedPosition = 0;     // フラッシュした記録の末尾
+  bool mJournalCommitting = false;              // リーダーが書き込み中か
+  std::condition_variable mJournalCommitCV;
+  // mJournalThreadがフラッシュすべき記録があるか（mJournalMutexで保護する）
+  bool mJournalSyncRequested = false;
+  bool mJournalTerminate = false;
+  std::thread mJournalThread;
 
   std::wstring FilenameToKey(std::wstring_view filename) const;
+  void OpenFile();
+  void MapFile();
+  void UnmapFile() noexcept;
+  const std::byte* GetMappedMetadataEntry(std::size_t index) const;
+  const std::byte* FindMappedMetadataEntryN(std::wstring_view key) const;
+  bool ContainsKey(const std::wstring& key) const;
+  std::optional<Metadata> FindMetadataN(const std::wstring& key) const;
+  void SetOverlayEntryL(std::wstring_view key, std::optional<Metadata> metadata);
+  void LoadRenameSection(const std::byte* begin, const std::byte* end, std::uint64_t count);
+  void LoadAppendix(const std::byte* begin, const std::byte* end);
   void LoadFromFile();
   void LoadFromFileV1();
   bool LoadFromFileV2();
+  bool LoadFromFileV3();
+  Snapshot TakeSnapshotL() const;
+  std::vector<std::byte> BuildFileImage(const Snapshot& snapshot) const;
+  HANDLE WriteTempFile(const std::vector<std::byte>& fileImage) const;
+  void CommitTempFileL(HANDLE hTempFile, const Snapshot& snapshot, std::uint64_t dataSize);
   void SaveToFile();
+  bool NeedsCompactionL() const;
+  void Compact();
+  void RequestCompaction();
+  void StartCompactionThread();
+  void StopCompactionThread();
+  void AppendJournalL(const std::byte* data, std::size_t size);
+  void WriteJournalL();
+  void SyncJournal();
+  void FlushJournal(bool durable);
+  void GroupCommitJournal(std::uint64_t position, bool durable);
+  void CommitJournal();
+  void StartJournalThread();
+  void StopJournalThread();
   void AddRenameAppendix(std::wstring_view a, std::wstring_view b);
   void AddRenameAppendix(std::wstring_view a);
   void AddMetadataAppendix(std::wstring_view keyName, const Metadata& metadata);
   void AddMetadataAppendix(std::wstring_view keyName);
+  void RenameL(std::wstring_view srcFilename, std::wstring_view destFilename);
 
 public:
   MetadataStore(const MetadataStore&) = delete;
 
   MetadataStore() = default;
-  MetadataStore(std::wstring_view storeFileName, bool caseSensitive);
+  MetadataStore(std::wstring_view storeFileName, bool caseSensitive, Durability durability = DefaultDurability, std::chrono::milliseconds maxCommitDelay = DefaultMaxCommitDelay);
   ~MetadataStore();
 
   void SetFilePath(std::wstring_view storeFilename);
+  // 溜まっている追記部への記録を書き込んでフラッシュする
+  void Flush();
   std::optional<std::wstring> ResolveFilepath(std::wstring_view filename) const;
   bool HasMetadataR(std::wstring_view resolvedFilename) const;
   bool HasMetadata(std::wstring_view filename) const;
-  const Metadata& GetMetadataR(std::wstring_view resolvedFilename) const;
-  const Metadata& GetMetadata(std::wstring_view filename) const;
+  Metadata GetMetadataR(std::wstring_view resolvedFilename) const;
+  Metadata GetMetadata(std::wstring_view filename) const;
   Metadata GetMetadata2R(std::wstring_view resolvedFilename) const;
   Metadata GetMetadata2(std::wstring_view filename) const;
   void SetMetadataR(std::wstring_view resolvedFilename, const Metadata& metadata);
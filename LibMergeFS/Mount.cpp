@@ -3,15 +3,21 @@
 #include "Mount.hpp"
 #include "NsError.hpp"
 #include "Util.hpp"
+#include "CacheConfig.hpp"
 #include "DokanConfig.hpp"
+#include "MountConfig.hpp"
 #include "DokanOperations.hpp"
+#include "Transport.hpp"
 
+#include "../SDK/Wildcard.hpp"
 #include "../Util/VirtualFs.hpp"
 
 #include <algorithm>
 #include <cassert>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <ios>
 #include <limits>
@@ -31,11 +37,6 @@ using namespace std::literals;
 
 
 
-std::shared_mutex Mount::gFileContextMapMutex;
-std::unordered_map<Mount::FileContext*, std::shared_ptr<Mount::FileContext>> Mount::gFileContextPtrToSharedPtrMap;
-
-
-
 namespace {
   template<typename T>
   NTSTATUS WrapException(const T& func) noexcept {
@@ -128,12 +129,15 @@ NTSTATUS Mount::FileContext::UpdateLastAccessTime() {
     return __NTSTATUS_FROM_WIN32(GetLastError());
   }
 
+  MetadataStore::DeferredCommit deferredCommit(mount.m_metadataStore);
   {
     std::lock_guard lock(mount.m_metadataMutex);
     auto metadata = mount.m_metadataStore.GetMetadata2R(resolvedFilename);
     metadata.lastAccessTime = currentFiletime;
     mount.m_metadataStore.SetMetadataR(resolvedFilename, metadata);
   }
+  deferredCommit.Commit();
+  mount.InvalidateFindFilesCache(filename);
 
   return STATUS_SUCCESS;
 }
@@ -152,12 +156,15 @@ NTSTATUS Mount::FileContext::UpdateLastWriteTime() {
     return __NTSTATUS_FROM_WIN32(GetLastError());
   }
 
+  MetadataStore::DeferredCommit deferredCommit(mount.m_metadataStore);
   {
     std::lock_guard lock(mount.m_metadataMutex);
     auto metadata = mount.m_metadataStore.GetMetadata2R(resolvedFilename);
     metadata.lastWriteTime = currentFiletime;
     mount.m_metadataStore.SetMetadataR(resolvedFilename, metadata);
   }
+  deferredCommit.Commit();
+  mount.InvalidateFindFilesCache(filename);
 
   return STATUS_SUCCESS;
 }
@@ -169,39 +176,19 @@ bool Mount::HasFileContext(PDOKAN_FILE_INFO DokanFileInfo) noexcept {
 }
 
 
-Mount::FileContext* Mount::GetFileContextPtr(PDOKAN_FILE_INFO DokanFileInfo) noexcept {
-  return reinterpret_cast<FileContext*>(DokanFileInfo->Context);
+// 閉じられたファイルのハンドルで呼び出された場合はnullptrを返す
+std::shared_ptr<Mount::FileContext> Mount::GetFileContextSharedPtrN(PDOKAN_FILE_INFO DokanFileInfo) const {
+  return m_fileContextTable.Get(DokanFileInfo->Context);
 }
 
 
-#ifdef USE_SHARED_PTR_FOR_FILE_CONTEXT
-std::shared_ptr<Mount::FileContext> Mount::GetFileContextSharedPtr(PDOKAN_FILE_INFO DokanFileInfo) {
-  auto ptrFileContext = GetFileContextPtr(DokanFileInfo);
+std::shared_ptr<Mount::FileContext> Mount::GetFileContextSharedPtr(PDOKAN_FILE_INFO DokanFileInfo) const {
+  auto ptrFileContext = GetFileContextSharedPtrN(DokanFileInfo);
   if (!ptrFileContext) {
     throw NsError(STATUS_INVALID_HANDLE);
   }
-  std::shared_lock lock(gFileContextMapMutex);
-  if (!gFileContextPtrToSharedPtrMap.count(ptrFileContext)) {
-    throw NsError(STATUS_INVALID_HANDLE);
-  }
-  return gFileContextPtrToSharedPtrMap.at(ptrFileContext);
-}
-#else
-Mount::FileContext* Mount::GetFileContextSharedPtr(PDOKAN_FILE_INFO DokanFileInfo) {
-  return GetFileContextPtr(DokanFileInfo);
-}
-#endif
-
-
-/*
-Mount::FileContext& Mount::GetFileContext(PDOKAN_FILE_INFO DokanFileInfo) {
-  auto fileContextPtr = GetFileContextPtr(DokanFileInfo);
-  if (!fileContextPtr) {
-    throw NsError(STATUS_INVALID_HANDLE);
-  }
-  return *fileContextPtr;
+  return ptrFileContext;
 }
-//*/
 
 
 NTSTATUS Mount::TransportR(std::wstring_view path, bool empty, FILE_CONTEXT_ID fileContextId, MountSource& source, MountSource& destination) {
@@ -214,43 +201,7 @@ NTSTATUS Mount::TransportR(std::wstring_view path, bool empty, FILE_CONTEXT_ID f
     empty ? TRUE : FALSE,
   };
 
-  if (const auto status = source.ExportStart(&portationInfo); status != STATUS_SUCCESS) {
-    return status;
-  }
-
-  if (const auto status = destination.ImportStart(&portationInfo); status != STATUS_SUCCESS) {
-    source.ExportFinish(&portationInfo, false);
-    return status;
-  }
-
-  if (!empty && !portationInfo.directory) {
-    while (true) {
-      const auto statusS = source.ExportData(&portationInfo);
-      if (statusS == STATUS_ALREADY_COMPLETE) {
-        break;
-      }
-      if (statusS != STATUS_SUCCESS) {
-        source.ExportFinish(&portationInfo, false);
-        destination.ImportFinish(&portationInfo, false);
-        return statusS;
-      }
-
-      if (const auto statusD = destination.ImportData(&portationInfo); statusD != STATUS_SUCCESS) {
-        return statusD;
-      }
-    }
-  }
-
-  if (const auto status = destination.ImportFinish(&portationInfo, true); status != STATUS_SUCCESS) {
-    source.ExportFinish(&portationInfo, false);
-    return status;
-  }
-
-  if (const auto status = source.ExportFinish(&portationInfo, true); status != STATUS_SUCCESS) {
-    return status;
-  }
-
-  return STATUS_SUCCESS;
+  return TransportFile(source, destination, portationInfo);
 }
 
 
@@ -259,12 +210,11 @@ std::wstring Mount::FilenameToKey(std::wstring_view filename) const {
 }
 
 
-Mount::Mount(std::wstring_view mountPoint, bool writable, std::wstring_view metadataFileName, bool deferCopyEnabled, bool caseSensitive, const VolumeInfoOverride& volumeInfoOverride, std::vector<std::unique_ptr<MountSource>>&& sources, std::function<void(Mount&, int)> callback) :
+Mount::Mount(std::wstring_view mountPoint, bool writable, std::wstring_view metadataFileName, bool deferCopyEnabled, bool caseSensitive, const VolumeInfoOverride& volumeInfoOverride, const MetadataOptions& metadataOptions, std::vector<std::unique_ptr<MountSource>>&& sources, std::function<void(Mount&, int)> callback) :
   m_imdMutex(),
   m_imdCv(),
   m_imdState(ImdState::Pending),
   m_imdResult(DOKAN_SUCCESS),
-  m_mutex(),
   m_metadataMutex(),
   m_mountPoint(mountPoint),
   m_mountSources(std::move(sources)),
@@ -274,10 +224,17 @@ Mount::Mount(std::wstring_view mountPoint, bool writable, std::wstring_view meta
   m_deferCopyEnabled(deferCopyEnabled),
   m_caseSensitive(caseSensitive),
   m_volumeInfoOverride(volumeInfoOverride),
-  m_metadataStore(m_metadataFileName, caseSensitive),
-  m_fileContextMap(),
-  m_minimumUnusedFileContextId(FileContextIdStart),
+  m_metadataStore(m_metadataFileName, caseSensitive, metadataOptions.durability, metadataOptions.maxCommitDelay),
+  m_layerResolver(m_mountSources, caseSensitive, [this](std::wstring_view resolvedFilename) {
+    std::shared_lock lock(m_metadataMutex);
+    return m_metadataStore.ExistsR(resolvedFilename);
+  }, CacheConfig::SourceIndexCacheCapacity, CacheConfig::SourceIndexCacheTTL),
+  m_findFilesCache(CacheConfig::FindFilesCacheCapacity, CacheConfig::FindFilesCacheTTL),
+  m_pathPool(),
+  m_fileContextTable(),
+  m_fileContextIdAllocator(FileContextIdStart, FileContextIdReuseDelay),
   m_fileIndexBases(CalcFileIndexBases(m_mountSources.size())),
+  m_findFilesThreadPool(std::min(MountConfig::FindFilesWorkerCount, m_mountSources.size() - 1)),
   m_thread([this, callback]() {
     // TODO: make customizable
     ULONG options = DokanConfig::Options;
@@ -349,6 +306,15 @@ bool Mount::IsWritable() const {
 }
 
 
+Mount::CacheStatistics Mount::GetCacheStatistics() const {
+  return {
+    m_layerResolver.GetStatistics(),
+    m_findFilesCache.GetStatistics(),
+    m_pathPool.GetStatistics(),
+  };
+}
+
+
 bool Mount::SafeUnmount() {
   {
     std::lock_guard lock(m_imdMutex);
@@ -391,40 +357,37 @@ std::wstring Mount::ResolveFilepath(std::wstring_view filename) {
 }
 
 
-std::optional<std::size_t> Mount::GetMountSourceIndexR(std::wstring_view resolvedFilename) {
-  if (util::vfs::IsRootDirectory(resolvedFilename)) {
-    return TopSourceIndex;
-  }
+Mount::SourceLookupResult Mount::LookupSourceR(std::wstring_view resolvedFilename) {
+  return m_layerResolver.Lookup(resolvedFilename);
+}
 
-  // 祖先ディレクトリの正当性を確認する
-  // 祖先ディレクトリがここより優先度の高いソースにおいてファイルとして存在しているか、
-  // メタデータにより削除済みとマークされている場合は対象のオブジェクトは存在しない
-  // ここでは直属の親ディレクトリに対してGetMountSourceIndexを呼び出して確認することで再帰的にチェックしている
-  const std::wstring parentFilename(util::vfs::GetParentPath(resolvedFilename));
-  const auto index = GetMountSourceIndexR(parentFilename);
-  if (!index || m_mountSources[index.value()]->GetFileType(parentFilename.c_str()) != FileType::Directory) {
-    return std::nullopt;
-  }
 
-  // メタデータにより削除済みとマークされている場合は存在しない
-  {
-    std::shared_lock lock(m_metadataMutex);
-    if (!m_metadataStore.ExistsR(resolvedFilename)) {
-      return std::nullopt;
-    }
+// ソース上のオブジェクトを作成、削除、移動したときや、存在に影響するメタデータを変更したときに、その変更の後で呼び出す
+// 子孫のエントリも併せて無効化される
+void Mount::InvalidateCachesR(std::wstring_view resolvedFilename) {
+  const auto key = FilenameToKey(resolvedFilename);
+  m_layerResolver.Invalidate(resolvedFilename);
+  m_findFilesCache.Invalidate(key);
+  if (!util::vfs::IsRootDirectory(resolvedFilename)) {
+    m_findFilesCache.InvalidateEntry(FilenameToKey(util::vfs::GetParentPath(resolvedFilename)));
   }
+}
 
-  // それ以外の場合、一番上位のソースに存在するものを探す
-  const std::wstring sResolvedFilename(resolvedFilename);
-  for (std::size_t i = 0; i < m_mountSources.size(); i++) {
-    const auto& mountSource = *m_mountSources[i];
-    if (mountSource.GetFileType(sResolvedFilename.c_str()) != FileType::Inexistent) {
-      return i;
-    }
+
+// ファイルの属性やタイムスタンプ、サイズ、（メタデータ上の）名前を変更したときに呼び出す
+// filenameを含むディレクトリの一覧のみが無効化される
+void Mount::InvalidateFindFilesCache(std::wstring_view filename) {
+  if (!m_findFilesCache.IsEnabled() || util::vfs::IsRootDirectory(filename)) {
+    return;
+  }
+  if (const auto resolvedParentFilenameN = ResolveFilepathN(util::vfs::GetParentPath(filename))) {
+    m_findFilesCache.InvalidateEntry(FilenameToKey(resolvedParentFilenameN.value()));
   }
+}
+
 
-  // 見つからなかった
-  return std::nullopt;
+std::optional<std::size_t> Mount::GetMountSourceIndexR(std::wstring_view resolvedFilename) {
+  return LookupSourceR(resolvedFilename).sourceIndex;
 }
 
 
@@ -443,15 +406,7 @@ bool Mount::FileExists(std::wstring_view filename) {
 
 
 Mount::FileType Mount::GetFileTypeR(std::wstring_view resolvedFilename) {
-  if (util::vfs::IsRootDirectory(resolvedFilename)) {
-    return FileType::Directory;
-  }
-  const auto index = GetMountSourceIndexR(resolvedFilename);
-  if (!index) {
-    return FileType::Inexistent;
-  }
-  const std::wstring sResolvedFilename(resolvedFilename);
-  return m_mountSources[index.value()]->GetFileType(sResolvedFilename.c_str());
+  return LookupSourceR(resolvedFilename).fileType;
 }
 
 
@@ -509,6 +464,7 @@ void Mount::CopyFileToTopSourceR(std::wstring_view resolvedFilename, bool empty,
       auto& source = *m_mountSources.at(sourceIndex.value());
 
       const auto status = TransportR(path, empty, fileContextId, source, m_topSource);
+      InvalidateCachesR(path);
       if (status != STATUS_SUCCESS) {
         throw NsError(status);
       }
@@ -536,39 +492,43 @@ void Mount::RemoveFile(std::wstring_view filename) {
   bool editMetadata = true;
 
   if (sourceIndex == TopSourceIndex) {
-    if (const auto status = m_mountSources[sourceIndex.value()]->RemoveFile(resolvedFileName.c_str()); status != STATUS_SUCCESS) {
+    const auto status = m_mountSources[sourceIndex.value()]->RemoveFile(resolvedFileName.c_str());
+    InvalidateCachesR(resolvedFileName);
+    if (status != STATUS_SUCCESS) {
       throw NsError(status);
     }
     editMetadata = FileExists(filename);
   }
 
   if (editMetadata) {
-    std::lock_guard lock(m_metadataMutex);
-    m_metadataStore.Delete(filename);
+    MetadataStore::DeferredCommit deferredCommit(m_metadataStore);
+    {
+      std::lock_guard lock(m_metadataMutex);
+      m_metadataStore.Delete(filename);
+    }
+    deferredCommit.Commit();
+    InvalidateCachesR(resolvedFileName);
   }
+
+  InvalidateFindFilesCache(filename);
 }
 
 
 Mount::FILE_CONTEXT_ID Mount::AssignFileContextId(std::wstring_view FileName, std::wstring_view ResolvedFileName, PDOKAN_FILE_INFO DokanFileInfo, std::size_t mountSourceIndex, bool isDirectory, bool deferCopy, PDOKAN_IO_SECURITY_CONTEXT SecurityContext, ACCESS_MASK DesiredAccess, ULONG FileAttributes, ULONG ShareAccess, ULONG CreateDisposition, ULONG CreateOptions) {
-  if (const auto fileContextPtr = GetFileContextPtr(DokanFileInfo)) {
-    return fileContextPtr->id;
+  if (const auto ptrFileContext = GetFileContextSharedPtrN(DokanFileInfo)) {
+    return ptrFileContext->id;
   }
 
-  std::lock_guard lock(m_mutex);
-
-  const FILE_CONTEXT_ID id = m_minimumUnusedFileContextId;
-  do {
-    m_minimumUnusedFileContextId++;
-  } while (m_fileContextMap.count(m_minimumUnusedFileContextId));
+  const FILE_CONTEXT_ID id = m_fileContextIdAllocator.Allocate();
 
   const bool writable = m_writable && mountSourceIndex == TopSourceIndex;
-  auto ptrFileContext = new FileContext{
+  auto ptrFileContext = std::shared_ptr<FileContext>(new FileContext{
     std::shared_mutex(),
     id,
     *this,
     *m_mountSources[mountSourceIndex].get(),
-    std::wstring(FileName),
-    std::wstring(ResolvedFileName),
+    m_pathPool.Intern(FileName),
+    m_pathPool.Intern(ResolvedFileName),
     isDirectory,
     writable,
     deferCopy,
@@ -581,16 +541,8 @@ Mount::FILE_CONTEXT_ID Mount::AssignFileContextId(std::wstring_view FileName, st
     ShareAccess,
     CreateDisposition,
     CreateOptions,
-  };
-#ifdef USE_SHARED_PTR_FOR_FILE_CONTEXT
-  std::lock_guard glock(gFileContextMapMutex);
-  std::shared_ptr<FileContext> spFileContext(ptrFileContext);
-  m_fileContextMap.emplace(id, spFileContext);
-  gFileContextPtrToSharedPtrMap.emplace(ptrFileContext, spFileContext);
-#else
-  m_fileContextMap.emplace(id, std::move(std::unique_ptr<FileContext>(ptrFileContext)));
-#endif
-  DokanFileInfo->Context = reinterpret_cast<ULONG64>(ptrFileContext);
+  });
+  DokanFileInfo->Context = m_fileContextTable.Insert(std::move(ptrFileContext));
 
   return id;
 }
@@ -598,27 +550,7 @@ Mount::FILE_CONTEXT_ID Mount::AssignFileContextId(std::wstring_view FileName, st
 
 bool Mount::ReleaseFileContextId(FILE_CONTEXT_ID FileContextId) noexcept {
   try {
-    if (FileContextId < FileContextIdStart) {
-      return false;
-    }
-    std::lock_guard lock(m_mutex);
-    if (FileContextId < m_minimumUnusedFileContextId) {
-      m_minimumUnusedFileContextId = FileContextId;
-    }
-#ifdef USE_SHARED_PTR_FOR_FILE_CONTEXT
-# ifdef _DEBUG
-    assert(m_fileContextMap.count(FileContextId));
-    // use_count will be usually 3 (+1 for m_fileContextMap and +1 for gFileContextPtrToSharedPtrMap and +1 for ptrFileContext in DCloseFile)
-    const std::size_t useCount = m_fileContextMap.at(FileContextId).use_count();
-    //assert(useCount == 3);
-    if (useCount != 3) {
-      OutputDebugStringW((L"### FileContext "s + std::to_wstring(FileContextId) + L" released with use count "s + std::to_wstring(useCount) + L"\n"s).c_str());
-    }
-# endif
-    std::lock_guard glock(gFileContextMapMutex);
-    gFileContextPtrToSharedPtrMap.erase(m_fileContextMap.at(FileContextId).get());
-#endif
-    return m_fileContextMap.erase(FileContextId);
+    return m_fileContextIdAllocator.Release(FileContextId);
   } catch (...) {}
   return false;
 }
@@ -629,9 +561,21 @@ bool Mount::ReleaseFileContextId(PDOKAN_FILE_INFO DokanFileInfo) noexcept {
     if (!DokanFileInfo->Context) {
       return false;
     }
-    const auto id = GetFileContextPtr(DokanFileInfo)->id;
+    // テーブルから取り除いた時点で以後このハンドルによる参照は失敗するようになる
+    // 実行中の他の操作が保持している参照はそれぞれの終了時に解放される
+    const auto ptrFileContext = m_fileContextTable.Remove(DokanFileInfo->Context);
     DokanFileInfo->Context = NULL;
-    return ReleaseFileContextId(id);
+    if (!ptrFileContext) {
+      return false;
+    }
+#ifdef _DEBUG
+    // use_count will be usually 2 (+1 for this function and +1 for ptrFileContext in DCloseFile)
+    const std::size_t useCount = ptrFileContext.use_count();
+    if (useCount != 2) {
+      OutputDebugStringW((L"### FileContext "s + std::to_wstring(ptrFileContext->id) + L" released with use count "s + std::to_wstring(useCount) + L"\n"s).c_str());
+    }
+#endif
+    return ReleaseFileContextId(ptrFileContext->id);
   } catch (...) {}
   return false;
 }
@@ -661,6 +605,7 @@ NTSTATUS Mount::TransportIfNeeded(PDOKAN_FILE_INFO DokanFileInfo) {
       if (const auto status = m_topSource.SwitchDestinationOpen(fileContext.resolvedFilename.c_str(), &fileContext.SecurityContext, fileContext.DesiredAccess, fileContext.FileAttributes, fileContext.ShareAccess, fileContext.CreateDisposition, fileContext.CreateOptions, DokanFileInfo, fileContext.id); status != STATUS_SUCCESS) {
         return status;
       }
+      InvalidateCachesR(fileContext.resolvedFilename);
       // transport
       try {
         if (const auto status = TransportR(fileContext.resolvedFilename, false, fileContext.id, source, m_topSource); status != STATUS_SUCCESS) {
@@ -669,6 +614,7 @@ NTSTATUS Mount::TransportIfNeeded(PDOKAN_FILE_INFO DokanFileInfo) {
         //CopyFileToTopSourceR(fileContext.resolvedFilename, false, fileContext.id);
       } catch (...) {
         m_topSource.SwitchDestinationClose(fileContext.resolvedFilename.c_str(), DokanFileInfo, fileContext.id);
+        InvalidateCachesR(fileContext.resolvedFilename);
         throw;
       }
       if (const auto status = oldMountSource.SwitchSourceClose(fileContext.resolvedFilename.c_str(), DokanFileInfo, fileContext.id); status != STATUS_SUCCESS) {
@@ -683,6 +629,232 @@ NTSTATUS Mount::TransportIfNeeded(PDOKAN_FILE_INFO DokanFileInfo) {
 }
 
 
+// DFindFilesとDFindFilesWithPatternの共通部分
+// 各ソースの一覧をマージし、メタデータを反映したものをfindDataMapに格納する
+// searchPatternがnullptrでなければ、それに一致するファイルのみを格納する（各ソースにも可能であればフィルタさせる）
+NTSTATUS Mount::ListMergedFiles(const FileContext& fileContext, LPCWSTR searchPattern, std::map<std::wstring, WIN32_FIND_DATAW>& findDataMap) {
+  const bool isRootDirectory = util::vfs::IsRootDirectory(fileContext.filename);
+  const std::wstring& resolvedFilename = fileContext.resolvedFilename;
+
+  //
+  std::vector<std::pair<std::wstring, std::wstring>> excludeList;
+  std::vector<std::pair<std::wstring, std::wstring>> includeList;
+  {
+    std::shared_lock lock(m_metadataMutex);
+    excludeList = m_metadataStore.ListChildrenInReverseLookupTree(fileContext.filename);
+    includeList = m_metadataStore.ListChildrenInForwardLookupTree(fileContext.filename);
+  }
+
+  std::unordered_set<std::wstring> excludeSet;
+  for (const auto& [key, value] : excludeList) {
+    excludeSet.emplace(FilenameToKey(key));
+  }
+
+  const auto resolvedDirectoryPrefix = resolvedFilename + L"\\";
+
+  // list files
+  // 遅いソース（アーカイブ等）があっても全体の待ち時間が合計にならないよう、各ソースの列挙は並列に行う
+  // ここでは結果を集めるだけで、マージは後で優先度順に行う
+  struct SourceListing {
+    NTSTATUS status;
+    NTSTATUS statusFromCallback;
+    std::vector<WIN32_FIND_DATAW> findDataList;
+  };
+
+  std::vector<SourceListing> sourceListings(m_mountSources.size());
+  m_findFilesThreadPool.RunParallel(m_mountSources.size(), [this, &resolvedFilename, searchPattern, &sourceListings](std::size_t sourceIndex) {
+    auto& sourceListing = sourceListings[sourceIndex];
+    sourceListing.statusFromCallback = STATUS_SUCCESS;
+    sourceListing.status = m_mountSources[sourceIndex]->ListFilesWithPattern(resolvedFilename.c_str(), searchPattern, [&sourceListing](PWIN32_FIND_DATAW ptrFindData) noexcept {
+      if (sourceListing.statusFromCallback != STATUS_SUCCESS) {
+        return;
+      }
+      if (!ptrFindData) {
+        sourceListing.statusFromCallback = STATUS_ACCESS_VIOLATION;
+        return;
+      }
+      sourceListing.statusFromCallback = WrapExceptionV([&]() {
+        sourceListing.findDataList.emplace_back(*ptrFindData);
+      });
+    });
+  });
+
+  // merge
+  bool isFirst = true;
+  for (std::size_t i = 0; i < m_mountSources.size(); i++) {
+    const bool canAddCurrentAndParentDirectory = !isRootDirectory && isFirst;
+
+    const auto& [status, statusFromCallback, findDataList] = sourceListings[i];
+    if (status == STATUS_OBJECT_NAME_NOT_FOUND || status == STATUS_OBJECT_PATH_NOT_FOUND) {
+      // ディレクトリの存在しないソースは無視
+      continue;
+    }
+    if (!isFirst && status == STATUS_NOT_A_DIRECTORY) {
+      // 2番目以降のソースでディレクトリ以外として存在している場合は無視
+      continue;
+    }
+    if (status != STATUS_SUCCESS) {
+      return status;
+    }
+    if (statusFromCallback != STATUS_SUCCESS) {
+      return statusFromCallback;
+    }
+
+    std::shared_lock lock(m_metadataMutex);
+    for (auto findData : findDataList) {
+      const std::wstring wsFileName(findData.cFileName);
+      const std::wstring wsKey(FilenameToKey(wsFileName));
+      if (!canAddCurrentAndParentDirectory && (wsFileName == L"."sv || wsFileName == L".."sv)) {
+        continue;
+      }
+      if (excludeSet.count(wsKey)) {
+        continue;
+      }
+      if (findDataMap.count(wsKey)) {
+        continue;
+      }
+      // refer metadata if available
+      // excludeSetに登録されていないということは、このファイルはリネームされていない
+      if (i != TopSourceIndex) {
+        const auto resolvedFilepath = resolvedDirectoryPrefix + wsFileName;
+        if (m_metadataStore.HasMetadataR(resolvedFilepath)) {
+          const auto& metadata = m_metadataStore.GetMetadataR(resolvedFilepath);
+          if (metadata.fileAttributes) {
+            findData.dwFileAttributes = metadata.fileAttributes.value();
+          }
+          if (metadata.creationTime) {
+            findData.ftCreationTime = metadata.creationTime.value();
+          }
+          if (metadata.lastAccessTime) {
+            findData.ftLastAccessTime = metadata.lastAccessTime.value();
+          }
+          if (metadata.lastWriteTime) {
+            findData.ftLastWriteTime = metadata.lastWriteTime.value();
+          }
+        }
+      }
+      findDataMap.emplace(wsKey, findData);
+    }
+
+    isFirst = false;
+  }
+
+  if (isFirst) {
+    // TODO: STATUS_OBJECT_NAME_NOT_FOUNDとSTATUS_OBJECT_PATH_NOT_FOUNDの使い分け
+    return STATUS_OBJECT_PATH_NOT_FOUND;
+  }
+
+
+  //
+  auto addObject = [this, &findDataMap](std::wstring_view filename, std::wstring_view resolvedFullPath, bool forceAddAsDirectory) -> NTSTATUS {
+    const std::wstring wsKey = FilenameToKey(filename);
+    if (findDataMap.count(wsKey)) {
+      return STATUS_OBJECT_NAME_COLLISION;
+    }
+
+    WIN32_FILE_ATTRIBUTE_DATA Win32FileAttributeData{
+      FILE_ATTRIBUTE_DIRECTORY,
+      {0, 0},
+      {0, 0},
+      {0, 0},
+      0,
+      0,
+    };
+
+    const auto sourceIndex = GetMountSourceIndexR(resolvedFullPath);
+    if (!forceAddAsDirectory && !sourceIndex) {
+      // TODO: STATUS_OBJECT_NAME_NOT_FOUNDとSTATUS_OBJECT_PATH_NOT_FOUNDの使い分け
+      return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+
+    const std::wstring sResolvedFullPath(resolvedFullPath);
+    if (const auto status = m_mountSources[sourceIndex.value()]->GetFileInfo(sResolvedFullPath.c_str(), &Win32FileAttributeData); status != STATUS_SUCCESS) {
+      return status;
+    }
+
+    if (sourceIndex != TopSourceIndex) {
+      std::shared_lock lock(m_metadataMutex);
+      if (m_metadataStore.HasMetadataR(resolvedFullPath)) {
+        const auto& metadata = m_metadataStore.GetMetadataR(resolvedFullPath);
+        if (metadata.fileAttributes) {
+          Win32FileAttributeData.dwFileAttributes = metadata.fileAttributes.value();
+        }
+        if (metadata.creationTime) {
+          Win32FileAttributeData.ftCreationTime = metadata.creationTime.value();
+        }
+        if (metadata.lastAccessTime) {
+          Win32FileAttributeData.ftLastAccessTime = metadata.lastAccessTime.value();
+        }
+        if (metadata.lastWriteTime) {
+          Win32FileAttributeData.ftLastWriteTime = metadata.lastWriteTime.value();
+        }
+      }
+    }
+
+    Win32FileAttributeData.dwFileAttributes &= ~static_cast<DWORD>(FILE_ATTRIBUTE_REPARSE_POINT);
+
+    WIN32_FIND_DATAW findData = {
+      Win32FileAttributeData.dwFileAttributes,
+      Win32FileAttributeData.ftCreationTime,
+      Win32FileAttributeData.ftLastAccessTime,
+      Win32FileAttributeData.ftLastWriteTime,
+      Win32FileAttributeData.nFileSizeHigh,
+      Win32FileAttributeData.nFileSizeLow,
+      0,    // ?
+      0,    // ?
+    };
+    const std::size_t size = std::min(sizeof(findData.cFileName) / sizeof(wchar_t) - 1, filename.size());
+    memcpy(findData.cFileName, filename.data(), size * sizeof(wchar_t));
+    findData.cFileName[size] = L'\0';
+    findData.cAlternateFileName[0] = L'\0';
+
+    findDataMap.emplace(wsKey, findData);
+
+    return STATUS_SUCCESS;
+  };
+
+  // add files in includeList
+  for (const auto& [key, value] : includeList) {
+    if (searchPattern && !Wildcard::Match(searchPattern, key, m_caseSensitive)) {
+      continue;
+    }
+    if (const auto status = addObject(key, value, false); status != STATUS_SUCCESS) {
+      return status;
+    }
+  }
+
+  // add . and .. for non-root directory
+  if (!isRootDirectory) {
+    if (!searchPattern || Wildcard::Match(searchPattern, L"."sv, m_caseSensitive)) {
+      if (const auto status = addObject(L"."sv, resolvedFilename, true); status != STATUS_SUCCESS && status != STATUS_OBJECT_NAME_COLLISION) {
+        return status;
+      }
+    }
+    if (!searchPattern || Wildcard::Match(searchPattern, L".."sv, m_caseSensitive)) {
+      if (const auto status = addObject(L".."sv, util::vfs::GetParentPath(resolvedFilename), true); status != STATUS_SUCCESS && status != STATUS_OBJECT_NAME_COLLISION) {
+        return status;
+      }
+    }
+  }
+
+  return STATUS_SUCCESS;
+}
+
+
+// キャッシュされたマージ結果を取得する（キャッシュに無いか、別の仮想パスで開かれたときのものであればnullptr）
+std::shared_ptr<const std::vector<WIN32_FIND_DATAW>> Mount::GetCachedFindDataListN(const FileContext& fileContext) {
+  if (!m_findFilesCache.IsEnabled()) {
+    return nullptr;
+  }
+  // 同じ実体でもメタデータ上のリネームにより別の名前で開かれている場合は内容が異なり得るので、仮想パスも照合する
+  const auto cacheEntryN = m_findFilesCache.Get(FilenameToKey(fileContext.resolvedFilename));
+  if (!cacheEntryN || cacheEntryN->filenameKey != FilenameToKey(fileContext.filename)) {
+    return nullptr;
+  }
+  return cacheEntryN->findDataList;
+}
+
+
 /*
 CreateFile Dokan API callback.
 
@@ -757,10 +929,15 @@ NTSTATUS Mount::DZwCreateFile(LPCWSTR FileName, PDOKAN_IO_SECURITY_CONTEXT Secur
       }
 
       // メタデータを消しておく
+      MetadataStore::DeferredCommit deferredCommit(m_metadataStore);
       {
         std::lock_guard lock(m_metadataMutex);
         m_metadataStore.RemoveMetadata(FileName);
       }
+      deferredCommit.Commit();
+      if (resolvedFilenameN) {
+        InvalidateCachesR(resolvedFilenameN.value());
+      }
 
       // mutateeに対して操作
       // 既にtargetSourceIndex == TopSourceIndex
@@ -882,15 +1059,28 @@ NTSTATUS Mount::DZwCreateFile(LPCWSTR FileName, PDOKAN_IO_SECURITY_CONTEXT Secur
 
     const auto status = targetSource.DZwCreateFile(resolvedFilename.c_str(), SecurityContext, DesiredAccess, FileAttributes, ShareAccess, CreateDisposition, CreateOptions, DokanFileInfo, deferCopy, fileContextId);
 
+    if (existingFileType == FileType::Inexistent || deferCopy) {
+      InvalidateCachesR(resolvedFilename);
+    }
+
     if (status != STATUS_SUCCESS && (status != STATUS_OBJECT_NAME_COLLISION || !createAlways)) {
       return status;
     }
 
     if (!resolvedFilenameN) {
       // TODO: もっと効率良く書く
-      std::lock_guard lock(m_metadataMutex);
-      m_metadataStore.Rename(std::wstring(util::vfs::GetParentPath(FileName)) + std::wstring(util::vfs::GetBaseName(resolvedFilename)), FileName);
-      //m_metadataStore.Rename(resolvedFilename, FileName);
+      MetadataStore::DeferredCommit deferredCommit(m_metadataStore);
+      {
+        std::lock_guard lock(m_metadataMutex);
+        m_metadataStore.Rename(std::wstring(util::vfs::GetParentPath(FileName)) + std::wstring(util::vfs::GetBaseName(resolvedFilename)), FileName);
+        //m_metadataStore.Rename(resolvedFilename, FileName);
+      }
+      deferredCommit.Commit();
+      InvalidateCachesR(resolvedFilename);
+    }
+
+    if (!resolvedFilenameN || willBeReplaced) {
+      InvalidateFindFilesCache(FileName);
     }
 
     if (existingFileType != FileType::Inexistent && createAlways) {
@@ -926,6 +1116,10 @@ void Mount::DCleanup(LPCWSTR FileName, PDOKAN_FILE_INFO DokanFileInfo) noexcept
       // Cleanup後CloseFile前にもファイルハンドルを要求されることがあるため、ここで削除するのが正しいかは分からない
       // が、ドキュメントによれば削除しろとのこと
       RemoveFile(FileName);
+    } else if (fileContext.writable && (fileContext.DesiredAccess & (FILE_WRITE_DATA | FILE_APPEND_DATA | GENERIC_ALL | GENERIC_WRITE))) {
+      // 書き込みによるサイズや最終更新日時の変化を一覧に反映させる
+      // NTFSと同様、ハンドルが閉じられるまでは一覧上の情報が古いままであることを許容する
+      InvalidateFindFilesCache(fileContext.filename);
     }
     // メモリリークを避けるためにCleanupでContextを解放しろと書かれているが、この後CloseFileでも使うためここでは解放しない
     // メモリリークするかも
@@ -951,6 +1145,10 @@ void Mount::DCloseFile(LPCWSTR FileName, PDOKAN_FILE_INFO DokanFileInfo) noexcep
     if (fileContext.copyDeferred) {
       m_topSource.SwitchDestinationClose(fileContext.resolvedFilename.c_str(), DokanFileInfo, fileContext.id);
     }
+    if (DokanFileInfo->DeleteOnClose) {
+      // ソースによってはCloseFileの時点で削除が行われる
+      InvalidateCachesR(fileContext.resolvedFilename);
+    }
     ReleaseFileContextId(DokanFileInfo);
   } catch (...) {}
 }
@@ -1025,6 +1223,8 @@ NTSTATUS Mount::DFlushFileBuffers(LPCWSTR FileName, PDOKAN_FILE_INFO DokanFileIn
     }
     auto ptrFileContext = GetFileContextSharedPtr(DokanFileInfo);
     auto& fileContext = *ptrFileContext;
+    // 属性やリネームなどのメタデータの変更もここで永続化する
+    m_metadataStore.Flush();
     if (fileContext.copyDeferred) {
       return STATUS_SUCCESS;
     }
@@ -1097,189 +1297,82 @@ It is recommended to have this implemented for performance reason.
 */
 NTSTATUS Mount::DFindFiles(LPCWSTR FileName, PFillFindData FillFindData, PDOKAN_FILE_INFO DokanFileInfo) noexcept {
   return WrapException([=]() -> NTSTATUS {
-    const bool isRootDirectory = util::vfs::IsRootDirectory(FileName);
-    std::map<std::wstring, WIN32_FIND_DATAW> findDataMap;
-
     //const auto resolvedFilename = ResolveFilepath(FileName);
     auto ptrFileContext = GetFileContextSharedPtr(DokanFileInfo);
     auto& fileContext = *ptrFileContext;
-    const auto& resolvedFilename = fileContext.resolvedFilename;
 
-    //
-    std::vector<std::pair<std::wstring, std::wstring>> excludeList;
-    std::vector<std::pair<std::wstring, std::wstring>> includeList;
-    {
-      std::shared_lock lock(m_metadataMutex);
-      excludeList = m_metadataStore.ListChildrenInReverseLookupTree(fileContext.filename);
-      includeList = m_metadataStore.ListChildrenInForwardLookupTree(fileContext.filename);
+    // エクスプローラー等は同じディレクトリを短時間に何度も列挙するため、マージ結果をキャッシュする
+    if (const auto cachedFindDataList = GetCachedFindDataListN(fileContext)) {
+      for (auto findData : *cachedFindDataList) {
+        FillFindData(&findData, DokanFileInfo);
+      }
+      return STATUS_SUCCESS;
     }
+    const auto cacheGeneration = m_findFilesCache.GetGeneration();
 
-    std::unordered_set<std::wstring> excludeSet;
-    for (const auto& [key, value] : excludeList) {
-      excludeSet.emplace(FilenameToKey(key));
+    std::map<std::wstring, WIN32_FIND_DATAW> findDataMap;
+    if (const auto status = ListMergedFiles(fileContext, nullptr, findDataMap); status != STATUS_SUCCESS) {
+      return status;
     }
 
-    const auto resolvedDirectoryPrefix = resolvedFilename + L"\\";
-
-    // list files
-    bool isFirst = true;
-    for (std::size_t i = 0; i < m_mountSources.size(); i++) {
-      const bool canAddCurrentAndParentDirectory = !isRootDirectory && isFirst;
-
-      auto& mountSource = *m_mountSources[i];
-      NTSTATUS statusFromCallback = STATUS_SUCCESS;
-      const auto status = mountSource.ListFiles(resolvedFilename.c_str(), [this, sourceIndex = i, &resolvedDirectoryPrefix, &excludeSet, &findDataMap, canAddCurrentAndParentDirectory, &statusFromCallback](PWIN32_FIND_DATAW ptrFindData) noexcept {
-        if (statusFromCallback != STATUS_SUCCESS) {
-          return;
-        }
-        if (!ptrFindData) {
-          statusFromCallback = STATUS_ACCESS_VIOLATION;
-          return;
-        }
-        statusFromCallback = WrapExceptionV([&]() {
-          WIN32_FIND_DATAW findData(*ptrFindData);
-
-          const std::wstring wsFileName(findData.cFileName);
-          const std::wstring wsKey(FilenameToKey(wsFileName));
-          if (!canAddCurrentAndParentDirectory && (wsFileName == L"."sv || wsFileName == L".."sv)) {
-            return;
-          }
-          if (excludeSet.count(wsKey)) {
-            return;
-          }
-          if (findDataMap.count(wsKey)) {
-            return;
-          }
-          // refer metadata if available
-          // excludeSetに登録されていないということは、このファイルはリネームされていない
-          if (sourceIndex != TopSourceIndex) {
-            std::shared_lock lock(m_metadataMutex);
-            const auto resolvedFilepath = resolvedDirectoryPrefix + wsFileName;
-            if (m_metadataStore.HasMetadataR(resolvedFilepath)) {
-              const auto& metadata = m_metadataStore.GetMetadataR(resolvedFilepath);
-              if (metadata.fileAttributes) {
-                findData.dwFileAttributes = metadata.fileAttributes.value();
-              }
-              if (metadata.creationTime) {
-                findData.ftCreationTime = metadata.creationTime.value();
-              }
-              if (metadata.lastAccessTime) {
-                findData.ftLastAccessTime = metadata.lastAccessTime.value();
-              }
-              if (metadata.lastWriteTime) {
-                findData.ftLastWriteTime = metadata.lastWriteTime.value();
-              }
-            }
-          }
-          findDataMap.emplace(wsKey, findData);
-        });
-      });
-      if (status == STATUS_OBJECT_NAME_NOT_FOUND || status == STATUS_OBJECT_PATH_NOT_FOUND) {
-        // ディレクトリの存在しないソースは無視
-        continue;
-      }
-      if (!isFirst && status == STATUS_NOT_A_DIRECTORY) {
-        // 2番目以降のソースでディレクトリ以外として存在している場合は無視
-        continue;
-      }
-      if (status != STATUS_SUCCESS) {
-        return status;
+    // store to cache
+    if (m_findFilesCache.IsEnabled()) {
+      const auto cacheKey = FilenameToKey(fileContext.resolvedFilename);
+      auto filenameKey = FilenameToKey(fileContext.filename);
+      auto findDataList = std::make_shared<std::vector<WIN32_FIND_DATAW>>();
+      findDataList->reserve(findDataMap.size());
+      for (const auto& [key, findData] : findDataMap) {
+        findDataList->emplace_back(findData);
       }
-      if (statusFromCallback != STATUS_SUCCESS) {
-        return statusFromCallback;
-      }
-      isFirst = false;
+      const std::size_t cost = findDataList->size() * sizeof(WIN32_FIND_DATAW) + (cacheKey.size() + filenameKey.size()) * sizeof(wchar_t) + sizeof(FindFilesCacheEntry);
+      m_findFilesCache.Put(cacheKey, FindFilesCacheEntry{
+        std::move(filenameKey),
+        std::move(findDataList),
+      }, cacheGeneration, cost);
     }
 
-    if (isFirst) {
-      // TODO: STATUS_OBJECT_NAME_NOT_FOUNDとSTATUS_OBJECT_PATH_NOT_FOUNDの使い分け
-      return STATUS_OBJECT_PATH_NOT_FOUND;
+    // call callback
+    for (auto& [key, findData] : findDataMap) {
+      FillFindData(&findData, DokanFileInfo);
     }
 
+    return STATUS_SUCCESS;
+  });
+}
 
-    //
-    auto addObject = [this, &findDataMap](std::wstring_view filename, std::wstring_view resolvedFullPath, bool forceAddAsDirectory) -> NTSTATUS {
-      const std::wstring wsKey = FilenameToKey(filename);
-      if (findDataMap.count(wsKey)) {
-        return STATUS_OBJECT_NAME_COLLISION;
-      }
 
-      WIN32_FILE_ATTRIBUTE_DATA Win32FileAttributeData{
-        FILE_ATTRIBUTE_DIRECTORY,
-        {0, 0},
-        {0, 0},
-        {0, 0},
-        0,
-        0,
-      };
-
-      const auto sourceIndex = GetMountSourceIndexR(resolvedFullPath);
-      if (!forceAddAsDirectory && !sourceIndex) {
-        // TODO: STATUS_OBJECT_NAME_NOT_FOUNDとSTATUS_OBJECT_PATH_NOT_FOUNDの使い分け
-        return STATUS_OBJECT_NAME_NOT_FOUND;
-      }
+/*
+FindFilesWithPattern Dokan API callback.
 
-      const std::wstring sResolvedFullPath(resolvedFullPath);
-      if (const auto status = m_mountSources[sourceIndex.value()]->GetFileInfo(sResolvedFullPath.c_str(), &Win32FileAttributeData); status != STATUS_SUCCESS) {
-        return status;
-      }
+Same as FindFiles but with a search pattern.
+The search pattern is a Windows MS-DOS-like expression.
+It can contain wild cards and extended characters or none of them. See DokanIsNameInExpression.
+If the function is not implemented, FindFiles will be called instead and the result will be filtered internally by the library.
+It is recommended to have this implemented for performance reason.
+*/
+NTSTATUS Mount::DFindFilesWithPattern(LPCWSTR PathName, LPCWSTR SearchPattern, PFillFindData FillFindData, PDOKAN_FILE_INFO DokanFileInfo) noexcept {
+  if (!SearchPattern || Wildcard::IsMatchAllPattern(SearchPattern)) {
+    return DFindFiles(PathName, FillFindData, DokanFileInfo);
+  }
 
-      if (sourceIndex != TopSourceIndex) {
-        std::shared_lock lock(m_metadataMutex);
-        if (m_metadataStore.HasMetadataR(resolvedFullPath)) {
-          const auto& metadata = m_metadataStore.GetMetadataR(resolvedFullPath);
-          if (metadata.fileAttributes) {
-            Win32FileAttributeData.dwFileAttributes = metadata.fileAttributes.value();
-          }
-          if (metadata.creationTime) {
-            Win32FileAttributeData.ftCreationTime = metadata.creationTime.value();
-          }
-          if (metadata.lastAccessTime) {
-            Win32FileAttributeData.ftLastAccessTime = metadata.lastAccessTime.value();
-          }
-          if (metadata.lastWriteTime) {
-            Win32FileAttributeData.ftLastWriteTime = metadata.lastWriteTime.value();
-          }
+  return WrapException([=]() -> NTSTATUS {
+    auto ptrFileContext = GetFileContextSharedPtr(DokanFileInfo);
+    auto& fileContext = *ptrFileContext;
+
+    // 一覧全体がキャッシュされていればそれをフィルタする
+    if (const auto cachedFindDataList = GetCachedFindDataListN(fileContext)) {
+      for (auto findData : *cachedFindDataList) {
+        if (Wildcard::Match(SearchPattern, findData.cFileName, m_caseSensitive)) {
+          FillFindData(&findData, DokanFileInfo);
         }
       }
-
-      Win32FileAttributeData.dwFileAttributes &= ~static_cast<DWORD>(FILE_ATTRIBUTE_REPARSE_POINT);
-
-      WIN32_FIND_DATAW findData = {
-        Win32FileAttributeData.dwFileAttributes,
-        Win32FileAttributeData.ftCreationTime,
-        Win32FileAttributeData.ftLastAccessTime,
-        Win32FileAttributeData.ftLastWriteTime,
-        Win32FileAttributeData.nFileSizeHigh,
-        Win32FileAttributeData.nFileSizeLow,
-        0,    // ?
-        0,    // ?
-      };
-      const std::size_t size = std::min(sizeof(findData.cFileName) / sizeof(wchar_t) - 1, filename.size());
-      memcpy(findData.cFileName, filename.data(), size * sizeof(wchar_t));
-      findData.cFileName[size] = L'\0';
-      findData.cAlternateFileName[0] = L'\0';
-
-      findDataMap.emplace(wsKey, findData);
-
       return STATUS_SUCCESS;
-    };
-
-    // add files in includeList
-    for (const auto& [key, value] : includeList) {
-      if (const auto status = addObject(key, value, false); status != STATUS_SUCCESS) {
-        return status;
-      }
     }
 
-    // add . and .. for non-root directory
-    if (!isRootDirectory) {
-      if (const auto status = addObject(L"."sv, resolvedFilename, true); status != STATUS_SUCCESS && status != STATUS_OBJECT_NAME_COLLISION) {
-        return status;
-      }
-      if (const auto status = addObject(L".."sv, util::vfs::GetParentPath(resolvedFilename), true); status != STATUS_SUCCESS && status != STATUS_OBJECT_NAME_COLLISION) {
-        return status;
-      }
+    // パターンに一致するものだけを列挙する（一覧の一部なのでキャッシュには格納しない）
+    std::map<std::wstring, WIN32_FIND_DATAW> findDataMap;
+    if (const auto status = ListMergedFiles(fileContext, SearchPattern, findDataMap); status != STATUS_SUCCESS) {
+      return status;
     }
 
     // call callback
@@ -1309,10 +1402,13 @@ NTSTATUS Mount::DSetFileAttributes(LPCWSTR FileName, DWORD FileAttributes, PDOKA
     auto& fileContext = *ptrFileContext;
     const auto& resolvedFilename = fileContext.resolvedFilename;
     if (fileContext.writable) {
-      return fileContext.mountSource.get().DSetFileAttributes(resolvedFilename.c_str(), FileAttributes, DokanFileInfo, fileContext.id);
+      const auto status = fileContext.mountSource.get().DSetFileAttributes(resolvedFilename.c_str(), FileAttributes, DokanFileInfo, fileContext.id);
+      InvalidateFindFilesCache(fileContext.filename);
+      return status;
     }
 
     // edit metadata
+    MetadataStore::DeferredCommit deferredCommit(m_metadataStore);
     {
       const auto filteredFileAttributes = (FileAttributes & FILE_ATTRIBUTE_NORMAL) && (FileAttributes != FILE_ATTRIBUTE_NORMAL)
         ? FileAttributes & ~static_cast<DWORD>(FILE_ATTRIBUTE_NORMAL)
@@ -1322,6 +1418,8 @@ NTSTATUS Mount::DSetFileAttributes(LPCWSTR FileName, DWORD FileAttributes, PDOKA
       metadata.fileAttributes = filteredFileAttributes;
       m_metadataStore.SetMetadataR(resolvedFilename, metadata);
     }
+    deferredCommit.Commit();
+    InvalidateFindFilesCache(fileContext.filename);
 
     /*
     if (const auto status = fileContext.UpdateLastWriteTime(); status != STATUS_SUCCESS) {
@@ -1351,7 +1449,9 @@ NTSTATUS Mount::DSetFileTime(LPCWSTR FileName, const FILETIME *CreationTime, con
     auto& fileContext = *ptrFileContext;
     const auto& resolvedFilename = fileContext.resolvedFilename;
     if (fileContext.writable) {
-      return fileContext.mountSource.get().DSetFileTime(resolvedFilename.c_str(), CreationTime, LastAccessTime, LastWriteTime, DokanFileInfo, fileContext.id);
+      const auto status = fileContext.mountSource.get().DSetFileTime(resolvedFilename.c_str(), CreationTime, LastAccessTime, LastWriteTime, DokanFileInfo, fileContext.id);
+      InvalidateFindFilesCache(fileContext.filename);
+      return status;
     }
 
     constexpr auto IsZeroFiletime = [](const FILETIME& filetime) -> bool {
@@ -1363,6 +1463,7 @@ NTSTATUS Mount::DSetFileTime(LPCWSTR FileName, const FILETIME *CreationTime, con
     };
 
     // edit metadata
+    MetadataStore::DeferredCommit deferredCommit(m_metadataStore);
     {
       std::lock_guard lock(m_metadataMutex);
       auto metadata = m_metadataStore.GetMetadata2R(resolvedFilename);
@@ -1385,6 +1486,8 @@ NTSTATUS Mount::DSetFileTime(LPCWSTR FileName, const FILETIME *CreationTime, con
       }
       m_metadataStore.SetMetadataR(resolvedFilename, metadata);
     }
+    deferredCommit.Commit();
+    InvalidateFindFilesCache(fileContext.filename);
 
     return STATUS_SUCCESS;
   });
@@ -1521,8 +1624,12 @@ NTSTATUS Mount::DMoveFile(LPCWSTR FileName, LPCWSTR NewFileName, BOOL ReplaceIfE
         if (isOriginalFilenameRenamed) {
           // リネーム元ファイル名が既にリネーム済みである場合、そのエントリを削除する必要がある
           // TODO: エラーチェック
-          std::lock_guard lock(m_metadataMutex);
-          m_metadataStore.RemoveRenameEntry(fileContext.filename);
+          MetadataStore::DeferredCommit deferredCommit(m_metadataStore);
+          {
+            std::lock_guard lock(m_metadataMutex);
+            m_metadataStore.RemoveRenameEntry(fileContext.filename);
+          }
+          deferredCommit.Commit();
         }
         const auto resolvedNewFileNameN = ResolveFilepathN(NewFileName);
         std::wstring resolvedNewFileName;
@@ -1539,7 +1646,10 @@ NTSTATUS Mount::DMoveFile(LPCWSTR FileName, LPCWSTR NewFileName, BOOL ReplaceIfE
             i++;
           } while (FileExists(resolvedNewFileName));
         }
-        if (const auto status = fileContext.mountSource.get().DMoveFile(resolvedFilename.c_str(), resolvedNewFileName.c_str(), ReplaceIfExisting, DokanFileInfo, fileContext.id); status != STATUS_SUCCESS) {
+        const auto status = fileContext.mountSource.get().DMoveFile(resolvedFilename.c_str(), resolvedNewFileName.c_str(), ReplaceIfExisting, DokanFileInfo, fileContext.id);
+        InvalidateCachesR(resolvedFilename);
+        InvalidateCachesR(resolvedNewFileName);
+        if (status != STATUS_SUCCESS) {
           return status;
         }
         // リネームにより下位層に隠れていたファイルが出現してしまうことがあるので、その対策
@@ -1547,24 +1657,47 @@ NTSTATUS Mount::DMoveFile(LPCWSTR FileName, LPCWSTR NewFileName, BOOL ReplaceIfE
         // TODO: 現状DMoveFileのIOに依存しているので、DMoveFileの前に下位層に存在しているか確認して処理した方が良いかも知れない
         const auto newIndex = GetMountSourceIndexR(resolvedFilename);
         if (newIndex && newIndex != TopSourceIndex) {
-          std::lock_guard lock(m_metadataMutex);
-          m_metadataStore.Delete(fileContext.filename);
+          MetadataStore::DeferredCommit deferredCommit(m_metadataStore);
+          {
+            std::lock_guard lock(m_metadataMutex);
+            m_metadataStore.Delete(fileContext.filename);
+          }
+          deferredCommit.Commit();
+          // 上のGetMountSourceIndexRで下位層のファイルがキャッシュされているため、削除の後で無効化する
+          InvalidateCachesR(resolvedFilename);
         }
         //
         if (!resolvedNewFileNameN) {
           // TODO: もっと効率良く書く
-          std::lock_guard lock(m_metadataMutex);
-          m_metadataStore.Rename(std::wstring(util::vfs::GetParentPathTs(NewFileName)) + std::wstring(util::vfs::GetBaseName(resolvedNewFileName)), NewFileName);
-          //m_metadataStore.Rename(resolvedNewFileName, NewFileName);
+          MetadataStore::DeferredCommit deferredCommit(m_metadataStore);
+          {
+            std::lock_guard lock(m_metadataMutex);
+            m_metadataStore.Rename(std::wstring(util::vfs::GetParentPathTs(NewFileName)) + std::wstring(util::vfs::GetBaseName(resolvedNewFileName)), NewFileName);
+            //m_metadataStore.Rename(resolvedNewFileName, NewFileName);
+          }
+          deferredCommit.Commit();
+          InvalidateCachesR(resolvedNewFileName);
         }
+        InvalidateFindFilesCache(FileName);
+        InvalidateFindFilesCache(NewFileName);
         return STATUS_SUCCESS;
       }
     }
     // リネーム
+    // 置き換えられるファイルはリネーム後には解決できなくなるので、先に解決しておく
+    const auto resolvedReplacedFilenameN = ResolveFilepathN(NewFileName);
+    MetadataStore::DeferredCommit deferredCommit(m_metadataStore);
     {
       std::lock_guard lock(m_metadataMutex);
       m_metadataStore.Rename(FileName, NewFileName);
     }
+    deferredCommit.Commit();
+    InvalidateCachesR(resolvedFilename);
+    if (resolvedReplacedFilenameN) {
+      InvalidateCachesR(resolvedReplacedFilenameN.value());
+    }
+    InvalidateFindFilesCache(FileName);
+    InvalidateFindFilesCache(NewFileName);
     return STATUS_SUCCESS;
   });
 }
@@ -1591,7 +1724,9 @@ NTSTATUS Mount::DSetEndOfFile(LPCWSTR FileName, LONGLONG ByteOffset, PDOKAN_FILE
     if (!fileContext.writable) {
       return STATUS_ACCESS_DENIED;
     }
-    return fileContext.mountSource.get().DSetEndOfFile(fileContext.resolvedFilename.c_str(), ByteOffset, DokanFileInfo, fileContext.id);
+    const auto status = fileContext.mountSource.get().DSetEndOfFile(fileContext.resolvedFilename.c_str(), ByteOffset, DokanFileInfo, fileContext.id);
+    InvalidateFindFilesCache(fileContext.filename);
+    return status;
   });
 }
 
@@ -1617,7 +1752,9 @@ NTSTATUS Mount::DSetAllocationSize(LPCWSTR FileName, LONGLONG AllocSize, PDOKAN_
     if (!fileContext.writable) {
       return STATUS_ACCESS_DENIED;
     }
-    return fileContext.mountSource.get().DSetAllocationSize(fileContext.resolvedFilename.c_str(), AllocSize, DokanFileInfo, fileContext.id);
+    const auto status = fileContext.mountSource.get().DSetAllocationSize(fileContext.resolvedFilename.c_str(), AllocSize, DokanFileInfo, fileContext.id);
+    InvalidateFindFilesCache(fileContext.filename);
+    return status;
   });
 }
 
@@ -1760,6 +1897,8 @@ Called when Dokan is unmounting the volume.
 */
 NTSTATUS Mount::DUnmounted(PDOKAN_FILE_INFO DokanFileInfo) noexcept {
   return WrapException([=]() -> NTSTATUS {
+    // 破棄を待たずに、溜まっているメタデータの変更を永続化する
+    m_metadataStore.Flush();
     return STATUS_SUCCESS;
   });
 }
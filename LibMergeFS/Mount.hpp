@@ -1,15 +1,21 @@
 #pragma once
 
-#define USE_SHARED_PTR_FOR_FILE_CONTEXT
-
 #include "../dokan/dokan/dokan.h"
 
 #include "MountSource.hpp"
 #include "MetadataStore.hpp"
+#include "FileContextTable.hpp"
+#include "IdAllocator.hpp"
+#include "LayerResolver.hpp"
+#include "PathCache.hpp"
+#include "PathPool.hpp"
+#include "ThreadPool.hpp"
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -36,8 +42,20 @@ struct VolumeInfoOverride {
 };
 
 
+struct MetadataOptions {
+  MetadataStore::Durability durability = MetadataStore::DefaultDurability;
+  std::chrono::milliseconds maxCommitDelay = MetadataStore::DefaultMaxCommitDelay;
+};
+
+
 class Mount {
 public:
+  struct CacheStatistics {
+    PathCacheStatistics sourceIndexCache;
+    PathCacheStatistics findFilesCache;
+    PathPoolStatistics pathPool;
+  };
+
   class DokanMainError : std::runtime_error {
     int result;
 
@@ -56,6 +74,15 @@ private:
 
   static constexpr std::size_t TopSourceIndex = 0;
   static constexpr FILE_CONTEXT_ID FileContextIdStart = FILE_CONTEXT_ID_NULL + 1;
+  // ソースプラグインがCloseFile後もIDを参照している可能性があるため、すぐには再利用しない
+  static constexpr std::size_t FileContextIdReuseDelay = 1024;
+
+  using SourceLookupResult = LayerResolver<MountSource>::Result;
+
+  struct FindFilesCacheEntry {
+    std::wstring filenameKey;
+    std::shared_ptr<const std::vector<WIN32_FIND_DATAW>> findDataList;
+  };
 
   enum class ImdState {
     Pending,
@@ -68,8 +95,8 @@ private:
     FILE_CONTEXT_ID id;
     Mount& mount;
     std::reference_wrapper<MountSource> mountSource;
-    std::wstring filename;
-    std::wstring resolvedFilename;
+    PooledPath filename;
+    PooledPath resolvedFilename;
     bool directory;
     std::atomic<bool> writable;
     std::atomic<bool> copyDeferred;
@@ -89,14 +116,10 @@ private:
     NTSTATUS UpdateLastWriteTime();
   };
 
-  static std::shared_mutex gFileContextMapMutex;
-  static std::unordered_map<Mount::FileContext*, std::shared_ptr<Mount::FileContext>> gFileContextPtrToSharedPtrMap;
-
   std::mutex m_imdMutex;
   std::condition_variable m_imdCv;
   ImdState m_imdState;
   int m_imdResult;
-  std::mutex m_mutex;
   std::shared_mutex m_metadataMutex;
   const std::wstring m_mountPoint;
   std::vector<std::unique_ptr<MountSource>> m_mountSources;
@@ -107,28 +130,27 @@ private:
   const bool m_caseSensitive;
   const VolumeInfoOverride m_volumeInfoOverride;
   MetadataStore m_metadataStore;
-#ifdef USE_SHARED_PTR_FOR_FILE_CONTEXT
-  std::unordered_map<FILE_CONTEXT_ID, std::shared_ptr<FileContext>> m_fileContextMap;
-#else
-  std::unordered_map<FILE_CONTEXT_ID, std::unique_ptr<FileContext>> m_fileContextMap;
-#endif
-  FILE_CONTEXT_ID m_minimumUnusedFileContextId;
+  LayerResolver<MountSource> m_layerResolver;
+  PathCache<FindFilesCacheEntry> m_findFilesCache;
+  // ファイルコンテキストのパスを共有する（m_fileContextTableより先に破棄されてはならない）
+  PathPool m_pathPool;
+  FileContextTable<FileContext> m_fileContextTable;
+  IdAllocator<FILE_CONTEXT_ID> m_fileContextIdAllocator;
   std::vector<ULONGLONG> m_fileIndexBases;
+  ThreadPool m_findFilesThreadPool;
   std::thread m_thread;
 
   static bool HasFileContext(PDOKAN_FILE_INFO DokanFileInfo) noexcept;
-  static FileContext* GetFileContextPtr(PDOKAN_FILE_INFO DokanFileInfo) noexcept;
-#ifdef USE_SHARED_PTR_FOR_FILE_CONTEXT
-  static std::shared_ptr<FileContext> GetFileContextSharedPtr(PDOKAN_FILE_INFO DokanFileInfo);
-#else
-  static FileContext* GetFileContextSharedPtr(PDOKAN_FILE_INFO DokanFileInfo);
-#endif
-  //static FileContext& GetFileContext(PDOKAN_FILE_INFO DokanFileInfo);
+  std::shared_ptr<FileContext> GetFileContextSharedPtrN(PDOKAN_FILE_INFO DokanFileInfo) const;
+  std::shared_ptr<FileContext> GetFileContextSharedPtr(PDOKAN_FILE_INFO DokanFileInfo) const;
   static NTSTATUS TransportR(std::wstring_view path, bool empty, FILE_CONTEXT_ID fileContextId, MountSource& source, MountSource& destination);
 
   std::wstring FilenameToKey(std::wstring_view filename) const;
   std::optional<std::wstring> ResolveFilepathN(std::wstring_view filename);
   std::wstring ResolveFilepath(std::wstring_view filename);
+  SourceLookupResult LookupSourceR(std::wstring_view resolvedFilename);
+  void InvalidateCachesR(std::wstring_view resolvedFilename);
+  void InvalidateFindFilesCache(std::wstring_view filename);
   std::optional<std::size_t> GetMountSourceIndexR(std::wstring_view resolvedFilename);
   std::optional<std::size_t> GetMountSourceIndex(std::wstring_view filename);
   bool FileExists(std::wstring_view filename);
@@ -141,12 +163,15 @@ private:
   bool ReleaseFileContextId(FILE_CONTEXT_ID FileContextId) noexcept;
   bool ReleaseFileContextId(PDOKAN_FILE_INFO DokanFileInfo) noexcept;
   NTSTATUS TransportIfNeeded(PDOKAN_FILE_INFO DokanFileInfo);
+  NTSTATUS ListMergedFiles(const FileContext& fileContext, LPCWSTR searchPattern, std::map<std::wstring, WIN32_FIND_DATAW>& findDataMap);
+  std::shared_ptr<const std::vector<WIN32_FIND_DATAW>> GetCachedFindDataListN(const FileContext& fileContext);
 
 public:
-  Mount(std::wstring_view mountPoint, bool writable, std::wstring_view metadataFileName, bool deferCopyEnabled, bool caseSensitive, const VolumeInfoOverride& volumeInfoOverride, std::vector<std::unique_ptr<MountSource>>&& sources, std::function<void(Mount&, int)> callback);
+  Mount(std::wstring_view mountPoint, bool writable, std::wstring_view metadataFileName, bool deferCopyEnabled, bool caseSensitive, const VolumeInfoOverride& volumeInfoOverride, const MetadataOptions& metadataOptions, std::vector<std::unique_ptr<MountSource>>&& sources, std::function<void(Mount&, int)> callback);
   ~Mount();
 
   bool IsWritable() const;
+  CacheStatistics GetCacheStatistics() const;
 
   bool SafeUnmount();
   bool Unmount();
@@ -159,6 +184,7 @@ public:
   NTSTATUS DFlushFileBuffers(LPCWSTR FileName, PDOKAN_FILE_INFO DokanFileInfo) noexcept;
   NTSTATUS DGetFileInformation(LPCWSTR FileName, LPBY_HANDLE_FILE_INFORMATION Buffer, PDOKAN_FILE_INFO DokanFileInfo) noexcept;
   NTSTATUS DFindFiles(LPCWSTR FileName, PFillFindData FillFindData, PDOKAN_FILE_INFO DokanFileInfo) noexcept;
+  NTSTATUS DFindFilesWithPattern(LPCWSTR PathName, LPCWSTR SearchPattern, PFillFindData FillFindData, PDOKAN_FILE_INFO DokanFileInfo) noexcept;
   NTSTATUS DSetFileAttributes(LPCWSTR FileName, DWORD FileAttributes, PDOKAN_FILE_INFO DokanFileInfo) noexcept;
   NTSTATUS DSetFileTime(LPCWSTR FileName, const FILETIME* CreationTime, const FILETIME* LastAccessTime, const FILETIME* LastWriteTime, PDOKAN_FILE_INFO DokanFileInfo) noexcept;
   NTSTATUS DDeleteFile(LPCWSTR FileName, PDOKAN_FILE_INFO DokanFileInfo) noexcept;
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace MountConfig {
+  // FindFilesで各ソースの列挙を並列に行うワーカースレッド数の上限（マウントごと、0で並列化しない）
+  constexpr std::size_t FindFilesWorkerCount = 4;
+  // このサイズ以上のファイルをトップソースへコピーする際は、ExportDataとImportDataを別スレッドで並行して行う
+  constexpr std::uint64_t TransportPipelineThreshold = 1024 * 1024;
+  // 同上、エクスポート側とインポート側の間で受け渡すバッファの数（2でダブルバッファリング）
+  constexpr std::size_t TransportPipelineDepth = 2;
+  // メタデータファイルの追記部がこのサイズ以上、かつ追記部以外の1/MetadataCompactionRatioDivisor以上になったら、バックグラウンドで統合する
+  constexpr std::uint64_t MetadataCompactionThreshold = 1024 * 1024;
+  constexpr std::uint64_t MetadataCompactionRatioDivisor = 2;
+  // メタデータファイルの追記部に書き込まれていない記録がこのサイズを超えたら、待たずに書き込む
+  constexpr std::size_t MetadataJournalBufferSize = 256 * 1024;
+}
@@ -23,7 +23,8 @@ MountSource::FileType MountSource::FileAttributesToFileType(DWORD fileAttributes
 
 
 MountSource::MountSource(const PLUGIN_INITIALIZE_MOUNT_INFO& initializeMountInfo, SourcePlugin& sourcePlugin) :
-  m_sourcePlugin(sourcePlugin)
+  m_sourcePlugin(sourcePlugin),
+  m_caseSensitive(initializeMountInfo.CaseSensitive)
 {
   if (const auto status = m_sourcePlugin.Mount(&initializeMountInfo, m_sourceContextId); status != STATUS_SUCCESS) {
     throw NsError(status);
@@ -146,6 +147,17 @@ NTSTATUS MountSource::ListFiles(LPCWSTR FileName, ListFilesCallback Callback) co
 }
 
 
+NTSTATUS MountSource::ListFilesWithPattern(LPCWSTR FileName, LPCWSTR SearchPattern, ListFilesCallback Callback) const noexcept {
+  try {
+    return m_sourcePlugin.ListFilesWithPattern(FileName, SearchPattern, m_caseSensitive, Callback, m_sourceContextId);
+  } catch (std::bad_alloc&) {
+    return STATUS_NO_MEMORY;
+  } catch (...) {
+    return STATUS_UNSUCCESSFUL;
+  }
+}
+
+
 NTSTATUS MountSource::ListStreams(LPCWSTR FileName, ListStreamsCallback Callback) const noexcept {
   try {
     return m_sourcePlugin.ListStreams(FileName, Callback, m_sourceContextId);
@@ -37,6 +37,7 @@ public:
 
 private:
   SourcePlugin& m_sourcePlugin;
+  const bool m_caseSensitive;
   SOURCE_CONTEXT_ID m_sourceContextId;
   SOURCE_INFO m_sourceInfo;
 
@@ -64,6 +65,7 @@ public:
   NTSTATUS SwitchDestinationCleanup(LPCWSTR FileName, PDOKAN_FILE_INFO DokanFileInfo, FILE_CONTEXT_ID FileContextId) noexcept;
   NTSTATUS SwitchDestinationClose(LPCWSTR FileName, PDOKAN_FILE_INFO DokanFileInfo, FILE_CONTEXT_ID FileContextId) noexcept;
   NTSTATUS ListFiles(LPCWSTR FileName, ListFilesCallback Callback) const noexcept;
+  NTSTATUS ListFilesWithPattern(LPCWSTR FileName, LPCWSTR SearchPattern, ListFilesCallback Callback) const noexcept;
   NTSTATUS ListStreams(LPCWSTR FileName, ListStreamsCallback Callback) const noexcept;
 
   NTSTATUS DZwCreateFile(LPCWSTR FileName, PDOKAN_IO_SECURITY_CONTEXT SecurityContext, ACCESS_MASK DesiredAccess, ULONG FileAttributes, ULONG ShareAccess, ULONG CreateDisposition, ULONG CreateOptions, PDOKAN_FILE_INFO DokanFileInfo, bool MaybeSwitched, FILE_CONTEXT_ID FileContextId) noexcept;
@@ -180,7 +180,7 @@ const MOUNT_INFO& MountStore::MountData::MountInfoWrapper::Get() const {
 MountStore::MountStore() :
   m_generalMutex(),
   m_mountMap(),
-  m_minimumUnusedMountId(MountIdStart),
+  m_mountIdAllocator(MountIdStart, MountIdReuseDelay),
   m_itMutex(),
   m_itCv(),
   m_itFinish(false),
@@ -203,9 +203,7 @@ MountStore::MountStore() :
             std::lock_guard generalLock(m_generalMutex);
             for (const auto& mountId : unregisterIdsCopy) {
               m_mountMap.erase(mountId);
-              if (mountId < m_minimumUnusedMountId) {
-                m_minimumUnusedMountId = mountId;
-              }
+              m_mountIdAllocator.Release(mountId);
             }
           }
           itLock.lock();
@@ -234,7 +232,7 @@ MountStore::~MountStore() {
 }
 
 
-MountStore::MOUNT_ID MountStore::Mount(std::wstring_view mountPoint, bool writable, std::wstring_view metadataFileName, bool deferCopyEnabled, bool caseSensitive, const VolumeInfoOverride& volumeInfoOverride, const std::vector<std::pair<PLUGIN_ID, PLUGIN_INITIALIZE_MOUNT_INFO>>& sources, std::function<void(MOUNT_ID, const MOUNT_INFO*, int)> callback) {
+MountStore::MOUNT_ID MountStore::Mount(std::wstring_view mountPoint, bool writable, std::wstring_view metadataFileName, bool deferCopyEnabled, bool caseSensitive, const VolumeInfoOverride& volumeInfoOverride, const MetadataOptions& metadataOptions, const std::vector<std::pair<PLUGIN_ID, PLUGIN_INITIALIZE_MOUNT_INFO>>& sources, std::function<void(MOUNT_ID, const MOUNT_INFO*, int)> callback) {
   if (sources.empty()) {
     throw NoSourceError();
   }
@@ -256,13 +254,10 @@ MountStore::MOUNT_ID MountStore::Mount(std::wstring_view mountPoint, bool writab
 
   std::lock_guard generalLock(m_generalMutex);
 
-  const MOUNT_ID mountId = m_minimumUnusedMountId;
-  do {
-    m_minimumUnusedMountId++;
-  } while (m_mountMap.count(m_minimumUnusedMountId));
+  const MOUNT_ID mountId = m_mountIdAllocator.Allocate();
 
   MountData::MountInfoWrapper wrappedMountInfo(mountPoint, writable, metadataFileName, deferCopyEnabled, caseSensitive, sources);
-  auto mount = std::make_unique<::Mount>(mountPoint, writable, metadataFileName, deferCopyEnabled, caseSensitive, volumeInfoOverride, std::move(mountSources), [this, callback, mountId, wrappedMountInfo](::Mount& mount, int dokanMainResult) mutable {
+  auto mount = std::make_unique<::Mount>(mountPoint, writable, metadataFileName, deferCopyEnabled, caseSensitive, volumeInfoOverride, metadataOptions, std::move(mountSources), [this, callback, mountId, wrappedMountInfo](::Mount& mount, int dokanMainResult) mutable {
     wrappedMountInfo.SetWritable(mount.IsWritable());
 
     callback(mountId, &wrappedMountInfo.Get(), dokanMainResult);
@@ -316,6 +311,33 @@ const MOUNT_INFO& MountStore::GetMountInfo(MOUNT_ID mountId) const {
 }
 
 
+MOUNT_CACHE_STATISTICS MountStore::GetMountCacheStatistics(MOUNT_ID mountId) const {
+  std::shared_lock generalLock(m_generalMutex);
+  if (!m_mountMap.count(mountId)) {
+    throw std::out_of_range("no such mountId");
+  }
+  const auto statistics = m_mountMap.at(mountId).mount->GetCacheStatistics();
+  const auto toCacheStatistics = [](const PathCacheStatistics& cacheStatistics) -> CACHE_STATISTICS {
+    return {
+      cacheStatistics.entries,
+      cacheStatistics.cost,
+      cacheStatistics.hits,
+      cacheStatistics.misses,
+    };
+  };
+  return MOUNT_CACHE_STATISTICS{
+    toCacheStatistics(statistics.sourceIndexCache),
+    toCacheStatistics(statistics.findFilesCache),
+    {
+      statistics.pathPool.entries,
+      statistics.pathPool.bytes,
+      statistics.pathPool.hits,
+      statistics.pathPool.misses,
+    },
+  };
+}
+
+
 bool MountStore::SafeUnmount(MOUNT_ID mountId) {
   std::lock_guard generalLock(m_generalMutex);
   if (!m_mountMap.count(mountId)) {
@@ -4,6 +4,7 @@
 
 #include "../SDK/LibMergeFS.h"
 
+#include "IdAllocator.hpp"
 #include "Mount.hpp"
 #include "SourcePluginStore.hpp"
 
@@ -34,6 +35,7 @@ public:
 
   static constexpr MOUNT_ID MOUNT_ID_NULL = ::MOUNT_ID_NULL;
   static constexpr MOUNT_ID MountIdStart = MOUNT_ID_NULL + 1;
+  static constexpr std::size_t MountIdReuseDelay = 16;
 
 private:
   struct MountData {
@@ -88,7 +90,7 @@ private:
 
   mutable std::shared_mutex m_generalMutex;
   std::unordered_map<MOUNT_ID, MountData> m_mountMap;
-  MOUNT_ID m_minimumUnusedMountId;
+  IdAllocator<MOUNT_ID> m_mountIdAllocator;
   std::mutex m_itMutex;
   std::condition_variable m_itCv;
   bool m_itFinish;
@@ -99,11 +101,12 @@ public:
   MountStore();
   ~MountStore();
 
-  MOUNT_ID Mount(std::wstring_view mountPoint, bool writable, std::wstring_view metadataFileName, bool deferCopyEnabled, bool caseSensitive, const VolumeInfoOverride& volumeInfoOverride, const std::vector<std::pair<PLUGIN_ID, PLUGIN_INITIALIZE_MOUNT_INFO>>& sources, std::function<void(MOUNT_ID, const MOUNT_INFO*, int)> callback);
+  MOUNT_ID Mount(std::wstring_view mountPoint, bool writable, std::wstring_view metadataFileName, bool deferCopyEnabled, bool caseSensitive, const VolumeInfoOverride& volumeInfoOverride, const MetadataOptions& metadataOptions, const std::vector<std::pair<PLUGIN_ID, PLUGIN_INITIALIZE_MOUNT_INFO>>& sources, std::function<void(MOUNT_ID, const MOUNT_INFO*, int)> callback);
   bool HasMount(MOUNT_ID mountId) const;
   std::size_t CountMounts() const;
   std::vector<MOUNT_ID> ListMounts() const;
   const MOUNT_INFO& GetMountInfo(MOUNT_ID mountId) const;
+  MOUNT_CACHE_STATISTICS GetMountCacheStatistics(MOUNT_ID mountId) const;
   bool Unmount(MOUNT_ID mountId);
   void UnmountAll();
   bool SafeUnmount(MOUNT_ID mountId);
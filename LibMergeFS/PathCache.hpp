@@ -0,0 +1,217 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+
+
+struct PathCacheStatistics {
+  std::size_t entries;
+  std::size_t cost;
+  std::uint64_t hits;
+  std::uint64_t misses;
+};
+
+
+// 正規化済みのパス（FilenameToKeyを通したもの）をキーとするスレッドセーフなLRUキャッシュ
+// 各エントリはコスト（エントリ数で制限するなら1、メモリ量で制限するならバイト数など）を持ち、その合計がcapacityを超えないよう古いものから追い出す
+// Invalidateはその子孫のエントリも無効化し、InvalidateEntryは指定したエントリのみを無効化する
+// 子孫のエントリを走査せずに範囲で削除できるよう、キーは順序付きのマップで保持する
+// 計算中に無効化が行われた場合に古い結果を格納しないよう、Putには計算開始前に取得した世代を渡す
+template<typename T>
+class PathCache {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  using Statistics = PathCacheStatistics;
+
+private:
+  struct Entry {
+    std::wstring key;
+    T value;
+    std::size_t cost;
+    Clock::time_point expiration;
+  };
+
+  using List = std::list<Entry>;
+
+  mutable std::mutex mMutex;
+  const std::size_t mCapacity;
+  const Clock::duration mTTL;
+  List mList;
+  std::map<std::wstring_view, typename List::iterator, std::less<>> mMap;
+  std::size_t mCost;
+  std::uint64_t mGeneration;
+  std::uint64_t mHits;
+  std::uint64_t mMisses;
+
+  void EraseEntry(typename List::iterator itr) {
+    mCost -= itr->cost;
+    mMap.erase(itr->key);
+    mList.erase(itr);
+  }
+
+  void ClearL() {
+    mMap.clear();
+    mList.clear();
+    mCost = 0;
+  }
+
+public:
+  // capacityに0を指定するとキャッシュを無効にする
+  // ttlに0を指定するとエントリは時間経過では無効化されない
+  PathCache(std::size_t capacity, Clock::duration ttl = Clock::duration::zero()) :
+    mMutex(),
+    mCapacity(capacity),
+    mTTL(ttl),
+    mList(),
+    mMap(),
+    mCost(0),
+    mGeneration(0),
+    mHits(0),
+    mMisses(0)
+  {}
+
+  PathCache(const PathCache&) = delete;
+  PathCache& operator=(const PathCache&) = delete;
+
+  bool IsEnabled() const {
+    return mCapacity != 0;
+  }
+
+  std::uint64_t GetGeneration() const {
+    std::lock_guard lock(mMutex);
+    return mGeneration;
+  }
+
+  std::optional<T> Get(std::wstring_view key) {
+    if (!IsEnabled()) {
+      return std::nullopt;
+    }
+
+    std::lock_guard lock(mMutex);
+
+    const auto itrMap = mMap.find(key);
+    if (itrMap == mMap.end()) {
+      mMisses++;
+      return std::nullopt;
+    }
+
+    const auto itr = itrMap->second;
+    if (mTTL != Clock::duration::zero() && itr->expiration <= Clock::now()) {
+      EraseEntry(itr);
+      mMisses++;
+      return std::nullopt;
+    }
+
+    mList.splice(mList.begin(), mList, itr);
+    mHits++;
+    return itr->value;
+  }
+
+  void Put(std::wstring_view key, const T& value, std::uint64_t generation, std::size_t cost = 1) {
+    if (!IsEnabled() || cost > mCapacity) {
+      return;
+    }
+
+    const auto expiration = mTTL != Clock::duration::zero() ? Clock::now() + mTTL : Clock::time_point::max();
+
+    std::lock_guard lock(mMutex);
+
+    // 計算中に無効化された
+    if (generation != mGeneration) {
+      return;
+    }
+
+    if (const auto itrMap = mMap.find(key); itrMap != mMap.end()) {
+      EraseEntry(itrMap->second);
+    }
+
+    mList.push_front(Entry{
+      std::wstring(key),
+      value,
+      cost,
+      expiration,
+    });
+    mMap.emplace(mList.front().key, mList.begin());
+    mCost += cost;
+
+    while (mCost > mCapacity) {
+      EraseEntry(std::prev(mList.end()));
+    }
+  }
+
+  // keyとその子孫のエントリを無効化する
+  void Invalidate(std::wstring_view key) {
+    if (!IsEnabled()) {
+      return;
+    }
+
+    std::lock_guard lock(mMutex);
+
+    mGeneration++;
+
+    if (key.empty() || key == std::wstring_view(L"\\")) {
+      ClearL();
+      return;
+    }
+
+    if (const auto itrMap = mMap.find(key); itrMap != mMap.end()) {
+      EraseEntry(itrMap->second);
+    }
+
+    // 子孫のキーは [key + L"\\", key + L"]") の範囲にある（L']'はL'\\'の次の文字）
+    std::wstring bound(key);
+    bound.push_back(L'\\');
+    auto itrMap = mMap.lower_bound(std::wstring_view(bound));
+    bound.back() = L']';
+    while (itrMap != mMap.end() && itrMap->first < std::wstring_view(bound)) {
+      const auto itr = itrMap->second;
+      itrMap = mMap.erase(itrMap);
+      mCost -= itr->cost;
+      mList.erase(itr);
+    }
+  }
+
+  // keyのエントリのみを無効化する
+  void InvalidateEntry(std::wstring_view key) {
+    if (!IsEnabled()) {
+      return;
+    }
+
+    std::lock_guard lock(mMutex);
+
+    mGeneration++;
+
+    if (const auto itrMap = mMap.find(key); itrMap != mMap.end()) {
+      EraseEntry(itrMap->second);
+    }
+  }
+
+  void Clear() {
+    std::lock_guard lock(mMutex);
+
+    mGeneration++;
+    ClearL();
+  }
+
+  Statistics GetStatistics() const {
+    std::lock_guard lock(mMutex);
+
+    return Statistics{
+      mList.size(),
+      mCost,
+      mHits,
+      mMisses,
+    };
+  }
+};
@@ -0,0 +1,182 @@
+#include "PathPool.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+
+
+namespace {
+  const std::wstring EmptyString;
+}
+
+
+
+PooledPath::Entry::Entry(PathPool& pool, std::size_t shardIndex, std::wstring_view value) :
+  refCount(1),
+  pool(pool),
+  shardIndex(shardIndex),
+  value(value)
+{}
+
+
+
+PooledPath::PooledPath(Entry* entry) noexcept :
+  mEntry(entry)
+{}
+
+
+PooledPath::PooledPath() noexcept :
+  mEntry(nullptr)
+{}
+
+
+PooledPath::PooledPath(const PooledPath& other) noexcept :
+  mEntry(other.mEntry)
+{
+  if (mEntry) {
+    mEntry->refCount.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+
+PooledPath::PooledPath(PooledPath&& other) noexcept :
+  mEntry(std::exchange(other.mEntry, nullptr))
+{}
+
+
+PooledPath& PooledPath::operator=(const PooledPath& other) noexcept {
+  PooledPath temp(other);
+  std::swap(mEntry, temp.mEntry);
+  return *this;
+}
+
+
+PooledPath& PooledPath::operator=(PooledPath&& other) noexcept {
+  PooledPath temp(std::move(other));
+  std::swap(mEntry, temp.mEntry);
+  return *this;
+}
+
+
+PooledPath::~PooledPath() {
+  if (mEntry) {
+    mEntry->pool.Release(mEntry);
+  }
+}
+
+
+const wchar_t* PooledPath::c_str() const noexcept {
+  return mEntry ? mEntry->value.c_str() : EmptyString.c_str();
+}
+
+
+std::size_t PooledPath::size() const noexcept {
+  return mEntry ? mEntry->value.size() : 0;
+}
+
+
+bool PooledPath::empty() const noexcept {
+  return !mEntry;
+}
+
+
+PooledPath::operator const std::wstring&() const noexcept {
+  return mEntry ? mEntry->value : EmptyString;
+}
+
+
+PooledPath::operator std::wstring_view() const noexcept {
+  return mEntry ? std::wstring_view(mEntry->value) : std::wstring_view();
+}
+
+
+
+std::size_t PathPool::GetEntryCost(const Entry& entry) noexcept {
+  return sizeof(Entry) + (entry.value.size() + 1) * sizeof(wchar_t);
+}
+
+
+std::size_t PathPool::GetShardIndex(std::wstring_view path) noexcept {
+  // シャード内のハッシュテーブルは下位ビットでバケットを選ぶことがあるので、全ビットを混ぜた上位ビットでシャードを選ぶ
+  const std::uint64_t hash = std::hash<std::wstring_view>()(path);
+  return static_cast<std::size_t>((hash * 0x9E3779B97F4A7C15) >> (64 - ShardBits));
+}
+
+
+PathPool::PathPool() :
+  mShards()
+{}
+
+
+PathPool::~PathPool() {
+  // ハンドルはすべて破棄されているはず
+  for ([[maybe_unused]] const auto& shard : mShards) {
+    assert(shard.entries.empty());
+  }
+}
+
+
+void PathPool::Release(Entry* entry) noexcept {
+  // 最後の参照でなければロックを取らずに減らす
+  auto refCount = entry->refCount.load(std::memory_order_relaxed);
+  while (refCount > 1) {
+    if (entry->refCount.compare_exchange_weak(refCount, refCount - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+      return;
+    }
+  }
+
+  // 0への遷移とInternによる参照の追加はどちらもシャードのロックの下で行うので、取り除いたエントリが再び参照されることはない
+  auto& shard = mShards[entry->shardIndex];
+  std::lock_guard lock(shard.mutex);
+  if (entry->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  shard.entries.erase(std::wstring_view(entry->value));
+  shard.bytes -= GetEntryCost(*entry);
+  delete entry;
+}
+
+
+PooledPath PathPool::Intern(std::wstring_view path) {
+  if (path.empty()) {
+    return PooledPath();
+  }
+
+  const auto shardIndex = GetShardIndex(path);
+  auto& shard = mShards[shardIndex];
+  std::lock_guard lock(shard.mutex);
+
+  if (const auto itr = shard.entries.find(path); itr != shard.entries.end()) {
+    itr->second->refCount.fetch_add(1, std::memory_order_relaxed);
+    shard.hits++;
+    return PooledPath(itr->second);
+  }
+
+  auto entry = std::make_unique<Entry>(*this, shardIndex, path);
+  shard.entries.emplace(entry->value, entry.get());
+  shard.bytes += GetEntryCost(*entry);
+  shard.misses++;
+  return PooledPath(entry.release());
+}
+
+
+PathPool::Statistics PathPool::GetStatistics() const {
+  // シャードごとに集計するので、並行して変更されている場合は厳密な一時点の値ではない
+  Statistics statistics{};
+  for (const auto& shard : mShards) {
+    std::lock_guard lock(shard.mutex);
+    statistics.entries += shard.entries.size();
+    statistics.bytes += shard.bytes;
+    statistics.hits += shard.hits;
+    statistics.misses += shard.misses;
+  }
+  return statistics;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+
+
+struct PathPoolStatistics {
+  std::size_t entries;
+  std::size_t bytes;
+  std::uint64_t hits;
+  std::uint64_t misses;
+};
+
+
+class PathPool;
+
+
+// PathPoolに格納されたパスへの参照カウント付きハンドル
+// コピーしても文字列は複製されず、最後のハンドルが破棄された時点でプールから取り除かれる
+// 既定構築したものは空文字列を指す
+class PooledPath {
+  friend class PathPool;
+
+  struct Entry {
+    std::atomic<std::size_t> refCount;
+    PathPool& pool;
+    const std::size_t shardIndex;
+    const std::wstring value;
+
+    Entry(PathPool& pool, std::size_t shardIndex, std::wstring_view value);
+  };
+
+  Entry* mEntry;
+
+  explicit PooledPath(Entry* entry) noexcept;
+
+public:
+  PooledPath() noexcept;
+  PooledPath(const PooledPath& other) noexcept;
+  PooledPath(PooledPath&& other) noexcept;
+  PooledPath& operator=(const PooledPath& other) noexcept;
+  PooledPath& operator=(PooledPath&& other) noexcept;
+  ~PooledPath();
+
+  const wchar_t* c_str() const noexcept;
+  std::size_t size() const noexcept;
+  bool empty() const noexcept;
+  operator const std::wstring&() const noexcept;
+  operator std::wstring_view() const noexcept;
+};
+
+
+// パス文字列をインターンするスレッドセーフなプール
+// 同じパスを保持する複数の構造（同じファイルを指す複数のファイルコンテキストなど）で文字列の実体を共有し、メモリ使用量を抑える
+// 大文字小文字は区別して格納する（表記の異なるパスを同一視すると、呼び出し側が元の表記を失うため）
+// 大文字小文字を区別しないキーを共有したい場合は、FilenameToKeyを通したものをインターンすること
+// プールはそこから得たすべてのハンドルより長く生存しなければならない
+// エントリはパスのハッシュで複数のシャードに分割されており、それぞれが独立したロックを持つ
+class PathPool {
+  friend class PooledPath;
+
+  using Entry = PooledPath::Entry;
+
+  static constexpr std::size_t ShardBits = 4;
+  static constexpr std::size_t ShardCount = std::size_t{1} << ShardBits;
+
+  // 偽共有を避けるためシャードごとにキャッシュラインを分ける
+  struct alignas(64) Shard {
+    mutable std::mutex mutex;
+    std::unordered_map<std::wstring_view, Entry*> entries;    // キーはEntry::valueを指す
+    std::size_t bytes = 0;
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+  };
+
+  std::array<Shard, ShardCount> mShards;
+
+  static std::size_t GetEntryCost(const Entry& entry) noexcept;
+  static std::size_t GetShardIndex(std::wstring_view path) noexcept;
+
+  void Release(Entry* entry) noexcept;
+
+public:
+  using Statistics = PathPoolStatistics;
+
+  PathPool();
+  ~PathPool();
+
+  PathPool(const PathPool&) = delete;
+  PathPool& operator=(const PathPool&) = delete;
+
+  PooledPath Intern(std::wstring_view path);
+  // bytesはエントリと文字列の大きさの概算（ハッシュテーブル自体の大きさは含まない）
+  Statistics GetStatistics() const;
+};
@@ -42,6 +42,12 @@ class PluginBase {
       }
       return reinterpret_cast<T>(address);
     }
+
+    // 省略可能な関数用、見つからなければnullptrを返す
+    template<typename T>
+    T GetProcN(LPCSTR ProcName) const noexcept {
+      return reinterpret_cast<T>(GetProcAddress(hModule, ProcName));
+    }
   };
 
 public:
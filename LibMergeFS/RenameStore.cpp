@@ -1,3 +1,5 @@
+#define NOMINMAX
+
 #include "RenameStore.hpp"
 #include "Util.hpp"
 
@@ -14,7 +16,6 @@
 #include <optional>
 #include <string>
 #include <string_view>
-#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -24,311 +25,382 @@ using namespace std::literals;
 
 namespace {
   static const std::wstring StrDelimiter = L"\\"s;
-}
 
+  constexpr wchar_t Delimiter = L'\\';
 
 
-RenameStore::PathTrieTree::PathTrieTree(bool caseSensitive) :
-  mCaseSensitive(caseSensitive),
-  mChildren(0, CaseSensitivity::CiHash(caseSensitive), CaseSensitivity::CiEqualTo(caseSensitive)),
-  mValid(false),
-  mFilepath()
-{}
+  std::wstring_view GetFirstComponent(std::wstring_view key) {
+    return key.substr(0, key.find(Delimiter));
+  }
 
 
-RenameStore::PathTrieTree::PathTrieTree(bool caseSensitive, std::wstring_view filepath) :
-  mCaseSensitive(caseSensitive),
-  mChildren(0, CaseSensitivity::CiHash(caseSensitive), CaseSensitivity::CiEqualTo(caseSensitive)),
-  mValid(true),
-  mFilepath(filepath)
-{}
+  // returns the length of the leading components of label which match those of key
+  std::size_t GetMatchedLabelLength(const CaseSensitivity::CiEqualTo& equalTo, std::wstring_view label, std::wstring_view key) {
+    std::size_t matchedLength = 0;
+    std::size_t pos = 0;
+    while (true) {
+      const auto labelEndPos = std::min(label.find(Delimiter, pos), label.size());
+      const auto keyEndPos = std::min(key.find(Delimiter, pos), key.size());
+      if (!equalTo(label.substr(pos, labelEndPos - pos), key.substr(pos, keyEndPos - pos))) {
+        break;
+      }
+      matchedLength = labelEndPos;
+      if (labelEndPos == label.size() || keyEndPos == key.size()) {
+        break;
+      }
+      pos = labelEndPos + 1;
+    }
+    return matchedLength;
+  }
 
 
-void RenameStore::PathTrieTree::Traverse(const std::wstring& prefix, std::function<void(const std::wstring&, const std::wstring&, bool)>& callback) const {
-  for (const auto& [key, value] : mChildren) {
-    const std::wstring filepath = prefix + key;
-    callback(filepath, value.mFilepath, value.mValid);
-    value.Traverse(filepath + StrDelimiter, callback);
+  // true if filepath is a descendant of ancestor
+  bool IsDescendant(const CaseSensitivity::CiEqualTo& equalTo, std::wstring_view ancestor, std::wstring_view filepath) {
+    return filepath.size() > ancestor.size() && filepath[ancestor.size()] == Delimiter && equalTo(filepath.substr(0, ancestor.size()), ancestor);
   }
 }
 
 
-bool RenameStore::PathTrieTree::IsCaseSensitive() const {
-  return mCaseSensitive;
-}
+
+RenameStore::PathTrieTree::Node::Node(bool caseSensitive) :
+  mLabel(),
+  mParent(nullptr),
+  mChildren(0, CaseSensitivity::CiHash(caseSensitive), CaseSensitivity::CiEqualTo(caseSensitive)),
+  mValid(false),
+  mFilepath()
+{}
 
 
-bool RenameStore::PathTrieTree::IsValid() const {
+bool RenameStore::PathTrieTree::Node::IsValid() const {
   return mValid;
 }
 
 
-const std::wstring& RenameStore::PathTrieTree::GetData() const {
+const std::wstring& RenameStore::PathTrieTree::Node::GetData() const {
   return mFilepath;
 }
 
 
-void RenameStore::PathTrieTree::SetData(std::wstring_view filepath) {
+void RenameStore::PathTrieTree::Node::SetData(std::wstring_view filepath) {
   mFilepath = filepath;
   mValid = true;
 }
 
 
-void RenameStore::PathTrieTree::Invalidate() {
-  mFilepath.clear();
-  mValid = false;
-}
 
+RenameStore::PathTrieTree::PathTrieTree(bool caseSensitive) :
+  mCaseSensitive(caseSensitive),
+  mEqualTo(caseSensitive),
+  mNodes(),
+  mFreeNodes(),
+  mRoot(&mNodes.emplace_back(caseSensitive))
+{}
 
-bool RenameStore::PathTrieTree::Has(std::wstring_view filepath, bool validOnly) const {
-  const auto itr = mChildren.find(std::wstring(filepath));
-  if (itr == mChildren.cend()) {
-    return false;
+
+RenameStore::PathTrieTree::Node* RenameStore::PathTrieTree::AllocateNode(Node* parent, std::wstring_view label) {
+  Node* node = nullptr;
+  if (!mFreeNodes.empty()) {
+    node = mFreeNodes.back();
+    mFreeNodes.pop_back();
+  } else {
+    node = &mNodes.emplace_back(mCaseSensitive);
   }
-  return !validOnly || itr->second.mValid;
+  node->mLabel = label;
+  Attach(parent, node);
+  return node;
 }
 
 
-RenameStore::PathTrieTree* RenameStore::PathTrieTree::Get(std::wstring_view filepath, bool validOnly) {
-  auto itr = mChildren.find(std::wstring(filepath));
-  if (itr == mChildren.end()) {
-    return nullptr;
+void RenameStore::PathTrieTree::ReleaseNode(Node* node) {
+  // node must be detached from its parent (or its parent must be being released)
+  for (const auto& [key, child] : node->mChildren) {
+    ReleaseNode(child);
   }
-  return !validOnly || itr->second.mValid ? &itr->second : nullptr;
+  node->mChildren.clear();
+  node->mLabel.clear();
+  node->mParent = nullptr;
+  node->mValid = false;
+  node->mFilepath.clear();
+  mFreeNodes.push_back(node);
 }
 
 
-const RenameStore::PathTrieTree* RenameStore::PathTrieTree::Get(std::wstring_view filepath, bool validOnly) const {
-  const auto itr = mChildren.find(std::wstring(filepath));
-  if (itr == mChildren.cend()) {
-    return nullptr;
-  }
-  return !validOnly || itr->second.mValid ? &itr->second : nullptr;
+void RenameStore::PathTrieTree::Attach(Node* parent, Node* child) {
+  child->mParent = parent;
+  parent->mChildren.emplace(GetFirstComponent(child->mLabel), child);
 }
 
 
-bool RenameStore::PathTrieTree::Remove(std::wstring_view filepath) {
-  return mChildren.erase(std::wstring(filepath));
+void RenameStore::PathTrieTree::Detach(Node* child) {
+  // the key is a view into child->mLabel; detach before modifying the label
+  child->mParent->mChildren.erase(GetFirstComponent(child->mLabel));
+  child->mParent = nullptr;
 }
 
 
-std::vector<std::pair<std::wstring, std::wstring>> RenameStore::PathTrieTree::ListChildren(bool validOnly) const {
-  std::vector<std::pair<std::wstring, std::wstring>> children;
-  children.reserve(mChildren.size());
-  for (const auto& [key, value] : mChildren) {
-    if (validOnly && !value.mValid) {
+RenameStore::PathTrieTree::Node* RenameStore::PathTrieTree::Split(Node* node, std::size_t labelLength) {
+  // split the edge to node at labelLength (a component boundary) and return the new intermediate node
+  assert(labelLength < node->mLabel.size() && node->mLabel[labelLength] == Delimiter);
+  Node* parent = node->mParent;
+  Detach(node);
+  Node* intermediateNode = AllocateNode(parent, std::wstring_view(node->mLabel).substr(0, labelLength));
+  node->mLabel.erase(0, labelLength + 1);
+  Attach(intermediateNode, node);
+  return intermediateNode;
+}
+
+
+void RenameStore::PathTrieTree::Compact(Node* node) {
+  // restore the invariant that every node except the root is valid or has two or more children
+  while (node != mRoot && !node->mValid) {
+    Node* parent = node->mParent;
+    if (node->mChildren.empty()) {
+      // remove unused leaf and check its parent
+      Detach(node);
+      ReleaseNode(node);
+      node = parent;
       continue;
     }
-    children.emplace_back(key, value.mFilepath);
+    if (node->mChildren.size() == 1) {
+      // merge the edge into its only child
+      Node* child = node->mChildren.begin()->second;
+      Detach(child);
+      Detach(node);
+      child->mLabel = node->mLabel + StrDelimiter + child->mLabel;
+      Attach(parent, child);
+      ReleaseNode(node);
+    }
+    break;
   }
-  return children;
 }
 
 
-RenameStore::PathTrieTree* RenameStore::PathTrieTree::RetrieveRecursive(std::wstring_view key) {
-  const auto firstDelimiterPos = key.find_first_of(Delimiter);
-  auto itrChild = mChildren.find(std::wstring(key.substr(0, firstDelimiterPos)));
-  if (itrChild == mChildren.end()) {
-    // child not found
-    return nullptr;
-  }
-  if (firstDelimiterPos == std::wstring_view::npos) {
-    return &itrChild->second;
+template<typename F>
+RenameStore::PathTrieTree::Cursor RenameStore::PathTrieTree::Walk(std::wstring_view key, F&& callback) const {
+  // callback is called for each node on the path whose whole label matched
+  Node* node = mRoot;
+  std::size_t keyLength = 0;
+  std::size_t pos = 0;
+  while (pos < key.size()) {
+    const auto leftKey = key.substr(pos);
+    const auto itrChild = node->mChildren.find(GetFirstComponent(leftKey));
+    if (itrChild == node->mChildren.end()) {
+      // child not found
+      break;
+    }
+    Node* child = itrChild->second;
+    const auto matchedLength = GetMatchedLabelLength(mEqualTo, child->mLabel, leftKey);
+    if (matchedLength < child->mLabel.size()) {
+      // stopped in the middle of the edge
+      return {child, matchedLength, pos + matchedLength};
+    }
+    node = child;
+    keyLength = pos + matchedLength;
+    pos = keyLength + 1;
+    callback(static_cast<const Node*>(node), keyLength);
   }
-  return itrChild->second.RetrieveRecursive(key.substr(firstDelimiterPos + 1));
+  return {node, node->mLabel.size(), keyLength};
 }
 
 
-const RenameStore::PathTrieTree* RenameStore::PathTrieTree::RetrieveRecursive(std::wstring_view key) const {
-  const auto firstDelimiterPos = key.find_first_of(Delimiter);
-  const auto itrChild = mChildren.find(std::wstring(key.substr(0, firstDelimiterPos)));
-  if (itrChild == mChildren.cend()) {
-    // child not found
+RenameStore::PathTrieTree::Cursor RenameStore::PathTrieTree::Walk(std::wstring_view key) const {
+  return Walk(key, [](const Node*, std::size_t) {});
+}
+
+
+RenameStore::PathTrieTree::Node* RenameStore::PathTrieTree::MaterializeN(std::wstring_view key) {
+  const auto cursor = Walk(key);
+  if (cursor.keyLength != key.size()) {
     return nullptr;
   }
-  if (firstDelimiterPos == std::wstring_view::npos) {
-    return &itrChild->second;
+  if (cursor.labelLength < cursor.node->mLabel.size()) {
+    return Split(cursor.node, cursor.labelLength);
   }
-  return itrChild->second.RetrieveRecursive(key.substr(firstDelimiterPos + 1));
+  return cursor.node;
 }
 
 
-bool RenameStore::PathTrieTree::Match(std::wstring_view key) const {
-  // returns !!FindLongestMatch(key);
-  if (mValid) {
-    return true;
+RenameStore::PathTrieTree::Node* RenameStore::PathTrieTree::InsertNode(std::wstring_view key) {
+  // the returned node may be invalid without children; callers must set data on it or compact it
+  const auto cursor = Walk(key);
+  Node* node = cursor.node;
+  if (cursor.labelLength < node->mLabel.size()) {
+    node = Split(node, cursor.labelLength);
   }
-  const auto firstDelimiterPos = key.find_first_of(Delimiter);
-  const auto itrChild = mChildren.find(std::wstring(key.substr(0, firstDelimiterPos)));
-  if (itrChild == mChildren.end()) {
-    // child not found
-    return false;
+  if (cursor.keyLength == key.size()) {
+    return node;
   }
-  return itrChild->second.Match(key.substr(firstDelimiterPos + 1));
+  return AllocateNode(node, key.substr(cursor.keyLength == 0 ? 0 : cursor.keyLength + 1));
 }
 
 
-std::optional<std::pair<std::wstring, std::wstring>> RenameStore::PathTrieTree::FindLongestMatch(std::wstring_view key) const {
-  const auto firstDelimiterPos = key.find_first_of(Delimiter);
-  const std::wstring childKey(key.substr(0, firstDelimiterPos));
-  const auto itrChild = mChildren.find(childKey);
-  if (itrChild != mChildren.end()) {
-    auto result = itrChild->second.FindLongestMatch(key.substr(firstDelimiterPos + 1));
-    if (result) {
-      result.value().first = result.value().first.empty() ? childKey : childKey + StrDelimiter + result.value().first;
-      return result;
+void RenameStore::PathTrieTree::Traverse(const Node* node, const std::wstring& prefix, const std::function<void(const std::wstring&, const std::wstring&)>& callback) const {
+  for (const auto& [key, child] : node->mChildren) {
+    const std::wstring filepath = prefix + child->mLabel;
+    if (child->mValid) {
+      callback(filepath, child->mFilepath);
     }
+    Traverse(child, filepath + StrDelimiter, callback);
   }
-  if (mValid) {
-    return std::make_pair(L""s, mFilepath);
-  }
-  return std::nullopt;
 }
 
 
-void RenameStore::PathTrieTree::Traverse(std::function<void(const std::wstring&, const std::wstring&, bool)> callback, bool self) const {
-  if (self) {
-    callback(L""s, mFilepath, mValid);
-  }
-  Traverse(L""s, callback);
+bool RenameStore::PathTrieTree::IsCaseSensitive() const {
+  return mCaseSensitive;
 }
 
 
-std::size_t RenameStore::PathTrieTree::CleanupUnusedNodes(std::wstring_view key) {
-  // remove nodes
-  std::deque<std::tuple<PathTrieTree*, std::wstring_view, PathTrieTree*>> nodes;
-  PathTrieTree* ptrCurrentNode = this;
-  std::wstring_view leftKey = key;
-  while (true) {
-    const auto firstDelimiterPos = leftKey.find_first_of(Delimiter);
-    if (firstDelimiterPos == std::wstring_view::npos) {
-      break;
-    }
-    const std::wstring_view currentKey = leftKey.substr(0, firstDelimiterPos);
-    leftKey.remove_prefix(firstDelimiterPos + 1);
-    auto ptrChildNode = ptrCurrentNode->Get(currentKey, false);
-    if (!ptrChildNode) {
-      break;
-    }
-    nodes.emplace_front(ptrCurrentNode, currentKey, ptrChildNode);
-    ptrCurrentNode = ptrChildNode;
+bool RenameStore::PathTrieTree::Contains(std::wstring_view key) const {
+  // true also for intermediate directories of entries
+  return Walk(key).keyLength == key.size();
+}
+
+
+RenameStore::PathTrieTree::Node* RenameStore::PathTrieTree::FindN(std::wstring_view key) {
+  const auto cursor = Walk(key);
+  return cursor.keyLength == key.size() && cursor.labelLength == cursor.node->mLabel.size() ? cursor.node : nullptr;
+}
+
+
+const RenameStore::PathTrieTree::Node* RenameStore::PathTrieTree::FindN(std::wstring_view key) const {
+  const auto cursor = Walk(key);
+  return cursor.keyLength == key.size() && cursor.labelLength == cursor.node->mLabel.size() ? cursor.node : nullptr;
+}
+
+
+std::vector<std::pair<std::wstring, std::wstring>> RenameStore::PathTrieTree::ListChildren(std::wstring_view key) const {
+  // lists valid direct children only
+  const auto cursor = Walk(key);
+  if (cursor.keyLength != key.size()) {
+    return {};
   }
 
-  std::size_t removedCount = 0;
-  for (const auto&[ptrParentNode, key, ptrChildNode] : nodes) {
-    if (ptrChildNode->mValid || !ptrChildNode->mChildren.empty()) {
-      break;
+  const std::wstring_view label = cursor.node->mLabel;
+  if (cursor.labelLength < label.size()) {
+    // key is an intermediate directory inside the edge; its only child is the next component
+    const auto leftLabel = label.substr(cursor.labelLength + 1);
+    if (!cursor.node->mValid || leftLabel.find(Delimiter) != std::wstring_view::npos) {
+      return {};
     }
-    ptrParentNode->Remove(key);
-    removedCount++;
+    return {
+      {std::wstring(leftLabel), cursor.node->mFilepath},
+    };
   }
 
-  return removedCount;
+  std::vector<std::pair<std::wstring, std::wstring>> children;
+  children.reserve(cursor.node->mChildren.size());
+  for (const auto& [childKey, child] : cursor.node->mChildren) {
+    if (!child->mValid || child->mLabel.size() != childKey.size()) {
+      continue;
+    }
+    children.emplace_back(child->mLabel, child->mFilepath);
+  }
+  return children;
 }
 
 
-std::pair<RenameStore::PathTrieTree&, bool> RenameStore::PathTrieTree::InsertRecursive(std::wstring_view key) {
-  const auto firstDelimiterPos = key.find_first_of(Delimiter);
-  const std::wstring childKey(key.substr(0, firstDelimiterPos));
-  bool emplaced = false;
-  auto itrChild = mChildren.find(childKey);
-  if (itrChild == mChildren.end()) {
-    itrChild = mChildren.emplace(childKey, PathTrieTree(this)).first;
-    emplaced = true;
-  }
-  if (firstDelimiterPos == std::wstring_view::npos) {
-    return {itrChild->second, emplaced};
-  }
-  return itrChild->second.InsertRecursive(key.substr(firstDelimiterPos + 1));
+bool RenameStore::PathTrieTree::Match(std::wstring_view key) const {
+  // returns !!FindLongestMatch(key);
+  bool matched = false;
+  Walk(key, [&matched](const Node* node, std::size_t) {
+    matched = matched || node->mValid;
+  });
+  return matched;
 }
 
 
-std::pair<RenameStore::PathTrieTree&, bool> RenameStore::PathTrieTree::InsertRecursive(std::wstring_view key, std::wstring_view filepath) {
-  const auto firstDelimiterPos = key.find_first_of(Delimiter);
-  const std::wstring childKey(key.substr(0, firstDelimiterPos));
-  auto itrChild = mChildren.find(childKey);
-  if (itrChild == mChildren.end()) {
-    itrChild = mChildren.emplace(childKey, PathTrieTree(this)).first;
-  }
-  if (firstDelimiterPos == std::wstring_view::npos) {
-    if (itrChild->second.mValid) {
-      return {itrChild->second, false};
+std::optional<std::pair<std::size_t, std::wstring_view>> RenameStore::PathTrieTree::FindLongestMatch(std::wstring_view key) const {
+  // returns the length of the matched prefix of key and the data of the node
+  std::optional<std::pair<std::size_t, std::wstring_view>> result;
+  Walk(key, [&result](const Node* node, std::size_t keyLength) {
+    if (node->mValid) {
+      result.emplace(keyLength, node->mFilepath);
     }
-    itrChild->second.SetData(filepath);
-    return {itrChild->second, true};
-  }
-  return itrChild->second.InsertRecursive(key.substr(firstDelimiterPos + 1), filepath);
+  });
+  return result;
 }
 
 
-std::optional<std::pair<std::wstring, bool>> RenameStore::PathTrieTree::ResetEntry(std::wstring_view key) {
-  auto ptrNode = RetrieveRecursive(key);
-  if (!ptrNode) {
-    return std::nullopt;
+void RenameStore::PathTrieTree::Traverse(std::function<void(const std::wstring&, const std::wstring&)> callback) const {
+  Traverse(mRoot, L""s, callback);
+}
+
+
+void RenameStore::PathTrieTree::Traverse(const Node* node, std::function<void(const std::wstring&, const std::wstring&)> callback) const {
+  Traverse(node, L""s, callback);
+}
+
+
+RenameStore::PathTrieTree::Node* RenameStore::PathTrieTree::Insert(std::wstring_view key, std::wstring_view filepath, bool overwrite) {
+  assert(!key.empty());
+  Node* node = InsertNode(key);
+  if (overwrite || !node->mValid) {
+    node->SetData(filepath);
   }
-  auto ret = std::make_pair(ptrNode->mFilepath, ptrNode->mValid);
-  ptrNode->Invalidate();
-  CleanupUnusedNodes(key);
-  return ret;
+  return node;
 }
 
 
-RenameStore::PathTrieTree* RenameStore::PathTrieTree::MoveNode(std::wstring_view source, std::wstring_view destination) {
-  // get parent node of source
-  std::wstring_view sourceBaseKey;
-  RenameStore::PathTrieTree* ptrSourceParentTree = nullptr;
-  if (auto lastSourceDelimiterPos = source.find_last_of(Delimiter); lastSourceDelimiterPos != std::wstring_view::npos) {
-    sourceBaseKey = source.substr(lastSourceDelimiterPos + 1);
-    auto sourceParentKey = source.substr(0, lastSourceDelimiterPos);
-    ptrSourceParentTree = RetrieveRecursive(sourceParentKey);
-    if (!ptrSourceParentTree) {
-      // not exists
-      return nullptr;
-    }
-  } else {
-    sourceBaseKey = source;
-    ptrSourceParentTree = this;
+std::optional<std::wstring> RenameStore::PathTrieTree::Remove(std::wstring_view key) {
+  Node* node = FindN(key);
+  if (!node || !node->mValid) {
+    return std::nullopt;
   }
+  std::wstring filepath = std::move(node->mFilepath);
+  node->mFilepath.clear();
+  node->mValid = false;
+  Compact(node);
+  return filepath;
+}
+
 
-  // get target node
-  auto ptrSourceTargetNode = ptrSourceParentTree->Get(sourceBaseKey, false);
-  if (!ptrSourceTargetNode) {
+RenameStore::PathTrieTree::Node* RenameStore::PathTrieTree::MoveN(std::wstring_view source, std::wstring_view destination, std::wstring_view filepath) {
+  // moves the node at source (with its descendants) to destination and sets data on it
+  // returns nullptr if source does not exist or destination already exists
+  Node* sourceNode = MaterializeN(source);
+  if (!sourceNode) {
     // not exists
     return nullptr;
   }
 
-  // get parent node of destination
-  std::wstring_view destinationBaseKey;
-  RenameStore::PathTrieTree* ptrDestinationParentTree = nullptr;
-  if (auto lastDestinationDelimiterPos = destination.find_last_of(Delimiter); lastDestinationDelimiterPos != std::wstring_view::npos) {
-    destinationBaseKey = destination.substr(lastDestinationDelimiterPos + 1);
-    auto destinationParentKey = destination.substr(0, lastDestinationDelimiterPos);
-    ptrDestinationParentTree = &InsertRecursive(destinationParentKey).first;
-  } else {
-    destinationBaseKey = destination;
-    ptrDestinationParentTree = this;
-  }
-
-  auto ptrDestinationTargetNode = &ptrDestinationParentTree->InsertRecursive(destinationBaseKey).first;
-  if (ptrDestinationTargetNode == ptrSourceTargetNode) {
+  if (mEqualTo(source, destination)) {
     // same name but different letter case
-    PathTrieTree tempTree(std::move(*ptrSourceTargetNode));
-    ptrSourceParentTree->Remove(sourceBaseKey);
-    ptrSourceParentTree->InsertRecursive(destinationBaseKey).first = std::move(tempTree);
-  } else {
-    if (ptrDestinationTargetNode->mValid) {
-      // already exists
-      return nullptr;
-    }
+    const auto destinationBaseKey = destination.substr(destination.find_last_of(Delimiter) + 1);
+    Node* parent = sourceNode->mParent;
+    Detach(sourceNode);
+    sourceNode->mLabel.replace(sourceNode->mLabel.size() - destinationBaseKey.size(), destinationBaseKey.size(), destinationBaseKey);
+    Attach(parent, sourceNode);
+    sourceNode->SetData(filepath);
+    return sourceNode;
+  }
+
+  if (IsDescendant(mEqualTo, source, destination) || IsDescendant(mEqualTo, destination, source)) {
+    // cannot move a node into its own subtree or onto its ancestor
+    Compact(sourceNode);
+    return nullptr;
+  }
 
-    *ptrDestinationTargetNode = std::move(*ptrSourceTargetNode);
-    ptrSourceParentTree->Remove(sourceBaseKey);
+  Node* destinationNode = InsertNode(destination);
+  if (destinationNode->mValid) {
+    // already exists
+    Compact(sourceNode);
+    return nullptr;
   }
 
+  // replace the destination node (and its descendants) with the source node
+  Node* sourceParent = sourceNode->mParent;
+  Node* destinationParent = destinationNode->mParent;
+  Detach(destinationNode);
+  Detach(sourceNode);
+  sourceNode->mLabel = std::move(destinationNode->mLabel);
+  ReleaseNode(destinationNode);
+  Attach(destinationParent, sourceNode);
+  sourceNode->SetData(filepath);
+
   // remove unnecessary nodes
-  CleanupUnusedNodes(source);
+  Compact(sourceParent);
 
-  return ptrDestinationTargetNode;
+  return sourceNode;
 }
 
 
@@ -341,42 +413,29 @@ RenameStore::RenameStore(bool caseSensitive) :
 
 
 void RenameStore::AddEntry(std::wstring_view originalFilepath, std::wstring_view renamedFilepath) {
-  mForwardLookupTree.InsertRecursive(renamedFilepath.substr(1), originalFilepath);
-  mReverseLookupTree.InsertRecursive(originalFilepath.substr(1), renamedFilepath);
+  mForwardLookupTree.Insert(renamedFilepath.substr(1), originalFilepath, false);
+  mReverseLookupTree.Insert(originalFilepath.substr(1), renamedFilepath, false);
 }
 
 
 std::vector<std::pair<std::wstring, std::wstring>> RenameStore::GetEntries() const {
   std::vector<std::pair<std::wstring, std::wstring>> result;
-  mForwardLookupTree.Traverse([&result](const std::wstring& fullKey, const std::wstring& filepath, bool isValid) -> void {
-    if (!isValid) {
-      return;
-    }
+  mForwardLookupTree.Traverse([&result](const std::wstring& fullKey, const std::wstring& filepath) -> void {
     result.emplace_back(L"\\"s + fullKey, filepath);
-  }, false);
+  });
   return result;
 }
 
 
 std::vector<std::pair<std::wstring, std::wstring>> RenameStore::ListChildrenInForwardLookupTree(std::wstring_view filepath) const {
   // trim leading backslash
-  const auto trimedFilepath = filepath.substr(1);
-  const auto ptrTree = trimedFilepath.empty() ? &mForwardLookupTree : mForwardLookupTree.RetrieveRecursive(trimedFilepath);
-  if (!ptrTree) {
-    return {};
-  }
-  return ptrTree->ListChildren(true);
+  return mForwardLookupTree.ListChildren(filepath.substr(1));
 }
 
 
 std::vector<std::pair<std::wstring, std::wstring>> RenameStore::ListChildrenInReverseLookupTree(std::wstring_view filepath) const {
   // trim leading backslash
-  const auto trimedFilepath = filepath.substr(1);
-  const auto ptrTree = trimedFilepath.empty() ? &mReverseLookupTree : mReverseLookupTree.RetrieveRecursive(trimedFilepath);
-  if (!ptrTree) {
-    return {};
-  }
-  return ptrTree->ListChildren(true);
+  return mReverseLookupTree.ListChildren(filepath.substr(1));
 }
 
 
@@ -404,7 +463,12 @@ std::optional<std::wstring> RenameStore::Resolve(std::wstring_view filepath) con
   const auto trimedFilepath = filepath.substr(1);
   const auto forwardLongestMatch = mForwardLookupTree.FindLongestMatch(trimedFilepath);
   if (forwardLongestMatch) {
-    return forwardLongestMatch.value().second + std::wstring(trimedFilepath.substr(forwardLongestMatch.value().first.size()));
+    const auto& [matchedLength, resolvedPrefix] = forwardLongestMatch.value();
+    std::wstring resolved;
+    resolved.reserve(resolvedPrefix.size() + trimedFilepath.size() - matchedLength);
+    resolved += resolvedPrefix;
+    resolved += trimedFilepath.substr(matchedLength);
+    return resolved;
   }
   const auto reverseMatch = mReverseLookupTree.Match(trimedFilepath);
   if (reverseMatch) {
@@ -432,39 +496,41 @@ RenameStore::Result RenameStore::Rename(std::wstring_view srcFilepath, std::wstr
   }
 
   // modify forawrd lookup tree
-  PathTrieTree* ptrForwardDestinationNode = nullptr;
-  if (auto ptrForwardSourceNode = mForwardLookupTree.RetrieveRecursive(trimedSrcFilepath); ptrForwardSourceNode) {
+  const PathTrieTree::Node* ptrForwardDestinationNode = nullptr;
+  if (mForwardLookupTree.Contains(trimedSrcFilepath)) {
     // node already exists; move children
-    ptrForwardDestinationNode = mForwardLookupTree.MoveNode(trimedSrcFilepath, trimedDestFilepath);
+    ptrForwardDestinationNode = mForwardLookupTree.MoveN(trimedSrcFilepath, trimedDestFilepath, resolvedSrcFilepath.value());    // use resolved one
     if (!ptrForwardDestinationNode) {
       return Result::AlreadyExists;
     }
   } else {
     // create node
-    ptrForwardDestinationNode = &mForwardLookupTree.InsertRecursive(trimedDestFilepath).first;
+    ptrForwardDestinationNode = mForwardLookupTree.Insert(trimedDestFilepath, resolvedSrcFilepath.value(), true);    // use resolved one
   }
-  ptrForwardDestinationNode->SetData(resolvedSrcFilepath.value());    // use resolved one
 
   // modify reverse lookup tree
-  mReverseLookupTree.InsertRecursive(trimedSrcFilepath, destFilepath);
+  mReverseLookupTree.Insert(trimedSrcFilepath, destFilepath, false);
   const std::size_t oldPrefixLength = srcFilepath.size();   // not resolved one
   const std::wstring newPrefix(destFilepath);
-  ptrForwardDestinationNode->Traverse([this, oldPrefixLength, &newPrefix](const std::wstring& key, const std::wstring& value, bool valid) {
-    if (!valid) {
+  // point the reverse entries of the moved node and its descendants to the destination
+  // an entry may be missing or point elsewhere: entries are keyed by the name at the time of each rename, which is not the original one if it was renamed inside a renamed directory
+  const CaseSensitivity::CiEqualTo equalTo(mCaseSensitive);
+  const auto updateReverseEntry = [this, &equalTo, srcFilepath, oldPrefixLength, &newPrefix](std::wstring_view value) {
+    auto ptrNode = mReverseLookupTree.FindN(value.substr(1));
+    if (!ptrNode || !ptrNode->IsValid()) {
       return;
     }
-    auto ptrNode = mReverseLookupTree.RetrieveRecursive(std::wstring_view(value).substr(1));
-    assert(ptrNode && ptrNode->IsValid());
-    if (!ptrNode) {
-      // TODO: error handling
+    const auto& reverseData = ptrNode->GetData();
+    if (!equalTo(reverseData, srcFilepath) && !IsDescendant(equalTo, srcFilepath, reverseData)) {
       return;
     }
-    if (!ptrNode->IsValid()) {
-      // TODO: error handling
-      return;
-    }
-    ptrNode->SetData(newPrefix + ptrNode->GetData().substr(oldPrefixLength));
-  }, false);
+    ptrNode->SetData(newPrefix + reverseData.substr(oldPrefixLength));
+  };
+  // Traverse visits the descendants only
+  updateReverseEntry(ptrForwardDestinationNode->GetData());
+  mForwardLookupTree.Traverse(ptrForwardDestinationNode, [&updateReverseEntry](const std::wstring&, const std::wstring& value) {
+    updateReverseEntry(value);
+  });
 
   return Result::Success;
 }
@@ -475,17 +541,13 @@ bool RenameStore::RemoveEntry(std::wstring_view filepath) {
     return false;
   }
   const auto trimedFilepath = filepath.substr(1);
-  auto forwardResult = mForwardLookupTree.ResetEntry(trimedFilepath);
+  const auto forwardResult = mForwardLookupTree.Remove(trimedFilepath);
   if (!forwardResult) {
     return false;
   }
-  auto& [resolved, forwardValid] = forwardResult.value();
-  if (!forwardValid) {
-    return false;
-  }
-  const auto trimedResolved = std::wstring_view(resolved).substr(1);
-  auto reverseResult = mReverseLookupTree.ResetEntry(trimedResolved);
-  if (!reverseResult || !reverseResult.value().second) {
+  const auto trimedResolved = std::wstring_view(forwardResult.value()).substr(1);
+  const auto reverseResult = mReverseLookupTree.Remove(trimedResolved);
+  if (!reverseResult) {
     // error
     return false;
   }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <deque>
 #include <functional>
 #include <optional>
 #include <string>
@@ -13,53 +14,80 @@
 
 
 class RenameStore {
+  // path-compressed radix tree keyed by path components
+  // an edge may hold several components (e.g. "a\\b\\c"); nodes exist only where they are valid or branch
+  // nodes are allocated from an arena owned by the tree and looked up by std::wstring_view without allocating
   class PathTrieTree {
   public:
     static constexpr wchar_t Delimiter = L'\\';
 
-  private:
-    bool mCaseSensitive;      // not const because of move assignment operator
-    std::unordered_map<std::wstring, PathTrieTree, CaseSensitivity::CiHash, CaseSensitivity::CiEqualTo> mChildren;
-    bool mValid;
-    std::wstring mFilepath;
+    class Node {
+      friend class PathTrieTree;
 
-  public:
-    // disable copy constructor and copy assignment operator for performance reasons
-    PathTrieTree(const PathTrieTree&) = delete;
-    PathTrieTree& operator=(const PathTrieTree&) = delete;
+      using Children = std::unordered_map<std::wstring_view, Node*, CaseSensitivity::CiHash, CaseSensitivity::CiEqualTo>;
 
-    // define move constructor and move assignment operator
-    PathTrieTree(PathTrieTree&&) = default;
-    PathTrieTree& operator=(PathTrieTree&&) = default;
+      std::wstring mLabel;      // components from the parent node joined with Delimiter; empty for the root node
+      Node* mParent;
+      Children mChildren;       // keyed by the first component of each child's label (views into the children's mLabel)
+      bool mValid;
+      std::wstring mFilepath;
 
-    PathTrieTree(bool caseSensitive);
-    PathTrieTree(bool caseSensitive, std::wstring_view filepath);
+    public:
+      Node(bool caseSensitive);
+
+      Node(const Node&) = delete;
+      Node& operator=(const Node&) = delete;
+
+      bool IsValid() const;
+      const std::wstring& GetData() const;
+      void SetData(std::wstring_view filepath);
+    };
 
   private:
-    void Traverse(const std::wstring& prefix, std::function<void(const std::wstring&, const std::wstring&, bool)>& callback) const;
-    std::size_t CleanupUnusedNodes(std::wstring_view key);
+    // position reached by walking a key from the root node
+    struct Cursor {
+      Node* node;
+      std::size_t labelLength;    // matched length of node->mLabel (shorter than the label if the walk ended in the middle of an edge)
+      std::size_t keyLength;      // matched length of the key
+    };
+
+    const bool mCaseSensitive;
+    const CaseSensitivity::CiEqualTo mEqualTo;
+    std::deque<Node> mNodes;          // arena; std::deque never relocates its elements
+    std::vector<Node*> mFreeNodes;
+    Node* mRoot;
+
+    Node* AllocateNode(Node* parent, std::wstring_view label);
+    void ReleaseNode(Node* node);
+    void Attach(Node* parent, Node* child);
+    void Detach(Node* child);
+    Node* Split(Node* node, std::size_t labelLength);
+    void Compact(Node* node);
+    template<typename F>
+    Cursor Walk(std::wstring_view key, F&& callback) const;
+    Cursor Walk(std::wstring_view key) const;
+    Node* MaterializeN(std::wstring_view key);
+    Node* InsertNode(std::wstring_view key);
+    void Traverse(const Node* node, const std::wstring& prefix, const std::function<void(const std::wstring&, const std::wstring&)>& callback) const;
 
   public:
+    PathTrieTree(bool caseSensitive);
+
+    PathTrieTree(const PathTrieTree&) = delete;
+    PathTrieTree& operator=(const PathTrieTree&) = delete;
+
     bool IsCaseSensitive() const;
-    bool IsValid() const;
-    const std::wstring& GetData() const;
-    void SetData(std::wstring_view filepath);
-    void Invalidate();
-    bool Has(std::wstring_view key, bool validOnly) const;
-    PathTrieTree* Get(std::wstring_view key, bool validOnly);
-    const PathTrieTree* Get(std::wstring_view key, bool validOnly) const;
-    bool Remove(std::wstring_view key);
-    std::vector<std::pair<std::wstring, std::wstring>> ListChildren(bool validOnly) const;
-
-    PathTrieTree* RetrieveRecursive(std::wstring_view key);
-    const PathTrieTree* RetrieveRecursive(std::wstring_view key) const;
+    bool Contains(std::wstring_view key) const;
+    Node* FindN(std::wstring_view key);
+    const Node* FindN(std::wstring_view key) const;
+    std::vector<std::pair<std::wstring, std::wstring>> ListChildren(std::wstring_view key) const;
     bool Match(std::wstring_view key) const;
-    std::optional<std::pair<std::wstring, std::wstring>> FindLongestMatch(std::wstring_view key) const;
-    void Traverse(std::function<void(const std::wstring&, const std::wstring&, bool)> callback, bool self) const;
-    std::pair<PathTrieTree&, bool> InsertRecursive(std::wstring_view key);
-    std::pair<PathTrieTree&, bool> InsertRecursive(std::wstring_view key, std::wstring_view filepath);
-    std::optional<std::pair<std::wstring, bool>> ResetEntry(std::wstring_view key);
-    PathTrieTree* MoveNode(std::wstring_view from, std::wstring_view to);
+    std::optional<std::pair<std::size_t, std::wstring_view>> FindLongestMatch(std::wstring_view key) const;
+    void Traverse(std::function<void(const std::wstring&, const std::wstring&)> callback) const;
+    void Traverse(const Node* node, std::function<void(const std::wstring&, const std::wstring&)> callback) const;
+    Node* Insert(std::wstring_view key, std::wstring_view filepath, bool overwrite);
+    std::optional<std::wstring> Remove(std::wstring_view key);
+    Node* MoveN(std::wstring_view source, std::wstring_view destination, std::wstring_view filepath);
   };
 
   const bool mCaseSensitive;
@@ -1,6 +1,8 @@
 #include "SourcePlugin.hpp"
 #include "NsError.hpp"
 
+#include "../SDK/Wildcard.hpp"
+
 #include <stdexcept>
 
 using namespace std::literals;
@@ -23,9 +25,11 @@ void WINAPI SourcePlugin::ListStreamsCallback(PWIN32_FIND_STREAM_DATA FindStream
 
 SourcePlugin::SourcePlugin(std::wstring_view pluginFilePath) :
   PluginBase(pluginFilePath, PluginBase::PLUGIN_TYPE::Source),
+  m_sourceContextIdAllocator(SourceContextIdStart, SourceContextIdReuseDelay),
   _Mount(dll.GetProc<PMount>("Mount")),
   _Unmount(dll.GetProc<PUnmount>("Unmount")),
   _ListFiles(dll.GetProc<PListFiles>("ListFiles")),
+  _ListFilesWithPatternN(dll.GetProcN<PListFilesWithPattern>("ListFilesWithPattern")),
   _ListStreams(dll.GetProc<PListStreams>("ListStreams")),
   SIsSupported(dll.GetProc<PSIsSupported>("SIsSupported")),
   GetSourceInfo(dll.GetProc<PGetSourceInfo>("GetSourceInfo")),
@@ -65,23 +69,12 @@ SourcePlugin::SourcePlugin(std::wstring_view pluginFilePath) :
 
 
 SourcePlugin::SOURCE_CONTEXT_ID SourcePlugin::AllocateSourceContextId() {
-  const auto sourceContextId = m_nextSourceContextId;
-  m_usedSourceContextIdSet.emplace(sourceContextId);
-  do {
-    m_nextSourceContextId++;
-  } while (m_usedSourceContextIdSet.count(m_nextSourceContextId));
-  return sourceContextId;
+  return m_sourceContextIdAllocator.Allocate();
 }
 
 
 bool SourcePlugin::ReleaseSourceContextId(SOURCE_CONTEXT_ID sourceContextId) {
-  if (sourceContextId < SourceContextIdStart) {
-    return false;
-  }
-  if (sourceContextId < m_nextSourceContextId) {
-    m_nextSourceContextId = sourceContextId;
-  }
-  return m_usedSourceContextIdSet.erase(sourceContextId);
+  return m_sourceContextIdAllocator.Release(sourceContextId);
 }
 
 
@@ -124,6 +117,31 @@ NTSTATUS SourcePlugin::ListFiles(LPCWSTR FileName, ListFilesUserCallback Callbac
 }
 
 
+// プラグインから返されたファイルもパターンに一致するかどうか確認する（プラグインのフィルタは大まかでもよい）
+// ListFilesWithPatternを実装していないプラグインではListFilesの結果をここでフィルタする
+NTSTATUS SourcePlugin::ListFilesWithPattern(LPCWSTR FileName, LPCWSTR SearchPattern, bool CaseSensitive, ListFilesUserCallback Callback, SOURCE_CONTEXT_ID SourceContextId) noexcept {
+  try {
+    if (!SearchPattern || Wildcard::IsMatchAllPattern(SearchPattern)) {
+      return ListFiles(FileName, std::move(Callback), SourceContextId);
+    }
+    ListFilesUserCallback filterCallback = [&](PWIN32_FIND_DATAW FindDataW) {
+      if (FindDataW && !Wildcard::Match(SearchPattern, FindDataW->cFileName, CaseSensitive)) {
+        return;
+      }
+      Callback(FindDataW);
+    };
+    if (_ListFilesWithPatternN) {
+      return _ListFilesWithPatternN(FileName, SearchPattern, ListFilesCallback, &filterCallback, SourceContextId);
+    }
+    return _ListFiles(FileName, ListFilesCallback, &filterCallback, SourceContextId);
+  } catch (std::bad_alloc&) {
+    return STATUS_NO_MEMORY;
+  } catch (...) {
+    return STATUS_UNSUCCESSFUL;
+  }
+}
+
+
 NTSTATUS SourcePlugin::ListStreams(LPCWSTR FileName, ListStreamsUserCallback Callback, SOURCE_CONTEXT_ID SourceContextId) noexcept {
   try {
     return _ListStreams(FileName, ListStreamsCallback, &Callback, SourceContextId);
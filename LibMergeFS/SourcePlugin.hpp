@@ -4,14 +4,15 @@
 
 #include "../dokan/dokan/dokan.h"
 
+#include "IdAllocator.hpp"
 #include "PluginBase.hpp"
 
 #include "../SDK/Plugin/Source.h"
 
+#include <cstddef>
 #include <functional>
 #include <string>
 #include <string_view>
-#include <unordered_set>
 
 
 class SourcePlugin : public PluginBase {
@@ -47,12 +48,14 @@ public:
 
 private:
   static constexpr SOURCE_CONTEXT_ID SourceContextIdStart = SOURCE_CONTEXT_ID_NULL + 1;
+  static constexpr std::size_t SourceContextIdReuseDelay = 16;
 
   using CALLBACK_CONTEXT = ::CALLBACK_CONTEXT;
   using PListFilesCallback = ::PListFilesCallback;
   using PListStreamsCallback = ::PListStreamsCallback;
 
   using PListFiles = decltype(&External::Plugin::Source::ListFiles);
+  using PListFilesWithPattern = decltype(&External::Plugin::Source::ListFilesWithPattern);
   using PListStreams = decltype(&External::Plugin::Source::ListStreams);
 
 public:
@@ -99,12 +102,12 @@ private:
   static void WINAPI ListFilesCallback(PWIN32_FIND_DATAW FindDataW, void* CallbackContext) noexcept;
   static void WINAPI ListStreamsCallback(PWIN32_FIND_STREAM_DATA FindStreamData, void* CallbackContext) noexcept;
 
-  std::unordered_set<SOURCE_CONTEXT_ID> m_usedSourceContextIdSet;
-  SOURCE_CONTEXT_ID m_nextSourceContextId = SourceContextIdStart;
+  IdAllocator<SOURCE_CONTEXT_ID> m_sourceContextIdAllocator;
 
   const PMount _Mount;
   const PUnmount _Unmount;
   const PListFiles _ListFiles;
+  const PListFilesWithPattern _ListFilesWithPatternN;
   const PListStreams _ListStreams;
 
   SOURCE_CONTEXT_ID AllocateSourceContextId();
@@ -153,5 +156,6 @@ public:
   NTSTATUS Mount(const PLUGIN_INITIALIZE_MOUNT_INFO* InitializeMountInfo, SOURCE_CONTEXT_ID& sourceContextId) noexcept;
   BOOL Unmount(SOURCE_CONTEXT_ID sourceContextId) noexcept;
   NTSTATUS ListFiles(LPCWSTR FileName, ListFilesUserCallback Callback, SOURCE_CONTEXT_ID SourceContextId) noexcept;
+  NTSTATUS ListFilesWithPattern(LPCWSTR FileName, LPCWSTR SearchPattern, bool CaseSensitive, ListFilesUserCallback Callback, SOURCE_CONTEXT_ID SourceContextId) noexcept;
   NTSTATUS ListStreams(LPCWSTR FileName, ListStreamsUserCallback Callback, SOURCE_CONTEXT_ID SourceContextId) noexcept;
 };
@@ -0,0 +1,128 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+
+
+ThreadPool::ThreadPool(std::size_t threadCount) :
+  m_mutex(),
+  m_cv(),
+  m_finish(false),
+  m_queue(),
+  m_threads()
+{
+  m_threads.reserve(threadCount);
+  for (std::size_t i = 0; i < threadCount; i++) {
+    m_threads.emplace_back([this]() {
+      std::unique_lock lock(m_mutex);
+      while (true) {
+        m_cv.wait(lock, [this]() {
+          return m_finish || !m_queue.empty();
+        });
+        if (m_queue.empty()) {
+          // m_finish
+          break;
+        }
+        auto task = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+        try {
+          task();
+        } catch (...) {}
+        lock.lock();
+      }
+    });
+  }
+}
+
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(m_mutex);
+    m_finish = true;
+    m_cv.notify_all();
+  }
+  for (auto& thread : m_threads) {
+    thread.join();
+  }
+}
+
+
+std::size_t ThreadPool::GetThreadCount() const {
+  return m_threads.size();
+}
+
+
+void ThreadPool::Post(std::function<void()> task) {
+  if (m_threads.empty()) {
+    task();
+    return;
+  }
+  std::lock_guard lock(m_mutex);
+  m_queue.emplace_back(std::move(task));
+  m_cv.notify_one();
+}
+
+
+void ThreadPool::RunParallel(std::size_t count, const std::function<void(std::size_t)>& func) {
+  struct State {
+    std::atomic<std::size_t> next;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::size_t finished;
+    std::exception_ptr exception;
+  };
+
+  if (count == 0) {
+    return;
+  }
+
+  // ワーカーの処理が始まる前に呼び出し元が全て処理し終えて戻ることがあるため、状態は共有ポインタで保持する
+  // ワーカーは未処理のインデックスを確保できた場合に限りfuncに触れるので、funcの寿命は呼び出し元で足りる
+  const auto state = std::make_shared<State>();
+  state->next = 0;
+  state->finished = 0;
+
+  const auto process = [state, count, &func]() {
+    std::size_t index;
+    while ((index = state->next.fetch_add(1)) < count) {
+      std::exception_ptr exception;
+      try {
+        func(index);
+      } catch (...) {
+        exception = std::current_exception();
+      }
+      std::lock_guard lock(state->mutex);
+      if (exception && !state->exception) {
+        state->exception = exception;
+      }
+      if (++state->finished == count) {
+        state->cv.notify_all();
+      }
+    }
+  };
+
+  const std::size_t helperCount = std::min(count - 1, m_threads.size());
+  for (std::size_t i = 0; i < helperCount; i++) {
+    Post(process);
+  }
+
+  process();
+
+  std::unique_lock lock(state->mutex);
+  state->cv.wait(lock, [&state, count]() {
+    return state->finished == count;
+  });
+  if (state->exception) {
+    std::rethrow_exception(state->exception);
+  }
+}
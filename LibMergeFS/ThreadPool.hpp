@@ -0,0 +1,36 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// 固定数のワーカースレッドを持つスレッドプール
+class ThreadPool {
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_finish;
+  std::deque<std::function<void()>> m_queue;
+  std::vector<std::thread> m_threads;
+
+public:
+  // threadCountに0を指定した場合、RunParallelは呼び出し元のスレッドのみで処理する
+  ThreadPool(std::size_t threadCount);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  std::size_t GetThreadCount() const;
+
+  void Post(std::function<void()> task);
+
+  // func(0) ... func(count - 1) を並列に実行し、全て完了するまで待機する
+  // 呼び出し元のスレッドも処理に参加するので、プールが混雑していても処理が滞ることはない
+  // funcが例外を送出した場合は、全て完了した後に最初の例外を再送出する
+  void RunParallel(std::size_t count, const std::function<void(std::size_t)>& func);
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "MountConfig.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <Windows.h>
+
+
+
+// ソース間でのファイルのコピー（トップソースへのコピーアップ）
+// TMountSourceはPORTATION_INFO型と、ExportStart、ExportData、ExportFinish、ImportStart、ImportData、ImportFinishを持つ必要がある
+// 各メンバ関数はNTSTATUSを返して例外を投げないこと
+
+
+template<typename TMountSource>
+NTSTATUS TransportData(TMountSource& source, TMountSource& destination, typename TMountSource::PORTATION_INFO& portationInfo) noexcept {
+  while (true) {
+    const auto statusS = source.ExportData(&portationInfo);
+    if (statusS == STATUS_ALREADY_COMPLETE) {
+      return STATUS_SUCCESS;
+    }
+    if (statusS != STATUS_SUCCESS) {
+      return statusS;
+    }
+
+    if (const auto statusD = destination.ImportData(&portationInfo); statusD != STATUS_SUCCESS) {
+      return statusD;
+    }
+  }
+}
+
+
+// ExportDataとImportDataを別スレッドで並行して行う
+// エクスポータのバッファは次のExportDataで上書きされるため、データは一旦こちらのバッファにコピーしてからインポータに渡す
+// インポータにはImportStart後のPORTATION_INFOのコピーを渡すので、importerContextはそのまま引き継がれる
+// どちらかが失敗した場合は、もう一方も止めてから戻る
+template<typename TMountSource>
+NTSTATUS TransportDataPipelined(TMountSource& source, TMountSource& destination, typename TMountSource::PORTATION_INFO& portationInfo) {
+  using PORTATION_INFO = typename TMountSource::PORTATION_INFO;
+
+  struct Chunk {
+    std::vector<char> data;
+    LARGE_INTEGER offset;
+  };
+
+  std::vector<Chunk> chunks(MountConfig::TransportPipelineDepth);
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Chunk*> freeChunks;
+  std::deque<Chunk*> filledChunks;
+  bool exportFinished = false;
+  NTSTATUS importStatus = STATUS_SUCCESS;
+
+  for (auto& chunk : chunks) {
+    freeChunks.push_back(&chunk);
+  }
+
+  PORTATION_INFO importPortationInfo(portationInfo);
+
+  std::thread importThread([&]() noexcept {
+    while (true) {
+      Chunk* chunk = nullptr;
+      {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [&]() {
+          return !filledChunks.empty() || exportFinished;
+        });
+        if (filledChunks.empty()) {
+          return;
+        }
+        chunk = filledChunks.front();
+        filledChunks.pop_front();
+      }
+
+      importPortationInfo.currentOffset = chunk->offset;
+      importPortationInfo.currentSize = static_cast<DWORD>(chunk->data.size());
+      importPortationInfo.currentData = chunk->data.data();
+
+      const auto status = destination.ImportData(&importPortationInfo);
+
+      {
+        std::lock_guard lock(mutex);
+        if (status != STATUS_SUCCESS) {
+          importStatus = status;
+        } else {
+          freeChunks.push_back(chunk);
+        }
+      }
+      cv.notify_all();
+
+      if (status != STATUS_SUCCESS) {
+        return;
+      }
+    }
+  });
+
+  const auto exportStatus = [&]() noexcept -> NTSTATUS {
+    try {
+      while (true) {
+        if (const auto status = source.ExportData(&portationInfo); status != STATUS_SUCCESS) {
+          return status == STATUS_ALREADY_COMPLETE ? STATUS_SUCCESS : status;
+        }
+
+        Chunk* chunk = nullptr;
+        {
+          std::unique_lock lock(mutex);
+          cv.wait(lock, [&]() {
+            return !freeChunks.empty() || importStatus != STATUS_SUCCESS;
+          });
+          if (importStatus != STATUS_SUCCESS) {
+            return STATUS_SUCCESS;
+          }
+          chunk = freeChunks.front();
+          freeChunks.pop_front();
+        }
+
+        chunk->data.assign(portationInfo.currentData, portationInfo.currentData + portationInfo.currentSize);
+        chunk->offset = portationInfo.currentOffset;
+
+        {
+          std::lock_guard lock(mutex);
+          filledChunks.push_back(chunk);
+        }
+        cv.notify_all();
+      }
+    } catch (std::bad_alloc&) {
+      return STATUS_NO_MEMORY;
+    } catch (...) {
+      return STATUS_UNSUCCESSFUL;
+    }
+  }();
+
+  {
+    std::lock_guard lock(mutex);
+    // エクスポートに失敗した場合は残りをインポートしても無駄なので捨てる
+    if (exportStatus != STATUS_SUCCESS) {
+      filledChunks.clear();
+    }
+    exportFinished = true;
+  }
+  cv.notify_all();
+
+  importThread.join();
+
+  return exportStatus != STATUS_SUCCESS ? exportStatus : importStatus;
+}
+
+
+// portationInfoはfilepath、fileContextId、emptyを設定したもの
+// 途中で失敗した場合は、インポータとエクスポータの両方のFinishをfalseで呼び出す
+template<typename TMountSource>
+NTSTATUS TransportFile(TMountSource& source, TMountSource& destination, typename TMountSource::PORTATION_INFO& portationInfo) {
+  if (const auto status = source.ExportStart(&portationInfo); status != STATUS_SUCCESS) {
+    return status;
+  }
+
+  if (const auto status = destination.ImportStart(&portationInfo); status != STATUS_SUCCESS) {
+    source.ExportFinish(&portationInfo, false);
+    return status;
+  }
+
+  if (!portationInfo.empty && !portationInfo.directory) {
+    const bool pipelined = static_cast<ULONGLONG>(portationInfo.fileSize.QuadPart) >= MountConfig::TransportPipelineThreshold;
+    NTSTATUS status = STATUS_SUCCESS;
+    if (pipelined) {
+      // スレッドを作成できなかった場合など
+      try {
+        status = TransportDataPipelined(source, destination, portationInfo);
+      } catch (std::bad_alloc&) {
+        status = STATUS_NO_MEMORY;
+      } catch (...) {
+        status = STATUS_UNSUCCESSFUL;
+      }
+    } else {
+      status = TransportData(source, destination, portationInfo);
+    }
+    if (status != STATUS_SUCCESS) {
+      destination.ImportFinish(&portationInfo, false);
+      source.ExportFinish(&portationInfo, false);
+      return status;
+    }
+  }
+
+  if (const auto status = destination.ImportFinish(&portationInfo, true); status != STATUS_SUCCESS) {
+    source.ExportFinish(&portationInfo, false);
+    return status;
+  }
+
+  if (const auto status = source.ExportFinish(&portationInfo, true); status != STATUS_SUCCESS) {
+    return status;
+  }
+
+  return STATUS_SUCCESS;
+}
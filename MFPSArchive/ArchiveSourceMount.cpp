@@ -8,8 +8,11 @@
 #include <cassert>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
 
 #include <Windows.h>
 #include <winrt/base.h>
@@ -18,11 +21,15 @@
 #include "../Util/InternalFs.hpp"
 #include "../Util/RealFs.hpp"
 #include "../Util/VirtualFs.hpp"
+#include "../SDK/Wildcard.hpp"
 
 #include "ArchiveSourceMount.hpp"
 #include "ArchiveSourceMountFile.hpp"
+#include "BlockCache.hpp"
 #include "Util.hpp"
+#include "NanaZ/ArchiveIndex.hpp"
 #include "NanaZ/COMError.hpp"
+#include "NanaZ/ExtractedContent.hpp"
 #include "NanaZ/FileStream.hpp"
 #include "NanaZ/NanaZ.hpp"
 
@@ -31,6 +38,27 @@ using json = nlohmann::json;
 
 
 
+namespace {
+  void CallListFilesCallback(const std::wstring& name, const DirectoryTree& directoryTree, PListFilesCallback Callback, CALLBACK_CONTEXT CallbackContext) {
+    WIN32_FIND_DATAW win32FindDataW{
+      DirectoryTree::FilterArchiveFileAttributes(directoryTree),
+      directoryTree.creationTime,
+      directoryTree.lastAccessTime,
+      directoryTree.lastWriteTime,
+      (directoryTree.fileSize >> 32) & 0xFFFFFFFF,
+      directoryTree.fileSize & 0xFFFFFFFF,
+      0,
+      0,
+    };
+    std::size_t copyLength = std::min<std::size_t>(name.size(), MAX_PATH - 1);
+    std::memcpy(win32FindDataW.cFileName, name.c_str(), copyLength * sizeof(wchar_t));
+    win32FindDataW.cFileName[copyLength] = L'\0';
+    Callback(&win32FindDataW, CallbackContext);
+  }
+}
+
+
+
 ArchiveSourceMount::ExportPortation::ExportPortation(ArchiveSourceMount& sourceMount, PORTATION_INFO* portationInfo) :
   sourceMount(sourceMount),
   filepath(portationInfo->filepath),
@@ -38,8 +66,11 @@ ArchiveSourceMount::ExportPortation::ExportPortation(ArchiveSourceMount& sourceM
   empty(portationInfo->empty),
   sourceMountFile(portationInfo->fileContextId != FILE_CONTEXT_ID_NULL ? std::static_pointer_cast<ArchiveSourceMountFile>(sourceMount.GetSourceMountFileBase(portationInfo->fileContextId)) : nullptr),
   realPath(sourceMount.GetRealPath(portationInfo->filepath)),
-  ptrDirectoryTree(sourceMount.GetDirectoryTreeR(realPath)),
-  lastNumberOfBytesWritten(0)
+  pin(),
+  ptrDirectoryTree(sourceMount.GetDirectoryTreeR(realPath, pin)),
+  lastNumberOfBytesWritten(0),
+  bufferSize(0),
+  chunkSize(MinChunkSize)
 {
   if (!ptrDirectoryTree) {
     throw NtstatusError(sourceMount.ReturnPathOrNameNotFoundErrorR(realPath));
@@ -49,7 +80,8 @@ ArchiveSourceMount::ExportPortation::ExportPortation(ArchiveSourceMount& sourceM
 
   // allocate buffer
   if (!directory) {
-    buffer = std::make_unique<char[]>(BufferSize);
+    bufferSize = static_cast<std::size_t>(std::min<ULONGLONG>(ptrDirectoryTree->fileSize, MaxChunkSize));
+    buffer = std::make_unique<char[]>(bufferSize);
   }
 
   portationInfo->directory = directory ? TRUE : FALSE;
@@ -76,10 +108,11 @@ NTSTATUS ArchiveSourceMount::ExportPortation::Export(PORTATION_INFO* portationIn
 
   portationInfo->currentOffset.QuadPart += lastNumberOfBytesWritten;
 
-  const std::size_t size = static_cast<std::size_t>(std::min<ULONGLONG>(portationInfo->fileSize.QuadPart - portationInfo->currentOffset.QuadPart, BufferSize));
+  const std::size_t size = static_cast<std::size_t>(std::min<ULONGLONG>(portationInfo->fileSize.QuadPart - portationInfo->currentOffset.QuadPart, std::min(chunkSize, bufferSize)));
   if (size == 0) {
     return STATUS_ALREADY_COMPLETE;
   }
+  chunkSize = std::min(chunkSize * 2, MaxChunkSize);
 
   {
     std::lock_guard lock(*ptrDirectoryTree->streamMutex);
@@ -100,9 +133,11 @@ NTSTATUS ArchiveSourceMount::ExportPortation::Finish(PORTATION_INFO* portationIn
 
 
 
-ArchiveSourceMount::ArchiveSourceMount(NanaZ& nanaZ, const PLUGIN_INITIALIZE_MOUNT_INFO* initializeMountInfo, SOURCE_CONTEXT_ID sourceContextId) :
+ArchiveSourceMount::ArchiveSourceMount(NanaZ& nanaZ, MemoryBudget& memoryBudget, const PLUGIN_INITIALIZE_MOUNT_INFO* initializeMountInfo, SOURCE_CONTEXT_ID sourceContextId) :
   ReadonlySourceMountBase(initializeMountInfo, sourceContextId),
   nanaZ(nanaZ),
+  memoryBudget(memoryBudget),
+  memoryBudgetRequestN(),
   subMutex(),
   portationMap(),
   archiveFileHandle(NULL)
@@ -116,6 +151,16 @@ ArchiveSourceMount::ArchiveSourceMount(NanaZ& nanaZ, const PLUGIN_INITIALIZE_MOU
     DirectoryTree::OnExisting optOnExisting = DirectoryTree::OnExisting::RenameNewOne;
     DirectoryTree::ExtractToMemory optExtractToMemory = DirectoryTree::ExtractToMemory::Auto;
     bool optRecursive = true;
+    std::size_t optBlockCacheSize = 64 * 1024 * 1024;
+    std::size_t optReadaheadBlocks = 4;
+    std::size_t optMaxArchiveInstances = 4;
+    std::optional<std::wstring> optIndexCacheDirectoryN;
+    std::size_t optMaxOpenNestedArchives = 64;
+    std::size_t optMaxNestedArchiveMemory = 256 * 1024 * 1024;
+    std::optional<std::size_t> optMemoryBudgetN;
+    UInt64 optSpillThreshold = 32 * 1024 * 1024;
+    std::size_t optPrefetchThreads = 0;
+    std::size_t optPrefetchDepth = 4;
 
     if (initializeMountInfo->OptionsJSON && initializeMountInfo->OptionsJSON[0] == '{') {
       try {
@@ -160,6 +205,56 @@ ArchiveSourceMount::ArchiveSourceMount(NanaZ& nanaZ, const PLUGIN_INITIALIZE_MOU
         } catch (json::type_error) {
         } catch (json::out_of_range) {}
 
+        try {
+          optBlockCacheSize = jsonOptions.at("blockCacheSize"s).get<std::size_t>();
+        } catch (json::type_error) {
+        } catch (json::out_of_range) {}
+
+        try {
+          optReadaheadBlocks = jsonOptions.at("readaheadBlocks"s).get<std::size_t>();
+        } catch (json::type_error) {
+        } catch (json::out_of_range) {}
+
+        try {
+          optMaxArchiveInstances = jsonOptions.at("maxArchiveInstances"s).get<std::size_t>();
+        } catch (json::type_error) {
+        } catch (json::out_of_range) {}
+
+        try {
+          optIndexCacheDirectoryN = jsonOptions.at("indexCacheDirectory"s).get<std::wstring>();
+        } catch (json::type_error) {
+        } catch (json::out_of_range) {}
+
+        try {
+          optMaxOpenNestedArchives = jsonOptions.at("maxOpenNestedArchives"s).get<std::size_t>();
+        } catch (json::type_error) {
+        } catch (json::out_of_range) {}
+
+        try {
+          optMaxNestedArchiveMemory = jsonOptions.at("maxNestedArchiveMemory"s).get<std::size_t>();
+        } catch (json::type_error) {
+        } catch (json::out_of_range) {}
+
+        try {
+          optMemoryBudgetN = jsonOptions.at("memoryBudget"s).get<std::size_t>();
+        } catch (json::type_error) {
+        } catch (json::out_of_range) {}
+
+        try {
+          optSpillThreshold = jsonOptions.at("spillThreshold"s).get<unsigned long long>();
+        } catch (json::type_error) {
+        } catch (json::out_of_range) {}
+
+        try {
+          optPrefetchThreads = jsonOptions.at("prefetchThreads"s).get<std::size_t>();
+        } catch (json::type_error) {
+        } catch (json::out_of_range) {}
+
+        try {
+          optPrefetchDepth = jsonOptions.at("prefetchDepth"s).get<std::size_t>();
+        } catch (json::type_error) {
+        } catch (json::out_of_range) {}
+
         //
       } catch (json::type_error) {
       } catch (json::out_of_range) {}
@@ -202,8 +297,40 @@ ArchiveSourceMount::ArchiveSourceMount(NanaZ& nanaZ, const PLUGIN_INITIALIZE_MOU
     fileSystemFlags = FILE_CASE_PRESERVED_NAMES | FILE_UNICODE_ON_DISK;
     fileSystemName = L"ARCHIVE"s;
 
+    // cache decompressed contents of files read from the archive stream (files extracted to memory do not use this)
+    blockCacheN.emplace(optBlockCacheSize, optReadaheadBlocks);
+
+    // load index of the archive saved on the previous mount
+    // an empty indexCacheDirectory disables the index cache; it defaults to a directory in %TEMP%
+    // the index is kept during the mount as nested archives are indexed on first access
+    if (optIndexCacheDirectoryN) {
+      archiveIndexDirectory = optIndexCacheDirectoryN.value();
+    } else {
+      wchar_t tempPathBuffer[MAX_PATH + 1];
+      const DWORD tempPathLength = GetTempPathW(MAX_PATH + 1, tempPathBuffer);
+      if (tempPathLength && tempPathLength <= MAX_PATH) {
+        archiveIndexDirectory = std::wstring(tempPathBuffer, tempPathLength) + L"MergeFS.ArchiveIndex"s;
+      }
+    }
+    if (!archiveIndexDirectory.empty()) {
+      try {
+        archiveIndexKeyN = ArchiveIndexKey::FromFile(archiveFileHandle, archiveFileInfo);
+        archiveIndexFilepath = ArchiveIndex::GetIndexFilepath(archiveIndexDirectory, archiveFilepath);
+        archiveIndexN.emplace();
+        archiveIndexN.value().Load(archiveIndexFilepath, archiveIndexKeyN.value());
+      } catch (...) {
+        archiveIndexN = std::nullopt;
+      }
+    }
+
+    // the memory budget is shared by all mounts of the plugin; its capacity is the largest "memoryBudget" among the mounted archives,
+    // where a mount without the option counts as the default (see DMemoryBudget), and shrinks again when such a mount is unmounted
+    memoryBudgetRequestN.emplace(memoryBudget, optMemoryBudgetN.value_or(memoryBudget.GetDefaultCapacity()));
+
     // open archive
-    archiveN.emplace(nanaZ, winrt::make_self<InFileStream>(archiveFileHandle), archiveFileInfo, optDefaultFilepath, pathPrefixWb, caseSensitive, optMaxCheckStartPosition, optOnExisting, optExtractToMemory, [optRecursive](const std::wstring& originalFilepath, std::size_t count) -> std::optional<std::pair<std::wstring, bool>> {
+    // contents extracted to memory are charged to the shared memory budget, and those larger than optSpillThreshold are extracted to temporary files instead
+    // nested archives are opened on first access, and closed again when more than optMaxOpenNestedArchives of them are open or they use more than optMaxNestedArchiveMemory bytes
+    archiveN.emplace(nanaZ, memoryBudget, winrt::make_self<InFileStream>(archiveFileHandle), archiveFileInfo, optDefaultFilepath, pathPrefixWb, caseSensitive, optMaxCheckStartPosition, optOnExisting, optExtractToMemory, [optRecursive](const std::wstring& originalFilepath, std::size_t count) -> std::optional<std::pair<std::wstring, bool>> {
       if (!optRecursive) {
         return std::nullopt;
       }
@@ -216,7 +343,20 @@ ArchiveSourceMount::ArchiveSourceMount(NanaZ& nanaZ, const PLUGIN_INITIALIZE_MOU
         newFilepath += L"."s + std::to_wstring(count + 1);
       }
       return std::make_optional<std::pair<std::wstring, bool>>(newFilepath, false);
-    }, nullptr);
+    }, nullptr, archiveIndexN ? &archiveIndexN.value() : nullptr, optMaxOpenNestedArchives, optMaxNestedArchiveMemory, optSpillThreshold);
+
+    SaveArchiveIndex();
+
+    // files of the root archive are read via other instances of the archive, which have their own file handles, so that they can be read concurrently
+    archiveInstancePoolN.emplace(nanaZ, archiveN.value().GetFormatClsid(), optMaxCheckStartPosition, optMaxArchiveInstances, [archiveFilepath = archiveFilepath]() -> winrt::com_ptr<IInStream> {
+      return winrt::make_self<InFileStream>(archiveFilepath.c_str());
+    });
+
+    // files extracted to memory which are likely to be read next are extracted again in background after being evicted
+    // prefetchThreads of 0 (the default) disables it
+    if (optPrefetchThreads != 0) {
+      prefetcherN.emplace(memoryBudget, optPrefetchThreads, optPrefetchDepth);
+    }
   } catch (...) {
     if (util::IsValidHandle(archiveFileHandle)) {
       CloseHandle(archiveFileHandle);
@@ -228,7 +368,26 @@ ArchiveSourceMount::ArchiveSourceMount(NanaZ& nanaZ, const PLUGIN_INITIALIZE_MOU
 
 
 ArchiveSourceMount::~ArchiveSourceMount() {
+#ifdef _DEBUG
+  if (blockCacheN) {
+    const auto statistics = blockCacheN.value().GetStatistics();
+    const std::wstring debugStr = L"ArchiveSourceMount::~ArchiveSourceMount [block cache] hits: "s + std::to_wstring(statistics.hits) + L", misses: "s + std::to_wstring(statistics.misses) + L", readaheads: "s + std::to_wstring(statistics.readaheads) + L", coalesced: "s + std::to_wstring(statistics.coalesced) + L", entries: "s + std::to_wstring(statistics.entries) + L", bytes: "s + std::to_wstring(statistics.bytes) + L"\n"s;
+    OutputDebugStringW(debugStr.c_str());
+  }
+  {
+    const auto statistics = memoryBudget.GetStatistics();
+    const std::wstring debugStr = L"ArchiveSourceMount::~ArchiveSourceMount [memory budget] capacity: "s + std::to_wstring(statistics.capacity) + L", entries: "s + std::to_wstring(statistics.entries) + L", bytes: "s + std::to_wstring(statistics.bytes) + L", spilled bytes: "s + std::to_wstring(statistics.spilledBytes) + L", evictions: "s + std::to_wstring(statistics.evictions) + L", reloads: "s + std::to_wstring(statistics.reloads) + L"\n"s;
+    OutputDebugStringW(debugStr.c_str());
+  }
+#endif
+  // cancel prefetching before closing the archive
+  prefetcherN = std::nullopt;
+  archiveInstancePoolN = std::nullopt;
   archiveN = std::nullopt;
+  // save records of nested archives opened during the mount
+  SaveArchiveIndex();
+  archiveIndexN = std::nullopt;
+  blockCacheN = std::nullopt;
   if (util::IsValidHandle(archiveFileHandle)) {
     CloseHandle(archiveFileHandle);
     archiveFileHandle = NULL;
@@ -236,6 +395,20 @@ ArchiveSourceMount::~ArchiveSourceMount() {
 }
 
 
+// saves the index if anything has been read from the archive; the index cache is optional, so errors are ignored
+void ArchiveSourceMount::SaveArchiveIndex() {
+  if (!archiveIndexN || !archiveIndexN.value().IsModified()) {
+    return;
+  }
+  try {
+    if (!CreateDirectoryW(archiveIndexDirectory.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+      throw Win32Error();
+    }
+    archiveIndexN.value().Save(archiveIndexFilepath, archiveIndexKeyN.value());
+  } catch (...) {}
+}
+
+
 std::wstring ArchiveSourceMount::GetRealPath(LPCWSTR filepath) const {
   assert(filepath && filepath[0] == L'\\');
   if (util::vfs::IsRootDirectory(filepath)) {
@@ -260,14 +433,14 @@ NTSTATUS ArchiveSourceMount::ReturnPathOrNameNotFoundError(LPCWSTR filepath) con
 }
 
 
-const DirectoryTree* ArchiveSourceMount::GetDirectoryTreeR(std::wstring_view realPath) const {
+const DirectoryTree* ArchiveSourceMount::GetDirectoryTreeR(std::wstring_view realPath, Archive::Pin& pin) const {
   auto& archive = this->archiveN.value();
-  return archive.Get(realPath);
+  return archive.Get(realPath, pin);
 }
 
 
-const DirectoryTree* ArchiveSourceMount::GetDirectoryTree(LPCWSTR filepath) const {
-  return GetDirectoryTreeR(GetRealPath(filepath));
+const DirectoryTree* ArchiveSourceMount::GetDirectoryTree(LPCWSTR filepath, Archive::Pin& pin) const {
+  return GetDirectoryTreeR(GetRealPath(filepath), pin);
 }
 
 
@@ -276,6 +449,60 @@ DWORD ArchiveSourceMount::GetVolumeSerialNumber() const {
 }
 
 
+BlockCache& ArchiveSourceMount::GetBlockCache() {
+  return blockCacheN.value();
+}
+
+
+BlockCacheStatistics ArchiveSourceMount::GetBlockCacheStatistics() const {
+  return blockCacheN.value().GetStatistics();
+}
+
+
+ArchiveInstancePool& ArchiveSourceMount::GetArchiveInstancePool() {
+  return archiveInstancePoolN.value();
+}
+
+
+void ArchiveSourceMount::Prefetch(std::wstring_view realPath, const DirectoryTree& directoryTree) {
+  if (!prefetcherN || !directoryTree.extractedContent) {
+    return;
+  }
+
+  // prefetching is only a hint, so errors are ignored
+  try {
+    auto& prefetcher = prefetcherN.value();
+
+    // collect files which follow this in name order in the same directory
+    std::vector<std::pair<std::wstring_view, std::shared_ptr<ExtractedContent>>> siblings;
+    Archive::Pin parentPin;
+    const auto ptrParentDirectoryTree = GetDirectoryTreeR(util::ifs::GetParentPath(realPath), parentPin);
+    if (ptrParentDirectoryTree) {
+      const auto baseName = util::ifs::GetBaseName(realPath);
+      for (const auto& [childName, childDirectoryTree] : ptrParentDirectoryTree->children) {
+        if (!childDirectoryTree.extractedContent || std::wstring_view(childName) <= baseName) {
+          continue;
+        }
+        siblings.emplace_back(childName, childDirectoryTree.extractedContent);
+      }
+      const auto count = std::min(siblings.size(), prefetcher.GetMaxDepth());
+      std::partial_sort(siblings.begin(), siblings.begin() + count, siblings.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+      });
+      siblings.resize(count);
+    }
+
+    std::vector<std::shared_ptr<ExtractedContent>> siblingContents;
+    siblingContents.reserve(siblings.size());
+    for (auto& [name, content] : siblings) {
+      siblingContents.emplace_back(std::move(content));
+    }
+
+    prefetcher.OnAccess(directoryTree.extractedContent, siblingContents);
+  } catch (...) {}
+}
+
+
 BOOL ArchiveSourceMount::GetSourceInfo(SOURCE_INFO* sourceInfo) {
   if (sourceInfo) {
     *sourceInfo = {
@@ -292,7 +519,8 @@ NTSTATUS ArchiveSourceMount::GetFileInfo(LPCWSTR FileName, WIN32_FILE_ATTRIBUTE_
   }
   auto& archive = this->archiveN.value();
   const auto realPath = GetRealPath(FileName);
-  const auto ptrDirectoryTree = archive.Get(realPath);
+  Archive::Pin pin;
+  const auto ptrDirectoryTree = archive.Get(realPath, pin);
   if (!ptrDirectoryTree) {
     return ReturnPathOrNameNotFoundErrorR(realPath);
   }
@@ -309,7 +537,8 @@ NTSTATUS ArchiveSourceMount::GetFileInfo(LPCWSTR FileName, WIN32_FILE_ATTRIBUTE_
 NTSTATUS ArchiveSourceMount::GetDirectoryInfo(LPCWSTR FileName) {
   auto& archive = this->archiveN.value();
   const auto realPath = GetRealPath(FileName);
-  const auto ptrDirectoryTree = archive.Get(realPath);
+  Archive::Pin pin;
+  const auto ptrDirectoryTree = archive.Get(realPath, pin);
   if (!ptrDirectoryTree) {
     return ReturnPathOrNameNotFoundErrorR(realPath);
   }
@@ -323,7 +552,8 @@ NTSTATUS ArchiveSourceMount::GetDirectoryInfo(LPCWSTR FileName) {
 NTSTATUS ArchiveSourceMount::ListFiles(LPCWSTR FileName, PListFilesCallback Callback, CALLBACK_CONTEXT CallbackContext) {
   auto& archive = this->archiveN.value();
   const auto realPath = GetRealPath(FileName);
-  const auto ptrDirectoryTree = archive.Get(realPath);
+  Archive::Pin pin;
+  const auto ptrDirectoryTree = archive.Get(realPath, pin);
   if (!ptrDirectoryTree) {
     return ReturnPathOrNameNotFoundErrorR(realPath);
   }
@@ -331,20 +561,37 @@ NTSTATUS ArchiveSourceMount::ListFiles(LPCWSTR FileName, PListFilesCallback Call
     return STATUS_NOT_A_DIRECTORY;
   }
   for (auto& [key, childDirectoryTree] : ptrDirectoryTree->children) {
-    WIN32_FIND_DATAW win32FindDataW{
-      DirectoryTree::FilterArchiveFileAttributes(childDirectoryTree),
-      childDirectoryTree.creationTime,
-      childDirectoryTree.lastAccessTime,
-      childDirectoryTree.lastWriteTime,
-      (childDirectoryTree.fileSize >> 32) & 0xFFFFFFFF,
-      childDirectoryTree.fileSize & 0xFFFFFFFF,
-      0,
-      0,
-    };
-    std::size_t copyLength = std::min<std::size_t>(key.size(), MAX_PATH - 1);
-    std::memcpy(win32FindDataW.cFileName, key.c_str(), copyLength * sizeof(wchar_t));
-    win32FindDataW.cFileName[copyLength] = L'\0';
-    Callback(&win32FindDataW, CallbackContext);
+    CallListFilesCallback(key, childDirectoryTree, Callback, CallbackContext);
+  }
+  return STATUS_SUCCESS;
+}
+
+
+NTSTATUS ArchiveSourceMount::ListFilesWithPattern(LPCWSTR FileName, LPCWSTR SearchPattern, PListFilesCallback Callback, CALLBACK_CONTEXT CallbackContext) {
+  if (!SearchPattern || Wildcard::IsMatchAllPattern(SearchPattern)) {
+    return ListFiles(FileName, Callback, CallbackContext);
+  }
+  auto& archive = this->archiveN.value();
+  const auto realPath = GetRealPath(FileName);
+  Archive::Pin pin;
+  const auto ptrDirectoryTree = archive.Get(realPath, pin);
+  if (!ptrDirectoryTree) {
+    return ReturnPathOrNameNotFoundErrorR(realPath);
+  }
+  if (ptrDirectoryTree->type == DirectoryTree::Type::File) {
+    return STATUS_NOT_A_DIRECTORY;
+  }
+  // ワイルドカードを含まなければ子を直接引く
+  if (!Wildcard::HasWildcard(SearchPattern)) {
+    if (const auto itr = ptrDirectoryTree->children.find(SearchPattern); itr != ptrDirectoryTree->children.end()) {
+      CallListFilesCallback(itr->first, itr->second, Callback, CallbackContext);
+    }
+    return STATUS_SUCCESS;
+  }
+  for (auto& [key, childDirectoryTree] : ptrDirectoryTree->children) {
+    if (Wildcard::Match(SearchPattern, key, caseSensitive)) {
+      CallListFilesCallback(key, childDirectoryTree, Callback, CallbackContext);
+    }
   }
   return STATUS_SUCCESS;
 }
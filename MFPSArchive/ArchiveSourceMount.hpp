@@ -8,13 +8,19 @@
 
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
 #include <unordered_map>
 
 #include <Windows.h>
 
+#include "BlockCache.hpp"
 #include "NanaZ/Archive.hpp"
+#include "NanaZ/ArchiveIndex.hpp"
+#include "NanaZ/ArchiveInstancePool.hpp"
+#include "NanaZ/MemoryBudget.hpp"
 #include "NanaZ/NanaZ.hpp"
+#include "Prefetcher.hpp"
 
 
 class ArchiveSourceMountFile;
@@ -22,7 +28,9 @@ class ArchiveSourceMountFile;
 
 class ArchiveSourceMount : public ReadonlySourceMountBase {
   class ExportPortation {
-    static constexpr std::size_t BufferSize = 4096;
+    // each Export doubles the chunk size, from MinChunkSize up to MaxChunkSize
+    static constexpr std::size_t MinChunkSize = 64 * 1024;
+    static constexpr std::size_t MaxChunkSize = 4 * 1024 * 1024;
 
   protected:
     ArchiveSourceMount& sourceMount;
@@ -31,11 +39,14 @@ class ArchiveSourceMount : public ReadonlySourceMountBase {
     const bool empty;
     const std::shared_ptr<ArchiveSourceMountFile> sourceMountFile;
     const std::wstring realPath;
+    Archive::Pin pin;
     const DirectoryTree* const ptrDirectoryTree;
 
     UInt32 lastNumberOfBytesWritten;
     bool directory;
     std::unique_ptr<char[]> buffer;
+    std::size_t bufferSize;
+    std::size_t chunkSize;
 
   public:
     ExportPortation(ArchiveSourceMount& sourceMount, PORTATION_INFO* portationInfo);
@@ -46,6 +57,8 @@ class ArchiveSourceMount : public ReadonlySourceMountBase {
 
 
   NanaZ& nanaZ;
+  MemoryBudget& memoryBudget;
+  std::optional<MemoryBudget::CapacityRequest> memoryBudgetRequestN;
   std::mutex subMutex;
   std::unordered_map<ExportPortation*, std::unique_ptr<ExportPortation>> portationMap;
   std::wstring absolutePath;
@@ -64,23 +77,39 @@ class ArchiveSourceMount : public ReadonlySourceMountBase {
   DWORD maximumComponentLength;
   DWORD fileSystemFlags;
   std::wstring fileSystemName;
+  std::optional<BlockCache> blockCacheN;
+  std::wstring archiveIndexDirectory;
+  std::wstring archiveIndexFilepath;
+  std::optional<ArchiveIndexKey> archiveIndexKeyN;
+  std::optional<ArchiveIndex> archiveIndexN;
   std::optional<Archive> archiveN;
+  std::optional<ArchiveInstancePool> archiveInstancePoolN;
+  std::optional<Prefetcher> prefetcherN;
+
+  void SaveArchiveIndex();
 
 public:
-  ArchiveSourceMount(NanaZ& nanaZ, const PLUGIN_INITIALIZE_MOUNT_INFO* InitializeMountInfo, SOURCE_CONTEXT_ID sourceContextId);
+  ArchiveSourceMount(NanaZ& nanaZ, MemoryBudget& memoryBudget, const PLUGIN_INITIALIZE_MOUNT_INFO* InitializeMountInfo, SOURCE_CONTEXT_ID sourceContextId);
   ~ArchiveSourceMount();
 
   std::wstring GetRealPath(LPCWSTR filepath) const;
   NTSTATUS ReturnPathOrNameNotFoundErrorR(std::wstring_view realPath) const;
   NTSTATUS ReturnPathOrNameNotFoundError(LPCWSTR filepath) const;
-  const DirectoryTree* GetDirectoryTreeR(std::wstring_view realPath) const;
-  const DirectoryTree* GetDirectoryTree(LPCWSTR filepath) const;
+  // the returned DirectoryTree is valid as long as pin is held
+  const DirectoryTree* GetDirectoryTreeR(std::wstring_view realPath, Archive::Pin& pin) const;
+  const DirectoryTree* GetDirectoryTree(LPCWSTR filepath, Archive::Pin& pin) const;
   DWORD GetVolumeSerialNumber() const;
+  BlockCache& GetBlockCache();
+  BlockCacheStatistics GetBlockCacheStatistics() const;
+  ArchiveInstancePool& GetArchiveInstancePool();
+  // predicts files likely to be read after the file at realPath and extracts them in background
+  void Prefetch(std::wstring_view realPath, const DirectoryTree& directoryTree);
 
   BOOL GetSourceInfo(SOURCE_INFO* sourceInfo) override;
   NTSTATUS GetFileInfo(LPCWSTR FileName, WIN32_FILE_ATTRIBUTE_DATA* Win32FileAttributeData) override;
   NTSTATUS GetDirectoryInfo(LPCWSTR FileName) override;
   NTSTATUS ListFiles(LPCWSTR FileName, PListFilesCallback Callback, CALLBACK_CONTEXT CallbackContext) override;
+  NTSTATUS ListFilesWithPattern(LPCWSTR FileName, LPCWSTR SearchPattern, PListFilesCallback Callback, CALLBACK_CONTEXT CallbackContext) override;
   NTSTATUS ListStreams(LPCWSTR FileName, PListStreamsCallback Callback, CALLBACK_CONTEXT CallbackContext) override;
   NTSTATUS DGetDiskFreeSpace(PULONGLONG FreeBytesAvailable, PULONGLONG TotalNumberOfBytes, PULONGLONG TotalNumberOfFreeBytes, PDOKAN_FILE_INFO DokanFileInfo) override;
   NTSTATUS DGetVolumeInformation(LPWSTR VolumeNameBuffer, DWORD VolumeNameSize, LPDWORD VolumeSerialNumber, LPDWORD MaximumComponentLength, LPDWORD FileSystemFlags, LPWSTR FileSystemNameBuffer, DWORD FileSystemNameSize, PDOKAN_FILE_INFO DokanFileInfo) override;
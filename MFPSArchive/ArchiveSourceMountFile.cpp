@@ -8,12 +8,14 @@
 #include <limits>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
 
 #include <Windows.h>
 
 #include "ArchiveSourceMountFile.hpp"
 #include "ArchiveSourceMount.hpp"
+#include "BlockCache.hpp"
 #include "Util.hpp"
 #include "NanaZ/COMError.hpp"
 
@@ -25,21 +27,103 @@ ArchiveSourceMountFile::ArchiveSourceMountFile(ArchiveSourceMount& sourceMount,
   ReadonlySourceMountFileBase(sourceMount, FileName, SecurityContext, DesiredAccess, FileAttributes, ShareAccess, CreateDisposition, CreateOptions, DokanFileInfo, MaybeSwitched, FileContextId),
   sourceMount(sourceMount),
   realPath(sourceMount.GetRealPath(FileName)),
-  ptrDirectoryTree(sourceMount.GetDirectoryTreeR(realPath))
+  pin(),
+  ptrDirectoryTree(sourceMount.GetDirectoryTreeR(realPath, pin)),
+  nextSequentialOffset(0),
+  inStreamReadAt()
 {
   if (!ptrDirectoryTree) {
     throw NtstatusError(sourceMount.ReturnPathOrNameNotFoundErrorR(realPath));
   }
 
+  if (ptrDirectoryTree->inStream) {
+    inStreamReadAt = ptrDirectoryTree->inStream.try_as<IInStreamReadAt>();
+  }
+
   fileAttributes = DirectoryTree::FilterArchiveFileAttributes(*ptrDirectoryTree);
   volumeSerialNumber = sourceMount.GetVolumeSerialNumber();
+
+  sourceMount.Prefetch(realPath, *ptrDirectoryTree);
+}
+
+
+// calls func with an IInStream of the file which is not used by others during the call
+// files of the root archive are read via an instance from the pool so that reads of different files do not block each other,
+// others (and files whose instance is not available) are read from the shared stream under streamMutex
+// usePool is false while the shared stream is learning whether it can read positionally (see InSeekFilterStream)
+template<typename F>
+decltype(auto) ArchiveSourceMountFile::AccessStream(F&& func, bool usePool) {
+  if (usePool && ptrDirectoryTree->rootItemIndexN) {
+    const UInt32 index = ptrDirectoryTree->rootItemIndexN.value();
+    if (auto lease = sourceMount.GetArchiveInstancePool().Acquire(index)) {
+      if (const auto ptrInStream = lease.GetItemStream(index)) {
+        return func(*ptrInStream);
+      }
+    }
+  }
+  std::lock_guard lock(*ptrDirectoryTree->streamMutex);
+  return func(*ptrDirectoryTree->inStream.get());
+}
+
+
+UInt32 ArchiveSourceMountFile::ReadFromStream(IInStream& inStream, std::byte* buffer, UInt32 size, UInt64 offset) {
+  UInt64 newPosition = -1;
+  COMError::CheckHRESULT(inStream.Seek(offset, STREAM_SEEK_SET, &newPosition));
+  if (newPosition != offset) {
+    throw NtstatusError(NtstatusFromWin32(ERROR_SEEK));
+  }
+  UInt32 totalReadSize = 0;
+  UInt32 readSize;
+  do {
+    readSize = 0;
+    COMError::CheckHRESULT(inStream.Read(buffer + totalReadSize, size - totalReadSize, &readSize));
+    totalReadSize += readSize;
+  } while (readSize && totalReadSize < size);
+  return totalReadSize;
+}
+
+
+// reads with IInStreamReadAt without locking; contents in memory and stored contents can be read so
+// returns std::nullopt if the stream cannot read positionally, and sets pending if it may become able to after being read via AccessStream
+std::optional<UInt32> ArchiveSourceMountFile::ReadFromStreamAt(std::byte* buffer, UInt32 size, UInt64 offset, bool& pending) {
+  pending = false;
+  if (!inStreamReadAt) {
+    return std::nullopt;
+  }
+  UInt32 totalReadSize = 0;
+  UInt32 readSize;
+  do {
+    readSize = 0;
+    const auto hResult = inStreamReadAt->ReadAt(offset + totalReadSize, buffer + totalReadSize, size - totalReadSize, &readSize);
+    if (hResult == E_NOTIMPL || hResult == E_PENDING) {
+      pending = hResult == E_PENDING;
+      return std::nullopt;
+    }
+    COMError::CheckHRESULT(hResult);
+    totalReadSize += readSize;
+  } while (readSize && totalReadSize < size);
+  return totalReadSize;
+}
+
+
+// see BlockCache::ReadBlocks
+// the blocks skipped by a forward seek are stored too unless the stream may still turn out to be a stored one (usePool is false)
+BlockCache::BlockPtr ArchiveSourceMountFile::ReadBlocks(BlockCache& blockCache, UInt64 firstBlockIndex, UInt64 lastBlockIndex, UInt64 lastReadaheadBlockIndex, bool usePool) {
+  return AccessStream([&](IInStream& inStream) {
+    UInt64 position = firstBlockIndex * BlockCache::BlockSize;
+    if (usePool) {
+      COMError::CheckHRESULT(inStream.Seek(0, STREAM_SEEK_CUR, &position));
+    }
+    return blockCache.ReadBlocks(ptrDirectoryTree->fileIndex, ptrDirectoryTree->fileSize, position, firstBlockIndex, lastBlockIndex, lastReadaheadBlockIndex, [&](UInt64 offset, std::byte* buffer, std::size_t size) -> std::size_t {
+      return ReadFromStream(inStream, buffer, static_cast<UInt32>(size), offset);
+    });
+  }, usePool);
 }
 
 
 NTSTATUS ArchiveSourceMountFile::DReadFile(LPVOID Buffer, DWORD BufferLength, LPDWORD ReadLength, LONGLONG Offset, PDOKAN_FILE_INFO DokanFileInfo) {
   static_assert(sizeof(UInt32) == sizeof(DWORD));
 
-  std::lock_guard lock(*ptrDirectoryTree->streamMutex);
   /*
   std::wstring debugStr = L"ReadFile  "s + realPath + L"  Offset: "s + std::to_wstring(Offset) + L", BufferLength: "s + std::to_wstring(BufferLength) + L", Sum: "s + std::to_wstring(Offset + BufferLength) + L"\n"s;
   OutputDebugStringW(debugStr.c_str());
@@ -53,19 +137,48 @@ NTSTATUS ArchiveSourceMountFile::DReadFile(LPVOID Buffer, DWORD BufferLength, LP
     }
     return STATUS_SUCCESS;
   }
-  UInt64 newPosition = -1;
-  COMError::CheckHRESULT(ptrDirectoryTree->inStream->Seek(Offset, STREAM_SEEK_SET, &newPosition));
-  if (newPosition != Offset) {
-    return NtstatusFromWin32(ERROR_SEEK);
-  }
   const UInt32 sizeToRead = static_cast<UInt32>(std::min<ULONGLONG>(BufferLength, ptrDirectoryTree->fileSize - Offset));
   UInt32 totalReadSize = 0;
-  UInt32 readSize;
-  do {
-    readSize = 0;
-    COMError::CheckHRESULT(ptrDirectoryTree->inStream->Read(static_cast<std::byte*>(Buffer) + totalReadSize, sizeToRead - totalReadSize, &readSize));
-    totalReadSize += readSize;
-  } while (readSize && totalReadSize < sizeToRead);
+  auto& blockCache = sourceMount.GetBlockCache();
+  bool positionalReadPending = false;
+  if (const auto readSizeN = ReadFromStreamAt(static_cast<std::byte*>(Buffer), sizeToRead, Offset, positionalReadPending)) {
+    // contents in memory and stored contents need neither locking nor caching
+    totalReadSize = readSizeN.value();
+  } else if (ptrDirectoryTree->onMemory || !blockCache.IsEnabled() || sizeToRead == 0) {
+    // no need to cache contents extracted to memory
+    totalReadSize = AccessStream([&](IInStream& inStream) {
+      return ReadFromStream(inStream, static_cast<std::byte*>(Buffer), sizeToRead, Offset);
+    }, !positionalReadPending);
+  } else {
+    // seeking backward in a compressed stream makes 7-Zip decompress again from the start of the (solid) block,
+    // so serve reads from the decompressed blocks cached in blockCache and read ahead on sequential access
+    const bool sequential = nextSequentialOffset.exchange(Offset + sizeToRead) == static_cast<UInt64>(Offset);
+    const UInt64 lastBlockIndex = (Offset + sizeToRead - 1) / BlockCache::BlockSize;
+    const UInt64 lastFileBlockIndex = (ptrDirectoryTree->fileSize - 1) / BlockCache::BlockSize;
+    const UInt64 lastReadaheadBlockIndex = sequential ? std::min<UInt64>(lastBlockIndex + blockCache.GetReadaheadBlocks(), lastFileBlockIndex) : lastBlockIndex;
+    while (totalReadSize < sizeToRead) {
+      const UInt64 position = Offset + totalReadSize;
+      const UInt64 blockIndex = position / BlockCache::BlockSize;
+      // concurrent misses on the same block wait for the first one instead of decoding the block again
+      auto block = blockCache.GetOrBeginLoad(ptrDirectoryTree->fileIndex, blockIndex);
+      if (!block) {
+        try {
+          block = ReadBlocks(blockCache, blockIndex, lastBlockIndex, lastReadaheadBlockIndex, !positionalReadPending);
+        } catch (...) {
+          blockCache.EndLoad(ptrDirectoryTree->fileIndex, blockIndex);
+          throw;
+        }
+        blockCache.EndLoad(ptrDirectoryTree->fileIndex, blockIndex);
+      }
+      const std::size_t blockOffset = static_cast<std::size_t>(position - blockIndex * BlockCache::BlockSize);
+      if (!block || blockOffset >= block->size()) {
+        break;
+      }
+      const UInt32 copySize = static_cast<UInt32>(std::min<std::size_t>(block->size() - blockOffset, sizeToRead - totalReadSize));
+      std::memcpy(static_cast<std::byte*>(Buffer) + totalReadSize, block->data() + blockOffset, copySize);
+      totalReadSize += copySize;
+    }
+  }
   if (ReadLength) {
     *ReadLength = totalReadSize;
   }
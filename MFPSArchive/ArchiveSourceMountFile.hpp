@@ -4,11 +4,16 @@
 
 #include "../SDK/Plugin/SourceCppReadonly.hpp"
 
+#include <atomic>
+#include <cstddef>
+#include <optional>
 #include <string>
 
 #include <Windows.h>
 
+#include "BlockCache.hpp"
 #include "NanaZ/Archive.hpp"
+#include "NanaZ/InStreamReadAt.hpp"
 
 
 class ArchiveSourceMount;
@@ -17,9 +22,18 @@ class ArchiveSourceMount;
 class ArchiveSourceMountFile : public ReadonlySourceMountFileBase {
   ArchiveSourceMount& sourceMount;
   std::wstring realPath;
+  Archive::Pin pin;
   const DirectoryTree* ptrDirectoryTree;
   DWORD fileAttributes;
   DWORD volumeSerialNumber;
+  std::atomic<UInt64> nextSequentialOffset;
+  winrt::com_ptr<IInStreamReadAt> inStreamReadAt;
+
+  template<typename F>
+  decltype(auto) AccessStream(F&& func, bool usePool);
+  UInt32 ReadFromStream(IInStream& inStream, std::byte* buffer, UInt32 size, UInt64 offset);
+  std::optional<UInt32> ReadFromStreamAt(std::byte* buffer, UInt32 size, UInt64 offset, bool& pending);
+  BlockCache::BlockPtr ReadBlocks(BlockCache& blockCache, UInt64 firstBlockIndex, UInt64 lastBlockIndex, UInt64 lastReadaheadBlockIndex, bool usePool);
 
 public:
   ArchiveSourceMountFile(ArchiveSourceMount& sourceMount, LPCWSTR FileName, PDOKAN_IO_SECURITY_CONTEXT SecurityContext, ACCESS_MASK DesiredAccess, ULONG FileAttributes, ULONG ShareAccess, ULONG CreateDisposition, ULONG CreateOptions, PDOKAN_FILE_INFO DokanFileInfo, BOOL MaybeSwitched, FILE_CONTEXT_ID FileContextId);
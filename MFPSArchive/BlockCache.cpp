@@ -0,0 +1,201 @@
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "BlockCache.hpp"
+
+
+
+bool BlockCache::Key::operator==(const Key& other) const noexcept {
+  return fileIndex == other.fileIndex && blockIndex == other.blockIndex;
+}
+
+
+std::size_t BlockCache::KeyHash::operator()(const Key& key) const noexcept {
+  // blocks of a file are looked up in sequence, so mix the bits to spread them over buckets
+  std::uint64_t value = key.fileIndex * 0x9E3779B97F4A7C15ull ^ key.blockIndex;
+  value ^= value >> 33;
+  value *= 0xFF51AFD7ED558CCDull;
+  value ^= value >> 33;
+  return static_cast<std::size_t>(value);
+}
+
+
+
+BlockCache::BlockCache(std::size_t capacity, std::size_t readaheadBlocks) :
+  mutex(),
+  loadCondition(),
+  capacity(capacity),
+  readaheadBlocks(readaheadBlocks),
+  list(),
+  map(),
+  loading(),
+  bytes(0),
+  hits(0),
+  misses(0),
+  readaheads(0),
+  coalesced(0)
+{}
+
+
+void BlockCache::EraseEntry(List::iterator itr) {
+  bytes -= itr->block->size();
+  map.erase(itr->key);
+  list.erase(itr);
+}
+
+
+bool BlockCache::IsEnabled() const {
+  return capacity != 0;
+}
+
+
+std::size_t BlockCache::GetCapacity() const {
+  return capacity;
+}
+
+
+std::size_t BlockCache::GetReadaheadBlocks() const {
+  return readaheadBlocks;
+}
+
+
+BlockCache::BlockPtr BlockCache::Get(std::uint64_t fileIndex, std::uint64_t blockIndex) {
+  if (!IsEnabled()) {
+    return nullptr;
+  }
+
+  std::lock_guard lock(mutex);
+
+  const auto itrMap = map.find(Key{fileIndex, blockIndex});
+  if (itrMap == map.end()) {
+    misses++;
+    return nullptr;
+  }
+
+  list.splice(list.begin(), list, itrMap->second);
+  hits++;
+  return itrMap->second->block;
+}
+
+
+BlockCache::BlockPtr BlockCache::GetOrBeginLoad(std::uint64_t fileIndex, std::uint64_t blockIndex) {
+  if (!IsEnabled()) {
+    return nullptr;
+  }
+
+  const Key key{fileIndex, blockIndex};
+
+  std::unique_lock lock(mutex);
+
+  bool waited = false;
+  while (true) {
+    if (const auto itrMap = map.find(key); itrMap != map.end()) {
+      list.splice(list.begin(), list, itrMap->second);
+      hits++;
+      if (waited) {
+        coalesced++;
+      }
+      return itrMap->second->block;
+    }
+    if (!loading.contains(key)) {
+      break;
+    }
+    loadCondition.wait(lock);
+    waited = true;
+  }
+
+  // the block could not be read by the other thread (or was evicted at once); read it here
+  loading.insert(key);
+  misses++;
+  return nullptr;
+}
+
+
+void BlockCache::EndLoad(std::uint64_t fileIndex, std::uint64_t blockIndex) {
+  if (!IsEnabled()) {
+    return;
+  }
+
+  std::lock_guard lock(mutex);
+
+  if (loading.erase(Key{fileIndex, blockIndex})) {
+    loadCondition.notify_all();
+  }
+}
+
+
+BlockCache::BlockPtr BlockCache::Peek(std::uint64_t fileIndex, std::uint64_t blockIndex) const {
+  if (!IsEnabled()) {
+    return nullptr;
+  }
+
+  std::lock_guard lock(mutex);
+
+  const auto itrMap = map.find(Key{fileIndex, blockIndex});
+  return itrMap != map.end() ? itrMap->second->block : nullptr;
+}
+
+
+void BlockCache::Put(std::uint64_t fileIndex, std::uint64_t blockIndex, BlockPtr block, bool readahead) {
+  if (!IsEnabled()) {
+    return;
+  }
+
+  const Key key{fileIndex, blockIndex};
+
+  std::lock_guard lock(mutex);
+
+  if (loading.erase(key)) {
+    loadCondition.notify_all();
+  }
+
+  if (!block || block->size() > capacity) {
+    return;
+  }
+
+  if (const auto itrMap = map.find(key); itrMap != map.end()) {
+    EraseEntry(itrMap->second);
+  }
+
+  list.push_front(Entry{
+    key,
+    std::move(block),
+  });
+  map.emplace(key, list.begin());
+  bytes += list.front().block->size();
+  if (readahead) {
+    readaheads++;
+  }
+
+  while (bytes > capacity) {
+    EraseEntry(std::prev(list.end()));
+  }
+}
+
+
+void BlockCache::Clear() {
+  std::lock_guard lock(mutex);
+
+  map.clear();
+  list.clear();
+  bytes = 0;
+}
+
+
+BlockCache::Statistics BlockCache::GetStatistics() const {
+  std::lock_guard lock(mutex);
+
+  return Statistics{
+    list.size(),
+    bytes,
+    hits,
+    misses,
+    readaheads,
+    coalesced,
+  };
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+
+struct BlockCacheStatistics {
+  std::size_t entries;
+  std::size_t bytes;
+  std::uint64_t hits;
+  std::uint64_t misses;
+  std::uint64_t readaheads;
+  std::uint64_t coalesced;
+};
+
+
+// thread-safe LRU cache of decompressed file contents, split into fixed-size blocks
+// a block is identified by the fileIndex of its DirectoryTree and its position in the file (offset / BlockSize)
+// blocks are evicted from the least recently used one so that the total size does not exceed the capacity
+// blocks are handed out as shared_ptr, so an evicted block stays valid for readers which already got it
+// a block being read by a thread (see GetOrBeginLoad) is not read again by others; they wait for it instead
+class BlockCache {
+public:
+  static constexpr std::size_t BlockSize = 256 * 1024;
+
+  using Block = std::vector<std::byte>;
+  using BlockPtr = std::shared_ptr<const Block>;
+  using Statistics = BlockCacheStatistics;
+
+private:
+  struct Key {
+    std::uint64_t fileIndex;
+    std::uint64_t blockIndex;
+
+    bool operator==(const Key& other) const noexcept;
+  };
+
+  struct KeyHash {
+    std::size_t operator()(const Key& key) const noexcept;
+  };
+
+  struct Entry {
+    Key key;
+    BlockPtr block;
+  };
+
+  using List = std::list<Entry>;
+
+  mutable std::mutex mutex;
+  std::condition_variable loadCondition;
+  const std::size_t capacity;
+  const std::size_t readaheadBlocks;
+  List list;
+  std::unordered_map<Key, List::iterator, KeyHash> map;
+  std::unordered_set<Key, KeyHash> loading;
+  std::size_t bytes;
+  std::uint64_t hits;
+  std::uint64_t misses;
+  std::uint64_t readaheads;
+  std::uint64_t coalesced;
+
+  void EraseEntry(List::iterator itr);
+
+public:
+  // capacity is in bytes; 0 disables the cache
+  // readaheadBlocks is the number of blocks to be read in advance on sequential access
+  BlockCache(std::size_t capacity, std::size_t readaheadBlocks);
+
+  BlockCache(const BlockCache&) = delete;
+  BlockCache& operator=(const BlockCache&) = delete;
+
+  bool IsEnabled() const;
+  std::size_t GetCapacity() const;
+  std::size_t GetReadaheadBlocks() const;
+
+  // returns nullptr on miss
+  BlockPtr Get(std::uint64_t fileIndex, std::uint64_t blockIndex);
+  // same as Get, but on miss marks the block as being loaded by the caller, which must then call EndLoad (after Put, if it could read the block)
+  // if another thread has marked the block, waits until it is put or the mark is removed
+  BlockPtr GetOrBeginLoad(std::uint64_t fileIndex, std::uint64_t blockIndex);
+  void EndLoad(std::uint64_t fileIndex, std::uint64_t blockIndex);
+  // same as Get but does not touch the LRU order nor the statistics
+  BlockPtr Peek(std::uint64_t fileIndex, std::uint64_t blockIndex) const;
+  // readahead tells that the block was not requested by a reader, and is only used for statistics
+  // also removes the mark set by GetOrBeginLoad
+  void Put(std::uint64_t fileIndex, std::uint64_t blockIndex, BlockPtr block, bool readahead);
+  void Clear();
+
+  // reads blocks of a file from firstBlockIndex up to lastReadaheadBlockIndex in a row, stores them and returns the first one
+  // blocks after lastBlockIndex are readahead ones; reading them stops at the first block which is already cached
+  // position is the current position of the stream; a compressed stream decodes everything from there to reach firstBlockIndex,
+  // so the blocks in between (up to half the capacity) are stored too rather than decoded again on a later miss
+  // pass the offset of firstBlockIndex as position for streams which can skip ranges cheaply
+  // read(offset, buffer, size) reads the file at offset and returns the size read, which is less than size only at the end of the stream
+  template<typename F>
+  BlockPtr ReadBlocks(std::uint64_t fileIndex, std::uint64_t fileSize, std::uint64_t position, std::uint64_t firstBlockIndex, std::uint64_t lastBlockIndex, std::uint64_t lastReadaheadBlockIndex, F&& read);
+
+  Statistics GetStatistics() const;
+};
+
+
+
+template<typename F>
+BlockCache::BlockPtr BlockCache::ReadBlocks(std::uint64_t fileIndex, std::uint64_t fileSize, std::uint64_t position, std::uint64_t firstBlockIndex, std::uint64_t lastBlockIndex, std::uint64_t lastReadaheadBlockIndex, F&& read) {
+  // another thread may have read the block as a readahead one while the caller was waiting for the stream
+  if (auto block = Peek(fileIndex, firstBlockIndex)) {
+    return block;
+  }
+
+  std::uint64_t startBlockIndex = firstBlockIndex;
+  if (position < firstBlockIndex * BlockSize) {
+    const std::uint64_t maxGapBlocks = std::min<std::uint64_t>(capacity / BlockSize / 2, firstBlockIndex);
+    startBlockIndex = std::max<std::uint64_t>((position + BlockSize - 1) / BlockSize, firstBlockIndex - maxGapBlocks);
+  }
+
+  BlockPtr firstBlock;
+  for (std::uint64_t blockIndex = startBlockIndex; blockIndex <= lastReadaheadBlockIndex; blockIndex++) {
+    const bool gap = blockIndex < firstBlockIndex;
+    const bool readahead = blockIndex > lastBlockIndex;
+    if (gap || readahead) {
+      if (Peek(fileIndex, blockIndex)) {
+        if (readahead) {
+          break;
+        }
+        // the next read seeks over it
+        continue;
+      }
+    }
+
+    const std::uint64_t blockOffset = blockIndex * BlockSize;
+    if (blockOffset >= fileSize) {
+      break;
+    }
+
+    auto block = std::make_shared<Block>(static_cast<std::size_t>(std::min<std::uint64_t>(BlockSize, fileSize - blockOffset)));
+    const std::size_t readSize = read(blockOffset, block->data(), block->size());
+    block->resize(readSize);
+
+    Put(fileIndex, blockIndex, block, gap || readahead);
+    if (blockIndex == firstBlockIndex) {
+      firstBlock = block;
+    }
+
+    // reached the end of the stream
+    if (readSize < BlockSize) {
+      break;
+    }
+  }
+  return firstBlock;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// extensions exported by the archive source plugin in addition to the standard source plugin interface
+// these are exported by MFPSArchive.def (Source.def plus these, so that they are not decorated on x86); look them up with GetProcAddress and treat them as optional
+
+#include "../SDK/Plugin/Source.h"
+
+
+#pragma pack(push, 1)
+
+
+// usage of the memory budget shared by all archive mounts of the plugin
+// capacity is the largest "memoryBudget" option among the mounted archives (mounts without the option count as 512 MiB)
+typedef struct {
+  ULONGLONG capacity;       // in bytes
+  ULONGLONG entries;        // number of contents held in memory
+  ULONGLONG bytes;          // in bytes
+  ULONGLONG spilledBytes;   // size of contents extracted to temporary files, not included in bytes
+  ULONGLONG evictions;      // number of contents evicted from memory
+  ULONGLONG reloads;        // number of contents extracted again after being evicted
+} MFPSARCHIVE_MEMORY_USAGE;
+
+
+#ifdef __cplusplus
+static_assert(sizeof(MFPSARCHIVE_MEMORY_USAGE) == 6 * 8);
+#endif
+
+
+#pragma pack(pop)
+
+
+typedef BOOL(WINAPI *PMFPSArchiveGetMemoryUsage)(MFPSARCHIVE_MEMORY_USAGE* MemoryUsage) MFNOEXCEPT;
+
+
+// returns FALSE if the plugin is not initialized
+MFEXTERNC MFPEXPORT BOOL WINAPI MFPSArchiveGetMemoryUsage(MFPSARCHIVE_MEMORY_USAGE* MemoryUsage) MFNOEXCEPT;
@@ -8,13 +8,16 @@
 
 #include "../Util/RealFs.hpp"
 
+#include <cstddef>
 #include <memory>
 
 #include <Windows.h>
 #include <winrt/base.h>
 
+#include "MFPSArchive.h"
 #include "Util.hpp"
 #include "ArchiveSourceMount.hpp"
+#include "NanaZ/MemoryBudget.hpp"
 #include "NanaZ/NanaZ.hpp"
 #include "NanaZ/FileStream.hpp"
 
@@ -37,6 +40,10 @@ namespace {
   constexpr DWORD DMaximumComponentLength = MAX_PATH;
   constexpr DWORD DFileSystemFlags = FILE_CASE_PRESERVED_NAMES | FILE_CASE_SENSITIVE_SEARCH | FILE_UNICODE_ON_DISK;
 
+  // capacity of the memory budget shared by all mounts
+  // each mount requests its "memoryBudget" option (or this) and the largest request of the mounted archives is used
+  constexpr std::size_t DMemoryBudget = 512 * 1024 * 1024;
+
   const PLUGIN_INFO gPluginInfo = {
     MERGEFS_PLUGIN_INTERFACE_VERSION,
     PLUGIN_TYPE::Source,
@@ -52,6 +59,9 @@ namespace {
   std::wstring gDllPrefix;
 
   std::unique_ptr<NanaZ> gPtrNanaZ{};
+
+  // shared by all mounts
+  std::unique_ptr<MemoryBudget> gPtrMemoryBudget{};
 }
 
 
@@ -80,6 +90,7 @@ PLUGIN_INITCODE SInitializeImpl(const PLUGIN_INITIALIZE_INFO* InitializeInfo) no
   _SetPluginInitializeInfo(*InitializeInfo);
   try {
     gPtrNanaZ = std::make_unique<NanaZ>((gDllPrefix + std::wstring(SevenZDllFilepath)).c_str());
+    gPtrMemoryBudget = std::make_unique<MemoryBudget>(DMemoryBudget);
   } catch (...) {
     return PLUGIN_INITCODE::Other;
   }
@@ -106,5 +117,25 @@ BOOL SIsSupportedImpl(const PLUGIN_INITIALIZE_MOUNT_INFO* InitializeMountInfo) n
 
 
 std::unique_ptr<SourceMountBase> MountImpl(const PLUGIN_INITIALIZE_MOUNT_INFO* InitializeMountInfo, SOURCE_CONTEXT_ID sourceContextId) {
-  return std::make_unique<ArchiveSourceMount>(*gPtrNanaZ, InitializeMountInfo, sourceContextId);
+  return std::make_unique<ArchiveSourceMount>(*gPtrNanaZ, *gPtrMemoryBudget, InitializeMountInfo, sourceContextId);
+}
+
+
+
+BOOL WINAPI MFPSArchiveGetMemoryUsage(MFPSARCHIVE_MEMORY_USAGE* MemoryUsage) noexcept {
+  if (!MemoryUsage || !gPtrMemoryBudget) {
+    return FALSE;
+  }
+  try {
+    const auto statistics = gPtrMemoryBudget->GetStatistics();
+    MemoryUsage->capacity = statistics.capacity;
+    MemoryUsage->entries = statistics.entries;
+    MemoryUsage->bytes = statistics.bytes;
+    MemoryUsage->spilledBytes = statistics.spilledBytes;
+    MemoryUsage->evictions = statistics.evictions;
+    MemoryUsage->reloads = statistics.reloads;
+    return TRUE;
+  } catch (...) {
+    return FALSE;
+  }
 }
@@ -7,23 +7,31 @@
 #include <7z/CPP/7zip/IPassword.h>
 #include <7z/CPP/7zip/Archive/IArchive.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #include <winrt/base.h>
 
 #include "../SDK/CaseSensitivity.hpp"
 
 #include "Archive.hpp"
+#include "ArchiveIndex.hpp"
 #include "ArchiveOpenCallback.hpp"
 #include "COMError.hpp"
-#include "MemoryArchiveExtractCallback.hpp"
+#include "ExtractedContent.hpp"
+#include "MemoryBudget.hpp"
 #include "MemoryStream.hpp"
 #include "PropVariantUtil.hpp"
 #include "PropVariantWrapper.hpp"
@@ -33,13 +41,79 @@ using namespace std::literals;
 
 
 
+// state shared by an Archive and its nested archives
+struct ArchiveContext {
+  NanaZ& nanaZ;
+  MemoryBudget& memoryBudget;
+  const std::wstring defaultFilepath;
+  const UInt64 maxCheckStartPosition;
+  const DirectoryTree::OnExisting onExisting;
+  const DirectoryTree::ExtractToMemory extractToMemory;
+  const Archive::ArchiveNameCallback archiveNameCallback;
+  const Archive::PasswordWithFilepathCallback passwordCallback;
+  ArchiveIndex* const ptrArchiveIndex;
+  const std::size_t maxOpenNestedArchives;
+  const std::size_t maxNestedArchiveMemory;
+  const UInt64 spillThreshold;
+
+  // locked exclusively while closing nested archives, and shared while traversing the tree
+  std::shared_mutex treeMutex;
+  // locked while opening a nested archive; guards the members below
+  std::mutex loadMutex;
+  UInt64 fileIndexCount;
+  std::vector<NestedArchive*> openNestedArchives;
+  std::size_t openNestedArchiveMemory;
+
+  std::atomic<UInt64> accessCount;
+  std::atomic<bool> trimRequested;
+
+  ArchiveContext(NanaZ& nanaZ, MemoryBudget& memoryBudget, const std::wstring& defaultFilepath, UInt64 maxCheckStartPosition, DirectoryTree::OnExisting onExisting, DirectoryTree::ExtractToMemory extractToMemory, Archive::ArchiveNameCallback archiveNameCallback, Archive::PasswordWithFilepathCallback passwordCallback, ArchiveIndex* ptrArchiveIndex, std::size_t maxOpenNestedArchives, std::size_t maxNestedArchiveMemory, UInt64 spillThreshold);
+
+  bool ExceedsLimits() const;
+};
+
+
+// a nested archive, which is opened on first access and closed by Archive::Trim while it is not pinned
+class NestedArchive {
+public:
+  ArchiveContext& context;
+  DirectoryTree& directoryTree;
+  // nullptr if the archive is directly in the root archive
+  NestedArchive* const parent;
+  const std::wstring passwordFilepath;
+  const std::wstring passwordFilepathPrefix;
+  const std::wstring indexKey;
+
+  std::atomic<bool> opened;
+  std::atomic<std::size_t> pinCount;
+  std::atomic<UInt64> lastAccess;
+
+  // guarded by ArchiveContext::loadMutex
+  std::optional<UInt64> firstFileIndexN;
+  std::size_t openChildren;
+  std::size_t memorySize;
+
+  NestedArchive(ArchiveContext& context, DirectoryTree& directoryTree, NestedArchive* parent, const std::wstring& passwordFilepath, const std::wstring& passwordFilepathPrefix, const std::wstring& indexKey);
+
+  // may be called concurrently while ArchiveContext::treeMutex is locked (shared)
+  void Open();
+  // must be called while ArchiveContext::treeMutex is locked exclusively and ArchiveContext::loadMutex is locked
+  void Close();
+};
+
+
+
 namespace {
-  using PasswordCallback = MemoryArchiveExtractCallback::PasswordCallback;
+  using PasswordCallback = ExtractedContent::PasswordCallback;
 
 
   // TODO: make customizable
   constexpr UInt32 SevereErrorFlags = kpv_ErrorFlags_IsNotArc;
 
+  // CLSIDs of 7-Zip's archive handlers are {23170F69-40C1-278A-1000-000110xx0000}, where xx is the format id
+  constexpr CLSID ZipFormatClsid = {0x23170F69, 0x40C1, 0x278A, {0x10, 0x00, 0x00, 0x01, 0x10, 0x01, 0x00, 0x00}};
+  constexpr CLSID TarFormatClsid = {0x23170F69, 0x40C1, 0x278A, {0x10, 0x00, 0x00, 0x01, 0x10, 0xEE, 0x00, 0x00}};
+
 
 
   FILETIME GetCreationTime(const DirectoryTree& directoryTree, const FILETIME& fallbackCreationTime) {
@@ -124,7 +198,7 @@ namespace {
       directoryTree.children.emplace(rootDirectoryName, DirectoryTree{
         nullptr,
         directoryTree.caseSensitive,
-        {0, CaseSensitivity::CiHash(directoryTree.caseSensitive), CaseSensitivity::CiEqualTo(directoryTree.caseSensitive)},
+        decltype(DirectoryTree::children){0, CaseSensitivity::CiHash(directoryTree.caseSensitive), CaseSensitivity::CiEqualTo(directoryTree.caseSensitive)},
         false,
         true,
         directoryTree.onMemory,
@@ -141,6 +215,8 @@ namespace {
         fallbackCreationTime,
         fallbackLastAccessTime,
         fallbackLastWriteTime,
+        std::nullopt,
+        nullptr,
         nullptr,
       });
     }
@@ -150,7 +226,7 @@ namespace {
   }
 
 
-  winrt::com_ptr<IInArchive> CreateInArchiveFromInStream(NanaZ& nanaZ, winrt::com_ptr<IInStream> inStream, UInt64 maxCheckStartPosition, PasswordCallback passwordCallback) {
+  winrt::com_ptr<IInArchive> CreateInArchiveFromInStream(NanaZ& nanaZ, winrt::com_ptr<IInStream> inStream, UInt64 maxCheckStartPosition, PasswordCallback passwordCallback, CLSID* outFormatClsid = nullptr) {
     auto formatIndices = nanaZ.FindFormatByStream(inStream);
     for (const auto& formatIndex : formatIndices) {
       const CLSID formatClsid = nanaZ.GetFormat(formatIndex).clsid;
@@ -174,6 +250,9 @@ namespace {
         }
       }
 
+      if (outFormatClsid) {
+        *outFormatClsid = formatClsid;
+      }
       return inArchive;
     }
 
@@ -181,7 +260,116 @@ namespace {
   }
 
 
-  void InitializeDirectoryTree(DirectoryTree& directoryTree, const std::wstring& defaultFilepath, const std::wstring_view prefixFilter, const std::wstring& passwordFilepathPrefix, NanaZ& nanaZ, UInt64 maxCheckStartPosition, DirectoryTree::OnExisting onExisting, DirectoryTree::ExtractToMemory extractToMemory, Archive::ArchiveNameCallback archiveNameCallback, Archive::PasswordWithFilepathCallback passwordCallback, UInt64& fileIndexCount) {
+  // whether the handler reports that the item is stored as is in a single range of the archive stream, which InSeekFilterStream may then read positionally
+  // only tar items and zip items with the Store method qualify, and neither encrypted ones nor those whose packed size differs from the size (such as sparse tar files)
+  bool IsStoredContiguously(IInArchive& inArchive, UInt32 index, const CLSID& formatClsid, std::optional<UInt64> fileSizeN) {
+    const bool tar = IsEqualCLSID(formatClsid, TarFormatClsid);
+    const bool zip = IsEqualCLSID(formatClsid, ZipFormatClsid);
+    if ((!tar && !zip) || !fileSizeN) {
+      return false;
+    }
+
+    try {
+      {
+        PropVariantWrapper propVariant;
+        inArchive.GetProperty(index, kpidEncrypted, &propVariant);
+        if (FromPropVariantN<bool>(propVariant).value_or(false)) {
+          return false;
+        }
+      }
+
+      if (zip) {
+        // encrypted items have the method prefixed (e.g. "ZipCrypto Store")
+        PropVariantWrapper propVariant;
+        inArchive.GetProperty(index, kpidMethod, &propVariant);
+        if (FromPropVariantN<std::wstring>(propVariant) != L"Store"s) {
+          return false;
+        }
+      }
+
+      {
+        PropVariantWrapper propVariant;
+        inArchive.GetProperty(index, kpidPackSize, &propVariant);
+        if (FromPropVariantN<UInt64>(propVariant) != fileSizeN) {
+          return false;
+        }
+      }
+    } catch (std::invalid_argument&) {
+      return false;
+    }
+
+    return true;
+  }
+
+
+  ArchiveItemRecord ReadArchiveItemRecord(IInArchive& inArchive, UInt32 index, const CLSID& formatClsid) {
+    ArchiveItemRecord record{};
+
+    {
+      PropVariantWrapper propVariant;
+      inArchive.GetProperty(index, kpidCTime, &propVariant);
+      record.creationTimeN = FromPropVariantN<FILETIME>(propVariant);
+    }
+    {
+      PropVariantWrapper propVariant;
+      inArchive.GetProperty(index, kpidATime, &propVariant);
+      record.lastAccessTimeN = FromPropVariantN<FILETIME>(propVariant);
+    }
+    {
+      PropVariantWrapper propVariant;
+      inArchive.GetProperty(index, kpidMTime, &propVariant);
+      record.lastWriteTimeN = FromPropVariantN<FILETIME>(propVariant);
+    }
+
+    {
+      // this may be null on tar.xz file
+      PropVariantWrapper propVariant;
+      inArchive.GetProperty(index, kpidIsDir, &propVariant);
+      record.directory = FromPropVariantN<bool>(propVariant).value_or(false);
+    }
+
+    {
+      // kpidAttrib is Windows' file attribute flags
+      PropVariantWrapper propVariant;
+      inArchive.GetProperty(index, kpidAttrib, &propVariant);
+      record.fileAttributes = FromPropVariantN<UInt32>(propVariant).value_or(record.directory ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL);
+    }
+
+    if (!record.directory) {
+      PropVariantWrapper propVariant;
+      inArchive.GetProperty(index, kpidSize, &propVariant);
+      record.fileSizeN = FromPropVariantN<UInt64>(propVariant);
+    }
+
+    {
+      PropVariantWrapper propVariant;
+      inArchive.GetProperty(index, kpidPath, &propVariant);
+      record.filepathN = FromPropVariantN<std::wstring>(propVariant);
+    }
+
+    if (!record.directory) {
+      record.storedContiguously = IsStoredContiguously(inArchive, index, formatClsid, record.fileSizeN);
+    }
+
+    return record;
+  }
+
+
+  // formatClsid is the handler of directoryTree.inArchive
+  // records of items are taken from context.ptrArchiveIndex (if available) instead of querying properties of each item, and stored into it otherwise
+  // indexKey identifies the (nested) archive in context.ptrArchiveIndex
+  // nested archives in the archive are not opened here but inserted as placeholders (see NestedArchive); ptrNestedArchive is the one being opened (nullptr for the root archive)
+  // contents extracted to memory are charged to context.memoryBudget, not included in the returned size
+  // returns the estimated size of memory used for the items
+  std::size_t InitializeDirectoryTree(DirectoryTree& directoryTree, const CLSID& formatClsid, ArchiveContext& context, const std::wstring_view prefixFilter, const std::wstring& passwordFilepathPrefix, UInt64& fileIndexCount, bool rootArchive, const std::wstring& indexKey, NestedArchive* ptrNestedArchive) {
+    const auto& defaultFilepath = context.defaultFilepath;
+    const auto onExisting = context.onExisting;
+    const auto extractToMemory = context.extractToMemory;
+    const auto spillThreshold = context.spillThreshold;
+    const auto& archiveNameCallback = context.archiveNameCallback;
+    const auto& passwordCallback = context.passwordCallback;
+    const auto ptrArchiveIndex = context.ptrArchiveIndex;
+
     const auto& fallbackCreationTime = directoryTree.creationTime;
     const auto& fallbackLastAccessTime = directoryTree.lastAccessTime;
     const auto& fallbackLastWriteTime = directoryTree.lastWriteTime;
@@ -194,61 +382,52 @@ namespace {
     UInt32 numItems = 0;
     COMError::CheckHRESULT(directoryTree.inArchive->GetNumberOfItems(&numItems));
 
+    std::size_t memorySize = numItems * sizeof(DirectoryTree);
+
     std::vector<UInt32> extractToMemoryIndices;
     std::vector<std::tuple<UInt32, DirectoryTree&, std::wstring>> extractToMemoryObjects;
 
     std::vector<std::tuple<UInt32, DirectoryTree&, std::wstring>> openAsArchiveObjects;
 
+    const std::vector<ArchiveItemRecord>* ptrRecords = ptrArchiveIndex ? ptrArchiveIndex->Find(indexKey) : nullptr;
+    if (ptrRecords && ptrRecords->size() != numItems) {
+      ptrRecords = nullptr;
+    }
+    const bool storeRecords = ptrArchiveIndex && !ptrRecords;
+    std::vector<ArchiveItemRecord> newRecords;
+    if (storeRecords) {
+      newRecords.reserve(numItems);
+    }
+
     for (UInt32 index = 0; index < numItems; index++) {
+      const ArchiveItemRecord record = ptrRecords ? (*ptrRecords)[index] : ReadArchiveItemRecord(*directoryTree.inArchive.get(), index, formatClsid);
+      if (storeRecords) {
+        newRecords.emplace_back(record);
+      }
+
       try {
         DirectoryTree contentDirectoryTree{
           directoryTree.streamMutex,
           directoryTree.caseSensitive,
-          {0, CaseSensitivity::CiHash(directoryTree.caseSensitive), CaseSensitivity::CiEqualTo(directoryTree.caseSensitive)},
+          decltype(DirectoryTree::children){0, CaseSensitivity::CiHash(directoryTree.caseSensitive), CaseSensitivity::CiEqualTo(directoryTree.caseSensitive)},
           true,
         };
 
-        {
-          PropVariantWrapper propVariant;
-          directoryTree.inArchive->GetProperty(index, kpidCTime, &propVariant);
-          contentDirectoryTree.creationTimeN = FromPropVariantN<FILETIME>(propVariant);
-        }
-        {
-          PropVariantWrapper propVariant;
-          directoryTree.inArchive->GetProperty(index, kpidATime, &propVariant);
-          contentDirectoryTree.lastAccessTimeN = FromPropVariantN<FILETIME>(propVariant);
-        }
-        {
-          PropVariantWrapper propVariant;
-          directoryTree.inArchive->GetProperty(index, kpidMTime, &propVariant);
-          contentDirectoryTree.lastWriteTimeN = FromPropVariantN<FILETIME>(propVariant);
-        }
+        contentDirectoryTree.creationTimeN = record.creationTimeN;
+        contentDirectoryTree.lastAccessTimeN = record.lastAccessTimeN;
+        contentDirectoryTree.lastWriteTimeN = record.lastWriteTimeN;
 
-        bool directory = false;
-        {
-          // this may be null on tar.xz file
-          PropVariantWrapper propVariant;
-          directoryTree.inArchive->GetProperty(index, kpidIsDir, &propVariant);
-          directory = FromPropVariantN<bool>(propVariant).value_or(false);
-        }
+        const bool directory = record.directory;
 
-        {
-          // kpidAttrib is Windows' file attribute flags
-          PropVariantWrapper propVariant;
-          directoryTree.inArchive->GetProperty(index, kpidAttrib, &propVariant);
-          contentDirectoryTree.fileAttributes = FromPropVariantN<UInt32>(propVariant).value_or(directory ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL);
-        }
+        contentDirectoryTree.fileAttributes = record.fileAttributes;
 
         contentDirectoryTree.type = directory ? DirectoryTree::Type::Directory : DirectoryTree::Type::File;
 
         contentDirectoryTree.contentAvailable = true;
 
         if (contentDirectoryTree.type == DirectoryTree::Type::File) {
-          PropVariantWrapper propVariant;
-          directoryTree.inArchive->GetProperty(index, kpidSize, &propVariant);
-          const auto fileSizeN = FromPropVariantN<UInt64>(propVariant);
-          contentDirectoryTree.fileSize = fileSizeN.value_or(0);
-          contentDirectoryTree.contentAvailable = !!fileSizeN;
+          contentDirectoryTree.fileSize = record.fileSizeN.value_or(0);
+          contentDirectoryTree.contentAvailable = !!record.fileSizeN;
         } else {
           contentDirectoryTree.fileSize = 0;
         }
@@ -258,14 +437,7 @@ namespace {
 
         contentDirectoryTree.fileIndex = fileIndexCount++;
 
-        std::optional<std::wstring> contentFilepathN;
-        {
-          PropVariantWrapper propVariant;
-          directoryTree.inArchive->GetProperty(index, kpidPath, &propVariant);
-          contentFilepathN = FromPropVariantN<std::wstring>(propVariant);
-        }
-
-        const std::wstring contentFilepath = contentFilepathN.value_or(defaultFilepath);
+        const std::wstring contentFilepath = record.filepathN.value_or(defaultFilepath);
 
         if (!prefixFilter.empty()) {
           // TODO: prefixFilterが\で終わっていれば\前のもの（prefixFilterが表すディレクトリ自身）も含めるようにするべき？
@@ -298,7 +470,10 @@ namespace {
           } while (false);
 
           if (contentInStream) {
-            contentDirectoryTree.inStream = winrt::make_self<InSeekFilterStream>(contentInStream, directoryTree.inStream);
+            contentDirectoryTree.inStream = winrt::make_self<InSeekFilterStream>(contentInStream, directoryTree.inStream, record.storedContiguously);
+            if (rootArchive) {
+              contentDirectoryTree.rootItemIndexN = index;
+            }
           } else {
             if (extractToMemory == DirectoryTree::ExtractToMemory::Never) {
               throw COMError(E_FAIL);
@@ -343,9 +518,12 @@ namespace {
       } catch (...) {}
     }
 
-    // extract into memory and create IInStream from memory data
+    if (storeRecords) {
+      ptrArchiveIndex->Set(indexKey, std::move(newRecords));
+    }
+
+    // extract into memory (or temporary files) and create IInStream from the extracted contents
     if (!extractToMemoryIndices.empty()) {
-      winrt::com_ptr<MemoryArchiveExtractCallback> memoryArchiveExtractCallback;
       PasswordCallback contentPasswordCallback;
       if (passwordCallback) {
         // TODO: fix passwordFilepath
@@ -355,24 +533,33 @@ namespace {
         };
       }
 
-      std::vector<UInt64> filesizes(extractToMemoryIndices.size());
-      std::vector<std::pair<UInt32, UInt64>> indexAndFilesizes(extractToMemoryIndices.size());
+      const std::size_t memoryCapacity = context.memoryBudget.GetCapacity();
+
+      std::vector<std::shared_ptr<ExtractedContent>> extractedContents(extractToMemoryIndices.size());
       for (std::size_t i = 0; i < extractToMemoryIndices.size(); i++) {
         const auto& [index, contentDirectoryTree, contentFilepath] = extractToMemoryObjects.at(i);
-        filesizes.at(i) = contentDirectoryTree.fileSize;
-        indexAndFilesizes.at(i) = std::make_pair(static_cast<UInt32>(index), static_cast<UInt64>(contentDirectoryTree.fileSize));
         assert(contentDirectoryTree.contentAvailable);
+        const UInt64 fileSize = contentDirectoryTree.fileSize;
+        // large contents are spilled to temporary files instead of being evicted and extracted again
+        const bool spill = spillThreshold != 0 && (fileSize > spillThreshold || fileSize > memoryCapacity);
+        extractedContents.at(i) = std::make_shared<ExtractedContent>(context.memoryBudget, directoryTree.inArchive, directoryTree.streamMutex, index, fileSize, spill, contentPasswordCallback);
+      }
+
+      // for prefetching contents which follow in the archive
+      const auto archiveContents = std::make_shared<const std::vector<std::weak_ptr<ExtractedContent>>>(extractedContents.begin(), extractedContents.end());
+      for (std::size_t i = 0; i < extractedContents.size(); i++) {
+        extractedContents.at(i)->SetArchiveContents(archiveContents, i);
       }
 
-      const auto totalExtractionMemorySize = MemoryArchiveExtractCallback::CalcMemorySize(filesizes);
-      directoryTree.extractionMemory = std::make_unique<std::byte[]>(totalExtractionMemorySize);
+      auto extractCallback = winrt::make_self<ExtractedContentExtractCallback>(extractedContents, contentPasswordCallback);
 
-      memoryArchiveExtractCallback = std::move(winrt::make_self<MemoryArchiveExtractCallback>(directoryTree.extractionMemory.get(), totalExtractionMemorySize, indexAndFilesizes, contentPasswordCallback));
+      COMError::CheckHRESULT(directoryTree.inArchive->Extract(extractToMemoryIndices.data(), static_cast<UInt32>(extractToMemoryIndices.size()), FALSE, extractCallback.get()));
 
-      COMError::CheckHRESULT(directoryTree.inArchive->Extract(extractToMemoryIndices.data(), static_cast<UInt32>(extractToMemoryIndices.size()), FALSE, memoryArchiveExtractCallback.get()));
+      for (std::size_t i = 0; i < extractToMemoryIndices.size(); i++) {
+        const auto& [index, contentDirectoryTree, contentFilepath] = extractToMemoryObjects.at(i);
+        const auto& extractedContent = extractedContents.at(i);
 
-      for (const auto& [index, contentDirectoryTree, contentFilepath] : extractToMemoryObjects) {
-        if (!memoryArchiveExtractCallback->Succeeded(index)) {
+        if (!extractedContent->IsAvailable()) {
           contentDirectoryTree.contentAvailable = false;
           contentDirectoryTree.fileSize = 0;
           contentDirectoryTree.inStream = winrt::make_self<InMemoryStream>(nullptr, 0);
@@ -380,12 +567,13 @@ namespace {
           continue;
         }
 
-        const std::size_t fileSize = memoryArchiveExtractCallback->GetSize(index);
+        const UInt64 fileSize = extractedContent->GetSize();
         assert(fileSize == contentDirectoryTree.fileSize);
 
         contentDirectoryTree.fileSize = fileSize;
-        contentDirectoryTree.inStream = winrt::make_self<InMemoryStream>(memoryArchiveExtractCallback->GetData(index), fileSize);
+        contentDirectoryTree.inStream = winrt::make_self<InExtractedContentStream>(extractedContent);
         contentDirectoryTree.streamMutex = std::make_shared<std::mutex>();
+        contentDirectoryTree.extractedContent = extractedContent;
       }
     }
 
@@ -409,25 +597,18 @@ namespace {
       }
       const std::wstring& asArchiveFilepath = asArchiveFilepathOption.value().first;
 
-      // TODO: fix passwordFilepath
-      const std::wstring passwordFilepath = contentFilepath;
-      PasswordCallback contentPasswordCallback = [passwordCallback, passwordFilepath]() -> std::optional<std::wstring> {
-        return passwordCallback(passwordFilepath);
-      };
-
-
       auto originalContentInStream = contentDirectoryTree.inStream;
       auto cloneContentInStream = winrt::make_self<InSeekFilterStream>(originalContentInStream);
 
-      auto contentInArchive = CreateInArchiveFromInStream(nanaZ, cloneContentInStream, maxCheckStartPosition, contentPasswordCallback);
-      if (!contentInArchive) {
+      // only check signatures here; the archive is opened on first access
+      if (context.nanaZ.FindFormatByStream(cloneContentInStream).empty()) {
         continue;
       }
 
       DirectoryTree cloneContentDirectoryTree{
         contentDirectoryTree.streamMutex,
         contentDirectoryTree.caseSensitive,
-        {0, CaseSensitivity::CiHash(contentDirectoryTree.caseSensitive), CaseSensitivity::CiEqualTo(contentDirectoryTree.caseSensitive)},
+        decltype(DirectoryTree::children){0, CaseSensitivity::CiHash(contentDirectoryTree.caseSensitive), CaseSensitivity::CiEqualTo(contentDirectoryTree.caseSensitive)},
         true,
         contentDirectoryTree.contentAvailable,
         contentDirectoryTree.onMemory,
@@ -440,10 +621,12 @@ namespace {
         1,    // TODO: numberOfLinks
         fileIndexCount++,
         cloneContentInStream,
-        contentInArchive,
+        nullptr,
         contentDirectoryTree.creationTime,
         contentDirectoryTree.lastAccessTime,
         contentDirectoryTree.lastWriteTime,
+        std::nullopt,
+        nullptr,
         nullptr,
       };
 
@@ -454,10 +637,162 @@ namespace {
       auto ptrInsertedCloneContentDirectoryTree = Insert(directoryTree, asArchiveFilepath, std::move(cloneContentDirectoryTree), fileIndexCount, DirectoryTree::OnExisting::Replace, extractToMemory);
 
       if (ptrInsertedCloneContentDirectoryTree) {
-        InitializeDirectoryTree(*ptrInsertedCloneContentDirectoryTree, defaultFilepath, L""sv, passwordFilepathPrefix + L"\\"s + contentFilepath, nanaZ, maxCheckStartPosition, onExisting, extractToMemory, archiveNameCallback, passwordCallback, fileIndexCount);
+        // TODO: fix passwordFilepath
+        ptrInsertedCloneContentDirectoryTree->nestedArchive = std::make_shared<NestedArchive>(context, *ptrInsertedCloneContentDirectoryTree, ptrNestedArchive, contentFilepath, passwordFilepathPrefix + L"\\"s + contentFilepath, indexKey + L"\\"s + std::to_wstring(index));
+      }
+    }
+
+    return memorySize;
+  }
+
+
+  // same as DirectoryTree::Get, but opens nested archives on the path (including the target itself) and collects them into nestedArchives
+  // must be called while ArchiveContext::treeMutex is locked (shared)
+  const DirectoryTree* GetAndOpen(const DirectoryTree& directoryTree, std::wstring_view filepath, std::vector<std::shared_ptr<NestedArchive>>& nestedArchives) {
+    const DirectoryTree* ptrDirectoryTree = &directoryTree;
+    while (true) {
+      if (ptrDirectoryTree->nestedArchive) {
+        ptrDirectoryTree->nestedArchive->Open();
+        nestedArchives.emplace_back(ptrDirectoryTree->nestedArchive);
+      }
+      if (filepath.empty()) {
+        return ptrDirectoryTree;
+      }
+      if (ptrDirectoryTree->type == DirectoryTree::Type::File) {
+        return nullptr;
+      }
+      const auto firstDelimiterPos = filepath.find_first_of(DirectoryTree::DirectorySeparator);
+      auto itrChild = ptrDirectoryTree->children.find(std::wstring(filepath.substr(0, firstDelimiterPos)));
+      if (itrChild == ptrDirectoryTree->children.end()) {
+        return nullptr;
+      }
+      ptrDirectoryTree = &itrChild->second;
+      filepath = firstDelimiterPos == std::wstring_view::npos ? L""sv : filepath.substr(firstDelimiterPos + 1);
+    }
+  }
+}
+
+
+
+ArchiveContext::ArchiveContext(NanaZ& nanaZ, MemoryBudget& memoryBudget, const std::wstring& defaultFilepath, UInt64 maxCheckStartPosition, DirectoryTree::OnExisting onExisting, DirectoryTree::ExtractToMemory extractToMemory, Archive::ArchiveNameCallback archiveNameCallback, Archive::PasswordWithFilepathCallback passwordCallback, ArchiveIndex* ptrArchiveIndex, std::size_t maxOpenNestedArchives, std::size_t maxNestedArchiveMemory, UInt64 spillThreshold) :
+  nanaZ(nanaZ),
+  memoryBudget(memoryBudget),
+  defaultFilepath(defaultFilepath),
+  maxCheckStartPosition(maxCheckStartPosition),
+  onExisting(onExisting),
+  extractToMemory(extractToMemory),
+  archiveNameCallback(archiveNameCallback),
+  passwordCallback(passwordCallback),
+  ptrArchiveIndex(ptrArchiveIndex),
+  maxOpenNestedArchives(maxOpenNestedArchives),
+  maxNestedArchiveMemory(maxNestedArchiveMemory),
+  spillThreshold(spillThreshold),
+  treeMutex(),
+  loadMutex(),
+  fileIndexCount(0),
+  openNestedArchives(),
+  openNestedArchiveMemory(0),
+  accessCount(0),
+  trimRequested(false)
+{}
+
+
+bool ArchiveContext::ExceedsLimits() const {
+  return (maxOpenNestedArchives != 0 && openNestedArchives.size() > maxOpenNestedArchives) || (maxNestedArchiveMemory != 0 && openNestedArchiveMemory > maxNestedArchiveMemory);
+}
+
+
+
+NestedArchive::NestedArchive(ArchiveContext& context, DirectoryTree& directoryTree, NestedArchive* parent, const std::wstring& passwordFilepath, const std::wstring& passwordFilepathPrefix, const std::wstring& indexKey) :
+  context(context),
+  directoryTree(directoryTree),
+  parent(parent),
+  passwordFilepath(passwordFilepath),
+  passwordFilepathPrefix(passwordFilepathPrefix),
+  indexKey(indexKey),
+  opened(false),
+  pinCount(0),
+  lastAccess(0),
+  firstFileIndexN(),
+  openChildren(0),
+  memorySize(0)
+{}
+
+
+void NestedArchive::Open() {
+  lastAccess.store(++context.accessCount, std::memory_order_relaxed);
+
+  if (opened.load(std::memory_order_acquire)) {
+    return;
+  }
+
+  std::lock_guard loadLock(context.loadMutex);
+
+  if (opened.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  {
+    // the stream is shared with other files in the parent archive
+    std::lock_guard streamLock(*directoryTree.streamMutex);
+
+    try {
+      PasswordCallback contentPasswordCallback;
+      if (context.passwordCallback) {
+        contentPasswordCallback = [passwordCallback = context.passwordCallback, passwordFilepath = passwordFilepath]() -> std::optional<std::wstring> {
+          return passwordCallback(passwordFilepath);
+        };
+      }
+
+      CLSID formatClsid{};
+      directoryTree.inArchive = CreateInArchiveFromInStream(context.nanaZ, directoryTree.inStream, context.maxCheckStartPosition, contentPasswordCallback, &formatClsid);
+      if (directoryTree.inArchive) {
+        // reuse the file indices assigned on the first opening so that they (and blocks cached with them) remain the same
+        if (!firstFileIndexN) {
+          firstFileIndexN = context.fileIndexCount;
+        }
+        UInt64 fileIndexCount = firstFileIndexN.value();
+        memorySize = InitializeDirectoryTree(directoryTree, formatClsid, context, L""sv, passwordFilepathPrefix, fileIndexCount, false, indexKey, this);
+        context.fileIndexCount = std::max(context.fileIndexCount, fileIndexCount);
       }
+    } catch (...) {
+      // leave the archive as an empty directory; it will be retried after being closed
+      directoryTree.children.clear();
+      directoryTree.inArchive = nullptr;
+      memorySize = 0;
     }
   }
+
+  opened.store(true, std::memory_order_release);
+
+  if (parent) {
+    parent->openChildren++;
+  }
+  context.openNestedArchives.emplace_back(this);
+  context.openNestedArchiveMemory += memorySize;
+  if (context.ExceedsLimits()) {
+    context.trimRequested = true;
+  }
+}
+
+
+void NestedArchive::Close() {
+  assert(opened);
+  assert(pinCount == 0);
+  assert(openChildren == 0);
+
+  {
+    std::lock_guard streamLock(*directoryTree.streamMutex);
+
+    directoryTree.children.clear();
+    directoryTree.inArchive = nullptr;
+  }
+
+  opened.store(false, std::memory_order_release);
+
+  if (parent) {
+    parent->openChildren--;
+  }
 }
 
 
@@ -505,11 +840,11 @@ bool DirectoryTree::Exists(std::wstring_view filepath) const {
 
 
 
-Archive::Archive(NanaZ& nanaZ, winrt::com_ptr<IInStream> inStream, const BY_HANDLE_FILE_INFORMATION& byHandleFileInformation, const std::wstring& defaultFilepath, std::wstring_view prefixFilter, bool caseSensitive, UInt64 maxCheckStartPosition, OnExisting onExisting, ExtractToMemory extractToMemory, ArchiveNameCallback archiveNameCallback, PasswordWithFilepathCallback passwordCallback) :
+Archive::Archive(NanaZ& nanaZ, MemoryBudget& memoryBudget, winrt::com_ptr<IInStream> inStream, const BY_HANDLE_FILE_INFORMATION& byHandleFileInformation, const std::wstring& defaultFilepath, std::wstring_view prefixFilter, bool caseSensitive, UInt64 maxCheckStartPosition, OnExisting onExisting, ExtractToMemory extractToMemory, ArchiveNameCallback archiveNameCallback, PasswordWithFilepathCallback passwordCallback, ArchiveIndex* ptrArchiveIndex, std::size_t maxOpenNestedArchives, std::size_t maxNestedArchiveMemory, UInt64 spillThreshold) :
   DirectoryTree{
     std::make_shared<std::mutex>(),
     caseSensitive,
-    {0, CaseSensitivity::CiHash(caseSensitive), CaseSensitivity::CiEqualTo(caseSensitive)},
+    decltype(DirectoryTree::children){0, CaseSensitivity::CiHash(caseSensitive), CaseSensitivity::CiEqualTo(caseSensitive)},
     true,
     true,
     false,
@@ -526,9 +861,12 @@ Archive::Archive(NanaZ& nanaZ, winrt::com_ptr<IInStream> inStream, const BY_HAND
     byHandleFileInformation.ftCreationTime,
     byHandleFileInformation.ftLastAccessTime,
     byHandleFileInformation.ftLastWriteTime,
+    std::nullopt,
+    nullptr,
     nullptr,
   },
-  nanaZ(nanaZ)
+  context(std::make_unique<ArchiveContext>(nanaZ, memoryBudget, defaultFilepath, maxCheckStartPosition, onExisting, extractToMemory, archiveNameCallback, passwordCallback, ptrArchiveIndex, maxOpenNestedArchives, maxNestedArchiveMemory, spillThreshold)),
+  formatClsid{}
 {
   PasswordCallback rootArchivePasswordCallback;
   if (passwordCallback) {
@@ -536,20 +874,103 @@ Archive::Archive(NanaZ& nanaZ, winrt::com_ptr<IInStream> inStream, const BY_HAND
       return passwordCallback(L""s);
     };
   }
-  this->inArchive = CreateInArchiveFromInStream(nanaZ, inStream, maxCheckStartPosition, rootArchivePasswordCallback);
+  this->inArchive = CreateInArchiveFromInStream(nanaZ, inStream, maxCheckStartPosition, rootArchivePasswordCallback, &formatClsid);
   if (!this->inArchive) {
     throw std::runtime_error("cannot open stream as archive");
   }
-  UInt64 fileIndexCount = this->fileIndex + 1;
-  InitializeDirectoryTree(*this, defaultFilepath, prefixFilter, L""s, nanaZ, maxCheckStartPosition, onExisting, extractToMemory, archiveNameCallback, passwordCallback, fileIndexCount);
+  context->fileIndexCount = this->fileIndex + 1;
+  InitializeDirectoryTree(*this, formatClsid, *context, prefixFilter, L""s, context->fileIndexCount, true, L""s, nullptr);
+}
+
+
+Archive::~Archive() = default;
+
+
+// closes least recently used nested archives until the limits are met
+// nested archives which are pinned or contain open ones are kept open
+void Archive::Trim() const {
+  std::unique_lock treeLock(context->treeMutex);
+  std::lock_guard loadLock(context->loadMutex);
+
+  auto& openNestedArchives = context->openNestedArchives;
+  while (context->ExceedsLimits()) {
+    auto itrOldest = openNestedArchives.end();
+    for (auto itr = openNestedArchives.begin(); itr != openNestedArchives.end(); itr++) {
+      const auto& nestedArchive = **itr;
+      if (nestedArchive.pinCount != 0 || nestedArchive.openChildren != 0) {
+        continue;
+      }
+      if (itrOldest == openNestedArchives.end() || nestedArchive.lastAccess < (*itrOldest)->lastAccess) {
+        itrOldest = itr;
+      }
+    }
+    if (itrOldest == openNestedArchives.end()) {
+      break;
+    }
+
+    auto& nestedArchive = **itrOldest;
+    openNestedArchives.erase(itrOldest);
+    context->openNestedArchiveMemory -= nestedArchive.memorySize;
+    nestedArchive.memorySize = 0;
+    nestedArchive.Close();
+  }
 }
 
 
-const DirectoryTree* Archive::Get(std::wstring_view filepath) const {
-  return DirectoryTree::Get(filepath);
+const DirectoryTree* Archive::Get(std::wstring_view filepath, Pin& pin) const {
+  // closing nested archives needs the exclusive lock, so do it before traversing
+  if (context->trimRequested.exchange(false)) {
+    Trim();
+  }
+
+  std::shared_lock treeLock(context->treeMutex);
+
+  std::vector<std::shared_ptr<NestedArchive>> nestedArchives;
+  const auto ptrDirectoryTree = GetAndOpen(*this, filepath, nestedArchives);
+  pin = Pin(std::move(nestedArchives));
+  return ptrDirectoryTree;
 }
 
 
 bool Archive::Exists(std::wstring_view filepath) const {
-  return DirectoryTree::Exists(filepath);
+  Pin pin;
+  return Get(filepath, pin) != nullptr;
+}
+
+
+const CLSID& Archive::GetFormatClsid() const {
+  return formatClsid;
+}
+
+
+
+Archive::Pin::Pin(std::vector<std::shared_ptr<NestedArchive>>&& nestedArchives) :
+  nestedArchives(std::move(nestedArchives))
+{
+  for (const auto& nestedArchive : this->nestedArchives) {
+    nestedArchive->pinCount++;
+  }
+}
+
+
+Archive::Pin::~Pin() {
+  Release();
+}
+
+
+void Archive::Pin::Release() {
+  for (const auto& nestedArchive : nestedArchives) {
+    nestedArchive->pinCount--;
+  }
+  nestedArchives.clear();
+}
+
+
+Archive::Pin& Archive::Pin::operator=(Pin&& other) noexcept {
+  if (this != &other) {
+    Release();
+    nestedArchives = std::move(other.nestedArchives);
+    other.nestedArchives.clear();
+  }
+  return *this;
 }
@@ -3,10 +3,13 @@
 #include <7z/CPP/7zip/IStream.h>
 #include <7z/CPP/7zip/Archive/IArchive.h>
 
+#include "ArchiveIndex.hpp"
+#include "MemoryBudget.hpp"
 #include "NanaZ.hpp"
 
 #include "../SDK/CaseSensitivity.hpp"
 
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -14,11 +17,17 @@
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include <Windows.h>
 #include <winrt/base.h>
 
 
+struct ArchiveContext;
+class ExtractedContent;
+class NestedArchive;
+
+
 struct DirectoryTree {
   enum class ExtractToMemory {
     Never,
@@ -61,8 +70,16 @@ struct DirectoryTree {
   FILETIME creationTime;
   FILETIME lastAccessTime;
   FILETIME lastWriteTime;
-  std::unique_ptr<std::byte[]> extractionMemory;
-
+  // index of the item in the root archive
+  // only set for files of the root archive which are read from the stream returned by IInArchiveGetStream, and such files can also be read via another instance of the root archive
+  std::optional<UInt32> rootItemIndexN;
+  // set for nested archives, which are opened on first access via Archive::Get and may be closed again while not in use
+  // children and inArchive of a nested archive are empty while it is not open
+  std::shared_ptr<NestedArchive> nestedArchive;
+  // set for files extracted to memory (or temporary files), which inStream reads from
+  std::shared_ptr<ExtractedContent> extractedContent;
+
+  // does not open nested archives; use Archive::Get to access their contents
   const DirectoryTree* Get(std::wstring_view filepath) const;
   bool Exists(std::wstring_view filepath) const;
 };
@@ -73,15 +90,46 @@ public:
   // 7z uses backslash for directory separator
   static constexpr wchar_t DirectorySeparatorFromLibrary = L'\\';
 
-private:
-  NanaZ& nanaZ;
-
-public:
   using ArchiveNameCallback = std::function<std::optional<std::pair<std::wstring, bool>>(const std::wstring&, std::size_t)>;
   using PasswordWithFilepathCallback = std::function<std::optional<std::wstring>(const std::wstring&)>;
 
-  Archive(NanaZ& nanaZ, winrt::com_ptr<IInStream> inStream, const BY_HANDLE_FILE_INFORMATION& byHandleFileInformation, const std::wstring& defaultFilepath, std::wstring_view prefixFilter, bool caseSensitive, UInt64 maxCheckStartPosition, OnExisting onExisting, ExtractToMemory extractToMemory, ArchiveNameCallback archiveNameCallback = nullptr, PasswordWithFilepathCallback passwordCallback = nullptr);
+  // keeps the nested archives containing a DirectoryTree returned by Get open until destruction
+  class Pin {
+    std::vector<std::shared_ptr<NestedArchive>> nestedArchives;
 
-  const DirectoryTree* Get(std::wstring_view filepath) const;
+    void Release();
+
+  public:
+    Pin() = default;
+    explicit Pin(std::vector<std::shared_ptr<NestedArchive>>&& nestedArchives);
+    ~Pin();
+
+    Pin(const Pin&) = delete;
+    Pin& operator=(const Pin&) = delete;
+
+    Pin(Pin&& other) noexcept = default;
+    Pin& operator=(Pin&& other) noexcept;
+  };
+
+private:
+  std::unique_ptr<ArchiveContext> context;
+  CLSID formatClsid;
+
+  void Trim() const;
+
+public:
+  // nested archives are opened on first access; least recently used ones which are not pinned are closed when more than maxOpenNestedArchives of them are open or they use more than maxNestedArchiveMemory bytes
+  // limits of 0 mean unlimited
+  // contents extracted to memory are charged to memoryBudget, and those larger than spillThreshold (or the capacity of memoryBudget) are extracted to temporary files instead; spillThreshold of 0 disables it
+  Archive(NanaZ& nanaZ, MemoryBudget& memoryBudget, winrt::com_ptr<IInStream> inStream, const BY_HANDLE_FILE_INFORMATION& byHandleFileInformation, const std::wstring& defaultFilepath, std::wstring_view prefixFilter, bool caseSensitive, UInt64 maxCheckStartPosition, OnExisting onExisting, ExtractToMemory extractToMemory, ArchiveNameCallback archiveNameCallback = nullptr, PasswordWithFilepathCallback passwordCallback = nullptr, ArchiveIndex* ptrArchiveIndex = nullptr, std::size_t maxOpenNestedArchives = 0, std::size_t maxNestedArchiveMemory = 0, UInt64 spillThreshold = 0);
+  ~Archive();
+
+  Archive(const Archive&) = delete;
+  Archive& operator=(const Archive&) = delete;
+
+  // opens nested archives on the path (including the target itself)
+  // the returned DirectoryTree is valid as long as pin is held
+  const DirectoryTree* Get(std::wstring_view filepath, Pin& pin) const;
   bool Exists(std::wstring_view filepath) const;
+  const CLSID& GetFormatClsid() const;
 };
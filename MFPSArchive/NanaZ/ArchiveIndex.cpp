@@ -0,0 +1,394 @@
+#define NOMINMAX
+
+#include <dokan/dokan.h>
+
+#include <7z/CPP/Common/Common.h>
+
+#include "../SDK/Plugin/SourceCpp.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <Windows.h>
+
+#include "ArchiveIndex.hpp"
+
+using namespace std::literals;
+
+
+
+namespace {
+  constexpr char Magic[8] = {'M', 'F', 'A', 'I', 'D', 'X', '\0', '\0'};
+  constexpr std::uint32_t Version = 2;
+
+  // size of the head and the tail of an archive file used for ArchiveIndexKey::contentHash
+  constexpr std::size_t ContentHashSampleSize = 64 * 1024;
+
+  enum RecordFlag : std::uint8_t {
+    HasCreationTime = 1 << 0,
+    HasLastAccessTime = 1 << 1,
+    HasLastWriteTime = 1 << 2,
+    IsDirectory = 1 << 3,
+    HasFileSize = 1 << 4,
+    HasFilepath = 1 << 5,
+    IsStoredContiguously = 1 << 6,
+  };
+
+
+  // FNV-1a
+  constexpr UInt64 HashOffsetBasis = 0xCBF29CE484222325ull;
+  constexpr UInt64 HashPrime = 0x00000100000001B3ull;
+
+  UInt64 Hash(const void* data, std::size_t size, UInt64 hash = HashOffsetBasis) {
+    const auto bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; i++) {
+      hash = (hash ^ bytes[i]) * HashPrime;
+    }
+    return hash;
+  }
+
+
+  UInt64 FromFileTime(const FILETIME& fileTime) {
+    return (static_cast<UInt64>(fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime;
+  }
+
+
+  FILETIME ToFileTime(UInt64 value) {
+    return FILETIME{
+      static_cast<DWORD>(value & 0xFFFFFFFF),
+      static_cast<DWORD>(value >> 32),
+    };
+  }
+
+
+  class Writer {
+    std::vector<char>& buffer;
+
+  public:
+    Writer(std::vector<char>& buffer) :
+      buffer(buffer)
+    {}
+
+    template<typename T>
+    void Write(const T& value) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      const auto ptr = reinterpret_cast<const char*>(&value);
+      buffer.insert(buffer.end(), ptr, ptr + sizeof(T));
+    }
+
+    void WriteString(const std::wstring& string) {
+      Write(static_cast<std::uint32_t>(string.size()));
+      const auto ptr = reinterpret_cast<const char*>(string.data());
+      buffer.insert(buffer.end(), ptr, ptr + string.size() * sizeof(wchar_t));
+    }
+  };
+
+
+  class Reader {
+    const char* ptr;
+    const char* const end;
+
+    void Check(std::size_t size) const {
+      if (static_cast<std::size_t>(end - ptr) < size) {
+        throw std::runtime_error("index file is truncated");
+      }
+    }
+
+  public:
+    Reader(const std::vector<char>& buffer) :
+      ptr(buffer.data()),
+      end(buffer.data() + buffer.size())
+    {}
+
+    template<typename T>
+    T Read() {
+      static_assert(std::is_trivially_copyable_v<T>);
+      Check(sizeof(T));
+      T value;
+      std::memcpy(&value, ptr, sizeof(T));
+      ptr += sizeof(T);
+      return value;
+    }
+
+    std::wstring ReadString() {
+      const std::size_t length = Read<std::uint32_t>();
+      Check(length * sizeof(wchar_t));
+      std::wstring string(length, L'\0');
+      std::memcpy(string.data(), ptr, length * sizeof(wchar_t));
+      ptr += length * sizeof(wchar_t);
+      return string;
+    }
+
+    bool IsEnd() const {
+      return ptr == end;
+    }
+  };
+
+
+  void WriteKey(Writer& writer, const ArchiveIndexKey& key) {
+    writer.Write(key.fileSize);
+    writer.Write(FromFileTime(key.lastWriteTime));
+    writer.Write(key.contentHash);
+  }
+
+
+  ArchiveIndexKey ReadKey(Reader& reader) {
+    ArchiveIndexKey key{};
+    key.fileSize = reader.Read<UInt64>();
+    key.lastWriteTime = ToFileTime(reader.Read<UInt64>());
+    key.contentHash = reader.Read<UInt64>();
+    return key;
+  }
+
+
+  // returns std::nullopt if the file does not exist or cannot be read
+  std::optional<std::vector<char>> ReadWholeFile(const std::wstring& filepath) {
+    const HANDLE fileHandle = CreateFileW(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+      return std::nullopt;
+    }
+
+    std::optional<std::vector<char>> bufferN;
+    LARGE_INTEGER fileSize{};
+    if (GetFileSizeEx(fileHandle, &fileSize) && static_cast<ULONGLONG>(fileSize.QuadPart) <= std::numeric_limits<DWORD>::max()) {
+      std::vector<char> buffer(static_cast<std::size_t>(fileSize.QuadPart));
+      DWORD numberOfBytesRead = 0;
+      if (buffer.empty() || (ReadFile(fileHandle, buffer.data(), static_cast<DWORD>(buffer.size()), &numberOfBytesRead, NULL) && numberOfBytesRead == buffer.size())) {
+        bufferN = std::move(buffer);
+      }
+    }
+    CloseHandle(fileHandle);
+    return bufferN;
+  }
+
+
+  // throws on failure
+  void WriteWholeFile(const std::wstring& filepath, const std::vector<char>& buffer) {
+    const HANDLE fileHandle = CreateFileW(filepath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+      throw Win32Error();
+    }
+
+    DWORD numberOfBytesWritten = 0;
+    if (!buffer.empty() && !WriteFile(fileHandle, buffer.data(), static_cast<DWORD>(buffer.size()), &numberOfBytesWritten, NULL)) {
+      const auto error = GetLastError();
+      CloseHandle(fileHandle);
+      throw Win32Error(error);
+    }
+    CloseHandle(fileHandle);
+  }
+
+
+  void HashFileRange(HANDLE fileHandle, UInt64 offset, std::size_t size, std::vector<char>& buffer, UInt64& hash) {
+    buffer.resize(size);
+    OVERLAPPED overlapped{};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD numberOfBytesRead = 0;
+    if (!ReadFile(fileHandle, buffer.data(), static_cast<DWORD>(size), &numberOfBytesRead, &overlapped)) {
+      throw Win32Error();
+    }
+    hash = Hash(buffer.data(), numberOfBytesRead, hash);
+  }
+}
+
+
+
+ArchiveIndexKey ArchiveIndexKey::FromFile(HANDLE fileHandle, const BY_HANDLE_FILE_INFORMATION& byHandleFileInformation) {
+  const UInt64 fileSize = (static_cast<UInt64>(byHandleFileInformation.nFileSizeHigh) << 32) | byHandleFileInformation.nFileSizeLow;
+
+  std::vector<char> buffer;
+  UInt64 contentHash = HashOffsetBasis;
+  const std::size_t headSize = static_cast<std::size_t>(std::min<UInt64>(fileSize, ContentHashSampleSize));
+  HashFileRange(fileHandle, 0, headSize, buffer, contentHash);
+  if (fileSize > headSize) {
+    const std::size_t tailSize = static_cast<std::size_t>(std::min<UInt64>(fileSize - headSize, ContentHashSampleSize));
+    HashFileRange(fileHandle, fileSize - tailSize, tailSize, buffer, contentHash);
+  }
+
+  return ArchiveIndexKey{
+    fileSize,
+    byHandleFileInformation.ftLastWriteTime,
+    contentHash,
+  };
+}
+
+
+bool ArchiveIndexKey::operator==(const ArchiveIndexKey& other) const noexcept {
+  return fileSize == other.fileSize && FromFileTime(lastWriteTime) == FromFileTime(other.lastWriteTime) && contentHash == other.contentHash;
+}
+
+
+
+std::wstring ArchiveIndex::GetIndexFilepath(const std::wstring& indexDirectory, const std::wstring& archiveFilepath) {
+  // paths are case insensitive on Windows
+  std::wstring lowerArchiveFilepath(archiveFilepath);
+  CharLowerBuffW(lowerArchiveFilepath.data(), static_cast<DWORD>(lowerArchiveFilepath.size()));
+  const UInt64 hash = Hash(lowerArchiveFilepath.data(), lowerArchiveFilepath.size() * sizeof(wchar_t));
+
+  wchar_t hashString[17];
+  swprintf_s(hashString, L"%016llX", static_cast<unsigned long long>(hash));
+
+  std::wstring filepath(indexDirectory);
+  if (!filepath.empty() && filepath.back() != L'\\') {
+    filepath += L'\\';
+  }
+  return filepath + hashString + L".idx"s;
+}
+
+
+ArchiveIndex::ArchiveIndex() :
+  archiveRecordsMap(),
+  modified(false)
+{}
+
+
+const std::vector<ArchiveItemRecord>* ArchiveIndex::Find(const std::wstring& key) const {
+  const auto itr = archiveRecordsMap.find(key);
+  return itr != archiveRecordsMap.end() ? &itr->second : nullptr;
+}
+
+
+void ArchiveIndex::Set(const std::wstring& key, std::vector<ArchiveItemRecord>&& records) {
+  archiveRecordsMap.insert_or_assign(key, std::move(records));
+  modified = true;
+}
+
+
+bool ArchiveIndex::IsModified() const {
+  return modified;
+}
+
+
+bool ArchiveIndex::Load(const std::wstring& filepath, const ArchiveIndexKey& key) {
+  const auto bufferN = ReadWholeFile(filepath);
+  if (!bufferN) {
+    return false;
+  }
+
+  try {
+    Reader reader(bufferN.value());
+
+    for (const auto c : Magic) {
+      if (reader.Read<char>() != c) {
+        return false;
+      }
+    }
+    if (reader.Read<std::uint32_t>() != Version) {
+      return false;
+    }
+    if (!(ReadKey(reader) == key)) {
+      return false;
+    }
+
+    std::unordered_map<std::wstring, std::vector<ArchiveItemRecord>> newArchiveRecordsMap;
+    const std::uint32_t numArchives = reader.Read<std::uint32_t>();
+    for (std::uint32_t i = 0; i < numArchives; i++) {
+      auto recordsKey = reader.ReadString();
+      const std::uint32_t numRecords = reader.Read<std::uint32_t>();
+      std::vector<ArchiveItemRecord> records;
+      for (std::uint32_t j = 0; j < numRecords; j++) {
+        const auto flags = reader.Read<std::uint8_t>();
+        ArchiveItemRecord record{};
+        record.fileAttributes = reader.Read<DWORD>();
+        record.directory = (flags & IsDirectory) != 0;
+        record.storedContiguously = (flags & IsStoredContiguously) != 0;
+        if (flags & HasCreationTime) {
+          record.creationTimeN = ToFileTime(reader.Read<UInt64>());
+        }
+        if (flags & HasLastAccessTime) {
+          record.lastAccessTimeN = ToFileTime(reader.Read<UInt64>());
+        }
+        if (flags & HasLastWriteTime) {
+          record.lastWriteTimeN = ToFileTime(reader.Read<UInt64>());
+        }
+        if (flags & HasFileSize) {
+          record.fileSizeN = reader.Read<UInt64>();
+        }
+        if (flags & HasFilepath) {
+          record.filepathN = reader.ReadString();
+        }
+        records.emplace_back(std::move(record));
+      }
+      newArchiveRecordsMap.insert_or_assign(std::move(recordsKey), std::move(records));
+    }
+    if (!reader.IsEnd()) {
+      return false;
+    }
+
+    archiveRecordsMap = std::move(newArchiveRecordsMap);
+    modified = false;
+    return true;
+  } catch (std::runtime_error&) {
+    return false;
+  }
+}
+
+
+void ArchiveIndex::Save(const std::wstring& filepath, const ArchiveIndexKey& key) {
+  std::vector<char> buffer;
+  Writer writer(buffer);
+
+  for (const auto c : Magic) {
+    writer.Write(c);
+  }
+  writer.Write(Version);
+  WriteKey(writer, key);
+
+  writer.Write(static_cast<std::uint32_t>(archiveRecordsMap.size()));
+  for (const auto& [recordsKey, records] : archiveRecordsMap) {
+    writer.WriteString(recordsKey);
+    writer.Write(static_cast<std::uint32_t>(records.size()));
+    for (const auto& record : records) {
+      std::uint8_t flags = 0;
+      flags |= record.creationTimeN ? HasCreationTime : 0;
+      flags |= record.lastAccessTimeN ? HasLastAccessTime : 0;
+      flags |= record.lastWriteTimeN ? HasLastWriteTime : 0;
+      flags |= record.directory ? IsDirectory : 0;
+      flags |= record.fileSizeN ? HasFileSize : 0;
+      flags |= record.filepathN ? HasFilepath : 0;
+      flags |= record.storedContiguously ? IsStoredContiguously : 0;
+      writer.Write(flags);
+      writer.Write(record.fileAttributes);
+      if (record.creationTimeN) {
+        writer.Write(FromFileTime(record.creationTimeN.value()));
+      }
+      if (record.lastAccessTimeN) {
+        writer.Write(FromFileTime(record.lastAccessTimeN.value()));
+      }
+      if (record.lastWriteTimeN) {
+        writer.Write(FromFileTime(record.lastWriteTimeN.value()));
+      }
+      if (record.fileSizeN) {
+        writer.Write(record.fileSizeN.value());
+      }
+      if (record.filepathN) {
+        writer.WriteString(record.filepathN.value());
+      }
+    }
+  }
+
+  // write to a temporary file and replace in order not to leave a broken index file
+  const std::wstring temporaryFilepath = filepath + L".tmp"s;
+  try {
+    WriteWholeFile(temporaryFilepath, buffer);
+  } catch (...) {
+    DeleteFileW(temporaryFilepath.c_str());
+    throw;
+  }
+  if (!MoveFileExW(temporaryFilepath.c_str(), filepath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+    const auto error = GetLastError();
+    DeleteFileW(temporaryFilepath.c_str());
+    throw Win32Error(error);
+  }
+
+  modified = false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <7z/CPP/Common/Common.h>
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Windows.h>
+
+
+// properties of an item in an archive, as retrieved by IInArchive::GetProperty
+struct ArchiveItemRecord {
+  std::optional<FILETIME> creationTimeN;
+  std::optional<FILETIME> lastAccessTimeN;
+  std::optional<FILETIME> lastWriteTimeN;
+  bool directory;
+  DWORD fileAttributes;
+  std::optional<UInt64> fileSizeN;
+  std::optional<std::wstring> filepathN;
+  // the content is stored as is in a single range of the archive (see InSeekFilterStream)
+  bool storedContiguously;
+};
+
+
+// identifies the content of an archive file
+// contentHash is computed from the head and the tail of the file, not from the whole of it
+struct ArchiveIndexKey {
+  UInt64 fileSize;
+  FILETIME lastWriteTime;
+  UInt64 contentHash;
+
+  static ArchiveIndexKey FromFile(HANDLE fileHandle, const BY_HANDLE_FILE_INFORMATION& byHandleFileInformation);
+
+  bool operator==(const ArchiveIndexKey& other) const noexcept;
+};
+
+
+// item records of an archive and its nested archives, which can be saved into a file and loaded on the next mount to skip querying properties of each item
+// records of the root archive are stored with an empty key, and those of nested archives with the indices of the items leading to them (e.g. "\\3\\12")
+class ArchiveIndex {
+  std::unordered_map<std::wstring, std::vector<ArchiveItemRecord>> archiveRecordsMap;
+  bool modified;
+
+public:
+  // returns the path of the index file for archiveFilepath in indexDirectory
+  static std::wstring GetIndexFilepath(const std::wstring& indexDirectory, const std::wstring& archiveFilepath);
+
+  ArchiveIndex();
+
+  // returns nullptr if not available
+  const std::vector<ArchiveItemRecord>* Find(const std::wstring& key) const;
+  void Set(const std::wstring& key, std::vector<ArchiveItemRecord>&& records);
+  bool IsModified() const;
+
+  // returns false if the file does not exist, is broken or has been created for another key
+  bool Load(const std::wstring& filepath, const ArchiveIndexKey& key);
+  // throws on failure
+  void Save(const std::wstring& filepath, const ArchiveIndexKey& key);
+};
@@ -0,0 +1,178 @@
+#include <7z/CPP/Common/Common.h>
+#include <7z/CPP/7zip/Archive/IArchive.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include <Windows.h>
+#include <winrt/base.h>
+
+#include "ArchiveInstancePool.hpp"
+#include "ArchiveOpenCallback.hpp"
+#include "COMError.hpp"
+
+
+
+ArchiveInstancePool::Lease::Lease() :
+  ptrPool(nullptr),
+  instance()
+{}
+
+
+ArchiveInstancePool::Lease::Lease(ArchiveInstancePool& pool, std::unique_ptr<Instance>&& instance) :
+  ptrPool(&pool),
+  instance(std::move(instance))
+{}
+
+
+ArchiveInstancePool::Lease::~Lease() {
+  if (ptrPool && instance) {
+    ptrPool->Release(std::move(instance));
+  }
+}
+
+
+ArchiveInstancePool::Lease::Lease(Lease&& other) noexcept :
+  ptrPool(other.ptrPool),
+  instance(std::move(other.instance))
+{
+  other.ptrPool = nullptr;
+}
+
+
+ArchiveInstancePool::Lease& ArchiveInstancePool::Lease::operator=(Lease&& other) noexcept {
+  if (this != &other) {
+    if (ptrPool && instance) {
+      ptrPool->Release(std::move(instance));
+    }
+    ptrPool = other.ptrPool;
+    instance = std::move(other.instance);
+    other.ptrPool = nullptr;
+  }
+  return *this;
+}
+
+
+ArchiveInstancePool::Lease::operator bool() const noexcept {
+  return static_cast<bool>(instance);
+}
+
+
+IInStream* ArchiveInstancePool::Lease::GetItemStream(UInt32 index) {
+  if (!instance) {
+    return nullptr;
+  }
+  if (instance->itemIndexN == index) {
+    return instance->itemInStream.get();
+  }
+
+  instance->itemIndexN = std::nullopt;
+  instance->itemInStream = nullptr;
+
+  winrt::com_ptr<ISequentialInStream> sequentialInStream;
+  if (FAILED(instance->inArchiveGetStream->GetStream(index, sequentialInStream.put())) || !sequentialInStream) {
+    return nullptr;
+  }
+  winrt::com_ptr<IInStream> itemInStream;
+  if (FAILED(sequentialInStream->QueryInterface(IID_IInStream, itemInStream.put_void())) || !itemInStream) {
+    return nullptr;
+  }
+
+  instance->itemIndexN = index;
+  instance->itemInStream = itemInStream;
+  return instance->itemInStream.get();
+}
+
+
+
+ArchiveInstancePool::ArchiveInstancePool(NanaZ& nanaZ, const CLSID& formatClsid, UInt64 maxCheckStartPosition, std::size_t maxInstances, InStreamFactory inStreamFactory) :
+  nanaZ(nanaZ),
+  formatClsid(formatClsid),
+  maxCheckStartPosition(maxCheckStartPosition),
+  maxInstances(maxInstances),
+  inStreamFactory(inStreamFactory),
+  mutex(),
+  condition(),
+  freeInstances(),
+  numInstances(0),
+  failed(false)
+{}
+
+
+std::unique_ptr<ArchiveInstancePool::Instance> ArchiveInstancePool::OpenInstance() {
+  auto instance = std::make_unique<Instance>();
+
+  const auto inStream = inStreamFactory();
+  COMError::CheckHRESULT(nanaZ.CreateObject(&formatClsid, &IID_IInArchive, instance->inArchive.put_void()));
+
+  // passwords are not supported; such archives fall back to the shared stream
+  auto archiveOpenCallback = winrt::make_self<ArchiveOpenCallback>();
+  COMError::CheckHRESULT(instance->inArchive->Open(inStream.get(), &maxCheckStartPosition, archiveOpenCallback.get()));
+  COMError::CheckHRESULT(instance->inArchive->QueryInterface(IID_IInArchiveGetStream, instance->inArchiveGetStream.put_void()));
+
+  return instance;
+}
+
+
+void ArchiveInstancePool::Release(std::unique_ptr<Instance>&& instance) {
+  {
+    std::lock_guard lock(mutex);
+    freeInstances.emplace_back(std::move(instance));
+  }
+  condition.notify_one();
+}
+
+
+bool ArchiveInstancePool::IsEnabled() const {
+  return maxInstances != 0;
+}
+
+
+ArchiveInstancePool::Lease ArchiveInstancePool::Acquire(UInt32 index) {
+  if (!IsEnabled()) {
+    return Lease();
+  }
+
+  std::unique_lock lock(mutex);
+
+  while (true) {
+    if (!freeInstances.empty()) {
+      auto itr = std::find_if(freeInstances.begin(), freeInstances.end(), [index](const std::unique_ptr<Instance>& instance) {
+        return instance->itemIndexN == index;
+      });
+      if (itr == freeInstances.end()) {
+        itr = std::prev(freeInstances.end());
+      }
+      auto instance = std::move(*itr);
+      freeInstances.erase(itr);
+      return Lease(*this, std::move(instance));
+    }
+
+    // once opening an instance failed, do not wait for other instances but let the caller use the shared stream
+    if (failed) {
+      return Lease();
+    }
+
+    if (numInstances < maxInstances) {
+      numInstances++;
+      lock.unlock();
+      try {
+        return Lease(*this, OpenInstance());
+      } catch (...) {
+        lock.lock();
+        numInstances--;
+        failed = true;
+        lock.unlock();
+        // wake up waiters so that they fall back as well
+        condition.notify_all();
+        return Lease();
+      }
+    }
+
+    condition.wait(lock);
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <7z/CPP/Common/Common.h>
+#include <7z/CPP/7zip/IStream.h>
+#include <7z/CPP/7zip/Archive/IArchive.h>
+
+#include "NanaZ.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <Windows.h>
+#include <winrt/base.h>
+
+
+// pool of IInArchive instances of the same archive, each of which is opened on its own IInStream
+// streams of items retrieved from different instances do not share any seek position, so they can be read concurrently
+// instances are opened lazily up to maxInstances; if all of them are in use, Acquire waits for one to be released
+class ArchiveInstancePool {
+public:
+  using InStreamFactory = std::function<winrt::com_ptr<IInStream>()>;
+
+private:
+  struct Instance {
+    winrt::com_ptr<IInArchive> inArchive;
+    winrt::com_ptr<IInArchiveGetStream> inArchiveGetStream;
+    std::optional<UInt32> itemIndexN;
+    winrt::com_ptr<IInStream> itemInStream;
+  };
+
+public:
+  // holds an instance until destruction
+  class Lease {
+    ArchiveInstancePool* ptrPool;
+    std::unique_ptr<Instance> instance;
+
+  public:
+    Lease();
+    Lease(ArchiveInstancePool& pool, std::unique_ptr<Instance>&& instance);
+    ~Lease();
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+    Lease(Lease&& other) noexcept;
+    Lease& operator=(Lease&& other) noexcept;
+
+    explicit operator bool() const noexcept;
+
+    // returns nullptr if the item cannot be read as IInStream
+    // the returned stream is owned by the lease and valid until the lease is released or GetItemStream is called with another index
+    IInStream* GetItemStream(UInt32 index);
+  };
+
+private:
+  NanaZ& nanaZ;
+  const CLSID formatClsid;
+  const UInt64 maxCheckStartPosition;
+  const std::size_t maxInstances;
+  const InStreamFactory inStreamFactory;
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::vector<std::unique_ptr<Instance>> freeInstances;
+  std::size_t numInstances;
+  bool failed;
+
+  std::unique_ptr<Instance> OpenInstance();
+  void Release(std::unique_ptr<Instance>&& instance);
+
+public:
+  // maxInstances of 0 disables the pool
+  ArchiveInstancePool(NanaZ& nanaZ, const CLSID& formatClsid, UInt64 maxCheckStartPosition, std::size_t maxInstances, InStreamFactory inStreamFactory);
+
+  ArchiveInstancePool(const ArchiveInstancePool&) = delete;
+  ArchiveInstancePool& operator=(const ArchiveInstancePool&) = delete;
+
+  bool IsEnabled() const;
+
+  // prefers an instance which has already opened the stream of the item
+  // returns an empty lease if no instance is available (the pool is disabled or failed to open the archive)
+  Lease Acquire(UInt32 index);
+};
@@ -0,0 +1,518 @@
+#define NOMINMAX
+
+#include <7z/CPP/Common/Common.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Windows.h>
+#include <winrt/base.h>
+
+#include "COMError.hpp"
+#include "ExtractedContent.hpp"
+#include "MemoryStream.hpp"
+
+using namespace std::literals;
+
+
+
+namespace {
+  // writes sequentially into a temporary file
+  class OutSpillFileStream : public winrt::implements<OutSpillFileStream, ISequentialOutStream, IStreamGetSize> {
+    HANDLE fileHandle;
+    UInt64 dataSize;
+
+  public:
+    OutSpillFileStream(HANDLE fileHandle) :
+      fileHandle(fileHandle),
+      dataSize(0)
+    {}
+
+    STDMETHODIMP Write(const void* data, UInt32 size, UInt32* processedSize) {
+      DWORD numberOfBytesWritten = 0;
+      if (size != 0 && !WriteFile(fileHandle, data, size, &numberOfBytesWritten, NULL)) {
+        return HRESULT_FROM_WIN32(GetLastError());
+      }
+      dataSize += numberOfBytesWritten;
+      if (processedSize) {
+        *processedSize = numberOfBytesWritten;
+      }
+      return S_OK;
+    }
+
+    STDMETHODIMP GetSize(UInt64* size) {
+      if (!size) {
+        return S_OK;
+      }
+      *size = dataSize;
+      return S_OK;
+    }
+  };
+
+
+  // returns INVALID_HANDLE_VALUE on failure
+  // the file is deleted when the handle is closed
+  HANDLE CreateSpillFile() {
+    wchar_t tempPathBuffer[MAX_PATH + 1];
+    const DWORD tempPathLength = GetTempPathW(MAX_PATH + 1, tempPathBuffer);
+    if (!tempPathLength || tempPathLength > MAX_PATH) {
+      return INVALID_HANDLE_VALUE;
+    }
+    wchar_t tempFilepathBuffer[MAX_PATH + 1];
+    if (!GetTempFileNameW(tempPathBuffer, L"MFA", 0, tempFilepathBuffer)) {
+      return INVALID_HANDLE_VALUE;
+    }
+    const HANDLE fileHandle = CreateFileW(tempFilepathBuffer, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+      DeleteFileW(tempFilepathBuffer);
+    }
+    return fileHandle;
+  }
+}
+
+
+
+ExtractedContent::ExtractedContent(MemoryBudget& memoryBudget, winrt::com_ptr<IInArchive> inArchive, std::shared_ptr<std::mutex> archiveMutex, UInt32 index, UInt64 expectedSize, bool spill, PasswordCallback passwordCallback) :
+  memoryBudget(memoryBudget),
+  inArchive(inArchive),
+  archiveMutex(archiveMutex),
+  index(index),
+  expectedSize(expectedSize),
+  passwordCallback(passwordCallback),
+  mutex(),
+  data(),
+  reloadedData(),
+  reloading(false),
+  spillFileHandle(spill ? CreateSpillFile() : INVALID_HANDLE_VALUE),
+  available(false),
+  size(0),
+  pendingData(),
+  pendingStreamGetSize(),
+  archiveContents(),
+  archivePosition(0)
+{
+  if constexpr (std::numeric_limits<UInt64>::max() > std::numeric_limits<std::size_t>::max()) {
+    if (spillFileHandle == INVALID_HANDLE_VALUE && expectedSize > std::numeric_limits<std::size_t>::max()) {
+      throw COMError(E_OUTOFMEMORY);
+    }
+  }
+}
+
+
+ExtractedContent::~ExtractedContent() {
+  if (spillFileHandle != INVALID_HANDLE_VALUE) {
+    if (available) {
+      memoryBudget.RemoveSpilledBytes(size);
+    }
+    CloseHandle(spillFileHandle);
+    spillFileHandle = INVALID_HANDLE_VALUE;
+  }
+}
+
+
+void ExtractedContent::Preload(const std::vector<std::shared_ptr<ExtractedContent>>& contents, const std::atomic<bool>* ptrCancelled) {
+  if (contents.empty()) {
+    return;
+  }
+
+  const auto& firstContent = *contents.front();
+
+  std::lock_guard archiveLock(*firstContent.archiveMutex);
+
+  // check under the lock as contents may have been extracted meanwhile
+  std::vector<std::shared_ptr<ExtractedContent>> targetContents;
+  for (const auto& content : contents) {
+    assert(content->inArchive == firstContent.inArchive);
+    if (!content->available || content->IsLoaded()) {
+      continue;
+    }
+    targetContents.emplace_back(content);
+  }
+  if (targetContents.empty()) {
+    return;
+  }
+
+  std::sort(targetContents.begin(), targetContents.end(), [](const auto& a, const auto& b) {
+    return a->index < b->index;
+  });
+  targetContents.erase(std::unique(targetContents.begin(), targetContents.end(), [](const auto& a, const auto& b) {
+    return a->index == b->index;
+  }), targetContents.end());
+
+  std::vector<UInt32> indices;
+  indices.reserve(targetContents.size());
+  for (const auto& content : targetContents) {
+    indices.emplace_back(content->index);
+  }
+
+  auto extractCallback = winrt::make_self<ExtractedContentExtractCallback>(targetContents, firstContent.passwordCallback, ptrCancelled);
+  firstContent.inArchive->Extract(indices.data(), static_cast<UInt32>(indices.size()), FALSE, extractCallback.get());
+}
+
+
+void ExtractedContent::SetArchiveContents(std::shared_ptr<const std::vector<std::weak_ptr<ExtractedContent>>> archiveContents, std::size_t archivePosition) {
+  this->archiveContents = archiveContents;
+  this->archivePosition = archivePosition;
+}
+
+
+std::vector<std::shared_ptr<ExtractedContent>> ExtractedContent::GetFollowingContents(std::size_t maxCount) const {
+  std::vector<std::shared_ptr<ExtractedContent>> contents;
+  if (!archiveContents) {
+    return contents;
+  }
+  for (std::size_t position = archivePosition + 1; position < archiveContents->size() && contents.size() < maxCount; position++) {
+    if (auto content = (*archiveContents)[position].lock()) {
+      contents.emplace_back(std::move(content));
+    }
+  }
+  return contents;
+}
+
+
+const IInArchive* ExtractedContent::GetInArchive() const {
+  return inArchive.get();
+}
+
+
+UInt32 ExtractedContent::GetIndex() const {
+  return index;
+}
+
+
+bool ExtractedContent::IsAvailable() const {
+  return available;
+}
+
+
+UInt64 ExtractedContent::GetSize() const {
+  return size;
+}
+
+
+bool ExtractedContent::IsSpilled() const {
+  return spillFileHandle != INVALID_HANDLE_VALUE;
+}
+
+
+bool ExtractedContent::IsLoaded() const {
+  if (spillFileHandle != INVALID_HANDLE_VALUE) {
+    return available;
+  }
+  return !!std::atomic_load(&data);
+}
+
+
+void ExtractedContent::Evict() {
+  std::atomic_store(&data, std::shared_ptr<std::byte[]>());
+}
+
+
+// returns the data in memory, extracting it again if it has been evicted
+std::shared_ptr<std::byte[]> ExtractedContent::Acquire() {
+  if (auto currentData = std::atomic_load(&data)) {
+    memoryBudget.Touch(*this);
+    return currentData;
+  }
+
+  std::lock_guard lock(mutex);
+
+  // another thread may have extracted it meanwhile
+  if (auto currentData = std::atomic_load(&data)) {
+    memoryBudget.Touch(*this);
+    return currentData;
+  }
+
+  {
+    // extracting a single item from a solid archive decompresses from the start of the block
+    std::lock_guard archiveLock(*archiveMutex);
+
+    // Preload may have extracted it meanwhile
+    if (auto currentData = std::atomic_load(&data)) {
+      memoryBudget.Touch(*this);
+      return currentData;
+    }
+
+    reloading = true;
+    auto extractCallback = winrt::make_self<ExtractedContentExtractCallback>(std::vector<std::shared_ptr<ExtractedContent>>{shared_from_this()}, passwordCallback);
+    const HRESULT hResult = inArchive->Extract(&index, 1, FALSE, extractCallback.get());
+    reloading = false;
+    COMError::CheckHRESULT(hResult);
+  }
+
+  auto currentData = std::move(reloadedData);
+  reloadedData = nullptr;
+  if (!currentData) {
+    throw COMError(E_FAIL);
+  }
+  return currentData;
+}
+
+
+winrt::com_ptr<ISequentialOutStream> ExtractedContent::BeginExtraction() {
+  if (spillFileHandle != INVALID_HANDLE_VALUE) {
+    // contents in temporary files are extracted only once
+    if (available) {
+      return nullptr;
+    }
+    auto outSpillFileStream = winrt::make_self<OutSpillFileStream>(spillFileHandle);
+    pendingStreamGetSize = outSpillFileStream.as<IStreamGetSize>();
+    return outSpillFileStream.as<ISequentialOutStream>();
+  }
+
+  // not initialized as it is overwritten by extraction
+  pendingData = std::shared_ptr<std::byte[]>(new std::byte[static_cast<std::size_t>(expectedSize)]);
+  auto outFixedMemoryStream = winrt::make_self<OutFixedMemoryStream>(pendingData.get(), static_cast<std::size_t>(expectedSize));
+  pendingStreamGetSize = outFixedMemoryStream.as<IStreamGetSize>();
+  return outFixedMemoryStream.as<ISequentialOutStream>();
+}
+
+
+void ExtractedContent::EndExtraction(bool succeeded) {
+  auto extractedData = std::move(pendingData);
+  pendingData = nullptr;
+  auto streamGetSize = std::move(pendingStreamGetSize);
+  pendingStreamGetSize = nullptr;
+
+  if (!succeeded || !streamGetSize) {
+    return;
+  }
+
+  UInt64 extractedSize = 0;
+  streamGetSize->GetSize(&extractedSize);
+
+  if (spillFileHandle != INVALID_HANDLE_VALUE) {
+    size = extractedSize;
+    available = true;
+    memoryBudget.AddSpilledBytes(extractedSize);
+    return;
+  }
+
+  // an item extracted again must have the same size
+  if (available && extractedSize != size) {
+    return;
+  }
+
+  const bool reload = available;
+  size = extractedSize;
+  available = true;
+  std::atomic_store(&data, extractedData);
+  if (reloading) {
+    reloadedData = extractedData;
+  }
+  memoryBudget.Charge(shared_from_this(), static_cast<std::size_t>(expectedSize), reload);
+}
+
+
+UInt32 ExtractedContent::Read(void* buffer, UInt64 offset, UInt32 size) {
+  const UInt64 contentSize = this->size;
+  if (size == 0 || offset >= contentSize) {
+    return 0;
+  }
+  const UInt32 readSize = static_cast<UInt32>(std::min<UInt64>(size, contentSize - offset));
+
+  if (spillFileHandle != INVALID_HANDLE_VALUE) {
+    OVERLAPPED overlapped{};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD numberOfBytesRead = 0;
+    if (!ReadFile(spillFileHandle, buffer, readSize, &numberOfBytesRead, &overlapped)) {
+      throw Win32Error();
+    }
+    return numberOfBytesRead;
+  }
+
+  const auto currentData = Acquire();
+  std::memcpy(buffer, currentData.get() + offset, readSize);
+  return readSize;
+}
+
+
+
+ExtractedContentExtractCallback::ExtractedContentExtractCallback(const std::vector<std::shared_ptr<ExtractedContent>>& contents, PasswordCallback passwordCallback, const std::atomic<bool>* ptrCancelled) :
+  indexToContentMap(),
+  passwordCallback(passwordCallback),
+  ptrCancelled(ptrCancelled),
+  processingIndex(-1),
+  extracting(false)
+{
+  for (const auto& content : contents) {
+    indexToContentMap.emplace(content->GetIndex(), content);
+  }
+}
+
+
+STDMETHODIMP ExtractedContentExtractCallback::GetStream(UInt32 index, ISequentialOutStream** outStream, Int32 askExtractMode) {
+  processingIndex = index;
+  if (!indexToContentMap.count(index)) {
+    return E_FAIL;
+  }
+  if (!outStream) {
+    return S_OK;
+  }
+  *outStream = nullptr;
+  if (askExtractMode != NArchive::NExtract::NAskMode::kExtract) {
+    return S_OK;
+  }
+  try {
+    *outStream = indexToContentMap.at(index)->BeginExtraction().detach();
+  } catch (...) {
+    return E_OUTOFMEMORY;
+  }
+  return S_OK;
+}
+
+
+STDMETHODIMP ExtractedContentExtractCallback::PrepareOperation(Int32 askExtractMode) {
+  if (!indexToContentMap.count(processingIndex)) {
+    return S_OK;
+  }
+  extracting = askExtractMode == NArchive::NExtract::NAskMode::kExtract;
+  return S_OK;
+}
+
+
+STDMETHODIMP ExtractedContentExtractCallback::SetOperationResult(Int32 opRes) {
+  if (!indexToContentMap.count(processingIndex)) {
+    return S_OK;
+  }
+  if (!extracting) {
+    return S_OK;
+  }
+  try {
+    indexToContentMap.at(processingIndex)->EndExtraction(opRes == NArchive::NExtract::NOperationResult::kOK);
+  } catch (...) {
+    return E_FAIL;
+  }
+  return S_OK;
+}
+
+
+STDMETHODIMP ExtractedContentExtractCallback::SetTotal([[maybe_unused]] UInt64 total) {
+  return S_OK;
+}
+
+
+STDMETHODIMP ExtractedContentExtractCallback::SetCompleted([[maybe_unused]] const UInt64* completeValue) {
+  if (ptrCancelled && ptrCancelled->load(std::memory_order_relaxed)) {
+    return E_ABORT;
+  }
+  return S_OK;
+}
+
+
+STDMETHODIMP ExtractedContentExtractCallback::CryptoGetTextPassword(BSTR* password) {
+  try {
+    if (!passwordCallback) {
+      return E_ABORT;
+    }
+    const auto passwordN = passwordCallback();
+    if (!passwordN) {
+      return E_ABORT;
+    }
+    *password = ::SysAllocString(passwordN.value().c_str());
+    return *password ? S_OK : E_OUTOFMEMORY;
+  } catch (...) {}
+  return E_FAIL;
+}
+
+
+
+InExtractedContentStream::InExtractedContentStream(std::shared_ptr<ExtractedContent> content) :
+  mutex(),
+  content(content),
+  seekOffset(0)
+{}
+
+
+STDMETHODIMP InExtractedContentStream::Read(void* data, UInt32 size, UInt32* processedSize) {
+  UInt64 oldSeekOffset;
+  {
+    std::lock_guard lock(mutex);
+    oldSeekOffset = seekOffset;
+  }
+  UInt32 readSize = 0;
+  try {
+    readSize = content->Read(data, oldSeekOffset, size);
+  } catch (COMError& error) {
+    return error.GetHRESULT();
+  } catch (...) {
+    return E_FAIL;
+  }
+  {
+    std::lock_guard lock(mutex);
+    seekOffset = oldSeekOffset + readSize;
+  }
+  if (processedSize) {
+    *processedSize = readSize;
+  }
+  return S_OK;
+}
+
+
+STDMETHODIMP InExtractedContentStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64* newPosition) {
+  std::lock_guard lock(mutex);
+  Int64 newOffset;
+  switch (seekOrigin) {
+    case STREAM_SEEK_SET:
+      newOffset = offset;
+      break;
+
+    case STREAM_SEEK_CUR:
+      newOffset = seekOffset + offset;
+      break;
+
+    case STREAM_SEEK_END:
+      newOffset = content->GetSize() + offset;
+      break;
+
+    default:
+      return STG_E_INVALIDFUNCTION;
+  }
+  if (newOffset < 0) {
+    return __HRESULT_FROM_WIN32(ERROR_NEGATIVE_SEEK);
+  }
+  // over seeking seems to be allowed (cf. LimitedStreams.cpp)
+  if (newPosition) {
+    *newPosition = newOffset;
+  }
+  seekOffset = static_cast<UInt64>(newOffset);
+  return S_OK;
+}
+
+
+STDMETHODIMP InExtractedContentStream::GetSize(UInt64* size) {
+  if (!size) {
+    return S_OK;
+  }
+  *size = content->GetSize();
+  return S_OK;
+}
+
+
+STDMETHODIMP InExtractedContentStream::ReadAt(UInt64 offset, void* data, UInt32 size, UInt32* processedSize) {
+  UInt32 readSize = 0;
+  try {
+    readSize = content->Read(data, offset, size);
+  } catch (COMError& error) {
+    return error.GetHRESULT();
+  } catch (...) {
+    return E_FAIL;
+  }
+  if (processedSize) {
+    *processedSize = readSize;
+  }
+  return S_OK;
+}
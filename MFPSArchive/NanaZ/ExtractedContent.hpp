@@ -0,0 +1,150 @@
+#pragma once
+
+#include <7z/CPP/Common/Common.h>
+#include <7z/CPP/7zip/IStream.h>
+#include <7z/CPP/7zip/Archive/IArchive.h>
+#include <7z/CPP/7zip/IPassword.h>
+#include <7z/CPP/7zip/IProgress.h>
+
+#include "7zGUID.hpp"
+#include "InStreamReadAt.hpp"
+#include "MemoryBudget.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Windows.h>
+#include <winrt/base.h>
+
+
+// content of an archive item extracted to memory, or to a temporary file if spill is specified
+// memory is charged to MemoryBudget, and the content is extracted again on access after being evicted
+// contents spilled to temporary files are kept until destruction
+class ExtractedContent : public MemoryBudget::Entry, public std::enable_shared_from_this<ExtractedContent> {
+public:
+  using PasswordCallback = std::function<std::optional<std::wstring>()>;
+
+private:
+  MemoryBudget& memoryBudget;
+  const winrt::com_ptr<IInArchive> inArchive;
+  // the mutex which guards inArchive and its stream
+  const std::shared_ptr<std::mutex> archiveMutex;
+  const UInt32 index;
+  const UInt64 expectedSize;
+  const PasswordCallback passwordCallback;
+
+  // serializes extractions
+  std::mutex mutex;
+  // accessed with std::atomic_load and std::atomic_store as it is reset by Evict
+  std::shared_ptr<std::byte[]> data;
+  // holds the data extracted again until Acquire picks it up, in case it is evicted immediately
+  std::shared_ptr<std::byte[]> reloadedData;
+  bool reloading;
+  HANDLE spillFileHandle;
+  std::atomic<bool> available;
+  std::atomic<UInt64> size;
+
+  // set between BeginExtraction and EndExtraction
+  std::shared_ptr<std::byte[]> pendingData;
+  winrt::com_ptr<IStreamGetSize> pendingStreamGetSize;
+
+  // contents extracted from the same archive in the order of item indices, and the position of this in it
+  std::shared_ptr<const std::vector<std::weak_ptr<ExtractedContent>>> archiveContents;
+  std::size_t archivePosition;
+
+  std::shared_ptr<std::byte[]> Acquire();
+
+protected:
+  void Evict() override;
+
+public:
+  ExtractedContent(MemoryBudget& memoryBudget, winrt::com_ptr<IInArchive> inArchive, std::shared_ptr<std::mutex> archiveMutex, UInt32 index, UInt64 expectedSize, bool spill, PasswordCallback passwordCallback = nullptr);
+  ~ExtractedContent();
+
+  ExtractedContent(const ExtractedContent&) = delete;
+  ExtractedContent& operator=(const ExtractedContent&) = delete;
+
+  // extracts contents which are not in memory in a single pass (contents in a solid block are decompressed once)
+  // all contents must belong to the same archive; failures are ignored as this is only for prefetching
+  // extraction is aborted when *ptrCancelled becomes true
+  static void Preload(const std::vector<std::shared_ptr<ExtractedContent>>& contents, const std::atomic<bool>* ptrCancelled = nullptr);
+
+  // must be called before the content is shared with other threads
+  void SetArchiveContents(std::shared_ptr<const std::vector<std::weak_ptr<ExtractedContent>>> archiveContents, std::size_t archivePosition);
+  // returns up to maxCount contents which follow this in the archive
+  std::vector<std::shared_ptr<ExtractedContent>> GetFollowingContents(std::size_t maxCount) const;
+
+  // identifies the archive the content belongs to
+  const IInArchive* GetInArchive() const;
+  UInt32 GetIndex() const;
+  // whether the first extraction has succeeded
+  bool IsAvailable() const;
+  UInt64 GetSize() const;
+  bool IsSpilled() const;
+  // whether the content can be read without extraction
+  bool IsLoaded() const;
+
+  // called by ExtractedContentExtractCallback
+  winrt::com_ptr<ISequentialOutStream> BeginExtraction();
+  void EndExtraction(bool succeeded);
+
+  // throws on failure
+  UInt32 Read(void* buffer, UInt64 offset, UInt32 size);
+};
+
+
+// extracts items into ExtractedContent objects
+class ExtractedContentExtractCallback : public winrt::implements<ExtractedContentExtractCallback, IArchiveExtractCallback, IProgress, ICryptoGetTextPassword> {
+public:
+  using PasswordCallback = ExtractedContent::PasswordCallback;
+
+private:
+  std::unordered_map<UInt32, std::shared_ptr<ExtractedContent>> indexToContentMap;
+  PasswordCallback passwordCallback;
+  const std::atomic<bool>* ptrCancelled;
+  UInt32 processingIndex;
+  bool extracting;
+
+public:
+  // extraction is aborted when *ptrCancelled becomes true
+  ExtractedContentExtractCallback(const std::vector<std::shared_ptr<ExtractedContent>>& contents, PasswordCallback passwordCallback = nullptr, const std::atomic<bool>* ptrCancelled = nullptr);
+
+  // IArchiveExtractCallback
+  STDMETHOD(GetStream)(UInt32 index, ISequentialOutStream** outStream, Int32 askExtractMode);
+  STDMETHOD(PrepareOperation)(Int32 askExtractMode);
+  STDMETHOD(SetOperationResult)(Int32 opRes);
+
+  // IProgress
+  STDMETHOD(SetTotal)(UInt64 total);
+  STDMETHOD(SetCompleted)(const UInt64* completeValue);
+
+  // ICryptoGetTextPassword
+  STDMETHOD(CryptoGetTextPassword)(BSTR* password);
+};
+
+
+class InExtractedContentStream : public winrt::implements<InExtractedContentStream, IInStream, ISequentialInStream, IStreamGetSize, IInStreamReadAt> {
+  std::mutex mutex;
+  const std::shared_ptr<ExtractedContent> content;
+  UInt64 seekOffset;
+
+public:
+  InExtractedContentStream(std::shared_ptr<ExtractedContent> content);
+
+  // IInStream
+  STDMETHOD(Read)(void* data, UInt32 size, UInt32* processedSize);
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64* newPosition);
+
+  // IStreamGetSize
+  STDMETHOD(GetSize)(UInt64 *size);
+
+  // IInStreamReadAt
+  STDMETHOD(ReadAt)(UInt64 offset, void* data, UInt32 size, UInt32* processedSize);
+};
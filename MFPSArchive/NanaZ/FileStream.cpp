@@ -108,18 +108,24 @@ STDMETHODIMP InFileStream::Read(void* data, UInt32 size, UInt32* processedSize)
   }
   static_assert(sizeof(DWORD) == sizeof(UInt32));
 #ifdef FILESTREAM_MANAGE_SEEK
-  static_assert(sizeof(LARGE_INTEGER) == sizeof(LARGE_INTEGER::QuadPart));
-  static_assert(sizeof(LARGE_INTEGER) == sizeof(Int64));
-  static_assert(sizeof(LARGE_INTEGER) == sizeof(UInt64));
+  // read at seekOffset without moving the file pointer first, so that ReadAt can be called concurrently
   std::lock_guard lock(mutex);
-  if (!SetFilePointerEx(fileHandle, util::CreateLargeInteger(seekOffset), NULL, SEEK_SET)) {
-    return HRESULT_FROM_WIN32(GetLastError());
+  OVERLAPPED overlapped{};
+  overlapped.Offset = static_cast<DWORD>(seekOffset & 0xFFFFFFFF);
+  overlapped.OffsetHigh = static_cast<DWORD>(seekOffset >> 32);
+  DWORD numberOfBytesRead = 0;
+  if (!ReadFile(fileHandle, data, size, &numberOfBytesRead, &overlapped)) {
+    if (const auto error = GetLastError(); error != ERROR_HANDLE_EOF) {
+      return HRESULT_FROM_WIN32(error);
+    }
+    numberOfBytesRead = 0;
   }
-#endif
+#else
   DWORD numberOfBytesRead = 0;
   if (!ReadFile(fileHandle, data, size, &numberOfBytesRead, NULL)) {
     return HRESULT_FROM_WIN32(GetLastError());
   }
+#endif
   if (processedSize) {
     *processedSize = numberOfBytesRead;
   }
@@ -206,3 +212,30 @@ STDMETHODIMP InFileStream::GetSize(UInt64* size) {
   }
   return S_OK;
 }
+
+
+STDMETHODIMP InFileStream::ReadAt(UInt64 offset, void* data, UInt32 size, UInt32* processedSize) {
+#ifdef FILESTREAM_MANAGE_SEEK
+  if (!util::IsValidHandle(fileHandle)) {
+    return __HRESULT_FROM_WIN32(ERROR_INVALID_HANDLE);
+  }
+  DWORD numberOfBytesRead = 0;
+  if (size != 0 && offset < fileSize) {
+    OVERLAPPED overlapped{};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    if (!ReadFile(fileHandle, data, size, &numberOfBytesRead, &overlapped)) {
+      if (const auto error = GetLastError(); error != ERROR_HANDLE_EOF) {
+        return HRESULT_FROM_WIN32(error);
+      }
+      numberOfBytesRead = 0;
+    }
+  }
+  if (processedSize) {
+    *processedSize = numberOfBytesRead;
+  }
+  return S_OK;
+#else
+  return E_NOTIMPL;
+#endif
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "7zGUID.hpp"
+#include "InStreamReadAt.hpp"
 
 #include <7z/CPP/Common/Common.h>
 #include <7z/CPP/Common/MyCom.h>
@@ -15,7 +16,7 @@
 #define FILESTREAM_MANAGE_SEEK
 
 
-class InFileStream : public winrt::implements<InFileStream, IInStream, ISequentialInStream, IStreamGetSize> {
+class InFileStream : public winrt::implements<InFileStream, IInStream, ISequentialInStream, IStreamGetSize, IInStreamReadAt> {
   bool needClose;
   HANDLE fileHandle;
   BY_HANDLE_FILE_INFORMATION byHandleFileInformation;
@@ -45,4 +46,8 @@ public:
 
   // IStreamGetSize
   STDMETHOD(GetSize)(UInt64 *size);
+
+  // IInStreamReadAt
+  // not available unless FILESTREAM_MANAGE_SEEK is defined, as ReadFile with an offset moves the file pointer
+  STDMETHOD(ReadAt)(UInt64 offset, void* data, UInt32 size, UInt32* processedSize);
 };
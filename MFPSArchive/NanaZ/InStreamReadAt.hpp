@@ -0,0 +1,15 @@
+#pragma once
+
+#include <7z/CPP/Common/Common.h>
+#include <7z/CPP/7zip/IStream.h>
+
+#include <Windows.h>
+
+
+// positional read interface implemented by streams of this project
+// ReadAt reads data at offset without using nor changing the seek position, so that it can be called concurrently without locking
+// ReadAt returns E_NOTIMPL if the stream cannot read positionally, and E_PENDING if it may become able to after being read with Seek and Read
+// in both cases use Seek and Read (with the lock for the stream) instead
+struct __declspec(uuid("{6DE456E8-266B-4E91-3000-200000000000}")) IInStreamReadAt : public IUnknown {
+  STDMETHOD(ReadAt)(UInt64 offset, void* data, UInt32 size, UInt32* processedSize) PURE;
+};
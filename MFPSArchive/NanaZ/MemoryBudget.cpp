@@ -0,0 +1,184 @@
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "MemoryBudget.hpp"
+
+
+
+MemoryBudget::Entry::~Entry() {
+  // ptrMemoryBudget is set once on the first charge and never changes
+  if (ptrMemoryBudget) {
+    ptrMemoryBudget->Discharge(*this);
+  }
+}
+
+
+
+MemoryBudget::CapacityRequest::CapacityRequest(MemoryBudget& memoryBudget, std::size_t capacity) :
+  memoryBudget(memoryBudget),
+  itr()
+{
+  memoryBudget.UpdateCapacity([this, capacity]() {
+    itr = this->memoryBudget.capacityRequests.insert(capacity);
+  });
+}
+
+
+MemoryBudget::CapacityRequest::~CapacityRequest() {
+  memoryBudget.UpdateCapacity([this]() {
+    memoryBudget.capacityRequests.erase(itr);
+  });
+}
+
+
+
+MemoryBudget::MemoryBudget(std::size_t defaultCapacity) :
+  mutex(),
+  defaultCapacity(defaultCapacity),
+  capacity(defaultCapacity),
+  capacityRequests(),
+  list(),
+  bytes(0),
+  spilledBytes(0),
+  evictions(0),
+  reloads(0)
+{}
+
+
+void MemoryBudget::Discharge(Entry& entry) {
+  std::lock_guard lock(mutex);
+
+  if (!entry.charged) {
+    return;
+  }
+  bytes -= entry.chargedSize;
+  list.erase(entry.itr);
+  entry.charged = false;
+  entry.chargedSize = 0;
+}
+
+
+// unlinks least recently used entries until the usage fits in the capacity
+// must be called with mutex locked; the returned entries are to be evicted after unlocking
+void MemoryBudget::PopExceedingEntries(std::vector<std::shared_ptr<Entry>>& victims) {
+  while (bytes > capacity && !list.empty()) {
+    auto& node = list.back();
+    node.entry->charged = false;
+    bytes -= node.entry->chargedSize;
+    node.entry->chargedSize = 0;
+    evictions++;
+    // the entry may be being destroyed
+    if (auto victim = node.weakEntry.lock()) {
+      victims.emplace_back(std::move(victim));
+    }
+    list.pop_back();
+  }
+}
+
+
+// calls updateRequests with mutex locked to change capacityRequests, then applies the largest request
+void MemoryBudget::UpdateCapacity(const std::function<void()>& updateRequests) {
+  std::vector<std::shared_ptr<Entry>> victims;
+  {
+    std::lock_guard lock(mutex);
+
+    updateRequests();
+    capacity = capacityRequests.empty() ? defaultCapacity : *capacityRequests.rbegin();
+    PopExceedingEntries(victims);
+  }
+
+  // evict outside the lock as entries may wait for another one being loaded
+  for (const auto& victim : victims) {
+    victim->Evict();
+  }
+}
+
+
+std::size_t MemoryBudget::GetDefaultCapacity() const {
+  return defaultCapacity;
+}
+
+
+std::size_t MemoryBudget::GetCapacity() const {
+  std::lock_guard lock(mutex);
+
+  return capacity;
+}
+
+
+void MemoryBudget::Charge(const std::shared_ptr<Entry>& entry, std::size_t size, bool reload) {
+  std::vector<std::shared_ptr<Entry>> victims;
+  {
+    std::lock_guard lock(mutex);
+
+    if (reload) {
+      reloads++;
+    }
+
+    if (entry->charged) {
+      bytes -= entry->chargedSize;
+      list.erase(entry->itr);
+    }
+    list.push_front(Entry::Node{
+      entry.get(),
+      entry,
+    });
+    entry->ptrMemoryBudget = this;
+    entry->itr = list.begin();
+    entry->charged = true;
+    entry->chargedSize = size;
+    bytes += size;
+
+    PopExceedingEntries(victims);
+  }
+
+  // evict outside the lock as entries may wait for another one being loaded
+  for (const auto& victim : victims) {
+    victim->Evict();
+  }
+}
+
+
+void MemoryBudget::Touch(Entry& entry) {
+  std::lock_guard lock(mutex);
+
+  if (!entry.charged) {
+    return;
+  }
+  list.splice(list.begin(), list, entry.itr);
+}
+
+
+void MemoryBudget::AddSpilledBytes(std::uint64_t size) {
+  std::lock_guard lock(mutex);
+
+  spilledBytes += size;
+}
+
+
+void MemoryBudget::RemoveSpilledBytes(std::uint64_t size) {
+  std::lock_guard lock(mutex);
+
+  spilledBytes -= size;
+}
+
+
+MemoryBudget::Statistics MemoryBudget::GetStatistics() const {
+  std::lock_guard lock(mutex);
+
+  return Statistics{
+    capacity,
+    list.size(),
+    bytes,
+    spilledBytes,
+    evictions,
+    reloads,
+  };
+}
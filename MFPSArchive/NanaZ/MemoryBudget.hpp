@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+
+struct MemoryBudgetStatistics {
+  std::size_t capacity;
+  std::size_t entries;
+  std::size_t bytes;
+  std::uint64_t spilledBytes;
+  std::uint64_t evictions;
+  std::uint64_t reloads;
+};
+
+
+// budget of memory for contents extracted from archives, shared by all mounts
+// when the total size of charged entries exceeds the capacity, least recently used ones are evicted
+// the capacity is the largest one requested by the live CapacityRequests, or the default capacity while there is none
+class MemoryBudget {
+public:
+  using Statistics = MemoryBudgetStatistics;
+
+  // requests capacity of the budget during its lifetime
+  class CapacityRequest {
+    MemoryBudget& memoryBudget;
+    std::multiset<std::size_t>::iterator itr;
+
+  public:
+    CapacityRequest(MemoryBudget& memoryBudget, std::size_t capacity);
+    ~CapacityRequest();
+
+    CapacityRequest(const CapacityRequest&) = delete;
+    CapacityRequest& operator=(const CapacityRequest&) = delete;
+  };
+
+  class Entry {
+    friend class MemoryBudget;
+
+    struct Node {
+      Entry* entry;
+      std::weak_ptr<Entry> weakEntry;
+    };
+
+    // guarded by MemoryBudget::mutex
+    MemoryBudget* ptrMemoryBudget = nullptr;
+    bool charged = false;
+    std::size_t chargedSize = 0;
+    std::list<Node>::iterator itr;
+
+  public:
+    virtual ~Entry();
+
+  protected:
+    // releases the memory of the entry
+    // called without the lock of MemoryBudget held, so this may race with loading the entry again
+    virtual void Evict() = 0;
+  };
+
+private:
+  mutable std::mutex mutex;
+  const std::size_t defaultCapacity;
+  std::size_t capacity;
+  std::multiset<std::size_t> capacityRequests;
+  std::list<Entry::Node> list;
+  std::size_t bytes;
+  std::uint64_t spilledBytes;
+  std::uint64_t evictions;
+  std::uint64_t reloads;
+
+  void Discharge(Entry& entry);
+  void PopExceedingEntries(std::vector<std::shared_ptr<Entry>>& victims);
+  // evicts entries if the new capacity is smaller than the current usage
+  void UpdateCapacity(const std::function<void()>& updateRequests);
+
+public:
+  explicit MemoryBudget(std::size_t defaultCapacity);
+
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+  std::size_t GetDefaultCapacity() const;
+  std::size_t GetCapacity() const;
+
+  // charges size bytes for entry (replacing its previous charge) and marks it as most recently used
+  // entries, possibly including entry itself, are evicted until the usage fits in the capacity
+  // reload is only for statistics; pass true if the entry has been evicted and loaded again
+  void Charge(const std::shared_ptr<Entry>& entry, std::size_t size, bool reload);
+  // marks entry as most recently used
+  void Touch(Entry& entry);
+
+  // contents spilled to temporary files are not charged but counted for statistics
+  void AddSpilledBytes(std::uint64_t size);
+  void RemoveSpilledBytes(std::uint64_t size);
+
+  Statistics GetStatistics() const;
+};
@@ -91,6 +91,20 @@ STDMETHODIMP InMemoryStream::GetSize(UInt64* size) {
 }
 
 
+STDMETHODIMP InMemoryStream::ReadAt(UInt64 offset, void* data, UInt32 size, UInt32* processedSize) {
+  // data is never modified, so no lock is needed
+  UInt32 readSize = 0;
+  if (size != 0 && offset < dataSize) {
+    readSize = static_cast<UInt32>(std::min<UInt64>(size, dataSize - offset));
+    std::memcpy(data, this->data + offset, readSize);
+  }
+  if (processedSize) {
+    *processedSize = readSize;
+  }
+  return S_OK;
+}
+
+
 
 OutFixedMemoryStream::OutFixedMemoryStream(std::byte* data, std::size_t maxDataSize) :
   mutex(),
@@ -4,6 +4,7 @@
 #include <7z/CPP/7zip/IStream.h>
 
 #include "7zGUID.hpp"
+#include "InStreamReadAt.hpp"
 
 #include <cstddef>
 #include <mutex>
@@ -12,7 +13,7 @@
 #include <winrt/base.h>
 
 
-class InMemoryStream : public winrt::implements<InMemoryStream, IInStream, ISequentialInStream, IStreamGetSize> {
+class InMemoryStream : public winrt::implements<InMemoryStream, IInStream, ISequentialInStream, IStreamGetSize, IInStreamReadAt> {
   std::mutex mutex;
   std::byte* data;
   std::size_t dataSize;
@@ -27,6 +28,9 @@ public:
 
   // IStreamGetSize
   STDMETHOD(GetSize)(UInt64 *size);
+
+  // IInStreamReadAt
+  STDMETHOD(ReadAt)(UInt64 offset, void* data, UInt32 size, UInt32* processedSize);
 };
 
 
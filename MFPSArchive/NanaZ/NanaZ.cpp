@@ -8,6 +8,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <memory>
 #include <numeric>
 #include <optional>
 #include <stdexcept>
@@ -179,7 +180,8 @@ std::vector<std::size_t> NanaZ::FormatStore::FindFormatByStream(winrt::com_ptr<I
   COMError::CheckHRESULT(inStream->Seek(0, STREAM_SEEK_SET, nullptr));
 
   std::size_t bufferSize = std::max(DefaultBufferSize, maxSignatureSize);
-  auto buffer = std::make_unique<std::byte[]>(bufferSize);
+  // not zero-filled; this runs for every item of an archive with "recursive", and only the bytes read are examined
+  std::unique_ptr<std::byte[]> buffer(new std::byte[bufferSize]);
 
   UInt32 readSize = 0;
   COMError::CheckHRESULT(inStream->Read(buffer.get(), static_cast<UInt32>(bufferSize), &readSize));
@@ -203,7 +205,7 @@ std::vector<std::size_t> NanaZ::FormatStore::FindFormatByStream(winrt::com_ptr<I
     // check format by signature
     std::size_t signatureOffset = format.signatureOffset.value_or(0);
     for (const auto& signature : format.signatures) {
-      if (signature.size() + signatureOffset > bufferSize) {
+      if (signature.size() + signatureOffset > readSize) {
         continue;
       }
       if (std::memcmp(signature.data(), buffer.get() + signatureOffset, signature.size()) == 0) {
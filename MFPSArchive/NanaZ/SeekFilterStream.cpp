@@ -1,7 +1,14 @@
+#define NOMINMAX
+
 #include <dokan/dokan.h>
 
 #include <7z/CPP/Common/Common.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
 #include <mutex>
 
 #include <Windows.h>
@@ -12,10 +19,15 @@
 
 
 
-InSeekFilterStream::InSeekFilterStream(winrt::com_ptr<IInStream> inStream, winrt::com_ptr<IInStream> baseInStream) :
+InSeekFilterStream::InSeekFilterStream(winrt::com_ptr<IInStream> inStream, winrt::com_ptr<IInStream> baseInStream, bool storedContiguously) :
   inStream(inStream),
   baseInStream(baseInStream),
-  baseInStreamSeekOffset(0)
+  baseInStreamSeekOffset(0),
+  baseInStreamReadAt(storedContiguously ? baseInStream.try_as<IInStreamReadAt>() : nullptr),
+  positionalState(baseInStreamReadAt ? PositionalState::Learning : PositionalState::Unavailable),
+  positionalOffset(0),
+  positionalSize(0),
+  verifications(0)
 {
   auto baseInSeekFilterStream = baseInStream.try_as<InSeekFilterStreamInternal::IInSeekFilterStream>();
   if (baseInSeekFilterStream) {
@@ -28,10 +40,55 @@ InSeekFilterStream::InSeekFilterStream(winrt::com_ptr<IInStream> inStream, winrt
 
 
 InSeekFilterStream::InSeekFilterStream(winrt::com_ptr<IInStream> inStream) :
-  InSeekFilterStream(inStream, inStream)
+  InSeekFilterStream(inStream, inStream, true)
 {}
 
 
+// compares data read from inStream at position with the data of baseInStream to find where inStream is stored in baseInStream
+// basePosition is the position of baseInStream after the read, which is the end of the read range for stored contents
+// must be called with mutex locked
+void InSeekFilterStream::LearnPosition(UInt64 position, const void* data, UInt32 size, UInt64 basePosition) {
+  if (size < MinVerificationSize) {
+    return;
+  }
+  if (basePosition < position + size) {
+    positionalState = PositionalState::Unavailable;
+    return;
+  }
+  const UInt64 offset = basePosition - position - size;
+  if (verifications != 0 && offset != positionalOffset) {
+    positionalState = PositionalState::Unavailable;
+    return;
+  }
+
+  auto buffer = std::make_unique<std::byte[]>(size);
+  UInt32 readSize = 0;
+  const auto hResult = baseInStreamReadAt->ReadAt(offset + position, buffer.get(), size, &readSize);
+  if (hResult == E_PENDING) {
+    // baseInStream may become able to read positionally later
+    return;
+  }
+  if (FAILED(hResult) || readSize != size || std::memcmp(buffer.get(), data, size) != 0) {
+    positionalState = PositionalState::Unavailable;
+    return;
+  }
+  positionalOffset = offset;
+  if (++verifications < VerificationsRequired) {
+    return;
+  }
+
+  // seeking a stream of a stored content does not touch baseInStream
+  UInt64 streamSize = 0;
+  UInt64 newPosition = -1;
+  if (FAILED(inStream->Seek(0, STREAM_SEEK_END, &streamSize)) || FAILED(inStream->Seek(position + size, STREAM_SEEK_SET, &newPosition)) || newPosition != position + size) {
+    positionalState = PositionalState::Unavailable;
+    return;
+  }
+  positionalSize = streamSize;
+  positionalState.store(PositionalState::Positional, std::memory_order_release);
+}
+
+
 STDMETHODIMP InSeekFilterStream::Read(void* data, UInt32 size, UInt32* processedSize) {
   std::lock_guard lock(mutex);
   UInt64 newSeekOffset = -1;
@@ -41,13 +98,27 @@ STDMETHODIMP InSeekFilterStream::Read(void* data, UInt32 size, UInt32* processed
   if (newSeekOffset != baseInStreamSeekOffset) {
     return E_FAIL;
   }
-  if (const auto hResult = inStream->Read(data, size, processedSize); FAILED(hResult)) {
+  const bool learning = positionalState.load(std::memory_order_relaxed) == PositionalState::Learning;
+  UInt64 position = 0;
+  if (learning) {
+    if (const auto hResult = inStream->Seek(0, STREAM_SEEK_CUR, &position); FAILED(hResult)) {
+      return hResult;
+    }
+  }
+  UInt32 readSize = 0;
+  if (const auto hResult = inStream->Read(data, size, &readSize); FAILED(hResult)) {
     return hResult;
   }
+  if (processedSize) {
+    *processedSize = readSize;
+  }
   if (const auto hResult = baseInStream->Seek(0, STREAM_SEEK_CUR, &newSeekOffset); FAILED(hResult)) {
     return hResult;
   }
   baseInStreamSeekOffset = newSeekOffset;
+  if (learning) {
+    LearnPosition(position, data, readSize, newSeekOffset);
+  }
   return S_OK;
 }
 
@@ -75,6 +146,30 @@ STDMETHODIMP InSeekFilterStream::Seek(Int64 offset, UInt32 seekOrigin, UInt64* n
 }
 
 
+STDMETHODIMP InSeekFilterStream::ReadAt(UInt64 offset, void* data, UInt32 size, UInt32* processedSize) {
+  switch (positionalState.load(std::memory_order_acquire)) {
+    case PositionalState::Learning:
+      return E_PENDING;
+
+    case PositionalState::Unavailable:
+      return E_NOTIMPL;
+
+    default:
+      break;
+  }
+  UInt32 readSize = 0;
+  if (size != 0 && offset < positionalSize) {
+    if (const auto hResult = baseInStreamReadAt->ReadAt(positionalOffset + offset, data, static_cast<UInt32>(std::min<UInt64>(size, positionalSize - offset)), &readSize); FAILED(hResult)) {
+      return hResult;
+    }
+  }
+  if (processedSize) {
+    *processedSize = readSize;
+  }
+  return S_OK;
+}
+
+
 STDMETHODIMP InSeekFilterStream::GetBaseStream(IInStream** outBaseInStream) {
   if (!outBaseInStream) {
     return S_OK;
@@ -4,7 +4,9 @@
 #include <7z/CPP/7zip/IStream.h>
 
 #include "7zGUID.hpp"
+#include "InStreamReadAt.hpp"
 
+#include <atomic>
 #include <mutex>
 
 #include <Windows.h>
@@ -21,20 +23,46 @@ namespace InSeekFilterStreamInternal {
 // InSeekFilterStream is a wrapper class for IInStream which uses another (shared) IInStream
 // this class restores seek position of the base IInStream before calling operations of target IInStream
 // typical usage: wrap IInStream retrieved from IInArchiveGetStream (in this case, use IInStream used for IInArchive for baseInStream)
-class InSeekFilterStream : public winrt::implements<InSeekFilterStream, IInStream, ISequentialInStream, InSeekFilterStreamInternal::IInSeekFilterStream> {
+// if the target IInStream turns out to read a stored (uncompressed) range of baseInStream, reads are served by IInStreamReadAt of baseInStream without seeking
+// this is only tried for items which the archive handler reports as stored in a single range (storedContiguously), as data of a fragmented or transformed item can match baseInStream by chance
+class InSeekFilterStream : public winrt::implements<InSeekFilterStream, IInStream, ISequentialInStream, IInStreamReadAt, InSeekFilterStreamInternal::IInSeekFilterStream> {
+  enum class PositionalState {
+    Learning,
+    Positional,
+    Unavailable,
+  };
+
+  // the range is regarded as stored after this number of reads are verified with the data of baseInStream
+  static constexpr unsigned VerificationsRequired = 2;
+  // smaller reads are not verified as they may match by chance
+  static constexpr UInt32 MinVerificationSize = 4096;
+
   std::mutex mutex;
   winrt::com_ptr<IInStream> inStream;
   winrt::com_ptr<IInStream> baseInStream;
   UInt64 baseInStreamSeekOffset;
 
+  winrt::com_ptr<IInStreamReadAt> baseInStreamReadAt;
+  std::atomic<PositionalState> positionalState;
+  // guarded by mutex while learning, and constant once positionalState becomes Positional
+  UInt64 positionalOffset;
+  UInt64 positionalSize;
+  unsigned verifications;
+
+  void LearnPosition(UInt64 position, const void* data, UInt32 size, UInt64 basePosition);
+
 public:
-  InSeekFilterStream(winrt::com_ptr<IInStream> inStream, winrt::com_ptr<IInStream> baseInStream);
+  InSeekFilterStream(winrt::com_ptr<IInStream> inStream, winrt::com_ptr<IInStream> baseInStream, bool storedContiguously);
+  // wraps inStream only to separate seek positions; positional reads are available if they are for inStream
   InSeekFilterStream(winrt::com_ptr<IInStream> inStream);
 
   // IInStream
   STDMETHOD(Read)(void* data, UInt32 size, UInt32* processedSize);
   STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64* newPosition);
 
+  // IInStreamReadAt
+  STDMETHOD(ReadAt)(UInt64 offset, void* data, UInt32 size, UInt32* processedSize);
+
   // IInSeekFilterStream
   STDMETHOD(GetBaseStream)(IInStream** outBaseInStream);
 };
@@ -0,0 +1,184 @@
+#define NOMINMAX
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Prefetcher.hpp"
+#include "NanaZ/ExtractedContent.hpp"
+#include "NanaZ/MemoryBudget.hpp"
+
+
+
+namespace {
+  // the prediction is widened up to depth << MaxSequentialShift while contents are accessed in the order of the archive
+  constexpr std::size_t MaxSequentialShift = 3;
+
+  // contents predicted on each access are limited to 1 / BudgetFraction of the memory budget so that they do not evict each other
+  constexpr std::size_t BudgetFraction = 4;
+
+  constexpr std::size_t QueuedTasksPerThread = 4;
+}
+
+
+
+Prefetcher::Prefetcher(MemoryBudget& memoryBudget, std::size_t concurrency, std::size_t depth) :
+  memoryBudget(memoryBudget),
+  depth(depth),
+  maxDepth(depth << MaxSequentialShift),
+  maxQueuedTasks(concurrency * QueuedTasksPerThread),
+  mutex(),
+  condition(),
+  queue(),
+  lastContent(),
+  sequentialCount(0),
+  cancelled(false),
+  threads()
+{
+  try {
+    for (std::size_t i = 0; i < concurrency; i++) {
+      threads.emplace_back(&Prefetcher::Worker, this);
+    }
+  } catch (...) {
+    Cancel();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    throw;
+  }
+}
+
+
+Prefetcher::~Prefetcher() {
+  Cancel();
+  for (auto& thread : threads) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+}
+
+
+void Prefetcher::Worker() {
+  while (true) {
+    std::vector<ContentPtr> contents;
+    {
+      std::unique_lock lock(mutex);
+      condition.wait(lock, [this]() {
+        return cancelled.load() || !queue.empty();
+      });
+      if (cancelled) {
+        return;
+      }
+      contents = std::move(queue.front());
+      queue.pop_front();
+    }
+
+    try {
+      ExtractedContent::Preload(contents, &cancelled);
+    } catch (...) {}
+  }
+}
+
+
+std::size_t Prefetcher::GetMaxDepth() const {
+  return maxDepth;
+}
+
+
+void Prefetcher::Cancel() {
+  {
+    std::lock_guard lock(mutex);
+
+    cancelled = true;
+    queue.clear();
+  }
+  condition.notify_all();
+}
+
+
+void Prefetcher::OnAccess(const ContentPtr& content, const std::vector<ContentPtr>& siblings) {
+  if (!content || threads.empty() || depth == 0) {
+    return;
+  }
+
+  std::size_t currentDepth;
+  {
+    std::lock_guard lock(mutex);
+
+    if (cancelled) {
+      return;
+    }
+
+    // successive accesses which go forward in the same archive are regarded as sequential
+    const auto previousContent = lastContent.lock();
+    if (previousContent != content) {
+      const std::size_t previousDepth = std::min(depth << sequentialCount, maxDepth);
+      const bool sequential = previousContent && previousContent->GetInArchive() == content->GetInArchive() && previousContent->GetIndex() < content->GetIndex() && content->GetIndex() - previousContent->GetIndex() <= previousDepth;
+      sequentialCount = sequential ? std::min(sequentialCount + 1, MaxSequentialShift) : 0;
+      lastContent = content;
+    }
+    currentDepth = std::min(depth << sequentialCount, maxDepth);
+  }
+
+  // contents following in the archive come first as they are cheap to extract along with the accessed one
+  std::vector<ContentPtr> candidates = content->GetFollowingContents(currentDepth);
+  candidates.insert(candidates.end(), siblings.begin(), siblings.begin() + std::min(siblings.size(), currentDepth));
+
+  const std::size_t maxBytes = memoryBudget.GetCapacity() / BudgetFraction;
+
+  std::unordered_set<const ExtractedContent*> visited{content.get()};
+  std::vector<std::vector<ContentPtr>> tasks;
+  std::size_t totalBytes = 0;
+  for (const auto& candidate : candidates) {
+    if (!visited.emplace(candidate.get()).second) {
+      continue;
+    }
+    if (!candidate->IsAvailable() || candidate->IsLoaded()) {
+      continue;
+    }
+    const auto size = candidate->GetSize();
+    if (size > maxBytes - totalBytes) {
+      break;
+    }
+    totalBytes += static_cast<std::size_t>(size);
+
+    // a task extracts contents of a single archive
+    auto itrTask = std::find_if(tasks.begin(), tasks.end(), [&candidate](const std::vector<ContentPtr>& task) {
+      return task.front()->GetInArchive() == candidate->GetInArchive();
+    });
+    if (itrTask == tasks.end()) {
+      tasks.emplace_back();
+      itrTask = std::prev(tasks.end());
+    }
+    itrTask->emplace_back(candidate);
+  }
+
+  if (tasks.empty()) {
+    return;
+  }
+
+  {
+    std::lock_guard lock(mutex);
+
+    if (cancelled) {
+      return;
+    }
+
+    for (auto& task : tasks) {
+      queue.emplace_back(std::move(task));
+    }
+    // old predictions are discarded first
+    while (queue.size() > maxQueuedTasks) {
+      queue.pop_front();
+    }
+  }
+  condition.notify_all();
+}
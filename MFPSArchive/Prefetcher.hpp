@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "NanaZ/ExtractedContent.hpp"
+#include "NanaZ/MemoryBudget.hpp"
+
+
+// extracts contents which are likely to be read next into the memory budget in background threads
+// predictions are made on each access from
+// - contents which follow the accessed one in the archive (they are in the same solid block if any)
+// - files which follow the accessed one in the same directory, in name order
+// - recent accesses; the prediction is widened while contents are accessed in the order of the archive
+class Prefetcher {
+public:
+  using ContentPtr = std::shared_ptr<ExtractedContent>;
+
+private:
+  MemoryBudget& memoryBudget;
+  const std::size_t depth;
+  const std::size_t maxDepth;
+  const std::size_t maxQueuedTasks;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  // each task is a list of contents of the same archive
+  std::deque<std::vector<ContentPtr>> queue;
+  std::weak_ptr<ExtractedContent> lastContent;
+  std::size_t sequentialCount;
+  std::atomic<bool> cancelled;
+  std::vector<std::thread> threads;
+
+  void Worker();
+
+public:
+  // concurrency is the number of threads; depth is the number of contents predicted on each access
+  Prefetcher(MemoryBudget& memoryBudget, std::size_t concurrency, std::size_t depth);
+  // cancels the prefetching and waits for the threads
+  ~Prefetcher();
+
+  Prefetcher(const Prefetcher&) = delete;
+  Prefetcher& operator=(const Prefetcher&) = delete;
+
+  // returns the maximum number of siblings used for a prediction
+  std::size_t GetMaxDepth() const;
+
+  // aborts the running extractions and discards the queued ones; no more tasks are accepted
+  void Cancel();
+
+  // siblings are contents of files which follow the accessed one in the same directory, in name order
+  void OnAccess(const ContentPtr& content, const std::vector<ContentPtr>& siblings);
+};
@@ -0,0 +1,133 @@
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AudioSource.hpp"
+
+
+
+namespace {
+  constexpr std::uint32_t GetChannelMaskBit(AudioSource::ChannelInfo channelInfo) {
+    switch (channelInfo) {
+      case AudioSource::ChannelInfo::Left:
+        return 0x0001;    // SPEAKER_FRONT_LEFT
+
+      case AudioSource::ChannelInfo::Right:
+        return 0x0002;    // SPEAKER_FRONT_RIGHT
+
+      case AudioSource::ChannelInfo::Center:
+        return 0x0004;    // SPEAKER_FRONT_CENTER
+
+      case AudioSource::ChannelInfo::LowFrequency:
+        return 0x0008;    // SPEAKER_LOW_FREQUENCY
+
+      case AudioSource::ChannelInfo::BackLeft:
+        return 0x0010;    // SPEAKER_BACK_LEFT
+
+      case AudioSource::ChannelInfo::BackRight:
+        return 0x0020;    // SPEAKER_BACK_RIGHT
+
+      case AudioSource::ChannelInfo::BackCenter:
+        return 0x0100;    // SPEAKER_BACK_CENTER
+
+      case AudioSource::ChannelInfo::SideLeft:
+        return 0x0200;    // SPEAKER_SIDE_LEFT
+
+      case AudioSource::ChannelInfo::SideRight:
+        return 0x0400;    // SPEAKER_SIDE_RIGHT
+
+      case AudioSource::ChannelInfo::None:
+      case AudioSource::ChannelInfo::Other:
+        return 0;
+    }
+    return 0;
+  }
+
+
+  constexpr AudioSource::ChannelInfo ChannelInfoList[] = {
+    AudioSource::ChannelInfo::Left,
+    AudioSource::ChannelInfo::Right,
+    AudioSource::ChannelInfo::Center,
+    AudioSource::ChannelInfo::LowFrequency,
+    AudioSource::ChannelInfo::BackLeft,
+    AudioSource::ChannelInfo::BackRight,
+    AudioSource::ChannelInfo::BackCenter,
+    AudioSource::ChannelInfo::SideLeft,
+    AudioSource::ChannelInfo::SideRight,
+  };
+}
+
+
+
+std::size_t AudioSource::GetBytesPerSample(DataType dataType) {
+  switch (dataType) {
+    case DataType::UInt8:
+      return 1;
+
+    case DataType::Int16:
+      return 2;
+
+    case DataType::Int24:
+      return 3;
+
+    case DataType::Int32:
+      return 4;
+
+    case DataType::Other:
+      return 0;
+  }
+  return 0;
+}
+
+
+AudioSource::DataType AudioSource::GetDataTypeFromBytesPerSample(std::size_t bytesPerSample) {
+  switch (bytesPerSample) {
+    case 1:
+      return DataType::UInt8;
+
+    case 2:
+      return DataType::Int16;
+
+    case 3:
+      return DataType::Int24;
+
+    case 4:
+      return DataType::Int32;
+  }
+  return DataType::Other;
+}
+
+
+std::vector<AudioSource::ChannelInfo> AudioSource::GetChannelInfoFromMask(std::uint32_t channelMask, std::size_t numChannels) {
+  // channels are assigned to the bits of the mask in ascending order
+  std::vector<ChannelInfo> channelInfo(numChannels, ChannelInfo::Other);
+  std::size_t channelIndex = 0;
+  for (const auto& currentChannelInfo : ChannelInfoList) {
+    if (channelIndex >= numChannels) {
+      break;
+    }
+    if (channelMask & GetChannelMaskBit(currentChannelInfo)) {
+      channelInfo[channelIndex++] = currentChannelInfo;
+    }
+  }
+  return channelInfo;
+}
+
+
+std::size_t AudioSource::GetBlockSize() const {
+  return GetBytesPerSample(GetDataType()) * GetChannels();
+}
+
+
+std::uint32_t AudioSource::GetChannelMask() const {
+  std::uint32_t channelMask = 0;
+  for (std::size_t channelIndex = 0; channelIndex < GetChannels(); channelIndex++) {
+    const auto bit = GetChannelMaskBit(GetChannelInfo(channelIndex));
+    // the order of channels must follow the order of bits
+    if (!bit || bit <= channelMask) {
+      return 0;
+    }
+    channelMask |= bit;
+  }
+  return channelMask;
+}
@@ -1,24 +1,47 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 #include "Source.hpp"
 
 
 class AudioSource : public Source {
 public:
+  // speaker positions are declared in the order of WAVE_FORMAT_EXTENSIBLE's channel mask bits
   enum class ChannelInfo {
     None,
     Other,
     Left,
     Right,
+    Center,
+    LowFrequency,
+    BackLeft,
+    BackRight,
+    BackCenter,
+    SideLeft,
+    SideRight,
   };
 
+  // samples are little endian; integers narrower than the type are left-justified as in WAV
   enum class DataType {
     Other,
     Int16,
+    UInt8,
+    Int24,
+    Int32,
   };
 
+  // returns 0 for DataType::Other
+  static std::size_t GetBytesPerSample(DataType dataType);
+  // returns DataType::Other for unsupported sizes
+  static DataType GetDataTypeFromBytesPerSample(std::size_t bytesPerSample);
+  // returns the channel layout specified by dwChannelMask of WAVE_FORMAT_EXTENSIBLE
+  // channels which are not specified in the mask are ChannelInfo::Other
+  static std::vector<ChannelInfo> GetChannelInfoFromMask(std::uint32_t channelMask, std::size_t numChannels);
+
   virtual ~AudioSource() = default;
 
   virtual bool IsCompressed() const = 0;
@@ -26,4 +49,9 @@ public:
   virtual ChannelInfo GetChannelInfo(std::size_t channelIndex) const = 0;
   virtual DataType GetDataType() const = 0;
   virtual std::uint_fast32_t GetSamplingRate() const = 0;
+
+  // returns the size of a sample of all channels in bytes, or 0 for DataType::Other
+  std::size_t GetBlockSize() const;
+  // returns dwChannelMask of WAVE_FORMAT_EXTENSIBLE, or 0 if the channel layout cannot be represented by a mask
+  std::uint32_t GetChannelMask() const;
 };
@@ -1,6 +1,10 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <stdexcept>
 #include <utility>
+#include <vector>
 
 #include "AudioSourceToSourceWAV.hpp"
 #include "GenerateTagID3.hpp"
@@ -20,7 +24,8 @@ AudioSourceToSourceWAV::AudioSourceToSourceWAV(std::shared_ptr<AudioSource> audi
   preambleFmt:
   00: fmt  [SIZE]
   08: [format data (16 bytes)]
-  18:::::
+  18: [extension for WAVE_FORMAT_EXTENSIBLE (24 bytes)]
+  30:::::
 
   preambleData:
   00: data [SIZE]
@@ -33,15 +38,19 @@ AudioSourceToSourceWAV::AudioSourceToSourceWAV(std::shared_ptr<AudioSource> audi
     /* 0C  */
   };
 
-  char preambleDataFmt[0x18] = {
-    /* 00  */ 'f', 'm', 't', ' ', 0x10, 0x00, 0x00, 0x00,
-    /* 08  */ 0x01, 0x00,
+  char preambleDataFmt[0x30] = {
+    /* 00# */ 'f', 'm', 't', ' ', 0x10, 0x00, 0x00, 0x00,
+    /* 08# */ 0x01, 0x00,
     /* 0A# */ 0x00, 0x00,
     /* 0C# */ 0x00, 0x00, 0x00, 0x00,
     /* 10# */ 0x00, 0x00, 0x00, 0x00,
     /* 14# */ 0x00, 0x00,
     /* 16# */ 0x00, 0x00,
-    /* 18  */
+    /* 18  */ 0x16, 0x00,
+    /* 1A# */ 0x00, 0x00,
+    /* 1C# */ 0x00, 0x00, 0x00, 0x00,
+    /* 20  */ 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, '\x80', 0x00, 0x00, '\xAA', 0x00, 0x38, '\x9B', 0x71,    // KSDATAFORMAT_SUBTYPE_PCM
+    /* 30  */
   };
 
   char preambleDataData[0x08] = {
@@ -63,23 +72,33 @@ AudioSourceToSourceWAV::AudioSourceToSourceWAV(std::shared_ptr<AudioSource> audi
     } catch (...) {}
   }
 
-  const std::size_t mergedPreambleDataSize = sizeof(preambleDataRiffWave) + sizeof(preambleDataFmt) + preambleDataRiffTag.size() + preambleDataId3Tag.size() + sizeof(preambleDataData);
+  const auto bytesPerSample = AudioSource::GetBytesPerSample(audioSource->GetDataType());
+  if (!bytesPerSample) {
+    throw std::runtime_error("unsupported DataType");
+  }
+  const auto bits = bytesPerSample * 8;
+  const auto numChannels = audioSource->GetChannels();
+
+  // WAVE_FORMAT_EXTENSIBLE is required for more than 2 channels or more than 16 bits per sample
+  const bool extensible = numChannels > 2 || bits > 16;
+  const std::size_t preambleDataFmtSize = extensible ? 0x30 : 0x18;
+
+  const std::size_t mergedPreambleDataSize = sizeof(preambleDataRiffWave) + preambleDataFmtSize + preambleDataRiffTag.size() + preambleDataId3Tag.size() + sizeof(preambleDataData);
 
   const SourceSize audioDataSize = audioSource->GetSize();
   const SourceSize totalSourceSize = mergedPreambleDataSize + audioDataSize;
 
-  constexpr auto Bits = 16;
-  if (audioSource->GetDataType() != AudioSource::DataType::Int16) {
-    throw std::runtime_error("unsupported DataType");
-  }
-
   *reinterpret_cast<std::uint32_t*>(preambleDataRiffWave + 0x04) = static_cast<std::uint32_t>(totalSourceSize - 8);
 
-  *reinterpret_cast<std::uint16_t*>(preambleDataFmt + 0x0A) = static_cast<std::uint16_t>(audioSource->GetChannels());
+  *reinterpret_cast<std::uint32_t*>(preambleDataFmt + 0x04) = static_cast<std::uint32_t>(preambleDataFmtSize - 8);
+  *reinterpret_cast<std::uint16_t*>(preambleDataFmt + 0x08) = static_cast<std::uint16_t>(extensible ? 0xFFFE : 0x0001);
+  *reinterpret_cast<std::uint16_t*>(preambleDataFmt + 0x0A) = static_cast<std::uint16_t>(numChannels);
   *reinterpret_cast<std::uint32_t*>(preambleDataFmt + 0x0C) = static_cast<std::uint32_t>(audioSource->GetSamplingRate());
-  *reinterpret_cast<std::uint32_t*>(preambleDataFmt + 0x10) = static_cast<std::uint32_t>(audioSource->GetSamplingRate() * Bits * audioSource->GetChannels() / 8);
-  *reinterpret_cast<std::uint16_t*>(preambleDataFmt + 0x14) = static_cast<std::uint16_t>(audioSource->GetChannels() * Bits / 8);
-  *reinterpret_cast<std::uint16_t*>(preambleDataFmt + 0x16) = static_cast<std::uint16_t>(Bits);
+  *reinterpret_cast<std::uint32_t*>(preambleDataFmt + 0x10) = static_cast<std::uint32_t>(audioSource->GetSamplingRate() * bits * numChannels / 8);
+  *reinterpret_cast<std::uint16_t*>(preambleDataFmt + 0x14) = static_cast<std::uint16_t>(numChannels * bits / 8);
+  *reinterpret_cast<std::uint16_t*>(preambleDataFmt + 0x16) = static_cast<std::uint16_t>(bits);
+  *reinterpret_cast<std::uint16_t*>(preambleDataFmt + 0x1A) = static_cast<std::uint16_t>(bits);
+  *reinterpret_cast<std::uint32_t*>(preambleDataFmt + 0x1C) = audioSource->GetChannelMask();
 
   *reinterpret_cast<std::uint32_t*>(preambleDataData + 0x04) = static_cast<std::uint32_t>(audioDataSize);
 
@@ -91,8 +110,8 @@ AudioSourceToSourceWAV::AudioSourceToSourceWAV(std::shared_ptr<AudioSource> audi
   ptr += preambleDataRiffTag.size();
   std::memcpy(ptr, preambleDataId3Tag.data(), preambleDataId3Tag.size());
   ptr += preambleDataId3Tag.size();
-  std::memcpy(ptr, preambleDataFmt, sizeof(preambleDataFmt));
-  ptr += sizeof(preambleDataFmt);
+  std::memcpy(ptr, preambleDataFmt, preambleDataFmtSize);
+  ptr += preambleDataFmtSize;
   std::memcpy(ptr, preambleDataData, sizeof(preambleDataData));
   ptr += sizeof(preambleDataData);
 
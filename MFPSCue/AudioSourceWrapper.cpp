@@ -18,7 +18,7 @@ AudioSourceWrapper::AudioSourceWrapper(std::shared_ptr<Source> source, bool comp
   mChannelInfo(channelInfo),
   mDataType(dataType)
 {
-  if (mSize % mChannelInfo.size()) {
+  if (const auto blockSize = GetBytesPerSample(mDataType) * mChannelInfo.size(); blockSize && mSize % blockSize) {
     throw std::runtime_error("invalid source size");
   }
 }
@@ -35,7 +35,7 @@ AudioSourceWrapper::AudioSourceWrapper(std::shared_ptr<Source> source, const Aud
   for (std::size_t channelIndex = 0; channelIndex < mChannelInfo.size(); channelIndex++) {
     mChannelInfo[channelIndex] = audioSource.GetChannelInfo(channelIndex);
   }
-  if (mSize % mChannelInfo.size()) {
+  if (const auto blockSize = GetBytesPerSample(mDataType) * mChannelInfo.size(); blockSize && mSize % blockSize) {
     throw std::runtime_error("invalid source size");
   }
 }
@@ -5,6 +5,7 @@
 #include <dokan/dokan.h>
 
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -33,17 +34,6 @@ using namespace std::literals;
 
 
 
-namespace {
-  const std::vector<AudioSource::ChannelInfo> gCDChannelInfo{
-    AudioSource::ChannelInfo::Left,
-    AudioSource::ChannelInfo::Right,
-  };
-
-  constexpr auto CDDataType = AudioSource::DataType::Int16;
-}
-
-
-
 CueAudioLoader::CueAudioLoader(LPCWSTR filepath, ExtractToMemory extractToMemory) {
   const auto fullCueFilepath = util::rfs::ToAbsoluteFilepath(filepath);
   const auto baseDirectoryPath = util::rfs::GetParentPath(fullCueFilepath);
@@ -80,15 +70,24 @@ CueAudioLoader::CueAudioLoader(LPCWSTR filepath, ExtractToMemory extractToMemory
     if (!audioSource) {
       throw std::runtime_error("cannot load audio");
     }
-    if (audioSource->GetChannels() != CDChannels || audioSource->GetSamplingRate() != CDSamplingRate) {
+    if (!audioSource->GetChannels() || !audioSource->GetSamplingRate()) {
       throw std::runtime_error("invalid audio format");
     }
-    if (audioSource->GetChannelInfo(0) != AudioSource::ChannelInfo::Left || audioSource->GetChannelInfo(1) != AudioSource::ChannelInfo::Right) {
-      throw std::runtime_error("unsupported channel layout");
-    }
-    if (audioSource->GetDataType() != AudioSource::DataType::Int16) {
+    if (audioSource->GetDataType() == AudioSource::DataType::Other) {
       throw std::runtime_error("unsupported data type");
     }
+    // all files are merged into a single audio source
+    if (!mAudioSources.empty()) {
+      const auto& firstAudioSource = *mAudioSources.front();
+      if (audioSource->GetChannels() != firstAudioSource.GetChannels() || audioSource->GetSamplingRate() != firstAudioSource.GetSamplingRate() || audioSource->GetDataType() != firstAudioSource.GetDataType()) {
+        throw std::runtime_error("audio formats differ between files");
+      }
+      for (std::size_t channelIndex = 0; channelIndex < audioSource->GetChannels(); channelIndex++) {
+        if (audioSource->GetChannelInfo(channelIndex) != firstAudioSource.GetChannelInfo(channelIndex)) {
+          throw std::runtime_error("channel layouts differ between files");
+        }
+      }
+    }
 
     if (extractToMemory == ExtractToMemory::Always || (extractToMemory == ExtractToMemory::Compressed && audioSource->IsCompressed())) {
       audioSource = std::make_shared<AudioSourceWrapper>(std::make_shared<OnMemorySourceWrapper>(audioSource), *audioSource, false);
@@ -112,6 +111,10 @@ CueAudioLoader::CueAudioLoader(LPCWSTR filepath, ExtractToMemory extractToMemory
     }
   }
 
+  if (mAudioSources.empty()) {
+    throw std::runtime_error("no file provided");
+  }
+
   {
     bool hasCompressedAudio = false;
 
@@ -123,7 +126,13 @@ CueAudioLoader::CueAudioLoader(LPCWSTR filepath, ExtractToMemory extractToMemory
       sources[sourceIndex] = mAudioSources[sourceIndex];
     }
 
-    mFullAudioSource = std::make_shared<AudioSourceWrapper>(std::make_shared<MergedSource>(sources), hasCompressedAudio, CDSamplingRate, gCDChannelInfo, CDDataType);
+    const auto& firstAudioSource = *mAudioSources.front();
+    std::vector<AudioSource::ChannelInfo> channelInfo(firstAudioSource.GetChannels());
+    for (std::size_t channelIndex = 0; channelIndex < channelInfo.size(); channelIndex++) {
+      channelInfo[channelIndex] = firstAudioSource.GetChannelInfo(channelIndex);
+    }
+
+    mFullAudioSource = std::make_shared<AudioSourceWrapper>(std::make_shared<MergedSource>(sources), hasCompressedAudio, firstAudioSource.GetSamplingRate(), channelInfo, firstAudioSource.GetDataType());
   }
 
   if (mTrackNumberToAdditionalTrackInfoMap.empty()) {
@@ -146,23 +155,28 @@ CueAudioLoader::CueAudioLoader(LPCWSTR filepath, ExtractToMemory extractToMemory
   for (TrackNumber trackNumber = mFirstTrackNumber; trackNumber <= mLastTrackNumber; trackNumber++) {
     auto& additionalTrackInfo = mTrackNumberToAdditionalTrackInfoMap.at(trackNumber);
 
+    auto currentAudioSource = mAudioSources.at(additionalTrackInfo.fileIndex);
+    const auto samplingRate = currentAudioSource->GetSamplingRate();
+    const auto blockSize = currentAudioSource->GetBlockSize();
+
     for (const auto& offsetNumber : mOffsetNumberSet) {
+      // offsets in samples
       Source::SourceOffset currentTrackOffset;
       if (additionalTrackInfo.offsetMap.count(offsetNumber)) {
-        currentTrackOffset = additionalTrackInfo.offsetMap.at(offsetNumber);
+        currentTrackOffset = FrameToSample(additionalTrackInfo.offsetMap.at(offsetNumber), samplingRate);
       } else {
-        currentTrackOffset = additionalTrackInfo.offsetMap.at(CueSheet::File::Track::DefaultOffsetNumber);
+        currentTrackOffset = FrameToSample(additionalTrackInfo.offsetMap.at(CueSheet::File::Track::DefaultOffsetNumber), samplingRate);
       }
 
       Source::SourceOffset nextTrackOffset;
       if (trackNumber == mLastTrackNumber || additionalTrackInfo.fileIndex != mTrackNumberToAdditionalTrackInfoMap.at(trackNumber + 1).fileIndex) {
-        nextTrackOffset = mAudioSources.at(additionalTrackInfo.fileIndex)->GetSize() / CDBytesPerFrame;
+        nextTrackOffset = currentAudioSource->GetSize() / blockSize;
       } else {
         const auto& nextTrackAdditionalTrackInfo = mTrackNumberToAdditionalTrackInfoMap.at(trackNumber + 1);
         if (nextTrackAdditionalTrackInfo.offsetMap.count(offsetNumber)) {
-          nextTrackOffset = nextTrackAdditionalTrackInfo.offsetMap.at(offsetNumber);
+          nextTrackOffset = FrameToSample(nextTrackAdditionalTrackInfo.offsetMap.at(offsetNumber), samplingRate);
         } else {
-          nextTrackOffset = nextTrackAdditionalTrackInfo.offsetMap.at(CueSheet::File::Track::DefaultOffsetNumber);
+          nextTrackOffset = FrameToSample(nextTrackAdditionalTrackInfo.offsetMap.at(CueSheet::File::Track::DefaultOffsetNumber), samplingRate);
         }
       }
 
@@ -170,9 +184,7 @@ CueAudioLoader::CueAudioLoader(LPCWSTR filepath, ExtractToMemory extractToMemory
         throw std::runtime_error("invalid track offset provided");
       }
 
-      auto currentAudioSource = mAudioSources.at(additionalTrackInfo.fileIndex);
-
-      additionalTrackInfo.partialAudioSources.emplace(offsetNumber, std::make_shared<AudioSourceWrapper>(std::make_shared<PartialSource>(currentAudioSource, currentTrackOffset * CDBytesPerFrame, (nextTrackOffset - currentTrackOffset) * CDBytesPerFrame), *currentAudioSource));
+      additionalTrackInfo.partialAudioSources.emplace(offsetNumber, std::make_shared<AudioSourceWrapper>(std::make_shared<PartialSource>(currentAudioSource, currentTrackOffset * blockSize, (nextTrackOffset - currentTrackOffset) * blockSize), *currentAudioSource));
     }
   }
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <set>
@@ -29,16 +30,13 @@ public:
   using TrackNumber = CueSheet::File::Track::TrackNumber;
   using OffsetNumber = CueSheet::File::Track::OffsetNumber;
 
-  static constexpr unsigned long CDSamplingRate = 44100;
-  static constexpr unsigned long CDChannels = 2;
-  static constexpr unsigned long CDBits = 16;
+  // offsets in cue sheets are in CD frames regardless of the format of audio files
   static constexpr unsigned long CDFramePerSecond = 75;
-  static constexpr unsigned long CDSamplesPerFrame = CDSamplingRate / CDFramePerSecond;
-  static constexpr unsigned long CDBytesPerSample = CDChannels * CDBits / 8;
-  static constexpr unsigned long CDBytesPerSecond = CDBytesPerSample * CDSamplingRate;
-  static constexpr unsigned long CDBytesPerFrame = CDBytesPerSecond / CDFramePerSecond;
 
-  static_assert(CDBytesPerFrame == 2352);
+  // rounds down if samplingRate is not a multiple of CDFramePerSecond
+  static constexpr Source::SourceOffset FrameToSample(unsigned long frame, std::uint_fast32_t samplingRate) {
+    return static_cast<Source::SourceOffset>(frame) * samplingRate / CDFramePerSecond;
+  }
 
 private:
   struct AdditionalTrackInfo {
@@ -86,16 +86,21 @@ CueSourceMount::ExportPortation::ExportPortation(CueSourceMount& sourceMount, PO
   empty(portationInfo->empty),
   sourceMountFile(portationInfo->fileContextId != FILE_CONTEXT_ID_NULL ? std::static_pointer_cast<CueSourceMountFile>(sourceMount.GetSourceMountFileBase(portationInfo->fileContextId)) : nullptr),
   ptrDirectoryTree(sourceMount.GetDirectoryTree(portationInfo->filepath)),
-  lastNumberOfBytesWritten(0)
+  lastNumberOfBytesWritten(0),
+  bufferSize(0),
+  chunkSize(MinChunkSize)
 {
   if (!ptrDirectoryTree) {
     throw NtstatusError(sourceMount.ReturnPathOrNameNotFoundError(portationInfo->filepath));
   }
 
 
+  directory = ptrDirectoryTree->directory;
+
   // allocate buffer
-  if (!ptrDirectoryTree->directory) {
-    buffer = std::make_unique<std::byte[]>(BufferSize);
+  if (!directory) {
+    bufferSize = static_cast<std::size_t>(std::min<Source::SourceSize>(ptrDirectoryTree->source ? ptrDirectoryTree->source->GetSize() : 0, MaxChunkSize));
+    buffer = std::make_unique<std::byte[]>(bufferSize);
   }
 
   portationInfo->directory = ptrDirectoryTree->directory ? TRUE : FALSE;
@@ -122,10 +127,11 @@ NTSTATUS CueSourceMount::ExportPortation::Export(PORTATION_INFO* portationInfo)
 
   portationInfo->currentOffset.QuadPart += lastNumberOfBytesWritten;
 
-  const std::size_t size = static_cast<std::size_t>(std::min<ULONGLONG>(portationInfo->fileSize.QuadPart - portationInfo->currentOffset.QuadPart, BufferSize));
+  const std::size_t size = static_cast<std::size_t>(std::min<ULONGLONG>(portationInfo->fileSize.QuadPart - portationInfo->currentOffset.QuadPart, std::min(chunkSize, bufferSize)));
   if (size == 0) {
     return STATUS_ALREADY_COMPLETE;
   }
+  chunkSize = std::min(chunkSize * 2, MaxChunkSize);
 
   if (const auto status = ptrDirectoryTree->source->Read(portationInfo->currentOffset.QuadPart, buffer.get(), size, &lastNumberOfBytesWritten); status != STATUS_SUCCESS) {
     return status;
@@ -244,7 +250,7 @@ CueSourceMount::CueSourceMount(const PLUGIN_INITIALIZE_MOUNT_INFO* initializeMou
       std::wstring directoryPrefix = L"INDEX "s + GetTwoDigit(offsetNumber) + L"\\"s;
 
       std::vector<std::wstring> audioFilenames;
-      std::vector<unsigned long long> audioSizes;
+      std::vector<double> audioDurations;
       for (auto trackNumber = firstTrackNumber; trackNumber <= lastTrackNumber; trackNumber++) {
         auto track = cueAudioLoader.GetTrack(trackNumber);
         if (!track) {
@@ -263,7 +269,10 @@ CueSourceMount::CueSourceMount(const PLUGIN_INITIALIZE_MOUNT_INFO* initializeMou
         Insert(directoryTree, directoryPrefix + audioFilename, std::make_shared<AudioSourceToSourceWAV>(trackAudioSource, &cueAudioLoader.GetCueSheet(), trackNumber), fileIndexCount);
 
         audioFilenames.emplace_back(audioFilename);
-        audioSizes.emplace_back(trackAudioSource->GetSize());
+        // tracks of FLAC or WAV files are not always 16-bit stereo at 44.1 kHz
+        const auto blockSize = trackAudioSource->GetBlockSize();
+        const auto samplingRate = trackAudioSource->GetSamplingRate();
+        audioDurations.emplace_back(blockSize && samplingRate ? static_cast<double>(trackAudioSource->GetSize() / blockSize) / samplingRate : 0.);
       }
 
       {
@@ -272,7 +281,7 @@ CueSourceMount::CueSourceMount(const PLUGIN_INITIALIZE_MOUNT_INFO* initializeMou
       }
 
       {
-        const auto data = GeneratePlaylistM3U8(cueAudioLoader.GetCueSheet(), audioSizes, audioFilenames);
+        const auto data = GeneratePlaylistM3U8(cueAudioLoader.GetCueSheet(), audioDurations, audioFilenames);
         Insert(directoryTree, directoryPrefix + cueBasename + L".m3u8"s, std::make_shared<MemorySource>(data.data(), data.size()), fileIndexCount);
       }
     }
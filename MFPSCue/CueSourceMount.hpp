@@ -22,7 +22,9 @@ class CueSourceMountFile;
 
 class CueSourceMount : public ReadonlySourceMountBase {
   class ExportPortation {
-    static constexpr std::size_t BufferSize = 4096;
+    // adaptive chunk size (doubled on each Export)
+    static constexpr std::size_t MinChunkSize = 64 * 1024;
+    static constexpr std::size_t MaxChunkSize = 4 * 1024 * 1024;
 
   protected:
     CueSourceMount& sourceMount;
@@ -35,6 +37,8 @@ class CueSourceMount : public ReadonlySourceMountBase {
     std::size_t lastNumberOfBytesWritten;
     bool directory;
     std::unique_ptr<std::byte[]> buffer;
+    std::size_t bufferSize;
+    std::size_t chunkSize;
 
   public:
     ExportPortation(CueSourceMount& sourceMount, PORTATION_INFO* portationInfo);
@@ -19,14 +19,14 @@ namespace {
 
 
 
-std::vector<std::byte> GeneratePlaylistM3U8(const CueSheet& cueSheet, const std::vector<unsigned long long>& audioSizes, const std::vector<std::wstring>& audioFilepaths) {
+std::vector<std::byte> GeneratePlaylistM3U8(const CueSheet& cueSheet, const std::vector<double>& audioDurations, const std::vector<std::wstring>& audioFilepaths) {
   std::wstring wstrData;
   wstrData += L"#EXTM3U"s + gNewLine;
   std::size_t index = 0;
   for (const auto& file : cueSheet.files) {
     for (const auto& track : file.tracks) {
       wstrData += gNewLine;
-      wstrData += L"#EXTINF:"s + std::to_wstring(static_cast<double>(audioSizes.at(index) / 4) / 44100.) + L","s + track.title.value_or(L""s) + gNewLine;
+      wstrData += L"#EXTINF:"s + std::to_wstring(audioDurations.at(index)) + L","s + track.title.value_or(L""s) + gNewLine;
       wstrData += audioFilepaths.at(index) + gNewLine;
       index++;
     }
@@ -8,4 +8,5 @@
 #include "CueSheet.hpp"
 
 
-std::vector<std::byte> GeneratePlaylistM3U8(const CueSheet& cueSheet, const std::vector<unsigned long long>& audioSizes, const std::vector<std::wstring>& audioFilepaths);
+// audioDurations are the lengths of the tracks in seconds
+std::vector<std::byte> GeneratePlaylistM3U8(const CueSheet& cueSheet, const std::vector<double>& audioDurations, const std::vector<std::wstring>& audioFilepaths);
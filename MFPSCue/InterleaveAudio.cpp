@@ -0,0 +1,304 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+# define INTERLEAVE_AUDIO_X86
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# else
+#  include <cpuid.h>
+# endif
+#endif
+
+// MSVC accepts intrinsics of any instruction set; GCC and Clang only in functions targeting it
+#if defined(INTERLEAVE_AUDIO_X86) && !defined(_MSC_VER)
+# define INTERLEAVE_AUDIO_TARGET(instructionSet) __attribute__((target(instructionSet)))
+#else
+# define INTERLEAVE_AUDIO_TARGET(instructionSet)
+#endif
+
+#include "InterleaveAudio.hpp"
+
+
+
+namespace {
+  template<std::size_t BytesPerSample>
+  void InterleaveAudioScalarImpl(std::byte* destination, const std::int32_t* const* source, std::size_t numChannels, std::size_t numSamples) {
+    for (std::size_t sampleIndex = 0; sampleIndex < numSamples; sampleIndex++) {
+      for (std::size_t channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+        auto value = source[channelIndex][sampleIndex];
+        if constexpr (BytesPerSample == 1) {
+          // 8bit PCM is unsigned
+          value += 0x80;
+        }
+        // little endian
+        std::memcpy(destination, &value, BytesPerSample);
+        destination += BytesPerSample;
+      }
+    }
+  }
+
+
+#ifdef INTERLEAVE_AUDIO_X86
+  // a kernel converts as many samples as it can at once and returns the number of converted samples
+  using Kernel = std::size_t(*)(std::byte* destination, const std::int32_t* const* source, std::size_t numSamples);
+
+
+  INTERLEAVE_AUDIO_TARGET("sse2")
+  std::size_t InterleaveMono16SSE2(std::byte* destination, const std::int32_t* const* source, std::size_t numSamples) {
+    const auto ptrSource = source[0];
+    std::size_t sampleIndex = 0;
+    for (; sampleIndex + 8 <= numSamples; sampleIndex += 8) {
+      const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptrSource + sampleIndex));
+      const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptrSource + sampleIndex + 4));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + sampleIndex * 2), _mm_packs_epi32(a, b));
+    }
+    return sampleIndex;
+  }
+
+
+  INTERLEAVE_AUDIO_TARGET("sse2")
+  std::size_t InterleaveStereo16SSE2(std::byte* destination, const std::int32_t* const* source, std::size_t numSamples) {
+    const auto ptrLeft = source[0];
+    const auto ptrRight = source[1];
+    std::size_t sampleIndex = 0;
+    for (; sampleIndex + 4 <= numSamples; sampleIndex += 4) {
+      const auto left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptrLeft + sampleIndex));
+      const auto right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptrRight + sampleIndex));
+      // L0 R0 L1 R1, L2 R2 L3 R3
+      const auto low = _mm_unpacklo_epi32(left, right);
+      const auto high = _mm_unpackhi_epi32(left, right);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + sampleIndex * 4), _mm_packs_epi32(low, high));
+    }
+    return sampleIndex;
+  }
+
+
+  INTERLEAVE_AUDIO_TARGET("sse2")
+  std::size_t InterleaveStereo32SSE2(std::byte* destination, const std::int32_t* const* source, std::size_t numSamples) {
+    const auto ptrLeft = source[0];
+    const auto ptrRight = source[1];
+    std::size_t sampleIndex = 0;
+    for (; sampleIndex + 4 <= numSamples; sampleIndex += 4) {
+      const auto left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptrLeft + sampleIndex));
+      const auto right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptrRight + sampleIndex));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + sampleIndex * 8), _mm_unpacklo_epi32(left, right));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + sampleIndex * 8 + 16), _mm_unpackhi_epi32(left, right));
+    }
+    return sampleIndex;
+  }
+
+
+  // AVX2 kernels are called only if IsAVX2Supported() returns true
+
+  INTERLEAVE_AUDIO_TARGET("avx2")
+  std::size_t InterleaveMono16AVX2(std::byte* destination, const std::int32_t* const* source, std::size_t numSamples) {
+    const auto ptrSource = source[0];
+    std::size_t sampleIndex = 0;
+    for (; sampleIndex + 16 <= numSamples; sampleIndex += 16) {
+      const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrSource + sampleIndex));
+      const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrSource + sampleIndex + 8));
+      // packs works in each 128bit lane; a0-3 b0-3 a4-7 b4-7 -> a0-3 a4-7 b0-3 b4-7
+      const auto packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + sampleIndex * 2), packed);
+    }
+    return sampleIndex;
+  }
+
+
+  INTERLEAVE_AUDIO_TARGET("avx2")
+  std::size_t InterleaveStereo16AVX2(std::byte* destination, const std::int32_t* const* source, std::size_t numSamples) {
+    const auto ptrLeft = source[0];
+    const auto ptrRight = source[1];
+    std::size_t sampleIndex = 0;
+    for (; sampleIndex + 8 <= numSamples; sampleIndex += 8) {
+      const auto left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrLeft + sampleIndex));
+      const auto right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrRight + sampleIndex));
+      // L0 R0 L1 R1 | L4 R4 L5 R5, L2 R2 L3 R3 | L6 R6 L7 R7; packs restores the order
+      const auto low = _mm256_unpacklo_epi32(left, right);
+      const auto high = _mm256_unpackhi_epi32(left, right);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + sampleIndex * 4), _mm256_packs_epi32(low, high));
+    }
+    return sampleIndex;
+  }
+
+
+  INTERLEAVE_AUDIO_TARGET("avx2")
+  std::size_t InterleaveStereo24AVX2(std::byte* destination, const std::int32_t* const* source, std::size_t numSamples) {
+    // drops the most significant byte of each sample in each 128bit lane
+    const auto shuffleMask = _mm256_setr_epi8(
+      0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+      0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    // moves 12 bytes of the upper lane next to 12 bytes of the lower lane
+    const auto permuteIndices = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+    const auto ptrLeft = source[0];
+    const auto ptrRight = source[1];
+    std::size_t sampleIndex = 0;
+    for (; sampleIndex + 8 <= numSamples; sampleIndex += 8) {
+      const auto left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrLeft + sampleIndex));
+      const auto right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrRight + sampleIndex));
+      const auto low = _mm256_unpacklo_epi32(left, right);
+      const auto high = _mm256_unpackhi_epi32(left, right);
+      // L0 R0 L1 R1 L2 R2 L3 R3, L4 R4 L5 R5 L6 R6 L7 R7
+      const auto first = _mm256_permute2x128_si256(low, high, 0x20);
+      const auto second = _mm256_permute2x128_si256(low, high, 0x31);
+      const auto packedFirst = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(first, shuffleMask), permuteIndices);
+      const auto packedSecond = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(second, shuffleMask), permuteIndices);
+      // write exactly 24 bytes each
+      const auto ptrDestination = destination + sampleIndex * 6;
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(ptrDestination), _mm256_castsi256_si128(packedFirst));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(ptrDestination + 16), _mm256_extracti128_si256(packedFirst, 1));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(ptrDestination + 24), _mm256_castsi256_si128(packedSecond));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(ptrDestination + 40), _mm256_extracti128_si256(packedSecond, 1));
+    }
+    return sampleIndex;
+  }
+
+
+  INTERLEAVE_AUDIO_TARGET("avx2")
+  std::size_t InterleaveStereo32AVX2(std::byte* destination, const std::int32_t* const* source, std::size_t numSamples) {
+    const auto ptrLeft = source[0];
+    const auto ptrRight = source[1];
+    std::size_t sampleIndex = 0;
+    for (; sampleIndex + 8 <= numSamples; sampleIndex += 8) {
+      const auto left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrLeft + sampleIndex));
+      const auto right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrRight + sampleIndex));
+      const auto low = _mm256_unpacklo_epi32(left, right);
+      const auto high = _mm256_unpackhi_epi32(left, right);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + sampleIndex * 8), _mm256_permute2x128_si256(low, high, 0x20));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + sampleIndex * 8 + 32), _mm256_permute2x128_si256(low, high, 0x31));
+    }
+    return sampleIndex;
+  }
+
+
+  // EAX, EBX, ECX and EDX of CPUID
+  void GetCPUID(unsigned int cpuInfo[4], unsigned int function, unsigned int subfunction) {
+#ifdef _MSC_VER
+    __cpuidex(reinterpret_cast<int*>(cpuInfo), function, subfunction);
+#else
+    __cpuid_count(function, subfunction, cpuInfo[0], cpuInfo[1], cpuInfo[2], cpuInfo[3]);
+#endif
+  }
+
+
+  // XCR0; only valid if OSXSAVE is set
+  std::uint64_t GetXCR0() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    // _xgetbv needs -mxsave on GCC
+    std::uint32_t eax;
+    std::uint32_t edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<std::uint64_t>(edx) << 32) | eax;
+#endif
+  }
+
+
+  bool IsAVX2Supported() {
+    unsigned int cpuInfo[4];
+    GetCPUID(cpuInfo, 0, 0);
+    if (cpuInfo[0] < 7) {
+      return false;
+    }
+    // the OS must save YMM registers
+    GetCPUID(cpuInfo, 1, 0);
+    constexpr unsigned int OSXSAVEBit = 1 << 27;
+    constexpr unsigned int AVXBit = 1 << 28;
+    if ((cpuInfo[2] & (OSXSAVEBit | AVXBit)) != (OSXSAVEBit | AVXBit) || (GetXCR0() & 0x06) != 0x06) {
+      return false;
+    }
+    GetCPUID(cpuInfo, 7, 0);
+    constexpr unsigned int AVX2Bit = 1 << 5;
+    return (cpuInfo[1] & AVX2Bit) != 0;
+  }
+
+
+  const bool gAVX2Supported = IsAVX2Supported();
+
+
+  // indexed by [numChannels - 1][bytesPerSample - 1]
+  constexpr Kernel SSE2Kernels[2][4] = {
+    {nullptr, InterleaveMono16SSE2, nullptr, nullptr},
+    {nullptr, InterleaveStereo16SSE2, nullptr, InterleaveStereo32SSE2},
+  };
+
+  constexpr Kernel AVX2Kernels[2][4] = {
+    {nullptr, InterleaveMono16AVX2, nullptr, nullptr},
+    {nullptr, InterleaveStereo16AVX2, InterleaveStereo24AVX2, InterleaveStereo32AVX2},
+  };
+
+
+  Kernel SelectKernel(std::size_t numChannels, std::size_t bytesPerSample, bool allowAVX2) {
+    if (numChannels < 1 || numChannels > 2 || bytesPerSample < 1 || bytesPerSample > 4) {
+      return nullptr;
+    }
+    if (allowAVX2 && gAVX2Supported && AVX2Kernels[numChannels - 1][bytesPerSample - 1]) {
+      return AVX2Kernels[numChannels - 1][bytesPerSample - 1];
+    }
+    return SSE2Kernels[numChannels - 1][bytesPerSample - 1];
+  }
+
+
+  void InterleaveAudioWithKernel(Kernel kernel, std::byte* destination, const std::int32_t* const* source, std::size_t numChannels, std::size_t bytesPerSample, std::size_t numSamples) {
+    if (!kernel) {
+      InterleaveAudioScalar(destination, source, numChannels, bytesPerSample, numSamples);
+      return;
+    }
+    const auto numConvertedSamples = kernel(destination, source, numSamples);
+    if (numConvertedSamples == numSamples) {
+      return;
+    }
+    // remaining samples; kernels are only for mono and stereo
+    const std::int32_t* const remainingSource[2] = {
+      source[0] + numConvertedSamples,
+      numChannels == 2 ? source[1] + numConvertedSamples : nullptr,
+    };
+    InterleaveAudioScalar(destination + numConvertedSamples * numChannels * bytesPerSample, remainingSource, numChannels, bytesPerSample, numSamples - numConvertedSamples);
+  }
+#endif
+}
+
+
+
+void InterleaveAudioScalar(std::byte* destination, const std::int32_t* const* source, std::size_t numChannels, std::size_t bytesPerSample, std::size_t numSamples) {
+  switch (bytesPerSample) {
+    case 1:
+      InterleaveAudioScalarImpl<1>(destination, source, numChannels, numSamples);
+      break;
+
+    case 2:
+      InterleaveAudioScalarImpl<2>(destination, source, numChannels, numSamples);
+      break;
+
+    case 3:
+      InterleaveAudioScalarImpl<3>(destination, source, numChannels, numSamples);
+      break;
+
+    case 4:
+      InterleaveAudioScalarImpl<4>(destination, source, numChannels, numSamples);
+      break;
+  }
+}
+
+
+void InterleaveAudio(std::byte* destination, const std::int32_t* const* source, std::size_t numChannels, std::size_t bytesPerSample, std::size_t numSamples) {
+#ifdef INTERLEAVE_AUDIO_X86
+  InterleaveAudioWithKernel(SelectKernel(numChannels, bytesPerSample, true), destination, source, numChannels, bytesPerSample, numSamples);
+#else
+  InterleaveAudioScalar(destination, source, numChannels, bytesPerSample, numSamples);
+#endif
+}
+
+
+void InterleaveAudioSSE2(std::byte* destination, const std::int32_t* const* source, std::size_t numChannels, std::size_t bytesPerSample, std::size_t numSamples) {
+#ifdef INTERLEAVE_AUDIO_X86
+  InterleaveAudioWithKernel(SelectKernel(numChannels, bytesPerSample, false), destination, source, numChannels, bytesPerSample, numSamples);
+#else
+  InterleaveAudioScalar(destination, source, numChannels, bytesPerSample, numSamples);
+#endif
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// converts planar 32-bit samples (as decoded by libFLAC) into interleaved little-endian PCM as stored in WAV
+// bytesPerSample is 1 (unsigned), 2, 3 or 4 (signed); each sample must fit in bytesPerSample bytes
+// SSE2 or AVX2 kernels are used for mono and stereo when the processor supports them
+void InterleaveAudio(std::byte* destination, const std::int32_t* const* source, std::size_t numChannels, std::size_t bytesPerSample, std::size_t numSamples);
+
+// uses SSE2 kernels even if the processor supports AVX2; same as InterleaveAudioScalar on other processors
+void InterleaveAudioSSE2(std::byte* destination, const std::int32_t* const* source, std::size_t numChannels, std::size_t bytesPerSample, std::size_t numSamples);
+
+// always uses the scalar implementation
+void InterleaveAudioScalar(std::byte* destination, const std::int32_t* const* source, std::size_t numChannels, std::size_t bytesPerSample, std::size_t numSamples);
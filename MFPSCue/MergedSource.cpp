@@ -14,10 +14,14 @@
 MergedSource::MergedSource(const std::vector<std::shared_ptr<Source>>& sources) :
   mTotalSourceSize(0)
 {
+  mSources.reserve(sources.size());
+  mSourceOffsets.reserve(sources.size() + 1);
   for (const auto& source : sources) {
     const auto currentSourceSize = source->GetSize();
+    if (!currentSourceSize) {
+      continue;
+    }
     mSources.emplace_back(source);
-    mSourceSizes.emplace_back(currentSourceSize);
     mSourceOffsets.emplace_back(mTotalSourceSize);
     mTotalSourceSize += currentSourceSize;
   }
@@ -25,6 +29,13 @@ MergedSource::MergedSource(const std::vector<std::shared_ptr<Source>>& sources)
 }
 
 
+// offset must be less than mTotalSourceSize
+std::size_t MergedSource::FindSourceIndex(SourceOffset offset) const {
+  // the first source whose end is greater than offset
+  return static_cast<std::size_t>(std::upper_bound(mSourceOffsets.cbegin() + 1, mSourceOffsets.cend(), offset) - (mSourceOffsets.cbegin() + 1));
+}
+
+
 Source::SourceSize MergedSource::GetSize() {
   return mTotalSourceSize;
 }
@@ -47,19 +58,20 @@ NTSTATUS MergedSource::Read(SourceOffset offset, std::byte* buffer, std::size_t
     return STATUS_SUCCESS;
   }
 
-  // linear search but does not matter in most cases
-  std::size_t firstSourceIndex = 0;
-  while (mSourceOffsets[firstSourceIndex + 1] <= offset) {
-    firstSourceIndex++;
+  std::size_t sourceIndex = FindSourceIndex(offset);
+
+  // fast path: the whole range lies in a single source
+  if (offset + size <= mSourceOffsets[sourceIndex + 1]) {
+    return mSources[sourceIndex]->Read(offset - mSourceOffsets[sourceIndex], buffer, size, readSize);
   }
 
+  // the range spans sources; every source after the first one is read from its beginning
   std::size_t tempReadSize = 0;
-  std::size_t sourceIndex = firstSourceIndex;
   while (tempReadSize != size) {
     auto& currentSource = *mSources[sourceIndex];
 
-    SourceOffset currentOffset = offset + tempReadSize - mSourceOffsets[sourceIndex];
-    const std::size_t sizeToRead = static_cast<std::size_t>(std::min<SourceSize>(size - tempReadSize, mSourceSizes[sourceIndex] - currentOffset));
+    const SourceOffset currentOffset = offset + tempReadSize - mSourceOffsets[sourceIndex];
+    const std::size_t sizeToRead = static_cast<std::size_t>(std::min<SourceSize>(size - tempReadSize, mSourceOffsets[sourceIndex + 1] - mSourceOffsets[sourceIndex] - currentOffset));
     std::size_t currentReadSize = 0;
     if (const auto status = currentSource.Read(currentOffset, buffer + tempReadSize, sizeToRead, &currentReadSize);  status != STATUS_SUCCESS) {
       return status;
@@ -8,11 +8,14 @@
 
 
 class MergedSource : public Source {
+  // empty sources are excluded so that mSourceOffsets is strictly increasing
   std::vector<std::shared_ptr<Source>> mSources;
+  // prefix sums of source sizes; has mSources.size() + 1 elements, the last of which is the total size
   std::vector<SourceOffset> mSourceOffsets;
-  std::vector<SourceSize> mSourceSizes;
   SourceSize mTotalSourceSize;
 
+  std::size_t FindSourceIndex(SourceOffset offset) const;
+
 public:
   MergedSource(const std::vector<std::shared_ptr<Source>>& sources);
 
@@ -5,19 +5,27 @@
 #include <FLAC++/decoder.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
+#include <iterator>
+#include <list>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <Windows.h>
 
 #include "SourceToAudioSourceFLAC.hpp"
 #include "AudioSource.hpp"
+#include "InterleaveAudio.hpp"
 #include "Source.hpp"
 
 using namespace std::literals;
@@ -25,12 +33,20 @@ using namespace std::literals;
 
 
 namespace {
-  // stereo 16bit
-  using DataType = std::int16_t;
-  constexpr std::size_t NumChannels = 2;
-  constexpr std::size_t Alignment = sizeof(DataType) * NumChannels;
+  // limits of FLAC
+  constexpr std::size_t MaxChannels = 8;
+  constexpr std::size_t MaxBlockSize = MaxChannels * sizeof(FLAC__int32);
   constexpr bool EnableMD5Check = false;
 
+  // minimum distance in samples between entries of the frame index; frames between them are decoded and discarded on seek
+  constexpr Source::SourceOffset FrameIndexInterval = 16384;
+  constexpr std::size_t FrameCacheCapacity = 4 << 20;    // in bytes
+  constexpr std::size_t ScanBufferSize = 1 << 20;
+  constexpr std::size_t MaxFrameHeaderSize = 16;
+
+  // decoders are added to the pool when a read is far from the positions of all idle decoders
+  constexpr std::size_t MaxDecoders = 4;
+
 
   class FLACDecoderImpl : public FLAC::Decoder::Stream {
   public:
@@ -134,125 +150,335 @@ namespace {
     void SetWriteCallback(WriteCallback writeCallback = nullptr) {
       mWriteCallback = writeCallback;
     }
+
+
+    // moves the read position; call flush() before this so that the decoder does not use the buffered data
+    void SetPosition(Source::SourceOffset position) {
+      mSeekPosition = position;
+    }
   };
 
 
-  void CopyAudioData(std::byte* destBuffer, std::size_t size, std::size_t unalignedOffset, const FLAC__int32* sourceLeft, const FLAC__int32* sourceRight) {
+  // copies size bytes of interleaved PCM beginning at unalignedOffset bytes of the first sample of source
+  void CopyAudioData(std::byte* destBuffer, std::size_t size, std::size_t unalignedOffset, const FLAC__int32* const* source, std::size_t numChannels, std::size_t bytesPerSample) {
     if (!size) {
       return;
     }
 
-    assert(unalignedOffset < Alignment);
+    const auto blockSize = numChannels * bytesPerSample;
 
-    const auto alignedSourceIndex = unalignedOffset ? 1 : 0;
-    const auto alignOffset = unalignedOffset ? Alignment - unalignedOffset : 0;
-    const auto alignedNumBlocks = size > alignOffset ? (size - alignOffset) / Alignment : 0;
+    assert(numChannels <= MaxChannels);
+    assert(unalignedOffset < blockSize);
 
-    {
-      auto alignedBuffer = reinterpret_cast<DataType*>(destBuffer + alignOffset);
-      auto ptrEnd = alignedBuffer + alignedNumBlocks * NumChannels;
-      auto ptr = alignedBuffer;
-      auto ptrLeft = sourceLeft + alignedSourceIndex;
-      auto ptrRight = sourceRight + alignedSourceIndex;
-      while (ptr != ptrEnd) {
-        *ptr++ = static_cast<DataType>(*ptrLeft++);
-        *ptr++ = static_cast<DataType>(*ptrRight++);
+    const FLAC__int32* shiftedSource[MaxChannels];
+    const auto shiftSource = [source, numChannels, &shiftedSource](std::size_t sampleIndex) {
+      for (std::size_t channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+        shiftedSource[channelIndex] = source[channelIndex] + sampleIndex;
       }
-    }
+      return shiftedSource;
+    };
+
+    std::size_t sampleIndex = 0;
 
     // beginning piece
     if (unalignedOffset) {
-      auto ptr = destBuffer;
-      switch (alignOffset) {
-        case 3:
-          // upper byte of L
-          *ptr++ = static_cast<std::byte>((sourceLeft[0] >> 8) & 0xFF);
-          [[fallthrough]];
-        case 2:
-          // lower byte of R
-          *ptr++ = static_cast<std::byte>(sourceRight[0] & 0xFF);
-          [[fallthrough]];
-        case 1:
-          // upper byte of R
-          *ptr++ = static_cast<std::byte>((sourceRight[0] >> 8) & 0xFF);
-      }
+      std::byte block[MaxBlockSize];
+      InterleaveAudio(block, source, numChannels, bytesPerSample, 1);
+      const auto pieceSize = std::min(blockSize - unalignedOffset, size);
+      std::memcpy(destBuffer, block + unalignedOffset, pieceSize);
+      destBuffer += pieceSize;
+      size -= pieceSize;
+      sampleIndex++;
     }
 
+    const auto alignedNumBlocks = size / blockSize;
+    InterleaveAudio(destBuffer, shiftSource(sampleIndex), numChannels, bytesPerSample, alignedNumBlocks);
+    destBuffer += alignedNumBlocks * blockSize;
+    size -= alignedNumBlocks * blockSize;
+    sampleIndex += alignedNumBlocks;
+
     // ending piece
-    if (size > alignOffset && (size - alignOffset) % Alignment) {
-      auto ptr = destBuffer + size;
-      const auto sourceIndex = alignedSourceIndex + alignedNumBlocks;
-      switch ((size - alignOffset) % Alignment) {
-        case 3:
-          // lower byte of R
-          *--ptr = static_cast<std::byte>(sourceRight[sourceIndex] & 0xFF);
-          [[fallthrough]];
-        case 2:
-          // upper byte of L
-          *--ptr = static_cast<std::byte>((sourceLeft[sourceIndex] >> 8) & 0xFF);
-          [[fallthrough]];
-        case 1:
-          // lower byte of L
-          *--ptr = static_cast<std::byte>(sourceLeft[sourceIndex] & 0xFF);
-      }
+    if (size) {
+      std::byte block[MaxBlockSize];
+      InterleaveAudio(block, shiftSource(sampleIndex), numChannels, bytesPerSample, 1);
+      std::memcpy(destBuffer, block, size);
     }
   }
 
 
-  std::size_t CopyAudioFromFLACBlock(const FLAC__Frame& frame, const FLAC__int32* const* sourceBuffer, std::byte* destinationBuffer, Source::SourceOffset currentByteOffset, Source::SourceOffset requestedByteEnd) {
-    const auto firstSampleIndex = frame.header.number.sample_number;
-    const auto numSamplesInBlock = frame.header.blocksize;
+  std::size_t CopyAudioFromFLACBlock(Source::SourceOffset firstSampleIndex, std::size_t numSamplesInBlock, const FLAC__int32* planarBuffer, std::size_t numChannels, std::size_t bytesPerSample, std::byte* destinationBuffer, Source::SourceOffset currentByteOffset, Source::SourceOffset requestedByteEnd) {
+    const auto blockSize = numChannels * bytesPerSample;
     const auto lastSampleIndex = firstSampleIndex + numSamplesInBlock;
 
-    const auto currentFirstSampleForBuffer = currentByteOffset / Alignment;
+    const auto currentFirstSampleForBuffer = currentByteOffset / blockSize;
     const auto copyStartSampleOffset = currentFirstSampleForBuffer - firstSampleIndex;
-    const auto copySize = std::min(lastSampleIndex * Alignment - currentByteOffset, requestedByteEnd - currentByteOffset);
-    CopyAudioData(destinationBuffer, static_cast<std::size_t>(copySize), currentByteOffset % Alignment, sourceBuffer[0] + copyStartSampleOffset, sourceBuffer[1] + copyStartSampleOffset);
+    const auto copySize = std::min(lastSampleIndex * blockSize - currentByteOffset, requestedByteEnd - currentByteOffset);
+    const FLAC__int32* source[MaxChannels];
+    for (std::size_t channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+      source[channelIndex] = planarBuffer + numSamplesInBlock * channelIndex + copyStartSampleOffset;
+    }
+    CopyAudioData(destinationBuffer, static_cast<std::size_t>(copySize), currentByteOffset % blockSize, source, numChannels, bytesPerSample);
 
     return static_cast<std::size_t>(copySize);
   }
+
+
+  // channel assignments defined by the FLAC format
+  std::vector<AudioSource::ChannelInfo> GetFLACChannelInfo(std::size_t numChannels) {
+    using ChannelInfo = AudioSource::ChannelInfo;
+
+    switch (numChannels) {
+      case 1:
+        return {ChannelInfo::Center};
+
+      case 2:
+        return {ChannelInfo::Left, ChannelInfo::Right};
+
+      case 3:
+        return {ChannelInfo::Left, ChannelInfo::Right, ChannelInfo::Center};
+
+      case 4:
+        return {ChannelInfo::Left, ChannelInfo::Right, ChannelInfo::BackLeft, ChannelInfo::BackRight};
+
+      case 5:
+        return {ChannelInfo::Left, ChannelInfo::Right, ChannelInfo::Center, ChannelInfo::BackLeft, ChannelInfo::BackRight};
+
+      case 6:
+        return {ChannelInfo::Left, ChannelInfo::Right, ChannelInfo::Center, ChannelInfo::LowFrequency, ChannelInfo::BackLeft, ChannelInfo::BackRight};
+
+      case 7:
+        return {ChannelInfo::Left, ChannelInfo::Right, ChannelInfo::Center, ChannelInfo::LowFrequency, ChannelInfo::BackCenter, ChannelInfo::SideLeft, ChannelInfo::SideRight};
+
+      case 8:
+        return {ChannelInfo::Left, ChannelInfo::Right, ChannelInfo::Center, ChannelInfo::LowFrequency, ChannelInfo::BackLeft, ChannelInfo::BackRight, ChannelInfo::SideLeft, ChannelInfo::SideRight};
+    }
+    return std::vector<ChannelInfo>(numChannels, ChannelInfo::Other);
+  }
+
+
+  std::uint8_t CalcCRC8(const std::uint8_t* data, std::size_t size) {
+    // polynomial x^8 + x^2 + x^1 + x^0
+    std::uint8_t crc = 0;
+    for (std::size_t i = 0; i < size; i++) {
+      crc ^= data[i];
+      for (int bit = 0; bit < 8; bit++) {
+        crc = static_cast<std::uint8_t>(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+      }
+    }
+    return crc;
+  }
+
+
+  struct FrameHeader {
+    bool variableBlockSize;
+    std::uint_fast64_t number;    // sample number if variableBlockSize, frame number otherwise
+    std::uint_fast32_t blockSize;
+    std::size_t size;
+  };
+
+
+  // parses a frame header including its CRC-8; returns std::nullopt if data does not begin with a valid frame header
+  std::optional<FrameHeader> ParseFrameHeader(const std::uint8_t* data, std::size_t size) {
+    if (size < 5) {
+      return std::nullopt;
+    }
+
+    // sync code, reserved bit and blocking strategy
+    if (data[0] != 0xFF || (data[1] & 0xFE) != 0xF8) {
+      return std::nullopt;
+    }
+
+    const unsigned int blockSizeCode = data[2] >> 4;
+    const unsigned int sampleRateCode = data[2] & 0x0F;
+    const unsigned int channelAssignment = data[3] >> 4;
+    const unsigned int sampleSizeCode = (data[3] >> 1) & 0x07;
+    if (blockSizeCode == 0 || sampleRateCode == 0x0F || channelAssignment >= 11 || sampleSizeCode == 3 || (data[3] & 0x01)) {
+      return std::nullopt;
+    }
+
+    std::size_t position = 4;
+
+    // UTF-8 like coded number
+    const std::uint8_t leadingByte = data[position++];
+    std::size_t numLeadingOnes = 0;
+    while (numLeadingOnes < 8 && ((leadingByte << numLeadingOnes) & 0x80)) {
+      numLeadingOnes++;
+    }
+    if (numLeadingOnes == 1 || numLeadingOnes == 8) {
+      return std::nullopt;
+    }
+    const std::size_t numFollowingBytes = numLeadingOnes ? numLeadingOnes - 1 : 0;
+    std::uint_fast64_t number = leadingByte & (0x7F >> numLeadingOnes);
+    if (size < position + numFollowingBytes) {
+      return std::nullopt;
+    }
+    for (std::size_t i = 0; i < numFollowingBytes; i++) {
+      const std::uint8_t byte = data[position++];
+      if ((byte & 0xC0) != 0x80) {
+        return std::nullopt;
+      }
+      number = (number << 6) | (byte & 0x3F);
+    }
+
+    std::uint_fast32_t blockSize;
+    switch (blockSizeCode) {
+      case 1:
+        blockSize = 192;
+        break;
+
+      case 2:
+      case 3:
+      case 4:
+      case 5:
+        blockSize = 576 << (blockSizeCode - 2);
+        break;
+
+      case 6:
+        if (size < position + 1) {
+          return std::nullopt;
+        }
+        blockSize = data[position] + 1;
+        position += 1;
+        break;
+
+      case 7:
+        if (size < position + 2) {
+          return std::nullopt;
+        }
+        blockSize = ((data[position] << 8) | data[position + 1]) + 1;
+        position += 2;
+        break;
+
+      default:
+        blockSize = 256 << (blockSizeCode - 8);
+        break;
+    }
+
+    if (sampleRateCode == 12) {
+      position += 1;
+    } else if (sampleRateCode == 13 || sampleRateCode == 14) {
+      position += 2;
+    }
+
+    if (size < position + 1 || CalcCRC8(data, position) != data[position]) {
+      return std::nullopt;
+    }
+    position++;
+
+    return FrameHeader{
+      (data[1] & 0x01) != 0,
+      number,
+      blockSize,
+      position,
+    };
+  }
 }
 
 
 SourceToAudioSourceFLAC::SourceToAudioSourceFLAC(std::shared_ptr<Source> source) :
-  mError(false),
-  mDecoder(std::make_shared<FLACDecoderImpl>(source)),
-  mLastFLACFrame(std::make_unique<std::byte[]>(sizeof(FLAC__Frame))),
+  mSource(source),
   mDataType(DataType::Other),
+  mBitsPerSample(0),
+  mBytesPerSample(0),
+  mBlockSize(0),
   mTotalSamples(0),
   mTotalSize(0),
-  mLastFLACAvailable(false)
+  mFirstFrameOffset(0),
+  mDecoderPoolMutex(),
+  mDecoderPoolCondition(),
+  mDecoderPool(),
+  mFrameIndexMutex(),
+  mFrameIndexBuilt(false),
+  mFrameIndex(),
+  mFrameIndexScanThread(),
+  mFrameIndexScanTerminate(false),
+  mFrameCacheMutex(),
+  mFrameCache(),
+  mFrameCacheMap(),
+  mFrameCacheBytes(0)
 {
-  auto& decoder = *static_cast<FLACDecoderImpl*>(mDecoder.get());
-  decoder.SetErrorCallback([this](FLAC__StreamDecoderErrorStatus errorStatus) {
-    mError = true;
-  });
-  decoder.SetMetadataCallback([this, &decoder](const FLAC__StreamMetadata* metadata) {
-    if (metadata->type != FLAC__METADATA_TYPE_STREAMINFO) {
-      return;
-    }
-    if (mTotalSamples) {
-      // too many STREAMINFO; error
-      return;
+  std::vector<FrameIndexEntry> seekPoints;
+  auto decoderInstance = std::make_unique<DecoderInstance>();
+  InitializeDecoder(*decoderInstance, &seekPoints);
+  mDecoderPool.emplace_back(std::move(decoderInstance));
+
+  const auto sourceSize = source->GetSize();
+  for (const auto& seekPoint : seekPoints) {
+    if (seekPoint.sample >= mTotalSamples || seekPoint.byteOffset >= sourceSize - mFirstFrameOffset) {
+      break;
     }
-    const auto& samplingRate = metadata->data.stream_info.sample_rate;
-    const auto& channels = metadata->data.stream_info.channels;
-    const auto& bitsPerSample = metadata->data.stream_info.bits_per_sample;
-    const auto& totalSamples = metadata->data.stream_info.total_samples;
-    mChannelInfo.resize(channels);
-    if (mChannelInfo.size() == 2) {
-      mChannelInfo[0] = ChannelInfo::Left;
-      mChannelInfo[1] = ChannelInfo::Right;
-    } else {
-      for (std::size_t channelIndex = 0; channelIndex < mChannelInfo.size(); channelIndex++) {
-        mChannelInfo[channelIndex] = ChannelInfo::Other;
-      }
+    if (!mFrameIndex.empty() && seekPoint.sample <= mFrameIndex.back().sample) {
+      continue;
     }
-    mDataType = bitsPerSample == 16 ? DataType::Int16 : DataType::Other;
-    mSamplingRate = samplingRate;
-    mTotalSamples = totalSamples;
-    mTotalSize = totalSamples * (bitsPerSample / 8) * channels;
+    mFrameIndex.push_back(FrameIndexEntry{
+      seekPoint.sample,
+      mFirstFrameOffset + seekPoint.byteOffset,
+    });
+  }
+  mFrameIndexBuilt = !mFrameIndex.empty();
+}
+
+
+SourceToAudioSourceFLAC::~SourceToAudioSourceFLAC() {
+  mFrameIndexScanTerminate = true;
+  if (mFrameIndexScanThread.joinable()) {
+    mFrameIndexScanThread.join();
+  }
+}
+
+
+// initializes a decoder and processes metadata; busy is not modified
+// metadata is read into members only if ptrSeekPoints is not nullptr; stream_offset of seek points are relative to the first frame
+void SourceToAudioSourceFLAC::InitializeDecoder(DecoderInstance& decoderInstance, std::vector<FrameIndexEntry>* ptrSeekPoints) {
+  decoderInstance.decoder = std::make_shared<FLACDecoderImpl>(mSource);
+  decoderInstance.error = false;
+  decoderInstance.positionAvailable = false;
+  decoderInstance.position = 0;
+
+  auto& decoder = *static_cast<FLACDecoderImpl*>(decoderInstance.decoder.get());
+  decoder.SetErrorCallback([&decoderInstance](FLAC__StreamDecoderErrorStatus) {
+    decoderInstance.error = true;
   });
+  if (ptrSeekPoints) {
+    decoder.SetMetadataCallback([this, ptrSeekPoints](const FLAC__StreamMetadata* metadata) {
+      if (metadata->type == FLAC__METADATA_TYPE_SEEKTABLE) {
+        const auto& seekTable = metadata->data.seek_table;
+        for (unsigned int i = 0; i < seekTable.num_points; i++) {
+          const auto& seekPoint = seekTable.points[i];
+          if (seekPoint.sample_number == FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER) {
+            continue;
+          }
+          ptrSeekPoints->push_back(FrameIndexEntry{
+            seekPoint.sample_number,
+            seekPoint.stream_offset,
+          });
+        }
+        return;
+      }
+      if (metadata->type != FLAC__METADATA_TYPE_STREAMINFO) {
+        return;
+      }
+      if (mTotalSamples) {
+        // too many STREAMINFO; error
+        return;
+      }
+      const auto& samplingRate = metadata->data.stream_info.sample_rate;
+      const auto& channels = metadata->data.stream_info.channels;
+      const auto& bitsPerSample = metadata->data.stream_info.bits_per_sample;
+      const auto& totalSamples = metadata->data.stream_info.total_samples;
+      // samples are stored in the smallest container, left-justified
+      const std::size_t bytesPerSample = (bitsPerSample + 7) / 8;
+      mChannelInfo = GetFLACChannelInfo(channels);
+      mDataType = GetDataTypeFromBytesPerSample(bytesPerSample);
+      mBitsPerSample = bitsPerSample;
+      mBytesPerSample = bytesPerSample;
+      mBlockSize = bytesPerSample * channels;
+      mSamplingRate = samplingRate;
+      mTotalSamples = totalSamples;
+      mTotalSize = totalSamples * mBlockSize;
+    });
+    decoder.set_metadata_respond(FLAC__METADATA_TYPE_SEEKTABLE);
+  }
   if constexpr (EnableMD5Check) {
     decoder.set_md5_checking(true);
   }
@@ -262,185 +488,502 @@ SourceToAudioSourceFLAC::SourceToAudioSourceFLAC(std::shared_ptr<Source> source)
   if (!decoder.process_until_end_of_metadata()) {
     throw std::runtime_error("failed to process metadata");
   }
-  if (mError) {
+  if (decoderInstance.error) {
     throw std::runtime_error("an error occurred while decoding stream");
   }
   if (!mTotalSamples) {
     throw std::runtime_error("unsupported FLAC file");
   }
   decoder.SetMetadataCallback();
+
+  // the decoder is at the first frame now
+  FLAC__uint64 firstFrameOffset;
+  if (!decoder.get_decode_position(&firstFrameOffset)) {
+    throw std::runtime_error("failed to get position of the first frame");
+  }
+  if (ptrSeekPoints) {
+    mFirstFrameOffset = firstFrameOffset;
+  }
+  decoderInstance.positionAvailable = true;
+  decoderInstance.position = 0;
 }
 
 
-bool SourceToAudioSourceFLAC::IsCompressed() const {
-  return true;
-}
+// returns the idle decoder nearest to sample, adding a decoder to the pool if all of them are far
+// returns nullptr if no decoder is available
+SourceToAudioSourceFLAC::DecoderInstance* SourceToAudioSourceFLAC::AcquireDecoder(SourceOffset sample) {
+  std::unique_lock lock(mDecoderPoolMutex);
+
+  bool canAddDecoder = true;
+  while (true) {
+    // decoders which can reach sample by decoding forward are preferred
+    DecoderInstance* ptrNearestDecoder = nullptr;
+    bool nearestIsForward = false;
+    SourceOffset nearestDistance = 0;
+    for (const auto& decoderInstance : mDecoderPool) {
+      if (decoderInstance->busy) {
+        continue;
+      }
+      const bool forward = decoderInstance->positionAvailable && decoderInstance->position <= sample;
+      const SourceOffset distance = !decoderInstance->positionAvailable ? mTotalSamples : forward ? sample - decoderInstance->position : decoderInstance->position - sample;
+      if (!ptrNearestDecoder || (forward && !nearestIsForward) || (forward == nearestIsForward && distance < nearestDistance)) {
+        ptrNearestDecoder = decoderInstance.get();
+        nearestIsForward = forward;
+        nearestDistance = distance;
+      }
+    }
 
+    const bool nearestIsNear = ptrNearestDecoder && nearestIsForward && nearestDistance <= FrameIndexInterval;
+    if (!nearestIsNear && canAddDecoder && mDecoderPool.size() < MaxDecoders) {
+      // keep positions of the other decoders for other readers; initialize a new one outside the lock
+      auto newDecoderInstance = std::make_unique<DecoderInstance>();
+      newDecoderInstance->busy = true;
+      const auto ptrNewDecoderInstance = newDecoderInstance.get();
+      mDecoderPool.emplace_back(std::move(newDecoderInstance));
+      lock.unlock();
+
+      bool initialized = false;
+      try {
+        InitializeDecoder(*ptrNewDecoderInstance, nullptr);
+        initialized = true;
+      } catch (...) {}
+
+      lock.lock();
+      if (initialized) {
+        return ptrNewDecoderInstance;
+      }
+      mDecoderPool.erase(std::find_if(mDecoderPool.begin(), mDecoderPool.end(), [ptrNewDecoderInstance](const std::unique_ptr<DecoderInstance>& decoderInstance) {
+        return decoderInstance.get() == ptrNewDecoderInstance;
+      }));
+      canAddDecoder = false;
+      continue;
+    }
 
-std::size_t SourceToAudioSourceFLAC::GetChannels() const {
-  return mChannelInfo.size();
-}
+    if (ptrNearestDecoder) {
+      ptrNearestDecoder->busy = true;
+      return ptrNearestDecoder;
+    }
 
+    if (mDecoderPool.empty()) {
+      return nullptr;
+    }
 
-AudioSource::ChannelInfo SourceToAudioSourceFLAC::GetChannelInfo(std::size_t channelIndex) const {
-  if (channelIndex >= mChannelInfo.size()) {
-    return ChannelInfo::None;
+    mDecoderPoolCondition.wait(lock);
   }
-  return mChannelInfo[channelIndex];
 }
 
 
-AudioSource::DataType SourceToAudioSourceFLAC::GetDataType() const {
-  return mDataType;
+void SourceToAudioSourceFLAC::ReleaseDecoder(DecoderInstance& decoderInstance) {
+  {
+    std::lock_guard lock(mDecoderPoolMutex);
+
+    decoderInstance.busy = false;
+  }
+  mDecoderPoolCondition.notify_one();
 }
 
 
-std::uint_fast32_t SourceToAudioSourceFLAC::GetSamplingRate() const {
-  return mSamplingRate;
+void SourceToAudioSourceFLAC::ResetDecoder(DecoderInstance& decoderInstance) {
+  auto& decoder = *static_cast<FLACDecoderImpl*>(decoderInstance.decoder.get());
+  decoder.flush();
+  if constexpr (EnableMD5Check) {
+    decoder.set_md5_checking(true);
+  }
+  decoderInstance.error = false;
+  decoderInstance.positionAvailable = false;
 }
 
 
-Source::SourceSize SourceToAudioSourceFLAC::GetSize() {
-  return mTotalSize;
+// starts ScanFrameIndex in mFrameIndexScanThread unless the index is built or being built; mFrameIndexMutex must be locked
+void SourceToAudioSourceFLAC::StartFrameIndexScan() {
+  if (mFrameIndexBuilt || mFrameIndexScanThread.joinable()) {
+    return;
+  }
+
+  try {
+    mFrameIndexScanThread = std::thread([this]() {
+      try {
+        ScanFrameIndex();
+      } catch (...) {
+        // seeks keep falling back to seek_absolute
+      }
+    });
+  } catch (...) {
+    // same as above; the scan is tried again on the next seek
+  }
 }
 
 
-NTSTATUS SourceToAudioSourceFLAC::Read(SourceOffset offset, std::byte* buffer, std::size_t size, std::size_t* readSize) {
-  if (mChannelInfo.size() != NumChannels || mDataType != DataType::Int16) {
-    return STATUS_UNSUCCESSFUL;
-  }
+// scans the whole stream for frame headers and merges them into mFrameIndex; called in mFrameIndexScanThread
+// mFrameIndexMutex is only locked for the merge so that seeks and AddFrameIndexEntry are not blocked by the scan
+// frame headers are validated with their CRC-8 and their sample numbers, which must be continuous
+void SourceToAudioSourceFLAC::ScanFrameIndex() {
+#ifdef _DEBUG
+  OutputDebugStringW(L"SourceToAudioSourceFLAC::ScanFrameIndex: begin\n");
+#endif
 
-  if (!size) {
-    if (readSize) {
-      *readSize = 0;
+  const auto sourceSize = mSource->GetSize();
+  auto buffer = std::make_unique<std::byte[]>(ScanBufferSize);
+  const auto data = reinterpret_cast<const std::uint8_t*>(buffer.get());
+
+  std::vector<FrameIndexEntry> frameIndex;
+  SourceOffset bufferOffset = mFirstFrameOffset;
+  std::size_t bufferSize = 0;
+  std::size_t position = 0;
+  SourceOffset nextSample = 0;
+  std::optional<bool> variableBlockSize;
+  std::uint_fast32_t fixedBlockSize = 0;
+  while (nextSample < mTotalSamples) {
+    if (mFrameIndexScanTerminate.load(std::memory_order_relaxed)) {
+      return;
+    }
+    if (bufferSize - position < MaxFrameHeaderSize && bufferOffset + bufferSize < sourceSize) {
+      std::memmove(buffer.get(), buffer.get() + position, bufferSize - position);
+      bufferOffset += position;
+      bufferSize -= position;
+      position = 0;
+      std::size_t readSize = 0;
+      if (mSource->Read(bufferOffset + bufferSize, buffer.get() + bufferSize, ScanBufferSize - bufferSize, &readSize) != STATUS_SUCCESS || !readSize) {
+        break;
+      }
+      bufferSize += readSize;
+    }
+    if (position >= bufferSize) {
+      break;
     }
-    return STATUS_SUCCESS;
-  }
 
-  std::lock_guard lock(mMutex);
+    const auto ptrSync = static_cast<const std::uint8_t*>(std::memchr(data + position, 0xFF, bufferSize - position));
+    if (!ptrSync) {
+      position = bufferSize;
+      continue;
+    }
+    position = static_cast<std::size_t>(ptrSync - data);
+    if (bufferSize - position < MaxFrameHeaderSize && bufferOffset + bufferSize < sourceSize) {
+      // read more data before parsing
+      continue;
+    }
 
-  const auto requestedByteEnd = offset + size;
-  const auto unalignedOffset = offset % Alignment;
-  const auto requestedSampleBegin = offset / Alignment;
+    const auto frameHeader = ParseFrameHeader(data + position, bufferSize - position);
+    if (!frameHeader || frameHeader->variableBlockSize != variableBlockSize.value_or(frameHeader->variableBlockSize)) {
+      position++;
+      continue;
+    }
+    // the number of the first frame is 0 in both blocking strategies
+    const SourceOffset firstSample = frameHeader->variableBlockSize || !variableBlockSize ? frameHeader->number : frameHeader->number * fixedBlockSize;
+    if (firstSample != nextSample) {
+      position++;
+      continue;
+    }
 
-  bool needsSeek = true;
-  if (mLastFLACAvailable) {
-    const auto& lastFLACFrame = *reinterpret_cast<FLAC__Frame*>(mLastFLACFrame.get());
-    const auto firstSampleIndex = lastFLACFrame.header.number.sample_number;
-    const auto numSamplesInBlock = lastFLACFrame.header.blocksize;
-    const auto lastSampleIndex = firstSampleIndex + numSamplesInBlock;
+    if (!variableBlockSize) {
+      // first frame
+      variableBlockSize = frameHeader->variableBlockSize;
+      fixedBlockSize = frameHeader->blockSize;
+    }
+    if (frameIndex.empty() || firstSample - frameIndex.back().sample >= FrameIndexInterval) {
+      frameIndex.push_back(FrameIndexEntry{
+        firstSample,
+        bufferOffset + position,
+      });
+    }
+    nextSample += frameHeader->blockSize;
+    position += frameHeader->size;
+  }
+
+  std::lock_guard lock(mFrameIndexMutex);
 
-    if (firstSampleIndex <= requestedSampleBegin && requestedSampleBegin <= lastSampleIndex) {
-      needsSeek = false;
+  // merge with the entries added while decoding
+  const auto numScannedEntries = frameIndex.size();
+  frameIndex.insert(frameIndex.end(), mFrameIndex.begin(), mFrameIndex.end());
+  std::inplace_merge(frameIndex.begin(), frameIndex.begin() + numScannedEntries, frameIndex.end(), [](const FrameIndexEntry& a, const FrameIndexEntry& b) {
+    return a.sample < b.sample;
+  });
+  mFrameIndex.clear();
+  for (const auto& entry : frameIndex) {
+    if (mFrameIndex.empty() || entry.sample - mFrameIndex.back().sample >= FrameIndexInterval) {
+      mFrameIndex.push_back(entry);
     }
+  }
+  mFrameIndexBuilt = true;
 
 #ifdef _DEBUG
-    const std::wstring debugStr = L"SourceToAudioSourceFLAC::Read: first = "s + std::to_wstring(firstSampleIndex) + L", last = "s + std::to_wstring(lastSampleIndex) + L", requested = "s + std::to_wstring(requestedSampleBegin) + L", needsSeek = "s + std::to_wstring(needsSeek) + L" \n"s;
-    OutputDebugStringW(debugStr.c_str());
+  const std::wstring debugStr = L"SourceToAudioSourceFLAC::ScanFrameIndex: end; scanned up to sample "s + std::to_wstring(nextSample) + L" of "s + std::to_wstring(mTotalSamples) + L", "s + std::to_wstring(mFrameIndex.size()) + L" entries\n"s;
+  OutputDebugStringW(debugStr.c_str());
 #endif
+}
+
+
+void SourceToAudioSourceFLAC::AddFrameIndexEntry(SourceOffset sample, SourceOffset byteOffset) {
+  // entries are optional; do not wait for the merge of the scan or another decoder
+  std::unique_lock lock(mFrameIndexMutex, std::try_to_lock);
+  if (!lock) {
+    return;
+  }
+
+  const auto itr = std::upper_bound(mFrameIndex.begin(), mFrameIndex.end(), sample, [](SourceOffset sample, const FrameIndexEntry& entry) {
+    return sample < entry.sample;
+  });
+  if (itr != mFrameIndex.begin() && sample - std::prev(itr)->sample < FrameIndexInterval) {
+    return;
+  }
+  if (itr != mFrameIndex.end() && itr->sample - sample < FrameIndexInterval) {
+    return;
   }
+  mFrameIndex.insert(itr, FrameIndexEntry{
+    sample,
+    byteOffset,
+  });
+}
+
+
+SourceToAudioSourceFLAC::DecodedFramePtr SourceToAudioSourceFLAC::FindCachedFrame(SourceOffset sample) {
+  std::lock_guard lock(mFrameCacheMutex);
+
+  const auto itr = mFrameCacheMap.upper_bound(sample);
+  if (itr == mFrameCacheMap.begin()) {
+    return nullptr;
+  }
+  const auto itrFrame = std::prev(itr)->second;
+  if (sample >= (*itrFrame)->firstSample + (*itrFrame)->numSamples) {
+    return nullptr;
+  }
+  mFrameCache.splice(mFrameCache.begin(), mFrameCache, itrFrame);
+  return *itrFrame;
+}
 
-  auto& decoder = *static_cast<FLACDecoderImpl*>(mDecoder.get());
-  if (mError) {
-    decoder.flush();
-    if constexpr (EnableMD5Check) {
-      decoder.set_md5_checking(true);
+
+SourceToAudioSourceFLAC::DecodedFramePtr SourceToAudioSourceFLAC::AddCachedFrame(SourceOffset firstSample, std::size_t numSamples, const std::int32_t* const* buffer) {
+  const auto numChannels = mChannelInfo.size();
+  const auto frameBytes = numSamples * numChannels * sizeof(std::int32_t);
+
+  // copy outside the lock; frames evicted while being read by other threads are kept alive by their references
+  auto frame = std::make_shared<DecodedFrame>();
+  frame->firstSample = firstSample;
+  frame->numSamples = numSamples;
+  frame->samples.resize(numSamples * numChannels);
+  const auto shift = mBytesPerSample * 8 - mBitsPerSample;
+  for (std::size_t channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+    const auto ptrDestination = frame->samples.data() + numSamples * channelIndex;
+    if (!shift) {
+      std::memcpy(ptrDestination, buffer[channelIndex], numSamples * sizeof(std::int32_t));
+      continue;
+    }
+    // left-justify samples as in WAV
+    for (std::size_t sampleIndex = 0; sampleIndex < numSamples; sampleIndex++) {
+      ptrDestination[sampleIndex] = static_cast<std::int32_t>(static_cast<std::uint32_t>(buffer[channelIndex][sampleIndex]) << shift);
     }
-    mError = false;
   }
-  auto currentByteOffset = offset;
-  auto currentBufferPointer = buffer;
-  bool finished = false;
+
+  std::lock_guard lock(mFrameCacheMutex);
+
+  const auto removeFrame = [this](std::list<DecodedFramePtr>::iterator itrFrame) {
+    mFrameCacheBytes -= (*itrFrame)->samples.size() * sizeof(std::int32_t);
+    mFrameCacheMap.erase((*itrFrame)->firstSample);
+    mFrameCache.erase(itrFrame);
+  };
+  if (const auto itr = mFrameCacheMap.find(firstSample); itr != mFrameCacheMap.end()) {
+    removeFrame(itr->second);
+  }
+  while (!mFrameCache.empty() && mFrameCacheBytes + frameBytes > FrameCacheCapacity) {
+    removeFrame(std::prev(mFrameCache.end()));
+  }
+
+  mFrameCache.push_front(frame);
+  mFrameCacheMap.emplace(firstSample, mFrameCache.begin());
+  mFrameCacheBytes += frameBytes;
+
+  return frame;
+}
+
+
+// decodes frames until the one which contains sample is decoded, and stores it to frame
+NTSTATUS SourceToAudioSourceFLAC::DecodeFrame(DecoderInstance& decoderInstance, SourceOffset sample, DecodedFramePtr& frame) {
+  auto& decoder = *static_cast<FLACDecoderImpl*>(decoderInstance.decoder.get());
+  if (decoderInstance.error) {
+    ResetDecoder(decoderInstance);
+  }
+
   bool outOfRange = false;
-  decoder.SetWriteCallback([this, &currentByteOffset, &currentBufferPointer, &finished, &outOfRange, requestedByteEnd](const FLAC__Frame* frame, const FLAC__int32* const srcBuffer[]) -> FLAC__StreamDecoderWriteStatus {
-    if (frame->header.channels != mChannelInfo.size() || frame->header.sample_rate != mSamplingRate || frame->header.bits_per_sample != 16) {
+  decoder.SetWriteCallback([this, &decoderInstance, sample, &frame, &outOfRange](const FLAC__Frame* flacFrame, const FLAC__int32* const srcBuffer[]) -> FLAC__StreamDecoderWriteStatus {
+    if (flacFrame->header.channels != mChannelInfo.size() || flacFrame->header.sample_rate != mSamplingRate || flacFrame->header.bits_per_sample != mBitsPerSample) {
       // format changed?
-      finished = true;
       return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
     }
 
-    const auto firstSampleIndex = frame->header.number.sample_number;
-    const auto numSamplesInBlock = frame->header.blocksize;
+    const auto firstSampleIndex = flacFrame->header.number.sample_number;
+    const auto numSamplesInBlock = flacFrame->header.blocksize;
     const auto lastSampleIndex = firstSampleIndex + numSamplesInBlock;
 
-    const auto currentSampleOffset = currentByteOffset / Alignment;
-    if (firstSampleIndex > currentSampleOffset || currentSampleOffset >= lastSampleIndex) {
-      // out of range
-      if (firstSampleIndex > currentSampleOffset) {
-        outOfRange = true;
-      }
+    decoderInstance.positionAvailable = true;
+    decoderInstance.position = lastSampleIndex;
+
+    if (firstSampleIndex > sample) {
+      outOfRange = true;
       return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
     }
+    if (sample < lastSampleIndex) {
+      frame = AddCachedFrame(firstSampleIndex, numSamplesInBlock, srcBuffer);
+    }
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+  });
 
-    const auto copiedSize = CopyAudioFromFLACBlock(*frame, srcBuffer, currentBufferPointer, currentByteOffset, requestedByteEnd);
-    currentBufferPointer += copiedSize;
-    currentByteOffset += copiedSize;
-    finished = currentByteOffset == requestedByteEnd;
+  const auto decodeUntilSample = [this, &decoderInstance, &decoder, sample, &outOfRange]() -> NTSTATUS {
+    while (!decoderInstance.positionAvailable || decoderInstance.position <= sample) {
+      if (!decoder.process_single() || decoderInstance.error || outOfRange) {
+        decoderInstance.error = true;
+        return STATUS_UNSUCCESSFUL;
+      }
+      switch (decoder.get_state()) {
+        case FLAC__STREAM_DECODER_END_OF_STREAM:
+        case FLAC__STREAM_DECODER_OGG_ERROR:
+        case FLAC__STREAM_DECODER_SEEK_ERROR:
+        case FLAC__STREAM_DECODER_ABORTED:
+        case FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR:
+        case FLAC__STREAM_DECODER_UNINITIALIZED:
+          decoderInstance.error = true;
+          return STATUS_UNSUCCESSFUL;
+
+        default:
+          break;
+      }
+      // the decoder is at the beginning of the next frame
+      if (FLAC__uint64 position; decoderInstance.positionAvailable && decoderInstance.position < mTotalSamples && decoder.get_decode_position(&position)) {
+        AddFrameIndexEntry(decoderInstance.position, position);
+      }
+    }
+    return STATUS_SUCCESS;
+  };
 
-    if (finished) {
-      // copy FLAC data for next use
-      if (!mLastFLACAvailable || frame->header.number.sample_number != reinterpret_cast<const FLAC__Frame*>(mLastFLACFrame.get())->header.number.sample_number) {
-#ifdef _DEBUG
-        const std::wstring debugStr = L"SourceToAudioSourceFLAC::Read: copy FLAC Frame; old = "s + (mLastFLACAvailable ? std::to_wstring(reinterpret_cast<const FLAC__Frame*>(mLastFLACFrame.get())->header.number.sample_number) : L"null"s) + L", new = "s + std::to_wstring(frame->header.number.sample_number) + L"\n"s;
-        OutputDebugStringW(debugStr.c_str());
-#endif
-        mLastFLACAvailable = true;
-        *reinterpret_cast<FLAC__Frame*>(mLastFLACFrame.get()) = *frame;
-        std::size_t blockSize = frame->header.blocksize * sizeof(FLAC__int32);
-        mLastFLACBufferData = std::make_unique<std::byte[]>(blockSize * frame->header.channels);
-        for (std::size_t i = 0; i < frame->header.channels; i++) {
-          mLastFLACBufferPointers[i] = mLastFLACBufferData.get() + blockSize * i;
-          std::memcpy(mLastFLACBufferPointers[i], srcBuffer[i], blockSize);
-        }
-      } else {
+  // decoding forward is cheaper than seeking if the sample is near
+  const bool canDecodeForward = decoderInstance.positionAvailable && decoderInstance.position <= sample;
+  if (canDecodeForward && sample - decoderInstance.position <= FrameIndexInterval) {
+    return decodeUntilSample();
+  }
+
+  std::optional<FrameIndexEntry> entry;
+  bool indexed = false;
+  {
+    std::lock_guard lock(mFrameIndexMutex);
+
+    // entries added while decoding are used until the scan completes
+    StartFrameIndexScan();
+
+    const auto itrEntry = std::upper_bound(mFrameIndex.begin(), mFrameIndex.end(), sample, [](SourceOffset sample, const FrameIndexEntry& entry) {
+      return sample < entry.sample;
+    });
+    // until the scan completes, the index only has the entries added while decoding, which can be far before sample
+    indexed = itrEntry != mFrameIndex.begin() && (mFrameIndexBuilt || sample - std::prev(itrEntry)->sample <= FrameIndexInterval);
+    if (indexed && (!canDecodeForward || std::prev(itrEntry)->sample > decoderInstance.position)) {
+      entry = *std::prev(itrEntry);
+    }
+  }
+
+  if (entry) {
 #ifdef _DEBUG
-        const std::wstring debugStr = L"SourceToAudioSourceFLAC::Read: skipped copying FLAC Frame\n"s;
-        OutputDebugStringW(debugStr.c_str());
+    const std::wstring debugStr = L"SourceToAudioSourceFLAC::DecodeFrame: requested = "s + std::to_wstring(sample) + L", seek to sample "s + std::to_wstring(entry->sample) + L" at "s + std::to_wstring(entry->byteOffset) + L"\n"s;
+    OutputDebugStringW(debugStr.c_str());
 #endif
-      }
+
+    ResetDecoder(decoderInstance);
+    decoder.SetPosition(entry->byteOffset);
+    decoderInstance.positionAvailable = true;
+    decoderInstance.position = entry->sample;
+    if (decodeUntilSample() == STATUS_SUCCESS) {
+      return STATUS_SUCCESS;
     }
 
-    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
-  });
-  if (needsSeek) {
+    // the index may be wrong; fall back to the seek of libFLAC
+    ResetDecoder(decoderInstance);
+    outOfRange = false;
+  }
+
+  // decode forward only if the decoder is past a usable entry; otherwise the decoder may be far behind, e.g. at the first frame
+  if (!decoderInstance.positionAvailable || decoderInstance.position > sample || !indexed) {
 #ifdef _DEBUG
-    const std::wstring debugStr = L"SourceToAudioSourceFLAC::Read: seek_absolute "s + std::to_wstring(requestedSampleBegin) + L"\n"s;
+    const std::wstring debugStr = L"SourceToAudioSourceFLAC::DecodeFrame: seek_absolute "s + std::to_wstring(sample) + L"\n"s;
     OutputDebugStringW(debugStr.c_str());
 #endif
-    if (!decoder.seek_absolute(requestedSampleBegin)) {
+    // the frame containing sample is passed to the write callback during the seek
+    if (!decoder.seek_absolute(sample)) {
+      decoderInstance.error = true;
       return __NTSTATUS_FROM_WIN32(ERROR_SEEK);
     }
-  } else {
-    // mLastFLACAvailable is true if needsSeek is false
-    const auto copiedSize = CopyAudioFromFLACBlock(*reinterpret_cast<FLAC__Frame*>(mLastFLACFrame.get()), reinterpret_cast<const FLAC__int32* const*>(mLastFLACBufferPointers), currentBufferPointer, currentByteOffset, requestedByteEnd);
-    currentBufferPointer += copiedSize;
-    currentByteOffset += copiedSize;
-    finished = currentByteOffset == requestedByteEnd;
   }
-  bool isFirstOutOfRange = needsSeek;
-  while (!finished) {
-    if (!decoder.process_single()) {
-      return STATUS_UNSUCCESSFUL;
+
+  return decodeUntilSample();
+}
+
+
+bool SourceToAudioSourceFLAC::IsCompressed() const {
+  return true;
+}
+
+
+std::size_t SourceToAudioSourceFLAC::GetChannels() const {
+  return mChannelInfo.size();
+}
+
+
+AudioSource::ChannelInfo SourceToAudioSourceFLAC::GetChannelInfo(std::size_t channelIndex) const {
+  if (channelIndex >= mChannelInfo.size()) {
+    return ChannelInfo::None;
+  }
+  return mChannelInfo[channelIndex];
+}
+
+
+AudioSource::DataType SourceToAudioSourceFLAC::GetDataType() const {
+  return mDataType;
+}
+
+
+std::uint_fast32_t SourceToAudioSourceFLAC::GetSamplingRate() const {
+  return mSamplingRate;
+}
+
+
+Source::SourceSize SourceToAudioSourceFLAC::GetSize() {
+  return mTotalSize;
+}
+
+
+NTSTATUS SourceToAudioSourceFLAC::Read(SourceOffset offset, std::byte* buffer, std::size_t size, std::size_t* readSize) {
+  if (mChannelInfo.empty() || mChannelInfo.size() > MaxChannels || mDataType == DataType::Other) {
+    return STATUS_UNSUCCESSFUL;
+  }
+
+  if (!size || offset >= mTotalSize) {
+    if (readSize) {
+      *readSize = 0;
     }
-    if (outOfRange) {
-      if (isFirstOutOfRange) {
-        isFirstOutOfRange = false;
-      } else {
+    return STATUS_SUCCESS;
+  }
+
+  const auto requestedByteEnd = std::min<SourceOffset>(offset + size, mTotalSize);
+  auto currentByteOffset = offset;
+  auto currentBufferPointer = buffer;
+  while (currentByteOffset < requestedByteEnd) {
+    const auto currentSample = currentByteOffset / mBlockSize;
+    auto frame = FindCachedFrame(currentSample);
+    if (!frame) {
+      const auto ptrDecoderInstance = AcquireDecoder(currentSample);
+      if (!ptrDecoderInstance) {
         return STATUS_UNSUCCESSFUL;
       }
-    }
-    if (mError) {
-      return STATUS_UNSUCCESSFUL;
-    }
-    switch (decoder.get_state()) {
-      case FLAC__STREAM_DECODER_OGG_ERROR:
-      case FLAC__STREAM_DECODER_SEEK_ERROR:
-      case FLAC__STREAM_DECODER_ABORTED:
-      case FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR:
-      case FLAC__STREAM_DECODER_UNINITIALIZED:
+      const auto status = DecodeFrame(*ptrDecoderInstance, currentSample, frame);
+      ReleaseDecoder(*ptrDecoderInstance);
+      if (status != STATUS_SUCCESS) {
+        return status;
+      }
+      if (!frame) {
         return STATUS_UNSUCCESSFUL;
+      }
     }
-  };
+
+    const auto copiedSize = CopyAudioFromFLACBlock(frame->firstSample, frame->numSamples, frame->samples.data(), mChannelInfo.size(), mBytesPerSample, currentBufferPointer, currentByteOffset, requestedByteEnd);
+    currentBufferPointer += copiedSize;
+    currentByteOffset += copiedSize;
+  }
 
   if (readSize) {
     *readSize = static_cast<std::size_t>(currentByteOffset - offset);
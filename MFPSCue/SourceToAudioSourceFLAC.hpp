@@ -1,7 +1,14 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 #include "AudioSource.hpp"
@@ -9,21 +16,72 @@
 
 
 class SourceToAudioSourceFLAC : public AudioSource {
-  std::mutex mMutex;
-  bool mError;
-  std::shared_ptr<void> mDecoder;
+  struct FrameIndexEntry {
+    SourceOffset sample;
+    SourceOffset byteOffset;
+  };
+
+  struct DecodedFrame {
+    SourceOffset firstSample;
+    std::size_t numSamples;
+    std::vector<std::int32_t> samples;    // planar; samples of channel n begin at n * numSamples
+  };
+
+  using DecodedFramePtr = std::shared_ptr<const DecodedFrame>;
+
+  // an independent decoder; used by one thread at a time
+  struct DecoderInstance {
+    std::shared_ptr<void> decoder;
+    bool busy;    // guarded by mDecoderPoolMutex
+    bool error;
+    // first sample of the frame which the decoder outputs next
+    bool positionAvailable;
+    SourceOffset position;
+  };
+
+  std::shared_ptr<Source> mSource;
   unsigned long mSamplingRate;
   std::vector<ChannelInfo> mChannelInfo;
   DataType mDataType;
+  unsigned int mBitsPerSample;
+  std::size_t mBytesPerSample;
+  std::size_t mBlockSize;
   SourceSize mTotalSamples;
   SourceSize mTotalSize;
-  bool mLastFLACAvailable;
-  std::unique_ptr<std::byte[]> mLastFLACFrame;
-  std::unique_ptr<std::byte[]> mLastFLACBufferData;
-  void* mLastFLACBufferPointers[8];
+  SourceOffset mFirstFrameOffset;
+
+  std::mutex mDecoderPoolMutex;
+  std::condition_variable mDecoderPoolCondition;
+  std::vector<std::unique_ptr<DecoderInstance>> mDecoderPool;
+
+  // built from SEEKTABLE, or by scanning frame headers in mFrameIndexScanThread from the first seek if there is no SEEKTABLE
+  // entries are also added while decoding; seeks fall back to seek_absolute of libFLAC until the scan completes
+  std::mutex mFrameIndexMutex;
+  bool mFrameIndexBuilt;
+  std::vector<FrameIndexEntry> mFrameIndex;
+  std::thread mFrameIndexScanThread;    // started with mFrameIndexMutex locked
+  std::atomic<bool> mFrameIndexScanTerminate;
+
+  // most recently used first
+  std::mutex mFrameCacheMutex;
+  std::list<DecodedFramePtr> mFrameCache;
+  std::map<SourceOffset, std::list<DecodedFramePtr>::iterator> mFrameCacheMap;
+  std::size_t mFrameCacheBytes;
+
+  void InitializeDecoder(DecoderInstance& decoderInstance, std::vector<FrameIndexEntry>* ptrSeekPoints);
+  DecoderInstance* AcquireDecoder(SourceOffset sample);
+  void ReleaseDecoder(DecoderInstance& decoderInstance);
+  void ResetDecoder(DecoderInstance& decoderInstance);
+  void StartFrameIndexScan();
+  void ScanFrameIndex();
+  void AddFrameIndexEntry(SourceOffset sample, SourceOffset byteOffset);
+  DecodedFramePtr FindCachedFrame(SourceOffset sample);
+  DecodedFramePtr AddCachedFrame(SourceOffset firstSample, std::size_t numSamples, const std::int32_t* const* buffer);
+  NTSTATUS DecodeFrame(DecoderInstance& decoderInstance, SourceOffset sample, DecodedFramePtr& frame);
 
 public:
   SourceToAudioSourceFLAC(std::shared_ptr<Source> source);
+  ~SourceToAudioSourceFLAC();
 
   bool IsCompressed() const override;
   std::size_t GetChannels() const override;
@@ -1,5 +1,6 @@
 #include <dokan/dokan.h>
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
@@ -28,6 +29,11 @@ SourceToAudioSourceWAV::SourceToAudioSourceWAV(std::shared_ptr<Source> source) {
   constexpr std::uint32_t SignatureWAVE = 0x45564157;
   constexpr std::uint32_t Signaturefmt  = 0x20746D66;
   constexpr std::uint32_t Signaturedata = 0x61746164;
+  constexpr std::uint16_t FormatPCM = 0x0001;
+  constexpr std::uint16_t FormatExtensible = 0xFFFE;
+  constexpr std::array<std::uint8_t, 16> SubFormatPCM{
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71,
+  };
 
   const auto sourceSize = source->GetSize();
   if (sourceSize < 12) {
@@ -64,7 +70,7 @@ SourceToAudioSourceWAV::SourceToAudioSourceWAV(std::shared_ptr<Source> source) {
           throw std::runtime_error("too many fmt chunk");
         }
 
-        if (currentChunkSize != 16) {
+        if (currentChunkSize < 16) {
           throw std::runtime_error("unsupported format");
         }
         auto tempOffset = offset;
@@ -80,12 +86,28 @@ SourceToAudioSourceWAV::SourceToAudioSourceWAV(std::shared_ptr<Source> source) {
         tempOffset += sizeof(blockSize);
         const auto bitsPerSample = ReadData<std::uint16_t>(*source, tempOffset);
         tempOffset += sizeof(bitsPerSample);
-        if (formatId != 1) {
+        std::uint32_t channelMask = 0;
+        if (formatId == FormatExtensible) {
+          if (currentChunkSize < 40) {
+            throw std::runtime_error("unsupported format");
+          }
+          // skip cbSize and wValidBitsPerSample; samples are left-justified anyway
+          tempOffset += 4;
+          channelMask = ReadData<std::uint32_t>(*source, tempOffset);
+          tempOffset += sizeof(channelMask);
+          if (ReadData<std::array<std::uint8_t, 16>>(*source, tempOffset) != SubFormatPCM) {
+            throw std::runtime_error("unsupported format");
+          }
+        } else if (formatId != FormatPCM) {
           throw std::runtime_error("unsupported format");
         }
         mSamplingRate = samplingRate;
-        mDataType = bitsPerSample == 16 ? DataType::Int16 : DataType::Other;
-        if (numChannels == 2) {
+        mDataType = bitsPerSample % 8 == 0 && blockSize == numChannels * (bitsPerSample / 8) ? GetDataTypeFromBytesPerSample(bitsPerSample / 8) : DataType::Other;
+        if (channelMask) {
+          mChannelInfo = GetChannelInfoFromMask(channelMask, numChannels);
+        } else if (numChannels == 1) {
+          mChannelInfo.emplace_back(ChannelInfo::Center);
+        } else if (numChannels == 2) {
           mChannelInfo.emplace_back(ChannelInfo::Left);
           mChannelInfo.emplace_back(ChannelInfo::Right);
         } else {
@@ -5,6 +5,7 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <utility>
 
 #include <Windows.h>
@@ -22,6 +23,22 @@ using namespace std::literals;
 
 
 
+namespace {
+  // FindFirstFileWはパターン中の'?'や"*."、".*"をDOSワイルドカードに変換し、末尾のピリオドや空白を取り除く
+  // カーネルから渡されるパターンは変換済みなので、その影響を受けないものだけをそのまま渡せる
+  bool IsWin32CompatiblePattern(std::wstring_view pattern) noexcept {
+    if (pattern.empty() || pattern.back() == L'.' || pattern.back() == L' ') {
+      return false;
+    }
+    if (pattern.find_first_of(L"?<>\"/\\") != std::wstring_view::npos) {
+      return false;
+    }
+    return pattern.find(L"*."sv) == std::wstring_view::npos && pattern.find(L".*"sv) == std::wstring_view::npos;
+  }
+}
+
+
+
 FilesystemSourceMount::Portation::Portation(FilesystemSourceMount& sourceMount, PORTATION_INFO* portationInfo) :
   sourceMount(sourceMount),
   filepath(portationInfo->filepath),
@@ -57,6 +74,8 @@ FilesystemSourceMount::ExportPortation::ExportPortation(FilesystemSourceMount& s
   Portation(sourceMount, portationInfo)
 {
   lastNumberOfBytesWritten = 0;
+  bufferSize = 0;
+  chunkSize = MinChunkSize;
 
   const DWORD fileAttributes = GetFileAttributesW(realPath.c_str());
   if (fileAttributes == INVALID_FILE_ATTRIBUTES) {
@@ -65,11 +84,6 @@ FilesystemSourceMount::ExportPortation::ExportPortation(FilesystemSourceMount& s
 
   directory = fileAttributes != FILE_ATTRIBUTE_NORMAL && (fileAttributes & FILE_ATTRIBUTE_DIRECTORY);
 
-  // allocate buffer
-  if (!directory) {
-    buffer = std::make_unique<char[]>(BufferSize);
-  }
-
   // create file handle if needed
   if (!util::IsValidHandle(hFile)) {
     hFile = directory
@@ -100,6 +114,12 @@ FilesystemSourceMount::ExportPortation::ExportPortation(FilesystemSourceMount& s
   portationInfo->fileSize.HighPart = byHandleFileInformation.nFileSizeHigh;
   portationInfo->fileSize.LowPart = byHandleFileInformation.nFileSizeLow;
 
+  // allocate buffer
+  if (!directory) {
+    bufferSize = static_cast<std::size_t>(std::min<ULONGLONG>(portationInfo->fileSize.QuadPart, MaxChunkSize));
+    buffer = std::make_unique<char[]>(bufferSize);
+  }
+
   // TODO: Set Security Information
   portationInfo->securitySize = 0;
   portationInfo->securityData = nullptr;
@@ -117,10 +137,11 @@ NTSTATUS FilesystemSourceMount::ExportPortation::Export(PORTATION_INFO* portatio
 
   portationInfo->currentOffset.QuadPart += lastNumberOfBytesWritten;
 
-  const std::size_t size = static_cast<std::size_t>(std::min<ULONGLONG>(portationInfo->fileSize.QuadPart - portationInfo->currentOffset.QuadPart, BufferSize));
+  const std::size_t size = static_cast<std::size_t>(std::min<ULONGLONG>(portationInfo->fileSize.QuadPart - portationInfo->currentOffset.QuadPart, std::min(chunkSize, bufferSize)));
   if (size == 0) {
     return STATUS_ALREADY_COMPLETE;
   }
+  chunkSize = std::min(chunkSize * 2, MaxChunkSize);
 
   if (!ReadFile(hFile, buffer.get(), static_cast<DWORD>(size), &lastNumberOfBytesWritten, NULL)) {
     lastNumberOfBytesWritten = 0;
@@ -381,6 +402,36 @@ NTSTATUS FilesystemSourceMount::ListFiles(LPCWSTR FileName, PListFilesCallback C
 }
 
 
+// 一致するものだけをファイルシステムに列挙させる
+// FindFirstFileWは短い名前（8.3形式）にも一致させるが、LibMergeFS側で再度フィルタされるので問題ない
+NTSTATUS FilesystemSourceMount::ListFilesWithPattern(LPCWSTR FileName, LPCWSTR SearchPattern, PListFilesCallback Callback, CALLBACK_CONTEXT CallbackContext) {
+  if (!SearchPattern || !IsWin32CompatiblePattern(SearchPattern)) {
+    return SourceMountBase::ListFilesWithPattern(FileName, SearchPattern, Callback, CallbackContext);
+  }
+  const std::wstring realPath = GetRealPath(FileName);
+  const std::wstring filter = realPath + L"\\"s + SearchPattern;
+  WIN32_FIND_DATAW win32FindData;
+  HANDLE hFind = FindFirstFileW(filter.c_str(), &win32FindData);
+  if (hFind == INVALID_HANDLE_VALUE) {
+    if (GetLastError() == ERROR_FILE_NOT_FOUND) {
+      // 一致するファイルが無いだけの場合
+      const DWORD fileAttributes = GetFileAttributesW(realPath.c_str());
+      if (fileAttributes != INVALID_FILE_ATTRIBUTES && (fileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return STATUS_SUCCESS;
+      }
+    }
+    // ListFilesと同じエラーを返すようにする
+    return SourceMountBase::ListFilesWithPattern(FileName, SearchPattern, Callback, CallbackContext);
+  }
+  do {
+    Callback(&win32FindData, CallbackContext);
+  } while (FindNextFileW(hFind, &win32FindData));
+  const DWORD error = GetLastError();
+  FindClose(hFind);
+  return error == ERROR_SUCCESS || error == ERROR_NO_MORE_FILES ? STATUS_SUCCESS : NtstatusFromWin32(error);
+}
+
+
 NTSTATUS FilesystemSourceMount::ListStreams(LPCWSTR FileName, PListStreamsCallback Callback, CALLBACK_CONTEXT CallbackContext) {
   const std::wstring realPath = GetRealPath(FileName);
   WIN32_FIND_STREAM_DATA win32FindStreamData;
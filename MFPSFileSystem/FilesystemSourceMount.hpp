@@ -38,11 +38,16 @@ class FilesystemSourceMount : public SourceMountBase {
 
 
   class ExportPortation : public Portation {
-    static constexpr std::size_t BufferSize = 4096;
+    // chunk size starts at MinChunkSize and doubles on every Export up to MaxChunkSize
+    // this keeps small files cheap while reducing the number of round trips for large files
+    static constexpr std::size_t MinChunkSize = 64 * 1024;
+    static constexpr std::size_t MaxChunkSize = 4 * 1024 * 1024;
 
     bool directory;
     BY_HANDLE_FILE_INFORMATION byHandleFileInformation;
     std::unique_ptr<char[]> buffer;
+    std::size_t bufferSize;
+    std::size_t chunkSize;
     DWORD lastNumberOfBytesWritten;
 
   public:
@@ -102,6 +107,7 @@ public:
   NTSTATUS GetDirectoryInfo(LPCWSTR FileName) override;
   NTSTATUS RemoveFile(LPCWSTR FileName) override;
   NTSTATUS ListFiles(LPCWSTR FileName, PListFilesCallback Callback, CALLBACK_CONTEXT CallbackContext) override;
+  NTSTATUS ListFilesWithPattern(LPCWSTR FileName, LPCWSTR SearchPattern, PListFilesCallback Callback, CALLBACK_CONTEXT CallbackContext) override;
   NTSTATUS ListStreams(LPCWSTR FileName, PListStreamsCallback Callback, CALLBACK_CONTEXT CallbackContext) override;
   NTSTATUS SwitchDestinationPrepareImpl(LPCWSTR FileName, PDOKAN_IO_SECURITY_CONTEXT SecurityContext, ACCESS_MASK DesiredAccess, ULONG FileAttributes, ULONG ShareAccess, ULONG CreateDisposition, ULONG CreateOptions, PDOKAN_FILE_INFO DokanFileInfo, FILE_CONTEXT_ID FileContextId) override;
   NTSTATUS SwitchDestinationCleanupImpl(LPCWSTR FileName, PDOKAN_FILE_INFO DokanFileInfo, FILE_CONTEXT_ID FileContextId) override;
@@ -202,6 +202,11 @@ NTSTATUS WINAPI ListFiles(LPCWSTR FileName, PListFilesCallback Callback, CALLBAC
 }
 
 
+NTSTATUS WINAPI ListFilesWithPattern(LPCWSTR FileName, LPCWSTR SearchPattern, PListFilesCallback Callback, CALLBACK_CONTEXT CallbackContext, SOURCE_CONTEXT_ID sourceContextId) MFNOEXCEPT {
+  return ListFiles(FileName, Callback, CallbackContext, sourceContextId);
+}
+
+
 NTSTATUS WINAPI ListStreams(LPCWSTR FileName, PListStreamsCallback Callback, CALLBACK_CONTEXT CallbackContext, SOURCE_CONTEXT_ID sourceContextId) MFNOEXCEPT {
   if (IsRootDirectory(FileName)) {
     return STATUS_SUCCESS;
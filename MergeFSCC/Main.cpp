@@ -214,6 +214,8 @@ int CommandMount(const std::deque<std::wstring>& args) {
       0,
       0,
     },
+    MERGEFS_METADATA_DURABILITY_DEFAULT,
+    0,
   };
   MOUNT_ID mountId;
   if (!LMF_Mount(&mountInitializeInfo, [](MOUNT_ID mountId, const MOUNT_INFO* mountInfo, int dokanMainResult) noexcept -> void {
@@ -238,6 +238,25 @@ MOUNT_ID MountManager::AddMount(const std::wstring& configFilepath, std::functio
   } catch (YAML::BadConversion&) {
   } catch (YAML::InvalidNode&) {}
 
+  DWORD metadataDurability = MERGEFS_METADATA_DURABILITY_DEFAULT;
+  try {
+    const auto durability = yaml["metadataDurability"].as<std::string>();
+    if (durability == "perOperation") {
+      metadataDurability = MERGEFS_METADATA_DURABILITY_PEROPERATION;
+    } else if (durability == "batched") {
+      metadataDurability = MERGEFS_METADATA_DURABILITY_BATCHED;
+    } else if (durability == "onFlush") {
+      metadataDurability = MERGEFS_METADATA_DURABILITY_ONFLUSH;
+    }
+  } catch (YAML::BadConversion&) {
+  } catch (YAML::InvalidNode&) {}
+
+  DWORD metadataCommitDelay = 0;
+  try {
+    metadataCommitDelay = yaml["metadataCommitDelay"].as<DWORD>();
+  } catch (YAML::BadConversion&) {
+  } catch (YAML::InvalidNode&) {}
+
   struct SourceInitializeInfoStorage {
     std::wstring mountSource;
     std::wstring sourcePluginFilename;
@@ -350,6 +369,8 @@ MOUNT_ID MountManager::AddMount(const std::wstring& configFilepath, std::functio
     static_cast<DWORD>(sourceInitializeInfos.size()),
     sourceInitializeInfos.data(),
     volumeInfoOverride,
+    metadataDurability,
+    metadataCommitDelay,
   };
 
   MOUNT_ID mountId = MOUNT_ID_NULL;
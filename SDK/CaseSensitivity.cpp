@@ -1,24 +1,126 @@
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
-#include <functional>
+#include <cstring>
+#include <cwchar>
 #include <string>
+#include <string_view>
+
+// the SSE2 kernels work on 16-bit code units, so they are used only where wchar_t is UTF-16
+#if (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)) && WCHAR_MAX <= 0xFFFF
+# define CASESENSITIVITY_USE_SSE2
+# include <emmintrin.h>
+#endif
 
 #include "CaseSensitivity.hpp"
 
 
 
 namespace CaseSensitivity {
-  std::size_t CiEqualTo::CaseSensitiveEqualTo(const std::wstring& a, const std::wstring& b) {
+  namespace {
+    // number of code units processed at once (one SSE2 register)
+    constexpr std::size_t BlockSize = 8;
+
+    constexpr std::uint64_t HashSeed = 0x9E3779B97F4A7C15;
+    constexpr std::uint64_t HashMultiplier = 0xFF51AFD7ED558CCD;
+    constexpr std::uint64_t FinalMultiplier = 0xC4CEB9FE1A85EC53;
+
+
+    constexpr std::uint16_t FoldCase(wchar_t c) noexcept {
+      return static_cast<std::uint16_t>(L'a' <= c && c <= L'z' ? c - L'a' + L'A' : c);
+    }
+
+
+#ifdef CASESENSITIVITY_USE_SSE2
+    __m128i LoadBlock(const wchar_t* ptr) noexcept {
+      return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+    }
+
+
+    bool IsEqualBlock(__m128i a, __m128i b) noexcept {
+      return _mm_movemask_epi8(_mm_cmpeq_epi16(a, b)) == 0xFFFF;
+    }
+
+
+    // converts 'a'-'z' to uppercase
+    // the comparisons are signed, so code units from U+8000 are never in range and are left as they are
+    __m128i FoldBlock(__m128i x) noexcept {
+      const auto lowercaseMask = _mm_and_si128(_mm_cmpgt_epi16(x, _mm_set1_epi16(L'a' - 1)), _mm_cmplt_epi16(x, _mm_set1_epi16(L'z' + 1)));
+      return _mm_sub_epi16(x, _mm_and_si128(lowercaseMask, _mm_set1_epi16(0x20)));
+    }
+#endif
+
+
+    // stores up to BlockSize code units (folded if fold is true) to block and pads the rest with zero
+    void LoadFoldedBlock(const wchar_t* ptr, std::size_t count, bool fold, std::uint16_t* block) {
+#ifdef CASESENSITIVITY_USE_SSE2
+      if (count == BlockSize) {
+        const auto x = LoadBlock(ptr);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(block), fold ? FoldBlock(x) : x);
+        return;
+      }
+#endif
+      for (std::size_t i = 0; i < count; i++) {
+        block[i] = fold ? FoldCase(ptr[i]) : static_cast<std::uint16_t>(ptr[i]);
+      }
+      std::fill(block + count, block + BlockSize, 0);
+    }
+
+
+    // where wchar_t is wider than 16 bits only the lower 16 bits of each code unit are hashed, which keeps the hash consistent with the equality
+    std::size_t HashBlocks(std::wstring_view x, bool fold) {
+      static_assert(BlockSize * sizeof(std::uint16_t) == sizeof(std::uint64_t) * 2);
+
+      std::uint64_t hash = HashSeed ^ x.size();
+      std::uint16_t block[BlockSize];
+      for (std::size_t pos = 0; pos < x.size(); pos += BlockSize) {
+        LoadFoldedBlock(x.data() + pos, std::min(x.size() - pos, BlockSize), fold, block);
+        std::uint64_t words[2];
+        std::memcpy(words, block, sizeof(words));
+        for (const auto word : words) {
+          hash = (hash ^ word) * HashMultiplier;
+          hash ^= hash >> 32;
+        }
+      }
+      hash ^= hash >> 29;
+      hash *= FinalMultiplier;
+      hash ^= hash >> 32;
+      return static_cast<std::size_t>(hash);
+    }
+  }
+
+
+
+  std::size_t CiEqualTo::CaseSensitiveEqualTo(std::wstring_view a, std::wstring_view b) {
     return a == b;
   }
 
 
-  std::size_t CiEqualTo::CaseInsensitiveEqualTo(const std::wstring& a, const std::wstring& b) {
-    return a.size() == b.size() && _wcsicmp(a.c_str(), b.c_str()) == 0;
+  std::size_t CiEqualTo::CaseInsensitiveEqualTo(std::wstring_view a, std::wstring_view b) {
+    if (a.size() != b.size()) {
+      return false;
+    }
+
+    std::size_t pos = 0;
+#ifdef CASESENSITIVITY_USE_SSE2
+    for (; pos + BlockSize <= a.size(); pos += BlockSize) {
+      const auto x = LoadBlock(a.data() + pos);
+      const auto y = LoadBlock(b.data() + pos);
+      if (!IsEqualBlock(x, y) && !IsEqualBlock(FoldBlock(x), FoldBlock(y))) {
+        return false;
+      }
+    }
+#endif
+    for (; pos < a.size(); pos++) {
+      if (a[pos] != b[pos] && FoldCase(a[pos]) != FoldCase(b[pos])) {
+        return false;
+      }
+    }
+    return true;
   }
 
 
-  std::size_t CiEqualTo::EqualTo(const std::wstring& a, const std::wstring& b, bool caseSensitive) {
+  std::size_t CiEqualTo::EqualTo(std::wstring_view a, std::wstring_view b, bool caseSensitive) {
     return caseSensitive
       ? CaseSensitiveEqualTo(a, b)
       : CaseInsensitiveEqualTo(a, b);
@@ -27,43 +129,27 @@ namespace CaseSensitivity {
 
   CiEqualTo::CiEqualTo(bool caseSensitive) :
     mCaseSensitive(caseSensitive),
-    mCompareFunc(caseSensitive ? std::wcscmp : _wcsicmp)
+    mEqualToFunc(caseSensitive ? CaseSensitiveEqualTo : CaseInsensitiveEqualTo)
   {}
 
 
-  bool CiEqualTo::operator() (const std::wstring& a, const std::wstring& b) const {
-    return a.size() == b.size() && mCompareFunc(a.c_str(), b.c_str()) == 0;
+  bool CiEqualTo::operator() (std::wstring_view a, std::wstring_view b) const {
+    return mEqualToFunc(a, b);
   }
 
 
 
-  std::size_t CiHash::CaseSensitiveHash(const std::wstring& x) {
-    static std::hash<std::wstring> hashFunctor;
-    return hashFunctor(x);
+  std::size_t CiHash::CaseSensitiveHash(std::wstring_view x) {
+    return HashBlocks(x, false);
   }
 
 
-  std::size_t CiHash::CaseInsensitiveHash(const std::wstring& x) {
-    // FNV-1a
-    static_assert(sizeof(wchar_t) == 2);
-    static_assert(sizeof(std::size_t) == 4 || sizeof(std::size_t) == 8);
-    constexpr std::size_t Prime = sizeof(std::size_t) == 4 ? 16777619 : 1099511628211;
-    constexpr std::size_t Basis = sizeof(std::size_t) == 4 ? 2166136261 : 14695981039346656037;
-    std::size_t hash = Basis;
-    for (const auto& c : x) {
-      const auto uc = static_cast<std::uint_fast16_t>(c);
-      const auto uc1b = static_cast<std::uint_fast8_t>(uc & 0xFF) | 0x20;   // convert to lowercase
-      const auto uc2b = static_cast<std::uint_fast8_t>(uc >> 8);
-      hash ^= uc1b;
-      hash *= Prime;
-      hash ^= uc2b;
-      hash *= Prime;
-    }
-    return hash;
+  std::size_t CiHash::CaseInsensitiveHash(std::wstring_view x) {
+    return HashBlocks(x, true);
   }
 
 
-  std::size_t CiHash::Hash(const std::wstring& x, bool caseSensitive) {
+  std::size_t CiHash::Hash(std::wstring_view x, bool caseSensitive) {
     return caseSensitive
       ? CaseSensitiveHash(x)
       : CaseInsensitiveHash(x);
@@ -76,7 +162,7 @@ namespace CaseSensitivity {
   {}
 
 
-  std::size_t CiHash::operator() (const std::wstring& x) const {
+  std::size_t CiHash::operator() (std::wstring_view x) const {
     return mHashFunc(x);
   }
 }
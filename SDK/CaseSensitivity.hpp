@@ -2,33 +2,36 @@
 
 #include <cstddef>
 #include <string>
+#include <string_view>
 
 
+// case-insensitive comparison and hashing fold only ASCII letters, consistently with FilenameToKey and Wildcard::Match
+// blocks of code units are processed with SSE2 where available
 namespace CaseSensitivity {
   class CiEqualTo {
     bool mCaseSensitive;
-    int(*mCompareFunc)(const wchar_t*, const wchar_t*);   // wcscmp or wcsicmp
+    std::size_t(*mEqualToFunc)(std::wstring_view, std::wstring_view);   // CaseSensitiveEqualTo or CaseInsensitiveEqualTo
 
   public:
-    static std::size_t CaseSensitiveEqualTo(const std::wstring& a, const std::wstring& b);
-    static std::size_t CaseInsensitiveEqualTo(const std::wstring& a, const std::wstring& b);
-    static std::size_t EqualTo(const std::wstring& a, const std::wstring& b, bool caseSensitive);
+    static std::size_t CaseSensitiveEqualTo(std::wstring_view a, std::wstring_view b);
+    static std::size_t CaseInsensitiveEqualTo(std::wstring_view a, std::wstring_view b);
+    static std::size_t EqualTo(std::wstring_view a, std::wstring_view b, bool caseSensitive);
 
     CiEqualTo(bool caseSensitive);
-    bool operator() (const std::wstring& a, const std::wstring& b) const;
+    bool operator() (std::wstring_view a, std::wstring_view b) const;
   };
 
 
   class CiHash {
     bool mCaseSensitive;
-    std::size_t(*mHashFunc)(const std::wstring&);   // CaseSensitiveHash or CaseInsensitiveHash
+    std::size_t(*mHashFunc)(std::wstring_view);   // CaseSensitiveHash or CaseInsensitiveHash
 
   public:
-    static std::size_t CaseSensitiveHash(const std::wstring& x);
-    static std::size_t CaseInsensitiveHash(const std::wstring& x);
-    static std::size_t Hash(const std::wstring& x, bool caseSensitive);
+    static std::size_t CaseSensitiveHash(std::wstring_view x);
+    static std::size_t CaseInsensitiveHash(std::wstring_view x);
+    static std::size_t Hash(std::wstring_view x, bool caseSensitive);
 
     CiHash(bool caseSensitive);
-    std::size_t operator() (const std::wstring& x) const;
+    std::size_t operator() (std::wstring_view x) const;
   };
 }
@@ -62,6 +62,11 @@
 #define MERGEFS_VIOF_TOTALNUMBEROFBYTES       ((DWORD) 0x00000200)
 #define MERGEFS_VIOF_TOTALNUMBEROFFREEBYTES   ((DWORD) 0x00000400)
 
+#define MERGEFS_METADATA_DURABILITY_DEFAULT         ((DWORD) 0)
+#define MERGEFS_METADATA_DURABILITY_PEROPERATION    ((DWORD) 1)   // write and flush every metadata change before returning
+#define MERGEFS_METADATA_DURABILITY_BATCHED         ((DWORD) 2)   // write every change before returning, flush at most metadataCommitDelay later
+#define MERGEFS_METADATA_DURABILITY_ONFLUSH         ((DWORD) 3)   // write and flush only on FlushFileBuffers, unmount or when the buffer is full
+
 
 # ifdef __cplusplus
 #  define MFEXTERNC extern "C"
@@ -165,6 +170,8 @@ typedef struct {
   DWORD numSources;
   MOUNT_SOURCE_INITIALIZE_INFO* sources;
   VOLUME_INFO_OVERRIDE volumeInfoOverride;
+  DWORD metadataDurability;         // MERGEFS_METADATA_DURABILITY_*; set MERGEFS_METADATA_DURABILITY_DEFAULT if unused
+  DWORD metadataCommitDelay;        // in milliseconds, for MERGEFS_METADATA_DURABILITY_BATCHED; set 0 if unused
 } MOUNT_INITIALIZE_INFO;
 
 
@@ -187,13 +194,30 @@ typedef struct {
 } MOUNT_INFO;
 
 
+typedef struct {
+  ULONGLONG entries;
+  ULONGLONG usage;
+  ULONGLONG hits;
+  ULONGLONG misses;
+} CACHE_STATISTICS;
+
+
+typedef struct {
+  CACHE_STATISTICS sourceIndexCache;
+  CACHE_STATISTICS findFilesCache;
+  CACHE_STATISTICS pathPool;    // usage is in bytes; hits are paths shared with an existing entry
+} MOUNT_CACHE_STATISTICS;
+
+
 #ifdef FROMLIBMERGEFS
 static_assert(sizeof(PLUGIN_INFO) == 3 * 4 + 1 * 16 + 3 * sizeof(void*));
 static_assert(sizeof(PLUGIN_INFO_EX) == sizeof(PLUGIN_INFO) + 1 * sizeof(void*));
 static_assert(sizeof(MOUNT_SOURCE_INITIALIZE_INFO) == 1 * 16 + 3 * sizeof(void*));
 static_assert(sizeof(VOLUME_INFO_OVERRIDE) == 4 * 4 + 3 * 8 + 2 * sizeof(void*));
-static_assert(sizeof(MOUNT_INITIALIZE_INFO) == 4 * 4 + 3 * sizeof(void*) + sizeof(VOLUME_INFO_OVERRIDE));
-static_assert(sizeof(MOUNT_INFO) == sizeof(MOUNT_INITIALIZE_INFO) - sizeof(VOLUME_INFO_OVERRIDE));
+static_assert(sizeof(MOUNT_INITIALIZE_INFO) == 6 * 4 + 3 * sizeof(void*) + sizeof(VOLUME_INFO_OVERRIDE));
+static_assert(sizeof(MOUNT_INFO) == sizeof(MOUNT_INITIALIZE_INFO) - sizeof(VOLUME_INFO_OVERRIDE) - 2 * 4);
+static_assert(sizeof(CACHE_STATISTICS) == 4 * 8);
+static_assert(sizeof(MOUNT_CACHE_STATISTICS) == 3 * sizeof(CACHE_STATISTICS));
 #endif
 
 
@@ -221,6 +245,7 @@ MFEXTERNC MFCIMPORT BOOL WINAPI LMF_GetSourcePluginInfo(PLUGIN_ID pluginId, PLUG
 MFEXTERNC MFCIMPORT BOOL WINAPI LMF_Mount(const MOUNT_INITIALIZE_INFO* mountInitializeInfo, PMountCallback callback, MOUNT_ID* outMountId) MFNOEXCEPT;
 MFEXTERNC MFCIMPORT BOOL WINAPI LMF_GetMounts(DWORD* outNumMountIds, MOUNT_ID* outMountIds, DWORD maxMountIds) MFNOEXCEPT;
 MFEXTERNC MFCIMPORT BOOL WINAPI LMF_GetMountInfo(MOUNT_ID mountId, MOUNT_INFO* outMountInfo) MFNOEXCEPT;
+MFEXTERNC MFCIMPORT BOOL WINAPI LMF_GetMountCacheStatistics(MOUNT_ID mountId, MOUNT_CACHE_STATISTICS* outCacheStatistics) MFNOEXCEPT;
 MFEXTERNC MFCIMPORT BOOL WINAPI LMF_SafeUnmount(MOUNT_ID mountId) MFNOEXCEPT;
 MFEXTERNC MFCIMPORT BOOL WINAPI LMF_Unmount(MOUNT_ID mountId) MFNOEXCEPT;
 MFEXTERNC MFCIMPORT BOOL WINAPI LMF_SafeUnmountAll() MFNOEXCEPT;
@@ -16,6 +16,7 @@
 
 #include "SourceCpp.hpp"
 #include "../CaseSensitivity.hpp"
+#include "../Wildcard.hpp"
 
 #include <cstdint>
 #include <functional>
@@ -387,6 +388,37 @@ std::shared_ptr<SourceMountFileBase> SourceMountBase::GetSourceMountFileBase(FIL
 }
 
 
+NTSTATUS SourceMountBase::ListFilesWithPattern(LPCWSTR FileName, LPCWSTR SearchPattern, PListFilesCallback Callback, CALLBACK_CONTEXT CallbackContext) {
+  if (!SearchPattern || Wildcard::IsMatchAllPattern(SearchPattern)) {
+    return ListFiles(FileName, Callback, CallbackContext);
+  }
+
+  struct FilterContext {
+    LPCWSTR searchPattern;
+    bool caseSensitive;
+    PListFilesCallback callback;
+    CALLBACK_CONTEXT callbackContext;
+  } filterContext{
+    SearchPattern,
+    caseSensitive,
+    Callback,
+    CallbackContext,
+  };
+
+  return ListFiles(FileName, [](PWIN32_FIND_DATAW FindDataW, CALLBACK_CONTEXT CallbackContext) MFNOEXCEPT {
+    const auto& filterContext = *static_cast<FilterContext*>(CallbackContext);
+    try {
+      if (FindDataW && !Wildcard::Match(filterContext.searchPattern, FindDataW->cFileName, filterContext.caseSensitive)) {
+        return;
+      }
+    } catch (...) {
+      // pass through; LibMergeFS filters the result again
+    }
+    filterContext.callback(FindDataW, filterContext.callbackContext);
+  }, &filterContext);
+}
+
+
 NTSTATUS SourceMountBase::ExportStart(PORTATION_INFO* PortationInfo) {
   if (!PortationInfo) {
     return STATUS_INVALID_PARAMETER;
@@ -731,6 +763,13 @@ NTSTATUS WINAPI ListFiles(LPCWSTR FileName, PListFilesCallback Callback, CALLBAC
 }
 
 
+NTSTATUS WINAPI ListFilesWithPattern(LPCWSTR FileName, LPCWSTR SearchPattern, PListFilesCallback Callback, CALLBACK_CONTEXT CallbackContext, SOURCE_CONTEXT_ID sourceContextId) MFNOEXCEPT {
+  return WrapException([=]() -> NTSTATUS {
+    return GetSourceMountBase(sourceContextId).ListFilesWithPattern(FileName, SearchPattern, Callback, CallbackContext);
+  });
+}
+
+
 NTSTATUS WINAPI ListStreams(LPCWSTR FileName, PListStreamsCallback Callback, CALLBACK_CONTEXT CallbackContext, SOURCE_CONTEXT_ID sourceContextId) MFNOEXCEPT {
   return WrapException([=]() -> NTSTATUS {
     return GetSourceMountBase(sourceContextId).ListStreams(FileName, Callback, CallbackContext);
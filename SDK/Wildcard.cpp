@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "Wildcard.hpp"
+
+
+
+namespace Wildcard {
+  namespace {
+    constexpr wchar_t FoldCase(wchar_t c) noexcept {
+      return L'A' <= c && c <= L'Z' ? c - L'A' + L'a' : c;
+    }
+  }
+
+
+  bool IsMatchAllPattern(std::wstring_view pattern) noexcept {
+    return pattern.empty() || pattern == L"*";
+  }
+
+
+  bool HasWildcard(std::wstring_view pattern) noexcept {
+    return pattern.find_first_of(L"*?<>\"") != std::wstring_view::npos;
+  }
+
+
+  bool Match(std::wstring_view pattern, std::wstring_view name, bool caseSensitive) {
+    if (IsMatchAllPattern(pattern)) {
+      return true;
+    }
+
+    if (!HasWildcard(pattern)) {
+      if (pattern.size() != name.size()) {
+        return false;
+      }
+      for (std::size_t i = 0; i < pattern.size(); i++) {
+        if (caseSensitive ? pattern[i] != name[i] : FoldCase(pattern[i]) != FoldCase(name[i])) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // simulate the pattern as an NFA whose states are positions in the pattern
+    // this runs in O(pattern.size() * name.size()) without backtracking
+    const std::size_t patternSize = pattern.size();
+    const std::size_t lastPeriodPos = name.find_last_of(L'.');
+
+    std::vector<char> states(patternSize + 1, 0);
+    std::vector<char> nextStates(patternSize + 1, 0);
+    states[0] = 1;
+
+    for (std::size_t namePos = 0; ; namePos++) {
+      const bool end = namePos == name.size();
+      const wchar_t c = end ? L'\0' : name[namePos];
+
+      // epsilon transitions (the states only move forward, so a single pass is enough)
+      for (std::size_t i = 0; i < patternSize; i++) {
+        if (!states[i]) {
+          continue;
+        }
+        switch (pattern[i]) {
+          case L'*':
+          case DosStar:
+            states[i + 1] = 1;
+            break;
+
+          case DosQm:
+            if (end || c == L'.') {
+              states[i + 1] = 1;
+            }
+            break;
+
+          case DosDot:
+            if (end) {
+              states[i + 1] = 1;
+            }
+            break;
+        }
+      }
+
+      if (end) {
+        return states[patternSize] != 0;
+      }
+
+      // consume c
+      bool any = false;
+      std::fill(nextStates.begin(), nextStates.end(), 0);
+      for (std::size_t i = 0; i < patternSize; i++) {
+        if (!states[i]) {
+          continue;
+        }
+        const wchar_t p = pattern[i];
+        switch (p) {
+          case L'*':
+            nextStates[i] = 1;
+            any = true;
+            break;
+
+          case DosStar:
+            // cannot consume the final period
+            if (c != L'.' || namePos != lastPeriodPos) {
+              nextStates[i] = 1;
+              any = true;
+            }
+            break;
+
+          case L'?':
+            nextStates[i + 1] = 1;
+            any = true;
+            break;
+
+          case DosQm:
+            if (c != L'.') {
+              nextStates[i + 1] = 1;
+              any = true;
+            }
+            break;
+
+          case DosDot:
+            if (c == L'.') {
+              nextStates[i + 1] = 1;
+              any = true;
+            }
+            break;
+
+          default:
+            if (caseSensitive ? p == c : FoldCase(p) == FoldCase(c)) {
+              nextStates[i + 1] = 1;
+              any = true;
+            }
+            break;
+        }
+      }
+
+      if (!any) {
+        return false;
+      }
+
+      states.swap(nextStates);
+    }
+  }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string_view>
+
+
+namespace Wildcard {
+  // DOS wildcards, which appear in search patterns passed by the kernel (e.g. "*.txt" is passed as "<.txt")
+  constexpr wchar_t DosStar = L'<';   // matches zero or more characters until the final period of the name
+  constexpr wchar_t DosQm = L'>';     // matches any single character, or nothing at a period or at the end of the name
+  constexpr wchar_t DosDot = L'"';    // matches a period, or nothing at the end of the name
+
+  // true if pattern is empty or "*"
+  bool IsMatchAllPattern(std::wstring_view pattern) noexcept;
+  // true if pattern contains any of '*', '?', '<', '>' and '"'
+  bool HasWildcard(std::wstring_view pattern) noexcept;
+  // matches name against pattern with the semantics of FsRtlIsNameInExpression
+  // case insensitive comparison only folds ASCII characters as FilenameToKey does
+  bool Match(std::wstring_view pattern, std::wstring_view name, bool caseSensitive);
+}
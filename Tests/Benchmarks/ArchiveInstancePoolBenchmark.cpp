@@ -0,0 +1,140 @@
+// concurrent reads of different files of an archive, as ArchiveSourceMountFile::AccessStream does them: via the shared stream of Archive under its streamMutex, or via instances of ArchiveInstancePool
+// the archive is read by the stand-in handler of Tests/MFPSArchive/ArchiveFixture.hpp, whose item streams sleep in proportion to the size of every read to stand in for a decoder
+// reads of the shared stream should stay at the throughput of one thread, those of the pool scale with the number of threads up to the number of instances
+// usage: ArchiveInstancePoolBenchmark [files] [file MiB] [read KiB] [us per MiB] [max threads] [rounds]
+
+#include "../MFPSArchive/ArchiveFixture.hpp"
+
+#include "../../MFPSArchive/NanaZ/Archive.hpp"
+#include "../../MFPSArchive/NanaZ/ArchiveInstancePool.hpp"
+#include "../../MFPSArchive/NanaZ/MemoryBudget.hpp"
+#include "../../MFPSArchive/NanaZ/MemoryStream.hpp"
+#include "../../MFPSArchive/NanaZ/NanaZ.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Windows.h>
+#include <winrt/base.h>
+
+
+
+namespace {
+  // reads the whole of the file in chunks of readSize, and returns the sum of sampled bytes
+  std::size_t ReadFile(IInStream& inStream, UInt64 fileSize, std::vector<std::byte>& buffer) {
+    std::size_t checksum = 0;
+    for (UInt64 offset = 0; offset < fileSize;) {
+      if (FAILED(inStream.Seek(static_cast<Int64>(offset), STREAM_SEEK_SET, nullptr))) {
+        std::cerr << "seek failed" << std::endl;
+        std::exit(1);
+      }
+      UInt32 readSize = 0;
+      if (FAILED(inStream.Read(buffer.data(), static_cast<UInt32>(buffer.size()), &readSize)) || readSize == 0) {
+        std::cerr << "read failed at " << offset << std::endl;
+        std::exit(1);
+      }
+      checksum += static_cast<unsigned char>(buffer[0]);
+      offset += readSize;
+    }
+    return checksum;
+  }
+
+
+  double Measure(bool usePool, std::size_t numThreads, NanaZ& nanaZ, const Archive& archive, std::vector<std::byte>& archiveData, const std::vector<std::wstring>& filepaths, std::size_t readSize, std::size_t& checksum) {
+    ArchiveInstancePool archiveInstancePool(nanaZ, archive.GetFormatClsid(), 0, usePool ? numThreads : 0, [&archiveData]() -> winrt::com_ptr<IInStream> {
+      return winrt::make_self<InMemoryStream>(archiveData.data(), archiveData.size());
+    });
+
+    std::atomic<std::size_t> nextFile = 0;
+    std::atomic<std::size_t> totalChecksum = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < numThreads; i++) {
+      threads.emplace_back([&]() {
+        std::vector<std::byte> buffer(readSize);
+        std::size_t threadChecksum = 0;
+        for (std::size_t fileIndex; (fileIndex = nextFile++) < filepaths.size();) {
+          Archive::Pin pin;
+          const auto ptrDirectoryTree = archive.Get(filepaths[fileIndex], pin);
+          if (!ptrDirectoryTree || !ptrDirectoryTree->rootItemIndexN) {
+            std::cerr << "file " << fileIndex << " cannot be read via the pool" << std::endl;
+            std::exit(1);
+          }
+
+          // see ArchiveSourceMountFile::AccessStream
+          const UInt32 itemIndex = ptrDirectoryTree->rootItemIndexN.value();
+          if (auto lease = archiveInstancePool.Acquire(itemIndex)) {
+            if (const auto ptrInStream = lease.GetItemStream(itemIndex)) {
+              threadChecksum += ReadFile(*ptrInStream, ptrDirectoryTree->fileSize, buffer);
+              continue;
+            }
+          }
+          std::lock_guard lock(*ptrDirectoryTree->streamMutex);
+          threadChecksum += ReadFile(*ptrDirectoryTree->inStream.get(), ptrDirectoryTree->fileSize, buffer);
+        }
+        totalChecksum += threadChecksum;
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    checksum += totalChecksum;
+    return elapsed;
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t numFiles = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 32;
+  const std::size_t fileMiB = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 4;
+  const std::size_t readKiB = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 64;
+  const std::chrono::microseconds latency(argc >= 5 ? std::strtoull(argv[4], nullptr, 10) : 2000);
+  const std::size_t maxThreads = argc >= 6 ? std::strtoull(argv[5], nullptr, 10) : 8;
+  const std::size_t rounds = argc >= 7 ? std::strtoull(argv[6], nullptr, 10) : 3;
+
+  test::RegisterArchiveHandler();
+  NanaZ nanaZ(test::HandlerDllFilepath);
+  MemoryBudget memoryBudget(64 << 20);
+
+  std::vector<test::ArchiveEntry> entries;
+  std::vector<std::wstring> filepaths;
+  for (std::size_t i = 0; i < numFiles; i++) {
+    entries.push_back({L"file" + std::to_wstring(i) + L".bin", false, test::GenerateItemData(fileMiB << 20, static_cast<unsigned int>(i))});
+    filepaths.push_back(entries.back().path);
+  }
+  auto archiveData = test::BuildArchive(entries);
+  entries.clear();
+
+  const Archive archive(nanaZ, memoryBudget, winrt::make_self<InMemoryStream>(archiveData.data(), archiveData.size()), test::MakeArchiveFileInformation(archiveData.size()), L"archive", L"", false, 0, DirectoryTree::OnExisting::Skip, DirectoryTree::ExtractToMemory::Never);
+  test::GetHandlerOptions().readLatencyPerMiB = latency;
+
+  std::cout << "archive: " << numFiles << " files of " << fileMiB << " MiB, read in chunks of " << readKiB << " KiB\n"
+            << "latency: " << latency.count() << " us/MiB\n";
+
+  std::size_t checksum = 0;
+  for (std::size_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+    for (const bool usePool : {false, true}) {
+      double best = 0;
+      for (std::size_t round = 0; round < rounds; round++) {
+        const auto elapsed = Measure(usePool, numThreads, nanaZ, archive, archiveData, filepaths, readKiB * 1024, checksum);
+        if (round == 0 || elapsed < best) {
+          best = elapsed;
+        }
+      }
+      std::cout << numThreads << (numThreads == 1 ? " thread,  " : " threads, ") << (usePool ? "pool:          " : "shared stream: ") << best * 1e3 << " ms, " << numFiles * fileMiB / best << " MiB/s\n";
+    }
+  }
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+
+  return 0;
+}
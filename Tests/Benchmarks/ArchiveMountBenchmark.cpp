@@ -0,0 +1,123 @@
+// mounting (constructing Archive for) a generated archive of many small files, without an archive index, while building one and saving it (the first mount), and with the saved index loaded (later mounts)
+// the archive is read by the stand-in handler of Tests/MFPSArchive/ArchiveFixture.hpp from memory, so the times are those of MFPSArchive and the handler calls, not of disk I/O or decoding
+// the index replaces the IInArchive::GetProperty calls for each item; IInArchive::Open still runs on every mount and is reported separately (with a real handler it reads the whole central directory or header)
+// usage: ArchiveMountBenchmark [items] [items per directory] [rounds]
+
+#include "../MFPSArchive/ArchiveFixture.hpp"
+
+#include "../../MFPSArchive/NanaZ/Archive.hpp"
+#include "../../MFPSArchive/NanaZ/ArchiveIndex.hpp"
+#include "../../MFPSArchive/NanaZ/MemoryBudget.hpp"
+#include "../../MFPSArchive/NanaZ/MemoryStream.hpp"
+#include "../../MFPSArchive/NanaZ/NanaZ.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Windows.h>
+#include <winrt/base.h>
+
+
+
+namespace {
+  enum class Mode {
+    NoIndex,
+    ColdIndex,
+    WarmIndex,
+  };
+
+
+  struct Result {
+    double mount = 0;
+    double open = 0;
+    double index = 0;
+    std::size_t getProperties = 0;
+  };
+
+
+  Result Measure(Mode mode, NanaZ& nanaZ, MemoryBudget& memoryBudget, std::vector<std::byte>& archiveData, const std::wstring& indexFilepath, const std::wstring& probeFilepath, std::size_t& checksum) {
+    const auto byHandleFileInformation = test::MakeArchiveFileInformation(archiveData.size());
+    const ArchiveIndexKey indexKey{archiveData.size(), byHandleFileInformation.ftLastWriteTime, 0x0123456789ABCDEFull};
+
+    test::GetHandlerCounters().Reset();
+    Result result;
+
+    const auto start = std::chrono::steady_clock::now();
+    ArchiveIndex archiveIndex;
+    if (mode == Mode::WarmIndex && !archiveIndex.Load(indexFilepath, indexKey)) {
+      std::cerr << "failed to load the index" << std::endl;
+      std::exit(1);
+    }
+    const auto loaded = std::chrono::steady_clock::now();
+
+    Archive archive(nanaZ, memoryBudget, winrt::make_self<InMemoryStream>(archiveData.data(), archiveData.size()), byHandleFileInformation, L"archive", L"", false, 0, DirectoryTree::OnExisting::Skip, DirectoryTree::ExtractToMemory::Never, nullptr, nullptr, mode == Mode::NoIndex ? nullptr : &archiveIndex);
+    const auto constructed = std::chrono::steady_clock::now();
+
+    if (mode == Mode::ColdIndex) {
+      archiveIndex.Save(indexFilepath, indexKey);
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    result.mount = std::chrono::duration<double>(end - start).count();
+    result.open = test::GetHandlerCounters().openNanoseconds * 1e-9;
+    result.index = std::chrono::duration<double>((loaded - start) + (end - constructed)).count();
+    result.getProperties = test::GetHandlerCounters().getProperties;
+
+    Archive::Pin pin;
+    const auto ptrDirectoryTree = archive.Get(probeFilepath, pin);
+    if (!ptrDirectoryTree) {
+      std::cerr << "mounted archive lacks " << std::string(probeFilepath.begin(), probeFilepath.end()) << std::endl;
+      std::exit(1);
+    }
+    checksum += ptrDirectoryTree->fileSize + ptrDirectoryTree->lastWriteTime.dwLowDateTime;
+
+    return result;
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t numItems = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+  const std::size_t itemsPerDirectory = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 1000;
+  const std::size_t rounds = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 3;
+
+  test::RegisterArchiveHandler();
+  NanaZ nanaZ(test::HandlerDllFilepath);
+  MemoryBudget memoryBudget(64 << 20);
+
+  std::vector<test::ArchiveEntry> entries;
+  entries.reserve(numItems);
+  for (std::size_t i = 0; i < numItems; i++) {
+    entries.push_back({L"dir" + std::to_wstring(i / itemsPerDirectory) + L"\\file" + std::to_wstring(i) + L".bin", false, test::GenerateItemData(64 + i % 192, static_cast<unsigned int>(i))});
+  }
+  auto archiveData = test::BuildArchive(entries);
+  const auto probeFilepath = entries.back().path;
+  entries.clear();
+
+  wchar_t tempDirectory[MAX_PATH];
+  GetTempPathW(MAX_PATH, tempDirectory);
+  const auto indexFilepath = ArchiveIndex::GetIndexFilepath(tempDirectory, L"archive.zip");
+
+  std::cout << "archive: " << numItems << " items in directories of " << itemsPerDirectory << ", " << archiveData.size() / 1024 << " KiB\n";
+
+  std::size_t checksum = 0;
+  for (const auto mode : {Mode::NoIndex, Mode::ColdIndex, Mode::WarmIndex}) {
+    Result best;
+    for (std::size_t round = 0; round < rounds; round++) {
+      const auto result = Measure(mode, nanaZ, memoryBudget, archiveData, indexFilepath, probeFilepath, checksum);
+      if (round == 0 || result.mount < best.mount) {
+        best = result;
+      }
+    }
+    std::cout << (mode == Mode::NoIndex ? "no index:   " : mode == Mode::ColdIndex ? "cold index: " : "warm index: ")
+              << best.mount * 1e3 << " ms (Open " << best.open * 1e3 << " ms, index load/save " << best.index * 1e3 << " ms), "
+              << best.getProperties << " GetProperty calls, " << numItems / best.mount << " items/s\n";
+  }
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+
+  return 0;
+}
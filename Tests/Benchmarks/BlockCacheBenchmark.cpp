@@ -0,0 +1,258 @@
+// reads of the last file of a generated solid archive (several files compressed as one LZMA stream), served directly by the decoder or via BlockCache as ArchiveSourceMountFile::DReadFile does
+// like 7-Zip, the decoder decodes everything in between on a forward seek and decodes again from the start of the solid block on a backward one, so every restart decodes the files before the target too
+// patterns: front to back, random reads, and two readers alternating between the first and the second half of the file (e.g. a media player reading the index and the stream)
+// usage: BlockCacheBenchmark [files] [file MiB] [read KiB] [random reads] [cache MiB] [readahead blocks]
+
+#include "../../MFPSArchive/BlockCache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <lzma.h>
+
+
+
+namespace {
+  constexpr std::uint64_t MiB = 1024 * 1024;
+
+
+  // text-like contents, which LZMA compresses several times
+  std::vector<std::uint8_t> GenerateSolidBlock(std::size_t size) {
+    static constexpr const char* Words[] = {"archive ", "block ", "cache ", "decoder ", "merge ", "mount ", "solid ", "stream ", "0123 ", "\n"};
+    std::vector<std::uint8_t> data;
+    data.reserve(size);
+    std::uint32_t state = 1;
+    while (data.size() < size) {
+      state = state * 1664525 + 1013904223;
+      const char* word = Words[(state >> 24) % std::size(Words)];
+      data.insert(data.end(), word, word + std::min(std::strlen(word), size - data.size()));
+    }
+    return data;
+  }
+
+
+  std::vector<std::uint8_t> Compress(const std::vector<std::uint8_t>& data) {
+    std::vector<std::uint8_t> compressed(lzma_stream_buffer_bound(data.size()));
+    std::size_t compressedSize = 0;
+    if (lzma_easy_buffer_encode(1, LZMA_CHECK_NONE, nullptr, data.data(), data.size(), compressed.data(), &compressedSize, compressed.size()) != LZMA_OK) {
+      std::cerr << "failed to compress" << std::endl;
+      std::exit(1);
+    }
+    compressed.resize(compressedSize);
+    return compressed;
+  }
+
+
+  // the stream of a file in a solid block
+  class SolidFileStream {
+    const std::vector<std::uint8_t>& compressed;
+    const std::uint64_t fileOffset;
+    const std::uint64_t fileSize;
+    lzma_stream stream = LZMA_STREAM_INIT;
+    std::uint64_t blockPosition = 0;
+    std::vector<std::uint8_t> discardBuffer;
+
+    void Restart() {
+      lzma_end(&stream);
+      stream = LZMA_STREAM_INIT;
+      if (lzma_stream_decoder(&stream, UINT64_MAX, 0) != LZMA_OK) {
+        std::cerr << "failed to initialize the decoder" << std::endl;
+        std::exit(1);
+      }
+      stream.next_in = compressed.data();
+      stream.avail_in = compressed.size();
+      blockPosition = 0;
+      restarts++;
+    }
+
+    void Decode(std::uint8_t* buffer, std::size_t size) {
+      stream.next_out = buffer;
+      stream.avail_out = size;
+      while (stream.avail_out != 0) {
+        const auto result = lzma_code(&stream, LZMA_RUN);
+        if (result == LZMA_STREAM_END) {
+          break;
+        }
+        if (result != LZMA_OK) {
+          std::cerr << "failed to decode" << std::endl;
+          std::exit(1);
+        }
+      }
+      const std::size_t decodedSize = size - stream.avail_out;
+      blockPosition += decodedSize;
+      decoded += decodedSize;
+    }
+
+  public:
+    std::uint64_t decoded = 0;
+    std::size_t restarts = 0;
+
+    SolidFileStream(const std::vector<std::uint8_t>& compressed, std::uint64_t fileOffset, std::uint64_t fileSize) :
+      compressed(compressed),
+      fileOffset(fileOffset),
+      fileSize(fileSize),
+      discardBuffer(1 << 16)
+    {
+      Restart();
+      restarts = 0;
+    }
+
+    ~SolidFileStream() {
+      lzma_end(&stream);
+    }
+
+    SolidFileStream(const SolidFileStream&) = delete;
+    SolidFileStream& operator=(const SolidFileStream&) = delete;
+
+    std::uint64_t GetPosition() const {
+      return blockPosition > fileOffset ? blockPosition - fileOffset : 0;
+    }
+
+    std::size_t Read(std::uint64_t offset, std::byte* buffer, std::size_t size) {
+      const std::uint64_t target = fileOffset + std::min(offset, fileSize);
+      if (target < blockPosition) {
+        Restart();
+      }
+      while (blockPosition < target) {
+        Decode(discardBuffer.data(), static_cast<std::size_t>(std::min<std::uint64_t>(discardBuffer.size(), target - blockPosition)));
+      }
+      const auto readSize = static_cast<std::size_t>(std::min<std::uint64_t>(size, offset < fileSize ? fileSize - offset : 0));
+      Decode(reinterpret_cast<std::uint8_t*>(buffer), readSize);
+      return readSize;
+    }
+  };
+
+
+  // the part of ArchiveSourceMountFile::DReadFile reading compressed contents
+  class FileReader {
+    static constexpr std::uint64_t FileIndex = 1;
+
+    BlockCache* ptrBlockCache;
+    SolidFileStream& stream;
+    const std::uint64_t fileSize;
+    std::uint64_t nextSequentialOffset = 0;
+
+  public:
+    FileReader(BlockCache* ptrBlockCache, SolidFileStream& stream, std::uint64_t fileSize) :
+      ptrBlockCache(ptrBlockCache),
+      stream(stream),
+      fileSize(fileSize)
+    {}
+
+    std::size_t Read(std::uint64_t offset, std::byte* buffer, std::size_t size) {
+      size = static_cast<std::size_t>(std::min<std::uint64_t>(size, fileSize - offset));
+      if (!ptrBlockCache) {
+        return stream.Read(offset, buffer, size);
+      }
+
+      auto& blockCache = *ptrBlockCache;
+      const bool sequential = std::exchange(nextSequentialOffset, offset + size) == offset;
+      const std::uint64_t lastBlockIndex = (offset + size - 1) / BlockCache::BlockSize;
+      const std::uint64_t lastFileBlockIndex = (fileSize - 1) / BlockCache::BlockSize;
+      const std::uint64_t lastReadaheadBlockIndex = sequential ? std::min<std::uint64_t>(lastBlockIndex + blockCache.GetReadaheadBlocks(), lastFileBlockIndex) : lastBlockIndex;
+      std::size_t totalReadSize = 0;
+      while (totalReadSize < size) {
+        const std::uint64_t position = offset + totalReadSize;
+        const std::uint64_t blockIndex = position / BlockCache::BlockSize;
+        auto block = blockCache.GetOrBeginLoad(FileIndex, blockIndex);
+        if (!block) {
+          block = blockCache.ReadBlocks(FileIndex, fileSize, stream.GetPosition(), blockIndex, lastBlockIndex, lastReadaheadBlockIndex, [this](std::uint64_t readOffset, std::byte* readBuffer, std::size_t readSize) {
+            return stream.Read(readOffset, readBuffer, readSize);
+          });
+          blockCache.EndLoad(FileIndex, blockIndex);
+        }
+        const auto blockOffset = static_cast<std::size_t>(position - blockIndex * BlockCache::BlockSize);
+        if (!block || blockOffset >= block->size()) {
+          break;
+        }
+        const std::size_t copySize = std::min<std::size_t>(block->size() - blockOffset, size - totalReadSize);
+        std::memcpy(buffer + totalReadSize, block->data() + blockOffset, copySize);
+        totalReadSize += copySize;
+      }
+      return totalReadSize;
+    }
+  };
+
+
+  struct Request {
+    std::uint64_t offset;
+    std::size_t size;
+  };
+
+
+  std::vector<Request> MakeRequests(const std::string& pattern, std::uint64_t fileSize, std::size_t readSize, std::size_t randomReads) {
+    std::vector<Request> requests;
+    if (pattern == "sequential") {
+      for (std::uint64_t offset = 0; offset < fileSize; offset += readSize) {
+        requests.push_back({offset, readSize});
+      }
+    } else if (pattern == "random") {
+      std::mt19937_64 engine(1);
+      for (std::size_t i = 0; i < randomReads; i++) {
+        requests.push_back({engine() % (fileSize / readSize) * readSize, readSize});
+      }
+    } else {
+      const std::uint64_t half = fileSize / 2;
+      for (std::uint64_t offset = 0; offset < half; offset += readSize) {
+        requests.push_back({offset, readSize});
+        requests.push_back({half + offset, readSize});
+      }
+    }
+    return requests;
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t numFiles = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 4;
+  const std::uint64_t fileMiB = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 4;
+  const std::size_t readKiB = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 64;
+  const std::size_t randomReads = argc >= 5 ? std::strtoull(argv[4], nullptr, 10) : 32;
+  const std::size_t cacheMiB = argc >= 6 ? std::strtoull(argv[5], nullptr, 10) : 64;
+  const std::size_t readaheadBlocks = argc >= 7 ? std::strtoull(argv[6], nullptr, 10) : 4;
+
+  const std::uint64_t fileSize = fileMiB * MiB;
+  const auto data = GenerateSolidBlock(static_cast<std::size_t>(numFiles * fileSize));
+  const auto compressed = Compress(data);
+  const std::uint64_t fileOffset = (numFiles - 1) * fileSize;
+
+  std::cout << "solid block: " << numFiles << " files of " << fileMiB << " MiB, compressed to " << compressed.size() / 1024 << " KiB; reading the last one in chunks of " << readKiB << " KiB\n"
+            << "cache:       " << cacheMiB << " MiB, readahead " << readaheadBlocks << " blocks of " << BlockCache::BlockSize / 1024 << " KiB\n";
+
+  std::size_t checksum = 0;
+  std::vector<std::byte> buffer(readKiB * 1024);
+  for (const std::string pattern : {"sequential", "random", "interleaved"}) {
+    const auto requests = MakeRequests(pattern, fileSize, buffer.size(), randomReads);
+    for (const bool cached : {false, true}) {
+      BlockCache blockCache(cacheMiB * MiB, readaheadBlocks);
+      SolidFileStream stream(compressed, fileOffset, fileSize);
+      FileReader reader(cached ? &blockCache : nullptr, stream, fileSize);
+
+      const auto start = std::chrono::steady_clock::now();
+      for (const auto& request : requests) {
+        const auto readSize = reader.Read(request.offset, buffer.data(), request.size);
+        if (readSize != std::min<std::uint64_t>(request.size, fileSize - request.offset) || std::memcmp(buffer.data(), data.data() + fileOffset + request.offset, readSize) != 0) {
+          std::cerr << "read wrong contents at " << request.offset << std::endl;
+          return 1;
+        }
+        checksum += static_cast<unsigned char>(buffer[0]);
+      }
+      const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      std::cout << pattern << std::string(12 - pattern.size(), ' ') << (cached ? "cached: " : "direct: ") << elapsed * 1e3 << " ms, "
+                << requests.size() << " reads, decoded " << stream.decoded / MiB << " MiB in " << stream.restarts << " restarts\n";
+    }
+  }
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,62 @@
+// case-insensitive hashing and comparison of path-like keys
+// usage: CaseSensitivityBenchmark [keys] [key length] [iterations]
+
+#include "../../SDK/CaseSensitivity.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t keyCount = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 10000;
+  const std::size_t keyLength = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 64;
+  const std::size_t iterations = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 200;
+
+  std::mt19937 engine(1);
+  std::uniform_int_distribution<int> distribution(0, 25);
+  std::vector<std::wstring> keys;
+  std::vector<std::wstring> upperKeys;
+  for (std::size_t i = 0; i < keyCount; i++) {
+    std::wstring key(keyLength, L'\0');
+    for (auto& c : key) {
+      c = static_cast<wchar_t>(L'a' + distribution(engine));
+    }
+    keys.push_back(key);
+    for (auto& c : key) {
+      c = static_cast<wchar_t>(c - L'a' + L'A');
+    }
+    upperKeys.push_back(key);
+  }
+
+  std::size_t checksum = 0;
+
+  const auto hashStart = std::chrono::steady_clock::now();
+  for (std::size_t iteration = 0; iteration < iterations; iteration++) {
+    for (const auto& key : keys) {
+      checksum += CaseSensitivity::CiHash::CaseInsensitiveHash(key);
+    }
+  }
+  const auto hashElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - hashStart).count();
+
+  const auto equalToStart = std::chrono::steady_clock::now();
+  for (std::size_t iteration = 0; iteration < iterations; iteration++) {
+    for (std::size_t i = 0; i < keyCount; i++) {
+      checksum += CaseSensitivity::CiEqualTo::CaseInsensitiveEqualTo(keys[i], upperKeys[i]);
+    }
+  }
+  const auto equalToElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - equalToStart).count();
+
+  const double units = static_cast<double>(keyCount) * keyLength * iterations;
+  std::cout << "keys:    " << keyCount << " x " << keyLength << " code units\n"
+            << "hash:    " << units / hashElapsed / 1e6 << " Munits/s\n"
+            << "equalTo: " << units / equalToElapsed / 1e6 << " Munits/s\n"
+            << "(checksum " << checksum << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,116 @@
+// aggregate throughput of SourceToAudioSourceFLAC when a FLAC image is read as several tracks at once, as with per-track WAVs of a cue sheet
+// each thread reads its own track from the beginning in player-sized chunks; the source sleeps for every read to stand in for a disk
+// "source reads" is the number of bytes the decoders read relative to the stream; it stays near 1 while each track keeps its own decoder,
+// i.e. up to the 4 decoders of the pool; more tracks take decoders over from each other and seek again
+// usage: FLACReadThroughputBenchmark [seconds of audio] [read latency us] [max threads]
+
+#include "../MFPSCue/FLACFixture.hpp"
+
+#include "../../MFPSCue/MemorySource.hpp"
+#include "../../MFPSCue/PartialSource.hpp"
+#include "../../MFPSCue/SourceToAudioSourceFLAC.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <Windows.h>
+
+
+
+namespace {
+  constexpr test::flac::Format Stereo16At44100{2, 16, 44100};
+  constexpr std::size_t BlockSize = 4;
+  constexpr std::size_t ChunkSize = 64 * 1024;
+  // reads of the frame index scan are not counted
+  constexpr std::size_t ScanReadSize = (1 << 20) - 16;
+
+
+  class SlowSource : public Source {
+    std::shared_ptr<Source> mSource;
+    std::chrono::microseconds mLatency;
+    std::atomic<std::size_t> mDecoderReadBytes;
+
+  public:
+    SlowSource(std::shared_ptr<Source> source, std::chrono::microseconds latency) :
+      mSource(source),
+      mLatency(latency),
+      mDecoderReadBytes(0)
+    {}
+
+    std::size_t GetDecoderReadBytes() const {
+      return mDecoderReadBytes;
+    }
+
+    SourceSize GetSize() override {
+      return mSource->GetSize();
+    }
+
+    NTSTATUS Read(SourceOffset offset, std::byte* buffer, std::size_t size, std::size_t* readSize) override {
+      if (size < ScanReadSize) {
+        mDecoderReadBytes += size;
+      }
+      if (mLatency.count()) {
+        std::this_thread::sleep_for(mLatency);
+      }
+      return mSource->Read(offset, buffer, size, readSize);
+    }
+  };
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t seconds = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 120;
+  const std::chrono::microseconds readLatency(argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 200);
+  const std::size_t maxThreads = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 8;
+
+  const auto data = test::flac::Encode(Stereo16At44100, test::flac::GenerateSamples(Stereo16At44100, seconds * Stereo16At44100.samplingRate)).data;
+
+  std::cout << "stream:       " << seconds << " s, " << data.size() / 1e6 << " MB\n"
+            << "read latency: " << readLatency.count() << " us\n"
+            << "hardware threads: " << std::thread::hardware_concurrency() << "\n";
+
+  std::size_t checksum = 0;
+  for (std::size_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+    const auto source = std::make_shared<SlowSource>(std::make_shared<MemorySource>(data.data(), data.size()), readLatency);
+    const auto audioSource = std::make_shared<SourceToAudioSourceFLAC>(source);
+    const auto numSamples = audioSource->GetSize() / BlockSize;
+
+    std::atomic<std::size_t> totalReadSize(0);
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t trackIndex = 0; trackIndex < numThreads; trackIndex++) {
+      const auto trackBegin = numSamples * trackIndex / numThreads * BlockSize;
+      const auto trackEnd = numSamples * (trackIndex + 1) / numThreads * BlockSize;
+      threads.emplace_back([&, trackBegin, trackEnd]() {
+        PartialSource track(audioSource, trackBegin, trackEnd - trackBegin);
+        std::vector<std::byte> buffer(ChunkSize);
+        std::size_t trackReadSize = 0;
+        for (Source::SourceOffset offset = 0; offset < trackEnd - trackBegin; offset += ChunkSize) {
+          std::size_t readSize = 0;
+          if (track.Read(offset, buffer.data(), buffer.size(), &readSize) != STATUS_SUCCESS) {
+            std::cerr << "read failed at " << trackBegin + offset << std::endl;
+            std::exit(1);
+          }
+          trackReadSize += readSize + static_cast<std::size_t>(buffer[0]);
+        }
+        totalReadSize += trackReadSize;
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    checksum += totalReadSize;
+
+    std::cout << numThreads << " threads: " << audioSource->GetSize() / elapsed / 1e6 << " MB/s of PCM, source reads " << static_cast<double>(source->GetDecoderReadBytes()) / data.size() << "x\n";
+  }
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,94 @@
+// latency of SourceToAudioSourceFLAC::Read at random positions of a FLAC stream without SEEKTABLE
+// the stream is encoded in memory and read through a source which sleeps for every read to stand in for a slow disk or an archive
+// the first far read used to wait for the frame header scan of the whole stream; it now runs in the background
+// the stream is encoded by Tests/MFPSCue/FLACFixture.hpp; frames are less compressed than with libFLAC, which only makes the stream larger
+// usage: FLACSeekLatencyBenchmark [seconds of audio] [read latency us] [reads]
+
+#include "../MFPSCue/FLACFixture.hpp"
+
+#include "../../MFPSCue/MemorySource.hpp"
+#include "../../MFPSCue/SourceToAudioSourceFLAC.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+
+namespace {
+  constexpr test::flac::Format Stereo16At44100{2, 16, 44100};
+  constexpr std::size_t BlockSize = 4;
+
+
+  class SlowSource : public Source {
+    std::shared_ptr<Source> mSource;
+    std::chrono::microseconds mLatency;
+
+  public:
+    SlowSource(std::shared_ptr<Source> source, std::chrono::microseconds latency) :
+      mSource(source),
+      mLatency(latency)
+    {}
+
+    SourceSize GetSize() override {
+      return mSource->GetSize();
+    }
+
+    NTSTATUS Read(SourceOffset offset, std::byte* buffer, std::size_t size, std::size_t* readSize) override {
+      std::this_thread::sleep_for(mLatency);
+      return mSource->Read(offset, buffer, size, readSize);
+    }
+  };
+
+
+  double Percentile(std::vector<double> values, double ratio) {
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<std::size_t>(ratio * values.size()))];
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t seconds = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 600;
+  const std::chrono::microseconds readLatency(argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 100);
+  const std::size_t readCount = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 200;
+
+  const auto data = test::flac::Encode(Stereo16At44100, test::flac::GenerateSamples(Stereo16At44100, seconds * Stereo16At44100.samplingRate)).data;
+  const auto source = std::make_shared<SlowSource>(std::make_shared<MemorySource>(data.data(), data.size()), readLatency);
+
+  std::cout << "stream:       " << seconds << " s, " << data.size() / 1e6 << " MB\n"
+            << "read latency: " << readLatency.count() << " us\n";
+
+  SourceToAudioSourceFLAC audioSource(source);
+  const auto totalSize = audioSource.GetSize();
+  std::vector<std::byte> buffer(64 * 1024);
+  std::size_t checksum = 0;
+
+  const auto timedRead = [&](Source::SourceOffset offset) {
+    const auto start = std::chrono::steady_clock::now();
+    std::size_t readSize = 0;
+    audioSource.Read(offset / BlockSize * BlockSize, buffer.data(), buffer.size(), &readSize);
+    checksum += readSize + static_cast<std::size_t>(buffer[0]);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  };
+
+  // the first read near the end starts the scan
+  std::cout << "first seek:   " << timedRead(totalSize * 9 / 10) << " ms\n";
+
+  std::mt19937_64 engine(2);
+  std::vector<double> latencies;
+  for (std::size_t i = 0; i < readCount; i++) {
+    latencies.push_back(timedRead(std::uniform_int_distribution<Source::SourceOffset>(0, totalSize - 1)(engine)));
+  }
+  std::cout << "random reads: p50 " << Percentile(latencies, 0.5) << " ms, p99 " << Percentile(latencies, 0.99) << " ms, max " << Percentile(latencies, 1.0) << " ms\n"
+            << "(checksum " << checksum << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,45 @@
+// allocate/release churn with 100k live IDs
+// usage: IdAllocatorBenchmark [live IDs] [operations]
+
+#include "../../LibMergeFS/IdAllocator.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t liveCount = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+  const std::size_t operationCount = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 10000000;
+
+  IdAllocator<std::uint64_t> allocator(1, 1024);
+
+  std::vector<std::uint64_t> live;
+  live.reserve(liveCount);
+  for (std::size_t i = 0; i < liveCount; i++) {
+    live.push_back(allocator.Allocate());
+  }
+
+  std::mt19937_64 engine(1);
+  std::uniform_int_distribution<std::size_t> distribution(0, liveCount - 1);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < operationCount; i++) {
+    auto& id = live[distribution(engine)];
+    allocator.Release(id);
+    id = allocator.Allocate();
+  }
+  const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << "live IDs:         " << liveCount << "\n"
+            << "release+allocate: " << operationCount << "\n"
+            << "elapsed:          " << elapsed << " s\n"
+            << "per pair:         " << elapsed / operationCount * 1e9 << " ns" << std::endl;
+
+  return 0;
+}
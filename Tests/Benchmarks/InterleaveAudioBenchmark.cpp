@@ -0,0 +1,62 @@
+// throughput of InterleaveAudio against the SSE2-only and scalar paths for the channel and sample size combinations with kernels
+// usage: InterleaveAudioBenchmark [samples per call] [calls]
+
+#include "../../MFPSCue/InterleaveAudio.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+
+
+namespace {
+  using InterleaveFunction = void(*)(std::byte* destination, const std::int32_t* const* source, std::size_t numChannels, std::size_t bytesPerSample, std::size_t numSamples);
+
+
+  // returns output bytes per second
+  double Measure(InterleaveFunction function, const std::int32_t* const* source, std::size_t numChannels, std::size_t bytesPerSample, std::size_t numSamples, std::size_t callCount, std::vector<std::byte>& output) {
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < callCount; i++) {
+      function(output.data(), source, numChannels, bytesPerSample, numSamples);
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(numSamples * numChannels * bytesPerSample * callCount) / elapsed;
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t numSamples = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 4608;
+  const std::size_t callCount = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 20000;
+
+  std::mt19937 engine(1);
+  std::uniform_int_distribution<std::int32_t> distribution(-128, 127);
+  std::vector<std::int32_t> left(numSamples);
+  std::vector<std::int32_t> right(numSamples);
+  for (std::size_t i = 0; i < numSamples; i++) {
+    left[i] = distribution(engine);
+    right[i] = distribution(engine);
+  }
+  const std::int32_t* const source[] = {left.data(), right.data()};
+  std::vector<std::byte> output(numSamples * 2 * 4);
+  std::uint32_t checksum = 0;
+
+  std::cout << "samples: " << numSamples << " x " << callCount << " calls\n";
+
+  const std::pair<std::size_t, std::size_t> formats[] = {{1, 2}, {2, 2}, {2, 3}, {2, 4}};
+  for (const auto& [numChannels, bytesPerSample] : formats) {
+    const auto scalar = Measure(InterleaveAudioScalar, source, numChannels, bytesPerSample, numSamples, callCount, output);
+    const auto sse2 = Measure(InterleaveAudioSSE2, source, numChannels, bytesPerSample, numSamples, callCount, output);
+    const auto dispatched = Measure(InterleaveAudio, source, numChannels, bytesPerSample, numSamples, callCount, output);
+    checksum += static_cast<std::uint32_t>(output[0]) + static_cast<std::uint32_t>(output[output.size() / 2]);
+    std::cout << numChannels << "ch " << bytesPerSample * 8 << "bit: scalar " << scalar / 1e9 << " GB/s, sse2 " << sse2 / 1e9 << " GB/s, dispatched " << dispatched / 1e9 << " GB/s\n";
+  }
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+// memory usage of a benchmark process: the bytes allocated with operator new and not yet freed, and the resident set size
+// replaces the global operator new and delete, so include this header from the source file of main only
+// the resident set size does not shrink when memory is freed to the allocator, so compare it only across growth
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+# include <Windows.h>
+# include <psapi.h>
+# pragma comment(lib, "psapi.lib")
+#else
+# include <unistd.h>
+#endif
+
+
+namespace test::memory_usage {
+  // each allocation is prefixed with its size, padded to keep the alignment of operator new
+  inline constexpr std::size_t HeaderSize = alignof(std::max_align_t);
+
+  inline std::atomic<std::size_t> heapBytes{0};
+
+
+  inline void* Allocate(std::size_t size) {
+    const auto ptr = static_cast<std::byte*>(std::malloc(size + HeaderSize));
+    if (!ptr) {
+      throw std::bad_alloc();
+    }
+    *reinterpret_cast<std::size_t*>(ptr) = size;
+    heapBytes.fetch_add(size, std::memory_order_relaxed);
+    return ptr + HeaderSize;
+  }
+
+
+  inline void Free(void* ptr) noexcept {
+    if (!ptr) {
+      return;
+    }
+    const auto base = static_cast<std::byte*>(ptr) - HeaderSize;
+    heapBytes.fetch_sub(*reinterpret_cast<std::size_t*>(base), std::memory_order_relaxed);
+    std::free(base);
+  }
+}
+
+
+void* operator new(std::size_t size) {
+  return test::memory_usage::Allocate(size);
+}
+
+
+void* operator new[](std::size_t size) {
+  return test::memory_usage::Allocate(size);
+}
+
+
+void operator delete(void* ptr) noexcept {
+  test::memory_usage::Free(ptr);
+}
+
+
+void operator delete[](void* ptr) noexcept {
+  test::memory_usage::Free(ptr);
+}
+
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  test::memory_usage::Free(ptr);
+}
+
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+  test::memory_usage::Free(ptr);
+}
+
+
+namespace test {
+  // bytes allocated with operator new (except over-aligned allocations) and not yet freed
+  inline std::size_t GetHeapBytes() {
+    return memory_usage::heapBytes.load(std::memory_order_relaxed);
+  }
+
+
+  inline std::size_t GetResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS processMemoryCounters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &processMemoryCounters, sizeof(processMemoryCounters))) {
+      return 0;
+    }
+    return processMemoryCounters.WorkingSetSize;
+#else
+    // the second field of /proc/self/statm is the resident set size in pages
+    std::size_t totalPages = 0;
+    std::size_t residentPages = 0;
+    if (const auto file = std::fopen("/proc/self/statm", "r")) {
+      if (std::fscanf(file, "%zu %zu", &totalPages, &residentPages) != 2) {
+        residentPages = 0;
+      }
+      std::fclose(file);
+    }
+    return residentPages * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+  }
+}
@@ -0,0 +1,110 @@
+// small random reads from MergedSource with thousands of segments, as a cue sheet with many tracks or FILE entries gives
+// the linear segment lookup which MergedSource used before is measured alongside for comparison
+// usage: MergedSourceBenchmark [reads] [segment size]
+
+#include "../../MFPSCue/MemorySource.hpp"
+#include "../../MFPSCue/MergedSource.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <Windows.h>
+
+
+
+namespace {
+  // the former MergedSource::Read, without its handling of short reads
+  class LinearMergedSource : public Source {
+    std::vector<std::shared_ptr<Source>> mSources;
+    std::vector<SourceOffset> mSourceOffsets;
+
+  public:
+    LinearMergedSource(const std::vector<std::shared_ptr<Source>>& sources) :
+      mSources(sources)
+    {
+      SourceOffset offset = 0;
+      for (const auto& source : sources) {
+        mSourceOffsets.push_back(offset);
+        offset += source->GetSize();
+      }
+      mSourceOffsets.push_back(offset);
+    }
+
+    SourceSize GetSize() override {
+      return mSourceOffsets.back();
+    }
+
+    NTSTATUS Read(SourceOffset offset, std::byte* buffer, std::size_t size, std::size_t* readSize) override {
+      size = static_cast<std::size_t>(std::min<SourceSize>(size, GetSize() - std::min(offset, GetSize())));
+      std::size_t sourceIndex = 0;
+      while (size && mSourceOffsets[sourceIndex + 1] <= offset) {
+        sourceIndex++;
+      }
+      std::size_t tempReadSize = 0;
+      while (tempReadSize != size) {
+        const SourceOffset currentOffset = offset + tempReadSize - mSourceOffsets[sourceIndex];
+        const auto sizeToRead = static_cast<std::size_t>(std::min<SourceSize>(size - tempReadSize, mSourceOffsets[sourceIndex + 1] - mSourceOffsets[sourceIndex] - currentOffset));
+        std::size_t currentReadSize = 0;
+        if (const auto status = mSources[sourceIndex]->Read(currentOffset, buffer + tempReadSize, sizeToRead, &currentReadSize); status != STATUS_SUCCESS) {
+          return status;
+        }
+        tempReadSize += currentReadSize;
+        sourceIndex++;
+      }
+      *readSize = tempReadSize;
+      return STATUS_SUCCESS;
+    }
+  };
+
+
+  // returns reads per second
+  double Measure(Source& source, const std::vector<Source::SourceOffset>& offsets, std::size_t readLength, std::size_t& checksum) {
+    std::vector<std::byte> buffer(readLength);
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto offset : offsets) {
+      std::size_t readSize = 0;
+      source.Read(offset, buffer.data(), buffer.size(), &readSize);
+      checksum += readSize + static_cast<std::size_t>(buffer[0]);
+    }
+    return offsets.size() / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t readCount = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+  const std::size_t segmentSize = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 4096;
+  constexpr std::size_t ReadLength = 2048;
+
+  const std::vector<std::byte> segmentData(segmentSize, std::byte{1});
+  std::mt19937_64 engine(1);
+  std::size_t checksum = 0;
+
+  std::cout << "reads: " << readCount << " x " << ReadLength << " bytes, segments of " << segmentSize << " bytes\n";
+  for (const std::size_t segmentCount : {10, 100, 1000, 5000, 20000}) {
+    std::vector<std::shared_ptr<Source>> sources;
+    for (std::size_t i = 0; i < segmentCount; i++) {
+      sources.push_back(std::make_shared<MemorySource>(segmentData.data(), segmentData.size()));
+    }
+    MergedSource merged(sources);
+    LinearMergedSource linear(sources);
+
+    std::vector<Source::SourceOffset> offsets(readCount);
+    for (auto& offset : offsets) {
+      offset = std::uniform_int_distribution<Source::SourceOffset>(0, merged.GetSize() - 1)(engine);
+    }
+
+    const auto binary = Measure(merged, offsets, ReadLength, checksum);
+    const auto linearSearch = Measure(linear, offsets, ReadLength, checksum);
+    std::cout << segmentCount << " segments: binary search " << binary / 1e6 << " M reads/s, linear search " << linearSearch / 1e6 << " M reads/s\n";
+  }
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+
+  return 0;
+}
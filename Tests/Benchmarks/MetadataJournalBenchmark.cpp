@@ -0,0 +1,125 @@
+// metadata changes per second for each MetadataStore::Durability mode, with one writer thread and with several concurrent ones
+// writers change the metadata under an outer lock and commit after releasing it, as Mount does; a reader thread takes the outer lock shared
+// meanwhile, and its reads per second show whether writes and flushes are done while the locks are held
+// runs on the in-memory file API of Compat/FileSystem.cpp; every FlushFileBuffers sleeps for a configurable latency to stand in for the disk
+// usage: MetadataJournalBenchmark [threads] [operations per thread] [flush latency us] [commit delay ms]
+
+#include "CompatFileSystem.hpp"
+
+#include "../../LibMergeFS/MetadataStore.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+
+
+
+namespace {
+  constexpr auto StorePath = L"C:\\MergeFS\\metadata.dat";
+
+
+  struct Result {
+    double seconds;
+    std::size_t flushes;
+    std::size_t reads;
+  };
+
+
+  Result Run(MetadataStore::Durability durability, std::chrono::milliseconds commitDelay, std::size_t threadCount, std::size_t operationCount) {
+    compat::fs::Reset();
+
+    MetadataStore store(StorePath, false, durability, commitDelay);
+    const auto flushesBefore = compat::fs::GetOperationCount(compat::fs::Operation::Flush);
+
+    // stands in for Mount::m_metadataMutex
+    std::shared_mutex outerMutex;
+    std::atomic<bool> finished{false};
+    std::size_t reads = 0;
+    std::thread reader([&]() {
+      while (!finished) {
+        std::shared_lock lock(outerMutex);
+        store.HasMetadata(L"\\t0\\f0");
+        reads++;
+      }
+    });
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; t++) {
+      threads.emplace_back([&store, &outerMutex, t, operationCount]() {
+        for (std::size_t i = 0; i < operationCount; i++) {
+          const auto filename = L"\\t" + std::to_wstring(t) + L"\\f" + std::to_wstring(i % 64);
+          MetadataStore::DeferredCommit deferredCommit(store);
+          {
+            std::lock_guard lock(outerMutex);
+            auto metadata = store.GetMetadata2(filename);
+            metadata.fileAttributes = static_cast<DWORD>(i);
+            store.SetMetadata(filename, metadata);
+          }
+          deferredCommit.Commit();
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    // the on-flush mode has to pay for the flush at some point too
+    store.Flush();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    finished = true;
+    reader.join();
+
+    return {elapsed, compat::fs::GetOperationCount(compat::fs::Operation::Flush) - flushesBefore, reads};
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t threadCount = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 4;
+  const std::size_t operationCount = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 500;
+  const std::chrono::microseconds flushLatency(argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 1000);
+  const std::chrono::milliseconds commitDelay(argc >= 5 ? std::strtoull(argv[4], nullptr, 10) : MetadataStore::DefaultMaxCommitDelay.count());
+
+  compat::fs::SetFaultHook([flushLatency](compat::fs::Operation operation, std::wstring_view) -> DWORD {
+    if (operation == compat::fs::Operation::Flush) {
+      std::this_thread::sleep_for(flushLatency);
+    }
+    return ERROR_SUCCESS;
+  });
+
+  std::cout << "threads:       " << threadCount << " x " << operationCount << " operations\n"
+            << "flush latency: " << flushLatency.count() << " us\n"
+            << "commit delay:  " << commitDelay.count() << " ms\n";
+
+  const std::pair<const char*, MetadataStore::Durability> modes[] = {
+    {"perOperation", MetadataStore::Durability::PerOperation},
+    {"batched     ", MetadataStore::Durability::Batched},
+    {"onFlush     ", MetadataStore::Durability::OnFlush},
+  };
+  std::size_t checksum = 0;
+  for (const auto threads : {std::size_t{1}, threadCount}) {
+    const double totalOperations = static_cast<double>(threads * operationCount);
+    for (const auto& [name, durability] : modes) {
+      const auto result = Run(durability, commitDelay, threads, operationCount);
+      checksum += result.flushes;
+      std::cout << name << " x " << threads << ": " << totalOperations / result.seconds << " operations/s, " << result.flushes << " flushes, "
+                << result.reads / result.seconds << " concurrent reads/s" << std::endl;
+    }
+  }
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+
+  compat::fs::SetFaultHook(nullptr);
+
+  return 0;
+}
@@ -0,0 +1,122 @@
+// opening a MetadataStore of many entries stored in each file format, then looking up random entries
+// V1 and V2 files are parsed into memory entirely and rewritten as V3 on open; V3 files are mapped and only their header and renames are read,
+// so their entries are found through the on-disk index on each lookup
+// runs on the in-memory file API of Compat/FileSystem.cpp, so this measures the parsing and not the disk
+// usage: MetadataLoadBenchmark [entries] [renames] [lookups] [rounds]
+
+#include "CompatFileSystem.hpp"
+
+#include "../LibMergeFS/MetadataFileFixture.hpp"
+
+#include "../../LibMergeFS/MetadataStore.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+
+namespace {
+  constexpr auto StorePath = L"C:\\MergeFS\\metadata.dat";
+
+
+  // a thousand files per directory, as a large tree would have
+  std::wstring KeyFilename(std::size_t index) {
+    return L"\\dir" + std::to_wstring(index / 1000) + L"\\file" + std::to_wstring(index) + L".txt";
+  }
+
+
+  struct Result {
+    double open;
+    double lookup;
+  };
+
+
+  Result Measure(const std::vector<std::byte>& image, const std::vector<std::wstring>& lookupFilenames, std::size_t& checksum) {
+    compat::fs::Reset();
+    test::WriteMetadataFile(StorePath, image);
+
+    const auto start = std::chrono::steady_clock::now();
+    MetadataStore store(StorePath, false);
+    const auto opened = std::chrono::steady_clock::now();
+    for (const auto& filename : lookupFilenames) {
+      checksum += store.GetMetadata(filename).fileAttributes.value();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    return {
+      std::chrono::duration<double>(opened - start).count(),
+      std::chrono::duration<double>(end - opened).count(),
+    };
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t entryCount = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+  const std::size_t renameCount = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 1000;
+  const std::size_t lookupCount = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 100000;
+  const std::size_t rounds = argc >= 5 ? std::strtoull(argv[4], nullptr, 10) : 3;
+
+  std::vector<test::MetadataFileEntry> entries;
+  entries.reserve(entryCount);
+  for (std::size_t i = 0; i < entryCount; i++) {
+    entries.push_back({KeyFilename(i), Metadata{static_cast<DWORD>(FILE_ATTRIBUTE_ARCHIVE | (i & FILE_ATTRIBUTE_HIDDEN)), {}, {}, FILETIME{static_cast<DWORD>(i), 0}, {}}});
+  }
+  std::vector<test::MetadataFileRename> renames;
+  for (std::size_t i = 0; i < renameCount; i++) {
+    renames.push_back({L"\\old" + std::to_wstring(i), L"\\new" + std::to_wstring(i)});
+  }
+
+  std::mt19937_64 engine(1);
+  std::vector<std::wstring> lookupFilenames;
+  for (std::size_t i = 0; i < lookupCount && entryCount != 0; i++) {
+    lookupFilenames.push_back(KeyFilename(engine() % entryCount));
+  }
+
+  const auto v1Image = test::BuildMetadataFileV1(entries, renames);
+  const auto v2Image = test::BuildMetadataFileV2(entries, renames);
+  entries.clear();
+  entries.shrink_to_fit();
+
+  // the V3 file is what opening the V2 one leaves behind
+  compat::fs::Reset();
+  test::WriteMetadataFile(StorePath, v2Image);
+  {
+    MetadataStore store(StorePath, false);
+  }
+  const auto v3Image = compat::fs::ReadAllBytes(StorePath);
+
+  std::cout << "entries: " << entryCount << " metadata entries, " << renameCount << " renames; " << lookupCount << " random lookups\n";
+
+  std::size_t checksum = 0;
+  const std::pair<const char*, const std::vector<std::byte>*> formats[] = {
+    {"V1", &v1Image},
+    {"V2", &v2Image},
+    {"V3", &v3Image},
+  };
+  for (const auto& [name, ptrImage] : formats) {
+    Result best{};
+    for (std::size_t round = 0; round < rounds; round++) {
+      const auto result = Measure(*ptrImage, lookupFilenames, checksum);
+      if (round == 0 || result.open < best.open) {
+        best.open = result.open;
+      }
+      if (round == 0 || result.lookup < best.lookup) {
+        best.lookup = result.lookup;
+      }
+    }
+    std::cout << name << " (" << ptrImage->size() / (1024 * 1024) << " MiB): open " << best.open * 1e3 << " ms, "
+              << (lookupFilenames.empty() ? 0.0 : best.lookup * 1e9 / lookupFilenames.size()) << " ns/lookup" << std::endl;
+  }
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+
+  compat::fs::Reset();
+
+  return 0;
+}
@@ -0,0 +1,123 @@
+// mounting an archive of many inner archives with "recursive", then reading a file of every inner archive in turn, with and without a limit of open nested archives
+// inner archives are only checked for their signature on mount and opened on first access; the limit closes least recently used ones again, which bounds the memory of their trees
+// the archives are read by the stand-in handler of Tests/MFPSArchive/ArchiveFixture.hpp from memory
+// usage: NestedArchiveBenchmark [inner archives] [items per inner archive] [max open nested archives] [rounds]
+
+#include "MemoryUsage.hpp"
+
+#include "../MFPSArchive/ArchiveFixture.hpp"
+
+#include "../../MFPSArchive/NanaZ/Archive.hpp"
+#include "../../MFPSArchive/NanaZ/MemoryBudget.hpp"
+#include "../../MFPSArchive/NanaZ/MemoryStream.hpp"
+#include "../../MFPSArchive/NanaZ/NanaZ.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <Windows.h>
+#include <winrt/base.h>
+
+
+
+namespace {
+  struct Result {
+    double mount = 0;
+    double access = 0;
+    std::size_t mountOpens = 0;
+    std::size_t accessOpens = 0;
+    std::size_t mountHeapBytes = 0;
+    std::size_t peakHeapBytes = 0;
+    std::size_t finalHeapBytes = 0;
+  };
+
+
+  Result Measure(std::size_t maxOpenNestedArchives, NanaZ& nanaZ, MemoryBudget& memoryBudget, std::vector<std::byte>& archiveData, std::size_t numInnerArchives, std::size_t& checksum) {
+    Result result;
+    test::GetHandlerCounters().Reset();
+    const auto baseHeapBytes = test::GetHeapBytes();
+
+    const auto start = std::chrono::steady_clock::now();
+    std::optional<Archive> archive;
+    archive.emplace(nanaZ, memoryBudget, winrt::make_self<InMemoryStream>(archiveData.data(), archiveData.size()), test::MakeArchiveFileInformation(archiveData.size()), L"archive", L"", false, 0, DirectoryTree::OnExisting::Skip, DirectoryTree::ExtractToMemory::Never, test::BracketArchiveName, nullptr, nullptr, maxOpenNestedArchives);
+    const auto mounted = std::chrono::steady_clock::now();
+    result.mountOpens = test::GetHandlerCounters().opens;
+    result.mountHeapBytes = test::GetHeapBytes() - baseHeapBytes;
+
+    for (std::size_t i = 0; i < numInnerArchives; i++) {
+      Archive::Pin pin;
+      const auto ptrDirectoryTree = archive->Get(L"[inner" + std::to_wstring(i) + L".zip]\\file0.bin", pin);
+      if (!ptrDirectoryTree) {
+        std::cerr << "inner archive " << i << " cannot be read" << std::endl;
+        std::exit(1);
+      }
+      checksum += ptrDirectoryTree->fileSize;
+      result.peakHeapBytes = std::max(result.peakHeapBytes, test::GetHeapBytes() - baseHeapBytes);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    result.accessOpens = test::GetHandlerCounters().opens - result.mountOpens;
+
+    // the last access only requests closing the ones above the limit; the next one closes them
+    {
+      Archive::Pin pin;
+      archive->Get(L"", pin);
+    }
+    result.finalHeapBytes = test::GetHeapBytes() - baseHeapBytes;
+    archive.reset();
+
+    result.mount = std::chrono::duration<double>(mounted - start).count();
+    result.access = std::chrono::duration<double>(end - mounted).count();
+    return result;
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t numInnerArchives = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 500;
+  const std::size_t itemsPerInnerArchive = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 200;
+  const std::size_t maxOpenNestedArchives = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 16;
+  const std::size_t rounds = argc >= 5 ? std::strtoull(argv[4], nullptr, 10) : 3;
+
+  test::RegisterArchiveHandler();
+  NanaZ nanaZ(test::HandlerDllFilepath);
+  MemoryBudget memoryBudget(64 << 20);
+
+  std::vector<test::ArchiveEntry> innerEntries;
+  for (std::size_t i = 0; i < itemsPerInnerArchive; i++) {
+    innerEntries.push_back({L"file" + std::to_wstring(i) + L".bin", false, test::GenerateItemData(64, static_cast<unsigned int>(i))});
+  }
+  const auto innerArchiveData = test::BuildArchive(innerEntries);
+
+  std::vector<test::ArchiveEntry> entries;
+  for (std::size_t i = 0; i < numInnerArchives; i++) {
+    entries.push_back({L"inner" + std::to_wstring(i) + L".zip", false, innerArchiveData});
+  }
+  auto archiveData = test::BuildArchive(entries);
+  entries.clear();
+
+  std::cout << "archive: " << numInnerArchives << " inner archives of " << itemsPerInnerArchive << " items, " << archiveData.size() / 1024 << " KiB\n";
+
+  std::size_t checksum = 0;
+  for (const std::size_t limit : {std::size_t{0}, maxOpenNestedArchives}) {
+    Result best;
+    for (std::size_t round = 0; round < rounds; round++) {
+      const auto result = Measure(limit, nanaZ, memoryBudget, archiveData, numInnerArchives, checksum);
+      if (round == 0 || result.mount + result.access < best.mount + best.access) {
+        best = result;
+      }
+    }
+    std::cout << (limit ? "at most " + std::to_string(limit) + " open:" : std::string("unlimited:")) << "\n"
+              << "  mount:  " << best.mount * 1e3 << " ms, " << best.mountOpens << " Open calls, heap " << best.mountHeapBytes / 1024 << " KiB\n"
+              << "  access: " << best.access * 1e3 << " ms, " << best.accessOpens << " Open calls, heap peak " << best.peakHeapBytes / 1024 << " KiB, after trimming " << best.finalHeapBytes / 1024 << " KiB\n";
+  }
+  std::cout << "resident: " << test::GetResidentBytes() / (1024 * 1024) << " MiB\n"
+            << "(checksum " << checksum << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,93 @@
+// per-layer directory enumeration as done by Mount::DFindFiles: sequential versus ThreadPool::RunParallel
+// each synthetic source sleeps for a configurable latency per ListFiles call and returns a fixed set of names
+// the results are merged by layer priority (upper layers win) exactly like the mount does
+// usage: ParallelListingBenchmark [sources] [latency ms] [files per source] [iterations]
+
+#include "../../LibMergeFS/ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+
+
+
+namespace {
+  struct SyntheticSource {
+    std::chrono::milliseconds latency;
+    std::vector<std::wstring> names;
+
+    std::vector<std::wstring> ListFiles() const {
+      std::this_thread::sleep_for(latency);
+      return names;
+    }
+  };
+
+
+  std::map<std::wstring, std::size_t> Merge(const std::vector<std::vector<std::wstring>>& listings) {
+    std::map<std::wstring, std::size_t> merged;
+    for (std::size_t i = 0; i < listings.size(); i++) {
+      for (const auto& name : listings[i]) {
+        merged.emplace(name, i);
+      }
+    }
+    return merged;
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t sourceCount = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 4;
+  const std::chrono::milliseconds latency(argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 20);
+  const std::size_t fileCount = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 1000;
+  const std::size_t iterations = argc >= 5 ? std::strtoull(argv[4], nullptr, 10) : 20;
+
+  std::vector<SyntheticSource> sources;
+  for (std::size_t i = 0; i < sourceCount; i++) {
+    SyntheticSource source{latency, {}};
+    for (std::size_t j = 0; j < fileCount; j++) {
+      // half of the names overlap with the next layer
+      source.names.push_back(L"file" + std::to_wstring(i * fileCount / 2 + j));
+    }
+    sources.push_back(std::move(source));
+  }
+
+  ThreadPool threadPool(std::min<std::size_t>(8, sourceCount - 1));
+
+  std::size_t checksum = 0;
+
+  const auto sequentialStart = std::chrono::steady_clock::now();
+  for (std::size_t iteration = 0; iteration < iterations; iteration++) {
+    std::vector<std::vector<std::wstring>> listings(sourceCount);
+    for (std::size_t i = 0; i < sourceCount; i++) {
+      listings[i] = sources[i].ListFiles();
+    }
+    checksum += Merge(listings).size();
+  }
+  const auto sequentialElapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sequentialStart).count() / iterations;
+
+  const auto parallelStart = std::chrono::steady_clock::now();
+  for (std::size_t iteration = 0; iteration < iterations; iteration++) {
+    std::vector<std::vector<std::wstring>> listings(sourceCount);
+    threadPool.RunParallel(sourceCount, [&](std::size_t i) {
+      listings[i] = sources[i].ListFiles();
+    });
+    checksum += Merge(listings).size();
+  }
+  const auto parallelElapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - parallelStart).count() / iterations;
+
+  std::cout << "sources:    " << sourceCount << " x " << latency.count() << " ms, " << fileCount << " files each\n"
+            << "sequential: " << sequentialElapsed << " ms per listing\n"
+            << "parallel:   " << parallelElapsed << " ms per listing\n"
+            << "(checksum " << checksum << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,149 @@
+// PathPool::Intern and handle release from several threads at once, as Dokan worker threads open and close files
+// each thread interns paths from a shared set and drops them again, so every operation touches the pool
+// then the memory of the file contexts of a whole tree, whose filename and resolvedFilename are plain std::wstring as before PathPool or
+// PooledPath handles, with some files opened several times at once
+// each layout is measured in a process of its own, since the resident set size does not shrink when memory is freed
+// usage: PathPoolBenchmark [threads] [operations per thread] [paths] [files] [contexts per file] [plain|pooled]
+
+#include "MemoryUsage.hpp"
+
+#include "../../LibMergeFS/PathPool.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+
+namespace {
+  std::wstring MakePath(std::size_t index) {
+    return L"\\Data\\Directory" + std::to_wstring(index % 1000) + L"\\File" + std::to_wstring(index) + L".dat";
+  }
+
+
+  void MeasureThroughput(std::size_t threadCount, std::size_t operationCount, std::size_t pathCount) {
+    std::vector<std::wstring> paths;
+    paths.reserve(pathCount);
+    for (std::size_t i = 0; i < pathCount; i++) {
+      paths.push_back(MakePath(i));
+    }
+
+    PathPool pool;
+    // half of the paths stay alive, so both hits and misses with removal are measured
+    std::vector<PooledPath> resident;
+    for (std::size_t i = 0; i < pathCount; i += 2) {
+      resident.push_back(pool.Intern(paths[i]));
+    }
+
+    std::vector<std::size_t> checksums(threadCount, 0);
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; t++) {
+      threads.emplace_back([&pool, &paths, &checksums, t, operationCount, pathCount]() {
+        std::size_t checksum = 0;
+        for (std::size_t i = 0; i < operationCount; i++) {
+          const auto handle = pool.Intern(paths[(i * 7919 + t * 104729) % pathCount]);
+          checksum += handle.size();
+        }
+        checksums[t] = checksum;
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::size_t checksum = 0;
+    for (const auto value : checksums) {
+      checksum += value;
+    }
+    const auto statistics = pool.GetStatistics();
+    std::cout << "threads:  " << threadCount << " x " << operationCount << " operations over " << pathCount << " paths\n"
+              << "intern:   " << threadCount * operationCount / elapsed / 1e6 << " M/s\n"
+              << "entries:  " << statistics.entries << " (" << statistics.bytes << " bytes)\n"
+              << "(checksum " << checksum << ")" << std::endl;
+  }
+
+
+  // the path members of Mount::FileContext
+  template<typename T>
+  struct ContextPaths {
+    T filename;
+    T resolvedFilename;
+  };
+
+
+  template<typename T, typename F>
+  void MeasureMemory(const char* name, std::size_t fileCount, std::size_t contextsPerFile, F makePath) {
+    const auto baseHeapBytes = test::GetHeapBytes();
+    const auto baseResidentBytes = test::GetResidentBytes();
+
+    std::vector<ContextPaths<T>> contexts;
+    contexts.reserve(fileCount * contextsPerFile);
+    std::size_t checksum = 0;
+    for (std::size_t i = 0; i < fileCount; i++) {
+      // Dokan passes the name of each open separately; files without renames resolve to the same name
+      for (std::size_t c = 0; c < contextsPerFile; c++) {
+        const auto path = MakePath(i);
+        contexts.push_back({makePath(path), makePath(path)});
+      }
+      checksum += std::wstring_view(contexts.back().filename).size();
+    }
+
+    const auto heapBytes = test::GetHeapBytes() - baseHeapBytes;
+    const auto residentBytes = test::GetResidentBytes() - baseResidentBytes;
+    std::cout << name << heapBytes / (1024 * 1024) << " MiB heap, " << residentBytes / (1024 * 1024) << " MiB resident ("
+              << static_cast<double>(residentBytes) / fileCount << " bytes/file)\n"
+              << "(checksum " << checksum << ")" << std::endl;
+  }
+
+
+  void MeasureMemory(const std::string& layout, std::size_t fileCount, std::size_t contextsPerFile) {
+    if (layout == "plain") {
+      MeasureMemory<std::wstring>("std::wstring: ", fileCount, contextsPerFile, [](const std::wstring& path) {
+        return path;
+      });
+    } else {
+      PathPool pool;
+      MeasureMemory<PooledPath>("PooledPath:   ", fileCount, contextsPerFile, [&pool](const std::wstring& path) {
+        return pool.Intern(path);
+      });
+    }
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t threadCount = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : std::thread::hardware_concurrency();
+  const std::size_t operationCount = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+  const std::size_t pathCount = argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 100000;
+  const std::size_t fileCount = argc >= 5 ? std::strtoull(argv[4], nullptr, 10) : 1000000;
+  const std::size_t contextsPerFile = argc >= 6 ? std::strtoull(argv[5], nullptr, 10) : 2;
+
+  if (argc >= 7) {
+    MeasureMemory(argv[6], fileCount, contextsPerFile);
+    return 0;
+  }
+
+  MeasureThroughput(threadCount, operationCount, pathCount);
+
+  std::cout << "tree:     " << fileCount << " files, " << contextsPerFile << " open contexts each" << std::endl;
+  for (const char* layout : {"plain", "pooled"}) {
+    auto command = "\"" + std::string(argv[0]) + "\" 0 0 0 " + std::to_string(fileCount) + " " + std::to_string(contextsPerFile) + " " + layout;
+#ifdef _WIN32
+    // cmd.exe strips the outermost quotes
+    command = "\"" + command + "\"";
+#endif
+    if (std::system(command.c_str()) != 0) {
+      std::cerr << "failed to run " << command << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,55 @@
+// RenameStore::Rename and RenameStore::Resolve on a store holding many entries
+// files spread over a fixed number of directories are renamed into other directories, then every renamed path and as many untouched paths are resolved
+// usage: RenameStoreBenchmark [renames] [directories]
+
+#include "../../LibMergeFS/RenameStore.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t renameCount = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+  const std::size_t directoryCount = argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 1000;
+
+  std::vector<std::wstring> sources;
+  std::vector<std::wstring> destinations;
+  std::vector<std::wstring> untouched;
+  sources.reserve(renameCount);
+  destinations.reserve(renameCount);
+  untouched.reserve(renameCount);
+  for (std::size_t i = 0; i < renameCount; i++) {
+    const auto directory = L"\\Data\\Directory" + std::to_wstring(i % directoryCount);
+    sources.push_back(directory + L"\\File" + std::to_wstring(i) + L".dat");
+    destinations.push_back(L"\\Data\\Directory" + std::to_wstring((i * 7 + 1) % directoryCount) + L"\\Renamed" + std::to_wstring(i) + L".dat");
+    untouched.push_back(directory + L"\\Other" + std::to_wstring(i) + L".dat");
+  }
+
+  RenameStore store(false);
+  std::size_t checksum = 0;
+
+  const auto renameStart = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < renameCount; i++) {
+    checksum += static_cast<std::size_t>(store.Rename(sources[i], destinations[i]));
+  }
+  const auto renameElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - renameStart).count();
+
+  const auto resolveStart = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < renameCount; i++) {
+    checksum += store.Resolve(destinations[i])->size();
+    checksum += store.Resolve(untouched[i])->size();
+  }
+  const auto resolveElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - resolveStart).count();
+
+  std::cout << "renames:  " << renameCount << " over " << directoryCount << " directories\n"
+            << "rename:   " << renameCount / renameElapsed / 1e6 << " M/s\n"
+            << "resolve:  " << 2 * renameCount / resolveElapsed / 1e6 << " M/s\n"
+            << "(checksum " << checksum << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+// copy-up of one file between two in-memory sources, with TransportData (ExportData and ImportData in turn) and TransportDataPipelined
+// both sources sleep in proportion to the size of every ExportData and ImportData to stand in for a disk or an archive decoder
+// the pipelined copy should approach the time of the slower side alone, the sequential one the sum of both
+// usage: TransportBenchmark [file MiB] [export us per MiB] [import us per MiB] [rounds]
+
+#include "../LibMergeFS/MemoryMountSource.hpp"
+
+#include "../../LibMergeFS/Transport.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <Windows.h>
+
+
+
+namespace {
+  using test::MemoryMountSource;
+
+
+  double Measure(bool pipelined, const std::vector<char>& data, const MemoryMountSource::Options& sourceOptions, const MemoryMountSource::Options& destinationOptions, std::size_t& checksum) {
+    MemoryMountSource source(data, sourceOptions);
+    MemoryMountSource destination({}, destinationOptions);
+    MemoryMountSource::PORTATION_INFO portationInfo{L"\\file", 0, FALSE, nullptr, nullptr, FALSE, {}, {}, 0, nullptr};
+
+    const auto start = std::chrono::steady_clock::now();
+    source.ExportStart(&portationInfo);
+    destination.ImportStart(&portationInfo);
+    const auto status = pipelined ? TransportDataPipelined(source, destination, portationInfo) : TransportData(source, destination, portationInfo);
+    destination.ImportFinish(&portationInfo, status == STATUS_SUCCESS);
+    source.ExportFinish(&portationInfo, status == STATUS_SUCCESS);
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (status != STATUS_SUCCESS || destination.GetData() != data) {
+      std::cerr << "copy failed with status " << status << std::endl;
+      std::exit(1);
+    }
+    for (std::size_t offset = 0; offset < data.size(); offset += 4096) {
+      checksum += static_cast<unsigned char>(destination.GetData()[offset]);
+    }
+    return elapsed;
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  const std::size_t fileMiB = argc >= 2 ? std::strtoull(argv[1], nullptr, 10) : 64;
+  const std::chrono::microseconds exportLatency(argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 2000);
+  const std::chrono::microseconds importLatency(argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 3000);
+  const std::size_t rounds = argc >= 5 ? std::strtoull(argv[4], nullptr, 10) : 3;
+
+  const auto data = test::GenerateFileData(fileMiB * 1024 * 1024);
+
+  MemoryMountSource::Options sourceOptions;
+  sourceOptions.latencyPerMiB = exportLatency;
+  MemoryMountSource::Options destinationOptions;
+  destinationOptions.latencyPerMiB = importLatency;
+
+  std::cout << "file:    " << fileMiB << " MiB in chunks of " << sourceOptions.chunkSize / 1024 << " KiB\n"
+            << "latency: export " << exportLatency.count() << " us/MiB, import " << importLatency.count() << " us/MiB\n";
+
+  std::size_t checksum = 0;
+  for (const bool pipelined : {false, true}) {
+    double best = 0;
+    for (std::size_t round = 0; round < rounds; round++) {
+      const auto elapsed = Measure(pipelined, data, sourceOptions, destinationOptions, checksum);
+      if (round == 0 || elapsed < best) {
+        best = elapsed;
+      }
+    }
+    std::cout << (pipelined ? "pipelined:  " : "sequential: ") << best * 1e3 << " ms, " << fileMiB / best << " MiB/s\n";
+  }
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+
+  return 0;
+}
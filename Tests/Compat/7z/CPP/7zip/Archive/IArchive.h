@@ -0,0 +1,141 @@
+#pragma once
+
+// the archive handler interfaces of 7-Zip's 7zip/Archive/IArchive.h and the property ids of 7zip/PropID.h
+// only the members used by MFPSArchive are declared
+
+#include <7z/CPP/Common/Common.h>
+#include <7z/CPP/7zip/IProgress.h>
+#include <7z/CPP/7zip/IStream.h>
+
+#include <cstddef>
+
+#include <Propidl.h>
+
+
+enum {
+  kpidNoProperty = 0,
+  kpidMainSubfile,
+  kpidHandlerItemIndex,
+  kpidPath,
+  kpidName,
+  kpidExtension,
+  kpidIsDir,
+  kpidSize,
+  kpidPackSize,
+  kpidAttrib,
+  kpidCTime,
+  kpidATime,
+  kpidMTime,
+  kpidSolid,
+  kpidCommented,
+  kpidEncrypted,
+  kpidSplitBefore,
+  kpidSplitAfter,
+  kpidDictionarySize,
+  kpidCRC,
+  kpidType,
+  kpidIsAnti,
+  kpidMethod,
+  kpidErrorFlags = 71,
+};
+
+
+const UInt32 kpv_ErrorFlags_IsNotArc = 1 << 0;
+
+const UInt32 k_IsArc_Res_NO = 0;
+const UInt32 k_IsArc_Res_YES = 1;
+const UInt32 k_IsArc_Res_NEED_MORE = 2;
+
+
+namespace NArchive {
+  namespace NHandlerPropID {
+    enum {
+      kName = 0,
+      kClassID,
+      kExtension,
+      kAddExtension,
+      kUpdate,
+      kKeepName,
+      kSignature,
+      kMultiSignature,
+      kSignatureOffset,
+      kAltStreams,
+      kNtSecure,
+      kFlags,
+      kTimeFlags,
+    };
+  }
+
+  namespace NExtract {
+    namespace NAskMode {
+      enum {
+        kExtract = 0,
+        kTest,
+        kSkip,
+        kReadExternal,
+      };
+    }
+
+    namespace NOperationResult {
+      enum {
+        kOK = 0,
+        kUnsupportedMethod,
+        kDataError,
+        kCRCError,
+        kUnavailable,
+        kUnexpectedEnd,
+        kDataAfterEnd,
+        kIsNotArc,
+        kHeadersError,
+        kWrongPassword,
+      };
+    }
+  }
+}
+
+
+struct IArchiveOpenCallback : public IUnknown {
+  STDMETHOD(SetTotal)(const UInt64* files, const UInt64* bytes) PURE;
+  STDMETHOD(SetCompleted)(const UInt64* files, const UInt64* bytes) PURE;
+};
+
+
+struct IArchiveExtractCallback : public IProgress {
+  STDMETHOD(GetStream)(UInt32 index, ISequentialOutStream** outStream, Int32 askExtractMode) PURE;
+  STDMETHOD(PrepareOperation)(Int32 askExtractMode) PURE;
+  STDMETHOD(SetOperationResult)(Int32 opRes) PURE;
+};
+
+
+struct IInArchiveGetStream : public IUnknown {
+  STDMETHOD(GetStream)(UInt32 index, ISequentialInStream** stream) PURE;
+};
+
+
+struct IInArchive : public IUnknown {
+  STDMETHOD(Open)(IInStream* stream, const UInt64* maxCheckStartPosition, IArchiveOpenCallback* openCallback) PURE;
+  STDMETHOD(Close)() PURE;
+  STDMETHOD(GetNumberOfItems)(UInt32* numItems) PURE;
+  STDMETHOD(GetProperty)(UInt32 index, PROPID propID, PROPVARIANT* value) PURE;
+  STDMETHOD(Extract)(const UInt32* indices, UInt32 numItems, Int32 testMode, IArchiveExtractCallback* extractCallback) PURE;
+  STDMETHOD(GetArchiveProperty)(PROPID propID, PROPVARIANT* value) PURE;
+  STDMETHOD(GetNumberOfProperties)(UInt32* numProps) PURE;
+  STDMETHOD(GetPropertyInfo)(UInt32 index, BSTR* name, PROPID* propID, VARTYPE* varType) PURE;
+  STDMETHOD(GetNumberOfArchiveProperties)(UInt32* numProps) PURE;
+  STDMETHOD(GetArchivePropertyInfo)(UInt32 index, BSTR* name, PROPID* propID, VARTYPE* varType) PURE;
+};
+
+
+// {23170F69-40C1-278A-0000-0006xxxx0000}
+inline constexpr IID IID_IArchiveOpenCallback = {0x23170F69, 0x40C1, 0x278A, {0x00, 0x00, 0x00, 0x06, 0x00, 0x10, 0x00, 0x00}};
+inline constexpr IID IID_IArchiveExtractCallback = {0x23170F69, 0x40C1, 0x278A, {0x00, 0x00, 0x00, 0x06, 0x00, 0x20, 0x00, 0x00}};
+inline constexpr IID IID_IInArchiveGetStream = {0x23170F69, 0x40C1, 0x278A, {0x00, 0x00, 0x00, 0x06, 0x00, 0x40, 0x00, 0x00}};
+inline constexpr IID IID_IInArchive = {0x23170F69, 0x40C1, 0x278A, {0x00, 0x00, 0x00, 0x06, 0x00, 0x60, 0x00, 0x00}};
+
+
+// exports of 7z.dll
+typedef HRESULT (WINAPI* Func_CreateObject)(const GUID* clsID, const GUID* iid, void** outObject);
+typedef UInt32 (WINAPI* Func_IsArc)(const Byte* p, std::size_t size);
+typedef HRESULT (WINAPI* Func_GetIsArc)(UInt32 formatIndex, Func_IsArc* isArc);
+typedef HRESULT (WINAPI* Func_GetNumberOfFormats)(UInt32* numFormats);
+typedef HRESULT (WINAPI* Func_GetHandlerProperty2)(UInt32 index, PROPID propID, PROPVARIANT* value);
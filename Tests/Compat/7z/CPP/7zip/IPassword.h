@@ -0,0 +1,13 @@
+#pragma once
+
+// ICryptoGetTextPassword of 7-Zip's 7zip/IPassword.h
+
+#include <7z/CPP/Common/Common.h>
+
+
+struct ICryptoGetTextPassword : public IUnknown {
+  STDMETHOD(CryptoGetTextPassword)(BSTR* password) PURE;
+};
+
+
+inline constexpr IID IID_ICryptoGetTextPassword = {0x23170F69, 0x40C1, 0x278A, {0x00, 0x00, 0x00, 0x05, 0x00, 0x10, 0x00, 0x00}};
@@ -0,0 +1,14 @@
+#pragma once
+
+// IProgress of 7-Zip's 7zip/IProgress.h
+
+#include <7z/CPP/Common/Common.h>
+
+
+struct IProgress : public IUnknown {
+  STDMETHOD(SetTotal)(UInt64 total) PURE;
+  STDMETHOD(SetCompleted)(const UInt64* completeValue) PURE;
+};
+
+
+inline constexpr IID IID_IProgress = {0x23170F69, 0x40C1, 0x278A, {0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00}};
@@ -0,0 +1,46 @@
+#pragma once
+
+// the stream interfaces of 7-Zip's 7zip/IStream.h
+
+#include <7z/CPP/Common/Common.h>
+
+
+enum {
+  STREAM_SEEK_SET = 0,
+  STREAM_SEEK_CUR = 1,
+  STREAM_SEEK_END = 2,
+};
+
+
+struct ISequentialInStream : public IUnknown {
+  STDMETHOD(Read)(void* data, UInt32 size, UInt32* processedSize) PURE;
+};
+
+
+struct ISequentialOutStream : public IUnknown {
+  STDMETHOD(Write)(const void* data, UInt32 size, UInt32* processedSize) PURE;
+};
+
+
+struct IInStream : public ISequentialInStream {
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64* newPosition) PURE;
+};
+
+
+struct IOutStream : public ISequentialOutStream {
+  STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64* newPosition) PURE;
+  STDMETHOD(SetSize)(UInt64 newSize) PURE;
+};
+
+
+struct IStreamGetSize : public IUnknown {
+  STDMETHOD(GetSize)(UInt64* size) PURE;
+};
+
+
+// {23170F69-40C1-278A-0000-0003xxxx0000}
+inline constexpr IID IID_ISequentialInStream = {0x23170F69, 0x40C1, 0x278A, {0x00, 0x00, 0x00, 0x03, 0x00, 0x01, 0x00, 0x00}};
+inline constexpr IID IID_ISequentialOutStream = {0x23170F69, 0x40C1, 0x278A, {0x00, 0x00, 0x00, 0x03, 0x00, 0x02, 0x00, 0x00}};
+inline constexpr IID IID_IInStream = {0x23170F69, 0x40C1, 0x278A, {0x00, 0x00, 0x00, 0x03, 0x00, 0x03, 0x00, 0x00}};
+inline constexpr IID IID_IOutStream = {0x23170F69, 0x40C1, 0x278A, {0x00, 0x00, 0x00, 0x03, 0x00, 0x04, 0x00, 0x00}};
+inline constexpr IID IID_IStreamGetSize = {0x23170F69, 0x40C1, 0x278A, {0x00, 0x00, 0x00, 0x03, 0x00, 0x06, 0x00, 0x00}};
@@ -0,0 +1,16 @@
+#pragma once
+
+// the integer types of 7-Zip's Common/MyTypes.h
+
+#include <cstdint>
+
+#include <Windows.h>
+
+
+typedef std::uint8_t Byte;
+typedef std::int16_t Int16;
+typedef std::uint16_t UInt16;
+typedef std::int32_t Int32;
+typedef std::uint32_t UInt32;
+typedef std::int64_t Int64;
+typedef std::uint64_t UInt64;
@@ -0,0 +1,5 @@
+#pragma once
+
+// 7-Zip's Common/MyCom.h; the components under test use C++/WinRT (Compat/winrt/base.h) instead of its smart pointers
+
+#include <7z/CPP/Common/Common.h>
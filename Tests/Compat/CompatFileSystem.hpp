@@ -0,0 +1,55 @@
+#pragma once
+
+// control interface of the in-memory file API declared in Compat/Windows.h
+// files live only in memory; tests can capture the state the disk would be left in if the process were killed at any point,
+// restore such a state and make individual operations fail
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <Windows.h>
+
+
+namespace compat::fs {
+  enum class Operation {
+    Create,   // CreateFileW (including truncation by CREATE_ALWAYS)
+    Write,    // WriteFile
+    Flush,    // FlushFileBuffers
+    Move,     // MoveFileExW (path is the source)
+    Delete,   // DeleteFileW
+  };
+
+  struct Buffer;
+
+  // contents of a file at some point
+  // versions share their buffers; appending in place never changes the bytes an older version refers to
+  struct FileVersion {
+    std::shared_ptr<Buffer> buffer;
+    std::size_t size = 0;
+  };
+
+  // contents of every file, as they would remain after the process was killed
+  using Image = std::map<std::wstring, FileVersion, std::less<>>;
+
+  // removes every file; must not be called while handles are open
+  void Reset();
+  Image CaptureImage();
+  // replaces every file with the image; must not be called while handles are open
+  void RestoreImage(const Image& image);
+  std::vector<std::byte> ReadImageFile(const Image& image, std::wstring_view path);
+  bool Exists(std::wstring_view path);
+  std::vector<std::byte> ReadAllBytes(std::wstring_view path);
+  // true if the file has been written since it was last flushed with FlushFileBuffers
+  bool IsDirty(std::wstring_view path);
+  std::size_t GetOperationCount(Operation operation);
+
+  // called after every operation which changes a file or a directory entry (not while any lock of the file system is held)
+  void SetMutationHook(std::function<void(Operation operation, std::wstring_view path)> hook);
+  // called before every operation; returning an error code other than ERROR_SUCCESS makes the operation fail without any effect
+  void SetFaultHook(std::function<DWORD(Operation operation, std::wstring_view path)> hook);
+}
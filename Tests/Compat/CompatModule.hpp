@@ -0,0 +1,24 @@
+#pragma once
+
+// control interface of the module API declared in Compat/Windows.h
+// tests register the exports of a stand-in DLL under a file name, which LoadLibraryW then finds
+
+#include <map>
+#include <string>
+
+#include <Windows.h>
+
+
+namespace compat::module {
+  using Exports = std::map<std::string, FARPROC, std::less<>>;
+
+  // replaces the module registered with the same name; must not be called while the module is loaded
+  void Register(const std::wstring& filename, Exports exports);
+  void Unregister(const std::wstring& filename);
+
+
+  template<typename T>
+  FARPROC Export(T* function) {
+    return reinterpret_cast<FARPROC>(function);
+  }
+}
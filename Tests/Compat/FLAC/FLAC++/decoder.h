@@ -0,0 +1,221 @@
+#pragma once
+
+// the subset of libFLAC++'s stream decoder used by MFPSCue, for hosts where libFLAC is neither checked out in MFPSCue/Vendor/flac nor installed
+// implemented in Compat/FLAC/StreamDecoder.cpp following the behavior of libFLAC 1.3/1.4 which MFPSCue relies on:
+// - get_decode_position returns the offset of the next frame (the position of the stream minus the buffered data)
+// - flush discards the buffered data and disables MD5 checking; the next frame is searched from the current position of the stream
+// - seek_absolute passes the frame containing the target sample to write_callback, with the samples before the target trimmed
+// - frame numbers of fixed-blocksize streams are converted to sample numbers before write_callback
+// only native FLAC (no Ogg) is supported and MD5 is never checked
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+
+using FLAC__bool = int;
+using FLAC__byte = std::uint8_t;
+using FLAC__int32 = std::int32_t;
+using FLAC__uint32 = std::uint32_t;
+using FLAC__uint64 = std::uint64_t;
+
+
+enum FLAC__StreamDecoderState {
+  FLAC__STREAM_DECODER_SEARCH_FOR_METADATA = 0,
+  FLAC__STREAM_DECODER_READ_METADATA,
+  FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC,
+  FLAC__STREAM_DECODER_READ_FRAME,
+  FLAC__STREAM_DECODER_END_OF_STREAM,
+  FLAC__STREAM_DECODER_OGG_ERROR,
+  FLAC__STREAM_DECODER_SEEK_ERROR,
+  FLAC__STREAM_DECODER_ABORTED,
+  FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR,
+  FLAC__STREAM_DECODER_UNINITIALIZED,
+};
+
+enum FLAC__StreamDecoderInitStatus {
+  FLAC__STREAM_DECODER_INIT_STATUS_OK = 0,
+  FLAC__STREAM_DECODER_INIT_STATUS_UNSUPPORTED_CONTAINER,
+  FLAC__STREAM_DECODER_INIT_STATUS_INVALID_CALLBACKS,
+  FLAC__STREAM_DECODER_INIT_STATUS_MEMORY_ALLOCATION_ERROR,
+  FLAC__STREAM_DECODER_INIT_STATUS_ERROR_OPENING_FILE,
+  FLAC__STREAM_DECODER_INIT_STATUS_ALREADY_INITIALIZED,
+};
+
+enum FLAC__StreamDecoderReadStatus {
+  FLAC__STREAM_DECODER_READ_STATUS_CONTINUE,
+  FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM,
+  FLAC__STREAM_DECODER_READ_STATUS_ABORT,
+};
+
+enum FLAC__StreamDecoderSeekStatus {
+  FLAC__STREAM_DECODER_SEEK_STATUS_OK,
+  FLAC__STREAM_DECODER_SEEK_STATUS_ERROR,
+  FLAC__STREAM_DECODER_SEEK_STATUS_UNSUPPORTED,
+};
+
+enum FLAC__StreamDecoderTellStatus {
+  FLAC__STREAM_DECODER_TELL_STATUS_OK,
+  FLAC__STREAM_DECODER_TELL_STATUS_ERROR,
+  FLAC__STREAM_DECODER_TELL_STATUS_UNSUPPORTED,
+};
+
+enum FLAC__StreamDecoderLengthStatus {
+  FLAC__STREAM_DECODER_LENGTH_STATUS_OK,
+  FLAC__STREAM_DECODER_LENGTH_STATUS_ERROR,
+  FLAC__STREAM_DECODER_LENGTH_STATUS_UNSUPPORTED,
+};
+
+enum FLAC__StreamDecoderWriteStatus {
+  FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE,
+  FLAC__STREAM_DECODER_WRITE_STATUS_ABORT,
+};
+
+enum FLAC__StreamDecoderErrorStatus {
+  FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC,
+  FLAC__STREAM_DECODER_ERROR_STATUS_BAD_HEADER,
+  FLAC__STREAM_DECODER_ERROR_STATUS_FRAME_CRC_MISMATCH,
+  FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM,
+};
+
+
+enum FLAC__MetadataType {
+  FLAC__METADATA_TYPE_STREAMINFO = 0,
+  FLAC__METADATA_TYPE_PADDING = 1,
+  FLAC__METADATA_TYPE_APPLICATION = 2,
+  FLAC__METADATA_TYPE_SEEKTABLE = 3,
+  FLAC__METADATA_TYPE_VORBIS_COMMENT = 4,
+  FLAC__METADATA_TYPE_CUESHEET = 5,
+  FLAC__METADATA_TYPE_PICTURE = 6,
+};
+
+constexpr FLAC__uint64 FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER = 0xFFFFFFFFFFFFFFFFull;
+
+struct FLAC__StreamMetadata_StreamInfo {
+  std::uint32_t min_blocksize, max_blocksize;
+  std::uint32_t min_framesize, max_framesize;
+  std::uint32_t sample_rate;
+  std::uint32_t channels;
+  std::uint32_t bits_per_sample;
+  FLAC__uint64 total_samples;
+  FLAC__byte md5sum[16];
+};
+
+struct FLAC__StreamMetadata_SeekPoint {
+  FLAC__uint64 sample_number;
+  FLAC__uint64 stream_offset;
+  std::uint32_t frame_samples;
+};
+
+struct FLAC__StreamMetadata_SeekTable {
+  std::uint32_t num_points;
+  FLAC__StreamMetadata_SeekPoint* points;
+};
+
+struct FLAC__StreamMetadata {
+  FLAC__MetadataType type;
+  FLAC__bool is_last;
+  std::uint32_t length;
+  union {
+    FLAC__StreamMetadata_StreamInfo stream_info;
+    FLAC__StreamMetadata_SeekTable seek_table;
+  } data;
+};
+
+
+enum FLAC__FrameNumberType {
+  FLAC__FRAME_NUMBER_TYPE_FRAME_NUMBER,
+  FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER,
+};
+
+enum FLAC__ChannelAssignment {
+  FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT = 0,
+  FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE = 1,
+  FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE = 2,
+  FLAC__CHANNEL_ASSIGNMENT_MID_SIDE = 3,
+};
+
+struct FLAC__FrameHeader {
+  std::uint32_t blocksize;
+  std::uint32_t sample_rate;
+  std::uint32_t channels;
+  FLAC__ChannelAssignment channel_assignment;
+  std::uint32_t bits_per_sample;
+  FLAC__FrameNumberType number_type;
+  union {
+    FLAC__uint32 frame_number;
+    FLAC__uint64 sample_number;
+  } number;
+  FLAC__byte crc;
+};
+
+struct FLAC__FrameFooter {
+  std::uint16_t crc;
+};
+
+// subframes are not exposed
+struct FLAC__Frame {
+  FLAC__FrameHeader header;
+  FLAC__FrameFooter footer;
+};
+
+
+namespace FLAC::Decoder {
+  class Stream {
+  public:
+    class State {
+      ::FLAC__StreamDecoderState mState;
+
+    public:
+      State(::FLAC__StreamDecoderState state) :
+        mState(state)
+      {}
+
+      operator ::FLAC__StreamDecoderState() const {
+        return mState;
+      }
+    };
+
+    struct Impl;
+
+  private:
+    std::unique_ptr<Impl> mImpl;
+
+  public:
+    Stream();
+    Stream(const Stream&) = delete;
+    virtual ~Stream();
+
+    Stream& operator=(const Stream&) = delete;
+
+    virtual bool is_valid() const;
+    virtual bool set_md5_checking(bool value);
+    virtual bool set_metadata_respond(::FLAC__MetadataType type);
+    virtual bool set_metadata_ignore(::FLAC__MetadataType type);
+
+    virtual State get_state() const;
+    virtual bool get_decode_position(FLAC__uint64* position) const;
+
+    virtual ::FLAC__StreamDecoderInitStatus init();
+    virtual bool finish();
+    virtual bool flush();
+    virtual bool reset();
+
+    virtual bool process_single();
+    virtual bool process_until_end_of_metadata();
+    virtual bool process_until_end_of_stream();
+    virtual bool seek_absolute(FLAC__uint64 sample);
+
+  protected:
+    virtual ::FLAC__StreamDecoderReadStatus read_callback(FLAC__byte buffer[], std::size_t* bytes) = 0;
+    virtual ::FLAC__StreamDecoderSeekStatus seek_callback(FLAC__uint64 absolute_byte_offset);
+    virtual ::FLAC__StreamDecoderTellStatus tell_callback(FLAC__uint64* absolute_byte_offset);
+    virtual ::FLAC__StreamDecoderLengthStatus length_callback(FLAC__uint64* stream_length);
+    virtual bool eof_callback();
+    virtual ::FLAC__StreamDecoderWriteStatus write_callback(const ::FLAC__Frame* frame, const FLAC__int32* const buffer[]) = 0;
+    virtual void metadata_callback(const ::FLAC__StreamMetadata* metadata);
+    virtual void error_callback(::FLAC__StreamDecoderErrorStatus status) = 0;
+
+    friend struct Impl;
+  };
+}
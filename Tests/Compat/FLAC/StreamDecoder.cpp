@@ -0,0 +1,1007 @@
+// decoder-only stand-in for libFLAC++ declared in Compat/FLAC/FLAC++/decoder.h
+// decodes every subframe type, stereo decorrelation and residual coding method of the FLAC format; not optimized
+
+#include <FLAC++/decoder.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <vector>
+
+
+
+namespace {
+  constexpr std::size_t ReadChunkSize = 8192;             // libFLAC reads in chunks of the capacity of its bit reader
+  constexpr std::size_t CompactThreshold = 64 * 1024;
+  constexpr std::uint64_t LinearSeekThreshold = 64 * 1024;
+  constexpr std::size_t MaxChannels = 8;
+
+
+  // thrown when the input ends or the read callback fails; the state is set before this is thrown
+  struct ReadFailure {};
+
+  // thrown when the data at a sync code is not a valid frame
+  struct InvalidFrame {
+    FLAC__StreamDecoderErrorStatus status;
+  };
+
+
+  std::uint8_t CalcCRC8(const std::uint8_t* data, std::size_t size) {
+    std::uint8_t crc = 0;
+    for (std::size_t i = 0; i < size; i++) {
+      crc ^= data[i];
+      for (int bit = 0; bit < 8; bit++) {
+        crc = static_cast<std::uint8_t>(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+      }
+    }
+    return crc;
+  }
+
+
+  std::uint16_t CalcCRC16(const std::uint8_t* data, std::size_t size) {
+    std::uint16_t crc = 0;
+    for (std::size_t i = 0; i < size; i++) {
+      crc ^= static_cast<std::uint16_t>(data[i] << 8);
+      for (int bit = 0; bit < 8; bit++) {
+        crc = static_cast<std::uint16_t>(crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1);
+      }
+    }
+    return crc;
+  }
+}
+
+
+
+struct FLAC::Decoder::Stream::Impl {
+  class BitReader {
+    Impl& mImpl;
+    std::size_t mIndex;
+    unsigned int mBit;
+
+    std::uint8_t CurrentByte() {
+      mImpl.Fill(mIndex + 1);
+      return mImpl.mData[mIndex];
+    }
+
+  public:
+    BitReader(Impl& impl, std::size_t index) :
+      mImpl(impl),
+      mIndex(index),
+      mBit(0)
+    {}
+
+    std::size_t GetIndex() const {
+      return mIndex;
+    }
+
+    std::uint32_t ReadBits(unsigned int numBits) {
+      std::uint64_t value = 0;
+      while (numBits) {
+        const unsigned int available = 8 - mBit;
+        const unsigned int take = std::min(available, numBits);
+        const unsigned int bits = (CurrentByte() >> (available - take)) & ((1u << take) - 1);
+        value = (value << take) | bits;
+        numBits -= take;
+        mBit += take;
+        if (mBit == 8) {
+          mBit = 0;
+          mIndex++;
+        }
+      }
+      return static_cast<std::uint32_t>(value);
+    }
+
+    std::uint64_t ReadBits64(unsigned int numBits) {
+      if (numBits <= 32) {
+        return ReadBits(numBits);
+      }
+      const std::uint64_t high = ReadBits(numBits - 32);
+      return (high << 32) | ReadBits(32);
+    }
+
+    std::int32_t ReadSigned(unsigned int numBits) {
+      if (!numBits) {
+        return 0;
+      }
+      const auto value = ReadBits(numBits);
+      if (numBits == 32) {
+        return static_cast<std::int32_t>(value);
+      }
+      const std::uint32_t signBit = 1u << (numBits - 1);
+      return static_cast<std::int32_t>((value ^ signBit) - signBit);
+    }
+
+    // counts zeros before the next one
+    std::uint32_t ReadUnary() {
+      std::uint32_t count = 0;
+      while (true) {
+        const std::uint8_t rest = static_cast<std::uint8_t>(CurrentByte() << mBit);
+        if (rest) {
+          unsigned int zeros = 0;
+          while (!(rest & (0x80 >> zeros))) {
+            zeros++;
+          }
+          count += zeros;
+          mBit += zeros + 1;
+          if (mBit == 8) {
+            mBit = 0;
+            mIndex++;
+          }
+          return count;
+        }
+        count += 8 - mBit;
+        mBit = 0;
+        mIndex++;
+      }
+    }
+
+    void AlignToByte() {
+      if (mBit) {
+        mBit = 0;
+        mIndex++;
+      }
+    }
+  };
+
+
+  struct FrameInfo {
+    FLAC__Frame frame;
+    std::uint64_t offset;     // stream offset of the sync code
+  };
+
+
+  Stream& mOwner;
+  FLAC__StreamDecoderState mState = FLAC__STREAM_DECODER_UNINITIALIZED;
+  bool mMetadataRespond[128] = {};
+  bool mSeeking = false;
+
+  // unconsumed input begins at mData[mConsumed]
+  std::vector<std::uint8_t> mData;
+  std::size_t mConsumed = 0;
+
+  bool mHasStreamInfo = false;
+  FLAC__StreamMetadata_StreamInfo mStreamInfo{};
+  std::optional<std::uint64_t> mFirstFrameOffset;
+  std::uint32_t mFixedBlockSize = 0;
+
+  std::array<std::vector<std::int32_t>, MaxChannels> mOutput;
+  std::vector<std::int32_t> mResidual;
+
+
+  Impl(Stream& owner) :
+    mOwner(owner)
+  {
+    mMetadataRespond[FLAC__METADATA_TYPE_STREAMINFO] = true;
+  }
+
+
+  // ensures that mData has at least size bytes; throws ReadFailure at the end of the input
+  void Fill(std::size_t size) {
+    while (mData.size() < size) {
+      if (mOwner.eof_callback()) {
+        mState = FLAC__STREAM_DECODER_END_OF_STREAM;
+        throw ReadFailure{};
+      }
+      const auto oldSize = mData.size();
+      mData.resize(oldSize + ReadChunkSize);
+      std::size_t bytes = ReadChunkSize;
+      const auto status = mOwner.read_callback(mData.data() + oldSize, &bytes);
+      mData.resize(oldSize + (status == FLAC__STREAM_DECODER_READ_STATUS_ABORT ? 0 : bytes));
+      if (status == FLAC__STREAM_DECODER_READ_STATUS_ABORT) {
+        mState = FLAC__STREAM_DECODER_ABORTED;
+        throw ReadFailure{};
+      }
+      if (!bytes && (status == FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM || mOwner.eof_callback())) {
+        mState = FLAC__STREAM_DECODER_END_OF_STREAM;
+        throw ReadFailure{};
+      }
+    }
+  }
+
+
+  void Compact() {
+    if (mConsumed < CompactThreshold) {
+      return;
+    }
+    mData.erase(mData.begin(), mData.begin() + static_cast<std::ptrdiff_t>(mConsumed));
+    mConsumed = 0;
+  }
+
+
+  void Clear() {
+    mData.clear();
+    mConsumed = 0;
+  }
+
+
+  void SendError(FLAC__StreamDecoderErrorStatus status) {
+    if (!mSeeking) {
+      mOwner.error_callback(status);
+    }
+  }
+
+
+  std::optional<std::uint64_t> GetPositionOf(std::size_t index) {
+    FLAC__uint64 position;
+    if (mOwner.tell_callback(&position) != FLAC__STREAM_DECODER_TELL_STATUS_OK) {
+      return std::nullopt;
+    }
+    return position - (mData.size() - index);
+  }
+
+
+  void ReadSignature() {
+    Fill(mConsumed + 4);
+    if (std::memcmp(mData.data() + mConsumed, "fLaC", 4) != 0) {
+      // no metadata; search for frames as libFLAC does
+      SendError(FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
+      mState = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+      return;
+    }
+    mConsumed += 4;
+    mState = FLAC__STREAM_DECODER_READ_METADATA;
+  }
+
+
+  void ReadMetadataBlock() {
+    Fill(mConsumed + 4);
+    const auto header = mData.data() + mConsumed;
+    const bool isLast = (header[0] & 0x80) != 0;
+    const unsigned int type = header[0] & 0x7F;
+    const std::uint32_t length = (header[1] << 16) | (header[2] << 8) | header[3];
+    Fill(mConsumed + 4 + length);
+    mConsumed += 4;
+
+    BitReader reader(*this, mConsumed);
+    FLAC__StreamMetadata metadata{};
+    metadata.type = static_cast<FLAC__MetadataType>(type);
+    metadata.is_last = isLast;
+    metadata.length = length;
+    std::vector<FLAC__StreamMetadata_SeekPoint> points;
+    if (type == FLAC__METADATA_TYPE_STREAMINFO && length >= 34) {
+      auto& streamInfo = metadata.data.stream_info;
+      streamInfo.min_blocksize = reader.ReadBits(16);
+      streamInfo.max_blocksize = reader.ReadBits(16);
+      streamInfo.min_framesize = reader.ReadBits(24);
+      streamInfo.max_framesize = reader.ReadBits(24);
+      streamInfo.sample_rate = reader.ReadBits(20);
+      streamInfo.channels = reader.ReadBits(3) + 1;
+      streamInfo.bits_per_sample = reader.ReadBits(5) + 1;
+      streamInfo.total_samples = reader.ReadBits64(36);
+      for (auto& byte : streamInfo.md5sum) {
+        byte = static_cast<FLAC__byte>(reader.ReadBits(8));
+      }
+      mHasStreamInfo = true;
+      mStreamInfo = streamInfo;
+    } else if (type == FLAC__METADATA_TYPE_SEEKTABLE) {
+      points.resize(length / 18);
+      for (auto& point : points) {
+        point.sample_number = reader.ReadBits64(64);
+        point.stream_offset = reader.ReadBits64(64);
+        point.frame_samples = reader.ReadBits(16);
+      }
+      metadata.data.seek_table.num_points = static_cast<std::uint32_t>(points.size());
+      metadata.data.seek_table.points = points.data();
+    }
+    mConsumed += length;
+
+    if (type < std::size(mMetadataRespond) && mMetadataRespond[type]) {
+      mOwner.metadata_callback(&metadata);
+    }
+
+    if (isLast) {
+      mState = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+      mFirstFrameOffset = GetPositionOf(mConsumed);
+    }
+  }
+
+
+  // moves mConsumed to the next sync code; throws ReadFailure at the end of the input
+  void FindSync() {
+    bool lostSync = false;
+    while (true) {
+      Fill(mConsumed + 2);
+      if (mData[mConsumed] == 0xFF && (mData[mConsumed + 1] & 0xFE) == 0xF8) {
+        return;
+      }
+      if (!lostSync) {
+        lostSync = true;
+        SendError(FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC);
+      }
+      mConsumed++;
+      Compact();
+    }
+  }
+
+
+  void DecodeResidual(BitReader& reader, std::uint32_t blockSize, unsigned int order, std::int32_t* residual) {
+    const unsigned int method = reader.ReadBits(2);
+    if (method > 1) {
+      throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM};
+    }
+    const unsigned int parameterBits = method == 0 ? 4 : 5;
+    const unsigned int escapeParameter = (1u << parameterBits) - 1;
+    const unsigned int partitionOrder = reader.ReadBits(4);
+    const std::uint32_t numPartitions = 1u << partitionOrder;
+    if ((blockSize >> partitionOrder) < order || (blockSize & (numPartitions - 1))) {
+      throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM};
+    }
+
+    std::size_t index = 0;
+    for (std::uint32_t partition = 0; partition < numPartitions; partition++) {
+      const std::uint32_t numSamples = (blockSize >> partitionOrder) - (partition == 0 ? order : 0);
+      const unsigned int parameter = reader.ReadBits(parameterBits);
+      if (parameter == escapeParameter) {
+        const unsigned int rawBits = reader.ReadBits(5);
+        for (std::uint32_t i = 0; i < numSamples; i++) {
+          residual[index++] = reader.ReadSigned(rawBits);
+        }
+        continue;
+      }
+      for (std::uint32_t i = 0; i < numSamples; i++) {
+        const std::uint32_t quotient = reader.ReadUnary();
+        const std::uint32_t folded = (quotient << parameter) | reader.ReadBits(parameter);
+        residual[index++] = static_cast<std::int32_t>(folded >> 1) ^ -static_cast<std::int32_t>(folded & 1);
+      }
+    }
+  }
+
+
+  void DecodeSubframe(BitReader& reader, std::uint32_t blockSize, unsigned int bitsPerSample, std::int32_t* output) {
+    if (reader.ReadBits(1)) {
+      throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC};
+    }
+    const unsigned int type = reader.ReadBits(6);
+    unsigned int wastedBits = 0;
+    if (reader.ReadBits(1)) {
+      wastedBits = reader.ReadUnary() + 1;
+      if (wastedBits >= bitsPerSample) {
+        throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM};
+      }
+      bitsPerSample -= wastedBits;
+    }
+
+    if (type == 0) {
+      // CONSTANT
+      std::fill_n(output, blockSize, reader.ReadSigned(bitsPerSample));
+    } else if (type == 1) {
+      // VERBATIM
+      for (std::uint32_t i = 0; i < blockSize; i++) {
+        output[i] = reader.ReadSigned(bitsPerSample);
+      }
+    } else if ((type & 0x38) == 0x08 && (type & 0x07) <= 4) {
+      // FIXED
+      const unsigned int order = type & 0x07;
+      if (order > blockSize) {
+        throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM};
+      }
+      for (unsigned int i = 0; i < order; i++) {
+        output[i] = reader.ReadSigned(bitsPerSample);
+      }
+      mResidual.resize(blockSize);
+      DecodeResidual(reader, blockSize, order, mResidual.data());
+      for (std::uint32_t i = order; i < blockSize; i++) {
+        const auto residual = static_cast<std::int64_t>(mResidual[i - order]);
+        std::int64_t prediction = 0;
+        switch (order) {
+          case 1:
+            prediction = output[i - 1];
+            break;
+
+          case 2:
+            prediction = 2 * static_cast<std::int64_t>(output[i - 1]) - output[i - 2];
+            break;
+
+          case 3:
+            prediction = 3 * static_cast<std::int64_t>(output[i - 1]) - 3 * static_cast<std::int64_t>(output[i - 2]) + output[i - 3];
+            break;
+
+          case 4:
+            prediction = 4 * static_cast<std::int64_t>(output[i - 1]) - 6 * static_cast<std::int64_t>(output[i - 2]) + 4 * static_cast<std::int64_t>(output[i - 3]) - output[i - 4];
+            break;
+        }
+        output[i] = static_cast<std::int32_t>(prediction + residual);
+      }
+    } else if (type & 0x20) {
+      // LPC
+      const unsigned int order = (type & 0x1F) + 1;
+      if (order > blockSize) {
+        throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM};
+      }
+      for (unsigned int i = 0; i < order; i++) {
+        output[i] = reader.ReadSigned(bitsPerSample);
+      }
+      const unsigned int precision = reader.ReadBits(4) + 1;
+      if (precision == 16) {
+        throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM};
+      }
+      const int shift = reader.ReadSigned(5);
+      if (shift < 0) {
+        throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM};
+      }
+      std::int32_t coefficients[32];
+      for (unsigned int i = 0; i < order; i++) {
+        coefficients[i] = reader.ReadSigned(precision);
+      }
+      mResidual.resize(blockSize);
+      DecodeResidual(reader, blockSize, order, mResidual.data());
+      for (std::uint32_t i = order; i < blockSize; i++) {
+        std::int64_t sum = 0;
+        for (unsigned int j = 0; j < order; j++) {
+          sum += static_cast<std::int64_t>(coefficients[j]) * output[i - j - 1];
+        }
+        output[i] = static_cast<std::int32_t>(mResidual[i - order] + (sum >> shift));
+      }
+    } else {
+      throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM};
+    }
+
+    if (wastedBits) {
+      for (std::uint32_t i = 0; i < blockSize; i++) {
+        output[i] = static_cast<std::int32_t>(static_cast<std::uint32_t>(output[i]) << wastedBits);
+      }
+    }
+  }
+
+
+  // decodes the frame at mConsumed, which must begin with a sync code; mConsumed is moved to the end of the frame
+  // returns false if the frame CRC does not match, in which case the output is filled with silence
+  bool DecodeFrame(FLAC__Frame& frame) {
+    const auto frameIndex = mConsumed;
+    BitReader reader(*this, frameIndex);
+
+    // header
+    reader.ReadBits(15);
+    const bool variableBlockSize = reader.ReadBits(1) != 0;
+    const unsigned int blockSizeCode = reader.ReadBits(4);
+    const unsigned int sampleRateCode = reader.ReadBits(4);
+    const unsigned int channelAssignment = reader.ReadBits(4);
+    const unsigned int sampleSizeCode = reader.ReadBits(3);
+    const unsigned int reserved = reader.ReadBits(1);
+    if (blockSizeCode == 0 || sampleRateCode == 15 || channelAssignment > 10 || sampleSizeCode == 3 || sampleSizeCode == 7 || reserved) {
+      throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC};
+    }
+
+    // UTF-8 like coded number
+    std::uint64_t number = reader.ReadBits(8);
+    unsigned int numLeadingOnes = 0;
+    while (numLeadingOnes < 8 && ((number << numLeadingOnes) & 0x80)) {
+      numLeadingOnes++;
+    }
+    if (numLeadingOnes == 1 || numLeadingOnes == 8 || (!variableBlockSize && numLeadingOnes > 6)) {
+      throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC};
+    }
+    number &= 0x7F >> numLeadingOnes;
+    for (unsigned int i = 1; i < numLeadingOnes; i++) {
+      const auto byte = reader.ReadBits(8);
+      if ((byte & 0xC0) != 0x80) {
+        throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC};
+      }
+      number = (number << 6) | (byte & 0x3F);
+    }
+
+    std::uint32_t blockSize;
+    switch (blockSizeCode) {
+      case 1:
+        blockSize = 192;
+        break;
+
+      case 2:
+      case 3:
+      case 4:
+      case 5:
+        blockSize = 576u << (blockSizeCode - 2);
+        break;
+
+      case 6:
+        blockSize = reader.ReadBits(8) + 1;
+        break;
+
+      case 7:
+        blockSize = reader.ReadBits(16) + 1;
+        break;
+
+      default:
+        blockSize = 256u << (blockSizeCode - 8);
+        break;
+    }
+
+    static constexpr std::uint32_t SampleRates[] = {0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000};
+    std::uint32_t sampleRate;
+    if (sampleRateCode == 0) {
+      if (!mHasStreamInfo) {
+        throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM};
+      }
+      sampleRate = mStreamInfo.sample_rate;
+    } else if (sampleRateCode == 12) {
+      sampleRate = reader.ReadBits(8) * 1000;
+    } else if (sampleRateCode == 13) {
+      sampleRate = reader.ReadBits(16);
+    } else if (sampleRateCode == 14) {
+      sampleRate = reader.ReadBits(16) * 10;
+    } else {
+      sampleRate = SampleRates[sampleRateCode];
+    }
+
+    static constexpr unsigned int SampleSizes[] = {0, 8, 12, 0, 16, 20, 24};
+    unsigned int bitsPerSample;
+    if (sampleSizeCode == 0) {
+      if (!mHasStreamInfo) {
+        throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM};
+      }
+      bitsPerSample = mStreamInfo.bits_per_sample;
+    } else {
+      bitsPerSample = SampleSizes[sampleSizeCode];
+    }
+
+    const auto headerSize = reader.GetIndex() - frameIndex;
+    const auto crc8 = reader.ReadBits(8);
+    if (CalcCRC8(mData.data() + frameIndex, headerSize) != crc8) {
+      throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC};
+    }
+
+    const unsigned int numChannels = channelAssignment < 8 ? channelAssignment + 1 : 2;
+    if (bitsPerSample > 24 || (mHasStreamInfo && blockSize > mStreamInfo.max_blocksize && mStreamInfo.max_blocksize >= 16)) {
+      throw InvalidFrame{FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM};
+    }
+
+    // subframes
+    for (unsigned int channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+      const bool side = (channelAssignment == FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE + 7 && channelIndex == 1) || (channelAssignment == FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE + 7 && channelIndex == 0) || (channelAssignment == FLAC__CHANNEL_ASSIGNMENT_MID_SIDE + 7 && channelIndex == 1);
+      mOutput[channelIndex].resize(blockSize);
+      DecodeSubframe(reader, blockSize, bitsPerSample + (side ? 1 : 0), mOutput[channelIndex].data());
+    }
+    reader.AlignToByte();
+
+    const auto frameSize = reader.GetIndex() - frameIndex;
+    const auto crc16 = reader.ReadBits(16);
+    const bool crcMatched = CalcCRC16(mData.data() + frameIndex, frameSize) == crc16;
+    mConsumed = reader.GetIndex();
+
+    // decorrelation
+    if (channelAssignment >= 8) {
+      auto& channel0 = mOutput[0];
+      auto& channel1 = mOutput[1];
+      for (std::uint32_t i = 0; i < blockSize; i++) {
+        switch (channelAssignment - 7) {
+          case FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE:
+            channel1[i] = channel0[i] - channel1[i];
+            break;
+
+          case FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE:
+            channel0[i] += channel1[i];
+            break;
+
+          case FLAC__CHANNEL_ASSIGNMENT_MID_SIDE: {
+            const std::int64_t mid = (static_cast<std::int64_t>(channel0[i]) * 2) | (channel1[i] & 1);
+            const std::int64_t side = channel1[i];
+            channel0[i] = static_cast<std::int32_t>((mid + side) >> 1);
+            channel1[i] = static_cast<std::int32_t>((mid - side) >> 1);
+            break;
+          }
+        }
+      }
+    }
+
+    if (!crcMatched) {
+      for (unsigned int channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+        std::fill(mOutput[channelIndex].begin(), mOutput[channelIndex].end(), 0);
+      }
+    }
+
+    frame.header.blocksize = blockSize;
+    frame.header.sample_rate = sampleRate;
+    frame.header.channels = numChannels;
+    frame.header.channel_assignment = channelAssignment < 8 ? FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT : static_cast<FLAC__ChannelAssignment>(channelAssignment - 7);
+    frame.header.bits_per_sample = bitsPerSample;
+    frame.header.crc = static_cast<FLAC__byte>(crc8);
+    frame.footer.crc = static_cast<std::uint16_t>(crc16);
+
+    // frame numbers are converted to sample numbers as libFLAC does
+    frame.header.number_type = FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER;
+    if (variableBlockSize) {
+      frame.header.number.sample_number = number;
+    } else if (mHasStreamInfo && mStreamInfo.min_blocksize == mStreamInfo.max_blocksize) {
+      frame.header.number.sample_number = number * mStreamInfo.min_blocksize;
+    } else if (mFixedBlockSize) {
+      frame.header.number.sample_number = number * mFixedBlockSize;
+    } else {
+      if (number == 0) {
+        mFixedBlockSize = blockSize;
+      }
+      frame.header.number.sample_number = number * blockSize;
+    }
+
+    return crcMatched;
+  }
+
+
+  // reads the next valid frame into frame and mOutput; invalid data is skipped with errors reported
+  // returns false at the end of the input or on a read error, with the state set; throws ReadFailure if the input ends inside a frame
+  bool ReadNextFrame(FrameInfo& frameInfo, bool& crcMatched) {
+    while (true) {
+      Compact();
+      try {
+        FindSync();
+      } catch (const ReadFailure&) {
+        return false;
+      }
+      const auto frameIndex = mConsumed;
+      try {
+        crcMatched = DecodeFrame(frameInfo.frame);
+      } catch (const InvalidFrame& invalidFrame) {
+        SendError(invalidFrame.status);
+        mConsumed = frameIndex + 1;
+        continue;
+      }
+      if (!crcMatched && mSeeking) {
+        mConsumed = frameIndex + 1;
+        continue;
+      }
+      frameInfo.offset = GetPositionOf(frameIndex).value_or(0);
+      return true;
+    }
+  }
+
+
+  // passes the current frame to the client, skipping the first skip samples
+  bool WriteFrame(const FLAC__Frame& frame, std::uint32_t skip) {
+    FLAC__Frame trimmedFrame = frame;
+    trimmedFrame.header.blocksize -= skip;
+    trimmedFrame.header.number.sample_number += skip;
+    const FLAC__int32* buffer[MaxChannels];
+    for (unsigned int channelIndex = 0; channelIndex < frame.header.channels; channelIndex++) {
+      buffer[channelIndex] = mOutput[channelIndex].data() + skip;
+    }
+    if (mOwner.write_callback(&trimmedFrame, buffer) != FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE) {
+      mState = FLAC__STREAM_DECODER_ABORTED;
+      return false;
+    }
+    return true;
+  }
+
+
+  bool ProcessSingle() {
+    while (true) {
+      try {
+        switch (mState) {
+          case FLAC__STREAM_DECODER_SEARCH_FOR_METADATA:
+            ReadSignature();
+            break;
+
+          case FLAC__STREAM_DECODER_READ_METADATA:
+            ReadMetadataBlock();
+            return true;
+
+          case FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC:
+          case FLAC__STREAM_DECODER_READ_FRAME: {
+            mState = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+            FrameInfo frameInfo{};
+            bool crcMatched = false;
+            if (!ReadNextFrame(frameInfo, crcMatched)) {
+              return true;
+            }
+            if (!crcMatched) {
+              SendError(FLAC__STREAM_DECODER_ERROR_STATUS_FRAME_CRC_MISMATCH);
+            }
+            return WriteFrame(frameInfo.frame, 0);
+          }
+
+          case FLAC__STREAM_DECODER_END_OF_STREAM:
+          case FLAC__STREAM_DECODER_ABORTED:
+            return true;
+
+          default:
+            return false;
+        }
+      } catch (const ReadFailure&) {
+        return false;
+      }
+    }
+  }
+
+
+  bool ProcessUntilEndOfMetadata() {
+    while (true) {
+      switch (mState) {
+        case FLAC__STREAM_DECODER_SEARCH_FOR_METADATA:
+        case FLAC__STREAM_DECODER_READ_METADATA:
+          if (!ProcessSingle()) {
+            return false;
+          }
+          break;
+
+        case FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC:
+        case FLAC__STREAM_DECODER_READ_FRAME:
+        case FLAC__STREAM_DECODER_END_OF_STREAM:
+        case FLAC__STREAM_DECODER_ABORTED:
+          return true;
+
+        default:
+          return false;
+      }
+    }
+  }
+
+
+  bool SeekTo(std::uint64_t position) {
+    Clear();
+    if (mOwner.seek_callback(position) != FLAC__STREAM_DECODER_SEEK_STATUS_OK) {
+      return false;
+    }
+    mState = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+    return true;
+  }
+
+
+  // bisects byte offsets with the sample numbers of the frames found, then decodes forward; the seek table is not trusted
+  bool SeekToSample(std::uint64_t length, std::uint64_t target) {
+    std::uint64_t lowerOffset = *mFirstFrameOffset;
+    std::uint64_t lowerSample = 0;
+    std::uint64_t upperOffset = length;
+    std::uint64_t upperSample = mStreamInfo.total_samples;
+
+    FrameInfo frameInfo{};
+    bool crcMatched = false;
+    bool bisect = false;
+    while (upperSample && upperOffset - lowerOffset > LinearSeekThreshold && upperSample > lowerSample) {
+      // aim a bit before the target so that the frame containing it is likely to be found next; halve the range after a miss
+      const auto estimate = lowerOffset + static_cast<std::uint64_t>(static_cast<double>(target - lowerSample) / static_cast<double>(upperSample - lowerSample) * static_cast<double>(upperOffset - lowerOffset));
+      const auto position = bisect ? lowerOffset + (upperOffset - lowerOffset) / 2 : std::clamp<std::uint64_t>(estimate > lowerOffset + mStreamInfo.max_framesize ? estimate - mStreamInfo.max_framesize : lowerOffset, lowerOffset, upperOffset - 1);
+      if (!SeekTo(position)) {
+        return false;
+      }
+      bool found;
+      try {
+        found = ReadNextFrame(frameInfo, crcMatched) && frameInfo.offset < upperOffset;
+      } catch (const ReadFailure&) {
+        found = false;
+      }
+      if (mState == FLAC__STREAM_DECODER_ABORTED) {
+        return false;
+      }
+      bisect = !found;
+      if (!found) {
+        upperOffset = position;
+        continue;
+      }
+      const auto& header = frameInfo.frame.header;
+      if (header.number.sample_number > target) {
+        upperOffset = position;
+        upperSample = header.number.sample_number;
+        continue;
+      }
+      if (header.number.sample_number + header.blocksize <= target) {
+        lowerOffset = *GetPositionOf(mConsumed);
+        lowerSample = header.number.sample_number + header.blocksize;
+        continue;
+      }
+      mState = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+      return WriteFrame(frameInfo.frame, static_cast<std::uint32_t>(target - header.number.sample_number));
+    }
+
+    if (!SeekTo(lowerOffset)) {
+      return false;
+    }
+    while (true) {
+      try {
+        if (!ReadNextFrame(frameInfo, crcMatched)) {
+          return false;
+        }
+      } catch (const ReadFailure&) {
+        return false;
+      }
+      const auto& header = frameInfo.frame.header;
+      if (header.number.sample_number > target) {
+        return false;
+      }
+      if (target < header.number.sample_number + header.blocksize) {
+        mState = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+        return WriteFrame(frameInfo.frame, static_cast<std::uint32_t>(target - header.number.sample_number));
+      }
+    }
+  }
+
+
+  bool SeekAbsolute(std::uint64_t sample) {
+    switch (mState) {
+      case FLAC__STREAM_DECODER_SEARCH_FOR_METADATA:
+      case FLAC__STREAM_DECODER_READ_METADATA:
+        if (!ProcessUntilEndOfMetadata()) {
+          return false;
+        }
+        break;
+
+      case FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC:
+      case FLAC__STREAM_DECODER_READ_FRAME:
+      case FLAC__STREAM_DECODER_END_OF_STREAM:
+        break;
+
+      default:
+        return false;
+    }
+
+    FLAC__uint64 length;
+    if (!mFirstFrameOffset || mOwner.length_callback(&length) != FLAC__STREAM_DECODER_LENGTH_STATUS_OK) {
+      return false;
+    }
+    if (mHasStreamInfo && mStreamInfo.total_samples && sample >= mStreamInfo.total_samples) {
+      return false;
+    }
+
+    mSeeking = true;
+    bool succeeded;
+    try {
+      succeeded = SeekToSample(length, sample);
+    } catch (...) {
+      mSeeking = false;
+      throw;
+    }
+    mSeeking = false;
+
+    if (!succeeded && mState != FLAC__STREAM_DECODER_ABORTED) {
+      mState = FLAC__STREAM_DECODER_SEEK_ERROR;
+    }
+    return succeeded;
+  }
+};
+
+
+
+namespace FLAC::Decoder {
+  Stream::Stream() :
+    mImpl(std::make_unique<Impl>(*this))
+  {}
+
+
+  Stream::~Stream() = default;
+
+
+  bool Stream::is_valid() const {
+    return true;
+  }
+
+
+  bool Stream::set_md5_checking(bool value) {
+    static_cast<void>(value);
+    return mImpl->mState == FLAC__STREAM_DECODER_UNINITIALIZED;
+  }
+
+
+  bool Stream::set_metadata_respond(::FLAC__MetadataType type) {
+    if (mImpl->mState != FLAC__STREAM_DECODER_UNINITIALIZED) {
+      return false;
+    }
+    mImpl->mMetadataRespond[type] = true;
+    return true;
+  }
+
+
+  bool Stream::set_metadata_ignore(::FLAC__MetadataType type) {
+    if (mImpl->mState != FLAC__STREAM_DECODER_UNINITIALIZED) {
+      return false;
+    }
+    mImpl->mMetadataRespond[type] = false;
+    return true;
+  }
+
+
+  Stream::State Stream::get_state() const {
+    return State(mImpl->mState);
+  }
+
+
+  bool Stream::get_decode_position(FLAC__uint64* position) const {
+    const auto result = mImpl->GetPositionOf(mImpl->mConsumed);
+    if (!result) {
+      return false;
+    }
+    *position = *result;
+    return true;
+  }
+
+
+  ::FLAC__StreamDecoderInitStatus Stream::init() {
+    if (mImpl->mState != FLAC__STREAM_DECODER_UNINITIALIZED) {
+      return FLAC__STREAM_DECODER_INIT_STATUS_ALREADY_INITIALIZED;
+    }
+    mImpl->mState = FLAC__STREAM_DECODER_SEARCH_FOR_METADATA;
+    return FLAC__STREAM_DECODER_INIT_STATUS_OK;
+  }
+
+
+  bool Stream::finish() {
+    mImpl->Clear();
+    mImpl->mState = FLAC__STREAM_DECODER_UNINITIALIZED;
+    return true;
+  }
+
+
+  bool Stream::flush() {
+    if (mImpl->mState == FLAC__STREAM_DECODER_UNINITIALIZED) {
+      return false;
+    }
+    mImpl->Clear();
+    mImpl->mState = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+    return true;
+  }
+
+
+  bool Stream::reset() {
+    if (!flush()) {
+      return false;
+    }
+    if (seek_callback(0) == FLAC__STREAM_DECODER_SEEK_STATUS_ERROR) {
+      return false;
+    }
+    mImpl->mState = FLAC__STREAM_DECODER_SEARCH_FOR_METADATA;
+    mImpl->mHasStreamInfo = false;
+    mImpl->mFirstFrameOffset.reset();
+    mImpl->mFixedBlockSize = 0;
+    return true;
+  }
+
+
+  bool Stream::process_single() {
+    return mImpl->ProcessSingle();
+  }
+
+
+  bool Stream::process_until_end_of_metadata() {
+    return mImpl->ProcessUntilEndOfMetadata();
+  }
+
+
+  bool Stream::process_until_end_of_stream() {
+    while (true) {
+      switch (mImpl->mState) {
+        case FLAC__STREAM_DECODER_END_OF_STREAM:
+        case FLAC__STREAM_DECODER_ABORTED:
+          return true;
+
+        default:
+          if (!mImpl->ProcessSingle()) {
+            return false;
+          }
+          break;
+      }
+    }
+  }
+
+
+  bool Stream::seek_absolute(FLAC__uint64 sample) {
+    return mImpl->SeekAbsolute(sample);
+  }
+
+
+  ::FLAC__StreamDecoderSeekStatus Stream::seek_callback(FLAC__uint64 absolute_byte_offset) {
+    static_cast<void>(absolute_byte_offset);
+    return FLAC__STREAM_DECODER_SEEK_STATUS_UNSUPPORTED;
+  }
+
+
+  ::FLAC__StreamDecoderTellStatus Stream::tell_callback(FLAC__uint64* absolute_byte_offset) {
+    static_cast<void>(absolute_byte_offset);
+    return FLAC__STREAM_DECODER_TELL_STATUS_UNSUPPORTED;
+  }
+
+
+  ::FLAC__StreamDecoderLengthStatus Stream::length_callback(FLAC__uint64* stream_length) {
+    static_cast<void>(stream_length);
+    return FLAC__STREAM_DECODER_LENGTH_STATUS_UNSUPPORTED;
+  }
+
+
+  bool Stream::eof_callback() {
+    return false;
+  }
+
+
+  void Stream::metadata_callback(const ::FLAC__StreamMetadata* metadata) {
+    static_cast<void>(metadata);
+  }
+}
@@ -0,0 +1,656 @@
+// in-memory implementation of the file API declared in Compat/Windows.h
+// sharing rules are simplified: a file cannot be deleted or replaced while a handle or a mapped view refers to it, as with the default sharing mode on Windows
+
+#include "CompatFileSystem.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <Windows.h>
+
+
+
+namespace compat::fs {
+  struct Buffer {
+    std::unique_ptr<std::byte[]> data;
+    std::size_t capacity;
+    std::size_t used;     // bytes ever written; appending in place is allowed only at this position
+  };
+}
+
+
+
+namespace {
+  using namespace compat::fs;
+
+  struct File {
+    FileVersion content;
+    bool dirty = false;
+    std::size_t openCount = 0;    // handles and mapped views
+  };
+
+
+  struct Object {
+    virtual ~Object() = default;
+  };
+
+
+  struct FileHandle : Object {
+    std::wstring path;
+    bool writable;
+    bool deleteOnClose;
+    std::uint64_t position = 0;
+  };
+
+
+  struct MappingHandle : Object {
+    std::wstring path;
+    FileVersion content;
+  };
+
+
+  struct View {
+    std::wstring path;
+    FileVersion content;
+  };
+
+
+  std::mutex gMutex;
+  std::map<std::wstring, File, std::less<>> gFiles;
+  std::unordered_set<Object*> gObjects;
+  std::unordered_multimap<const void*, View> gViews;
+  std::array<std::size_t, 5> gOperationCounts{};
+  UINT gTempFileCount = 0;
+  std::function<void(Operation, std::wstring_view)> gMutationHook;
+  std::function<DWORD(Operation, std::wstring_view)> gFaultHook;
+
+
+  // returns false (with the last error set) if the fault hook decided to fail the operation
+  bool Enter(Operation operation, std::wstring_view path) {
+    std::function<DWORD(Operation, std::wstring_view)> hook;
+    {
+      std::lock_guard lock(gMutex);
+      gOperationCounts[static_cast<std::size_t>(operation)]++;
+      hook = gFaultHook;
+    }
+    if (hook) {
+      if (const auto error = hook(operation, path); error != ERROR_SUCCESS) {
+        SetLastError(error);
+        return false;
+      }
+    }
+    return true;
+  }
+
+
+  void NotifyMutation(Operation operation, std::wstring_view path) {
+    std::function<void(Operation, std::wstring_view)> hook;
+    {
+      std::lock_guard lock(gMutex);
+      hook = gMutationHook;
+    }
+    if (hook) {
+      hook(operation, path);
+    }
+  }
+
+
+  BOOL Fail(DWORD error) {
+    SetLastError(error);
+    return FALSE;
+  }
+
+
+  template<typename T>
+  T* GetObject(HANDLE handle) {
+    const auto object = static_cast<Object*>(handle);
+    if (!gObjects.count(object)) {
+      return nullptr;
+    }
+    return dynamic_cast<T*>(object);
+  }
+
+
+  std::uint64_t GetOverlappedOffset(const OVERLAPPED& overlapped) {
+    return (static_cast<std::uint64_t>(overlapped.OffsetHigh) << 32) | overlapped.Offset;
+  }
+
+
+  // writes data at position, copying the buffer unless the write only appends to bytes nobody else can see
+  void WriteAt(FileVersion& content, std::uint64_t position, const std::byte* data, std::size_t size) {
+    const auto end = std::max<std::size_t>(content.size, static_cast<std::size_t>(position) + size);
+    auto& buffer = content.buffer;
+
+    const bool inPlace =
+      buffer &&
+      (buffer.use_count() == 1 || (position >= content.size && buffer->used == content.size)) &&
+      end <= buffer->capacity;
+    if (!inPlace) {
+      const auto capacity = std::max<std::size_t>({end, buffer ? buffer->capacity * 2 : 0, 4096});
+      auto newBuffer = std::make_shared<Buffer>(Buffer{std::make_unique<std::byte[]>(capacity), capacity, content.size});
+      if (content.size != 0) {
+        std::memcpy(newBuffer->data.get(), buffer->data.get(), content.size);
+      }
+      buffer = std::move(newBuffer);
+    }
+
+    if (position > content.size) {
+      std::memset(buffer->data.get() + content.size, 0, static_cast<std::size_t>(position) - content.size);
+    }
+    std::memcpy(buffer->data.get() + position, data, size);
+    buffer->used = std::max(buffer->used, end);
+    content.size = end;
+  }
+}
+
+
+
+namespace compat::fs {
+  void Reset() {
+    std::lock_guard lock(gMutex);
+    gFiles.clear();
+    gOperationCounts = {};
+  }
+
+
+  Image CaptureImage() {
+    std::lock_guard lock(gMutex);
+    Image image;
+    for (const auto& [path, file] : gFiles) {
+      image.emplace(path, file.content);
+    }
+    return image;
+  }
+
+
+  void RestoreImage(const Image& image) {
+    std::lock_guard lock(gMutex);
+    gFiles.clear();
+    for (const auto& [path, content] : image) {
+      gFiles.emplace(path, File{content, false, 0});
+    }
+  }
+
+
+  std::vector<std::byte> ReadImageFile(const Image& image, std::wstring_view path) {
+    const auto itr = image.find(path);
+    if (itr == image.end() || itr->second.size == 0) {
+      return {};
+    }
+    const auto data = itr->second.buffer->data.get();
+    return std::vector<std::byte>(data, data + itr->second.size);
+  }
+
+
+  bool Exists(std::wstring_view path) {
+    std::lock_guard lock(gMutex);
+    return gFiles.find(path) != gFiles.end();
+  }
+
+
+  std::vector<std::byte> ReadAllBytes(std::wstring_view path) {
+    return ReadImageFile(CaptureImage(), path);
+  }
+
+
+  bool IsDirty(std::wstring_view path) {
+    std::lock_guard lock(gMutex);
+    const auto itr = gFiles.find(path);
+    return itr != gFiles.end() && itr->second.dirty;
+  }
+
+
+  std::size_t GetOperationCount(Operation operation) {
+    std::lock_guard lock(gMutex);
+    return gOperationCounts[static_cast<std::size_t>(operation)];
+  }
+
+
+  void SetMutationHook(std::function<void(Operation operation, std::wstring_view path)> hook) {
+    std::lock_guard lock(gMutex);
+    gMutationHook = std::move(hook);
+  }
+
+
+  void SetFaultHook(std::function<DWORD(Operation operation, std::wstring_view path)> hook) {
+    std::lock_guard lock(gMutex);
+    gFaultHook = std::move(hook);
+  }
+}
+
+
+
+HANDLE CreateFileW(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD, LPSECURITY_ATTRIBUTES, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE) {
+  const std::wstring path(lpFileName);
+  if (!Enter(Operation::Create, path)) {
+    return INVALID_HANDLE_VALUE;
+  }
+
+  bool mutated = false;
+  HANDLE handle = INVALID_HANDLE_VALUE;
+  {
+    std::lock_guard lock(gMutex);
+
+    auto itr = gFiles.find(path);
+    const bool exists = itr != gFiles.end();
+    switch (dwCreationDisposition) {
+      case CREATE_NEW:
+        if (exists) {
+          SetLastError(ERROR_FILE_EXISTS);
+          return INVALID_HANDLE_VALUE;
+        }
+        break;
+
+      case OPEN_EXISTING:
+      case TRUNCATE_EXISTING:
+        if (!exists) {
+          SetLastError(ERROR_FILE_NOT_FOUND);
+          return INVALID_HANDLE_VALUE;
+        }
+        break;
+
+      case CREATE_ALWAYS:
+      case OPEN_ALWAYS:
+        break;
+
+      default:
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    if (!exists) {
+      itr = gFiles.emplace(path, File{}).first;
+      mutated = true;
+    } else if (dwCreationDisposition == CREATE_ALWAYS || dwCreationDisposition == TRUNCATE_EXISTING) {
+      if (itr->second.openCount != 0) {
+        SetLastError(ERROR_SHARING_VIOLATION);
+        return INVALID_HANDLE_VALUE;
+      }
+      itr->second.content = FileVersion{};
+      itr->second.dirty = true;
+      mutated = true;
+    }
+
+    itr->second.openCount++;
+
+    const auto fileHandle = new FileHandle();
+    fileHandle->path = path;
+    fileHandle->writable = (dwDesiredAccess & GENERIC_WRITE) != 0;
+    fileHandle->deleteOnClose = (dwFlagsAndAttributes & FILE_FLAG_DELETE_ON_CLOSE) != 0;
+    gObjects.insert(fileHandle);
+    handle = fileHandle;
+
+    // as CreateFileW does, report whether an existing file was opened
+    SetLastError((exists && (dwCreationDisposition == CREATE_ALWAYS || dwCreationDisposition == OPEN_ALWAYS)) ? ERROR_ALREADY_EXISTS : ERROR_SUCCESS);
+  }
+
+  if (mutated) {
+    const auto error = GetLastError();
+    NotifyMutation(Operation::Create, path);
+    SetLastError(error);
+  }
+  return handle;
+}
+
+
+BOOL ReadFile(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped) {
+  std::lock_guard lock(gMutex);
+
+  const auto fileHandle = GetObject<FileHandle>(hFile);
+  if (!fileHandle) {
+    return Fail(ERROR_INVALID_HANDLE);
+  }
+  if (lpOverlapped) {
+    fileHandle->position = GetOverlappedOffset(*lpOverlapped);
+  }
+  const auto& content = gFiles.at(fileHandle->path).content;
+
+  std::size_t read = 0;
+  if (fileHandle->position < content.size) {
+    read = std::min<std::size_t>(nNumberOfBytesToRead, content.size - static_cast<std::size_t>(fileHandle->position));
+    std::memcpy(lpBuffer, content.buffer->data.get() + fileHandle->position, read);
+  }
+  fileHandle->position += read;
+  if (lpNumberOfBytesRead) {
+    *lpNumberOfBytesRead = static_cast<DWORD>(read);
+  }
+  return TRUE;
+}
+
+
+BOOL WriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten, LPOVERLAPPED lpOverlapped) {
+  std::wstring path;
+  {
+    std::lock_guard lock(gMutex);
+    const auto fileHandle = GetObject<FileHandle>(hFile);
+    if (!fileHandle) {
+      return Fail(ERROR_INVALID_HANDLE);
+    }
+    path = fileHandle->path;
+  }
+
+  if (lpNumberOfBytesWritten) {
+    *lpNumberOfBytesWritten = 0;
+  }
+  if (!Enter(Operation::Write, path)) {
+    return FALSE;
+  }
+
+  {
+    std::lock_guard lock(gMutex);
+    const auto fileHandle = GetObject<FileHandle>(hFile);
+    if (!fileHandle) {
+      return Fail(ERROR_INVALID_HANDLE);
+    }
+    if (!fileHandle->writable) {
+      return Fail(ERROR_ACCESS_DENIED);
+    }
+    if (lpOverlapped) {
+      fileHandle->position = GetOverlappedOffset(*lpOverlapped);
+    }
+    auto& file = gFiles.at(fileHandle->path);
+    WriteAt(file.content, fileHandle->position, static_cast<const std::byte*>(lpBuffer), nNumberOfBytesToWrite);
+    file.dirty = true;
+    fileHandle->position += nNumberOfBytesToWrite;
+    if (lpNumberOfBytesWritten) {
+      *lpNumberOfBytesWritten = nNumberOfBytesToWrite;
+    }
+  }
+
+  NotifyMutation(Operation::Write, path);
+  SetLastError(ERROR_SUCCESS);
+  return TRUE;
+}
+
+
+BOOL SetFilePointerEx(HANDLE hFile, LARGE_INTEGER liDistanceToMove, PLARGE_INTEGER lpNewFilePointer, DWORD dwMoveMethod) {
+  std::lock_guard lock(gMutex);
+
+  const auto fileHandle = GetObject<FileHandle>(hFile);
+  if (!fileHandle) {
+    return Fail(ERROR_INVALID_HANDLE);
+  }
+
+  std::int64_t base = 0;
+  switch (dwMoveMethod) {
+    case FILE_BEGIN:
+      break;
+
+    case FILE_CURRENT:
+      base = static_cast<std::int64_t>(fileHandle->position);
+      break;
+
+    case FILE_END:
+      base = static_cast<std::int64_t>(gFiles.at(fileHandle->path).content.size);
+      break;
+
+    default:
+      return Fail(ERROR_INVALID_PARAMETER);
+  }
+
+  const auto position = base + liDistanceToMove.QuadPart;
+  if (position < 0) {
+    return Fail(ERROR_NEGATIVE_SEEK);
+  }
+  fileHandle->position = static_cast<std::uint64_t>(position);
+  if (lpNewFilePointer) {
+    lpNewFilePointer->QuadPart = position;
+  }
+  return TRUE;
+}
+
+
+DWORD SetFilePointer(HANDLE hFile, LONG lDistanceToMove, PLONG lpDistanceToMoveHigh, DWORD dwMoveMethod) {
+  LARGE_INTEGER distance;
+  if (lpDistanceToMoveHigh) {
+    distance.u.LowPart = static_cast<DWORD>(lDistanceToMove);
+    distance.u.HighPart = *lpDistanceToMoveHigh;
+  } else {
+    distance.QuadPart = lDistanceToMove;
+  }
+
+  LARGE_INTEGER newPosition;
+  if (!SetFilePointerEx(hFile, distance, &newPosition, dwMoveMethod)) {
+    return INVALID_SET_FILE_POINTER;
+  }
+  if (lpDistanceToMoveHigh) {
+    *lpDistanceToMoveHigh = newPosition.u.HighPart;
+  }
+  SetLastError(ERROR_SUCCESS);
+  return newPosition.u.LowPart;
+}
+
+
+BOOL GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER lpFileSize) {
+  std::lock_guard lock(gMutex);
+
+  const auto fileHandle = GetObject<FileHandle>(hFile);
+  if (!fileHandle) {
+    return Fail(ERROR_INVALID_HANDLE);
+  }
+  lpFileSize->QuadPart = static_cast<LONGLONG>(gFiles.at(fileHandle->path).content.size);
+  return TRUE;
+}
+
+
+BOOL FlushFileBuffers(HANDLE hFile) {
+  std::wstring path;
+  {
+    std::lock_guard lock(gMutex);
+    const auto fileHandle = GetObject<FileHandle>(hFile);
+    if (!fileHandle) {
+      return Fail(ERROR_INVALID_HANDLE);
+    }
+    if (!fileHandle->writable) {
+      return Fail(ERROR_ACCESS_DENIED);
+    }
+    path = fileHandle->path;
+  }
+
+  if (!Enter(Operation::Flush, path)) {
+    return FALSE;
+  }
+
+  std::lock_guard lock(gMutex);
+  if (const auto itr = gFiles.find(path); itr != gFiles.end()) {
+    itr->second.dirty = false;
+  }
+  return TRUE;
+}
+
+
+BOOL CloseHandle(HANDLE hObject) {
+  std::wstring deletedPath;
+  {
+    std::lock_guard lock(gMutex);
+
+    const auto object = static_cast<Object*>(hObject);
+    if (!gObjects.erase(object)) {
+      return Fail(ERROR_INVALID_HANDLE);
+    }
+    if (const auto fileHandle = dynamic_cast<FileHandle*>(object)) {
+      const auto itr = gFiles.find(fileHandle->path);
+      itr->second.openCount--;
+      // the file is deleted when the last handle is closed, which is the only one for the exclusive handles used with FILE_FLAG_DELETE_ON_CLOSE
+      if (fileHandle->deleteOnClose && itr->second.openCount == 0) {
+        deletedPath = fileHandle->path;
+        gFiles.erase(itr);
+      }
+    }
+    delete object;
+  }
+
+  if (!deletedPath.empty()) {
+    NotifyMutation(Operation::Delete, deletedPath);
+  }
+  return TRUE;
+}
+
+
+BOOL DeleteFileW(LPCWSTR lpFileName) {
+  const std::wstring path(lpFileName);
+  if (!Enter(Operation::Delete, path)) {
+    return FALSE;
+  }
+
+  {
+    std::lock_guard lock(gMutex);
+    const auto itr = gFiles.find(path);
+    if (itr == gFiles.end()) {
+      return Fail(ERROR_FILE_NOT_FOUND);
+    }
+    if (itr->second.openCount != 0) {
+      return Fail(ERROR_SHARING_VIOLATION);
+    }
+    gFiles.erase(itr);
+  }
+
+  NotifyMutation(Operation::Delete, path);
+  return TRUE;
+}
+
+
+BOOL MoveFileExW(LPCWSTR lpExistingFileName, LPCWSTR lpNewFileName, DWORD dwFlags) {
+  const std::wstring source(lpExistingFileName);
+  const std::wstring destination(lpNewFileName);
+  if (!Enter(Operation::Move, source)) {
+    return FALSE;
+  }
+
+  {
+    std::lock_guard lock(gMutex);
+    const auto sourceItr = gFiles.find(source);
+    if (sourceItr == gFiles.end()) {
+      return Fail(ERROR_FILE_NOT_FOUND);
+    }
+    if (sourceItr->second.openCount != 0) {
+      return Fail(ERROR_SHARING_VIOLATION);
+    }
+    if (const auto destinationItr = gFiles.find(destination); destinationItr != gFiles.end()) {
+      if (!(dwFlags & MOVEFILE_REPLACE_EXISTING)) {
+        return Fail(ERROR_ALREADY_EXISTS);
+      }
+      if (destinationItr->second.openCount != 0) {
+        return Fail(ERROR_ACCESS_DENIED);
+      }
+      gFiles.erase(destinationItr);
+    }
+    auto file = std::move(gFiles.at(source));
+    gFiles.erase(source);
+    gFiles.emplace(destination, std::move(file));
+  }
+
+  NotifyMutation(Operation::Move, source);
+  return TRUE;
+}
+
+
+HANDLE CreateFileMappingW(HANDLE hFile, LPSECURITY_ATTRIBUTES, DWORD, DWORD, DWORD, LPCWSTR) {
+  std::lock_guard lock(gMutex);
+
+  const auto fileHandle = GetObject<FileHandle>(hFile);
+  if (!fileHandle) {
+    SetLastError(ERROR_INVALID_HANDLE);
+    return NULL;
+  }
+  const auto& file = gFiles.at(fileHandle->path);
+  if (file.content.size == 0) {
+    // an empty file cannot be mapped without specifying a size
+    SetLastError(ERROR_FILE_INVALID);
+    return NULL;
+  }
+
+  const auto mappingHandle = new MappingHandle();
+  mappingHandle->path = fileHandle->path;
+  mappingHandle->content = file.content;
+  gObjects.insert(mappingHandle);
+  return mappingHandle;
+}
+
+
+LPVOID MapViewOfFile(HANDLE hFileMappingObject, DWORD, DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow, SIZE_T dwNumberOfBytesToMap) {
+  std::lock_guard lock(gMutex);
+
+  const auto mappingHandle = GetObject<MappingHandle>(hFileMappingObject);
+  if (!mappingHandle) {
+    SetLastError(ERROR_INVALID_HANDLE);
+    return nullptr;
+  }
+  if (dwFileOffsetHigh != 0 || dwFileOffsetLow != 0 || dwNumberOfBytesToMap != 0) {
+    // only whole-file views are supported
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return nullptr;
+  }
+
+  // the view keeps the file open even after the mapping handle is closed
+  const void* ptr = mappingHandle->content.buffer->data.get();
+  gFiles.at(mappingHandle->path).openCount++;
+  gViews.emplace(ptr, View{mappingHandle->path, mappingHandle->content});
+  return const_cast<void*>(ptr);
+}
+
+
+BOOL UnmapViewOfFile(LPCVOID lpBaseAddress) {
+  std::lock_guard lock(gMutex);
+
+  const auto itr = gViews.find(lpBaseAddress);
+  if (itr == gViews.end()) {
+    return Fail(ERROR_INVALID_PARAMETER);
+  }
+  gFiles.at(itr->second.path).openCount--;
+  gViews.erase(itr);
+  return TRUE;
+}
+
+
+DWORD GetTempPathW(DWORD nBufferLength, LPWSTR lpBuffer) {
+  constexpr std::wstring_view TempPath = L"C:\\Temp\\";
+  if (nBufferLength <= TempPath.size()) {
+    return static_cast<DWORD>(TempPath.size() + 1);
+  }
+  std::copy(TempPath.begin(), TempPath.end(), lpBuffer);
+  lpBuffer[TempPath.size()] = L'\0';
+  return static_cast<DWORD>(TempPath.size());
+}
+
+
+UINT GetTempFileNameW(LPCWSTR lpPathName, LPCWSTR lpPrefixString, UINT, LPWSTR lpTempFileName) {
+  UINT unique;
+  {
+    std::lock_guard lock(gMutex);
+    unique = ++gTempFileCount;
+  }
+
+  wchar_t uniqueString[9];
+  std::swprintf(uniqueString, 9, L"%X", unique);
+  const auto path = std::wstring(lpPathName) + std::wstring(lpPrefixString).substr(0, 3) + uniqueString + L".TMP";
+  if (path.size() >= MAX_PATH) {
+    SetLastError(ERROR_BUFFER_OVERFLOW);
+    return 0;
+  }
+
+  // as GetTempFileNameW does with uUnique of 0, create the file
+  const HANDLE fileHandle = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (fileHandle == INVALID_HANDLE_VALUE) {
+    return 0;
+  }
+  CloseHandle(fileHandle);
+
+  std::copy(path.begin(), path.end(), lpTempFileName);
+  lpTempFileName[path.size()] = L'\0';
+  return unique;
+}
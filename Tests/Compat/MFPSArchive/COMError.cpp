@@ -0,0 +1,106 @@
+// MFPSArchive/NanaZ/COMError.cpp, and NtstatusError and Win32Error of SDK/Plugin/SourceCpp.cpp without Dokan
+// every failure is reported as STATUS_UNSUCCESSFUL
+
+#include "../../../MFPSArchive/NanaZ/COMError.hpp"
+
+#include <string>
+
+#include <Windows.h>
+
+using namespace std::literals;
+
+
+
+NtstatusError::NtstatusError(NTSTATUS ntstatusErrorCode) :
+  NtstatusError(ntstatusErrorCode, "NTSTATUS error "s + std::to_string(ntstatusErrorCode))
+{}
+
+
+NtstatusError::NtstatusError(NTSTATUS ntstatusErrorCode, const std::string& errorMessage) :
+  std::runtime_error(errorMessage),
+  ntstatusErrorCode(ntstatusErrorCode)
+{}
+
+
+NtstatusError::NtstatusError(NTSTATUS ntstatusErrorCode, const char* errorMessage) :
+  std::runtime_error(errorMessage),
+  ntstatusErrorCode(ntstatusErrorCode)
+{}
+
+
+NtstatusError::operator NTSTATUS() const noexcept {
+  return ntstatusErrorCode;
+}
+
+
+
+NTSTATUS Win32Error::NTSTATUSFromWin32(DWORD win32ErrorCode) noexcept {
+  return win32ErrorCode == ERROR_SUCCESS ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL;
+}
+
+
+Win32Error::Win32Error(DWORD win32ErrorCode) :
+  Win32Error(win32ErrorCode, "Win32 Error "s + std::to_string(win32ErrorCode))
+{}
+
+
+Win32Error::Win32Error(DWORD win32ErrorCode, const std::string& errorMessage) :
+  NtstatusError(NTSTATUSFromWin32(win32ErrorCode), errorMessage),
+  win32ErrorCode(win32ErrorCode)
+{}
+
+
+Win32Error::Win32Error(DWORD win32ErrorCode, const char* errorMessage) :
+  NtstatusError(NTSTATUSFromWin32(win32ErrorCode), errorMessage),
+  win32ErrorCode(win32ErrorCode)
+{}
+
+
+Win32Error::Win32Error() :
+  Win32Error(GetLastError())
+{}
+
+
+Win32Error::Win32Error(const std::string& errorMessage) :
+  Win32Error(GetLastError(), errorMessage)
+{}
+
+
+Win32Error::Win32Error(const char* errorMessage) :
+  Win32Error(GetLastError(), errorMessage)
+{}
+
+
+
+NTSTATUS COMError::NTSTATUSFromHRESULT(HRESULT hResult) noexcept {
+  return SUCCEEDED(hResult) ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL;
+}
+
+
+void COMError::CheckHRESULT(HRESULT hResult) {
+  if (FAILED(hResult)) {
+    throw COMError(hResult);
+  }
+}
+
+
+COMError::COMError(HRESULT hResult) :
+  COMError(hResult, "HRESULT error "s + std::to_string(hResult))
+{}
+
+
+COMError::COMError(HRESULT hResult, const std::string& errorMessage) :
+  NtstatusError(NTSTATUSFromHRESULT(hResult), errorMessage),
+  hResult(hResult)
+{}
+
+
+COMError::COMError(HRESULT hResult, const char* errorMessage) :
+  NtstatusError(NTSTATUSFromHRESULT(hResult), errorMessage),
+  hResult(hResult)
+{}
+
+
+HRESULT COMError::GetHRESULT() const noexcept {
+  return hResult;
+}
@@ -0,0 +1,20 @@
+// GenerateTagRIFF and GenerateTagID3 without the code page conversions of EncodingConverter
+// the tests build WAV files without cue sheets, so these are never called
+
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "../../../MFPSCue/GenerateTagID3.hpp"
+#include "../../../MFPSCue/GenerateTagRIFF.hpp"
+
+
+
+std::vector<std::byte> GenerateTagRIFF(const CueSheet&, CueSheet::File::Track::TrackNumber) {
+  throw std::logic_error("GenerateTagRIFF is not available in the tests");
+}
+
+
+std::vector<std::byte> GenerateTagID3(const CueSheet&, CueSheet::File::Track::TrackNumber) {
+  throw std::logic_error("GenerateTagID3 is not available in the tests");
+}
@@ -0,0 +1,81 @@
+// module API of Compat/Windows.h backed by the modules registered with compat::module::Register
+
+#include "CompatModule.hpp"
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <Windows.h>
+
+
+
+namespace {
+  struct Module {
+    compat::module::Exports exports;
+    std::size_t loadCount = 0;
+  };
+
+
+  std::mutex gMutex;
+  std::map<std::wstring, std::unique_ptr<Module>, std::less<>> gModules;
+}
+
+
+
+namespace compat::module {
+  void Register(const std::wstring& filename, Exports exports) {
+    std::lock_guard lock(gMutex);
+    gModules.insert_or_assign(filename, std::make_unique<Module>(Module{std::move(exports)}));
+  }
+
+
+  void Unregister(const std::wstring& filename) {
+    std::lock_guard lock(gMutex);
+    gModules.erase(filename);
+  }
+}
+
+
+
+HMODULE LoadLibraryW(LPCWSTR lpLibFileName) {
+  std::lock_guard lock(gMutex);
+
+  const auto itr = gModules.find(std::wstring_view(lpLibFileName));
+  if (itr == gModules.end()) {
+    SetLastError(ERROR_FILE_NOT_FOUND);
+    return NULL;
+  }
+  itr->second->loadCount++;
+  return itr->second.get();
+}
+
+
+FARPROC GetProcAddress(HMODULE hModule, LPCSTR lpProcName) {
+  std::lock_guard lock(gMutex);
+
+  const auto module = static_cast<Module*>(hModule);
+  const auto itr = module->exports.find(std::string_view(lpProcName));
+  if (itr == module->exports.end()) {
+    SetLastError(ERROR_INVALID_FUNCTION);
+    return nullptr;
+  }
+  return itr->second;
+}
+
+
+BOOL FreeLibrary(HMODULE hLibModule) {
+  std::lock_guard lock(gMutex);
+
+  const auto module = static_cast<Module*>(hLibModule);
+  if (module->loadCount == 0) {
+    SetLastError(ERROR_INVALID_HANDLE);
+    return FALSE;
+  }
+  module->loadCount--;
+  return TRUE;
+}
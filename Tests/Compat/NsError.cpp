@@ -0,0 +1,95 @@
+// LibMergeFS/NsError.cpp without Dokan
+// DokanNtStatusFromWin32 is replaced by a table covering the errors the components under test report
+
+#include "../../LibMergeFS/NsError.hpp"
+
+#include <stdexcept>
+
+#include <Windows.h>
+
+
+
+namespace {
+  NTSTATUS NtStatusFromWin32(DWORD error) {
+    switch (error) {
+      case ERROR_SUCCESS:
+        return STATUS_SUCCESS;
+
+      case ERROR_FILE_NOT_FOUND:
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+
+      case ERROR_PATH_NOT_FOUND:
+        return STATUS_OBJECT_PATH_NOT_FOUND;
+
+      case ERROR_ACCESS_DENIED:
+        return STATUS_ACCESS_DENIED;
+
+      case ERROR_INVALID_HANDLE:
+        return STATUS_INVALID_HANDLE;
+
+      case ERROR_NOT_ENOUGH_MEMORY:
+      case ERROR_OUTOFMEMORY:
+        return STATUS_NO_MEMORY;
+
+      case ERROR_SHARING_VIOLATION:
+        return STATUS_SHARING_VIOLATION;
+
+      case ERROR_HANDLE_EOF:
+        return STATUS_END_OF_FILE;
+
+      case ERROR_NOT_SUPPORTED:
+        return STATUS_NOT_SUPPORTED;
+
+      case ERROR_FILE_EXISTS:
+      case ERROR_ALREADY_EXISTS:
+        return STATUS_OBJECT_NAME_COLLISION;
+
+      case ERROR_INVALID_PARAMETER:
+        return STATUS_INVALID_PARAMETER;
+
+      case ERROR_BUFFER_OVERFLOW:
+        return STATUS_BUFFER_OVERFLOW;
+
+      case ERROR_INSUFFICIENT_BUFFER:
+        return STATUS_BUFFER_TOO_SMALL;
+
+      default:
+        return STATUS_UNSUCCESSFUL;
+    }
+  }
+}
+
+
+
+NsError::NsError(NTSTATUS status, const char* message) :
+  std::runtime_error(message),
+  status(status)
+{}
+
+
+NsError::NsError(NTSTATUS status) :
+  std::runtime_error("NsError"),
+  status(status)
+{}
+
+
+NTSTATUS NsError::GetStatus() const {
+  return status;
+}
+
+
+NsError::operator NTSTATUS() const {
+  return status;
+}
+
+
+
+W32Error::W32Error(DWORD error) :
+  NsError(NtStatusFromWin32(error), "W32Error"),
+  error(error)
+{}
+
+
+DWORD W32Error::GetError() const {
+  return error;
+}
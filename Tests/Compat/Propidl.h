@@ -0,0 +1,51 @@
+#pragma once
+
+// PROPVARIANT of Propidl.h, with the members used by 7-Zip's handlers
+
+#include <Windows.h>
+
+
+using VARTYPE = USHORT;
+using PROPID = ULONG;
+using VARIANT_BOOL = SHORT;
+
+#define VARIANT_TRUE  (static_cast<VARIANT_BOOL>(-1))
+#define VARIANT_FALSE (static_cast<VARIANT_BOOL>(0))
+
+enum VARENUM {
+  VT_EMPTY = 0,
+  VT_BSTR = 8,
+  VT_BOOL = 11,
+  VT_UI1 = 17,
+  VT_UI2 = 18,
+  VT_UI4 = 19,
+  VT_UI8 = 21,
+  VT_FILETIME = 64,
+};
+
+
+struct PROPVARIANT {
+  VARTYPE vt;
+  WORD wReserved1;
+  WORD wReserved2;
+  WORD wReserved3;
+  union {
+    UCHAR bVal;
+    USHORT uiVal;
+    ULONG ulVal;
+    ULARGE_INTEGER uhVal;
+    VARIANT_BOOL boolVal;
+    FILETIME filetime;
+    BSTR bstrVal;
+  };
+};
+
+
+inline HRESULT PropVariantClear(PROPVARIANT* pvar) {
+  if (pvar->vt == VT_BSTR) {
+    SysFreeString(pvar->bstrVal);
+  }
+  pvar->vt = VT_EMPTY;
+  pvar->uhVal.QuadPart = 0;
+  return S_OK;
+}
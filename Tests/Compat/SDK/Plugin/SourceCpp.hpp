@@ -0,0 +1,38 @@
+#pragma once
+
+// the exception classes of SDK/Plugin/SourceCpp.hpp without the plugin interface, which needs Dokan
+// reached from MFPSArchive/NanaZ/COMError.hpp through the include directory Compat/MFPSArchive (see CMakeLists.txt)
+
+#include <stdexcept>
+#include <string>
+
+#include <Windows.h>
+
+
+class NtstatusError : public std::runtime_error {
+public:
+  const NTSTATUS ntstatusErrorCode;
+
+  NtstatusError(NTSTATUS ntstatusErrorCode);
+  NtstatusError(NTSTATUS ntstatusErrorCode, const std::string& errorMessage);
+  NtstatusError(NTSTATUS ntstatusErrorCode, const char* errorMessage);
+
+  operator NTSTATUS() const noexcept;
+};
+
+
+class Win32Error : public NtstatusError {
+public:
+  static NTSTATUS NTSTATUSFromWin32(DWORD win32ErrorCode) noexcept;
+
+  const DWORD win32ErrorCode;
+
+  Win32Error(DWORD win32ErrorCode);
+  Win32Error(DWORD win32ErrorCode, const std::string& errorMessage);
+  Win32Error(DWORD win32ErrorCode, const char* errorMessage);
+
+  // they will retrieve error code from GetLastError()
+  Win32Error();
+  Win32Error(const std::string& errorMessage);
+  Win32Error(const char* errorMessage);
+};
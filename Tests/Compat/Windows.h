@@ -0,0 +1,407 @@
+#pragma once
+
+// the subset of the Windows API used by the portable components under test
+// only used when building the tests on non-Windows hosts; the real SDK headers are used on Windows
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+
+
+#define WINAPI
+#define CALLBACK
+#define FAR
+#define NEAR
+#define CONST const
+#define UNREFERENCED_PARAMETER(P) ((void)(P))
+
+using BYTE = std::uint8_t;
+using WORD = std::uint16_t;
+using DWORD = std::uint32_t;
+using BOOL = std::int32_t;
+using BOOLEAN = std::uint8_t;
+using UCHAR = std::uint8_t;
+using USHORT = std::uint16_t;
+using SHORT = std::int16_t;
+using INT = std::int32_t;
+using UINT = std::uint32_t;
+using LONG = std::int32_t;
+using ULONG = std::uint32_t;
+using LONGLONG = std::int64_t;
+using ULONGLONG = std::uint64_t;
+using LONG64 = std::int64_t;
+using ULONG64 = std::uint64_t;
+using DWORD64 = std::uint64_t;
+using INT_PTR = std::intptr_t;
+using UINT_PTR = std::uintptr_t;
+using LONG_PTR = std::intptr_t;
+using ULONG_PTR = std::uintptr_t;
+using DWORD_PTR = std::uintptr_t;
+using SIZE_T = std::size_t;
+using NTSTATUS = std::int32_t;
+using HRESULT = std::int32_t;
+using ACCESS_MASK = DWORD;
+using WCHAR = wchar_t;
+using CHAR = char;
+using LPSTR = char*;
+using LPCSTR = const char*;
+using LPWSTR = wchar_t*;
+using LPCWSTR = const wchar_t*;
+using PWSTR = wchar_t*;
+using PCWSTR = const wchar_t*;
+using LPVOID = void*;
+using LPCVOID = const void*;
+using PVOID = void*;
+using HANDLE = void*;
+using HMODULE = void*;
+using BSTR = wchar_t*;
+using LPDWORD = DWORD*;
+using PDWORD = DWORD*;
+using PULONG = ULONG*;
+using PLONG = LONG*;
+using LPBOOL = BOOL*;
+
+#ifndef TRUE
+#  define TRUE 1
+#endif
+#ifndef FALSE
+#  define FALSE 0
+#endif
+
+#define INVALID_HANDLE_VALUE (reinterpret_cast<HANDLE>(static_cast<LONG_PTR>(-1)))
+#define INVALID_FILE_ATTRIBUTES (static_cast<DWORD>(-1))
+#define INVALID_FILE_SIZE (static_cast<DWORD>(0xFFFFFFFF))
+#define INVALID_SET_FILE_POINTER (static_cast<DWORD>(-1))
+
+#define MAX_PATH 260
+
+
+union LARGE_INTEGER {
+  struct {
+    DWORD LowPart;
+    LONG HighPart;
+  } u;
+  LONGLONG QuadPart;
+};
+using PLARGE_INTEGER = LARGE_INTEGER*;
+
+
+union ULARGE_INTEGER {
+  struct {
+    DWORD LowPart;
+    DWORD HighPart;
+  } u;
+  ULONGLONG QuadPart;
+};
+using PULARGE_INTEGER = ULARGE_INTEGER*;
+
+
+struct FILETIME {
+  DWORD dwLowDateTime;
+  DWORD dwHighDateTime;
+};
+using PFILETIME = FILETIME*;
+using LPFILETIME = FILETIME*;
+
+
+struct WIN32_FIND_DATAW {
+  DWORD dwFileAttributes;
+  FILETIME ftCreationTime;
+  FILETIME ftLastAccessTime;
+  FILETIME ftLastWriteTime;
+  DWORD nFileSizeHigh;
+  DWORD nFileSizeLow;
+  DWORD dwReserved0;
+  DWORD dwReserved1;
+  WCHAR cFileName[MAX_PATH];
+  WCHAR cAlternateFileName[14];
+};
+using PWIN32_FIND_DATAW = WIN32_FIND_DATAW*;
+
+
+struct SECURITY_ATTRIBUTES;
+using LPSECURITY_ATTRIBUTES = SECURITY_ATTRIBUTES*;
+
+
+// the union of Offset and OffsetHigh with Pointer is left out
+struct OVERLAPPED {
+  ULONG_PTR Internal;
+  ULONG_PTR InternalHigh;
+  DWORD Offset;
+  DWORD OffsetHigh;
+  HANDLE hEvent;
+};
+using LPOVERLAPPED = OVERLAPPED*;
+
+
+struct BY_HANDLE_FILE_INFORMATION {
+  DWORD dwFileAttributes;
+  FILETIME ftCreationTime;
+  FILETIME ftLastAccessTime;
+  FILETIME ftLastWriteTime;
+  DWORD dwVolumeSerialNumber;
+  DWORD nFileSizeHigh;
+  DWORD nFileSizeLow;
+  DWORD nNumberOfLinks;
+  DWORD nFileIndexHigh;
+  DWORD nFileIndexLow;
+};
+using LPBY_HANDLE_FILE_INFORMATION = BY_HANDLE_FILE_INFORMATION*;
+
+
+struct GUID {
+  DWORD Data1;
+  WORD Data2;
+  WORD Data3;
+  BYTE Data4[8];
+};
+
+
+using IID = GUID;
+using CLSID = GUID;
+using REFIID = const IID&;
+using REFGUID = const GUID&;
+using REFCLSID = const CLSID&;
+
+
+inline bool IsEqualGUID(REFGUID a, REFGUID b) {
+  return std::memcmp(&a, &b, sizeof(GUID)) == 0;
+}
+
+
+inline bool IsEqualCLSID(REFCLSID a, REFCLSID b) {
+  return IsEqualGUID(a, b);
+}
+
+
+// COM
+// interfaces are declared with __declspec(uuid(...)) for MSVC; Compat/winrt/base.h looks them up with dynamic_cast instead
+#define __declspec(x)
+#define STDMETHODCALLTYPE
+#define STDMETHOD(method) virtual HRESULT STDMETHODCALLTYPE method
+#define STDMETHOD_(type, method) virtual type STDMETHODCALLTYPE method
+#define STDMETHODIMP HRESULT STDMETHODCALLTYPE
+#define STDMETHODIMP_(type) type STDMETHODCALLTYPE
+#define PURE = 0
+
+#define S_OK            (static_cast<HRESULT>(0x00000000L))
+#define S_FALSE         (static_cast<HRESULT>(0x00000001L))
+#define E_PENDING       (static_cast<HRESULT>(0x8000000AL))
+#define E_NOTIMPL       (static_cast<HRESULT>(0x80004001L))
+#define E_NOINTERFACE   (static_cast<HRESULT>(0x80004002L))
+#define E_POINTER       (static_cast<HRESULT>(0x80004003L))
+#define E_ABORT         (static_cast<HRESULT>(0x80004004L))
+#define E_FAIL          (static_cast<HRESULT>(0x80004005L))
+#define E_OUTOFMEMORY   (static_cast<HRESULT>(0x8007000EL))
+#define E_INVALIDARG    (static_cast<HRESULT>(0x80070057L))
+#define STG_E_INVALIDFUNCTION (static_cast<HRESULT>(0x80030001L))
+#define SUCCEEDED(hr) (static_cast<HRESULT>(hr) >= 0)
+#define FAILED(hr) (static_cast<HRESULT>(hr) < 0)
+
+#define FACILITY_WIN32 7
+#define __HRESULT_FROM_WIN32(x) (static_cast<HRESULT>(x) <= 0 ? static_cast<HRESULT>(x) : static_cast<HRESULT>(((x) & 0x0000FFFF) | (FACILITY_WIN32 << 16) | 0x80000000))
+#define HRESULT_FROM_WIN32(x) __HRESULT_FROM_WIN32(x)
+
+struct IUnknown {
+  STDMETHOD(QueryInterface)(REFIID riid, void** ppvObject) PURE;
+  STDMETHOD_(ULONG, AddRef)() PURE;
+  STDMETHOD_(ULONG, Release)() PURE;
+};
+
+
+// BSTR, prefixed with its length in bytes
+// also used for raw data (e.g. CLSIDs returned by 7-Zip's GetHandlerProperty2), so the length need not be a multiple of sizeof(wchar_t)
+inline BSTR SysAllocStringByteLen(LPCSTR psz, UINT len) {
+  const auto block = static_cast<char*>(std::malloc(sizeof(UINT) + len + sizeof(wchar_t)));
+  if (!block) {
+    return nullptr;
+  }
+  std::memcpy(block, &len, sizeof(UINT));
+  if (psz) {
+    std::memcpy(block + sizeof(UINT), psz, len);
+  }
+  std::memset(block + sizeof(UINT) + len, 0, sizeof(wchar_t));
+  return reinterpret_cast<BSTR>(block + sizeof(UINT));
+}
+
+
+inline BSTR SysAllocString(const wchar_t* psz) {
+  if (!psz) {
+    return nullptr;
+  }
+  return SysAllocStringByteLen(reinterpret_cast<LPCSTR>(psz), static_cast<UINT>(std::wcslen(psz) * sizeof(wchar_t)));
+}
+
+
+inline UINT SysStringByteLen(BSTR bstr) {
+  if (!bstr) {
+    return 0;
+  }
+  UINT len;
+  std::memcpy(&len, reinterpret_cast<char*>(bstr) - sizeof(UINT), sizeof(UINT));
+  return len;
+}
+
+
+inline void SysFreeString(BSTR bstrString) {
+  if (bstrString) {
+    std::free(reinterpret_cast<char*>(bstrString) - sizeof(UINT));
+  }
+}
+
+
+// NTSTATUS values
+#define STATUS_SUCCESS                   (static_cast<NTSTATUS>(0x00000000L))
+#define STATUS_ALREADY_COMPLETE          (static_cast<NTSTATUS>(0x000000B8L))
+#define STATUS_PENDING                   (static_cast<NTSTATUS>(0x00000103L))
+#define STATUS_BUFFER_OVERFLOW           (static_cast<NTSTATUS>(0x80000005L))
+#define STATUS_NO_MORE_FILES             (static_cast<NTSTATUS>(0x80000006L))
+#define STATUS_UNSUCCESSFUL              (static_cast<NTSTATUS>(0xC0000001L))
+#define STATUS_NOT_IMPLEMENTED           (static_cast<NTSTATUS>(0xC0000002L))
+#define STATUS_INVALID_HANDLE            (static_cast<NTSTATUS>(0xC0000008L))
+#define STATUS_INVALID_PARAMETER         (static_cast<NTSTATUS>(0xC000000DL))
+#define STATUS_END_OF_FILE               (static_cast<NTSTATUS>(0xC0000011L))
+#define STATUS_NO_MEMORY                 (static_cast<NTSTATUS>(0xC0000017L))
+#define STATUS_ACCESS_DENIED             (static_cast<NTSTATUS>(0xC0000022L))
+#define STATUS_BUFFER_TOO_SMALL          (static_cast<NTSTATUS>(0xC0000023L))
+#define STATUS_OBJECT_NAME_INVALID       (static_cast<NTSTATUS>(0xC0000033L))
+#define STATUS_OBJECT_NAME_NOT_FOUND     (static_cast<NTSTATUS>(0xC0000034L))
+#define STATUS_OBJECT_NAME_COLLISION     (static_cast<NTSTATUS>(0xC0000035L))
+#define STATUS_OBJECT_PATH_NOT_FOUND     (static_cast<NTSTATUS>(0xC000003AL))
+#define STATUS_SHARING_VIOLATION         (static_cast<NTSTATUS>(0xC0000043L))
+#define STATUS_DISK_FULL                 (static_cast<NTSTATUS>(0xC000007FL))
+#define STATUS_INSUFFICIENT_RESOURCES    (static_cast<NTSTATUS>(0xC000009AL))
+#define STATUS_MEDIA_WRITE_PROTECTED     (static_cast<NTSTATUS>(0xC00000A2L))
+#define STATUS_NOT_SUPPORTED             (static_cast<NTSTATUS>(0xC00000BBL))
+#define STATUS_INTERNAL_ERROR            (static_cast<NTSTATUS>(0xC00000E5L))
+#define STATUS_DIRECTORY_NOT_EMPTY       (static_cast<NTSTATUS>(0xC0000101L))
+#define STATUS_NOT_A_DIRECTORY           (static_cast<NTSTATUS>(0xC0000103L))
+#define STATUS_FILE_IS_A_DIRECTORY       (static_cast<NTSTATUS>(0xC00000BAL))
+#define STATUS_CANCELLED                 (static_cast<NTSTATUS>(0xC0000120L))
+
+// Win32 error codes
+#define ERROR_SUCCESS              0L
+#define NO_ERROR                   0L
+#define ERROR_INVALID_FUNCTION     1L
+#define ERROR_FILE_NOT_FOUND       2L
+#define ERROR_PATH_NOT_FOUND       3L
+#define ERROR_ACCESS_DENIED        5L
+#define ERROR_INVALID_HANDLE       6L
+#define ERROR_NOT_ENOUGH_MEMORY    8L
+#define ERROR_INVALID_DATA         13L
+#define ERROR_OUTOFMEMORY          14L
+#define ERROR_WRITE_FAULT          29L
+#define ERROR_READ_FAULT           30L
+#define ERROR_GEN_FAILURE          31L
+#define ERROR_SHARING_VIOLATION    32L
+#define ERROR_HANDLE_EOF           38L
+#define ERROR_NOT_SUPPORTED        50L
+#define ERROR_FILE_EXISTS          80L
+#define ERROR_INVALID_PARAMETER    87L
+#define ERROR_DISK_FULL            112L
+#define ERROR_INSUFFICIENT_BUFFER  122L
+#define ERROR_ALREADY_EXISTS       183L
+#define ERROR_NO_UNICODE_TRANSLATION 1113L
+#define ERROR_SEEK                 25L
+#define ERROR_BUFFER_OVERFLOW      111L
+#define ERROR_NEGATIVE_SEEK        131L
+#define ERROR_FILE_INVALID         1006L
+
+// file attributes
+#define FILE_ATTRIBUTE_READONLY   0x00000001
+#define FILE_ATTRIBUTE_HIDDEN     0x00000002
+#define FILE_ATTRIBUTE_SYSTEM     0x00000004
+#define FILE_ATTRIBUTE_DIRECTORY  0x00000010
+#define FILE_ATTRIBUTE_ARCHIVE    0x00000020
+#define FILE_ATTRIBUTE_NORMAL     0x00000080
+#define FILE_ATTRIBUTE_TEMPORARY  0x00000100
+
+// file API
+#define GENERIC_READ               0x80000000
+#define GENERIC_WRITE              0x40000000
+#define FILE_SHARE_READ            0x00000001
+#define FILE_SHARE_WRITE           0x00000002
+#define FILE_SHARE_DELETE          0x00000004
+#define CREATE_NEW                 1
+#define CREATE_ALWAYS              2
+#define OPEN_EXISTING              3
+#define OPEN_ALWAYS                4
+#define TRUNCATE_EXISTING          5
+#define FILE_BEGIN                 0
+#define FILE_CURRENT               1
+#define FILE_END                   2
+#define FILE_FLAG_DELETE_ON_CLOSE  0x04000000
+#define MOVEFILE_REPLACE_EXISTING  0x00000001
+#define MOVEFILE_WRITE_THROUGH     0x00000008
+#define PAGE_READONLY              0x02
+#define FILE_MAP_READ              0x0004
+
+
+namespace compat {
+  inline thread_local DWORD gLastError = ERROR_SUCCESS;
+}
+
+
+inline DWORD GetLastError() {
+  return compat::gLastError;
+}
+
+
+inline void SetLastError(DWORD error) {
+  compat::gLastError = error;
+}
+
+
+inline void OutputDebugStringW(LPCWSTR) {}
+
+
+inline void OutputDebugStringA(LPCSTR) {}
+
+
+// only ASCII letters are converted
+inline DWORD CharLowerBuffW(LPWSTR lpsz, DWORD cchLength) {
+  for (DWORD i = 0; i < cchLength; i++) {
+    if (lpsz[i] >= L'A' && lpsz[i] <= L'Z') {
+      lpsz[i] += L'a' - L'A';
+    }
+  }
+  return cchLength;
+}
+
+
+template<std::size_t N, typename... Args>
+int swprintf_s(wchar_t (&buffer)[N], const wchar_t* format, Args... args) {
+  return std::swprintf(buffer, N, format, args...);
+}
+
+
+// file API, implemented in memory by Compat/FileSystem.cpp (see CompatFileSystem.hpp)
+// ReadFile and WriteFile with OVERLAPPED access the given offset synchronously and move the file pointer after it, as they do for synchronous handles
+HANDLE CreateFileW(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
+BOOL ReadFile(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped);
+BOOL WriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten, LPOVERLAPPED lpOverlapped);
+DWORD SetFilePointer(HANDLE hFile, LONG lDistanceToMove, PLONG lpDistanceToMoveHigh, DWORD dwMoveMethod);
+BOOL SetFilePointerEx(HANDLE hFile, LARGE_INTEGER liDistanceToMove, PLARGE_INTEGER lpNewFilePointer, DWORD dwMoveMethod);
+BOOL GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER lpFileSize);
+BOOL FlushFileBuffers(HANDLE hFile);
+BOOL CloseHandle(HANDLE hObject);
+BOOL DeleteFileW(LPCWSTR lpFileName);
+BOOL MoveFileExW(LPCWSTR lpExistingFileName, LPCWSTR lpNewFileName, DWORD dwFlags);
+HANDLE CreateFileMappingW(HANDLE hFile, LPSECURITY_ATTRIBUTES lpFileMappingAttributes, DWORD flProtect, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCWSTR lpName);
+LPVOID MapViewOfFile(HANDLE hFileMappingObject, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow, SIZE_T dwNumberOfBytesToMap);
+BOOL UnmapViewOfFile(LPCVOID lpBaseAddress);
+// the temporary directory is C:\Temp\ (which always exists), and temporary files are created with a counter instead of uUnique
+DWORD GetTempPathW(DWORD nBufferLength, LPWSTR lpBuffer);
+UINT GetTempFileNameW(LPCWSTR lpPathName, LPCWSTR lpPrefixString, UINT uUnique, LPWSTR lpTempFileName);
+
+
+// modules, implemented by Compat/Module.cpp (see CompatModule.hpp)
+// LoadLibraryW only finds modules registered by the tests
+// FARPROC takes no parameters and returns nothing (unlike INT_PTR of Windows) so that GCC accepts casts to the actual function types
+using FARPROC = void (WINAPI*)();
+
+HMODULE LoadLibraryW(LPCWSTR lpLibFileName);
+FARPROC GetProcAddress(HMODULE hModule, LPCSTR lpProcName);
+BOOL FreeLibrary(HMODULE hLibModule);
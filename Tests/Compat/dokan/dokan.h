@@ -0,0 +1,9 @@
+#pragma once
+
+// only included for the Windows types by the components under test, plus the NTSTATUS helpers which dokan.h brings in
+
+#include <Windows.h>
+
+
+// NTSTATUS of FACILITY_NTWIN32 for a Win32 error code
+#define __NTSTATUS_FROM_WIN32(x) ((NTSTATUS)(x) <= 0 ? ((NTSTATUS)(x)) : ((NTSTATUS)(((x) & 0x0000FFFF) | (7 << 16) | 0xC0000000)))
@@ -0,0 +1,22 @@
+#pragma once
+
+// _aligned_malloc and _aligned_free of the Microsoft C runtime
+
+#include_next <malloc.h>
+
+#include <cstddef>
+#include <cstdlib>
+
+
+inline void* _aligned_malloc(std::size_t size, std::size_t alignment) {
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, alignment < sizeof(void*) ? sizeof(void*) : alignment, size) != 0) {
+    return nullptr;
+  }
+  return ptr;
+}
+
+
+inline void _aligned_free(void* ptr) {
+  std::free(ptr);
+}
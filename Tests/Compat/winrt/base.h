@@ -0,0 +1,166 @@
+#pragma once
+
+// the subset of C++/WinRT used for classic COM objects
+// without IIDs, as and try_as look interfaces up with dynamic_cast and QueryInterface of the objects fails for every interface
+// objects queried by IID (such as the stand-in archive handlers of the tests) override QueryInterface themselves
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <Windows.h>
+
+
+namespace winrt {
+  template<typename T>
+  class com_ptr {
+    template<typename U>
+    friend class com_ptr;
+
+    T* ptr = nullptr;
+
+    void AddRefPointer() const noexcept {
+      if (ptr) {
+        ptr->AddRef();
+      }
+    }
+
+    void ReleasePointer() noexcept {
+      if (ptr) {
+        std::exchange(ptr, nullptr)->Release();
+      }
+    }
+
+  public:
+    com_ptr(std::nullptr_t = nullptr) noexcept {}
+
+    com_ptr(const com_ptr& other) noexcept :
+      ptr(other.ptr)
+    {
+      AddRefPointer();
+    }
+
+    template<typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    com_ptr(const com_ptr<U>& other) noexcept :
+      ptr(other.ptr)
+    {
+      AddRefPointer();
+    }
+
+    com_ptr(com_ptr&& other) noexcept :
+      ptr(std::exchange(other.ptr, nullptr))
+    {}
+
+    template<typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    com_ptr(com_ptr<U>&& other) noexcept :
+      ptr(std::exchange(other.ptr, nullptr))
+    {}
+
+    ~com_ptr() {
+      ReleasePointer();
+    }
+
+    com_ptr& operator=(com_ptr other) noexcept {
+      std::swap(ptr, other.ptr);
+      return *this;
+    }
+
+    explicit operator bool() const noexcept {
+      return ptr != nullptr;
+    }
+
+    T* operator->() const noexcept {
+      return ptr;
+    }
+
+    T& operator*() const noexcept {
+      return *ptr;
+    }
+
+    T* get() const noexcept {
+      return ptr;
+    }
+
+    T** put() noexcept {
+      ReleasePointer();
+      return &ptr;
+    }
+
+    void** put_void() noexcept {
+      return reinterpret_cast<void**>(put());
+    }
+
+    void attach(T* value) noexcept {
+      ReleasePointer();
+      ptr = value;
+    }
+
+    T* detach() noexcept {
+      return std::exchange(ptr, nullptr);
+    }
+
+    template<typename U>
+    com_ptr<U> try_as() const noexcept {
+      com_ptr<U> result;
+      result.ptr = dynamic_cast<U*>(ptr);
+      result.AddRefPointer();
+      return result;
+    }
+
+    // throws instead of winrt::hresult_no_interface
+    template<typename U>
+    com_ptr<U> as() const {
+      auto result = try_as<U>();
+      if (!result) {
+        throw std::logic_error("no such interface");
+      }
+      return result;
+    }
+  };
+
+
+  namespace impl {
+    // interfaces which are also bases of other listed interfaces (e.g. ISequentialInStream of IInStream) are not inherited again
+    template<typename I>
+    struct skipped_interface {};
+
+    template<typename I, typename... Interfaces>
+    using interface_base = std::conditional_t<(... || (!std::is_same_v<I, Interfaces> && std::is_base_of_v<I, Interfaces>)), skipped_interface<I>, I>;
+  }
+
+
+  template<typename D, typename... Interfaces>
+  class implements : public impl::interface_base<Interfaces, Interfaces...>... {
+    std::atomic<ULONG> refCount = 1;
+
+  public:
+    STDMETHODIMP QueryInterface(REFIID, void** ppvObject) override {
+      if (ppvObject) {
+        *ppvObject = nullptr;
+      }
+      return E_NOINTERFACE;
+    }
+
+    STDMETHODIMP_(ULONG) AddRef() override {
+      return ++refCount;
+    }
+
+    STDMETHODIMP_(ULONG) Release() override {
+      const ULONG count = --refCount;
+      if (count == 0) {
+        delete static_cast<D*>(this);
+      }
+      return count;
+    }
+  };
+
+
+  template<typename D, typename... Args>
+  com_ptr<D> make_self(Args&&... args) {
+    com_ptr<D> result;
+    result.attach(new D(std::forward<Args>(args)...));
+    return result;
+  }
+}
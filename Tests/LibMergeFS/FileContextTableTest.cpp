@@ -0,0 +1,190 @@
+#include "Test.hpp"
+
+#include "../../LibMergeFS/FileContextTable.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+
+namespace {
+  std::atomic<std::int64_t> gLiveObjects{0};
+
+
+  struct Object {
+    std::atomic<std::uint64_t> handle;
+    std::uint64_t value;
+
+    Object(std::uint64_t value) :
+      handle(0),
+      value(value)
+    {
+      gLiveObjects++;
+    }
+
+    ~Object() {
+      gLiveObjects--;
+    }
+  };
+
+  using Table = FileContextTable<Object, 8>;
+}
+
+
+TEST_CASE(NullHandleIsInvalid) {
+  Table table;
+  CHECK(!table.Get(Table::NullHandle));
+  CHECK(!table.Remove(Table::NullHandle));
+  CHECK(!table.Get(0xFFFFFFFF00000000ull));
+  CHECK(!table.Get(0x0000000100001000ull));
+}
+
+
+TEST_CASE(InsertGetRemove) {
+  Table table;
+  const auto handle = table.Insert(std::make_shared<Object>(42));
+  CHECK(handle != Table::NullHandle);
+
+  const auto ptr = table.Get(handle);
+  CHECK(ptr && ptr->value == 42);
+
+  const auto removed = table.Remove(handle);
+  CHECK(removed == ptr);
+  CHECK(!table.Get(handle));
+  CHECK(!table.Remove(handle));
+}
+
+
+// a handle must not reach a different object after its slot has been reused
+TEST_CASE(ReusedSlotRejectsOldHandle) {
+  Table table;
+  std::vector<Table::Handle> oldHandles;
+  for (int i = 0; i < 64; i++) {
+    oldHandles.push_back(table.Insert(std::make_shared<Object>(i)));
+  }
+  for (const auto handle : oldHandles) {
+    CHECK(table.Remove(handle));
+  }
+
+  std::vector<Table::Handle> newHandles;
+  for (int i = 0; i < 64; i++) {
+    newHandles.push_back(table.Insert(std::make_shared<Object>(1000 + i)));
+  }
+  for (const auto handle : oldHandles) {
+    CHECK(!table.Get(handle));
+    CHECK(!table.Remove(handle));
+  }
+  for (std::size_t i = 0; i < newHandles.size(); i++) {
+    const auto ptr = table.Get(newHandles[i]);
+    CHECK(ptr && ptr->value == 1000 + i);
+  }
+  for (const auto handle : newHandles) {
+    CHECK(table.Remove(handle));
+  }
+}
+
+
+// inserters, readers and removers race on a shared pool of handles, including stale ones
+// a lookup must return either nothing or the very object the handle was issued for
+TEST_CASE(ConcurrentStress) {
+  constexpr std::size_t PoolSize = 1024;
+  constexpr std::size_t Iterations = 200000;
+
+  const std::size_t threadCount = std::max<std::size_t>(4, std::thread::hardware_concurrency());
+
+  {
+    Table table;
+    std::vector<std::atomic<Table::Handle>> pool(PoolSize);
+    for (auto& handle : pool) {
+      handle.store(Table::NullHandle);
+    }
+    std::atomic<std::uint64_t> nextValue{1};
+    std::atomic<std::size_t> failures{0};
+    std::atomic<std::size_t> hits{0};
+
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; t++) {
+      threads.emplace_back([&, t]() {
+        std::mt19937_64 engine(t);
+        std::uniform_int_distribution<std::size_t> indexDistribution(0, PoolSize - 1);
+        for (std::size_t i = 0; i < Iterations; i++) {
+          auto& entry = pool[indexDistribution(engine)];
+          switch (engine() % 4) {
+            // open: replace the pooled handle with a new one (closing the old one)
+            case 0: {
+              const auto value = nextValue++;
+              auto ptr = std::make_shared<Object>(value);
+              auto* rawPtr = ptr.get();
+              const auto handle = table.Insert(std::move(ptr));
+              rawPtr->handle.store(handle);
+              const auto oldHandle = entry.exchange(handle);
+              if (oldHandle != Table::NullHandle) {
+                if (!table.Remove(oldHandle)) {
+                  failures++;
+                }
+                if (table.Get(oldHandle)) {
+                  failures++;
+                }
+              }
+              break;
+            }
+
+            // close
+            case 1: {
+              const auto handle = entry.exchange(Table::NullHandle);
+              if (handle == Table::NullHandle) {
+                break;
+              }
+              const auto removed = table.Remove(handle);
+              if (!removed || removed->handle.load() != handle) {
+                failures++;
+              }
+              if (table.Get(handle) || table.Remove(handle)) {
+                failures++;
+              }
+              break;
+            }
+
+            // lookup, possibly with a stale handle
+            default: {
+              const auto handle = entry.load();
+              if (handle == Table::NullHandle) {
+                break;
+              }
+              if (const auto ptr = table.Get(handle)) {
+                const auto objectHandle = ptr->handle.load();
+                // the handle is stored right after Insert returns
+                if (objectHandle != handle && objectHandle != Table::NullHandle) {
+                  failures++;
+                }
+                hits++;
+              }
+              break;
+            }
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    CHECK(failures == 0);
+    CHECK(hits > 0);
+
+    for (auto& entry : pool) {
+      if (const auto handle = entry.load(); handle != Table::NullHandle) {
+        CHECK(table.Remove(handle));
+      }
+    }
+    CHECK(gLiveObjects == 0);
+  }
+
+  CHECK(gLiveObjects == 0);
+}
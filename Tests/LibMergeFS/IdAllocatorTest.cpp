@@ -0,0 +1,110 @@
+#include "Test.hpp"
+
+#include "../../LibMergeFS/IdAllocator.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+
+
+TEST_CASE(AllocatesSequentiallyFromStart) {
+  IdAllocator<std::uint32_t> allocator(5, 0);
+  CHECK(allocator.Allocate() == 5);
+  CHECK(allocator.Allocate() == 6);
+  CHECK(allocator.Allocate() == 7);
+  CHECK(allocator.IsAllocated(6));
+  CHECK(!allocator.IsAllocated(4));
+  CHECK(!allocator.IsAllocated(8));
+}
+
+
+TEST_CASE(InvalidReleasesAreIgnored) {
+  IdAllocator<std::uint32_t> allocator(1, 0);
+  const auto id = allocator.Allocate();
+  CHECK(!allocator.Release(0));
+  CHECK(!allocator.Release(id + 1));
+  CHECK(allocator.Release(id));
+  CHECK(!allocator.Release(id));
+  CHECK(!allocator.IsAllocated(id));
+}
+
+
+// a released ID is not handed out again until reuseDelay more IDs have been released after it
+TEST_CASE(ReuseIsDelayed) {
+  constexpr std::size_t ReuseDelay = 4;
+  IdAllocator<std::uint32_t> allocator(1, ReuseDelay);
+
+  std::vector<std::uint32_t> ids;
+  for (int i = 0; i < 16; i++) {
+    ids.push_back(allocator.Allocate());
+  }
+
+  CHECK(allocator.Release(ids[0]));
+  for (std::size_t i = 0; i < ReuseDelay; i++) {
+    CHECK(allocator.Allocate() != ids[0]);
+  }
+  for (std::size_t i = 1; i <= ReuseDelay; i++) {
+    CHECK(allocator.Release(ids[i]));
+  }
+  CHECK(allocator.Allocate() == ids[0]);
+}
+
+
+TEST_CASE(ReusesWhenIdSpaceIsExhausted) {
+  IdAllocator<std::uint8_t> allocator(250, 100);
+  std::vector<std::uint8_t> ids;
+  for (int i = 0; i < 5; i++) {
+    ids.push_back(allocator.Allocate());
+  }
+  CHECK(ids.back() == 254);
+  CHECK_THROWS(allocator.Allocate(), std::length_error);
+
+  CHECK(allocator.Release(ids[2]));
+  CHECK(allocator.Allocate() == ids[2]);
+}
+
+
+// random churn against a model: live IDs are unique and a released ID respects the delay
+TEST_CASE(ChurnMatchesModel) {
+  constexpr std::size_t ReuseDelay = 64;
+  IdAllocator<std::uint32_t> allocator(1, ReuseDelay);
+
+  std::mt19937 engine(1);
+  std::vector<std::uint32_t> live;
+  std::set<std::uint32_t> liveSet;
+  std::deque<std::uint32_t> released;
+
+  for (int iteration = 0; iteration < 100000; iteration++) {
+    if (live.empty() || engine() % 3 != 0) {
+      const auto id = allocator.Allocate();
+      CHECK(liveSet.insert(id).second);
+      live.push_back(id);
+      for (std::size_t i = released.size() > ReuseDelay ? released.size() - ReuseDelay : 0; i < released.size(); i++) {
+        CHECK(released[i] != id);
+      }
+      for (auto itr = released.begin(); itr != released.end(); ++itr) {
+        if (*itr == id) {
+          released.erase(itr);
+          break;
+        }
+      }
+    } else {
+      const auto index = engine() % live.size();
+      const auto id = live[index];
+      live[index] = live.back();
+      live.pop_back();
+      liveSet.erase(id);
+      CHECK(allocator.Release(id));
+      released.push_back(id);
+    }
+  }
+
+  for (const auto id : live) {
+    CHECK(allocator.IsAllocated(id));
+  }
+}
@@ -0,0 +1,258 @@
+#include "Test.hpp"
+
+#include "../../LibMergeFS/LayerResolver.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std::literals;
+
+
+
+namespace {
+  // stands in for MountSource: a flat map of paths which counts GetFileType calls
+  class FakeMountSource {
+  public:
+    enum class FileType {
+      Inexistent,
+      Directory,
+      File,
+    };
+
+  private:
+    std::map<std::wstring, FileType> mEntries;
+    mutable std::size_t mQueries = 0;
+
+  public:
+    FileType GetFileType(const wchar_t* filename) const {
+      mQueries++;
+      const auto itr = mEntries.find(filename);
+      return itr != mEntries.end() ? itr->second : FileType::Inexistent;
+    }
+
+    void Add(std::wstring_view filename, FileType fileType) {
+      mEntries.insert_or_assign(std::wstring(filename), fileType);
+    }
+
+    void Remove(std::wstring_view filename) {
+      mEntries.erase(std::wstring(filename));
+    }
+
+    void Move(std::wstring_view source, std::wstring_view destination) {
+      const auto itr = mEntries.find(std::wstring(source));
+      CHECK(itr != mEntries.end());
+      const auto fileType = itr->second;
+      mEntries.erase(itr);
+      mEntries.insert_or_assign(std::wstring(destination), fileType);
+    }
+
+    std::size_t GetQueries() const {
+      return mQueries;
+    }
+  };
+
+  using FileType = FakeMountSource::FileType;
+  using Resolver = LayerResolver<FakeMountSource>;
+
+  constexpr std::size_t Top = 0;
+  constexpr std::size_t Lower = 1;
+
+
+  // two layers and a set of resolved paths marked as removed by the metadata (what MetadataStore::ExistsR reports)
+  struct Fixture {
+    std::vector<std::unique_ptr<FakeMountSource>> sources;
+    std::set<std::wstring> removed;
+    Resolver resolver;
+
+    Fixture(std::size_t cacheCapacity = 1024, std::chrono::milliseconds cacheTTL = 0ms) :
+      sources(),
+      removed(),
+      resolver(sources, false, [this](std::wstring_view resolvedFilename) {
+        return removed.count(std::wstring(resolvedFilename)) == 0;
+      }, cacheCapacity, cacheTTL)
+    {
+      sources.push_back(std::make_unique<FakeMountSource>());
+      sources.push_back(std::make_unique<FakeMountSource>());
+      sources[Top]->Add(L"\\dir", FileType::Directory);
+      sources[Lower]->Add(L"\\dir", FileType::Directory);
+    }
+
+    FakeMountSource& top() {
+      return *sources[Top];
+    }
+
+    FakeMountSource& lower() {
+      return *sources[Lower];
+    }
+
+    std::size_t queries() const {
+      return sources[Top]->GetQueries() + sources[Lower]->GetQueries();
+    }
+  };
+}
+
+
+TEST_CASE(RootIsTopDirectory) {
+  Fixture fixture;
+  const auto result = fixture.resolver.Lookup(L"\\");
+  CHECK(result.sourceIndex == Top);
+  CHECK(result.fileType == FileType::Directory);
+  CHECK(fixture.queries() == 0);
+}
+
+
+TEST_CASE(TopmostLayerWins) {
+  Fixture fixture;
+  fixture.top().Add(L"\\dir\\a", FileType::File);
+  fixture.lower().Add(L"\\dir\\a", FileType::Directory);
+  fixture.lower().Add(L"\\dir\\b", FileType::File);
+
+  const auto a = fixture.resolver.Lookup(L"\\dir\\a");
+  CHECK(a.sourceIndex == Top);
+  CHECK(a.fileType == FileType::File);
+
+  const auto b = fixture.resolver.Lookup(L"\\dir\\b");
+  CHECK(b.sourceIndex == Lower);
+  CHECK(b.fileType == FileType::File);
+
+  const auto c = fixture.resolver.Lookup(L"\\dir\\c");
+  CHECK(!c.sourceIndex);
+  CHECK(c.fileType == FileType::Inexistent);
+}
+
+
+TEST_CASE(FileInUpperLayerHidesLowerDirectory) {
+  Fixture fixture;
+  fixture.top().Add(L"\\x", FileType::File);
+  fixture.lower().Add(L"\\x", FileType::Directory);
+  fixture.lower().Add(L"\\x\\child", FileType::File);
+
+  CHECK(fixture.resolver.Lookup(L"\\x").fileType == FileType::File);
+  CHECK(!fixture.resolver.Lookup(L"\\x\\child").sourceIndex);
+}
+
+
+TEST_CASE(RemovedAncestorHidesDescendants) {
+  Fixture fixture;
+  fixture.lower().Add(L"\\dir\\sub", FileType::Directory);
+  fixture.lower().Add(L"\\dir\\sub\\file", FileType::File);
+  fixture.removed.insert(L"\\dir\\sub");
+
+  CHECK(!fixture.resolver.Lookup(L"\\dir\\sub").sourceIndex);
+  CHECK(!fixture.resolver.Lookup(L"\\dir\\sub\\file").sourceIndex);
+}
+
+
+TEST_CASE(ResultsAreCachedCaseInsensitively) {
+  Fixture fixture;
+  fixture.lower().Add(L"\\dir\\File", FileType::File);
+
+  CHECK(fixture.resolver.Lookup(L"\\dir\\File").sourceIndex == Lower);
+  const auto queries = fixture.queries();
+  CHECK(fixture.resolver.Lookup(L"\\DIR\\file").sourceIndex == Lower);
+  CHECK(fixture.resolver.Lookup(L"\\dir\\File").sourceIndex == Lower);
+  CHECK(fixture.queries() == queries);
+
+  const auto statistics = fixture.resolver.GetStatistics();
+  CHECK(statistics.hits >= 2);
+}
+
+
+TEST_CASE(InvalidateDropsSubtree) {
+  Fixture fixture;
+  fixture.lower().Add(L"\\dir\\sub", FileType::Directory);
+  fixture.lower().Add(L"\\dir\\sub\\file", FileType::File);
+  fixture.lower().Add(L"\\dir\\other", FileType::File);
+
+  CHECK(fixture.resolver.Lookup(L"\\dir\\sub\\file").sourceIndex == Lower);
+  CHECK(fixture.resolver.Lookup(L"\\dir\\other").sourceIndex == Lower);
+
+  fixture.lower().Remove(L"\\dir\\sub\\file");
+  fixture.lower().Remove(L"\\dir\\sub");
+  fixture.resolver.Invalidate(L"\\dir\\sub");
+
+  CHECK(!fixture.resolver.Lookup(L"\\dir\\sub\\file").sourceIndex);
+  const auto queries = fixture.queries();
+  CHECK(fixture.resolver.Lookup(L"\\dir\\other").sourceIndex == Lower);
+  CHECK(fixture.queries() == queries);
+}
+
+
+// Mount::DMoveFile renaming \dir\a to \dir\b when only the top layer's \dir\a is moved and the lower layer also has \dir\a
+// the move uncovers the lower \dir\a, which Mount then hides by marking it removed in the metadata
+// the marking has to be followed by an invalidation because the lookup made to detect the uncovered file caches it
+TEST_CASE(RenameOverLowerLayer) {
+  Fixture fixture;
+  fixture.top().Add(L"\\dir\\a", FileType::File);
+  fixture.lower().Add(L"\\dir\\a", FileType::File);
+
+  CHECK(fixture.resolver.Lookup(L"\\dir\\a").sourceIndex == Top);
+  CHECK(!fixture.resolver.Lookup(L"\\dir\\b").sourceIndex);
+
+  // move on the top source, then invalidate both paths
+  fixture.top().Move(L"\\dir\\a", L"\\dir\\b");
+  fixture.resolver.Invalidate(L"\\dir\\a");
+  fixture.resolver.Invalidate(L"\\dir\\b");
+
+  // detect the uncovered lower-layer file (this caches it)
+  const auto newIndex = fixture.resolver.Lookup(L"\\dir\\a").sourceIndex;
+  CHECK(newIndex == Lower);
+
+  // hide it by the metadata, then invalidate
+  fixture.removed.insert(L"\\dir\\a");
+  fixture.resolver.Invalidate(L"\\dir\\a");
+
+  CHECK(!fixture.resolver.Lookup(L"\\dir\\a").sourceIndex);
+  CHECK(fixture.resolver.Lookup(L"\\dir\\b").sourceIndex == Top);
+}
+
+
+// documents why invalidating before the metadata change is not enough
+TEST_CASE(InvalidationBeforeMetadataChangeLeavesStaleEntry) {
+  Fixture fixture;
+  fixture.lower().Add(L"\\dir\\a", FileType::File);
+
+  fixture.resolver.Invalidate(L"\\dir\\a");
+  CHECK(fixture.resolver.Lookup(L"\\dir\\a").sourceIndex == Lower);
+  fixture.removed.insert(L"\\dir\\a");
+  CHECK(fixture.resolver.Lookup(L"\\dir\\a").sourceIndex == Lower);
+
+  fixture.resolver.Invalidate(L"\\dir\\a");
+  CHECK(!fixture.resolver.Lookup(L"\\dir\\a").sourceIndex);
+}
+
+
+// Mount::DMoveFile's metadata-only rename of \dir\a over an existing \dir\b
+// the lower layer's \dir\b can no longer be reached after the rename and must be invalidated as well
+TEST_CASE(MetadataRenameReplacesTarget) {
+  Fixture fixture;
+  fixture.lower().Add(L"\\dir\\a", FileType::File);
+  fixture.lower().Add(L"\\dir\\b", FileType::File);
+
+  CHECK(fixture.resolver.Lookup(L"\\dir\\a").sourceIndex == Lower);
+  CHECK(fixture.resolver.Lookup(L"\\dir\\b").sourceIndex == Lower);
+
+  fixture.removed.insert(L"\\dir\\b");
+  fixture.resolver.Invalidate(L"\\dir\\a");
+  fixture.resolver.Invalidate(L"\\dir\\b");
+
+  CHECK(fixture.resolver.Lookup(L"\\dir\\a").sourceIndex == Lower);
+  CHECK(!fixture.resolver.Lookup(L"\\dir\\b").sourceIndex);
+}
+
+
+TEST_CASE(DisabledCacheAlwaysQueries) {
+  Fixture fixture(0);
+  fixture.lower().Add(L"\\dir\\a", FileType::File);
+
+  CHECK(fixture.resolver.Lookup(L"\\dir\\a").sourceIndex == Lower);
+  const auto queries = fixture.queries();
+  CHECK(fixture.resolver.Lookup(L"\\dir\\a").sourceIndex == Lower);
+  CHECK(fixture.queries() > queries);
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+// stands in for MountSource in the tests and benchmarks of Transport.hpp: one in-memory file which can be exported from and imported to
+// the exporter hands out the file in chunks from its own buffer, overwritten by the next ExportData, as the plugins do
+// every ExportData and ImportData can take time in proportion to its size, and can be made to fail at a given chunk
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <Windows.h>
+
+
+namespace test {
+  class MemoryMountSource {
+  public:
+    // the fields of the SDK's PORTATION_INFO which LibMergeFS touches
+    struct PORTATION_INFO {
+      const LPCWSTR filepath;
+      const DWORD fileContextId;
+      const BOOL empty;
+      void* exporterContext;
+      void* importerContext;
+      BOOL directory;
+      LARGE_INTEGER fileSize;
+      LARGE_INTEGER currentOffset;
+      DWORD currentSize;
+      LPCSTR currentData;
+    };
+
+    struct Options {
+      std::size_t chunkSize = 256 * 1024;
+      // time per MiB exported or imported; 0 for none
+      std::chrono::microseconds latencyPerMiB{0};
+      // fails the ExportData or ImportData of this chunk index with failStatus
+      std::optional<std::size_t> failExportAt;
+      std::optional<std::size_t> failImportAt;
+      NTSTATUS failStatus = STATUS_DISK_FULL;
+    };
+
+  private:
+    const Options mOptions;
+    std::vector<char> mData;
+    std::vector<char> mExportBuffer;
+    std::size_t mLastExportSize = 0;
+    std::size_t mExportedChunks = 0;
+    std::atomic<std::size_t> mImportedChunks{0};
+    std::mutex mMutex;
+    std::vector<bool> mExportFinishCalls;
+    std::vector<bool> mImportFinishCalls;
+
+    void Wait(std::size_t size) const {
+      if (mOptions.latencyPerMiB.count()) {
+        std::this_thread::sleep_for(mOptions.latencyPerMiB * size / (1024 * 1024));
+      }
+    }
+
+  public:
+    MemoryMountSource(std::vector<char> data, const Options& options) :
+      mOptions(options),
+      mData(std::move(data))
+    {}
+
+    explicit MemoryMountSource(std::vector<char> data = {}) :
+      MemoryMountSource(std::move(data), Options())
+    {}
+
+    const std::vector<char>& GetData() const {
+      return mData;
+    }
+
+    std::vector<bool> GetExportFinishCalls() {
+      std::lock_guard lock(mMutex);
+      return mExportFinishCalls;
+    }
+
+    std::vector<bool> GetImportFinishCalls() {
+      std::lock_guard lock(mMutex);
+      return mImportFinishCalls;
+    }
+
+    NTSTATUS ExportStart(PORTATION_INFO* portationInfo) noexcept {
+      portationInfo->directory = FALSE;
+      portationInfo->fileSize.QuadPart = static_cast<LONGLONG>(mData.size());
+      portationInfo->currentOffset.QuadPart = 0;
+      portationInfo->currentSize = 0;
+      portationInfo->currentData = nullptr;
+      mExportBuffer.resize(mOptions.chunkSize);
+      mLastExportSize = 0;
+      mExportedChunks = 0;
+      return STATUS_SUCCESS;
+    }
+
+    NTSTATUS ExportData(PORTATION_INFO* portationInfo) noexcept {
+      portationInfo->currentOffset.QuadPart += mLastExportSize;
+      mLastExportSize = 0;
+
+      const auto offset = static_cast<std::size_t>(portationInfo->currentOffset.QuadPart);
+      const auto size = std::min(mOptions.chunkSize, mData.size() - offset);
+      if (size == 0) {
+        return STATUS_ALREADY_COMPLETE;
+      }
+      if (mOptions.failExportAt == mExportedChunks++) {
+        return mOptions.failStatus;
+      }
+
+      Wait(size);
+      std::memcpy(mExportBuffer.data(), mData.data() + offset, size);
+      mLastExportSize = size;
+      portationInfo->currentData = mExportBuffer.data();
+      portationInfo->currentSize = static_cast<DWORD>(size);
+      return STATUS_SUCCESS;
+    }
+
+    NTSTATUS ExportFinish(PORTATION_INFO*, bool success) noexcept {
+      std::lock_guard lock(mMutex);
+      mExportFinishCalls.push_back(success);
+      return STATUS_SUCCESS;
+    }
+
+    NTSTATUS ImportStart(PORTATION_INFO* portationInfo) noexcept {
+      mData.assign(static_cast<std::size_t>(portationInfo->fileSize.QuadPart), '\0');
+      mImportedChunks = 0;
+      return STATUS_SUCCESS;
+    }
+
+    NTSTATUS ImportData(PORTATION_INFO* portationInfo) noexcept {
+      if (mOptions.failImportAt == mImportedChunks++) {
+        return mOptions.failStatus;
+      }
+
+      Wait(portationInfo->currentSize);
+      const auto offset = static_cast<std::size_t>(portationInfo->currentOffset.QuadPart);
+      if (offset + portationInfo->currentSize > mData.size()) {
+        return STATUS_INVALID_PARAMETER;
+      }
+      std::memcpy(mData.data() + offset, portationInfo->currentData, portationInfo->currentSize);
+      return STATUS_SUCCESS;
+    }
+
+    NTSTATUS ImportFinish(PORTATION_INFO*, bool success) noexcept {
+      std::lock_guard lock(mMutex);
+      mImportFinishCalls.push_back(success);
+      return STATUS_SUCCESS;
+    }
+  };
+
+
+  inline std::vector<char> GenerateFileData(std::size_t size, unsigned int seed = 1) {
+    std::vector<char> data(size);
+    std::uint32_t state = seed;
+    for (auto& c : data) {
+      state = state * 1664525 + 1013904223;
+      c = static_cast<char>(state >> 24);
+    }
+    return data;
+  }
+}
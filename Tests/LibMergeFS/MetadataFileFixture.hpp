@@ -0,0 +1,236 @@
+#pragma once
+
+// builds metadata files of the older formats (V1 and V2 of LibMergeFS/MetadataStore.cpp) byte by byte, as older versions of MergeFS left them
+// the encoders of MetadataStore.cpp are not used on purpose, so that the migration tests do not depend on them
+
+#include "../../LibMergeFS/Metadata.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <Windows.h>
+
+
+namespace test {
+  // keys are stored as is; lowercase them for case-insensitive stores, as FilenameToKey does
+  struct MetadataFileEntry {
+    std::wstring key;
+    Metadata metadata;    // nothing set removes the entry (in the appendix of V2) or makes it empty
+  };
+
+  struct MetadataFileRename {
+    std::wstring from;    // the original name; the current name for renames in the appendix of V2
+    std::wstring to;
+  };
+
+
+  namespace metadata_file {
+    constexpr std::uint32_t HasAttributes     = 1 << 1;
+    constexpr std::uint32_t HasCreationTime   = 1 << 2;
+    constexpr std::uint32_t HasLastAccessTime = 1 << 3;
+    constexpr std::uint32_t HasLastWriteTime  = 1 << 4;
+    constexpr std::uint32_t HasSecurity       = 1 << 5;
+
+    constexpr std::size_t Alignment = 16;
+
+
+    class ImageWriter {
+    public:
+      std::vector<std::byte> bytes;
+
+      template<typename T>
+      void Put(const T& value) {
+        const auto ptr = reinterpret_cast<const std::byte*>(&value);
+        bytes.insert(bytes.end(), ptr, ptr + sizeof(value));
+      }
+
+      template<typename T>
+      void PutAt(std::size_t offset, const T& value) {
+        std::memcpy(bytes.data() + offset, &value, sizeof(value));
+      }
+
+      void PutUTF16(std::wstring_view str) {
+        for (const auto c : str) {
+          Put(static_cast<char16_t>(c));
+        }
+      }
+
+      void PutBytes(std::string_view str) {
+        const auto ptr = reinterpret_cast<const std::byte*>(str.data());
+        bytes.insert(bytes.end(), ptr, ptr + str.size());
+      }
+
+      void Pad() {
+        bytes.resize((bytes.size() + Alignment - 1) / Alignment * Alignment);
+      }
+    };
+
+
+    inline std::uint32_t GetFlags(const Metadata& metadata) {
+      return (metadata.fileAttributes ? HasAttributes : 0)
+        | (metadata.creationTime ? HasCreationTime : 0)
+        | (metadata.lastAccessTime ? HasLastAccessTime : 0)
+        | (metadata.lastWriteTime ? HasLastWriteTime : 0)
+        | (metadata.security ? HasSecurity : 0);
+    }
+
+
+    inline std::uint64_t ToUInt64(const std::optional<FILETIME>& filetime) {
+      return filetime ? static_cast<std::uint64_t>(filetime->dwLowDateTime) | (static_cast<std::uint64_t>(filetime->dwHighDateTime) << 32) : 0;
+    }
+
+
+    inline void PutRenameEntryV2(ImageWriter& writer, const MetadataFileRename& rename) {
+      const auto begin = writer.bytes.size();
+      writer.Put(std::uint32_t{0});
+      writer.Put(std::uint32_t{0});
+      writer.Put(static_cast<std::uint32_t>(rename.from.size()));
+      writer.Put(static_cast<std::uint32_t>(rename.to.size()));
+      writer.PutUTF16(rename.from);
+      writer.Pad();
+      writer.PutUTF16(rename.to);
+      writer.Pad();
+      writer.PutAt(begin, static_cast<std::uint32_t>(writer.bytes.size() - begin));
+    }
+
+
+    inline void PutMetadataEntryV2(ImageWriter& writer, const MetadataFileEntry& entry) {
+      const auto& metadata = entry.metadata;
+      const auto begin = writer.bytes.size();
+      writer.Put(std::uint32_t{0});
+      writer.Put(std::uint32_t{0});
+      writer.Put(static_cast<std::uint32_t>(entry.key.size()));
+      writer.Put(static_cast<std::uint32_t>(metadata.security ? metadata.security->size() : 0));
+      writer.Put(GetFlags(metadata));
+      writer.Put(static_cast<std::uint32_t>(metadata.fileAttributes.value_or(0)));
+      writer.Put(ToUInt64(metadata.creationTime));
+      writer.Put(ToUInt64(metadata.lastAccessTime));
+      writer.Put(ToUInt64(metadata.lastWriteTime));
+      writer.PutUTF16(entry.key);
+      writer.Pad();
+      if (metadata.security) {
+        writer.PutBytes(*metadata.security);
+        writer.Pad();
+      }
+      writer.PutAt(begin, static_cast<std::uint32_t>(writer.bytes.size() - begin));
+    }
+
+
+    // wraps what put writes into an appendix record
+    template<typename F>
+    void PutAppendixEntryV2(ImageWriter& writer, std::uint32_t dataType, F put) {
+      const auto begin = writer.bytes.size();
+      writer.Put(std::uint32_t{0});
+      writer.Put(std::uint32_t{0});
+      writer.Put(dataType);
+      writer.Put(std::uint32_t{0});
+      put();
+      writer.PutAt(begin, static_cast<std::uint32_t>(writer.bytes.size() - begin));
+    }
+  }
+
+
+  // V1: entry count, length-prefixed entries, rename count and renames, without any alignment
+  // a zero entry size marks an invalid entry, which loaders skip; invalidEntries of them are written before the entries
+  inline std::vector<std::byte> BuildMetadataFileV1(const std::vector<MetadataFileEntry>& entries, const std::vector<MetadataFileRename>& renames, std::size_t invalidEntries = 0) {
+    using namespace metadata_file;
+
+    ImageWriter writer;
+    writer.Put(std::uint32_t{0x00000001});
+    writer.Put(static_cast<std::uint64_t>(entries.size() + invalidEntries));
+    for (std::size_t i = 0; i < invalidEntries; i++) {
+      writer.Put(std::uint32_t{0});
+    }
+    for (const auto& [key, metadata] : entries) {
+      ImageWriter entryWriter;
+      entryWriter.Put(static_cast<std::uint16_t>(GetFlags(metadata)));
+      entryWriter.Put(static_cast<std::uint32_t>(key.size()));
+      entryWriter.PutUTF16(key);
+      if (metadata.fileAttributes) {
+        entryWriter.Put(static_cast<std::uint32_t>(*metadata.fileAttributes));
+      }
+      for (const auto& filetime : {metadata.creationTime, metadata.lastAccessTime, metadata.lastWriteTime}) {
+        if (filetime) {
+          entryWriter.Put(static_cast<std::uint32_t>(filetime->dwLowDateTime));
+          entryWriter.Put(static_cast<std::uint32_t>(filetime->dwHighDateTime));
+        }
+      }
+      if (metadata.security) {
+        entryWriter.Put(static_cast<std::uint32_t>(metadata.security->size()));
+        entryWriter.PutBytes(*metadata.security);
+      }
+
+      writer.Put(static_cast<std::uint32_t>(entryWriter.bytes.size()));
+      writer.bytes.insert(writer.bytes.end(), entryWriter.bytes.begin(), entryWriter.bytes.end());
+    }
+
+    writer.Put(static_cast<std::uint64_t>(renames.size()));
+    for (const auto& [original, renamed] : renames) {
+      writer.Put(static_cast<std::uint32_t>(renamed.size()));
+      writer.Put(static_cast<std::uint32_t>(original.size()));
+      writer.PutUTF16(renamed);
+      writer.PutUTF16(original);
+    }
+
+    return std::move(writer.bytes);
+  }
+
+
+  // V2: the header, the rename section and the metadata section, followed by the appendix of changes made since the last save
+  // the appendix holds the renames first, then the metadata changes
+  inline std::vector<std::byte> BuildMetadataFileV2(const std::vector<MetadataFileEntry>& entries, const std::vector<MetadataFileRename>& renames, const std::vector<MetadataFileEntry>& appendixEntries = {}, const std::vector<MetadataFileRename>& appendixRenames = {}) {
+    using namespace metadata_file;
+
+    constexpr std::size_t HeaderSize = 16 * 5;
+
+    ImageWriter writer;
+    writer.bytes.resize(HeaderSize);
+
+    const std::uint64_t renameSectionOffset = writer.bytes.size();
+    for (const auto& rename : renames) {
+      PutRenameEntryV2(writer, rename);
+    }
+
+    const std::uint64_t metadataSectionOffset = writer.bytes.size();
+    for (const auto& entry : entries) {
+      PutMetadataEntryV2(writer, entry);
+    }
+
+    const std::uint64_t dataSize = writer.bytes.size();
+    for (const auto& rename : appendixRenames) {
+      PutAppendixEntryV2(writer, 1, [&]() { PutRenameEntryV2(writer, rename); });
+    }
+    for (const auto& entry : appendixEntries) {
+      PutAppendixEntryV2(writer, 2, [&]() { PutMetadataEntryV2(writer, entry); });
+    }
+
+    writer.PutAt(0, std::uint32_t{0x444D464D});
+    writer.PutAt(4, std::uint32_t{0x00020000});
+    writer.PutAt(8, dataSize);
+    writer.PutAt(16, renameSectionOffset);
+    writer.PutAt(24, metadataSectionOffset - renameSectionOffset);
+    writer.PutAt(32, static_cast<std::uint64_t>(renames.size()));
+    writer.PutAt(48, metadataSectionOffset);
+    writer.PutAt(56, dataSize - metadataSectionOffset);
+    writer.PutAt(64, static_cast<std::uint64_t>(entries.size()));
+
+    return std::move(writer.bytes);
+  }
+
+
+  inline bool WriteMetadataFile(LPCWSTR filepath, const std::vector<std::byte>& bytes) {
+    const auto handle = CreateFileW(filepath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+    DWORD written = 0;
+    const bool succeeded = WriteFile(handle, bytes.data(), static_cast<DWORD>(bytes.size()), &written, NULL) && written == bytes.size();
+    return CloseHandle(handle) && succeeded;
+  }
+}
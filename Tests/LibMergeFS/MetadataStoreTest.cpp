@@ -0,0 +1,734 @@
+#include "Test.hpp"
+
+#include "CompatFileSystem.hpp"
+#include "MetadataFileFixture.hpp"
+
+#include "../../LibMergeFS/MetadataStore.hpp"
+#include "../../LibMergeFS/MountConfig.hpp"
+#include "../../LibMergeFS/NsError.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std::literals;
+
+
+
+namespace {
+  constexpr auto StorePath = L"C:\\MergeFS\\metadata.dat";
+  constexpr auto TempPath = L"C:\\MergeFS\\metadata.dat.tmp";
+
+  // the workload sets the metadata of KeyCount files over and over; every RenameInterval-th operation renames a file instead
+  // each record carries a large security descriptor so that the appendix reaches MetadataCompactionThreshold after about a hundred operations
+  constexpr std::size_t KeyCount = 8;
+  constexpr std::size_t RenameInterval = 5;
+  constexpr std::size_t SecuritySize = 8192;
+
+
+  std::wstring KeyFilename(std::size_t index) {
+    return L"\\f" + std::to_wstring(index);
+  }
+
+
+  std::wstring RenameSource(std::size_t operation) {
+    return L"\\r" + std::to_wstring(operation);
+  }
+
+
+  std::wstring RenameDestination(std::size_t operation) {
+    return L"\\s" + std::to_wstring(operation);
+  }
+
+
+  std::string SecurityFor(DWORD attributes) {
+    std::string security(SecuritySize, static_cast<char>('a' + attributes % 26));
+    security.replace(0, 10, std::to_string(1000000000 + attributes));
+    return security;
+  }
+
+
+  // the contents of an older metadata file; keys are lowercase, as the case-insensitive store keeps them
+  std::vector<test::MetadataFileEntry> MigrationEntries() {
+    return {
+      {L"\\dir\\file.txt", Metadata{FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_READONLY, FILETIME{0x89ABCDEF, 0x01234567}, FILETIME{2, 0}, FILETIME{3, 0}, "security"s}},
+      {L"\\attributes.txt", Metadata{FILE_ATTRIBUTE_ARCHIVE, {}, {}, {}, {}}},
+      {L"\\times.txt", Metadata{{}, {}, {}, FILETIME{4, 5}, {}}},
+    };
+  }
+
+
+  std::vector<test::MetadataFileRename> MigrationRenames() {
+    return {
+      {L"\\old", L"\\new"},
+      {L"\\dir\\a", L"\\b"},
+    };
+  }
+
+
+  bool EqualsFiletime(const std::optional<FILETIME>& filetime, DWORD lowDateTime, DWORD highDateTime) {
+    return filetime && filetime->dwLowDateTime == lowDateTime && filetime->dwHighDateTime == highDateTime;
+  }
+
+
+  std::uint32_t ReadFileVersion() {
+    const auto bytes = compat::fs::ReadAllBytes(StorePath);
+    std::uint32_t version = 0;
+    if (bytes.size() >= 8) {
+      std::memcpy(&version, bytes.data() + 4, sizeof(version));
+    }
+    return version;
+  }
+
+
+  // checks what the V1 and V2 files have in common
+  void CheckMigratedStore(const MetadataStore& store) {
+    const auto metadata = store.GetMetadata(L"\\Dir\\File.TXT");
+    CHECK(metadata.fileAttributes == static_cast<DWORD>(FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_READONLY));
+    CHECK(EqualsFiletime(metadata.creationTime, 0x89ABCDEF, 0x01234567));
+    CHECK(EqualsFiletime(metadata.lastAccessTime, 2, 0));
+    CHECK(EqualsFiletime(metadata.lastWriteTime, 3, 0));
+    CHECK(metadata.security == "security"s);
+    CHECK(store.ResolveFilepath(L"\\b") == L"\\dir\\a"s);
+    CHECK(!store.HasMetadata(L"\\missing.txt"));
+  }
+
+
+  // what a store should report after some prefix of the workload
+  struct State {
+    std::map<std::size_t, DWORD> attributes;    // key index -> attributes
+    std::set<std::size_t> renamed;              // operations whose rename is visible
+
+    bool operator==(const State& other) const {
+      return attributes == other.attributes && renamed == other.renamed;
+    }
+  };
+
+
+  void RunOperation(MetadataStore& store, std::size_t operation) {
+    if (operation % RenameInterval == RenameInterval - 1) {
+      store.Rename(RenameSource(operation), RenameDestination(operation));
+      return;
+    }
+    const auto attributes = static_cast<DWORD>(operation);
+    Metadata metadata;
+    metadata.fileAttributes = attributes;
+    metadata.security = SecurityFor(attributes);
+    store.SetMetadata(KeyFilename(operation % KeyCount), metadata);
+  }
+
+
+  // expectedStates[k] is the state after the first k operations
+  std::vector<State> BuildExpectedStates(std::size_t operationCount) {
+    std::vector<State> states(1);
+    for (std::size_t operation = 0; operation < operationCount; operation++) {
+      auto state = states.back();
+      if (operation % RenameInterval == RenameInterval - 1) {
+        state.renamed.insert(operation);
+      } else {
+        state.attributes[operation % KeyCount] = static_cast<DWORD>(operation);
+      }
+      states.push_back(std::move(state));
+    }
+    return states;
+  }
+
+
+  // returns std::nullopt if the store reports something no prefix of the workload can produce (e.g. a torn record)
+  std::optional<State> ReadState(const MetadataStore& store, std::size_t operationCount) {
+    State state;
+    for (std::size_t i = 0; i < KeyCount; i++) {
+      const auto metadata = store.GetMetadata2(KeyFilename(i));
+      if (!metadata.fileAttributes) {
+        continue;
+      }
+      if (metadata.security != SecurityFor(metadata.fileAttributes.value())) {
+        return std::nullopt;
+      }
+      state.attributes[i] = metadata.fileAttributes.value();
+    }
+    for (std::size_t operation = RenameInterval - 1; operation < operationCount; operation += RenameInterval) {
+      if (store.ResolveFilepath(RenameDestination(operation)) == RenameSource(operation)) {
+        state.renamed.insert(operation);
+      }
+    }
+    return state;
+  }
+
+
+  // disk contents at a point where the process could have been killed
+  struct CrashImage {
+    compat::fs::Image image;
+    std::size_t completedOperations;    // operations which had returned before the image was taken
+    std::size_t startedOperations;      // operations which had started when the image was taken
+  };
+
+
+  // runs the workload while capturing the disk contents after every change to a file
+  // the background compaction is held after creating its temporary file until the workload has made a few more changes,
+  // so that records are appended between taking the snapshot and replacing the store file
+  class CrashRecorder {
+    static constexpr std::size_t OperationsPerStall = 3;
+
+    const std::thread::id mWorkloadThreadId = std::this_thread::get_id();
+    std::atomic<std::size_t> mCompleted{0};
+    std::atomic<std::size_t> mStarted{0};
+    std::mutex mMutex;
+    std::condition_variable mCV;
+    bool mFinished = false;
+    std::vector<CrashImage> mImages;
+
+    void Stall() {
+      std::unique_lock lock(mMutex);
+      const std::size_t resumeAt = mCompleted + OperationsPerStall;
+      mCV.wait_for(lock, 1s, [this, resumeAt]() {
+        return mFinished || mCompleted >= resumeAt;
+      });
+    }
+
+  public:
+    CrashRecorder() {
+      compat::fs::SetMutationHook([this](compat::fs::Operation operation, std::wstring_view path) {
+        if (operation == compat::fs::Operation::Create && path == TempPath && std::this_thread::get_id() != mWorkloadThreadId) {
+          Stall();
+        }
+        const std::size_t completed = mCompleted;
+        auto image = compat::fs::CaptureImage();
+        const std::size_t started = mStarted;
+        std::lock_guard lock(mMutex);
+        mImages.push_back(CrashImage{std::move(image), completed, started});
+      });
+    }
+
+    ~CrashRecorder() {
+      compat::fs::SetMutationHook(nullptr);
+    }
+
+    void Run(MetadataStore& store, std::size_t operation) {
+      mStarted = operation + 1;
+      RunOperation(store, operation);
+      {
+        std::lock_guard lock(mMutex);
+        mCompleted = operation + 1;
+      }
+      mCV.notify_all();
+    }
+
+    // stops holding the compaction once the workload is done
+    void Finish() {
+      {
+        std::lock_guard lock(mMutex);
+        mFinished = true;
+      }
+      mCV.notify_all();
+    }
+
+    std::vector<CrashImage> TakeImages() {
+      std::lock_guard lock(mMutex);
+      return std::move(mImages);
+    }
+  };
+
+
+  // every image must load, and show a state between the operations completed and started when it was taken
+  void CheckCrashImages(const std::vector<CrashImage>& images, const std::vector<State>& expectedStates) {
+    const auto operationCount = expectedStates.size() - 1;
+    for (std::size_t i = 0; i < images.size(); i++) {
+      const auto& crashImage = images[i];
+      compat::fs::RestoreImage(crashImage.image);
+
+      std::optional<State> state;
+      try {
+        MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+        state = ReadState(store, operationCount);
+      } catch (const W32Error& error) {
+        CHECK_MESSAGE(false, "image " << i << " (after " << crashImage.completedOperations << " operations) failed to load with error " << error.GetError());
+      }
+      CHECK_MESSAGE(state.has_value(), "image " << i << " contains a record no operation wrote");
+
+      bool matched = false;
+      for (auto k = crashImage.completedOperations; k <= crashImage.startedOperations && !matched; k++) {
+        matched = state.value() == expectedStates[k];
+      }
+      CHECK_MESSAGE(matched, "image " << i << " does not match the state after " << crashImage.completedOperations << " to " << crashImage.startedOperations << " operations");
+    }
+  }
+
+
+  // waits until the background compaction has replaced the store file at least count times
+  bool WaitForCompactions(std::size_t count) {
+    const auto deadline = std::chrono::steady_clock::now() + 10s;
+    while (compat::fs::GetOperationCount(compat::fs::Operation::Move) < count) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        return false;
+      }
+      std::this_thread::sleep_for(1ms);
+    }
+    return true;
+  }
+
+
+  void CheckFinalState(std::size_t operationCount) {
+    const auto expectedStates = BuildExpectedStates(operationCount);
+    MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+    const auto state = ReadState(store, operationCount);
+    CHECK(state.has_value());
+    CHECK(state.value() == expectedStates.back());
+  }
+}
+
+
+TEST_CASE(PersistsAcrossReopen) {
+  compat::fs::Reset();
+
+  {
+    MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+    Metadata metadata;
+    metadata.fileAttributes = FILE_ATTRIBUTE_HIDDEN;
+    metadata.security = "security";
+    store.SetMetadata(L"\\Dir\\File.txt", metadata);
+    store.SetMetadata(L"\\Removed.txt", metadata);
+    CHECK(store.RemoveMetadata(L"\\Removed.txt"));
+    store.Rename(L"\\Old", L"\\New");
+  }
+
+  // the clean shutdown merges the appendix into the indexed part
+  CHECK(!compat::fs::Exists(TempPath));
+
+  MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+  // keys are case-insensitive
+  CHECK(store.HasMetadata(L"\\DIR\\file.TXT"));
+  CHECK(store.GetMetadata(L"\\Dir\\File.txt").fileAttributes == FILE_ATTRIBUTE_HIDDEN);
+  CHECK(store.GetMetadata(L"\\Dir\\File.txt").security == "security"s);
+  CHECK(!store.HasMetadata(L"\\Removed.txt"));
+  CHECK(store.ResolveFilepath(L"\\New") == L"\\Old"s);
+  CHECK_THROWS(store.GetMetadata(L"\\Missing"), W32Error);
+}
+
+
+// a leftover temporary file of an interrupted compaction is discarded and the original file is used
+TEST_CASE(DiscardsLeftoverTemporaryFile) {
+  compat::fs::Reset();
+
+  {
+    MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+    store.SetMetadata(L"\\a", Metadata{FILE_ATTRIBUTE_READONLY, {}, {}, {}, {}});
+  }
+
+  const auto handle = CreateFileW(TempPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  DWORD written = 0;
+  CHECK(WriteFile(handle, "garbage", 7, &written, NULL));
+  CHECK(CloseHandle(handle));
+
+  MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+  CHECK(!compat::fs::Exists(TempPath));
+  CHECK(store.GetMetadata(L"\\a").fileAttributes == FILE_ATTRIBUTE_READONLY);
+}
+
+
+// a V1 file is loaded and rewritten in the current format
+TEST_CASE(MigratesFromV1) {
+  compat::fs::Reset();
+  CHECK(test::WriteMetadataFile(StorePath, test::BuildMetadataFileV1(MigrationEntries(), MigrationRenames(), 2)));
+
+  for (int i = 0; i < 2; i++) {
+    MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+    CHECK(ReadFileVersion() == 0x00030000);
+    CheckMigratedStore(store);
+    CHECK(store.GetMetadata(L"\\attributes.txt").fileAttributes == static_cast<DWORD>(FILE_ATTRIBUTE_ARCHIVE));
+    CHECK(!store.GetMetadata(L"\\attributes.txt").security);
+    CHECK(!store.GetMetadata(L"\\times.txt").fileAttributes);
+    CHECK(EqualsFiletime(store.GetMetadata(L"\\times.txt").lastWriteTime, 4, 5));
+    CHECK(store.ResolveFilepath(L"\\new") == L"\\old"s);
+  }
+}
+
+
+// a V2 file is loaded together with its appendix and rewritten in the current format
+TEST_CASE(MigratesFromV2) {
+  compat::fs::Reset();
+  const std::vector<test::MetadataFileEntry> appendixEntries{
+    {L"\\attributes.txt", Metadata{}},
+    {L"\\times.txt", Metadata{FILE_ATTRIBUTE_SYSTEM, {}, {}, {}, {}}},
+  };
+  const std::vector<test::MetadataFileRename> appendixRenames{
+    {L"\\new", L"\\newer"},
+  };
+  CHECK(test::WriteMetadataFile(StorePath, test::BuildMetadataFileV2(MigrationEntries(), MigrationRenames(), appendixEntries, appendixRenames)));
+
+  for (int i = 0; i < 2; i++) {
+    MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+    CHECK(ReadFileVersion() == 0x00030000);
+    CheckMigratedStore(store);
+    CHECK(!store.HasMetadata(L"\\attributes.txt"));
+    CHECK(store.GetMetadata(L"\\times.txt").fileAttributes == static_cast<DWORD>(FILE_ATTRIBUTE_SYSTEM));
+    CHECK(!store.GetMetadata(L"\\times.txt").lastWriteTime);
+    CHECK(store.ResolveFilepath(L"\\newer") == L"\\old"s);
+  }
+}
+
+
+// kills the process after every single change to the disk, including in the middle of background compactions
+TEST_CASE(CompactionSurvivesCrashAtAnyPoint) {
+  constexpr std::size_t OperationCount = 400;
+
+  compat::fs::Reset();
+  // the recorder outlives the store, so the clean shutdown is covered as well
+  CrashRecorder recorder;
+  {
+    MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+    for (std::size_t operation = 0; operation < OperationCount; operation++) {
+      recorder.Run(store, operation);
+    }
+    recorder.Finish();
+    // the initial file counts as one replacement
+    CHECK(WaitForCompactions(3));
+  }
+  const auto images = recorder.TakeImages();
+  CHECK(images.size() > OperationCount);
+
+  CheckCrashImages(images, BuildExpectedStates(OperationCount));
+}
+
+
+// failures of the compaction (creating, writing or flushing the temporary file, or replacing the store file) must not lose records
+TEST_CASE(CompactionSurvivesFailures) {
+  constexpr std::size_t OperationCount = 400;
+
+  compat::fs::Reset();
+  std::atomic<std::size_t> attempts{0};
+  std::atomic<std::size_t> injected{0};
+  CrashRecorder recorder;
+  {
+    MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+
+    // fail two out of every three steps of a compaction
+    compat::fs::SetFaultHook([&](compat::fs::Operation operation, std::wstring_view path) -> DWORD {
+      const bool compactionStep = operation == compat::fs::Operation::Move || path == TempPath;
+      if (!compactionStep || attempts++ % 3 == 0) {
+        return ERROR_SUCCESS;
+      }
+      injected++;
+      return operation == compat::fs::Operation::Move ? ERROR_ACCESS_DENIED : ERROR_DISK_FULL;
+    });
+
+    for (std::size_t operation = 0; operation < OperationCount; operation++) {
+      recorder.Run(store, operation);
+    }
+    recorder.Finish();
+
+    compat::fs::SetFaultHook(nullptr);
+  }
+  CHECK(injected > 0);
+  const auto images = recorder.TakeImages();
+  const auto finalImage = compat::fs::CaptureImage();
+
+  CheckCrashImages(images, BuildExpectedStates(OperationCount));
+
+  // the clean shutdown must have written everything
+  compat::fs::RestoreImage(finalImage);
+  CheckFinalState(OperationCount);
+}
+
+
+// a clean shutdown after failed compactions writes every record
+TEST_CASE(ShutdownAfterFailedCompactionsKeepsEverything) {
+  constexpr std::size_t OperationCount = 300;
+
+  compat::fs::Reset();
+  {
+    MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+    compat::fs::SetFaultHook([](compat::fs::Operation operation, std::wstring_view) -> DWORD {
+      return operation == compat::fs::Operation::Move ? ERROR_ACCESS_DENIED : ERROR_SUCCESS;
+    });
+    for (std::size_t operation = 0; operation < OperationCount; operation++) {
+      RunOperation(store, operation);
+    }
+    compat::fs::SetFaultHook(nullptr);
+  }
+
+  CheckFinalState(OperationCount);
+}
+
+
+// in the batched mode only the flushes are deferred; every record reaches the OS before the operation returns
+TEST_CASE(BatchedSurvivesProcessCrashAtAnyPoint) {
+  constexpr std::size_t OperationCount = 400;
+
+  compat::fs::Reset();
+  CrashRecorder recorder;
+  {
+    MetadataStore store(StorePath, false, MetadataStore::Durability::Batched, 5ms);
+    for (std::size_t operation = 0; operation < OperationCount; operation++) {
+      recorder.Run(store, operation);
+    }
+    recorder.Finish();
+    // the workload runs faster without flushes, so only one compaction after the initial file is guaranteed to fall within it
+    CHECK(WaitForCompactions(2));
+  }
+  const auto images = recorder.TakeImages();
+  CHECK(images.size() > OperationCount);
+
+  CheckCrashImages(images, BuildExpectedStates(OperationCount));
+}
+
+
+TEST_CASE(BatchedWritesBeforeReturning) {
+  compat::fs::Reset();
+
+  compat::fs::Image image;
+  {
+    // the background flush does not come within the test
+    MetadataStore store(StorePath, false, MetadataStore::Durability::Batched, 1h);
+    store.SetMetadata(L"\\a", Metadata{FILE_ATTRIBUTE_READONLY, {}, {}, {}, {}});
+    store.Rename(L"\\b", L"\\c");
+    image = compat::fs::CaptureImage();
+    CHECK(compat::fs::IsDirty(StorePath));
+  }
+
+  compat::fs::RestoreImage(image);
+  MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+  CHECK(store.GetMetadata(L"\\a").fileAttributes == FILE_ATTRIBUTE_READONLY);
+  CHECK(store.ResolveFilepath(L"\\c") == L"\\b"s);
+}
+
+
+// records written within the commit delay are flushed together
+TEST_CASE(BatchedFlushesWithinCommitDelay) {
+  constexpr std::size_t RecordCount = 10;
+
+  compat::fs::Reset();
+  MetadataStore store(StorePath, false, MetadataStore::Durability::Batched, 100ms);
+  const auto flushesBefore = compat::fs::GetOperationCount(compat::fs::Operation::Flush);
+  for (std::size_t i = 0; i < RecordCount; i++) {
+    store.SetMetadata(KeyFilename(i), Metadata{static_cast<DWORD>(i + 1), {}, {}, {}, {}});
+  }
+
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (compat::fs::IsDirty(StorePath) && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  CHECK(!compat::fs::IsDirty(StorePath));
+  CHECK(compat::fs::GetOperationCount(compat::fs::Operation::Flush) - flushesBefore < RecordCount);
+}
+
+
+// concurrent operations of the per-operation mode are flushed together; a thread waiting for a flush does not hold the store lock
+TEST_CASE(PerOperationGroupsConcurrentFlushes) {
+  constexpr std::size_t ThreadCount = 8;
+  constexpr std::size_t OperationCount = 50;
+
+  compat::fs::Reset();
+  {
+    MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+    std::atomic<std::size_t> flushing{0};
+    std::atomic<std::size_t> flushesCompleted{0};
+    std::atomic<std::size_t> readsDuringFlush{0};
+    compat::fs::SetFaultHook([&](compat::fs::Operation operation, std::wstring_view) -> DWORD {
+      if (operation == compat::fs::Operation::Flush) {
+        flushing++;
+        std::this_thread::sleep_for(2ms);
+        flushesCompleted++;
+        flushing--;
+      }
+      return ERROR_SUCCESS;
+    });
+    const auto flushesBefore = compat::fs::GetOperationCount(compat::fs::Operation::Flush);
+
+    std::atomic<bool> finished{false};
+    std::thread reader([&]() {
+      while (!finished) {
+        // a read which starts and ends within the same flush
+        const bool flushingBefore = flushing > 0;
+        const std::size_t completedBefore = flushesCompleted;
+        store.HasMetadata(KeyFilename(0));
+        if (flushingBefore && flushesCompleted == completedBefore) {
+          readsDuringFlush++;
+        }
+        std::this_thread::yield();
+      }
+    });
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < ThreadCount; t++) {
+      threads.emplace_back([&store, t]() {
+        for (std::size_t i = 0; i < OperationCount; i++) {
+          store.SetMetadata(L"\\t" + std::to_wstring(t) + L"\\f" + std::to_wstring(i), Metadata{static_cast<DWORD>(i + 1), {}, {}, {}, {}});
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    finished = true;
+    reader.join();
+    compat::fs::SetFaultHook(nullptr);
+
+    CHECK(!compat::fs::IsDirty(StorePath));
+    const auto flushes = compat::fs::GetOperationCount(compat::fs::Operation::Flush) - flushesBefore;
+    CHECK_MESSAGE(flushes < ThreadCount * OperationCount, flushes << " flushes for " << ThreadCount * OperationCount << " operations");
+    CHECK(readsDuringFlush > 0);
+  }
+
+  MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+  for (std::size_t t = 0; t < ThreadCount; t++) {
+    for (std::size_t i = 0; i < OperationCount; i++) {
+      CHECK(store.GetMetadata(L"\\t" + std::to_wstring(t) + L"\\f" + std::to_wstring(i)).fileAttributes == static_cast<DWORD>(i + 1));
+    }
+  }
+}
+
+
+// changes made while a DeferredCommit exists are written by its Commit, after the caller has released its own lock
+TEST_CASE(DeferredCommitWritesOnCommit) {
+  compat::fs::Reset();
+
+  MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+  const auto sizeBefore = compat::fs::ReadAllBytes(StorePath).size();
+  {
+    MetadataStore::DeferredCommit deferredCommit(store);
+    store.SetMetadata(L"\\a", Metadata{FILE_ATTRIBUTE_READONLY, {}, {}, {}, {}});
+    store.Rename(L"\\b", L"\\c");
+    CHECK(compat::fs::ReadAllBytes(StorePath).size() == sizeBefore);
+
+    deferredCommit.Commit();
+    CHECK(compat::fs::ReadAllBytes(StorePath).size() > sizeBefore);
+    CHECK(!compat::fs::IsDirty(StorePath));
+
+    // changes after Commit are written right away
+    const auto sizeAfterCommit = compat::fs::ReadAllBytes(StorePath).size();
+    store.SetMetadata(L"\\d", Metadata{FILE_ATTRIBUTE_HIDDEN, {}, {}, {}, {}});
+    CHECK(compat::fs::ReadAllBytes(StorePath).size() > sizeAfterCommit);
+  }
+
+  // the destructor commits if Commit was not called, e.g. when an exception is thrown
+  const auto sizeBeforeDestruction = compat::fs::ReadAllBytes(StorePath).size();
+  {
+    MetadataStore::DeferredCommit deferredCommit(store);
+    store.SetMetadata(L"\\e", Metadata{FILE_ATTRIBUTE_SYSTEM, {}, {}, {}, {}});
+    CHECK(compat::fs::ReadAllBytes(StorePath).size() == sizeBeforeDestruction);
+  }
+  CHECK(compat::fs::ReadAllBytes(StorePath).size() > sizeBeforeDestruction);
+  CHECK(!compat::fs::IsDirty(StorePath));
+}
+
+
+TEST_CASE(FlushMakesRecordsDurable) {
+  for (const auto durability : {MetadataStore::Durability::PerOperation, MetadataStore::Durability::Batched, MetadataStore::Durability::OnFlush}) {
+    compat::fs::Reset();
+
+    compat::fs::Image image;
+    {
+      MetadataStore store(StorePath, false, durability, 1h);
+      const auto sizeBefore = compat::fs::ReadAllBytes(StorePath).size();
+      store.SetMetadata(L"\\a", Metadata{FILE_ATTRIBUTE_READONLY, {}, {}, {}, {}});
+      store.Rename(L"\\b", L"\\c");
+      // only the on-flush mode keeps the records in memory
+      CHECK((compat::fs::ReadAllBytes(StorePath).size() == sizeBefore) == (durability == MetadataStore::Durability::OnFlush));
+
+      store.Flush();
+      CHECK(!compat::fs::IsDirty(StorePath));
+      image = compat::fs::CaptureImage();
+    }
+
+    compat::fs::RestoreImage(image);
+    MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+    CHECK(store.GetMetadata(L"\\a").fileAttributes == FILE_ATTRIBUTE_READONLY);
+    CHECK(store.ResolveFilepath(L"\\c") == L"\\b"s);
+  }
+}
+
+
+
+// records of the on-flush mode which are still buffered when a compaction replaces the store file have to be written before the tail is copied;
+// otherwise they end up in the new appendix without being counted, and the next compaction copies its tail from a wrong offset
+// compactions alternately replace the file while the workload waits with a record buffered (no tail) and after the workload has appended more records (a tail)
+TEST_CASE(OnFlushCompactionKeepsBufferedRecords) {
+  constexpr std::size_t OperationCount = 1000;
+  constexpr std::size_t FlushInterval = 3;
+  constexpr std::size_t OperationsPerStall = 5;
+
+  compat::fs::Reset();
+
+  const auto workloadThreadId = std::this_thread::get_id();
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::size_t completed = 0;
+  std::size_t compactionCount = 0;
+  bool compacting = false;
+  bool finished = false;
+  compat::fs::SetMutationHook([&](compat::fs::Operation operation, std::wstring_view path) {
+    std::unique_lock lock(mutex);
+    if (operation == compat::fs::Operation::Create && path == TempPath && std::this_thread::get_id() != workloadThreadId) {
+      compacting = true;
+      if (compactionCount++ % 2 == 1) {
+        const auto resumeAt = completed + OperationsPerStall;
+        cv.wait_for(lock, 1s, [&]() {
+          return finished || completed >= resumeAt;
+        });
+      }
+    } else if (operation == compat::fs::Operation::Move) {
+      compacting = false;
+      cv.notify_all();
+    }
+  });
+
+  // images taken right after Flush returned, with the number of operations they must contain
+  std::vector<std::pair<compat::fs::Image, std::size_t>> images;
+  {
+    MetadataStore store(StorePath, false, MetadataStore::Durability::OnFlush);
+    for (std::size_t operation = 0; operation < OperationCount; operation++) {
+      RunOperation(store, operation);
+
+      // lets a compaction requested by this operation take its snapshot, and waits for it unless it is being held
+      std::this_thread::sleep_for(1ms);
+      {
+        std::unique_lock lock(mutex);
+        completed = operation + 1;
+        cv.notify_all();
+        cv.wait_for(lock, 1s, [&]() {
+          return !compacting || compactionCount % 2 == 0;
+        });
+      }
+
+      if ((operation + 1) % FlushInterval == 0) {
+        store.Flush();
+        images.emplace_back(compat::fs::CaptureImage(), operation + 1);
+      }
+    }
+    {
+      std::lock_guard lock(mutex);
+      finished = true;
+      CHECK(compactionCount >= 4);
+    }
+    cv.notify_all();
+  }
+  compat::fs::SetMutationHook(nullptr);
+  const auto finalImage = compat::fs::CaptureImage();
+
+  const auto expectedStates = BuildExpectedStates(OperationCount);
+  for (const auto& [image, completedOperations] : images) {
+    compat::fs::RestoreImage(image);
+    std::optional<State> state;
+    try {
+      MetadataStore store(StorePath, false, MetadataStore::Durability::PerOperation);
+      state = ReadState(store, OperationCount);
+    } catch (const W32Error& error) {
+      CHECK_MESSAGE(false, "image after " << completedOperations << " operations failed to load with error " << error.GetError());
+    }
+    CHECK_MESSAGE(state && state.value() == expectedStates[completedOperations], "image after " << completedOperations << " operations lost records");
+  }
+
+  compat::fs::RestoreImage(finalImage);
+  CheckFinalState(OperationCount);
+}
@@ -0,0 +1,176 @@
+#include "Test.hpp"
+
+#include "../../LibMergeFS/PathCache.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::literals;
+
+
+
+TEST_CASE(GetReturnsPutValue) {
+  PathCache<int> cache(16);
+  CHECK(!cache.Get(L"\\a"));
+  cache.Put(L"\\a", 1, cache.GetGeneration());
+  CHECK(cache.Get(L"\\a") == 1);
+
+  const auto statistics = cache.GetStatistics();
+  CHECK(statistics.entries == 1);
+  CHECK(statistics.hits == 1);
+  CHECK(statistics.misses == 1);
+}
+
+
+TEST_CASE(PutReplacesExistingEntry) {
+  PathCache<int> cache(16);
+  cache.Put(L"\\a", 1, cache.GetGeneration(), 3);
+  cache.Put(L"\\a", 2, cache.GetGeneration(), 5);
+  CHECK(cache.Get(L"\\a") == 2);
+  CHECK(cache.GetStatistics().entries == 1);
+  CHECK(cache.GetStatistics().cost == 5);
+}
+
+
+TEST_CASE(LeastRecentlyUsedIsEvicted) {
+  PathCache<int> cache(3);
+  cache.Put(L"\\a", 1, cache.GetGeneration());
+  cache.Put(L"\\b", 2, cache.GetGeneration());
+  cache.Put(L"\\c", 3, cache.GetGeneration());
+  CHECK(cache.Get(L"\\a") == 1);
+  cache.Put(L"\\d", 4, cache.GetGeneration());
+
+  CHECK(!cache.Get(L"\\b"));
+  CHECK(cache.Get(L"\\a") == 1);
+  CHECK(cache.Get(L"\\c") == 3);
+  CHECK(cache.Get(L"\\d") == 4);
+}
+
+
+TEST_CASE(CostBoundsCapacity) {
+  PathCache<int> cache(10);
+  cache.Put(L"\\a", 1, cache.GetGeneration(), 4);
+  cache.Put(L"\\b", 2, cache.GetGeneration(), 4);
+  cache.Put(L"\\c", 3, cache.GetGeneration(), 4);
+  CHECK(cache.GetStatistics().cost <= 10);
+  CHECK(!cache.Get(L"\\a"));
+
+  // larger than the whole capacity: never stored
+  cache.Put(L"\\huge", 4, cache.GetGeneration(), 11);
+  CHECK(!cache.Get(L"\\huge"));
+}
+
+
+TEST_CASE(StaleGenerationIsNotStored) {
+  PathCache<int> cache(16);
+  const auto generation = cache.GetGeneration();
+  cache.InvalidateEntry(L"\\a");
+  cache.Put(L"\\a", 1, generation);
+  CHECK(!cache.Get(L"\\a"));
+}
+
+
+TEST_CASE(ExpiredEntryIsMissed) {
+  PathCache<int> cache(16, 20ms);
+  cache.Put(L"\\a", 1, cache.GetGeneration());
+  CHECK(cache.Get(L"\\a") == 1);
+  std::this_thread::sleep_for(40ms);
+  CHECK(!cache.Get(L"\\a"));
+  CHECK(cache.GetStatistics().entries == 0);
+}
+
+
+TEST_CASE(DisabledCacheStoresNothing) {
+  PathCache<int> cache(0);
+  CHECK(!cache.IsEnabled());
+  cache.Put(L"\\a", 1, cache.GetGeneration());
+  CHECK(!cache.Get(L"\\a"));
+}
+
+
+TEST_CASE(InvalidateRemovesDescendantsOnly) {
+  PathCache<int> cache(64);
+  for (const auto key : {L"\\a", L"\\a\\b", L"\\a\\b\\c", L"\\a\\bc", L"\\ab", L"\\a.b", L"\\a]", L"\\a[", L"\\b", L"\\b\\a"}) {
+    cache.Put(key, 1, cache.GetGeneration(), 2);
+  }
+
+  cache.Invalidate(L"\\a");
+
+  CHECK(!cache.Get(L"\\a"));
+  CHECK(!cache.Get(L"\\a\\b"));
+  CHECK(!cache.Get(L"\\a\\b\\c"));
+  CHECK(!cache.Get(L"\\a\\bc"));
+  CHECK(cache.Get(L"\\ab"));
+  CHECK(cache.Get(L"\\a.b"));
+  CHECK(cache.Get(L"\\a]"));
+  CHECK(cache.Get(L"\\a["));
+  CHECK(cache.Get(L"\\b"));
+  CHECK(cache.Get(L"\\b\\a"));
+  CHECK(cache.GetStatistics().entries == 6);
+  CHECK(cache.GetStatistics().cost == 12);
+}
+
+
+TEST_CASE(InvalidateRootClearsEverything) {
+  PathCache<int> cache(16);
+  cache.Put(L"\\a", 1, cache.GetGeneration());
+  cache.Put(L"\\b\\c", 1, cache.GetGeneration());
+  cache.Invalidate(L"\\");
+  CHECK(cache.GetStatistics().entries == 0);
+  CHECK(cache.GetStatistics().cost == 0);
+}
+
+
+TEST_CASE(InvalidateEntryKeepsDescendants) {
+  PathCache<int> cache(16);
+  cache.Put(L"\\a", 1, cache.GetGeneration());
+  cache.Put(L"\\a\\b", 2, cache.GetGeneration());
+  cache.InvalidateEntry(L"\\a");
+  CHECK(!cache.Get(L"\\a"));
+  CHECK(cache.Get(L"\\a\\b") == 2);
+}
+
+
+// compares the range-based subtree invalidation against a brute-force model
+TEST_CASE(InvalidateMatchesModel) {
+  std::mt19937 engine(12345);
+  const std::vector<std::wstring> components{L"a", L"b", L"ab", L"a b", L"a.b", L"[", L"]", L"~"};
+
+  const auto randomPath = [&]() {
+    std::wstring path;
+    const auto depth = std::uniform_int_distribution<int>(1, 4)(engine);
+    for (int i = 0; i < depth; i++) {
+      path += L"\\" + components[std::uniform_int_distribution<std::size_t>(0, components.size() - 1)(engine)];
+    }
+    return path;
+  };
+
+  PathCache<int> cache(1 << 20);
+  std::set<std::wstring> model;
+  for (int iteration = 0; iteration < 5000; iteration++) {
+    const auto path = randomPath();
+    if (std::uniform_int_distribution<int>(0, 3)(engine) != 0) {
+      cache.Put(path, 0, cache.GetGeneration());
+      model.insert(path);
+    } else {
+      cache.Invalidate(path);
+      for (auto itr = model.begin(); itr != model.end(); ) {
+        if (*itr == path || itr->rfind(path + L"\\", 0) == 0) {
+          itr = model.erase(itr);
+        } else {
+          ++itr;
+        }
+      }
+    }
+  }
+
+  CHECK(cache.GetStatistics().entries == model.size());
+  for (const auto& path : model) {
+    CHECK(cache.Get(path));
+  }
+}
@@ -0,0 +1,139 @@
+#include "Test.hpp"
+
+#include "../../LibMergeFS/PathPool.hpp"
+
+#include <cstddef>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+
+
+
+TEST_CASE(InternSharesEntries) {
+  PathPool pool;
+  {
+    const auto a = pool.Intern(L"\\dir\\file.txt");
+    const auto b = pool.Intern(L"\\dir\\file.txt"s);
+    const auto c = pool.Intern(L"\\dir\\other.txt");
+
+    CHECK(a.c_str() == b.c_str());
+    CHECK(a.c_str() != c.c_str());
+    CHECK(std::wstring_view(a) == L"\\dir\\file.txt"sv);
+    CHECK(a.size() == 13);
+
+    const auto statistics = pool.GetStatistics();
+    CHECK(statistics.entries == 2);
+    CHECK(statistics.hits == 1);
+    CHECK(statistics.misses == 2);
+    CHECK(statistics.bytes > 0);
+  }
+
+  // the last handle removes the entry
+  const auto statistics = pool.GetStatistics();
+  CHECK(statistics.entries == 0);
+  CHECK(statistics.bytes == 0);
+}
+
+
+TEST_CASE(InternKeepsCase) {
+  PathPool pool;
+  const auto upper = pool.Intern(L"\\Dir\\File");
+  const auto lower = pool.Intern(L"\\dir\\file");
+  CHECK(upper.c_str() != lower.c_str());
+  CHECK(static_cast<const std::wstring&>(upper) == L"\\Dir\\File"s);
+  CHECK(pool.GetStatistics().entries == 2);
+}
+
+
+TEST_CASE(HandleCopyAndMove) {
+  PathPool pool;
+  PooledPath empty;
+  CHECK(empty.empty());
+  CHECK(empty.c_str() == L""sv);
+
+  auto a = pool.Intern(L"\\a");
+  PooledPath b = a;
+  PooledPath c = std::move(a);
+  CHECK(b.c_str() == c.c_str());
+  CHECK(pool.GetStatistics().entries == 1);
+
+  b = PooledPath();
+  CHECK(pool.GetStatistics().entries == 1);
+  c = pool.Intern(L"\\b");
+  CHECK(pool.GetStatistics().entries == 1);
+  CHECK(std::wstring_view(c) == L"\\b"sv);
+  c = c;
+  CHECK(std::wstring_view(c) == L"\\b"sv);
+}
+
+
+// many paths spread over the shards stay counted once each
+TEST_CASE(ManyPathsStatistics) {
+  PathPool pool;
+  std::vector<PooledPath> handles;
+  for (int i = 0; i < 10000; i++) {
+    handles.push_back(pool.Intern(L"\\dir" + std::to_wstring(i % 100) + L"\\file" + std::to_wstring(i)));
+  }
+  for (int i = 0; i < 10000; i += 2) {
+    handles.push_back(pool.Intern(L"\\dir" + std::to_wstring(i % 100) + L"\\file" + std::to_wstring(i)));
+  }
+
+  auto statistics = pool.GetStatistics();
+  CHECK(statistics.entries == 10000);
+  CHECK(statistics.misses == 10000);
+  CHECK(statistics.hits == 5000);
+
+  handles.resize(10000);
+  CHECK(pool.GetStatistics().entries == 10000);
+  handles.clear();
+  statistics = pool.GetStatistics();
+  CHECK(statistics.entries == 0);
+  CHECK(statistics.bytes == 0);
+}
+
+
+// threads intern, copy and drop an overlapping set of paths; entries must be shared while alive and all gone at the end
+TEST_CASE(ConcurrentInternAndRelease) {
+  constexpr int ThreadCount = 8;
+  constexpr int PathCount = 256;
+
+  PathPool pool;
+  std::vector<std::thread> threads;
+  std::vector<int> failures(ThreadCount, 0);
+  for (int t = 0; t < ThreadCount; t++) {
+    threads.emplace_back([&pool, &failures, t]() {
+      std::mt19937 engine(t);
+      std::uniform_int_distribution<int> distribution(0, PathCount - 1);
+      std::vector<PooledPath> held(16);
+      for (int i = 0; i < 50000; i++) {
+        const auto index = distribution(engine);
+        const auto path = L"\\p\\" + std::to_wstring(index);
+        auto handle = pool.Intern(path);
+        if (std::wstring_view(handle) != path) {
+          failures[t]++;
+        }
+        auto& slot = held[static_cast<std::size_t>(index) % held.size()];
+        if (std::wstring_view(slot) == std::wstring_view(handle) && slot.c_str() != handle.c_str()) {
+          failures[t]++;
+        }
+        slot = (i % 3 == 0) ? std::move(handle) : handle;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (const auto failure : failures) {
+    CHECK(failure == 0);
+  }
+  const auto statistics = pool.GetStatistics();
+  CHECK(statistics.entries == 0);
+  CHECK(statistics.bytes == 0);
+  CHECK(statistics.hits + statistics.misses == ThreadCount * 50000);
+}
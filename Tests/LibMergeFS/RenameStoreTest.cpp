@@ -0,0 +1,245 @@
+#include "Test.hpp"
+
+#include "../../LibMergeFS/RenameStore.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+
+
+
+namespace {
+  bool IsSameOrDescendant(std::wstring_view path, std::wstring_view ancestor) {
+    return path.size() >= ancestor.size() && path.substr(0, ancestor.size()) == ancestor && (path.size() == ancestor.size() || path[ancestor.size()] == L'\\');
+  }
+
+
+  std::wstring SwapCase(std::wstring_view str) {
+    std::wstring result(str);
+    for (auto& c : result) {
+      if (L'a' <= c && c <= L'z') {
+        c = c - L'a' + L'A';
+      } else if (L'A' <= c && c <= L'Z') {
+        c = c - L'A' + L'a';
+      }
+    }
+    return result;
+  }
+
+
+  // a file tree which only knows where each current path originally came from
+  // paths are renamed only to fresh names, as the mount does after checking the destination does not exist
+  class ReferenceTree {
+    std::map<std::wstring, std::wstring> mOriginals;    // current path -> original path
+
+  public:
+    ReferenceTree() {
+      for (int d = 0; d < 6; d++) {
+        const auto dir = L"\\d"s + std::to_wstring(d);
+        mOriginals.emplace(dir, dir);
+        mOriginals.emplace(dir + L"\\sub", dir + L"\\sub");
+        for (int f = 0; f < 3; f++) {
+          const auto file = L"\\f"s + std::to_wstring(f);
+          mOriginals.emplace(dir + file, dir + file);
+          mOriginals.emplace(dir + L"\\sub" + file, dir + L"\\sub" + file);
+        }
+      }
+    }
+
+    const std::map<std::wstring, std::wstring>& GetOriginals() const {
+      return mOriginals;
+    }
+
+    void Rename(const std::wstring& source, const std::wstring& destination) {
+      std::vector<std::pair<std::wstring, std::wstring>> moved;
+      for (auto itr = mOriginals.begin(); itr != mOriginals.end(); ) {
+        if (IsSameOrDescendant(itr->first, source)) {
+          moved.emplace_back(destination + itr->first.substr(source.size()), itr->second);
+          itr = mOriginals.erase(itr);
+        } else {
+          ++itr;
+        }
+      }
+      mOriginals.insert(moved.begin(), moved.end());
+    }
+  };
+
+
+  // every current path must resolve to where it came from
+  void CheckResolvesAll(const RenameStore& store, const ReferenceTree& reference, bool caseSensitive, int iteration) {
+    const CaseSensitivity::CiEqualTo equalTo(caseSensitive);
+    for (const auto& [current, original] : reference.GetOriginals()) {
+      const auto resolved = store.Resolve(current);
+      CHECK_MESSAGE(resolved && *resolved == original, "a path resolves wrongly after " << iteration << " renames");
+      CHECK_MESSAGE(store.Exists(current) != false, "a current path is reported as renamed after " << iteration << " renames");
+      if (!caseSensitive) {
+        const auto resolvedSwapped = store.Resolve(SwapCase(current));
+        CHECK_MESSAGE(resolvedSwapped && equalTo(*resolvedSwapped, original), "a case-swapped path resolves wrongly after " << iteration << " renames");
+      }
+    }
+  }
+}
+
+
+TEST_CASE(RenameFile) {
+  RenameStore store(false);
+  CHECK(store.Rename(L"\\a", L"\\b") == RenameStore::Result::Success);
+
+  CHECK(store.Resolve(L"\\b") == L"\\a"s);
+  CHECK(store.Resolve(L"\\a") == std::nullopt);
+  CHECK(store.Resolve(L"\\c") == L"\\c"s);
+  CHECK(store.Resolve(L"\\") == L"\\"s);
+  CHECK(store.Exists(L"\\b") == true);
+  CHECK(store.Exists(L"\\a") == false);
+  CHECK(store.Exists(L"\\c") == std::nullopt);
+}
+
+
+TEST_CASE(RenameChain) {
+  RenameStore store(false);
+  CHECK(store.Rename(L"\\a", L"\\b") == RenameStore::Result::Success);
+  CHECK(store.Rename(L"\\b", L"\\c") == RenameStore::Result::Success);
+
+  CHECK(store.Resolve(L"\\c") == L"\\a"s);
+  CHECK(store.Resolve(L"\\b") == std::nullopt);
+  CHECK(store.Resolve(L"\\a") == std::nullopt);
+
+  // renaming back leaves an identity entry
+  CHECK(store.Rename(L"\\c", L"\\a") == RenameStore::Result::Success);
+  CHECK(store.Resolve(L"\\a") == L"\\a"s);
+  CHECK(store.Resolve(L"\\c") == std::nullopt);
+}
+
+
+TEST_CASE(RenameDirectory) {
+  RenameStore store(false);
+  CHECK(store.Rename(L"\\dir", L"\\moved") == RenameStore::Result::Success);
+  CHECK(store.Resolve(L"\\moved\\file") == L"\\dir\\file"s);
+  CHECK(store.Resolve(L"\\dir\\file") == std::nullopt);
+
+  // a child of a renamed directory, then the directory again
+  CHECK(store.Rename(L"\\moved\\file", L"\\top") == RenameStore::Result::Success);
+  CHECK(store.Resolve(L"\\top") == L"\\dir\\file"s);
+  CHECK(store.Rename(L"\\moved", L"\\again") == RenameStore::Result::Success);
+  CHECK(store.Resolve(L"\\again\\other") == L"\\dir\\other"s);
+  CHECK(store.Resolve(L"\\top") == L"\\dir\\file"s);
+
+  // a renamed directory keeps the renamed children inside it
+  CHECK(store.Rename(L"\\again\\x", L"\\again\\y") == RenameStore::Result::Success);
+  CHECK(store.Rename(L"\\again", L"\\last") == RenameStore::Result::Success);
+  CHECK(store.Resolve(L"\\last\\y") == L"\\dir\\x"s);
+  CHECK(store.Resolve(L"\\last\\z") == L"\\dir\\z"s);
+}
+
+
+TEST_CASE(InvalidRenames) {
+  RenameStore store(false);
+  CHECK(store.Rename(L"\\", L"\\a") == RenameStore::Result::Invalid);
+  CHECK(store.Rename(L"\\a", L"\\") == RenameStore::Result::Invalid);
+  CHECK(store.Rename(L"\\a", L"\\a") == RenameStore::Result::Success);
+  CHECK(store.GetEntries().empty());
+
+  CHECK(store.Rename(L"\\a", L"\\b") == RenameStore::Result::Success);
+  CHECK(store.Rename(L"\\a", L"\\c") == RenameStore::Result::NotExists);
+  CHECK(store.Rename(L"\\c", L"\\d") == RenameStore::Result::Success);
+  CHECK(store.Rename(L"\\b", L"\\d") == RenameStore::Result::AlreadyExists);
+  CHECK(store.Resolve(L"\\b") == L"\\a"s);
+}
+
+
+TEST_CASE(CaseSensitiveKeys) {
+  RenameStore insensitive(false);
+  CHECK(insensitive.Rename(L"\\Dir", L"\\New") == RenameStore::Result::Success);
+  CHECK(insensitive.Resolve(L"\\NEW\\File") == L"\\Dir\\File"s);
+  CHECK(insensitive.Resolve(L"\\dir") == std::nullopt);
+
+  RenameStore sensitive(true);
+  CHECK(sensitive.Rename(L"\\Dir", L"\\New") == RenameStore::Result::Success);
+  CHECK(sensitive.Resolve(L"\\NEW\\File") == L"\\NEW\\File"s);
+  CHECK(sensitive.Resolve(L"\\dir") == L"\\dir"s);
+  CHECK(sensitive.Resolve(L"\\Dir") == std::nullopt);
+}
+
+
+// long labels are split and merged again as the tree changes
+TEST_CASE(CompressedPaths) {
+  RenameStore store(false);
+  CHECK(store.Rename(L"\\a\\b\\c\\d", L"\\x\\y\\z") == RenameStore::Result::Success);
+  CHECK(store.Rename(L"\\a\\b\\e", L"\\x\\y\\w") == RenameStore::Result::Success);
+  CHECK(store.Resolve(L"\\x\\y\\z\\file") == L"\\a\\b\\c\\d\\file"s);
+  CHECK(store.Resolve(L"\\x\\y\\w") == L"\\a\\b\\e"s);
+  CHECK(store.Resolve(L"\\x\\y") == L"\\x\\y"s);
+  // a label must match whole components
+  CHECK(store.Resolve(L"\\x\\y\\zz") == L"\\x\\y\\zz"s);
+  CHECK(store.Resolve(L"\\a\\b\\cc") == L"\\a\\b\\cc"s);
+
+  CHECK(store.RemoveEntry(L"\\x\\y\\z"));
+  CHECK(!store.RemoveEntry(L"\\x\\y\\z"));
+  CHECK(!store.RemoveEntry(L"\\x\\y"));
+  CHECK(store.Resolve(L"\\x\\y\\z") == L"\\x\\y\\z"s);
+  CHECK(store.Resolve(L"\\a\\b\\c\\d") == L"\\a\\b\\c\\d"s);
+  CHECK(store.Resolve(L"\\x\\y\\w") == L"\\a\\b\\e"s);
+}
+
+
+TEST_CASE(ListChildren) {
+  RenameStore store(false);
+  CHECK(store.Rename(L"\\src\\a", L"\\dst\\a") == RenameStore::Result::Success);
+  CHECK(store.Rename(L"\\src\\b", L"\\dst\\sub\\b") == RenameStore::Result::Success);
+
+  auto forward = store.ListChildrenInForwardLookupTree(L"\\dst");
+  std::sort(forward.begin(), forward.end());
+  CHECK(forward == (std::vector<std::pair<std::wstring, std::wstring>>{{L"a", L"\\src\\a"}}));
+
+  auto reverse = store.ListChildrenInReverseLookupTree(L"\\src");
+  std::sort(reverse.begin(), reverse.end());
+  CHECK(reverse == (std::vector<std::pair<std::wstring, std::wstring>>{{L"a", L"\\dst\\a"}, {L"b", L"\\dst\\sub\\b"}}));
+}
+
+
+// random renames of files and directories against a model which moves whole subtrees
+// the store must also come back the same from GetEntries, which is what MetadataStore persists
+TEST_CASE(RandomRenamesAgainstReference) {
+  for (const bool caseSensitive : {false, true}) {
+    std::mt19937 engine(caseSensitive ? 11 : 3);
+    ReferenceTree reference;
+    RenameStore store(caseSensitive);
+    int fresh = 0;
+
+    for (int iteration = 1; iteration <= 1500; iteration++) {
+      const auto& originals = reference.GetOriginals();
+      auto source = std::next(originals.begin(), std::uniform_int_distribution<std::size_t>(0, originals.size() - 1)(engine))->first;
+
+      // move into another existing directory or to the top level, never below the source itself
+      std::wstring parent;
+      if (std::uniform_int_distribution<int>(0, 2)(engine) != 0) {
+        parent = std::next(originals.begin(), std::uniform_int_distribution<std::size_t>(0, originals.size() - 1)(engine))->first;
+        if (IsSameOrDescendant(parent, source)) {
+          parent.clear();
+        }
+      }
+      const auto destination = parent + L"\\n" + std::to_wstring(fresh++);
+
+      CHECK_MESSAGE(store.Rename(source, destination) == RenameStore::Result::Success, "rename " << iteration << " failed");
+      reference.Rename(source, destination);
+
+      if (iteration % 100 == 0) {
+        CheckResolvesAll(store, reference, caseSensitive, iteration);
+
+        RenameStore restored(caseSensitive);
+        for (const auto& [renamed, original] : store.GetEntries()) {
+          restored.AddEntry(original, renamed);
+        }
+        CheckResolvesAll(restored, reference, caseSensitive, iteration);
+      }
+    }
+  }
+}
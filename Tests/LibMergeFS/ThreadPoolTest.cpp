@@ -0,0 +1,129 @@
+#include "Test.hpp"
+
+#include "../../LibMergeFS/ThreadPool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std::literals;
+
+
+
+TEST_CASE(PostRunsTasks) {
+  std::atomic<int> counter{0};
+  {
+    ThreadPool threadPool(4);
+    CHECK(threadPool.GetThreadCount() == 4);
+    for (int i = 0; i < 1000; i++) {
+      threadPool.Post([&counter]() {
+        counter++;
+      });
+    }
+  }
+  // the destructor drains the queue before joining
+  CHECK(counter == 1000);
+}
+
+
+TEST_CASE(PostWithoutThreadsRunsInline) {
+  ThreadPool threadPool(0);
+  const auto caller = std::this_thread::get_id();
+  std::thread::id executor;
+  threadPool.Post([&executor]() {
+    executor = std::this_thread::get_id();
+  });
+  CHECK(executor == caller);
+}
+
+
+TEST_CASE(RunParallelVisitsEachIndexOnce) {
+  ThreadPool threadPool(3);
+  for (const std::size_t count : {0u, 1u, 2u, 3u, 17u, 1000u}) {
+    std::vector<std::atomic<int>> visits(count);
+    threadPool.RunParallel(count, [&visits](std::size_t index) {
+      visits[index]++;
+    });
+    for (const auto& visit : visits) {
+      CHECK(visit == 1);
+    }
+  }
+}
+
+
+TEST_CASE(RunParallelUsesWorkers) {
+  ThreadPool threadPool(3);
+  std::mutex mutex;
+  std::set<std::thread::id> threadIds;
+  threadPool.RunParallel(4, [&](std::size_t) {
+    {
+      std::lock_guard lock(mutex);
+      threadIds.insert(std::this_thread::get_id());
+    }
+    std::this_thread::sleep_for(50ms);
+  });
+  CHECK(threadIds.size() > 1);
+}
+
+
+TEST_CASE(RunParallelRethrowsAfterAllFinish) {
+  ThreadPool threadPool(2);
+  std::atomic<int> finished{0};
+  CHECK_THROWS(threadPool.RunParallel(8, [&finished](std::size_t index) {
+    if (index == 3) {
+      throw std::runtime_error("task failed");
+    }
+    std::this_thread::sleep_for(5ms);
+    finished++;
+  }), std::runtime_error);
+  CHECK(finished == 7);
+}
+
+
+// the caller takes part in processing, so RunParallel completes even if every worker is blocked
+TEST_CASE(RunParallelProgressesWhenPoolIsBusy) {
+  ThreadPool threadPool(2);
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool release = false;
+  for (int i = 0; i < 2; i++) {
+    threadPool.Post([&]() {
+      std::unique_lock lock(mutex);
+      cv.wait(lock, [&release]() {
+        return release;
+      });
+    });
+  }
+
+  std::atomic<int> processed{0};
+  threadPool.RunParallel(10, [&processed](std::size_t) {
+    processed++;
+  });
+  CHECK(processed == 10);
+
+  {
+    std::lock_guard lock(mutex);
+    release = true;
+  }
+  cv.notify_all();
+}
+
+
+// nested RunParallel from inside a task must not deadlock
+TEST_CASE(NestedRunParallel) {
+  ThreadPool threadPool(2);
+  std::atomic<int> processed{0};
+  threadPool.RunParallel(4, [&](std::size_t) {
+    threadPool.RunParallel(4, [&processed](std::size_t) {
+      processed++;
+    });
+  });
+  CHECK(processed == 16);
+}
@@ -0,0 +1,125 @@
+#include "Test.hpp"
+#include "MemoryMountSource.hpp"
+
+#include "../../LibMergeFS/MountConfig.hpp"
+#include "../../LibMergeFS/Transport.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+using namespace std::literals;
+
+
+
+namespace {
+  using test::MemoryMountSource;
+
+  // below and above MountConfig::TransportPipelineThreshold, to cover TransportData and TransportDataPipelined
+  constexpr std::size_t SequentialFileSize = MountConfig::TransportPipelineThreshold / 2 + 123;
+  constexpr std::size_t PipelinedFileSize = MountConfig::TransportPipelineThreshold * 4 + 123;
+  constexpr std::size_t ChunkSize = 64 * 1024;
+
+
+  struct Result {
+    NTSTATUS status;
+    std::vector<bool> exportFinishCalls;
+    std::vector<bool> importFinishCalls;
+    std::vector<char> importedData;
+  };
+
+
+  // a hang fails the test instead of blocking ctest
+  Result RunTransport(std::size_t fileSize, const MemoryMountSource::Options& sourceOptions, const MemoryMountSource::Options& destinationOptions) {
+    MemoryMountSource source(test::GenerateFileData(fileSize), sourceOptions);
+    MemoryMountSource destination({}, destinationOptions);
+
+    auto future = std::async(std::launch::async, [&]() {
+      MemoryMountSource::PORTATION_INFO portationInfo{L"\\file", 0, FALSE, nullptr, nullptr, FALSE, {}, {}, 0, nullptr};
+      return TransportFile(source, destination, portationInfo);
+    });
+    if (future.wait_for(10s) != std::future_status::ready) {
+      std::cerr << "TransportFile did not return within 10 seconds" << std::endl;
+      std::_Exit(1);
+    }
+
+    return {future.get(), source.GetExportFinishCalls(), destination.GetImportFinishCalls(), destination.GetData()};
+  }
+
+
+  void CheckFailure(std::size_t fileSize, std::optional<std::size_t> failExportAt, std::optional<std::size_t> failImportAt) {
+    MemoryMountSource::Options sourceOptions;
+    sourceOptions.chunkSize = ChunkSize;
+    sourceOptions.failExportAt = failExportAt;
+    MemoryMountSource::Options destinationOptions;
+    destinationOptions.failImportAt = failImportAt;
+    // a slow side keeps the pipeline full when the other one fails
+    (failImportAt ? sourceOptions : destinationOptions).latencyPerMiB = 2ms;
+
+    const auto result = RunTransport(fileSize, sourceOptions, destinationOptions);
+    CHECK_MESSAGE(result.status == STATUS_DISK_FULL, "file of " << fileSize << " bytes, failing at chunk " << failExportAt.value_or(failImportAt.value_or(0)) << ": status " << result.status);
+    CHECK(result.exportFinishCalls == std::vector<bool>{false});
+    CHECK(result.importFinishCalls == std::vector<bool>{false});
+  }
+}
+
+
+TEST_CASE(CopiesSmallFile) {
+  MemoryMountSource::Options options;
+  options.chunkSize = ChunkSize;
+  const auto result = RunTransport(SequentialFileSize, options, {});
+  CHECK(result.status == STATUS_SUCCESS);
+  CHECK(result.importedData == test::GenerateFileData(SequentialFileSize));
+  CHECK(result.exportFinishCalls == std::vector<bool>{true});
+  CHECK(result.importFinishCalls == std::vector<bool>{true});
+}
+
+
+TEST_CASE(CopiesLargeFilePipelined) {
+  for (const auto latency : {0ms, 1ms}) {
+    MemoryMountSource::Options sourceOptions;
+    sourceOptions.chunkSize = ChunkSize;
+    sourceOptions.latencyPerMiB = latency;
+    MemoryMountSource::Options destinationOptions;
+    destinationOptions.latencyPerMiB = 2 * latency;
+    const auto result = RunTransport(PipelinedFileSize, sourceOptions, destinationOptions);
+    CHECK(result.status == STATUS_SUCCESS);
+    CHECK(result.importedData == test::GenerateFileData(PipelinedFileSize));
+    CHECK(result.exportFinishCalls == std::vector<bool>{true});
+    CHECK(result.importFinishCalls == std::vector<bool>{true});
+  }
+}
+
+
+TEST_CASE(CopiesEmptyFile) {
+  const auto result = RunTransport(0, {}, {});
+  CHECK(result.status == STATUS_SUCCESS);
+  CHECK(result.importedData.empty());
+  CHECK(result.exportFinishCalls == std::vector<bool>{true});
+  CHECK(result.importFinishCalls == std::vector<bool>{true});
+}
+
+
+// the first, a middle and the last chunk
+TEST_CASE(ExportFailureFinishesBothSides) {
+  for (const auto fileSize : {SequentialFileSize, PipelinedFileSize}) {
+    const auto lastChunk = (fileSize - 1) / ChunkSize;
+    for (const auto chunk : {std::size_t{0}, lastChunk / 2, lastChunk}) {
+      CheckFailure(fileSize, chunk, std::nullopt);
+    }
+  }
+}
+
+
+TEST_CASE(ImportFailureFinishesBothSides) {
+  for (const auto fileSize : {SequentialFileSize, PipelinedFileSize}) {
+    const auto lastChunk = (fileSize - 1) / ChunkSize;
+    for (const auto chunk : {std::size_t{0}, lastChunk / 2, lastChunk}) {
+      CheckFailure(fileSize, std::nullopt, chunk);
+    }
+  }
+}
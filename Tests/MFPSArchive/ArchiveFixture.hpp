@@ -0,0 +1,575 @@
+#pragma once
+
+// stands in for 7z.dll in the tests and benchmarks of Archive and ArchiveInstancePool: a handler of a simple uncompressed format registered as "Zip"
+// the format is a header listing every item followed by the contents, so that Open reads the header like the central directory of a zip file
+// items report the properties of stored zip items, so MFPSArchive reads them through IInArchiveGetStream and may read them positionally
+// calls to Open, GetProperty and Extract are counted (see GetHandlerCounters), and reads of items can be slowed down to stand in for a decoder (see GetHandlerOptions)
+
+#include <7z/CPP/Common/Common.h>
+#include <7z/CPP/7zip/IStream.h>
+#include <7z/CPP/7zip/Archive/IArchive.h>
+
+#include <CompatModule.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <Propidl.h>
+#include <Windows.h>
+#include <winrt/base.h>
+
+
+namespace test {
+  // the file name under which the handler is registered with compat::module
+  inline constexpr auto HandlerDllFilepath = L"7z.dll";
+
+  // CLSID of 7-Zip's zip handler, so that MFPSArchive treats items as zip items
+  inline constexpr CLSID ZipFormatClsid = {0x23170F69, 0x40C1, 0x278A, {0x10, 0x00, 0x00, 0x01, 0x10, 0x01, 0x00, 0x00}};
+
+  inline constexpr char Signature[8] = {'M', 'F', 'T', 'E', 'S', 'T', 'A', 'R'};
+
+  inline constexpr UInt64 ItemLastWriteTime = 0x01D9000000000000ull;
+
+
+  struct ArchiveEntry {
+    std::wstring path;
+    bool directory = false;
+    std::vector<std::byte> data;
+  };
+
+
+  struct HandlerCounters {
+    std::atomic<std::size_t> opens{0};
+    std::atomic<std::size_t> getProperties{0};
+    std::atomic<std::size_t> extracts{0};
+    std::atomic<std::int64_t> openNanoseconds{0};
+
+    void Reset() {
+      opens = 0;
+      getProperties = 0;
+      extracts = 0;
+      openNanoseconds = 0;
+    }
+  };
+
+
+  inline HandlerCounters& GetHandlerCounters() {
+    static HandlerCounters counters;
+    return counters;
+  }
+
+
+  struct HandlerOptions {
+    // streams returned by IInArchiveGetStream::GetStream sleep in proportion to the size of every read
+    std::chrono::microseconds readLatencyPerMiB{0};
+  };
+
+
+  inline HandlerOptions& GetHandlerOptions() {
+    static HandlerOptions options;
+    return options;
+  }
+
+
+  namespace archive_fixture {
+    struct Item {
+      std::wstring path;
+      bool directory;
+      UInt64 offset;
+      UInt64 size;
+    };
+
+
+    template<typename T>
+    void Append(std::vector<std::byte>& buffer, const T& value) {
+      const auto ptr = reinterpret_cast<const std::byte*>(&value);
+      buffer.insert(buffer.end(), ptr, ptr + sizeof(T));
+    }
+
+
+    template<typename T>
+    T Take(const std::vector<std::byte>& buffer, std::size_t& offset) {
+      T value{};
+      if (offset + sizeof(T) <= buffer.size()) {
+        std::memcpy(&value, buffer.data() + offset, sizeof(T));
+      }
+      offset += sizeof(T);
+      return value;
+    }
+
+
+    // reads exactly size bytes at offset, or returns false
+    inline bool ReadAt(IInStream& inStream, UInt64 offset, void* data, std::size_t size) {
+      if (FAILED(inStream.Seek(static_cast<Int64>(offset), STREAM_SEEK_SET, nullptr))) {
+        return false;
+      }
+      auto ptr = static_cast<std::byte*>(data);
+      while (size != 0) {
+        UInt32 readSize = 0;
+        if (FAILED(inStream.Read(ptr, static_cast<UInt32>(std::min<std::size_t>(size, 1 << 20)), &readSize)) || readSize == 0) {
+          return false;
+        }
+        ptr += readSize;
+        size -= readSize;
+      }
+      return true;
+    }
+
+
+    inline HRESULT SetString(PROPVARIANT* value, const std::wstring& string) {
+      value->bstrVal = SysAllocString(string.c_str());
+      if (!value->bstrVal) {
+        return E_OUTOFMEMORY;
+      }
+      value->vt = VT_BSTR;
+      return S_OK;
+    }
+
+
+    inline void SetBool(PROPVARIANT* value, bool boolean) {
+      value->vt = VT_BOOL;
+      value->boolVal = boolean ? VARIANT_TRUE : VARIANT_FALSE;
+    }
+
+
+    inline void SetUInt32(PROPVARIANT* value, UInt32 number) {
+      value->vt = VT_UI4;
+      value->ulVal = number;
+    }
+
+
+    inline void SetUInt64(PROPVARIANT* value, UInt64 number) {
+      value->vt = VT_UI8;
+      value->uhVal.QuadPart = number;
+    }
+
+
+    // the content of an item, read from the archive stream; the stream must not be used concurrently (MFPSArchive locks it)
+    class ItemInStream : public winrt::implements<ItemInStream, IInStream, ISequentialInStream> {
+      const winrt::com_ptr<IInStream> baseInStream;
+      const UInt64 offset;
+      const UInt64 size;
+      UInt64 position = 0;
+
+    public:
+      ItemInStream(winrt::com_ptr<IInStream> baseInStream, UInt64 offset, UInt64 size) :
+        baseInStream(std::move(baseInStream)),
+        offset(offset),
+        size(size)
+      {}
+
+      STDMETHODIMP QueryInterface(REFIID riid, void** ppvObject) override {
+        if (IsEqualGUID(riid, IID_IInStream) || IsEqualGUID(riid, IID_ISequentialInStream)) {
+          AddRef();
+          *ppvObject = static_cast<IInStream*>(this);
+          return S_OK;
+        }
+        *ppvObject = nullptr;
+        return E_NOINTERFACE;
+      }
+
+      STDMETHODIMP Read(void* data, UInt32 readSize, UInt32* processedSize) override {
+        if (processedSize) {
+          *processedSize = 0;
+        }
+        if (position >= size || readSize == 0) {
+          return S_OK;
+        }
+        const auto currentSize = static_cast<UInt32>(std::min<UInt64>(readSize, size - position));
+        if (!ReadAt(*baseInStream, offset + position, data, currentSize)) {
+          return E_FAIL;
+        }
+        if (const auto latency = GetHandlerOptions().readLatencyPerMiB; latency.count()) {
+          std::this_thread::sleep_for(latency * currentSize / (1 << 20));
+        }
+        position += currentSize;
+        if (processedSize) {
+          *processedSize = currentSize;
+        }
+        return S_OK;
+      }
+
+      STDMETHODIMP Seek(Int64 seekOffset, UInt32 seekOrigin, UInt64* newPosition) override {
+        Int64 base = 0;
+        switch (seekOrigin) {
+          case STREAM_SEEK_SET:
+            break;
+
+          case STREAM_SEEK_CUR:
+            base = static_cast<Int64>(position);
+            break;
+
+          case STREAM_SEEK_END:
+            base = static_cast<Int64>(size);
+            break;
+
+          default:
+            return STG_E_INVALIDFUNCTION;
+        }
+        if (base + seekOffset < 0) {
+          return __HRESULT_FROM_WIN32(ERROR_NEGATIVE_SEEK);
+        }
+        position = static_cast<UInt64>(base + seekOffset);
+        if (newPosition) {
+          *newPosition = position;
+        }
+        return S_OK;
+      }
+    };
+
+
+    class InArchive : public winrt::implements<InArchive, IInArchive, IInArchiveGetStream> {
+      winrt::com_ptr<IInStream> inStream;
+      std::vector<Item> items;
+
+    public:
+      STDMETHODIMP QueryInterface(REFIID riid, void** ppvObject) override {
+        if (IsEqualGUID(riid, IID_IInArchive)) {
+          AddRef();
+          *ppvObject = static_cast<IInArchive*>(this);
+          return S_OK;
+        }
+        if (IsEqualGUID(riid, IID_IInArchiveGetStream)) {
+          AddRef();
+          *ppvObject = static_cast<IInArchiveGetStream*>(this);
+          return S_OK;
+        }
+        *ppvObject = nullptr;
+        return E_NOINTERFACE;
+      }
+
+      // IInArchive
+      STDMETHODIMP Open(IInStream* stream, const UInt64*, IArchiveOpenCallback*) override {
+        const auto start = std::chrono::steady_clock::now();
+        GetHandlerCounters().opens++;
+
+        const HRESULT hResult = [&]() -> HRESULT {
+          // signature, number of items and size of the header
+          std::vector<std::byte> buffer(sizeof(Signature) + sizeof(UInt32) + sizeof(UInt64));
+          if (!ReadAt(*stream, 0, buffer.data(), buffer.size()) || std::memcmp(buffer.data(), Signature, sizeof(Signature)) != 0) {
+            return S_FALSE;
+          }
+          std::size_t offset = sizeof(Signature);
+          const auto numItems = Take<UInt32>(buffer, offset);
+          const auto headerSize = Take<UInt64>(buffer, offset);
+
+          buffer.resize(static_cast<std::size_t>(headerSize));
+          if (!ReadAt(*stream, 0, buffer.data(), buffer.size())) {
+            return S_FALSE;
+          }
+
+          std::vector<Item> newItems(numItems);
+          for (auto& item : newItems) {
+            item.directory = Take<Byte>(buffer, offset) != 0;
+            item.offset = Take<UInt64>(buffer, offset);
+            item.size = Take<UInt64>(buffer, offset);
+            const auto pathLength = Take<UInt32>(buffer, offset);
+            item.path.resize(pathLength);
+            for (auto& c : item.path) {
+              c = static_cast<wchar_t>(Take<char16_t>(buffer, offset));
+            }
+          }
+          if (offset > buffer.size()) {
+            return S_FALSE;
+          }
+
+          stream->AddRef();
+          inStream.attach(stream);
+          items = std::move(newItems);
+          return S_OK;
+        }();
+
+        GetHandlerCounters().openNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        return hResult;
+      }
+
+      STDMETHODIMP Close() override {
+        inStream = nullptr;
+        items.clear();
+        return S_OK;
+      }
+
+      STDMETHODIMP GetNumberOfItems(UInt32* numItems) override {
+        *numItems = static_cast<UInt32>(items.size());
+        return S_OK;
+      }
+
+      STDMETHODIMP GetProperty(UInt32 index, PROPID propID, PROPVARIANT* value) override {
+        GetHandlerCounters().getProperties++;
+        if (index >= items.size()) {
+          return E_INVALIDARG;
+        }
+        const auto& item = items[index];
+        value->vt = VT_EMPTY;
+        switch (propID) {
+          case kpidPath:
+            return SetString(value, item.path);
+
+          case kpidIsDir:
+            SetBool(value, item.directory);
+            break;
+
+          case kpidSize:
+          case kpidPackSize:
+            if (!item.directory) {
+              SetUInt64(value, item.size);
+            }
+            break;
+
+          case kpidAttrib:
+            SetUInt32(value, item.directory ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_ARCHIVE);
+            break;
+
+          case kpidMTime:
+            value->vt = VT_FILETIME;
+            value->filetime = FILETIME{static_cast<DWORD>(ItemLastWriteTime + index), static_cast<DWORD>(ItemLastWriteTime >> 32)};
+            break;
+
+          case kpidEncrypted:
+            SetBool(value, false);
+            break;
+
+          case kpidMethod:
+            return SetString(value, L"Store");
+        }
+        return S_OK;
+      }
+
+      STDMETHODIMP Extract(const UInt32* indices, UInt32 numItems, Int32 testMode, IArchiveExtractCallback* extractCallback) override {
+        GetHandlerCounters().extracts++;
+
+        const bool all = numItems == static_cast<UInt32>(-1);
+        if (all) {
+          numItems = static_cast<UInt32>(items.size());
+        }
+
+        UInt64 total = 0;
+        for (UInt32 i = 0; i < numItems; i++) {
+          total += items.at(all ? i : indices[i]).size;
+        }
+        extractCallback->SetTotal(total);
+
+        std::vector<std::byte> buffer;
+        UInt64 completed = 0;
+        for (UInt32 i = 0; i < numItems; i++) {
+          const UInt32 index = all ? i : indices[i];
+          const auto& item = items.at(index);
+          const Int32 askMode = testMode ? NArchive::NExtract::NAskMode::kTest : NArchive::NExtract::NAskMode::kExtract;
+
+          winrt::com_ptr<ISequentialOutStream> outStream;
+          if (const auto hResult = extractCallback->GetStream(index, outStream.put(), askMode); hResult != S_OK) {
+            return hResult;
+          }
+          extractCallback->PrepareOperation(askMode);
+
+          Int32 opRes = NArchive::NExtract::NOperationResult::kOK;
+          if (outStream && !item.directory) {
+            buffer.resize(static_cast<std::size_t>(item.size));
+            if (!ReadAt(*inStream, item.offset, buffer.data(), buffer.size())) {
+              opRes = NArchive::NExtract::NOperationResult::kUnexpectedEnd;
+            } else {
+              for (std::size_t offset = 0; offset < buffer.size();) {
+                UInt32 writtenSize = 0;
+                if (FAILED(outStream->Write(buffer.data() + offset, static_cast<UInt32>(std::min<std::size_t>(buffer.size() - offset, 1 << 16)), &writtenSize)) || writtenSize == 0) {
+                  opRes = NArchive::NExtract::NOperationResult::kDataError;
+                  break;
+                }
+                offset += writtenSize;
+              }
+            }
+          }
+          outStream = nullptr;
+
+          if (const auto hResult = extractCallback->SetOperationResult(opRes); FAILED(hResult)) {
+            return hResult;
+          }
+          completed += item.size;
+          if (const auto hResult = extractCallback->SetCompleted(&completed); FAILED(hResult)) {
+            return hResult;
+          }
+        }
+        return S_OK;
+      }
+
+      STDMETHODIMP GetArchiveProperty(PROPID, PROPVARIANT* value) override {
+        value->vt = VT_EMPTY;
+        return S_OK;
+      }
+
+      STDMETHODIMP GetNumberOfProperties(UInt32* numProps) override {
+        *numProps = 0;
+        return S_OK;
+      }
+
+      STDMETHODIMP GetPropertyInfo(UInt32, BSTR*, PROPID*, VARTYPE*) override {
+        return E_NOTIMPL;
+      }
+
+      STDMETHODIMP GetNumberOfArchiveProperties(UInt32* numProps) override {
+        *numProps = 0;
+        return S_OK;
+      }
+
+      STDMETHODIMP GetArchivePropertyInfo(UInt32, BSTR*, PROPID*, VARTYPE*) override {
+        return E_NOTIMPL;
+      }
+
+      // IInArchiveGetStream
+      STDMETHODIMP GetStream(UInt32 index, ISequentialInStream** stream) override {
+        *stream = nullptr;
+        if (index >= items.size()) {
+          return E_INVALIDARG;
+        }
+        const auto& item = items[index];
+        if (item.directory) {
+          return S_FALSE;
+        }
+        *stream = static_cast<IInStream*>(winrt::make_self<ItemInStream>(inStream, item.offset, item.size).detach());
+        return S_OK;
+      }
+    };
+
+
+    // exports of the stand-in 7z.dll
+
+    inline HRESULT WINAPI CreateObject(const GUID* clsID, const GUID* iid, void** outObject) {
+      *outObject = nullptr;
+      if (!IsEqualCLSID(*clsID, ZipFormatClsid) || !IsEqualGUID(*iid, IID_IInArchive)) {
+        return E_NOINTERFACE;
+      }
+      *outObject = static_cast<IInArchive*>(winrt::make_self<InArchive>().detach());
+      return S_OK;
+    }
+
+
+    inline HRESULT WINAPI GetIsArc(UInt32, Func_IsArc* isArc) {
+      *isArc = nullptr;
+      return S_OK;
+    }
+
+
+    inline HRESULT WINAPI GetNumberOfFormats(UInt32* numFormats) {
+      *numFormats = 1;
+      return S_OK;
+    }
+
+
+    inline HRESULT WINAPI GetHandlerProperty2(UInt32, PROPID propID, PROPVARIANT* value) {
+      value->vt = VT_EMPTY;
+      switch (propID) {
+        case NArchive::NHandlerPropID::kName:
+          return SetString(value, L"Zip");
+
+        case NArchive::NHandlerPropID::kClassID:
+          value->bstrVal = SysAllocStringByteLen(reinterpret_cast<const char*>(&ZipFormatClsid), sizeof(CLSID));
+          value->vt = VT_BSTR;
+          break;
+
+        case NArchive::NHandlerPropID::kExtension:
+          return SetString(value, L"zip");
+
+        case NArchive::NHandlerPropID::kFlags:
+          SetUInt32(value, 0);
+          break;
+
+        case NArchive::NHandlerPropID::kSignature:
+          value->bstrVal = SysAllocStringByteLen(Signature, sizeof(Signature));
+          value->vt = VT_BSTR;
+          break;
+      }
+      return S_OK;
+    }
+  }
+
+
+  // makes LoadLibraryW(HandlerDllFilepath) load the handler
+  inline void RegisterArchiveHandler() {
+    using compat::module::Export;
+    compat::module::Register(HandlerDllFilepath, {
+      {"CreateObject", Export(&archive_fixture::CreateObject)},
+      {"GetIsArc", Export(&archive_fixture::GetIsArc)},
+      {"GetNumberOfFormats", Export(&archive_fixture::GetNumberOfFormats)},
+      {"GetHandlerProperty2", Export(&archive_fixture::GetHandlerProperty2)},
+    });
+  }
+
+
+  // entries are stored in the given order; directories need not be listed
+  inline std::vector<std::byte> BuildArchive(const std::vector<ArchiveEntry>& entries) {
+    using archive_fixture::Append;
+
+    std::size_t headerSize = sizeof(Signature) + sizeof(UInt32) + sizeof(UInt64);
+    for (const auto& entry : entries) {
+      headerSize += sizeof(Byte) + sizeof(UInt64) * 2 + sizeof(UInt32) + entry.path.size() * sizeof(char16_t);
+    }
+
+    std::vector<std::byte> archive;
+    archive.reserve(headerSize);
+    for (const auto c : Signature) {
+      Append(archive, c);
+    }
+    Append(archive, static_cast<UInt32>(entries.size()));
+    Append(archive, static_cast<UInt64>(headerSize));
+
+    UInt64 dataOffset = headerSize;
+    for (const auto& entry : entries) {
+      Append(archive, static_cast<Byte>(entry.directory ? 1 : 0));
+      Append(archive, dataOffset);
+      Append(archive, static_cast<UInt64>(entry.data.size()));
+      Append(archive, static_cast<UInt32>(entry.path.size()));
+      for (const auto c : entry.path) {
+        Append(archive, static_cast<char16_t>(c));
+      }
+      dataOffset += entry.data.size();
+    }
+
+    for (const auto& entry : entries) {
+      archive.insert(archive.end(), entry.data.begin(), entry.data.end());
+    }
+    return archive;
+  }
+
+
+  inline std::vector<std::byte> GenerateItemData(std::size_t size, unsigned int seed) {
+    std::vector<std::byte> data(size);
+    std::uint32_t state = seed * 2654435761u + 1;
+    for (auto& b : data) {
+      state = state * 1664525 + 1013904223;
+      b = static_cast<std::byte>(state >> 24);
+    }
+    return data;
+  }
+
+
+  // the archive name callback of ArchiveSourceMount with "recursive": "dir\\inner.zip" is opened at "dir\\[inner.zip]"
+  inline std::optional<std::pair<std::wstring, bool>> BracketArchiveName(const std::wstring& filepath, std::size_t count) {
+    const auto separatorPos = filepath.find_last_of(L'\\');
+    const auto parent = separatorPos == std::wstring::npos ? std::wstring() : filepath.substr(0, separatorPos + 1);
+    const auto name = separatorPos == std::wstring::npos ? filepath : filepath.substr(separatorPos + 1);
+    auto newFilepath = parent + L"[" + name + L"]";
+    if (count) {
+      newFilepath += L"." + std::to_wstring(count + 1);
+    }
+    return std::make_pair(newFilepath, false);
+  }
+
+
+  inline BY_HANDLE_FILE_INFORMATION MakeArchiveFileInformation(std::size_t size) {
+    BY_HANDLE_FILE_INFORMATION byHandleFileInformation{};
+    byHandleFileInformation.dwFileAttributes = FILE_ATTRIBUTE_ARCHIVE;
+    byHandleFileInformation.ftLastWriteTime = FILETIME{0, static_cast<DWORD>(ItemLastWriteTime >> 32)};
+    byHandleFileInformation.nFileSizeHigh = static_cast<DWORD>(static_cast<UInt64>(size) >> 32);
+    byHandleFileInformation.nFileSizeLow = static_cast<DWORD>(size & 0xFFFFFFFF);
+    byHandleFileInformation.nNumberOfLinks = 1;
+    return byHandleFileInformation;
+  }
+}
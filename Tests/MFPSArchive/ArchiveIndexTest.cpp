@@ -0,0 +1,310 @@
+#include "Test.hpp"
+
+#include "../../MFPSArchive/NanaZ/ArchiveIndex.hpp"
+#include "../SDK/Plugin/SourceCpp.hpp"
+
+#include <CompatFileSystem.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <Windows.h>
+
+using namespace std::literals;
+
+
+
+namespace {
+  constexpr auto IndexDirectory = L"C:\\Index";
+  constexpr auto IndexPath = L"C:\\Index\\archive.idx";
+  constexpr auto TemporaryIndexPath = L"C:\\Index\\archive.idx.tmp";
+  constexpr auto ArchivePath = L"C:\\Archives\\archive.zip";
+
+  // offset of the version in the index file, after the magic
+  constexpr std::size_t VersionOffset = 8;
+
+
+  constexpr FILETIME MakeFileTime(UInt64 value) {
+    return FILETIME{static_cast<DWORD>(value & 0xFFFFFFFF), static_cast<DWORD>(value >> 32)};
+  }
+
+
+  bool Equals(const std::optional<FILETIME>& a, const std::optional<FILETIME>& b) {
+    if (!a || !b) {
+      return !a && !b;
+    }
+    return a->dwLowDateTime == b->dwLowDateTime && a->dwHighDateTime == b->dwHighDateTime;
+  }
+
+
+  bool Equals(const ArchiveItemRecord& a, const ArchiveItemRecord& b) {
+    return
+      Equals(a.creationTimeN, b.creationTimeN) &&
+      Equals(a.lastAccessTimeN, b.lastAccessTimeN) &&
+      Equals(a.lastWriteTimeN, b.lastWriteTimeN) &&
+      a.directory == b.directory &&
+      a.fileAttributes == b.fileAttributes &&
+      a.fileSizeN == b.fileSizeN &&
+      a.filepathN == b.filepathN &&
+      a.storedContiguously == b.storedContiguously;
+  }
+
+
+  bool Equals(const std::vector<ArchiveItemRecord>* records, const std::vector<ArchiveItemRecord>& expected) {
+    if (!records || records->size() != expected.size()) {
+      return false;
+    }
+    for (std::size_t i = 0; i < expected.size(); i++) {
+      if (!Equals((*records)[i], expected[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+
+  // covers every optional field being present and absent
+  std::vector<ArchiveItemRecord> MakeRootRecords() {
+    return {
+      {MakeFileTime(0x01D9000000000001), MakeFileTime(0x01D9000000000002), MakeFileTime(0x01D9000000000003), false, FILE_ATTRIBUTE_ARCHIVE, 12345, L"dir\\file.txt"s, true},
+      {std::nullopt, std::nullopt, MakeFileTime(0x01D9000000000004), true, FILE_ATTRIBUTE_DIRECTORY, std::nullopt, L"dir"s, false},
+      {std::nullopt, std::nullopt, std::nullopt, false, FILE_ATTRIBUTE_NORMAL, std::nullopt, std::nullopt, false},
+      {std::nullopt, std::nullopt, std::nullopt, false, FILE_ATTRIBUTE_READONLY, 0xFFFFFFFFFull + 1, L"\u65E5\u672C\u8A9E\\\u30D5\u30A1\u30A4\u30EB.bin"s, false},
+    };
+  }
+
+
+  std::vector<ArchiveItemRecord> MakeNestedRecords() {
+    return {
+      {std::nullopt, std::nullopt, MakeFileTime(0x01D9000000000005), false, FILE_ATTRIBUTE_NORMAL, 42, L"inner.txt"s, false},
+    };
+  }
+
+
+  ArchiveIndexKey MakeKey() {
+    return ArchiveIndexKey{1 << 20, MakeFileTime(0x01D9000000000010), 0x0123456789ABCDEFull};
+  }
+
+
+  void WriteFileBytes(LPCWSTR path, const std::vector<std::byte>& data) {
+    const HANDLE fileHandle = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    CHECK(fileHandle != INVALID_HANDLE_VALUE);
+    DWORD numberOfBytesWritten = 0;
+    CHECK(data.empty() || WriteFile(fileHandle, data.data(), static_cast<DWORD>(data.size()), &numberOfBytesWritten, NULL));
+    CloseHandle(fileHandle);
+  }
+
+
+  // saves MakeRootRecords and MakeNestedRecords with MakeKey into IndexPath
+  std::vector<std::byte> SaveIndex() {
+    ArchiveIndex index;
+    index.Set(L""s, MakeRootRecords());
+    index.Set(L"\\3\\12"s, MakeNestedRecords());
+    index.Save(IndexPath, MakeKey());
+    return compat::fs::ReadAllBytes(IndexPath);
+  }
+
+
+  BY_HANDLE_FILE_INFORMATION MakeFileInformation(std::size_t fileSize) {
+    BY_HANDLE_FILE_INFORMATION byHandleFileInformation{};
+    byHandleFileInformation.ftLastWriteTime = MakeFileTime(0x01D9000000000020);
+    byHandleFileInformation.nFileSizeLow = static_cast<DWORD>(fileSize);
+    return byHandleFileInformation;
+  }
+
+
+  UInt64 HashFile(const std::vector<std::byte>& data) {
+    WriteFileBytes(ArchivePath, data);
+    const HANDLE fileHandle = CreateFileW(ArchivePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    CHECK(fileHandle != INVALID_HANDLE_VALUE);
+    const auto key = ArchiveIndexKey::FromFile(fileHandle, MakeFileInformation(data.size()));
+    CloseHandle(fileHandle);
+    CHECK(key.fileSize == data.size());
+    return key.contentHash;
+  }
+}
+
+
+TEST_CASE(RoundTrip) {
+  compat::fs::Reset();
+
+  ArchiveIndex index;
+  CHECK(!index.IsModified());
+  index.Set(L""s, MakeRootRecords());
+  index.Set(L"\\3\\12"s, MakeNestedRecords());
+  CHECK(index.IsModified());
+  index.Save(IndexPath, MakeKey());
+  CHECK(!index.IsModified());
+  CHECK(!compat::fs::Exists(TemporaryIndexPath));
+
+  ArchiveIndex loadedIndex;
+  CHECK(loadedIndex.Load(IndexPath, MakeKey()));
+  CHECK(!loadedIndex.IsModified());
+  CHECK(Equals(loadedIndex.Find(L""s), MakeRootRecords()));
+  CHECK(Equals(loadedIndex.Find(L"\\3\\12"s), MakeNestedRecords()));
+  CHECK(loadedIndex.Find(L"\\3"s) == nullptr);
+}
+
+
+TEST_CASE(SaveReplacesIndex) {
+  compat::fs::Reset();
+  SaveIndex();
+
+  ArchiveIndex index;
+  CHECK(index.Load(IndexPath, MakeKey()));
+  index.Set(L"\\3\\12"s, {});
+  index.Save(IndexPath, MakeKey());
+
+  ArchiveIndex loadedIndex;
+  CHECK(loadedIndex.Load(IndexPath, MakeKey()));
+  CHECK(Equals(loadedIndex.Find(L""s), MakeRootRecords()));
+  CHECK(Equals(loadedIndex.Find(L"\\3\\12"s), {}));
+}
+
+
+TEST_CASE(KeyMismatch) {
+  compat::fs::Reset();
+  SaveIndex();
+
+  auto sizeChanged = MakeKey();
+  sizeChanged.fileSize++;
+  auto timeChanged = MakeKey();
+  timeChanged.lastWriteTime.dwHighDateTime++;
+  auto contentChanged = MakeKey();
+  contentChanged.contentHash ^= 1;
+
+  for (const auto& key : {sizeChanged, timeChanged, contentChanged}) {
+    ArchiveIndex index;
+    CHECK(!index.Load(IndexPath, key));
+    CHECK(index.Find(L""s) == nullptr);
+  }
+}
+
+
+TEST_CASE(MissingFile) {
+  compat::fs::Reset();
+
+  ArchiveIndex index;
+  CHECK(!index.Load(IndexPath, MakeKey()));
+  CHECK(index.Find(L""s) == nullptr);
+}
+
+
+// every proper prefix of a valid file, as left by a crash if the file were written in place
+TEST_CASE(TruncatedFile) {
+  compat::fs::Reset();
+  const auto data = SaveIndex();
+  CHECK(data.size() > VersionOffset + 4);
+
+  for (std::size_t size = 0; size < data.size(); size++) {
+    WriteFileBytes(IndexPath, std::vector<std::byte>(data.begin(), data.begin() + size));
+    ArchiveIndex index;
+    CHECK_MESSAGE(!index.Load(IndexPath, MakeKey()), "truncated to " << size << " of " << data.size() << " bytes");
+    CHECK(index.Find(L""s) == nullptr);
+  }
+
+  auto extended = data;
+  extended.push_back(std::byte{0});
+  WriteFileBytes(IndexPath, extended);
+  ArchiveIndex index;
+  CHECK(!index.Load(IndexPath, MakeKey()));
+}
+
+
+// version 1 files lack the flag of storedContiguously, so they must not be reused
+TEST_CASE(Version1File) {
+  compat::fs::Reset();
+  auto data = SaveIndex();
+
+  std::uint32_t version = 0;
+  std::memcpy(&version, data.data() + VersionOffset, sizeof(version));
+  CHECK(version == 2);
+
+  version = 1;
+  std::memcpy(data.data() + VersionOffset, &version, sizeof(version));
+  WriteFileBytes(IndexPath, data);
+
+  ArchiveIndex index;
+  CHECK(!index.Load(IndexPath, MakeKey()));
+  CHECK(index.Find(L""s) == nullptr);
+}
+
+
+TEST_CASE(FailedLoadKeepsRecords) {
+  compat::fs::Reset();
+  WriteFileBytes(IndexPath, {std::byte{'M'}, std::byte{'F'}});
+
+  ArchiveIndex index;
+  index.Set(L""s, MakeNestedRecords());
+  CHECK(!index.Load(IndexPath, MakeKey()));
+  CHECK(Equals(index.Find(L""s), MakeNestedRecords()));
+  CHECK(index.IsModified());
+}
+
+
+TEST_CASE(FailedSaveKeepsPreviousFile) {
+  compat::fs::Reset();
+  const auto data = SaveIndex();
+
+  for (const auto failedOperation : {compat::fs::Operation::Create, compat::fs::Operation::Write, compat::fs::Operation::Move}) {
+    compat::fs::SetFaultHook([failedOperation](compat::fs::Operation operation, std::wstring_view) -> DWORD {
+      return operation == failedOperation ? ERROR_DISK_FULL : ERROR_SUCCESS;
+    });
+
+    ArchiveIndex index;
+    index.Set(L""s, {});
+    CHECK_THROWS(index.Save(IndexPath, MakeKey()), Win32Error);
+    CHECK(index.IsModified());
+
+    compat::fs::SetFaultHook(nullptr);
+    CHECK(compat::fs::ReadAllBytes(IndexPath) == data);
+    CHECK(!compat::fs::Exists(TemporaryIndexPath));
+  }
+}
+
+
+// the key samples the head and the tail of the archive
+TEST_CASE(KeyHashesHeadAndTail) {
+  compat::fs::Reset();
+
+  std::vector<std::byte> data(256 * 1024);
+  for (std::size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<std::byte>(i * 7 + 1);
+  }
+  const auto hash = HashFile(data);
+  CHECK(HashFile(data) == hash);
+
+  auto middleChanged = data;
+  middleChanged[data.size() / 2] ^= std::byte{1};
+  CHECK(HashFile(middleChanged) == hash);
+
+  auto headChanged = data;
+  headChanged.front() ^= std::byte{1};
+  CHECK(HashFile(headChanged) != hash);
+
+  auto tailChanged = data;
+  tailChanged.back() ^= std::byte{1};
+  CHECK(HashFile(tailChanged) != hash);
+
+  // smaller than the samples
+  const std::vector<std::byte> small(data.begin(), data.begin() + 100);
+  auto smallChanged = small;
+  smallChanged[50] ^= std::byte{1};
+  CHECK(HashFile(small) != HashFile(smallChanged));
+}
+
+
+TEST_CASE(IndexFilepath) {
+  const auto filepath = ArchiveIndex::GetIndexFilepath(IndexDirectory, ArchivePath);
+  CHECK(filepath.substr(0, 9) == L"C:\\Index\\"s);
+  CHECK(filepath.size() == 9 + 16 + 4);
+  CHECK(filepath.substr(filepath.size() - 4) == L".idx"s);
+
+  CHECK(ArchiveIndex::GetIndexFilepath(L"C:\\Index\\"s, ArchivePath) == filepath);
+  CHECK(ArchiveIndex::GetIndexFilepath(IndexDirectory, L"c:\\ARCHIVES\\Archive.ZIP"s) == filepath);
+  CHECK(ArchiveIndex::GetIndexFilepath(IndexDirectory, L"C:\\Archives\\archive2.zip"s) != filepath);
+}
@@ -0,0 +1,214 @@
+#include "Test.hpp"
+
+#include "ArchiveFixture.hpp"
+
+#include "../../MFPSArchive/NanaZ/Archive.hpp"
+#include "../../MFPSArchive/NanaZ/MemoryBudget.hpp"
+#include "../../MFPSArchive/NanaZ/MemoryStream.hpp"
+#include "../../MFPSArchive/NanaZ/NanaZ.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <winrt/base.h>
+
+using namespace std::literals;
+
+
+
+namespace {
+  constexpr std::size_t ItemsPerInnerArchive = 4;
+
+
+  std::vector<std::byte> MakeInnerArchive(unsigned int seed) {
+    std::vector<test::ArchiveEntry> entries;
+    for (std::size_t i = 0; i < ItemsPerInnerArchive; i++) {
+      entries.push_back({L"file" + std::to_wstring(i) + L".bin", false, test::GenerateItemData(100 + i, seed + static_cast<unsigned int>(i))});
+    }
+    return test::BuildArchive(entries);
+  }
+
+
+  // inner0.zip to inner3.zip, and mid.zip containing inner.zip
+  std::vector<std::byte> MakeOuterArchive() {
+    std::vector<test::ArchiveEntry> entries;
+    for (unsigned int i = 0; i < 4; i++) {
+      entries.push_back({L"inner" + std::to_wstring(i) + L".zip", false, MakeInnerArchive(i * 100)});
+    }
+    entries.push_back({L"mid.zip", false, test::BuildArchive({{L"inner.zip", false, MakeInnerArchive(1000)}})});
+    return test::BuildArchive(entries);
+  }
+
+
+  // mounts the outer archive with "recursive" and the given limits
+  class NestedArchiveMount {
+    std::vector<std::byte> archiveData;
+    NanaZ nanaZ;
+    MemoryBudget memoryBudget;
+
+  public:
+    std::unique_ptr<Archive> archive;
+
+    NestedArchiveMount(std::size_t maxOpenNestedArchives, std::size_t maxNestedArchiveMemory = 0) :
+      archiveData((test::RegisterArchiveHandler(), MakeOuterArchive())),
+      nanaZ(test::HandlerDllFilepath),
+      memoryBudget(1 << 20)
+    {
+      test::GetHandlerCounters().Reset();
+      archive = std::make_unique<Archive>(nanaZ, memoryBudget, winrt::make_self<InMemoryStream>(archiveData.data(), archiveData.size()), test::MakeArchiveFileInformation(archiveData.size()), L"archive"s, L""sv, false, 0, DirectoryTree::OnExisting::Skip, DirectoryTree::ExtractToMemory::Never, test::BracketArchiveName, nullptr, nullptr, maxOpenNestedArchives, maxNestedArchiveMemory);
+    }
+
+    // opens the nested archive and returns its tree, whose children are cleared when it is closed
+    const DirectoryTree* Access(const std::wstring& filepath) {
+      Archive::Pin pin;
+      return archive->Get(filepath, pin);
+    }
+
+    bool IsOpen(const DirectoryTree* ptrDirectoryTree) const {
+      return !ptrDirectoryTree->children.empty();
+    }
+  };
+
+
+  std::size_t GetOpens() {
+    return test::GetHandlerCounters().opens;
+  }
+}
+
+
+
+TEST_CASE(NestedArchivesOpenOnFirstAccess) {
+  NestedArchiveMount mount(0);
+  CHECK(GetOpens() == 1);
+
+  const auto ptrInner = mount.Access(L"[inner0.zip]"s);
+  CHECK(ptrInner != nullptr);
+  CHECK(ptrInner->type == DirectoryTree::Type::Archive);
+  CHECK(GetOpens() == 2);
+  CHECK(mount.IsOpen(ptrInner));
+  CHECK(ptrInner->children.size() == ItemsPerInnerArchive);
+
+  const auto ptrFile = mount.Access(L"[inner0.zip]\\file1.bin"s);
+  CHECK(ptrFile != nullptr);
+  CHECK(ptrFile->fileSize == 101);
+  CHECK(GetOpens() == 2);
+
+  CHECK(mount.Access(L"[inner0.zip]\\missing.bin"s) == nullptr);
+  CHECK(mount.Access(L"[inner9.zip]"s) == nullptr);
+  CHECK(GetOpens() == 2);
+}
+
+
+TEST_CASE(UnlimitedKeepsEveryArchiveOpen) {
+  NestedArchiveMount mount(0);
+
+  std::vector<const DirectoryTree*> inners;
+  for (int i = 0; i < 4; i++) {
+    inners.push_back(mount.Access(L"[inner"s + std::to_wstring(i) + L".zip]"s));
+  }
+  mount.Access(L""s);
+  for (const auto ptrInner : inners) {
+    CHECK(mount.IsOpen(ptrInner));
+  }
+  CHECK(GetOpens() == 5);
+}
+
+
+TEST_CASE(TrimClosesLeastRecentlyUsed) {
+  NestedArchiveMount mount(2);
+
+  const auto ptrInner0 = mount.Access(L"[inner0.zip]"s);
+  const auto ptrInner1 = mount.Access(L"[inner1.zip]"s);
+  const auto ptrInner2 = mount.Access(L"[inner2.zip]"s);
+  CHECK(GetOpens() == 4);
+
+  // the access exceeding the limit only requests trimming; the next access closes inner0, which has been used least recently
+  CHECK(mount.IsOpen(ptrInner0));
+  mount.Access(L"[inner1.zip]\\file0.bin"s);
+  CHECK(!mount.IsOpen(ptrInner0));
+  CHECK(mount.IsOpen(ptrInner1));
+  CHECK(mount.IsOpen(ptrInner2));
+  CHECK(GetOpens() == 4);
+
+  // inner1 has just been used, so reopening inner0 closes inner2
+  CHECK(mount.Access(L"[inner0.zip]\\file2.bin"s) != nullptr);
+  CHECK(GetOpens() == 5);
+  mount.Access(L""s);
+  CHECK(mount.IsOpen(ptrInner0));
+  CHECK(mount.IsOpen(ptrInner1));
+  CHECK(!mount.IsOpen(ptrInner2));
+}
+
+
+TEST_CASE(PinnedArchiveIsKeptOpen) {
+  NestedArchiveMount mount(1);
+
+  Archive::Pin pin;
+  const auto ptrFile = mount.archive->Get(L"[inner0.zip]\\file3.bin"sv, pin);
+  CHECK(ptrFile != nullptr);
+  const auto ptrInner0 = mount.Access(L"[inner0.zip]"s);
+
+  // inner0 is pinned, so inner1 is closed instead although it has been used more recently
+  const auto ptrInner1 = mount.Access(L"[inner1.zip]"s);
+  mount.Access(L"[inner2.zip]"s);
+  CHECK(mount.IsOpen(ptrInner0));
+  CHECK(!mount.IsOpen(ptrInner1));
+  CHECK(ptrFile->fileSize == 103);
+
+  pin = Archive::Pin();
+  mount.Access(L""s);
+  CHECK(!mount.IsOpen(ptrInner0));
+}
+
+
+TEST_CASE(ArchiveWithOpenChildIsKeptOpen) {
+  NestedArchiveMount mount(1);
+
+  const auto ptrMid = mount.Access(L"[mid.zip]"s);
+  const auto ptrInner = mount.Access(L"[mid.zip]\\[inner.zip]"s);
+  CHECK(ptrInner != nullptr);
+  CHECK(GetOpens() == 3);
+
+  // mid.zip has been used least recently but cannot be closed while inner.zip is open, so inner.zip is closed instead
+  mount.Access(L""s);
+  CHECK(mount.IsOpen(ptrMid));
+  CHECK(!mount.IsOpen(ptrInner));
+}
+
+
+TEST_CASE(TrimByMemory) {
+  // each inner archive charges the trees of its items; two of them fit in the limit
+  NestedArchiveMount mount(0, 2 * ItemsPerInnerArchive * sizeof(DirectoryTree));
+
+  const auto ptrInner0 = mount.Access(L"[inner0.zip]"s);
+  const auto ptrInner1 = mount.Access(L"[inner1.zip]"s);
+  mount.Access(L""s);
+  CHECK(mount.IsOpen(ptrInner0));
+  CHECK(mount.IsOpen(ptrInner1));
+
+  const auto ptrInner2 = mount.Access(L"[inner2.zip]"s);
+  mount.Access(L""s);
+  CHECK(!mount.IsOpen(ptrInner0));
+  CHECK(mount.IsOpen(ptrInner1));
+  CHECK(mount.IsOpen(ptrInner2));
+}
+
+
+TEST_CASE(ReopenedArchiveKeepsFileIndices) {
+  NestedArchiveMount mount(1);
+
+  const auto ptrFile = mount.Access(L"[inner0.zip]\\file2.bin"s);
+  const auto fileIndex = ptrFile->fileIndex;
+  const auto ptrInner0 = mount.Access(L"[inner0.zip]"s);
+
+  mount.Access(L"[inner1.zip]"s);
+  mount.Access(L""s);
+  CHECK(!mount.IsOpen(ptrInner0));
+
+  const auto ptrReopenedFile = mount.Access(L"[inner0.zip]\\file2.bin"s);
+  CHECK(ptrReopenedFile != nullptr);
+  CHECK(ptrReopenedFile->fileIndex == fileIndex);
+  CHECK(GetOpens() == 4);
+}
@@ -0,0 +1,291 @@
+#include "Test.hpp"
+
+#include "../../MFPSArchive/BlockCache.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std::literals;
+
+
+
+namespace {
+  constexpr std::size_t BlockSize = BlockCache::BlockSize;
+
+
+  std::byte ByteAt(std::uint64_t offset) {
+    return static_cast<std::byte>((offset * 131) >> 7);
+  }
+
+
+  BlockCache::BlockPtr MakeBlock(std::size_t size) {
+    return std::make_shared<BlockCache::Block>(size);
+  }
+
+
+  // a stream which behaves like a compressed one: a forward seek decodes everything in between,
+  // and a backward seek starts decoding over from the beginning
+  class DecoderStream {
+    std::uint64_t size;
+    std::uint64_t position = 0;
+    std::uint64_t decoded = 0;
+    std::size_t reads = 0;
+
+  public:
+    explicit DecoderStream(std::uint64_t size) :
+      size(size)
+    {}
+
+    std::uint64_t GetPosition() const {
+      return position;
+    }
+
+    std::uint64_t GetDecodedSize() const {
+      return decoded;
+    }
+
+    std::size_t GetReadCount() const {
+      return reads;
+    }
+
+    std::size_t Read(std::uint64_t offset, std::byte* buffer, std::size_t bufferSize) {
+      reads++;
+      if (offset < position) {
+        position = 0;
+      }
+      decoded += offset - position;
+      const auto readSize = static_cast<std::size_t>(std::min<std::uint64_t>(bufferSize, offset < size ? size - offset : 0));
+      for (std::size_t i = 0; i < readSize; i++) {
+        buffer[i] = ByteAt(offset + i);
+      }
+      decoded += readSize;
+      position = offset + readSize;
+      return readSize;
+    }
+  };
+
+
+  // what ArchiveSourceMountFile::DReadFile does for a read of a single block
+  BlockCache::BlockPtr ReadBlock(BlockCache& cache, DecoderStream& stream, std::uint64_t fileIndex, std::uint64_t fileSize, std::uint64_t blockIndex, std::uint64_t lastReadaheadBlockIndex) {
+    auto block = cache.GetOrBeginLoad(fileIndex, blockIndex);
+    if (!block) {
+      block = cache.ReadBlocks(fileIndex, fileSize, stream.GetPosition(), blockIndex, blockIndex, lastReadaheadBlockIndex, [&stream](std::uint64_t offset, std::byte* buffer, std::size_t size) {
+        return stream.Read(offset, buffer, size);
+      });
+      cache.EndLoad(fileIndex, blockIndex);
+    }
+    return block;
+  }
+
+
+  bool HasContents(const BlockCache::BlockPtr& block, std::uint64_t blockIndex, std::size_t size) {
+    if (!block || block->size() != size) {
+      return false;
+    }
+    for (std::size_t i = 0; i < size; i++) {
+      if ((*block)[i] != ByteAt(blockIndex * BlockSize + i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+
+TEST_CASE(EvictsLeastRecentlyUsed) {
+  BlockCache cache(3 * BlockSize, 0);
+  CHECK(cache.IsEnabled());
+  cache.Put(1, 0, MakeBlock(BlockSize), false);
+  cache.Put(1, 1, MakeBlock(BlockSize), false);
+  cache.Put(2, 0, MakeBlock(BlockSize), false);
+  CHECK(cache.Get(1, 0) != nullptr);
+
+  // (1, 1) is the least recently used one now
+  cache.Put(2, 1, MakeBlock(BlockSize), true);
+  CHECK(cache.Peek(1, 1) == nullptr);
+  CHECK(cache.Peek(1, 0) != nullptr);
+  CHECK(cache.Peek(2, 0) != nullptr);
+  CHECK(cache.Get(1, 1) == nullptr);
+
+  const auto statistics = cache.GetStatistics();
+  CHECK(statistics.entries == 3);
+  CHECK(statistics.bytes == 3 * BlockSize);
+  CHECK(statistics.hits == 1);
+  CHECK(statistics.misses == 1);
+  CHECK(statistics.readaheads == 1);
+
+  // a block larger than the whole cache is not stored
+  BlockCache small(BlockSize / 2, 0);
+  small.Put(1, 0, MakeBlock(BlockSize), false);
+  CHECK(small.GetStatistics().entries == 0);
+
+  cache.Clear();
+  CHECK(cache.GetStatistics().bytes == 0);
+}
+
+
+TEST_CASE(DisabledCache) {
+  BlockCache cache(0, 4);
+  CHECK(!cache.IsEnabled());
+  cache.Put(1, 0, MakeBlock(16), false);
+  CHECK(cache.Get(1, 0) == nullptr);
+  CHECK(cache.GetOrBeginLoad(1, 0) == nullptr);
+  CHECK(cache.GetOrBeginLoad(1, 0) == nullptr);
+  CHECK(cache.GetStatistics().misses == 0);
+}
+
+
+TEST_CASE(ReadBlocksWithReadahead) {
+  const std::uint64_t fileSize = 10 * BlockSize + 100;
+  BlockCache cache(64 * BlockSize, 4);
+  DecoderStream stream(fileSize);
+
+  CHECK(HasContents(ReadBlock(cache, stream, 1, fileSize, 0, 4), 0, BlockSize));
+  for (std::uint64_t i = 1; i <= 4; i++) {
+    CHECK(HasContents(cache.Peek(1, i), i, BlockSize));
+  }
+  CHECK(cache.Peek(1, 5) == nullptr);
+  CHECK(cache.GetStatistics().readaheads == 4);
+
+  // readahead stops at the first cached block
+  cache.Put(1, 7, MakeBlock(BlockSize), false);
+  CHECK(HasContents(ReadBlock(cache, stream, 1, fileSize, 5, 9), 5, BlockSize));
+  CHECK(cache.Peek(1, 6) != nullptr);
+  CHECK(cache.Peek(1, 8) == nullptr);
+
+  // the last block is short
+  CHECK(HasContents(ReadBlock(cache, stream, 1, fileSize, 10, 10), 10, 100));
+  CHECK(stream.GetDecodedSize() == fileSize);
+}
+
+
+// a forward seek decodes the range in between anyway, so it is kept
+TEST_CASE(ReadBlocksStoresSkippedBlocks) {
+  const std::uint64_t fileSize = 64 * BlockSize;
+  BlockCache cache(64 * BlockSize, 0);
+  DecoderStream stream(fileSize);
+
+  CHECK(HasContents(ReadBlock(cache, stream, 1, fileSize, 5, 5), 5, BlockSize));
+  for (std::uint64_t i = 0; i < 5; i++) {
+    CHECK(HasContents(cache.Peek(1, i), i, BlockSize));
+  }
+  CHECK(cache.GetStatistics().readaheads == 5);
+
+  // only whole blocks after the current position are stored
+  stream.Read(8 * BlockSize + 1, nullptr, 0);   // moves the stream into block 8
+  CHECK(HasContents(ReadBlock(cache, stream, 1, fileSize, 12, 12), 12, BlockSize));
+  CHECK(cache.Peek(1, 8) == nullptr);
+  CHECK(cache.Peek(1, 9) != nullptr);
+  CHECK(cache.Peek(1, 11) != nullptr);
+
+  // a position at the requested block (as for streams which seek cheaply) stores nothing else
+  CHECK(HasContents(cache.ReadBlocks(1, fileSize, 30 * BlockSize, 30, 30, 30, [&stream](std::uint64_t offset, std::byte* buffer, std::size_t size) {
+    return stream.Read(offset, buffer, size);
+  }), 30, BlockSize));
+  CHECK(cache.Peek(1, 29) == nullptr);
+}
+
+
+TEST_CASE(ReadBlocksLimitsSkippedBlocksToHalfCapacity) {
+  const std::uint64_t fileSize = 64 * BlockSize;
+  BlockCache cache(8 * BlockSize, 0);
+  DecoderStream stream(fileSize);
+
+  CHECK(HasContents(ReadBlock(cache, stream, 1, fileSize, 20, 20), 20, BlockSize));
+  CHECK(cache.Peek(1, 15) == nullptr);
+  for (std::uint64_t i = 16; i <= 20; i++) {
+    CHECK(cache.Peek(1, i) != nullptr);
+  }
+}
+
+
+// first-time reads in random order used to decode the file from the beginning for each backward step
+// with the skipped blocks kept (the cache holds twice the file so that no gap is cut short), every byte is decoded once
+TEST_CASE(RandomFirstReadsDecodeOnce) {
+  constexpr std::uint64_t BlockCount = 200;
+  const std::uint64_t fileSize = BlockCount * BlockSize;
+  BlockCache cache(2 * BlockCount * BlockSize, 0);
+  DecoderStream stream(fileSize);
+
+  std::vector<std::uint64_t> order(BlockCount);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(7));
+  for (const auto blockIndex : order) {
+    CHECK(HasContents(ReadBlock(cache, stream, 1, fileSize, blockIndex, blockIndex), blockIndex, BlockSize));
+  }
+  CHECK(stream.GetDecodedSize() == fileSize);
+  CHECK(cache.GetStatistics().entries == BlockCount);
+}
+
+
+TEST_CASE(ConcurrentMissesAreCoalesced) {
+  constexpr int ThreadCount = 8;
+  BlockCache cache(16 * BlockSize, 0);
+  std::atomic<int> loads = 0;
+  std::vector<BlockCache::BlockPtr> results(ThreadCount);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < ThreadCount; t++) {
+    threads.emplace_back([&cache, &loads, &results, t]() {
+      auto block = cache.GetOrBeginLoad(1, 3);
+      if (!block) {
+        loads++;
+        // give the others time to miss too
+        std::this_thread::sleep_for(50ms);
+        block = MakeBlock(BlockSize);
+        cache.Put(1, 3, block, false);
+        cache.EndLoad(1, 3);
+      }
+      results[t] = block;
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  CHECK(loads == 1);
+  for (const auto& block : results) {
+    CHECK(block && block == results[0]);
+  }
+  const auto statistics = cache.GetStatistics();
+  CHECK(statistics.misses == 1);
+  CHECK(statistics.hits == ThreadCount - 1);
+  CHECK(statistics.coalesced <= ThreadCount - 1);
+}
+
+
+// a waiter reads the block itself if the first reader gives up
+TEST_CASE(FailedLoadWakesWaiters) {
+  BlockCache cache(16 * BlockSize, 0);
+  CHECK(cache.GetOrBeginLoad(1, 0) == nullptr);
+
+  std::atomic<bool> waiterReturned = false;
+  BlockCache::BlockPtr waiterResult = MakeBlock(1);
+  std::thread waiter([&]() {
+    waiterResult = cache.GetOrBeginLoad(1, 0);
+    waiterReturned = true;
+  });
+
+  std::this_thread::sleep_for(50ms);
+  CHECK(!waiterReturned);
+  cache.EndLoad(1, 0);
+  waiter.join();
+
+  CHECK(waiterResult == nullptr);
+  CHECK(cache.GetStatistics().misses == 2);
+  cache.EndLoad(1, 0);
+
+  // other blocks are not blocked by a load in progress
+  CHECK(cache.GetOrBeginLoad(1, 1) == nullptr);
+  CHECK(cache.GetOrBeginLoad(1, 2) == nullptr);
+  cache.EndLoad(1, 1);
+  cache.EndLoad(1, 2);
+}
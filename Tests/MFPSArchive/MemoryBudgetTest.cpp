@@ -0,0 +1,170 @@
+#include "Test.hpp"
+
+#include "../../MFPSArchive/NanaZ/MemoryBudget.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+
+namespace {
+  class TestEntry : public MemoryBudget::Entry {
+  public:
+    std::atomic<int> evictions = 0;
+
+  protected:
+    void Evict() override {
+      evictions++;
+    }
+  };
+
+
+  std::shared_ptr<TestEntry> MakeEntry() {
+    return std::make_shared<TestEntry>();
+  }
+}
+
+
+TEST_CASE(EvictsLeastRecentlyUsed) {
+  MemoryBudget budget(100);
+  const auto a = MakeEntry();
+  const auto b = MakeEntry();
+  const auto c = MakeEntry();
+  budget.Charge(a, 40, false);
+  budget.Charge(b, 40, false);
+  budget.Touch(*a);
+
+  // b is the least recently used one now
+  budget.Charge(c, 40, false);
+  CHECK(a->evictions == 0);
+  CHECK(b->evictions == 1);
+  CHECK(c->evictions == 0);
+
+  auto statistics = budget.GetStatistics();
+  CHECK(statistics.capacity == 100);
+  CHECK(statistics.entries == 2);
+  CHECK(statistics.bytes == 80);
+  CHECK(statistics.evictions == 1);
+
+  // charging again replaces the previous charge
+  budget.Charge(b, 10, true);
+  budget.Charge(b, 20, false);
+  statistics = budget.GetStatistics();
+  CHECK(statistics.bytes == 100);
+  CHECK(statistics.reloads == 1);
+  CHECK(a->evictions == 0);
+}
+
+
+TEST_CASE(EntryLargerThanCapacityEvictsItself) {
+  MemoryBudget budget(100);
+  const auto a = MakeEntry();
+  const auto big = MakeEntry();
+  budget.Charge(a, 50, false);
+  budget.Charge(big, 150, false);
+  CHECK(a->evictions == 1);
+  CHECK(big->evictions == 1);
+  CHECK(budget.GetStatistics().bytes == 0);
+}
+
+
+TEST_CASE(DestroyedEntryIsDischarged) {
+  MemoryBudget budget(100);
+  auto a = MakeEntry();
+  budget.Charge(a, 60, false);
+  a.reset();
+  CHECK(budget.GetStatistics().entries == 0);
+  CHECK(budget.GetStatistics().bytes == 0);
+
+  // an evicted entry is discharged only once
+  auto b = MakeEntry();
+  budget.Charge(b, 200, false);
+  b.reset();
+  CHECK(budget.GetStatistics().entries == 0);
+
+  budget.AddSpilledBytes(1000);
+  budget.RemoveSpilledBytes(400);
+  CHECK(budget.GetStatistics().spilledBytes == 600);
+}
+
+
+// the capacity must not depend on which mount came last
+TEST_CASE(CapacityIsLargestRequest) {
+  MemoryBudget budget(100);
+  CHECK(budget.GetDefaultCapacity() == 100);
+  CHECK(budget.GetCapacity() == 100);
+
+  std::optional<MemoryBudget::CapacityRequest> large;
+  std::optional<MemoryBudget::CapacityRequest> small;
+  large.emplace(budget, 300);
+  small.emplace(budget, 50);
+  CHECK(budget.GetCapacity() == 300);
+
+  const auto a = MakeEntry();
+  const auto b = MakeEntry();
+  budget.Charge(a, 150, false);
+  budget.Charge(b, 100, false);
+  CHECK(a->evictions == 0);
+
+  // removing the largest request shrinks the budget and evicts what no longer fits
+  large.reset();
+  CHECK(budget.GetCapacity() == 50);
+  CHECK(a->evictions == 1);
+  CHECK(b->evictions == 1);
+
+  {
+    MemoryBudget::CapacityRequest same(budget, 50);
+    small.reset();
+    CHECK(budget.GetCapacity() == 50);
+  }
+  CHECK(budget.GetCapacity() == 100);
+}
+
+
+TEST_CASE(ConcurrentChargeAndRelease) {
+  constexpr int ThreadCount = 8;
+  MemoryBudget budget(1000);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < ThreadCount; t++) {
+    threads.emplace_back([&budget, t]() {
+      std::mt19937 engine(t);
+      std::uniform_int_distribution<std::size_t> distribution(1, 100);
+      std::vector<std::shared_ptr<TestEntry>> entries(8);
+      for (int i = 0; i < 20000; i++) {
+        auto& entry = entries[i % entries.size()];
+        switch (i % 3) {
+          case 0:
+            entry = MakeEntry();
+            budget.Charge(entry, distribution(engine), false);
+            break;
+
+          case 1:
+            if (entry) {
+              budget.Touch(*entry);
+            }
+            break;
+
+          default:
+            if (t == 0 && i % 300 == 2) {
+              MemoryBudget::CapacityRequest request(budget, 2000);
+            }
+            entry.reset();
+            break;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  const auto statistics = budget.GetStatistics();
+  CHECK(statistics.capacity == 1000);
+  CHECK(statistics.entries == 0);
+  CHECK(statistics.bytes == 0);
+}
@@ -0,0 +1,292 @@
+#include "Test.hpp"
+
+#include "../../MFPSArchive/NanaZ/SeekFilterStream.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <winrt/base.h>
+
+
+
+namespace {
+  constexpr UInt32 ReadSize = 8192;
+
+
+  std::vector<Byte> MakeData(std::size_t size, unsigned seed) {
+    std::mt19937 engine(seed);
+    std::vector<Byte> data(size);
+    for (auto& value : data) {
+      value = static_cast<Byte>(engine());
+    }
+    return data;
+  }
+
+
+  HRESULT SeekPosition(UInt64& position, UInt64 size, Int64 offset, UInt32 seekOrigin, UInt64* newPosition) {
+    Int64 base = 0;
+    switch (seekOrigin) {
+      case STREAM_SEEK_SET:
+        break;
+
+      case STREAM_SEEK_CUR:
+        base = static_cast<Int64>(position);
+        break;
+
+      case STREAM_SEEK_END:
+        base = static_cast<Int64>(size);
+        break;
+
+      default:
+        return E_INVALIDARG;
+    }
+    if (base + offset < 0) {
+      return E_INVALIDARG;
+    }
+    position = static_cast<UInt64>(base + offset);
+    if (newPosition) {
+      *newPosition = position;
+    }
+    return S_OK;
+  }
+
+
+  // the archive file, which can read positionally like the streams of this project
+  class MemoryInStream : public winrt::implements<MemoryInStream, IInStream, ISequentialInStream, IInStreamReadAt> {
+    std::vector<Byte> data;
+    UInt64 position = 0;
+
+  public:
+    MemoryInStream(std::vector<Byte> data) :
+      data(std::move(data))
+    {}
+
+    STDMETHODIMP Read(void* buffer, UInt32 size, UInt32* processedSize) override {
+      UInt32 readSize = 0;
+      ReadAt(position, buffer, size, &readSize);
+      position += readSize;
+      if (processedSize) {
+        *processedSize = readSize;
+      }
+      return S_OK;
+    }
+
+    STDMETHODIMP Seek(Int64 offset, UInt32 seekOrigin, UInt64* newPosition) override {
+      return SeekPosition(position, data.size(), offset, seekOrigin, newPosition);
+    }
+
+    STDMETHODIMP ReadAt(UInt64 offset, void* buffer, UInt32 size, UInt32* processedSize) override {
+      const UInt32 readSize = offset < data.size() ? static_cast<UInt32>(std::min<UInt64>(size, data.size() - offset)) : 0;
+      std::memcpy(buffer, data.data() + offset, readSize);
+      if (processedSize) {
+        *processedSize = readSize;
+      }
+      return S_OK;
+    }
+  };
+
+
+  // a stream of an archive item as a handler returns it
+  // the item consists of extents of the archive file and reads them with the shared archive stream, leaving its position at the end of the read
+  // the content is the stored data XORed with key, so a key other than 0 stands in for a compressed or encrypted item
+  class ItemInStream : public winrt::implements<ItemInStream, IInStream, ISequentialInStream> {
+  public:
+    struct Extent {
+      UInt64 offset;
+      UInt64 size;
+    };
+
+  private:
+    winrt::com_ptr<IInStream> archiveInStream;
+    std::vector<Extent> extents;
+    Byte key;
+    UInt64 size = 0;
+    UInt64 position = 0;
+
+  public:
+    ItemInStream(winrt::com_ptr<IInStream> archiveInStream, std::vector<Extent> extents, Byte key = 0) :
+      archiveInStream(std::move(archiveInStream)),
+      extents(std::move(extents)),
+      key(key)
+    {
+      for (const auto& extent : this->extents) {
+        size += extent.size;
+      }
+    }
+
+    STDMETHODIMP Read(void* buffer, UInt32 size, UInt32* processedSize) override {
+      // reads end at an extent boundary as readers of fragmented items do
+      UInt64 extentStart = 0;
+      UInt32 readSize = 0;
+      for (const auto& extent : extents) {
+        if (position < extentStart + extent.size) {
+          const auto offsetInExtent = position - extentStart;
+          if (const auto hResult = archiveInStream->Seek(static_cast<Int64>(extent.offset + offsetInExtent), STREAM_SEEK_SET, nullptr); FAILED(hResult)) {
+            return hResult;
+          }
+          if (const auto hResult = archiveInStream->Read(buffer, static_cast<UInt32>(std::min<UInt64>(size, extent.size - offsetInExtent)), &readSize); FAILED(hResult)) {
+            return hResult;
+          }
+          break;
+        }
+        extentStart += extent.size;
+      }
+      for (UInt32 i = 0; i < readSize; i++) {
+        static_cast<Byte*>(buffer)[i] ^= key;
+      }
+      position += readSize;
+      if (processedSize) {
+        *processedSize = readSize;
+      }
+      return S_OK;
+    }
+
+    STDMETHODIMP Seek(Int64 offset, UInt32 seekOrigin, UInt64* newPosition) override {
+      return SeekPosition(position, size, offset, seekOrigin, newPosition);
+    }
+  };
+
+
+  std::vector<Byte> Read(IInStream* inStream, UInt32 size) {
+    std::vector<Byte> buffer(size);
+    UInt32 readSize = 0;
+    CHECK(SUCCEEDED(inStream->Read(buffer.data(), size, &readSize)));
+    buffer.resize(readSize);
+    return buffer;
+  }
+
+
+  HRESULT ReadAt(IInStreamReadAt* inStreamReadAt, UInt64 offset, UInt32 size, std::vector<Byte>& buffer) {
+    buffer.assign(size, 0);
+    UInt32 readSize = 0;
+    const auto hResult = inStreamReadAt->ReadAt(offset, buffer.data(), size, &readSize);
+    buffer.resize(SUCCEEDED(hResult) ? readSize : 0);
+    return hResult;
+  }
+
+
+  std::vector<Byte> Slice(const std::vector<Byte>& data, std::size_t offset, std::size_t size) {
+    return std::vector<Byte>(data.begin() + offset, data.begin() + offset + size);
+  }
+
+
+  struct Fixture {
+    std::vector<Byte> archiveData = MakeData(1 << 20, 1);
+    winrt::com_ptr<MemoryInStream> archiveInStream = winrt::make_self<MemoryInStream>(archiveData);
+
+    winrt::com_ptr<InSeekFilterStream> Open(std::vector<ItemInStream::Extent> extents, bool storedContiguously, Byte key = 0) {
+      return winrt::make_self<InSeekFilterStream>(winrt::make_self<ItemInStream>(archiveInStream, std::move(extents), key), archiveInStream, storedContiguously);
+    }
+  };
+}
+
+
+TEST_CASE(StoredItemBecomesPositional) {
+  Fixture fixture;
+  constexpr UInt64 ItemOffset = 100000;
+  constexpr UInt64 ItemSize = 200000;
+  const auto expected = Slice(fixture.archiveData, ItemOffset, ItemSize);
+  const auto stream = fixture.Open({{ItemOffset, ItemSize}}, true);
+
+  std::vector<Byte> buffer;
+  CHECK(ReadAt(stream.get(), 0, ReadSize, buffer) == E_PENDING);
+
+  // small reads may match by chance and do not count
+  CHECK(Read(stream.get(), 100) == Slice(expected, 0, 100));
+  CHECK(ReadAt(stream.get(), 0, ReadSize, buffer) == E_PENDING);
+
+  CHECK(Read(stream.get(), ReadSize) == Slice(expected, 100, ReadSize));
+  CHECK(ReadAt(stream.get(), 0, ReadSize, buffer) == E_PENDING);
+  CHECK(Read(stream.get(), ReadSize) == Slice(expected, 100 + ReadSize, ReadSize));
+
+  CHECK(ReadAt(stream.get(), 50000, ReadSize, buffer) == S_OK);
+  CHECK(buffer == Slice(expected, 50000, ReadSize));
+  CHECK(ReadAt(stream.get(), ItemSize - 10, ReadSize, buffer) == S_OK);
+  CHECK(buffer == Slice(expected, ItemSize - 10, 10));
+  CHECK(ReadAt(stream.get(), ItemSize + 10, ReadSize, buffer) == S_OK);
+  CHECK(buffer.empty());
+
+  // learning leaves the stream where the last read ended
+  CHECK(Read(stream.get(), ReadSize) == Slice(expected, 100 + 2 * ReadSize, ReadSize));
+}
+
+
+TEST_CASE(NotStoredContiguouslyIsNotImplemented) {
+  Fixture fixture;
+  constexpr UInt64 ItemOffset = 4096;
+  constexpr UInt64 ItemSize = 65536;
+  const auto stream = fixture.Open({{ItemOffset, ItemSize}}, false);
+
+  std::vector<Byte> buffer;
+  CHECK(ReadAt(stream.get(), 0, ReadSize, buffer) == E_NOTIMPL);
+  // the data matches the archive file, but the handler did not report the item as stored in a single range
+  for (UInt64 offset = 0; offset < ItemSize; offset += ReadSize) {
+    CHECK(Read(stream.get(), ReadSize) == Slice(fixture.archiveData, ItemOffset + offset, ReadSize));
+  }
+  CHECK(ReadAt(stream.get(), 0, ReadSize, buffer) == E_NOTIMPL);
+}
+
+
+// e.g. a sparse tar entry or a file of a volume spanning two places of the archive file
+TEST_CASE(FragmentedItem) {
+  Fixture fixture;
+  const std::vector<ItemInStream::Extent> extents{{300000, 3 * ReadSize}, {100000, 3 * ReadSize}};
+  std::vector<Byte> expected = Slice(fixture.archiveData, 300000, 3 * ReadSize);
+  const auto second = Slice(fixture.archiveData, 100000, 3 * ReadSize);
+  expected.insert(expected.end(), second.begin(), second.end());
+
+  // the first extent alone passes the verification, so the handler has to tell the item is not contiguous
+  {
+    const auto stream = fixture.Open(extents, false);
+    for (UInt64 offset = 0; offset < expected.size(); offset += ReadSize) {
+      CHECK(Read(stream.get(), ReadSize) == Slice(expected, offset, ReadSize));
+    }
+    std::vector<Byte> buffer;
+    CHECK(ReadAt(stream.get(), 4 * ReadSize, ReadSize, buffer) == E_NOTIMPL);
+  }
+
+  // if the verified reads cross the extents, the offsets differ and positional reads are given up
+  {
+    const auto stream = fixture.Open(extents, true);
+    CHECK(stream->Seek(2 * ReadSize, STREAM_SEEK_SET, nullptr) == S_OK);
+    CHECK(Read(stream.get(), ReadSize) == Slice(expected, 2 * ReadSize, ReadSize));
+    CHECK(Read(stream.get(), ReadSize) == Slice(expected, 3 * ReadSize, ReadSize));
+    std::vector<Byte> buffer;
+    CHECK(ReadAt(stream.get(), 4 * ReadSize, ReadSize, buffer) == E_NOTIMPL);
+    CHECK(Read(stream.get(), ReadSize) == Slice(expected, 4 * ReadSize, ReadSize));
+  }
+}
+
+
+TEST_CASE(TransformedItemIsNotPositional) {
+  Fixture fixture;
+  const auto stream = fixture.Open({{0, 65536}}, true, 0x5A);
+
+  const auto data = Read(stream.get(), ReadSize);
+  CHECK(data.size() == ReadSize);
+  CHECK(data != Slice(fixture.archiveData, 0, ReadSize));
+  std::vector<Byte> buffer;
+  CHECK(ReadAt(stream.get(), 0, ReadSize, buffer) == E_NOTIMPL);
+}
+
+
+// streams of different items share the archive stream and keep their own positions
+TEST_CASE(InterleavedItems) {
+  Fixture fixture;
+  const auto first = fixture.Open({{0, 8 * ReadSize}}, true);
+  const auto second = fixture.Open({{500000, 8 * ReadSize}}, false);
+
+  for (UInt64 offset = 0; offset < 8 * ReadSize; offset += ReadSize) {
+    CHECK(Read(first.get(), ReadSize) == Slice(fixture.archiveData, offset, ReadSize));
+    CHECK(Read(second.get(), ReadSize) == Slice(fixture.archiveData, 500000 + offset, ReadSize));
+  }
+
+  std::vector<Byte> buffer;
+  CHECK(ReadAt(first.get(), ReadSize, ReadSize, buffer) == S_OK);
+  CHECK(buffer == Slice(fixture.archiveData, ReadSize, ReadSize));
+  CHECK(ReadAt(second.get(), ReadSize, ReadSize, buffer) == E_NOTIMPL);
+}
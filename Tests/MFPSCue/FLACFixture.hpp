@@ -0,0 +1,385 @@
+#pragma once
+
+// generated FLAC streams for the tests and benchmarks of SourceToAudioSourceFLAC
+// the encoder here does not depend on libFLAC; it writes CONSTANT, VERBATIM and FIXED subframes of independent channels,
+// so that frames have different sizes and contents, with an optional SEEKTABLE and optionally variable block sizes
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+
+namespace test::flac {
+  struct Format {
+    unsigned int channels;
+    unsigned int bitsPerSample;
+    unsigned int samplingRate;
+  };
+
+  struct Options {
+    std::uint32_t blockSize = 4096;
+    // block sizes cycle through blockSize, blockSize / 4, blockSize * 3 / 4 and blockSize / 2 if set
+    bool variableBlockSize = false;
+    // 0 to omit SEEKTABLE
+    std::uint64_t seekPointInterval = 0;
+    // added to the stream offsets of the seek points to make SEEKTABLE point into the middle of frames
+    std::uint64_t seekPointOffsetError = 0;
+  };
+
+  struct Stream {
+    std::vector<std::byte> data;
+    std::vector<std::uint64_t> frameOffsets;    // absolute byte offsets of the frames
+  };
+
+
+  namespace detail {
+    class BitWriter {
+      std::vector<std::byte>& mData;
+      std::uint64_t mBuffer = 0;
+      unsigned int mBits = 0;
+
+    public:
+      BitWriter(std::vector<std::byte>& data) :
+        mData(data)
+      {}
+
+      // value is truncated to the lowest bits bits (two's complement for negative values)
+      void Write(std::uint64_t value, unsigned int bits) {
+        for (unsigned int bit = bits; bit > 0; bit--) {
+          mBuffer = (mBuffer << 1) | ((value >> (bit - 1)) & 1);
+          if (++mBits == 8) {
+            mData.push_back(static_cast<std::byte>(mBuffer));
+            mBuffer = 0;
+            mBits = 0;
+          }
+        }
+      }
+
+      void WriteUnary(std::uint32_t zeros) {
+        for (std::uint32_t i = 0; i < zeros; i++) {
+          Write(0, 1);
+        }
+        Write(1, 1);
+      }
+
+      void AlignToByte() {
+        if (mBits) {
+          Write(0, 8 - mBits);
+        }
+      }
+    };
+
+
+    inline std::uint8_t CRC8(const std::byte* data, std::size_t size) {
+      std::uint8_t crc = 0;
+      for (std::size_t i = 0; i < size; i++) {
+        crc ^= static_cast<std::uint8_t>(data[i]);
+        for (int bit = 0; bit < 8; bit++) {
+          crc = static_cast<std::uint8_t>(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+      }
+      return crc;
+    }
+
+
+    inline std::uint16_t CRC16(const std::byte* data, std::size_t size) {
+      std::uint16_t crc = 0;
+      for (std::size_t i = 0; i < size; i++) {
+        crc ^= static_cast<std::uint16_t>(static_cast<std::uint8_t>(data[i]) << 8);
+        for (int bit = 0; bit < 8; bit++) {
+          crc = static_cast<std::uint16_t>(crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1);
+        }
+      }
+      return crc;
+    }
+
+
+    // the UTF-8 like coding of frame and sample numbers; up to 36 bits
+    inline void WriteCodedNumber(BitWriter& writer, std::uint64_t number) {
+      if (number < 0x80) {
+        writer.Write(number, 8);
+        return;
+      }
+      // the leading byte holds 6 - numFollowingBytes bits and each following byte 6 bits
+      unsigned int numFollowingBytes = 1;
+      while (numFollowingBytes < 6 && number >> (6 + 5 * numFollowingBytes)) {
+        numFollowingBytes++;
+      }
+      writer.Write(((1u << (numFollowingBytes + 1)) - 1) << 1, numFollowingBytes + 2);
+      writer.Write(number >> (6 * numFollowingBytes), 6 - numFollowingBytes);
+      for (unsigned int i = numFollowingBytes; i > 0; i--) {
+        writer.Write(0b10, 2);
+        writer.Write(number >> (6 * (i - 1)), 6);
+      }
+    }
+
+
+    inline unsigned int GetSamplingRateCode(unsigned int samplingRate) {
+      switch (samplingRate) {
+        case 88200:  return 1;
+        case 176400: return 2;
+        case 192000: return 3;
+        case 8000:   return 4;
+        case 16000:  return 5;
+        case 22050:  return 6;
+        case 24000:  return 7;
+        case 32000:  return 8;
+        case 44100:  return 9;
+        case 48000:  return 10;
+        case 96000:  return 11;
+      }
+      // taken from STREAMINFO
+      return 0;
+    }
+
+
+    inline unsigned int GetSampleSizeCode(unsigned int bitsPerSample) {
+      switch (bitsPerSample) {
+        case 8:  return 1;
+        case 12: return 2;
+        case 16: return 4;
+        case 20: return 5;
+        case 24: return 6;
+      }
+      return 0;
+    }
+
+
+    inline std::uint32_t FoldResidual(std::int64_t residual) {
+      return static_cast<std::uint32_t>(residual >= 0 ? residual * 2 : -residual * 2 - 1);
+    }
+
+
+    // CONSTANT if all samples are the same, otherwise FIXED of order 2 with a single Rice partition, or VERBATIM if that is not smaller
+    inline void WriteSubframe(BitWriter& writer, const std::int32_t* samples, std::size_t numSamples, unsigned int bitsPerSample) {
+      if (std::all_of(samples, samples + numSamples, [samples](std::int32_t sample) { return sample == samples[0]; })) {
+        writer.Write(0b0'000000'0, 8);
+        writer.Write(static_cast<std::uint32_t>(samples[0]), bitsPerSample);
+        return;
+      }
+
+      std::vector<std::uint32_t> residuals;
+      std::uint64_t sum = 0;
+      for (std::size_t i = 2; i < numSamples; i++) {
+        residuals.push_back(FoldResidual(static_cast<std::int64_t>(samples[i]) - 2 * static_cast<std::int64_t>(samples[i - 1]) + samples[i - 2]));
+        sum += residuals.back();
+      }
+      // about log2 of the mean; 31 is the escape code of 5-bit parameters
+      unsigned int parameter = 0;
+      while (parameter < 30 && (std::uint64_t{residuals.size()} << (parameter + 1)) <= sum) {
+        parameter++;
+      }
+      std::uint64_t fixedBits = 2 * bitsPerSample + 2 + 4 + 5;
+      for (const auto residual : residuals) {
+        fixedBits += (residual >> parameter) + 1 + parameter;
+      }
+
+      if (numSamples <= 2 || fixedBits >= std::uint64_t{bitsPerSample} * numSamples) {
+        writer.Write(0b0'000001'0, 8);
+        for (std::size_t i = 0; i < numSamples; i++) {
+          writer.Write(static_cast<std::uint32_t>(samples[i]), bitsPerSample);
+        }
+        return;
+      }
+
+      writer.Write(0b0'001010'0, 8);
+      writer.Write(static_cast<std::uint32_t>(samples[0]), bitsPerSample);
+      writer.Write(static_cast<std::uint32_t>(samples[1]), bitsPerSample);
+      // RICE2 (5-bit parameters), partition order 0
+      writer.Write(0b01, 2);
+      writer.Write(0, 4);
+      writer.Write(parameter, 5);
+      for (const auto residual : residuals) {
+        writer.WriteUnary(residual >> parameter);
+        writer.Write(residual, parameter);
+      }
+    }
+
+
+    inline void WriteFrame(std::vector<std::byte>& data, const Format& format, const std::vector<std::int32_t>& samples, std::uint64_t firstSample, std::uint32_t blockSize, std::uint64_t number, bool variableBlockSize) {
+      const auto frameBegin = data.size();
+      BitWriter writer(data);
+
+      writer.Write(variableBlockSize ? 0xFFF9 : 0xFFF8, 16);
+      const bool blockSize16Bit = blockSize > 256;
+      writer.Write(blockSize16Bit ? 7 : 6, 4);
+      writer.Write(GetSamplingRateCode(format.samplingRate), 4);
+      writer.Write(format.channels - 1, 4);
+      writer.Write(GetSampleSizeCode(format.bitsPerSample), 3);
+      writer.Write(0, 1);
+      WriteCodedNumber(writer, number);
+      writer.Write(blockSize - 1, blockSize16Bit ? 16 : 8);
+      writer.Write(CRC8(data.data() + frameBegin, data.size() - frameBegin), 8);
+
+      std::vector<std::int32_t> channelSamples(blockSize);
+      for (unsigned int channel = 0; channel < format.channels; channel++) {
+        for (std::uint32_t i = 0; i < blockSize; i++) {
+          channelSamples[i] = samples[(firstSample + i) * format.channels + channel];
+        }
+        WriteSubframe(writer, channelSamples.data(), blockSize, format.bitsPerSample);
+      }
+      writer.AlignToByte();
+
+      const auto crc = CRC16(data.data() + frameBegin, data.size() - frameBegin);
+      writer.Write(crc, 16);
+    }
+
+
+    inline void WriteMetadataBlockHeader(std::vector<std::byte>& data, bool last, unsigned int type, std::uint32_t length) {
+      BitWriter writer(data);
+      writer.Write(last, 1);
+      writer.Write(type, 7);
+      writer.Write(length, 24);
+    }
+  }
+
+
+  // interleaved samples; a tone for each channel with some noise, and a silent and a full-scale noise section,
+  // so that the encoder uses CONSTANT, FIXED and VERBATIM subframes
+  inline std::vector<std::int32_t> GenerateSamples(const Format& format, std::size_t numSamples, unsigned int seed = 1) {
+    std::mt19937 engine(seed);
+    const std::int32_t maxValue = static_cast<std::int32_t>((std::int64_t{1} << (format.bitsPerSample - 1)) - 1);
+    const std::int32_t minValue = -maxValue - 1;
+    std::uniform_int_distribution<std::int32_t> noise(-std::max(1, maxValue / 256), std::max(1, maxValue / 256));
+    std::uniform_int_distribution<std::int32_t> fullScale(minValue, maxValue);
+
+    std::vector<std::int32_t> samples(numSamples * format.channels);
+    for (std::size_t i = 0; i < numSamples; i++) {
+      const auto section = i * 16 / std::max<std::size_t>(numSamples, 1);
+      for (unsigned int channel = 0; channel < format.channels; channel++) {
+        std::int32_t value;
+        if (section == 5) {
+          value = 0;
+        } else if (section == 9) {
+          value = fullScale(engine);
+        } else {
+          const double frequency = 220.0 * (channel + 1);
+          const double tone = std::sin(static_cast<double>(i) * frequency * 2 * 3.14159265358979 / format.samplingRate) * maxValue / 2;
+          value = std::clamp(static_cast<std::int32_t>(tone) + noise(engine), minValue, maxValue);
+        }
+        samples[i * format.channels + channel] = value;
+      }
+    }
+    return samples;
+  }
+
+
+  inline Stream Encode(const Format& format, const std::vector<std::int32_t>& samples, const Options& options = {}) {
+    const std::uint64_t totalSamples = samples.size() / format.channels;
+
+    // block sizes of the frames
+    std::vector<std::uint32_t> blockSizes;
+    const std::uint32_t blockSizePattern[] = {
+      options.blockSize,
+      options.variableBlockSize ? options.blockSize / 4 : options.blockSize,
+      options.variableBlockSize ? options.blockSize * 3 / 4 : options.blockSize,
+      options.variableBlockSize ? options.blockSize / 2 : options.blockSize,
+    };
+    for (std::uint64_t sample = 0; sample < totalSamples; ) {
+      const auto blockSize = static_cast<std::uint32_t>(std::min<std::uint64_t>(blockSizePattern[blockSizes.size() % 4], totalSamples - sample));
+      blockSizes.push_back(blockSize);
+      sample += blockSize;
+    }
+    const auto minBlockSize = *std::min_element(blockSizePattern, blockSizePattern + 4);
+    const auto maxBlockSize = *std::max_element(blockSizePattern, blockSizePattern + 4);
+
+    // frames first, to know the offsets for SEEKTABLE
+    std::vector<std::byte> frames;
+    std::vector<std::uint64_t> relativeFrameOffsets;
+    std::vector<std::uint64_t> frameFirstSamples;
+    std::uint64_t firstSample = 0;
+    for (std::size_t frameIndex = 0; frameIndex < blockSizes.size(); frameIndex++) {
+      relativeFrameOffsets.push_back(frames.size());
+      frameFirstSamples.push_back(firstSample);
+      detail::WriteFrame(frames, format, samples, firstSample, blockSizes[frameIndex], options.variableBlockSize ? firstSample : frameIndex, options.variableBlockSize);
+      firstSample += blockSizes[frameIndex];
+    }
+
+    std::uint64_t minFrameSize = ~std::uint64_t{0};
+    std::uint64_t maxFrameSize = 0;
+    for (std::size_t frameIndex = 0; frameIndex < relativeFrameOffsets.size(); frameIndex++) {
+      const auto frameSize = (frameIndex + 1 < relativeFrameOffsets.size() ? relativeFrameOffsets[frameIndex + 1] : frames.size()) - relativeFrameOffsets[frameIndex];
+      minFrameSize = std::min(minFrameSize, frameSize);
+      maxFrameSize = std::max(maxFrameSize, frameSize);
+    }
+
+    // the first frame of each interval, and a placeholder at the end
+    std::vector<std::size_t> seekPointFrames;
+    if (options.seekPointInterval) {
+      for (std::size_t frameIndex = 0; frameIndex < blockSizes.size(); frameIndex++) {
+        if (seekPointFrames.empty() || frameFirstSamples[frameIndex] / options.seekPointInterval != frameFirstSamples[seekPointFrames.back()] / options.seekPointInterval) {
+          seekPointFrames.push_back(frameIndex);
+        }
+      }
+    }
+
+    Stream stream;
+    auto& data = stream.data;
+    for (const char c : {'f', 'L', 'a', 'C'}) {
+      data.push_back(static_cast<std::byte>(c));
+    }
+
+    // STREAMINFO
+    detail::WriteMetadataBlockHeader(data, false, 0, 34);
+    {
+      detail::BitWriter writer(data);
+      writer.Write(minBlockSize, 16);
+      writer.Write(maxBlockSize, 16);
+      writer.Write(minFrameSize, 24);
+      writer.Write(maxFrameSize, 24);
+      writer.Write(format.samplingRate, 20);
+      writer.Write(format.channels - 1, 3);
+      writer.Write(format.bitsPerSample - 1, 5);
+      writer.Write(totalSamples, 36);
+      // MD5 is unknown
+      writer.Write(0, 64);
+      writer.Write(0, 64);
+    }
+
+    if (options.seekPointInterval) {
+      detail::WriteMetadataBlockHeader(data, false, 3, static_cast<std::uint32_t>((seekPointFrames.size() + 1) * 18));
+      detail::BitWriter writer(data);
+      for (const auto frameIndex : seekPointFrames) {
+        writer.Write(frameFirstSamples[frameIndex], 64);
+        writer.Write(relativeFrameOffsets[frameIndex] + options.seekPointOffsetError, 64);
+        writer.Write(blockSizes[frameIndex], 16);
+      }
+      writer.Write(~std::uint64_t{0}, 64);
+      writer.Write(0, 64);
+      writer.Write(0, 16);
+    }
+
+    // PADDING, which the decoder has to skip
+    detail::WriteMetadataBlockHeader(data, true, 1, 100);
+    data.resize(data.size() + 100);
+
+    const auto firstFrameOffset = data.size();
+    for (const auto offset : relativeFrameOffsets) {
+      stream.frameOffsets.push_back(firstFrameOffset + offset);
+    }
+    data.insert(data.end(), frames.begin(), frames.end());
+    return stream;
+  }
+
+
+  // interleaved PCM as SourceToAudioSourceFLAC outputs it: samples left-justified in the smallest container, 8-bit ones unsigned
+  inline std::vector<std::byte> ToPCM(const Format& format, const std::vector<std::int32_t>& samples) {
+    const unsigned int bytesPerSample = (format.bitsPerSample + 7) / 8;
+    const unsigned int shift = bytesPerSample * 8 - format.bitsPerSample;
+    std::vector<std::byte> pcm;
+    pcm.reserve(samples.size() * bytesPerSample);
+    for (const auto sample : samples) {
+      auto value = static_cast<std::uint32_t>(sample) << shift;
+      if (bytesPerSample == 1) {
+        value += 0x80;
+      }
+      for (unsigned int i = 0; i < bytesPerSample; i++) {
+        pcm.push_back(static_cast<std::byte>(value >> (8 * i)));
+      }
+    }
+    return pcm;
+  }
+}
@@ -0,0 +1,424 @@
+#include "Test.hpp"
+#include "FLACFixture.hpp"
+
+#include "../../MFPSCue/AudioSource.hpp"
+#include "../../MFPSCue/MemorySource.hpp"
+#include "../../MFPSCue/PartialSource.hpp"
+#include "../../MFPSCue/SourceToAudioSourceFLAC.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <Windows.h>
+
+using namespace std::literals;
+
+
+
+namespace {
+  using ChannelInfo = AudioSource::ChannelInfo;
+
+  constexpr test::flac::Format Stereo16At44100{2, 16, 44100};
+
+  // the frame index scan reads 1 MiB at a time, less the bytes kept for a frame header; decoders read much less at once
+  constexpr std::size_t ScanReadSize = (1 << 20) - 16;
+
+
+  // fails every read which reaches failOffset
+  class FailingSource : public Source {
+    std::shared_ptr<Source> mSource;
+    SourceOffset mFailOffset;
+
+  public:
+    FailingSource(std::shared_ptr<Source> source, SourceOffset failOffset) :
+      mSource(source),
+      mFailOffset(failOffset)
+    {}
+
+    SourceSize GetSize() override {
+      return mSource->GetSize();
+    }
+
+    NTSTATUS Read(SourceOffset offset, std::byte* buffer, std::size_t size, std::size_t* readSize) override {
+      if (offset + size > mFailOffset) {
+        return STATUS_UNSUCCESSFUL;
+      }
+      return mSource->Read(offset, buffer, size, readSize);
+    }
+  };
+
+
+  // delays the reads of the frame index scan and counts them
+  class SlowScanSource : public Source {
+    std::shared_ptr<Source> mSource;
+    std::chrono::milliseconds mLatency;
+    std::atomic<std::size_t> mScanReads;
+
+  public:
+    SlowScanSource(std::shared_ptr<Source> source, std::chrono::milliseconds latency) :
+      mSource(source),
+      mLatency(latency),
+      mScanReads(0)
+    {}
+
+    std::size_t GetScanReads() const {
+      return mScanReads;
+    }
+
+    SourceSize GetSize() override {
+      return mSource->GetSize();
+    }
+
+    NTSTATUS Read(SourceOffset offset, std::byte* buffer, std::size_t size, std::size_t* readSize) override {
+      if (size >= ScanReadSize) {
+        mScanReads++;
+        std::this_thread::sleep_for(mLatency);
+      }
+      return mSource->Read(offset, buffer, size, readSize);
+    }
+  };
+
+
+  // counts the bytes read by the decoders, excluding the reads of the frame index scan
+  class CountingSource : public Source {
+    std::shared_ptr<Source> mSource;
+    std::atomic<std::size_t> mDecoderReadBytes;
+
+  public:
+    CountingSource(std::shared_ptr<Source> source) :
+      mSource(source),
+      mDecoderReadBytes(0)
+    {}
+
+    std::size_t GetDecoderReadBytes() const {
+      return mDecoderReadBytes;
+    }
+
+    SourceSize GetSize() override {
+      return mSource->GetSize();
+    }
+
+    NTSTATUS Read(SourceOffset offset, std::byte* buffer, std::size_t size, std::size_t* readSize) override {
+      if (size < ScanReadSize) {
+        mDecoderReadBytes += size;
+      }
+      return mSource->Read(offset, buffer, size, readSize);
+    }
+  };
+
+
+  std::shared_ptr<MemorySource> ToSource(const std::vector<std::byte>& data) {
+    return std::make_shared<MemorySource>(data.data(), data.size());
+  }
+
+
+  std::vector<std::byte> ReadAll(Source& source) {
+    std::vector<std::byte> data(static_cast<std::size_t>(source.GetSize()));
+    std::size_t readSize = 0;
+    CHECK(source.Read(0, data.data(), data.size(), &readSize) == STATUS_SUCCESS);
+    CHECK(readSize == data.size());
+    return data;
+  }
+
+
+  // unaligned reads of various sizes at random positions, in an order which needs seeks in both directions
+  void CheckRandomReads(Source& source, const std::vector<std::byte>& expected, std::size_t numReads, unsigned int seed) {
+    CHECK(source.GetSize() == expected.size());
+
+    std::mt19937_64 engine(seed);
+    std::vector<std::byte> buffer;
+    for (std::size_t i = 0; i < numReads; i++) {
+      const auto offset = std::uniform_int_distribution<std::size_t>(0, expected.size() - 1)(engine);
+      const auto size = std::uniform_int_distribution<std::size_t>(1, i % 4 == 0 ? 200000 : 5000)(engine);
+      const auto expectedSize = std::min(size, expected.size() - offset);
+      buffer.assign(size, std::byte{0xCC});
+      std::size_t readSize = 0;
+      CHECK(source.Read(offset, buffer.data(), size, &readSize) == STATUS_SUCCESS);
+      CHECK_MESSAGE(readSize == expectedSize, "read of " << size << " bytes at " << offset << " returned " << readSize << " bytes");
+      CHECK_MESSAGE(std::memcmp(buffer.data(), expected.data() + offset, expectedSize) == 0, "read of " << size << " bytes at " << offset << " differs");
+    }
+  }
+}
+
+
+TEST_CASE(SequentialRead) {
+  const auto samples = test::flac::GenerateSamples(Stereo16At44100, 44100 * 3);
+  const auto stream = test::flac::Encode(Stereo16At44100, samples);
+  SourceToAudioSourceFLAC audioSource(ToSource(stream.data));
+
+  CHECK(audioSource.IsCompressed());
+  CHECK(audioSource.GetSamplingRate() == 44100);
+  CHECK(audioSource.GetDataType() == AudioSource::DataType::Int16);
+  CHECK(audioSource.GetChannels() == 2);
+  CHECK(audioSource.GetChannelInfo(0) == ChannelInfo::Left);
+  CHECK(audioSource.GetChannelInfo(1) == ChannelInfo::Right);
+  CHECK(audioSource.GetChannelInfo(2) == ChannelInfo::None);
+  CHECK(ReadAll(audioSource) == test::flac::ToPCM(Stereo16At44100, samples));
+}
+
+
+TEST_CASE(HighResolution) {
+  constexpr test::flac::Format Stereo24At96000{2, 24, 96000};
+  const auto samples = test::flac::GenerateSamples(Stereo24At96000, 96000 * 4);
+  const auto stream = test::flac::Encode(Stereo24At96000, samples, {4096, false, 96000});
+  const auto expected = test::flac::ToPCM(Stereo24At96000, samples);
+  SourceToAudioSourceFLAC audioSource(ToSource(stream.data));
+
+  CHECK(audioSource.GetSamplingRate() == 96000);
+  CHECK(audioSource.GetDataType() == AudioSource::DataType::Int24);
+  CHECK(audioSource.GetBlockSize() == 6);
+  CHECK(audioSource.GetSize() == 96000 * 4 * 6);
+  CHECK(ReadAll(audioSource) == expected);
+  CheckRandomReads(audioSource, expected, 100, 24);
+}
+
+
+// FLAC defines the channel order for up to 8 channels; 5.1 is L, R, C, LFE, BL, BR
+TEST_CASE(Surround51) {
+  constexpr test::flac::Format Surround24At48000{6, 24, 48000};
+  const auto samples = test::flac::GenerateSamples(Surround24At48000, 48000 * 2);
+  const auto stream = test::flac::Encode(Surround24At48000, samples);
+  const auto expected = test::flac::ToPCM(Surround24At48000, samples);
+  SourceToAudioSourceFLAC audioSource(ToSource(stream.data));
+
+  CHECK(audioSource.GetChannels() == 6);
+  CHECK(audioSource.GetChannelInfo(0) == ChannelInfo::Left);
+  CHECK(audioSource.GetChannelInfo(1) == ChannelInfo::Right);
+  CHECK(audioSource.GetChannelInfo(2) == ChannelInfo::Center);
+  CHECK(audioSource.GetChannelInfo(3) == ChannelInfo::LowFrequency);
+  CHECK(audioSource.GetChannelInfo(4) == ChannelInfo::BackLeft);
+  CHECK(audioSource.GetChannelInfo(5) == ChannelInfo::BackRight);
+  CHECK(audioSource.GetChannelInfo(6) == ChannelInfo::None);
+  CHECK(audioSource.GetChannelMask() == 0x3F);
+  CHECK(audioSource.GetBlockSize() == 18);
+  // each channel is a tone of its own frequency, so a swapped channel would not match
+  CHECK(ReadAll(audioSource) == expected);
+  CheckRandomReads(audioSource, expected, 50, 51);
+}
+
+
+// samples of 20, 12 and 8 bits are widened to 24, 16 and 8 bits, left-justified; 8-bit samples are unsigned as in WAV
+TEST_CASE(SampleWidening) {
+  const struct {
+    test::flac::Format format;
+    AudioSource::DataType dataType;
+  } cases[] = {
+    {{2, 20, 44100}, AudioSource::DataType::Int24},
+    {{2, 12, 44100}, AudioSource::DataType::Int16},
+    {{1, 8, 22050}, AudioSource::DataType::UInt8},
+  };
+
+  for (const auto& testCase : cases) {
+    const auto samples = test::flac::GenerateSamples(testCase.format, testCase.format.samplingRate);
+    const auto stream = test::flac::Encode(testCase.format, samples);
+    SourceToAudioSourceFLAC audioSource(ToSource(stream.data));
+
+    CHECK_MESSAGE(audioSource.GetDataType() == testCase.dataType, testCase.format.bitsPerSample << "-bit samples");
+    CHECK_MESSAGE(ReadAll(audioSource) == test::flac::ToPCM(testCase.format, samples), testCase.format.bitsPerSample << "-bit samples");
+  }
+
+  // the lowest bits are zero and the highest ones keep the sign
+  constexpr test::flac::Format Mono20At44100{1, 20, 44100};
+  const std::vector<std::int32_t> samples(4096, -0x7FFFF);
+  SourceToAudioSourceFLAC audioSource(ToSource(test::flac::Encode(Mono20At44100, samples).data));
+  const auto pcm = ReadAll(audioSource);
+  CHECK(pcm.size() == samples.size() * 3);
+  CHECK(pcm[0] == std::byte{0x10});
+  CHECK(pcm[1] == std::byte{0x00});
+  CHECK(pcm[2] == std::byte{0x80});
+}
+
+
+TEST_CASE(RandomReadWithoutSeekTable) {
+  const auto samples = test::flac::GenerateSamples(Stereo16At44100, 44100 * 20);
+  const auto expected = test::flac::ToPCM(Stereo16At44100, samples);
+  const auto stream = test::flac::Encode(Stereo16At44100, samples);
+  SourceToAudioSourceFLAC audioSource(ToSource(stream.data));
+
+  // the first far read starts the frame index scan; the reads fall back to seek_absolute until it completes
+  CheckRandomReads(audioSource, expected, 300, 1);
+  std::this_thread::sleep_for(100ms);
+  CheckRandomReads(audioSource, expected, 300, 2);
+}
+
+
+TEST_CASE(RandomReadWithSeekTable) {
+  const auto samples = test::flac::GenerateSamples(Stereo16At44100, 44100 * 20);
+  const auto expected = test::flac::ToPCM(Stereo16At44100, samples);
+
+  test::flac::Options options;
+  options.seekPointInterval = 44100;
+  const auto stream = test::flac::Encode(Stereo16At44100, samples, options);
+  SourceToAudioSourceFLAC audioSource(ToSource(stream.data));
+  CheckRandomReads(audioSource, expected, 300, 3);
+}
+
+
+TEST_CASE(RandomReadWithVariableBlockSize) {
+  const auto samples = test::flac::GenerateSamples(Stereo16At44100, 44100 * 10);
+  const auto expected = test::flac::ToPCM(Stereo16At44100, samples);
+
+  test::flac::Options options;
+  options.variableBlockSize = true;
+  const auto stream = test::flac::Encode(Stereo16At44100, samples, options);
+  SourceToAudioSourceFLAC audioSource(ToSource(stream.data));
+  CheckRandomReads(audioSource, expected, 300, 4);
+  std::this_thread::sleep_for(100ms);
+  CheckRandomReads(audioSource, expected, 100, 5);
+}
+
+
+TEST_CASE(RandomReadWithWrongSeekTable) {
+  const auto samples = test::flac::GenerateSamples(Stereo16At44100, 44100 * 10);
+  const auto expected = test::flac::ToPCM(Stereo16At44100, samples);
+
+  // seek points into the middle of frames; the decoder loses sync and the read falls back to seek_absolute
+  test::flac::Options options;
+  options.seekPointInterval = 44100;
+  options.seekPointOffsetError = 7;
+  const auto stream = test::flac::Encode(Stereo16At44100, samples, options);
+  SourceToAudioSourceFLAC audioSource(ToSource(stream.data));
+  CheckRandomReads(audioSource, expected, 200, 6);
+}
+
+
+TEST_CASE(FarReadSeeks) {
+  const auto samples = test::flac::GenerateSamples(Stereo16At44100, 44100 * 20);
+  const auto expected = test::flac::ToPCM(Stereo16At44100, samples);
+  const auto stream = test::flac::Encode(Stereo16At44100, samples);
+  const auto source = std::make_shared<CountingSource>(ToSource(stream.data));
+  SourceToAudioSourceFLAC audioSource(source);
+
+  // nothing is indexed yet; the read must not decode all frames from the beginning
+  const auto offset = expected.size() * 9 / 10 / 4 * 4;
+  std::vector<std::byte> buffer(4096);
+  std::size_t readSize = 0;
+  CHECK(audioSource.Read(offset, buffer.data(), buffer.size(), &readSize) == STATUS_SUCCESS);
+  CHECK(std::memcmp(buffer.data(), expected.data() + offset, buffer.size()) == 0);
+  CHECK_MESSAGE(source->GetDecoderReadBytes() < stream.data.size() / 4, source->GetDecoderReadBytes() << " of " << stream.data.size() << " bytes read");
+}
+
+
+TEST_CASE(ConcurrentTrackReads) {
+  constexpr std::size_t NumTracks = 3;
+  constexpr std::size_t ChunkSize = 16 * 1024;
+  constexpr std::size_t BlockSize = 4;
+
+  const auto samples = test::flac::GenerateSamples(Stereo16At44100, 44100 * 24);
+  const auto expected = test::flac::ToPCM(Stereo16At44100, samples);
+  const auto stream = test::flac::Encode(Stereo16At44100, samples);
+  const auto source = std::make_shared<CountingSource>(ToSource(stream.data));
+  const auto audioSource = std::make_shared<SourceToAudioSourceFLAC>(source);
+
+  // tracks as CueAudioLoader makes them, not aligned to frames; each thread plays one track from the beginning
+  const auto numSamples = expected.size() / BlockSize;
+  std::atomic<std::size_t> numFailures(0);
+  std::vector<std::thread> threads;
+  for (std::size_t trackIndex = 0; trackIndex < NumTracks; trackIndex++) {
+    const auto trackBegin = (numSamples * trackIndex / NumTracks + trackIndex * 1000) * BlockSize;
+    const auto trackEnd = trackIndex + 1 == NumTracks ? expected.size() : (numSamples * (trackIndex + 1) / NumTracks + (trackIndex + 1) * 1000) * BlockSize;
+    threads.emplace_back([&, trackBegin, trackEnd]() {
+      PartialSource track(audioSource, trackBegin, trackEnd - trackBegin);
+      std::vector<std::byte> buffer(ChunkSize);
+      for (Source::SourceOffset offset = 0; offset < trackEnd - trackBegin; offset += ChunkSize) {
+        std::size_t readSize = 0;
+        const auto expectedSize = std::min<std::size_t>(ChunkSize, static_cast<std::size_t>(trackEnd - trackBegin - offset));
+        if (track.Read(offset, buffer.data(), ChunkSize, &readSize) != STATUS_SUCCESS || readSize != expectedSize || std::memcmp(buffer.data(), expected.data() + trackBegin + offset, readSize) != 0) {
+          numFailures++;
+        }
+      }
+    });
+  }
+  // another reader jumps around meanwhile
+  threads.emplace_back([&]() {
+    std::mt19937_64 engine(7);
+    std::vector<std::byte> buffer(ChunkSize);
+    for (int i = 0; i < 20; i++) {
+      const auto offset = std::uniform_int_distribution<std::size_t>(0, expected.size() - ChunkSize)(engine);
+      std::size_t readSize = 0;
+      if (audioSource->Read(offset, buffer.data(), ChunkSize, &readSize) != STATUS_SUCCESS || readSize != ChunkSize || std::memcmp(buffer.data(), expected.data() + offset, ChunkSize) != 0) {
+        numFailures++;
+      }
+    }
+  });
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  CHECK(numFailures == 0);
+  // each track keeps its own decoder; decoders taken over by another track would read the stream many times
+  CHECK_MESSAGE(source->GetDecoderReadBytes() < stream.data.size() * 3 / 2, source->GetDecoderReadBytes() << " bytes read for a stream of " << stream.data.size() << " bytes");
+}
+
+
+TEST_CASE(ReadPastEnd) {
+  const auto samples = test::flac::GenerateSamples(Stereo16At44100, 10000);
+  const auto expected = test::flac::ToPCM(Stereo16At44100, samples);
+  const auto stream = test::flac::Encode(Stereo16At44100, samples);
+  SourceToAudioSourceFLAC audioSource(ToSource(stream.data));
+
+  std::vector<std::byte> buffer(1000);
+  std::size_t readSize = 1;
+  CHECK(audioSource.Read(expected.size(), buffer.data(), buffer.size(), &readSize) == STATUS_SUCCESS);
+  CHECK(readSize == 0);
+  CHECK(audioSource.Read(expected.size() - 10, buffer.data(), buffer.size(), &readSize) == STATUS_SUCCESS);
+  CHECK(readSize == 10);
+  CHECK(std::memcmp(buffer.data(), expected.data() + expected.size() - 10, 10) == 0);
+}
+
+
+TEST_CASE(DestroyDuringScan) {
+  const auto samples = test::flac::GenerateSamples(Stereo16At44100, 44100 * 40);
+  const auto expected = test::flac::ToPCM(Stereo16At44100, samples);
+  const auto stream = test::flac::Encode(Stereo16At44100, samples);
+  const auto numScanReads = (stream.data.size() + ScanReadSize - 1) / ScanReadSize;
+  CHECK(numScanReads >= 4);
+
+  const auto source = std::make_shared<SlowScanSource>(ToSource(stream.data), 200ms);
+  {
+    SourceToAudioSourceFLAC audioSource(source);
+
+    // a far read starts the scan and is served by seek_absolute meanwhile
+    const auto offset = expected.size() * 3 / 4 / 4 * 4;
+    std::vector<std::byte> buffer(4096);
+    std::size_t readSize = 0;
+    CHECK(audioSource.Read(offset, buffer.data(), buffer.size(), &readSize) == STATUS_SUCCESS);
+    CHECK(readSize == buffer.size());
+    CHECK(std::memcmp(buffer.data(), expected.data() + offset, buffer.size()) == 0);
+  }
+
+  // the destructor stops the scan after the read in progress
+  CHECK_MESSAGE(source->GetScanReads() < numScanReads, source->GetScanReads() << " of " << numScanReads << " scan reads done");
+}
+
+
+TEST_CASE(ReadFailure) {
+  const auto samples = test::flac::GenerateSamples(Stereo16At44100, 44100 * 5);
+  const auto stream = test::flac::Encode(Stereo16At44100, samples);
+  SourceToAudioSourceFLAC audioSource(std::make_shared<FailingSource>(ToSource(stream.data), stream.frameOffsets[stream.frameOffsets.size() / 2]));
+
+  std::vector<std::byte> buffer(static_cast<std::size_t>(audioSource.GetSize()));
+  std::size_t readSize = 0;
+  CHECK(audioSource.Read(0, buffer.data(), buffer.size(), &readSize) != STATUS_SUCCESS);
+  CHECK(audioSource.Read(buffer.size() - 4, buffer.data(), 4, &readSize) != STATUS_SUCCESS);
+}
+
+
+TEST_CASE(InvalidStream) {
+  std::vector<std::byte> data(1000, std::byte{0x55});
+  CHECK_THROWS(SourceToAudioSourceFLAC(ToSource(data)), std::runtime_error);
+
+  // truncated in STREAMINFO
+  const auto stream = test::flac::Encode(Stereo16At44100, test::flac::GenerateSamples(Stereo16At44100, 1000));
+  const std::vector<std::byte> truncated(stream.data.begin(), stream.data.begin() + 20);
+  CHECK_THROWS(SourceToAudioSourceFLAC(ToSource(truncated)), std::runtime_error);
+}
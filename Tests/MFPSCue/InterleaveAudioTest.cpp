@@ -0,0 +1,103 @@
+#include "Test.hpp"
+
+#include "../../MFPSCue/InterleaveAudio.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <random>
+#include <vector>
+
+
+
+namespace {
+  using InterleaveFunction = void(*)(std::byte* destination, const std::int32_t* const* source, std::size_t numChannels, std::size_t bytesPerSample, std::size_t numSamples);
+
+  constexpr std::size_t MaxChannels = 8;
+  constexpr std::size_t GuardSize = 64;
+  constexpr auto Guard = std::byte{0xCD};
+
+  // around the kernel widths (4, 8 and 16 samples) and their remainders
+  constexpr std::size_t SampleCounts[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 100, 1000, 1027};
+
+
+  // planar samples which fit in bytesPerSample bytes, including the extremes
+  std::vector<std::vector<std::int32_t>> MakeSamples(std::size_t numChannels, std::size_t bytesPerSample, std::size_t numSamples, std::size_t sourceOffset, unsigned seed) {
+    const std::int64_t max = (std::int64_t{1} << (bytesPerSample * 8 - 1)) - 1;
+    const std::int64_t min = -max - 1;
+    std::mt19937 engine(seed);
+    std::uniform_int_distribution<std::int64_t> distribution(min, max);
+
+    std::vector<std::vector<std::int32_t>> samples(numChannels, std::vector<std::int32_t>(sourceOffset + numSamples));
+    for (std::size_t channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+      for (std::size_t sampleIndex = 0; sampleIndex < sourceOffset + numSamples; sampleIndex++) {
+        const auto selector = (sampleIndex + channelIndex) % 16;
+        const auto value = selector == 0 ? min : selector == 1 ? max : selector == 2 ? 0 : selector == 3 ? -1 : distribution(engine);
+        samples[channelIndex][sampleIndex] = static_cast<std::int32_t>(value);
+      }
+    }
+    return samples;
+  }
+
+
+  // compares function with InterleaveAudioScalar byte by byte for every combination, with misaligned source and destination
+  // bytes around the destination must be left untouched
+  void CheckMatchesScalar(InterleaveFunction function) {
+    unsigned seed = 0;
+    for (std::size_t numChannels = 1; numChannels <= MaxChannels; numChannels++) {
+      for (std::size_t bytesPerSample = 1; bytesPerSample <= 4; bytesPerSample++) {
+        for (const auto numSamples : SampleCounts) {
+          for (const std::size_t offset : {0, 1, 3}) {
+            const auto samples = MakeSamples(numChannels, bytesPerSample, numSamples, offset, seed++);
+            const std::int32_t* source[MaxChannels];
+            for (std::size_t channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+              source[channelIndex] = samples[channelIndex].data() + offset;
+            }
+
+            const auto size = numSamples * numChannels * bytesPerSample;
+            std::vector<std::byte> expected(GuardSize + offset + size + GuardSize, Guard);
+            std::vector<std::byte> actual(expected.size(), Guard);
+            InterleaveAudioScalar(expected.data() + GuardSize + offset, source, numChannels, bytesPerSample, numSamples);
+            function(actual.data() + GuardSize + offset, source, numChannels, bytesPerSample, numSamples);
+
+            CHECK_MESSAGE(actual == expected, "output differs for " << numChannels << " channels, " << bytesPerSample << " bytes per sample, " << numSamples << " samples, offset " << offset);
+          }
+        }
+      }
+    }
+  }
+}
+
+
+TEST_CASE(ScalarLayout) {
+  const std::int32_t left[] = {0x12345678, -2};
+  const std::int32_t right[] = {-0x80, 0x7F};
+  const std::int32_t* const source[] = {left, right};
+
+  std::byte output[16]{};
+  InterleaveAudioScalar(output, source, 2, 3, 2);
+  const std::byte expected24[] = {
+    std::byte{0x78}, std::byte{0x56}, std::byte{0x34}, std::byte{0x80}, std::byte{0xFF}, std::byte{0xFF},
+    std::byte{0xFE}, std::byte{0xFF}, std::byte{0xFF}, std::byte{0x7F}, std::byte{0x00}, std::byte{0x00},
+  };
+  CHECK(std::vector<std::byte>(output, output + 12) == std::vector<std::byte>(std::begin(expected24), std::end(expected24)));
+
+  // 8-bit PCM is unsigned
+  const std::int32_t mono[] = {-128, 0, 127};
+  const std::int32_t* const monoSource[] = {mono};
+  InterleaveAudioScalar(output, monoSource, 1, 1, 3);
+  CHECK(output[0] == std::byte{0x00});
+  CHECK(output[1] == std::byte{0x80});
+  CHECK(output[2] == std::byte{0xFF});
+}
+
+
+// dispatches to AVX2 kernels if the processor supports them, SSE2 kernels otherwise
+TEST_CASE(DispatchedMatchesScalar) {
+  CheckMatchesScalar(InterleaveAudio);
+}
+
+
+TEST_CASE(SSE2MatchesScalar) {
+  CheckMatchesScalar(InterleaveAudioSSE2);
+}
@@ -0,0 +1,168 @@
+#include "Test.hpp"
+
+#include "../../MFPSCue/MemorySource.hpp"
+#include "../../MFPSCue/MergedSource.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <Windows.h>
+
+
+
+namespace {
+  // returns at most maxReadSize bytes per read
+  class ShortReadSource : public Source {
+    std::shared_ptr<Source> mSource;
+    std::size_t mMaxReadSize;
+
+  public:
+    ShortReadSource(std::shared_ptr<Source> source, std::size_t maxReadSize) :
+      mSource(source),
+      mMaxReadSize(maxReadSize)
+    {}
+
+    SourceSize GetSize() override {
+      return mSource->GetSize();
+    }
+
+    NTSTATUS Read(SourceOffset offset, std::byte* buffer, std::size_t size, std::size_t* readSize) override {
+      return mSource->Read(offset, buffer, std::min(size, mMaxReadSize), readSize);
+    }
+  };
+
+
+  class FailingSource : public Source {
+    SourceSize mSize;
+
+  public:
+    FailingSource(SourceSize size) :
+      mSize(size)
+    {}
+
+    SourceSize GetSize() override {
+      return mSize;
+    }
+
+    NTSTATUS Read(SourceOffset, std::byte*, std::size_t, std::size_t*) override {
+      return STATUS_UNSUCCESSFUL;
+    }
+  };
+
+
+  // segments of the given sizes and the concatenation of their contents
+  struct Segments {
+    std::vector<std::shared_ptr<Source>> sources;
+    std::vector<std::byte> data;
+
+    Segments(const std::vector<std::size_t>& sizes) {
+      for (const auto size : sizes) {
+        std::vector<std::byte> segment(size);
+        for (auto& value : segment) {
+          value = static_cast<std::byte>(data.size() * 7 + sources.size());
+          data.push_back(value);
+        }
+        sources.push_back(std::make_shared<MemorySource>(segment.data(), segment.size()));
+      }
+    }
+  };
+
+
+  std::vector<std::byte> Read(Source& source, Source::SourceOffset offset, std::size_t size) {
+    std::vector<std::byte> buffer(size);
+    std::size_t readSize = 0;
+    CHECK(source.Read(offset, buffer.data(), size, &readSize) == STATUS_SUCCESS);
+    buffer.resize(readSize);
+    return buffer;
+  }
+
+
+  std::vector<std::byte> Slice(const std::vector<std::byte>& data, std::size_t offset, std::size_t size) {
+    offset = std::min(offset, data.size());
+    return std::vector<std::byte>(data.begin() + offset, data.begin() + std::min(offset + size, data.size()));
+  }
+}
+
+
+TEST_CASE(EmptySources) {
+  MergedSource none(std::vector<std::shared_ptr<Source>>{});
+  CHECK(none.GetSize() == 0);
+  CHECK(Read(none, 0, 10).empty());
+
+  // empty segments anywhere do not affect reads
+  Segments segments({0, 5, 0, 0, 3, 0});
+  MergedSource merged(segments.sources);
+  CHECK(merged.GetSize() == 8);
+  CHECK(Read(merged, 0, 8) == segments.data);
+  CHECK(Read(merged, 4, 2) == Slice(segments.data, 4, 2));
+}
+
+
+TEST_CASE(Boundaries) {
+  Segments segments({4, 1, 6});
+  MergedSource merged(segments.sources);
+  const auto size = segments.data.size();
+
+  for (std::size_t offset = 0; offset <= size + 1; offset++) {
+    for (std::size_t length = 0; length <= size + 1; length++) {
+      CHECK_MESSAGE(Read(merged, offset, length) == Slice(segments.data, offset, length), "read of " << length << " bytes at " << offset << " differs");
+    }
+  }
+
+  // a null readSize is allowed
+  std::byte buffer[3];
+  CHECK(merged.Read(3, buffer, sizeof(buffer), nullptr) == STATUS_SUCCESS);
+  CHECK(std::vector<std::byte>(buffer, buffer + 3) == Slice(segments.data, 3, 3));
+}
+
+
+// random reads over many segments, including single-byte and empty ones
+TEST_CASE(RandomReads) {
+  std::mt19937 engine(5);
+  std::vector<std::size_t> sizes;
+  for (int i = 0; i < 3000; i++) {
+    const auto kind = std::uniform_int_distribution<int>(0, 9)(engine);
+    sizes.push_back(kind == 0 ? 0 : kind == 1 ? 1 : std::uniform_int_distribution<std::size_t>(2, 300)(engine));
+  }
+  Segments segments(sizes);
+  MergedSource merged(segments.sources);
+  CHECK(merged.GetSize() == segments.data.size());
+
+  for (int i = 0; i < 20000; i++) {
+    const auto offset = std::uniform_int_distribution<std::size_t>(0, segments.data.size() + 10)(engine);
+    const auto length = std::uniform_int_distribution<std::size_t>(0, i % 10 == 0 ? 5000 : 400)(engine);
+    CHECK_MESSAGE(Read(merged, offset, length) == Slice(segments.data, offset, length), "read of " << length << " bytes at " << offset << " differs");
+  }
+}
+
+
+// a short read of a segment ends the read there
+TEST_CASE(ShortRead) {
+  Segments segments({8, 8, 8});
+  segments.sources[1] = std::make_shared<ShortReadSource>(segments.sources[1], 3);
+  MergedSource merged(segments.sources);
+
+  CHECK(Read(merged, 4, 16) == Slice(segments.data, 4, 7));
+  CHECK(Read(merged, 8, 2) == Slice(segments.data, 8, 2));
+  CHECK(Read(merged, 8, 5) == Slice(segments.data, 8, 3));
+  CHECK(Read(merged, 16, 8) == Slice(segments.data, 16, 8));
+}
+
+
+TEST_CASE(ErrorPropagates) {
+  Segments segments({8, 8});
+  auto sources = segments.sources;
+  sources.insert(sources.begin() + 1, std::make_shared<FailingSource>(8));
+  MergedSource merged(sources);
+
+  std::byte buffer[16];
+  std::size_t readSize = 0;
+  CHECK(merged.Read(0, buffer, 8, &readSize) == STATUS_SUCCESS);
+  CHECK(merged.Read(4, buffer, 8, &readSize) == STATUS_UNSUCCESSFUL);
+  CHECK(merged.Read(8, buffer, 8, &readSize) == STATUS_UNSUCCESSFUL);
+  CHECK(merged.Read(16, buffer, 8, &readSize) == STATUS_SUCCESS);
+  CHECK(std::vector<std::byte>(buffer, buffer + 8) == Slice(segments.data, 8, 8));
+}
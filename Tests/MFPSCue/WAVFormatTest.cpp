@@ -0,0 +1,243 @@
+#include "Test.hpp"
+
+#include "../../MFPSCue/AudioSource.hpp"
+#include "../../MFPSCue/AudioSourceToSourceWAV.hpp"
+#include "../../MFPSCue/CueAudioLoader.hpp"
+#include "../../MFPSCue/MemorySource.hpp"
+#include "../../MFPSCue/PartialSource.hpp"
+#include "../../MFPSCue/SourceToAudioSourceWAV.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <Windows.h>
+
+
+
+namespace {
+  using ChannelInfo = AudioSource::ChannelInfo;
+
+  struct Format {
+    std::uint16_t numChannels;
+    std::uint32_t samplingRate;
+    std::uint16_t bitsPerSample;
+    std::uint32_t channelMask;    // written as WAVE_FORMAT_EXTENSIBLE if not 0
+  };
+
+  constexpr Format Stereo16At44100{2, 44100, 16, 0};
+  constexpr Format Stereo24At96000{2, 96000, 24, 0x0003};
+  constexpr Format Surround51At96000{6, 96000, 24, 0x003F};
+  constexpr Format Surround51At48000{6, 48000, 16, 0x003F};
+
+  const std::vector<ChannelInfo> Surround51ChannelInfo{
+    ChannelInfo::Left,
+    ChannelInfo::Right,
+    ChannelInfo::Center,
+    ChannelInfo::LowFrequency,
+    ChannelInfo::BackLeft,
+    ChannelInfo::BackRight,
+  };
+
+
+  void Append(std::vector<std::byte>& data, const char* signature) {
+    for (int i = 0; i < 4; i++) {
+      data.push_back(static_cast<std::byte>(signature[i]));
+    }
+  }
+
+
+  // little endian
+  template<typename T>
+  void Append(std::vector<std::byte>& data, T value) {
+    for (std::size_t i = 0; i < sizeof(T); i++) {
+      data.push_back(static_cast<std::byte>(static_cast<std::uint64_t>(value) >> (i * 8)));
+    }
+  }
+
+
+  std::size_t GetBlockSize(const Format& format) {
+    return format.numChannels * format.bitsPerSample / 8;
+  }
+
+
+  // PCM which differs in every byte position of a block, so that swapped channels or bytes are noticed
+  std::vector<std::byte> MakePCM(const Format& format, std::size_t numSamples) {
+    std::vector<std::byte> pcm(numSamples * GetBlockSize(format));
+    for (std::size_t i = 0; i < pcm.size(); i++) {
+      pcm[i] = static_cast<std::byte>(i * 31 + i / 251);
+    }
+    return pcm;
+  }
+
+
+  // a WAV file laid out as AudioSourceToSourceWAV writes it; an unrelated LIST chunk can be put before fmt
+  std::vector<std::byte> MakeWAV(const Format& format, const std::vector<std::byte>& pcm, bool withListChunk = false) {
+    const bool extensible = format.channelMask != 0;
+    std::vector<std::byte> data;
+    Append(data, "RIFF");
+    Append(data, std::uint32_t{0});
+    Append(data, "WAVE");
+
+    if (withListChunk) {
+      Append(data, "LIST");
+      Append(data, std::uint32_t{12});
+      Append(data, "INFO");
+      Append(data, "ISFT");
+      Append(data, std::uint32_t{0});
+    }
+
+    Append(data, "fmt ");
+    Append(data, std::uint32_t{extensible ? 40u : 16u});
+    Append(data, std::uint16_t{extensible ? std::uint16_t{0xFFFE} : std::uint16_t{0x0001}});
+    Append(data, format.numChannels);
+    Append(data, format.samplingRate);
+    Append(data, static_cast<std::uint32_t>(format.samplingRate * GetBlockSize(format)));
+    Append(data, static_cast<std::uint16_t>(GetBlockSize(format)));
+    Append(data, format.bitsPerSample);
+    if (extensible) {
+      Append(data, std::uint16_t{22});
+      Append(data, format.bitsPerSample);
+      Append(data, format.channelMask);
+      // KSDATAFORMAT_SUBTYPE_PCM
+      for (const int value : {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71}) {
+        data.push_back(static_cast<std::byte>(value));
+      }
+    }
+
+    Append(data, "data");
+    Append(data, static_cast<std::uint32_t>(pcm.size()));
+    data.insert(data.end(), pcm.begin(), pcm.end());
+
+    const auto riffSize = static_cast<std::uint32_t>(data.size() - 8);
+    for (std::size_t i = 0; i < 4; i++) {
+      data[4 + i] = static_cast<std::byte>(riffSize >> (i * 8));
+    }
+    return data;
+  }
+
+
+  std::shared_ptr<MemorySource> ToSource(const std::vector<std::byte>& data) {
+    return std::make_shared<MemorySource>(data.data(), data.size());
+  }
+
+
+  std::vector<std::byte> ReadAll(Source& source) {
+    std::vector<std::byte> data(static_cast<std::size_t>(source.GetSize()));
+    std::size_t readSize = 0;
+    CHECK(source.Read(0, data.data(), data.size(), &readSize) == STATUS_SUCCESS);
+    CHECK(readSize == data.size());
+    return data;
+  }
+
+
+  std::vector<ChannelInfo> GetChannelInfo(const AudioSource& audioSource) {
+    std::vector<ChannelInfo> channelInfo;
+    for (std::size_t channelIndex = 0; channelIndex < audioSource.GetChannels(); channelIndex++) {
+      channelInfo.push_back(audioSource.GetChannelInfo(channelIndex));
+    }
+    return channelInfo;
+  }
+}
+
+
+TEST_CASE(Parse24Bit96kHz) {
+  const auto pcm = MakePCM(Stereo24At96000, 9600);
+  SourceToAudioSourceWAV audioSource(ToSource(MakeWAV(Stereo24At96000, pcm, true)));
+
+  CHECK(audioSource.GetSamplingRate() == 96000);
+  CHECK(audioSource.GetDataType() == AudioSource::DataType::Int24);
+  CHECK(GetChannelInfo(audioSource) == (std::vector<ChannelInfo>{ChannelInfo::Left, ChannelInfo::Right}));
+  CHECK(audioSource.GetBlockSize() == 6);
+  CHECK(audioSource.GetChannelMask() == 0x0003);
+  CHECK(!audioSource.IsCompressed());
+  CHECK(ReadAll(audioSource) == pcm);
+}
+
+
+TEST_CASE(Parse51) {
+  for (const auto& format : {Surround51At96000, Surround51At48000}) {
+    const auto pcm = MakePCM(format, 4800);
+    SourceToAudioSourceWAV audioSource(ToSource(MakeWAV(format, pcm)));
+
+    CHECK(audioSource.GetSamplingRate() == format.samplingRate);
+    CHECK(audioSource.GetDataType() == (format.bitsPerSample == 24 ? AudioSource::DataType::Int24 : AudioSource::DataType::Int16));
+    CHECK(GetChannelInfo(audioSource) == Surround51ChannelInfo);
+    CHECK(audioSource.GetBlockSize() == GetBlockSize(format));
+    CHECK(audioSource.GetChannelMask() == 0x003F);
+    CHECK(ReadAll(audioSource) == pcm);
+  }
+}
+
+
+// six channels without WAVE_FORMAT_EXTENSIBLE have no speaker positions
+TEST_CASE(Parse6ChannelsWithoutMask) {
+  const Format format{6, 48000, 16, 0};
+  SourceToAudioSourceWAV audioSource(ToSource(MakeWAV(format, MakePCM(format, 100))));
+
+  CHECK(GetChannelInfo(audioSource) == std::vector<ChannelInfo>(6, ChannelInfo::Other));
+  CHECK(audioSource.GetChannelMask() == 0);
+}
+
+
+TEST_CASE(ParseInvalid) {
+  auto data = MakeWAV(Stereo16At44100, MakePCM(Stereo16At44100, 100));
+  data[8] = std::byte{'X'};
+  CHECK_THROWS(SourceToAudioSourceWAV(ToSource(data)), std::runtime_error);
+
+  auto truncated = MakeWAV(Stereo16At44100, MakePCM(Stereo16At44100, 100));
+  truncated.resize(truncated.size() - 2);
+  CHECK_THROWS(SourceToAudioSourceWAV(ToSource(truncated)), std::runtime_error);
+}
+
+
+// AudioSourceToSourceWAV must write back the same file, using WAVE_FORMAT_EXTENSIBLE only for more than 2 channels or 16 bits
+TEST_CASE(RoundTrip) {
+  for (const auto& format : {Stereo16At44100, Stereo24At96000, Surround51At96000, Surround51At48000}) {
+    const auto pcm = MakePCM(format, 1000);
+    const auto expected = MakeWAV(format, pcm);
+    AudioSourceToSourceWAV wav(std::make_shared<SourceToAudioSourceWAV>(ToSource(MakeWAV(format, pcm, true))));
+
+    CHECK(wav.GetSize() == expected.size());
+    CHECK_MESSAGE(ReadAll(wav) == expected, "output differs for " << format.numChannels << " channels at " << format.samplingRate << " Hz, " << format.bitsPerSample << " bits");
+
+    // reads crossing the header and the samples
+    const auto headerSize = expected.size() - pcm.size();
+    std::vector<std::byte> buffer(40);
+    std::size_t readSize = 0;
+    CHECK(wav.Read(headerSize - 20, buffer.data(), buffer.size(), &readSize) == STATUS_SUCCESS);
+    CHECK(readSize == buffer.size());
+    CHECK(buffer == std::vector<std::byte>(expected.begin() + headerSize - 20, expected.begin() + headerSize + 20));
+  }
+}
+
+
+TEST_CASE(FrameToSample) {
+  static_assert(CueAudioLoader::FrameToSample(1, 44100) == 588);
+  CHECK(CueAudioLoader::FrameToSample(75, 96000) == 96000);
+  CHECK(CueAudioLoader::FrameToSample(1, 96000) == 1280);
+  CHECK(CueAudioLoader::FrameToSample(1, 48000) == 640);
+  CHECK(CueAudioLoader::FrameToSample(1, 192000) == 2560);
+  // 22050 / 75 = 294
+  CHECK(CueAudioLoader::FrameToSample(3, 22050) == 882);
+  // rounds down
+  CHECK(CueAudioLoader::FrameToSample(1, 8000) == 106);
+  // 99 minutes at 192 kHz does not overflow
+  CHECK(CueAudioLoader::FrameToSample(99 * 60 * 75, 192000) == 99ull * 60 * 192000);
+}
+
+
+// a track cut as CueAudioLoader does begins at the sample of its first CD frame
+TEST_CASE(TrackAt96kHz51) {
+  const auto pcm = MakePCM(Surround51At96000, 4 * 1280);
+  const auto audioSource = std::make_shared<SourceToAudioSourceWAV>(ToSource(MakeWAV(Surround51At96000, pcm)));
+  const auto blockSize = audioSource->GetBlockSize();
+  const auto begin = CueAudioLoader::FrameToSample(1, audioSource->GetSamplingRate());
+  const auto end = CueAudioLoader::FrameToSample(3, audioSource->GetSamplingRate());
+
+  PartialSource track(audioSource, begin * blockSize, (end - begin) * blockSize);
+  CHECK(track.GetSize() == 2 * 1280 * blockSize);
+  CHECK(ReadAll(track) == std::vector<std::byte>(pcm.begin() + begin * blockSize, pcm.begin() + end * blockSize));
+}
@@ -0,0 +1,114 @@
+#include "Test.hpp"
+
+#include "../../LibMergeFS/Util.hpp"
+#include "../../SDK/CaseSensitivity.hpp"
+#include "../../SDK/Wildcard.hpp"
+
+#include <cstddef>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+using namespace std::literals;
+
+using CaseSensitivity::CiEqualTo;
+using CaseSensitivity::CiHash;
+
+
+
+namespace {
+  wchar_t FoldCase(wchar_t c) {
+    return L'a' <= c && c <= L'z' ? c - L'a' + L'A' : c;
+  }
+
+
+  bool ReferenceEqualTo(std::wstring_view a, std::wstring_view b) {
+    if (a.size() != b.size()) {
+      return false;
+    }
+    for (std::size_t i = 0; i < a.size(); i++) {
+      if (FoldCase(a[i]) != FoldCase(b[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+
+  // random string mixing ASCII letters with their non-ASCII look-alikes and code units that differ from them by 0x20
+  std::wstring RandomString(std::mt19937& engine, std::size_t maxLength) {
+    static constexpr wchar_t Alphabet[] = {
+      L'a', L'A', L'z', L'Z', L'@', L'[', L'`', L'{', L'.', L'\\',
+      L'Ä', L'ä', L'İ', L'ı', L'K', L'Σ', L'σ', L'Ａ', L'ａ', L'聡',
+    };
+    std::wstring str(std::uniform_int_distribution<std::size_t>(0, maxLength)(engine), L'\0');
+    for (auto& c : str) {
+      c = Alphabet[std::uniform_int_distribution<std::size_t>(0, std::size(Alphabet) - 1)(engine)];
+    }
+    return str;
+  }
+
+
+  // flips the case of random ASCII letters
+  std::wstring ShuffleCase(std::mt19937& engine, std::wstring str) {
+    for (auto& c : str) {
+      if (engine() % 2 != 0 && ((L'a' <= c && c <= L'z') || (L'A' <= c && c <= L'Z'))) {
+        c ^= 0x20;
+      }
+    }
+    return str;
+  }
+}
+
+
+TEST_CASE(FoldsAsciiOnly) {
+  CHECK(CiEqualTo::CaseInsensitiveEqualTo(L"Readme.TXT", L"rEADME.txt"));
+  CHECK(!CiEqualTo::CaseSensitiveEqualTo(L"Readme.TXT", L"rEADME.txt"));
+  CHECK(!CiEqualTo::CaseInsensitiveEqualTo(L"abc", L"abcd"));
+  CHECK(!CiEqualTo::CaseInsensitiveEqualTo(L"@", L"`"));
+  CHECK(!CiEqualTo::CaseInsensitiveEqualTo(L"[", L"{"));
+  CHECK(!CiEqualTo::CaseInsensitiveEqualTo(L"Ä", L"ä"));
+  CHECK(!CiEqualTo::CaseInsensitiveEqualTo(L"k", L"K"));
+  CHECK(!CiEqualTo::CaseInsensitiveEqualTo(L"Ａ", L"ａ"));
+  // longer than one block, differing only in the tail
+  CHECK(CiEqualTo::CaseInsensitiveEqualTo(L"0123456789abcdefXYZ", L"0123456789ABCDEFxyz"));
+  CHECK(!CiEqualTo::CaseInsensitiveEqualTo(L"0123456789abcdefXYZ", L"0123456789ABCDEFxyÄ"));
+}
+
+
+TEST_CASE(CiContainers) {
+  std::unordered_set<std::wstring, CiHash, CiEqualTo> set(0, CiHash(false), CiEqualTo(false));
+  set.emplace(L"Folder\\File.txt");
+  CHECK(set.count(L"FOLDER\\file.TXT") == 1);
+  CHECK(set.count(L"FÖLDER\\file.TXT") == 0);
+
+  std::unordered_set<std::wstring, CiHash, CiEqualTo> sensitiveSet(0, CiHash(true), CiEqualTo(true));
+  sensitiveSet.emplace(L"Folder\\File.txt");
+  CHECK(sensitiveSet.count(L"FOLDER\\file.TXT") == 0);
+  CHECK(sensitiveSet.count(L"Folder\\File.txt") == 1);
+}
+
+
+// CiEqualTo, CiHash, FilenameToKey and literal Wildcard::Match must agree on which names are the same
+TEST_CASE(FuzzAgainstReference) {
+  std::mt19937 engine(12);
+  for (int iteration = 0; iteration < 200000; iteration++) {
+    const auto a = RandomString(engine, 40);
+    const auto b = iteration % 2 == 0 ? ShuffleCase(engine, a) : RandomString(engine, 3);
+
+    const bool expected = ReferenceEqualTo(a, b);
+    CHECK_MESSAGE(CiEqualTo::CaseInsensitiveEqualTo(a, b) == expected, "EqualTo differs from the reference at iteration " << iteration);
+    CHECK_MESSAGE(CiEqualTo::CaseSensitiveEqualTo(a, b) == (a == b), "case-sensitive EqualTo differs at iteration " << iteration);
+    CHECK_MESSAGE((FilenameToKey(a, false) == FilenameToKey(b, false)) == expected, "FilenameToKey differs at iteration " << iteration);
+    if (!Wildcard::HasWildcard(a)) {
+      CHECK_MESSAGE(Wildcard::Match(a, b, false) == (a.empty() || expected), "Wildcard::Match differs at iteration " << iteration);
+    }
+    if (expected) {
+      CHECK_MESSAGE(CiHash::CaseInsensitiveHash(a) == CiHash::CaseInsensitiveHash(b), "hash differs for equal strings at iteration " << iteration);
+    }
+    if (a == b) {
+      CHECK(CiHash::CaseSensitiveHash(a) == CiHash::CaseSensitiveHash(b));
+    }
+  }
+}
@@ -0,0 +1,179 @@
+#include "Test.hpp"
+
+#include "../../SDK/Wildcard.hpp"
+
+#include <cstddef>
+#include <random>
+#include <string>
+#include <string_view>
+
+using namespace std::literals;
+
+
+
+namespace {
+  wchar_t FoldCase(wchar_t c) {
+    return L'A' <= c && c <= L'Z' ? c - L'A' + L'a' : c;
+  }
+
+
+  // straightforward backtracking matcher used as the reference
+  bool ReferenceMatch(std::wstring_view pattern, std::wstring_view name, std::size_t namePos, std::size_t lastPeriodPos, bool caseSensitive) {
+    if (pattern.empty()) {
+      return namePos == name.size();
+    }
+
+    const bool end = namePos == name.size();
+    const wchar_t c = end ? L'\0' : name[namePos];
+    const auto rest = pattern.substr(1);
+
+    switch (pattern[0]) {
+      case L'*':
+        for (std::size_t i = namePos; i <= name.size(); i++) {
+          if (ReferenceMatch(rest, name, i, lastPeriodPos, caseSensitive)) {
+            return true;
+          }
+        }
+        return false;
+
+      case Wildcard::DosStar:
+        for (std::size_t i = namePos; i <= name.size(); i++) {
+          if (ReferenceMatch(rest, name, i, lastPeriodPos, caseSensitive)) {
+            return true;
+          }
+          if (i == name.size() || (name[i] == L'.' && i == lastPeriodPos)) {
+            break;
+          }
+        }
+        return false;
+
+      case L'?':
+        return !end && ReferenceMatch(rest, name, namePos + 1, lastPeriodPos, caseSensitive);
+
+      case Wildcard::DosQm:
+        if ((end || c == L'.') && ReferenceMatch(rest, name, namePos, lastPeriodPos, caseSensitive)) {
+          return true;
+        }
+        return !end && c != L'.' && ReferenceMatch(rest, name, namePos + 1, lastPeriodPos, caseSensitive);
+
+      case Wildcard::DosDot:
+        if (end) {
+          return ReferenceMatch(rest, name, namePos, lastPeriodPos, caseSensitive);
+        }
+        return c == L'.' && ReferenceMatch(rest, name, namePos + 1, lastPeriodPos, caseSensitive);
+
+      default:
+        if (end || (caseSensitive ? pattern[0] != c : FoldCase(pattern[0]) != FoldCase(c))) {
+          return false;
+        }
+        return ReferenceMatch(rest, name, namePos + 1, lastPeriodPos, caseSensitive);
+    }
+  }
+
+
+  bool ReferenceMatch(std::wstring_view pattern, std::wstring_view name, bool caseSensitive) {
+    if (pattern.empty()) {
+      return true;
+    }
+    return ReferenceMatch(pattern, name, 0, name.find_last_of(L'.'), caseSensitive);
+  }
+}
+
+
+TEST_CASE(MatchAllPatterns) {
+  CHECK(Wildcard::IsMatchAllPattern(L""));
+  CHECK(Wildcard::IsMatchAllPattern(L"*"));
+  CHECK(!Wildcard::IsMatchAllPattern(L"**"));
+  CHECK(!Wildcard::IsMatchAllPattern(L"<"));
+  CHECK(Wildcard::Match(L"*", L"", false));
+  CHECK(Wildcard::Match(L"", L"anything", false));
+}
+
+
+TEST_CASE(HasWildcard) {
+  CHECK(!Wildcard::HasWildcard(L"plain.txt"));
+  for (const auto pattern : {L"*", L"?", L"<", L">", L"\""}) {
+    CHECK(Wildcard::HasWildcard(pattern));
+  }
+}
+
+
+TEST_CASE(LiteralPatterns) {
+  CHECK(Wildcard::Match(L"Readme.TXT", L"readme.txt", false));
+  CHECK(!Wildcard::Match(L"Readme.TXT", L"readme.txt", true));
+  CHECK(Wildcard::Match(L"readme.txt", L"readme.txt", true));
+  CHECK(!Wildcard::Match(L"readme.txt", L"readme.txt2", false));
+  // only ASCII is folded, consistently with FilenameToKey
+  CHECK(!Wildcard::Match(L"Ä", L"ä", false));
+}
+
+
+TEST_CASE(Wildcards) {
+  CHECK(Wildcard::Match(L"*.txt", L"a.txt", false));
+  CHECK(Wildcard::Match(L"*.txt", L".txt", false));
+  CHECK(!Wildcard::Match(L"*.txt", L"a.txt.bak", false));
+  CHECK(Wildcard::Match(L"a*b*c", L"aXXbYYc", false));
+  CHECK(!Wildcard::Match(L"a*b*c", L"aXXbYY", false));
+  CHECK(Wildcard::Match(L"???", L"abc", false));
+  CHECK(!Wildcard::Match(L"???", L"ab", false));
+  CHECK(!Wildcard::Match(L"???", L"abcd", false));
+}
+
+
+// DOS wildcards as produced by the kernel from Win32 patterns
+TEST_CASE(DosWildcards) {
+  // "*.txt" -> "<.txt"
+  CHECK(Wildcard::Match(L"<.txt", L"a.txt", false));
+  CHECK(Wildcard::Match(L"<.txt", L"a.b.txt", false));
+  CHECK(!Wildcard::Match(L"<.txt", L"a.txt.bak", false));
+
+  // "*.*" -> "<\"*" also matches names without a period
+  CHECK(Wildcard::Match(L"<\"*", L"abc", false));
+  CHECK(Wildcard::Match(L"<\"*", L"abc.def", false));
+  CHECK(Wildcard::Match(L"<\"*", L"a.b.c", false));
+
+  // "????????.???" -> ">>>>>>>>\">>>"
+  CHECK(Wildcard::Match(L">>>>>>>>\">>>", L"abc.txt", false));
+  CHECK(Wildcard::Match(L">>>>>>>>\">>>", L"abcdefgh.txt", false));
+  CHECK(Wildcard::Match(L">>>>>>>>\">>>", L"abc", false));
+  CHECK(!Wildcard::Match(L">>>>>>>>\">>>", L"abcdefghi.txt", false));
+  CHECK(!Wildcard::Match(L">>>>>>>>\">>>", L"abc.text", false));
+
+  // '<' cannot consume the final period, but may consume earlier ones
+  CHECK(Wildcard::Match(L"<", L"ab", false));
+  CHECK(!Wildcard::Match(L"<", L"a.b", false));
+  CHECK(Wildcard::Match(L"<.c", L"a.b.c", false));
+  CHECK(!Wildcard::Match(L"<b", L"a.b", false));
+  CHECK(Wildcard::Match(L"<.b", L"a.b", false));
+}
+
+
+// long runs of stars must not blow up (the matcher does not backtrack)
+TEST_CASE(PathologicalPattern) {
+  const std::wstring pattern = L"*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*b";
+  const std::wstring name(200, L'a');
+  CHECK(!Wildcard::Match(pattern, name, false));
+  CHECK(Wildcard::Match(pattern, name + L"b", false));
+}
+
+
+TEST_CASE(RandomAgainstReference) {
+  std::mt19937 engine(7);
+  const std::wstring patternAlphabet = L"aAb.*?<>\"";
+  const std::wstring nameAlphabet = L"aAbB.";
+
+  const auto randomString = [&engine](const std::wstring& alphabet, std::size_t maxLength) {
+    std::wstring str(std::uniform_int_distribution<std::size_t>(0, maxLength)(engine), L'\0');
+    for (auto& c : str) {
+      c = alphabet[std::uniform_int_distribution<std::size_t>(0, alphabet.size() - 1)(engine)];
+    }
+    return str;
+  };
+
+  for (int iteration = 0; iteration < 200000; iteration++) {
+    const auto pattern = randomString(patternAlphabet, 7);
+    const auto name = randomString(nameAlphabet, 8);
+    const bool caseSensitive = iteration % 2 != 0;
+    CHECK_MESSAGE(Wildcard::Match(pattern, name, caseSensitive) == ReferenceMatch(pattern, name, caseSensitive), "differs from the reference at iteration " << iteration);
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// minimal test harness
+// each test executable consists of one or more test files defining TEST_CASEs and TestMain.cpp which runs them
+namespace test {
+  struct TestCase {
+    const char* name;
+    void(*function)();
+  };
+
+
+  class Failure : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+
+  std::vector<TestCase>& GetTestCases();
+
+
+  struct Registrar {
+    Registrar(const char* name, void(*function)()) {
+      GetTestCases().push_back({name, function});
+    }
+  };
+
+
+  [[noreturn]] inline void Fail(const char* file, int line, const std::string& message) {
+    std::ostringstream oss;
+    oss << file << ":" << line << ": " << message;
+    throw Failure(oss.str());
+  }
+}
+
+
+#define TEST_CASE(name) \
+  static void name(); \
+  static const ::test::Registrar name##Registrar(#name, name); \
+  static void name()
+
+#define CHECK(expr) \
+  do { \
+    if (!(expr)) { \
+      ::test::Fail(__FILE__, __LINE__, "CHECK(" #expr ") failed"); \
+    } \
+  } while (false)
+
+#define CHECK_MESSAGE(expr, message) \
+  do { \
+    if (!(expr)) { \
+      std::ostringstream testMessageStream_; \
+      testMessageStream_ << "CHECK(" #expr ") failed: " << message; \
+      ::test::Fail(__FILE__, __LINE__, testMessageStream_.str()); \
+    } \
+  } while (false)
+
+#define CHECK_THROWS(expr, ExceptionType) \
+  do { \
+    bool testThrown_ = false; \
+    try { \
+      (void)(expr); \
+    } catch (const ExceptionType&) { \
+      testThrown_ = true; \
+    } \
+    if (!testThrown_) { \
+      ::test::Fail(__FILE__, __LINE__, "CHECK_THROWS(" #expr ", " #ExceptionType ") failed"); \
+    } \
+  } while (false)
@@ -0,0 +1,44 @@
+#include "Test.hpp"
+
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <vector>
+
+
+
+namespace test {
+  std::vector<TestCase>& GetTestCases() {
+    static std::vector<TestCase> testCases;
+    return testCases;
+  }
+}
+
+
+// usage: <test> [name-substring]
+int main(int argc, char* argv[]) {
+  const char* filter = argc >= 2 ? argv[1] : nullptr;
+
+  std::size_t passed = 0;
+  std::size_t failed = 0;
+  for (const auto& testCase : test::GetTestCases()) {
+    if (filter && !std::strstr(testCase.name, filter)) {
+      continue;
+    }
+    try {
+      testCase.function();
+      std::cout << "[PASS] " << testCase.name << std::endl;
+      passed++;
+    } catch (const std::exception& exception) {
+      std::cout << "[FAIL] " << testCase.name << ": " << exception.what() << std::endl;
+      failed++;
+    } catch (...) {
+      std::cout << "[FAIL] " << testCase.name << ": unknown exception" << std::endl;
+      failed++;
+    }
+  }
+
+  std::cout << passed << " passed, " << failed << " failed" << std::endl;
+
+  return failed == 0 && passed != 0 ? 0 : 1;
+}